@@ -21,19 +21,26 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "q2proto_client.h"
 #include "q2proto_connect.h"
+#include "q2proto_context_stats.h"
 #include "q2proto_coords.h"
 #include "q2proto_defs.h"
+#include "q2proto_delta_cache.h"
+#include "q2proto_download_scheduler.h"
 #include "q2proto_error.h"
+#include "q2proto_frame_writer.h"
 #include "q2proto_game_api.h"
 #include "q2proto_io.h"
 #include "q2proto_packing.h"
 #include "q2proto_protocol.h"
 #include "q2proto_server.h"
+#include "q2proto_server_pool.h"
+#include "q2proto_snapshot.h"
 #include "q2proto_solid.h"
 #include "q2proto_sound.h"
 #include "q2proto_string.h"
 #include "q2proto_struct_clc.h"
 #include "q2proto_struct_svc.h"
+#include "q2proto_trace.h"
 #include "q2proto_valenc.h"
 
 #endif // Q2PROTO_H_
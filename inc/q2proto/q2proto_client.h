@@ -23,6 +23,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define Q2PROTO_CLIENT_H_
 
 #include "q2proto_connect.h"
+#include "q2proto_context_stats.h"
 #include "q2proto_coords.h"
 #include "q2proto_defs.h"
 #include "q2proto_entity_bits.h"
@@ -110,6 +111,14 @@ struct q2proto_clientcontext_s {
         q2proto_game_api_t server_game_api;
     } features;
 
+    /// Identifier of the context in trace records (see q2proto_trace.h). Cleared on setup.
+    uint32_t trace_id;
+
+#if Q2PROTO_CONTEXT_STATS
+    /// Message statistics, see q2proto_client_get_stats()
+    q2proto_context_stats_t Q2PROTO_PRIVATE_API_MEMBER(stats);
+#endif
+
     /// Server protocol number
     q2proto_protocol_t Q2PROTO_PRIVATE_API_MEMBER(server_protocol);
     /// Protocol version (for R1Q2/Q2PRO)
@@ -181,6 +190,15 @@ Q2PROTO_PUBLIC_API q2proto_error_t q2proto_client_download_reset(q2proto_clientc
 Q2PROTO_PUBLIC_API q2proto_error_t q2proto_client_write(q2proto_clientcontext_t *context, uintptr_t io_arg,
                                                         const q2proto_clc_message_t *clc_message);
 
+/**
+ * Get message statistics of a client context.
+ * \param context Client communications context.
+ * \param stats Receives the statistics.
+ * \returns Error code. Returns \c Q2P_ERR_NOT_IMPLEMENTED if q2proto was built without #Q2PROTO_CONTEXT_STATS.
+ */
+Q2PROTO_PUBLIC_API q2proto_error_t q2proto_client_get_stats(const q2proto_clientcontext_t *context,
+                                                            q2proto_context_stats_t *stats);
+
 /**
  * Pack a bounding box into a q2proto_entity_state_delta_t::solid value
  * \param context Client context for solid packing
@@ -201,6 +219,54 @@ Q2PROTO_PUBLIC_API void q2proto_client_unpack_solid(q2proto_clientcontext_t *con
                                                     q2proto_vec3_t mins, q2proto_vec3_t maxs);
 /** @} */
 
+/**\name Saved client state
+ * The state a client context has accumulated from server messages can be saved and restored later, allowing
+ * reading to resume from a given point without reading all the preceding data again. This is intended for
+ * random access in demos: a demo player can save the state at regular intervals and restore the state nearest
+ * to a seek target.
+ *
+ * State can only be saved between packets, after \c svc_serverdata was read.
+ * @{ */
+/**
+ * Saved client context state.
+ * Consists of fixed-size integer fields only, so it can be stored as-is, e.g. in an index file,
+ * and restored on a machine with the same byte order.
+ */
+typedef struct q2proto_client_saved_state_s {
+    /// Server protocol (a q2proto_protocol_t value)
+    uint32_t Q2PROTO_PRIVATE_API_MEMBER(server_protocol);
+    /// Protocol version
+    int32_t Q2PROTO_PRIVATE_API_MEMBER(protocol_version);
+    /// Type of game run by the server (a q2proto_game_api_t value)
+    uint32_t Q2PROTO_PRIVATE_API_MEMBER(server_game_api);
+    /// Protocol & connection feature flags
+    uint32_t Q2PROTO_PRIVATE_API_MEMBER(feature_flags);
+    /// For Q2P_PROTOCOL_KEX_DEMOS. Bits indicating whether a baseline entity has a solid value != 0
+    q2proto_entity_bits Q2PROTO_PRIVATE_API_MEMBER(kex_demo_baseline_nonzero_solid);
+    /// For Q2P_PROTOCOL_KEX_DEMOS. Bits indicating whether an entity was previously seen to have a solid value != 0
+    q2proto_entity_bits Q2PROTO_PRIVATE_API_MEMBER(kex_demo_edict_nonzero_solid);
+} q2proto_client_saved_state_t;
+
+/**
+ * Save the state of a client context.
+ * \param context Client communications context.
+ * \param state Receives the saved state.
+ * \returns Error code. Returns \c Q2P_ERR_INVALID_ARGUMENT if no \c svc_serverdata was read yet or if the context
+ *   is in the middle of reading a packet.
+ */
+Q2PROTO_PUBLIC_API q2proto_error_t q2proto_client_save_state(const q2proto_clientcontext_t *context,
+                                                             q2proto_client_saved_state_t *state);
+/**
+ * Set up a client context from a saved state.
+ * The context is initialized from scratch; any previous contents are discarded.
+ * \param context Client communications context.
+ * \param state Saved state, as returned by q2proto_client_save_state().
+ * \returns Error code
+ */
+Q2PROTO_PUBLIC_API q2proto_error_t q2proto_client_restore_state(q2proto_clientcontext_t *context,
+                                                                const q2proto_client_saved_state_t *state);
+/** @} */
+
 #if defined(__cplusplus)
 } // extern "C"
 #endif
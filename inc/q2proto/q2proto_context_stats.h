@@ -0,0 +1,108 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/**\file
+ * Per-context message statistics
+ */
+#ifndef Q2PROTO_CONTEXT_STATS_H_
+#define Q2PROTO_CONTEXT_STATS_H_
+
+#include "q2proto_defs.h"
+#include "q2proto_error.h"
+#include "q2proto_struct_clc.h"
+#include "q2proto_struct_svc.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/**\name Context statistics
+ * If built with #Q2PROTO_CONTEXT_STATS, server and client contexts count the messages they write and read,
+ * obtainable with q2proto_server_get_stats() and q2proto_client_get_stats().
+ *
+ * Messages are counted by q2proto_server_write(), q2proto_server_read(), q2proto_client_read() and
+ * q2proto_client_write(). Byte counts are differences of q2protoio_trace_position() before and after
+ * the call. As with trace records, messages read from compressed data are accounted for as a whole,
+ * in the message that caused the compressed data to be read.
+ *
+ * Counters are cleared when the context is set up and only ever increase afterwards.
+ * @{ */
+/// Number of server message types (q2proto_svc_message_type_t values)
+#define Q2PROTO_CONTEXT_STATS_NUM_SVC_TYPES (Q2P_SVC_LOCPRINT + 1)
+/// Number of client message types (q2proto_clc_message_type_t values)
+#define Q2PROTO_CONTEXT_STATS_NUM_CLC_TYPES (Q2P_CLC_USERINFO_DELTA + 1)
+/// Number of error counters, see q2proto_context_stats_error_index()
+#define Q2PROTO_CONTEXT_STATS_NUM_ERRORS    20
+/// Error counter for error codes without a counter of their own
+#define Q2PROTO_CONTEXT_STATS_ERROR_OTHER   (Q2PROTO_CONTEXT_STATS_NUM_ERRORS - 1)
+
+/// Counters for one message type
+typedef struct q2proto_message_stats_s {
+    /// Number of messages
+    uint64_t count;
+    /// Total size of messages, in bytes
+    uint64_t bytes;
+} q2proto_message_stats_t;
+
+/// Context statistics
+typedef struct q2proto_context_stats_s {
+    /// Server messages, by type. Written messages for a server context, read messages for a client context.
+    q2proto_message_stats_t svc[Q2PROTO_CONTEXT_STATS_NUM_SVC_TYPES];
+    /// Client messages, by type. Read messages for a server context, written messages for a client context.
+    q2proto_message_stats_t clc[Q2PROTO_CONTEXT_STATS_NUM_CLC_TYPES];
+    /// Number of Q2P_SVC_FRAME_ENTITY_DELTA messages updating an entity
+    uint64_t entity_deltas;
+    /// Number of Q2P_SVC_FRAME_ENTITY_DELTA messages removing an entity
+    uint64_t entity_removals;
+    /// Bytes written by q2proto_server_write_gamestate(), over all calls
+    uint64_t gamestate_bytes;
+    /// Number of zpackets written or read
+    uint64_t zpackets;
+    /// Size of zpackets, including the zpacket header
+    uint64_t zpacket_compressed_bytes;
+    /// Size of the data in zpackets, after decompression
+    uint64_t zpacket_uncompressed_bytes;
+    /**
+     * Number of calls failing, by error code; indexed by q2proto_context_stats_error_index().
+     * Q2P_ERR_NO_MORE_INPUT is not counted, as it's the normal end of reading.
+     * For q2proto_server_write_zpacket() and q2proto_server_write_gamestate(), only negative error codes
+     * are counted, as positive codes are part of normal operation.
+     */
+    uint64_t errors[Q2PROTO_CONTEXT_STATS_NUM_ERRORS];
+} q2proto_context_stats_t;
+
+/**
+ * Return the index in q2proto_context_stats_t::errors counting the given error code.
+ * \returns Counter index. #Q2PROTO_CONTEXT_STATS_ERROR_OTHER for unknown error codes.
+ */
+Q2PROTO_PUBLIC_API size_t q2proto_context_stats_error_index(q2proto_error_t err);
+/**
+ * Return the error code counted by the given index in q2proto_context_stats_t::errors.
+ * \returns Error code. \c Q2P_ERR_SUCCESS for #Q2PROTO_CONTEXT_STATS_ERROR_OTHER and out-of-range indices.
+ */
+Q2PROTO_PUBLIC_API q2proto_error_t q2proto_context_stats_error_code(size_t index);
+/** @} */
+
+#if defined(__cplusplus)
+} // extern "C"
+#endif
+
+#endif // Q2PROTO_CONTEXT_STATS_H_
@@ -57,6 +57,10 @@ with this program; if not, write to the Free Software Foundation, Inc.,
  *   can be used. (Useful for implementing \c q2protoio_write_available().)
  * - Call \c q2proto_deflate_impl_helper_destroy() for cleanup.
  *
+ * A helper struct holds the state of one deflate stream, so it must only be used by one thread at a time.
+ * To encode for multiple clients concurrently, give each thread its own \c q2protoio_deflate_args_t
+ * (and thus its own helper struct and output buffer).
+ *
  * @{
  */
 
@@ -130,6 +130,22 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #if !defined(Q2PROTO_SHOWNET)
     #define Q2PROTO_SHOWNET 0
 #endif
+/**\def Q2PROTO_TRACE
+ * If defined to 1, emits binary trace records for messages read and written, see q2proto_trace.h.
+ * Requires an externally defined q2protoio_trace_position() function.
+ * Defaults to 0.
+ */
+#if !defined(Q2PROTO_TRACE)
+    #define Q2PROTO_TRACE 0
+#endif
+/**\def Q2PROTO_CONTEXT_STATS
+ * If defined to 1, server and client contexts count messages read and written, see q2proto_context_stats.h.
+ * Requires an externally defined q2protoio_trace_position() function.
+ * Defaults to 0.
+ */
+#if !defined(Q2PROTO_CONTEXT_STATS)
+    #define Q2PROTO_CONTEXT_STATS 0
+#endif
 /**\def Q2PROTO_EXTERNALLY_PROVIDED_DECL
  * Declaration for "externally provided" functions.
  * Can be used to eg make these functions \c static, when wrapping everything into a single source.
@@ -160,6 +176,14 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #if !defined(Q2PROTO_COMPRESSION_DEFLATE)
     #define Q2PROTO_COMPRESSION_DEFLATE 0
 #endif
+/**\def Q2PROTO_WRITE_RAW_SEGMENT
+ * If defined to 1, download data is handed to the I/O layer as a reference via \c q2protoio_write_raw_segment,
+ * instead of being copied into the output buffer, which requires provision of that function.
+ * Defaults to 0.
+ */
+#if !defined(Q2PROTO_WRITE_RAW_SEGMENT)
+    #define Q2PROTO_WRITE_RAW_SEGMENT 0
+#endif
 /** @} */
 
 /* Macros to provide "hidden" struct members.
@@ -0,0 +1,153 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/**\file
+ * Cache for encoded entity deltas, shared between clients
+ */
+#ifndef Q2PROTO_DELTA_CACHE_H_
+#define Q2PROTO_DELTA_CACHE_H_
+
+#include "q2proto_defs.h"
+#include "q2proto_error.h"
+#include "q2proto_packing.h"
+#include "q2proto_server.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/**\name Entity delta cache
+ * Clients using the same protocol typically see the same entities, delta'd from the same frame, so
+ * the encoded entity deltas are often byte-identical between clients. The entity delta cache stores
+ * encoded deltas, keyed by protocol, entity number and the contents of the "from" and "to" states,
+ * so subsequent clients just receive a copy of the cached bytes.
+ *
+ * All memory is provided by the caller. The cache is meant to be reset each server frame with
+ * q2proto_delta_cache_reset(); resetting is cheap, independent of the cache size.
+ *
+ * The cache is not synchronized. Every lookup modifies it, hit or miss, so when encoding frames for clients on
+ * multiple threads, either use one cache per thread or serialize all calls taking the cache.
+ * @{ */
+/// Entity delta cache slot. Contents are private.
+typedef struct q2proto_delta_cache_entry_s {
+    /// Hash of from & to states
+    uint64_t Q2PROTO_PRIVATE_API_MEMBER(states_hash);
+    /// Server info of encoding context
+    const q2proto_server_info_t *Q2PROTO_PRIVATE_API_MEMBER(server_info);
+    /// Protocol of encoding context
+    q2proto_protocol_t Q2PROTO_PRIVATE_API_MEMBER(protocol);
+    /// Protocol version of encoding context
+    int Q2PROTO_PRIVATE_API_MEMBER(protocol_version);
+    /// Generation the slot was filled in. Slot is unused if it doesn't match cache generation.
+    uint32_t Q2PROTO_PRIVATE_API_MEMBER(generation);
+    /// Offset of encoded delta in storage
+    uint32_t Q2PROTO_PRIVATE_API_MEMBER(offset);
+    /// Size of encoded delta
+    uint16_t Q2PROTO_PRIVATE_API_MEMBER(size);
+    /// Entity number
+    uint16_t Q2PROTO_PRIVATE_API_MEMBER(entnum);
+    /// Whether the "old origin" was written
+    bool Q2PROTO_PRIVATE_API_MEMBER(write_old_origin);
+} q2proto_delta_cache_entry_t;
+
+/// Entity delta cache statistics
+typedef struct q2proto_delta_cache_stats_s {
+    /// Number of deltas served from the cache
+    uint32_t hits;
+    /// Number of deltas that had to be encoded
+    uint32_t misses;
+    /// Number of deltas that could not be stored, due to lack of slots or storage
+    uint32_t store_failures;
+    /// Number of deltas not eligible for caching (protocol is stateful)
+    uint32_t bypassed;
+    /// Number of encoded bytes served from the cache
+    uint64_t bytes_saved;
+} q2proto_delta_cache_stats_t;
+
+/// Entity delta cache
+typedef struct q2proto_delta_cache_s {
+    /// Statistics. Accumulated until explicitly cleared.
+    q2proto_delta_cache_stats_t stats;
+
+    /// Cache slots
+    q2proto_delta_cache_entry_t *Q2PROTO_PRIVATE_API_MEMBER(entries);
+    /// Number of cache slots
+    size_t Q2PROTO_PRIVATE_API_MEMBER(num_entries);
+    /// Storage for encoded deltas
+    uint8_t *Q2PROTO_PRIVATE_API_MEMBER(storage);
+    /// Size of encoded delta storage
+    size_t Q2PROTO_PRIVATE_API_MEMBER(storage_size);
+    /// Used encoded delta storage
+    size_t Q2PROTO_PRIVATE_API_MEMBER(storage_used);
+    /// Current generation
+    uint32_t Q2PROTO_PRIVATE_API_MEMBER(generation);
+} q2proto_delta_cache_t;
+
+/**
+ * Initialize an entity delta cache.
+ * \param cache Cache to initialize.
+ * \param entries Cache slots. Each slot holds one encoded delta.
+ * \param num_entries Number of cache slots. Should be generously larger than the expected number of distinct
+ *   deltas per frame, as performance degrades when the slots fill up.
+ * \param storage Storage for encoded deltas.
+ * \param storage_size Size of storage for encoded deltas.
+ */
+Q2PROTO_PUBLIC_API void q2proto_delta_cache_init(q2proto_delta_cache_t *cache, q2proto_delta_cache_entry_t *entries,
+                                                 size_t num_entries, void *storage, size_t storage_size);
+/**
+ * Discard all cached deltas. Statistics are kept.
+ * Should be called every server frame, before writing frames for clients.
+ * \param cache Entity delta cache.
+ */
+Q2PROTO_PUBLIC_API void q2proto_delta_cache_reset(q2proto_delta_cache_t *cache);
+/**
+ * Reset statistics of an entity delta cache.
+ * \param cache Entity delta cache.
+ */
+Q2PROTO_PUBLIC_API void q2proto_delta_cache_clear_stats(q2proto_delta_cache_t *cache);
+/**
+ * Write an entity delta message, using a cached encoding if available.
+ * Equivalent to filling the entity delta with q2proto_server_make_entity_state_delta() and writing a
+ * Q2P_SVC_FRAME_ENTITY_DELTA message with q2proto_server_write().
+ * To capture the encoded delta, the position of the written bytes is determined using
+ * q2protoio_write_reserve_raw() with a size of 0, so \a io_arg must write to contiguous memory.
+ * \param cache Entity delta cache. If \c NULL, the delta is just written.
+ * \param context Server communications context.
+ * \param io_arg "I/O argument", passed to externally provided I/O functions.
+ * \param entnum Entity number.
+ * \param from The "from", or "old", packed entity state. Can be \c NULL.
+ * \param to The "to", or "new", packed entity state.
+ * \param write_old_origin Whether to always write the "old origin".
+ * \returns Error code
+ */
+Q2PROTO_PUBLIC_API q2proto_error_t q2proto_server_write_entity_delta_cached(q2proto_delta_cache_t *cache,
+                                                                            q2proto_servercontext_t *context,
+                                                                            uintptr_t io_arg, uint16_t entnum,
+                                                                            const q2proto_packed_entity_state_t *from,
+                                                                            const q2proto_packed_entity_state_t *to,
+                                                                            bool write_old_origin);
+/** @} */
+
+#if defined(__cplusplus)
+} // extern "C"
+#endif
+
+#endif // Q2PROTO_DELTA_CACHE_H_
@@ -0,0 +1,128 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/**\file
+ * Download scheduling across multiple clients
+ */
+#ifndef Q2PROTO_DOWNLOAD_SCHEDULER_H_
+#define Q2PROTO_DOWNLOAD_SCHEDULER_H_
+
+#include "q2proto_defs.h"
+#include "q2proto_error.h"
+#include "q2proto_server.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/**\name Download scheduler
+ * Distributes a global per-frame download budget fairly between clients, using deficit round robin.
+ *
+ * Each frame, every client with an ongoing download is granted a "quantum" of bytes. A client sends as much of
+ * its accumulated allowance as the remaining frame budget and its own packet space
+ * (per q2protoio_write_available()) permit; unused allowance is carried over to the next frame, so clients
+ * limited by packet space catch up later instead of being starved.
+ *
+ * q2proto_download_scheduler_run_frame() writes to the download states and I/O arguments of all clients, so
+ * no other thread may use those while it runs.
+ * @{ */
+/// Per-client download scheduling state
+typedef struct q2proto_download_sched_client_s {
+    /// Download state. Client does not take part in scheduling if \c NULL.
+    q2proto_server_download_state_t *download;
+    /// "I/O argument" used to write download messages for this client
+    uintptr_t io_arg;
+    /// Remaining data to download. Updated as data is sent.
+    const uint8_t *data;
+    /// Size of remaining data to download. Updated as data is sent.
+    size_t remaining;
+
+    /// Set once the last download message has been written.
+    bool complete;
+    /// Error that occured while writing download messages. Client is not scheduled any more if set.
+    q2proto_error_t error;
+
+    /// Total number of download payload bytes sent
+    uint64_t bytes_sent;
+    /// Total number of download messages sent
+    uint32_t messages_sent;
+    /// Download payload bytes sent in last frame
+    uint32_t frame_bytes;
+    /// Number of frames in which the client could not send anything, due to lack of budget or packet space
+    uint32_t frames_stalled;
+
+    /// Accumulated, but unused, byte allowance
+    size_t Q2PROTO_PRIVATE_API_MEMBER(deficit);
+} q2proto_download_sched_client_t;
+
+/// Download scheduler
+typedef struct q2proto_download_scheduler_s {
+    /// Total number of bytes for download messages, per frame, across all clients
+    size_t frame_budget;
+    /**
+     * Number of bytes granted to each client per frame.
+     * If 0, the frame budget is evenly divided between all downloading clients.
+     */
+    size_t quantum;
+
+    /// Client to start with in next frame
+    size_t Q2PROTO_PRIVATE_API_MEMBER(next_client);
+} q2proto_download_scheduler_t;
+
+/**
+ * Initialize a download scheduler.
+ * \param scheduler Scheduler to initialize.
+ * \param frame_budget Total number of bytes for download messages, per frame, across all clients.
+ */
+Q2PROTO_PUBLIC_API void q2proto_download_scheduler_init(q2proto_download_scheduler_t *scheduler,
+                                                        size_t frame_budget);
+/**
+ * Initialize a client for download scheduling.
+ * \param client Client scheduling state.
+ * \param download Download state. Must have been set up with q2proto_server_download_begin().
+ * \param io_arg "I/O argument" used to write download messages for this client.
+ * \param data Data to download.
+ * \param size Size of data to download.
+ */
+Q2PROTO_PUBLIC_API void q2proto_download_sched_client_init(q2proto_download_sched_client_t *client,
+                                                           q2proto_server_download_state_t *download,
+                                                           uintptr_t io_arg, const void *data, size_t size);
+/**
+ * Write download messages for a frame.
+ * Messages are written to the clients' "I/O arguments"; the amount written for each client is limited by
+ * the scheduler frame budget, the client's share of it, and q2protoio_write_available().
+ * Clients which finished their download (\c complete is set) or encountered an error (\c error is set)
+ * are skipped.
+ * \param scheduler Download scheduler.
+ * \param clients Array of client scheduling states.
+ * \param num_clients Number of clients.
+ * \returns Error code. Errors for individual clients are reported in their scheduling state.
+ */
+Q2PROTO_PUBLIC_API q2proto_error_t q2proto_download_scheduler_run_frame(q2proto_download_scheduler_t *scheduler,
+                                                                        q2proto_download_sched_client_t *clients,
+                                                                        size_t num_clients);
+/** @} */
+
+#if defined(__cplusplus)
+} // extern "C"
+#endif
+
+#endif // Q2PROTO_DOWNLOAD_SCHEDULER_H_
@@ -0,0 +1,123 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/**\file
+ * Budget-aware writing of frame entity deltas
+ */
+#ifndef Q2PROTO_FRAME_WRITER_H_
+#define Q2PROTO_FRAME_WRITER_H_
+
+#include "q2proto_defs.h"
+#include "q2proto_delta_cache.h"
+#include "q2proto_error.h"
+#include "q2proto_packing.h"
+#include "q2proto_server.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/**\name Budget-aware frame writer
+ * Writes the entity deltas of a frame, limited to the space available in the packet.
+ *
+ * Writing entity deltas one by one with q2proto_server_write() fails with Q2P_ERR_NOT_ENOUGH_PACKET_SPACE
+ * at whatever entity happens to exceed the packet size. Instead, the frame writer determines the encoded size
+ * of all deltas upfront and picks the deltas with the highest priority that fit into the available space.
+ * The remaining deltas are "deferred": they are not written, and the server should treat them as not sent,
+ * ie record the "from" state for them in the frame it keeps for the client, so they are sent in a later frame.
+ * @{ */
+/// Entity delta to be written by the frame writer
+typedef struct q2proto_frame_entity_s {
+    /// Entity number
+    uint16_t entnum;
+    /// Whether to remove the entity.
+    bool remove;
+    /// Whether to always write the "old origin".
+    bool write_old_origin;
+    /**
+     * Priority of the delta. Deltas with higher priorities are written first.
+     * See q2proto_frame_entity_priority() for a way to compute a priority.
+     */
+    uint32_t priority;
+    /// The "from", or "old", packed entity state. Can be \c NULL.
+    const q2proto_packed_entity_state_t *from;
+    /// The "to", or "new", packed entity state. Ignored if \c remove is set.
+    const q2proto_packed_entity_state_t *to;
+
+    /// Set by q2proto_server_write_frame_entities() if the delta was not written.
+    bool deferred;
+
+    /// Encoded size of delta
+    uint32_t Q2PROTO_PRIVATE_API_MEMBER(size);
+} q2proto_frame_entity_t;
+
+/// Result of q2proto_server_write_frame_entities()
+typedef struct q2proto_frame_write_result_s {
+    /// Number of entity deltas written
+    uint32_t num_written;
+    /// Number of entity deltas deferred
+    uint32_t num_deferred;
+    /// Number of bytes written, including the terminating "end of entity deltas" marker
+    uint32_t bytes_written;
+} q2proto_frame_write_result_t;
+
+/**
+ * Compute an entity delta priority from common criteria.
+ * Player-relevant entities take precedence over everything else; among the remaining entities, recently
+ * changed entities come before entities that haven't changed for a while, with closer entities
+ * coming before farther ones.
+ * \param distance Distance of the entity to the client's view origin.
+ * \param frames_since_change Number of frames since the entity last changed.
+ * \param player_relevant Whether the entity is relevant to the client's player, such as the player's own
+ *   entity, its weapon effects or entities it interacts with.
+ * \returns Priority suitable for q2proto_frame_entity_t::priority.
+ */
+Q2PROTO_PUBLIC_API uint32_t q2proto_frame_entity_priority(float distance, uint32_t frames_since_change,
+                                                          bool player_relevant);
+
+/**
+ * Write entity deltas of a frame, as many as fit into the packet.
+ * Should be called after writing the Q2P_SVC_FRAME message. Writes the entity deltas that fit into the
+ * space reported by q2protoio_write_available(), followed by the "end of entity deltas" marker.
+ * Deltas are picked greedily by priority: higher priority deltas are considered first, and a delta that doesn't
+ * fit anymore is skipped in favour of smaller, lower priority ones.
+ * \param context Server communications context.
+ * \param io_arg "I/O argument", passed to externally provided I/O functions.
+ * \param cache Entity delta cache used for writing deltas. Can be \c NULL.
+ * \param entities Entity deltas. Must be sorted by entity number. The array is reordered while picking deltas,
+ *   but sorted by entity number again on return; \c deferred is set for deltas that were not written.
+ * \param num_entities Number of entity deltas.
+ * \param result Receives statistics about the written deltas. Can be \c NULL.
+ * \returns Error code. Returns Q2P_ERR_NOT_ENOUGH_PACKET_SPACE if not even the "end of entity deltas" marker fits.
+ */
+Q2PROTO_PUBLIC_API q2proto_error_t q2proto_server_write_frame_entities(q2proto_servercontext_t *context,
+                                                                       uintptr_t io_arg,
+                                                                       q2proto_delta_cache_t *cache,
+                                                                       q2proto_frame_entity_t *entities,
+                                                                       size_t num_entities,
+                                                                       q2proto_frame_write_result_t *result);
+/** @} */
+
+#if defined(__cplusplus)
+} // extern "C"
+#endif
+
+#endif // Q2PROTO_FRAME_WRITER_H_
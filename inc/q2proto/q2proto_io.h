@@ -18,6 +18,10 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 /**\file
  * Externally provided IO interface
+ *
+ * If server contexts are used from multiple threads, these functions are called concurrently, with a
+ * different \c io_arg (resp. \c deflate_args) per thread; they should keep all their state in the objects
+ * referenced by those arguments.
  */
 #ifndef Q2PROTO_IO_H_
 #define Q2PROTO_IO_H_
@@ -84,6 +88,16 @@ Q2PROTO_EXTERNALLY_PROVIDED_DECL void *q2protoio_write_reserve_raw(uintptr_t io_
  */
 Q2PROTO_EXTERNALLY_PROVIDED_DECL void q2protoio_write_raw(uintptr_t io_arg, const void *data, size_t size,
                                                           size_t *written);
+#if Q2PROTO_WRITE_RAW_SEGMENT
+/**
+ * Append a reference to \a size bytes at \a data to the output, instead of copying the data.
+ * The data stays valid until the output is sent, so it may be described as a separate segment
+ * of the packet (eg an \c iovec for \c sendmsg).
+ * Copying the data, as q2protoio_write_raw() does, is a valid implementation as well.
+ * Used for download data.
+ */
+Q2PROTO_EXTERNALLY_PROVIDED_DECL void q2protoio_write_raw_segment(uintptr_t io_arg, const void *data, size_t size);
+#endif
 
 /**
  * Return a (conservative) limit on how many bytes can still be written to the output buffer.
@@ -208,6 +222,15 @@ Q2PROTO_EXTERNALLY_PROVIDED_DECL bool q2protodbg_shownet_check(uintptr_t io_arg,
  */
 Q2PROTO_EXTERNALLY_PROVIDED_DECL void q2protodbg_shownet(uintptr_t io_arg, int level, int offset, const char *msg, ...);
 #endif
+
+#if Q2PROTO_TRACE || Q2PROTO_CONTEXT_STATS
+/**
+ * Return the current read or write position of \a io_arg, in bytes.
+ * Used for offsets and lengths in trace records, see q2proto_trace.h,
+ * and for byte counts in context statistics, see q2proto_context_stats.h.
+ */
+Q2PROTO_EXTERNALLY_PROVIDED_DECL size_t q2protoio_trace_position(uintptr_t io_arg);
+#endif
 /** @} */
 
 #if Q2PROTO_ERROR_FEEDBACK
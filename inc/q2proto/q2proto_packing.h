@@ -26,6 +26,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "q2proto_game_api.h"
 #include "q2proto_limits.h" // for Q2PROTO_STATS
 
+#include <stdbool.h>
+
 /// Packed representation of entity state. Use with only server context used for packing!
 typedef struct q2proto_packed_entity_state_s {
     uint16_t modelindex;
@@ -116,6 +118,62 @@ typedef struct q2proto_packed_player_state_s {
     void FUNCTION_NAME(q2proto_servercontext_t *context, const ENTITYSTATE_TYPE entity_state, \
                        q2proto_packed_entity_state_t *entity_packed)
 
+/**
+ * Packing input of an entity state, as seen by the last call to a "pack if changed" function.
+ * Initialize by zeroing; a zeroed cache is considered invalid and causes the next call to pack.
+ * Contents are only meant to be used by code generated by `q2proto_packing_entitystate_impl.inc`.
+ */
+typedef struct q2proto_entity_pack_cache_s {
+    /// Whether the cache contents are valid
+    bool valid;
+    /// Packing flavor used
+    uint8_t flavor;
+    /// Game API used
+    uint8_t game_api;
+    uint16_t modelindex;
+    uint16_t modelindex2;
+    uint16_t modelindex3;
+    uint16_t modelindex4;
+    uint16_t frame;
+    uint16_t sound;
+    uint8_t event;
+    uint32_t skinnum;
+    uint32_t renderfx;
+    uint32_t solid;
+    uint64_t effects;
+    /// Source vectors: integer components as-is, float components as bit patterns
+    int32_t origin[3];
+    int32_t angles[3];
+    int32_t old_origin[3];
+#if Q2PROTO_ENTITY_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_ENTITY_LOOP_ALPHA_SCALE_FX64
+    /// Float bit patterns
+    uint32_t loop_volume;
+    uint32_t loop_attenuation;
+    uint32_t alpha;
+    uint32_t scale;
+#endif
+} q2proto_entity_pack_cache_t;
+
+/**\def Q2PROTO_DECLARE_ENTITY_PACK_IF_CHANGED_FUNCTION
+ * Declare a function to pack an entity state, but only if the state changed since the last call.
+ *
+ * Most entities in a map are static. This function compares the packing input with a cached copy, and only
+ * if it changed repacks the entity. If nothing changed, the previously packed state can be reused; and, as it
+ * is unchanged, the entity delta can be skipped entirely. Function arguments:
+ * - \c context Server communications context.
+ * - \c entity_state Entity state to create a packed representation of.
+ * - \c cache Cached packing input. One per entity; initialize by zeroing.
+ * - \c entity_packed Receives the packed entity state representation. Left untouched if nothing changed,
+ *   so this should be the same storage used in the previous call for the entity.
+ * Returns \c true if the entity state was packed, \c false if it was unchanged.
+ *
+ * To define this function define #Q2P_PACK_ENTITY_IF_CHANGED_FUNCTION_NAME before including
+ * `q2proto_packing_entitystate_impl.inc`.
+ */
+#define Q2PROTO_DECLARE_ENTITY_PACK_IF_CHANGED_FUNCTION(FUNCTION_NAME, ENTITYSTATE_TYPE)        \
+    bool FUNCTION_NAME(q2proto_servercontext_t *context, const ENTITYSTATE_TYPE entity_state, \
+                       q2proto_entity_pack_cache_t *cache, q2proto_packed_entity_state_t *entity_packed)
+
 /**\def Q2PROTO_DECLARE_PLAYER_PACKING_FUNCTION
  * Declare a function to pack a player state in a protocol-dependent manner.
  * To define this function include `q2proto_packing_playerstate_impl.inc`.
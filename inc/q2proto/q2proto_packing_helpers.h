@@ -123,6 +123,32 @@ static inline void _q2p_packing_angle_float_to_floatbits(int32_t *dest, const fl
         const int16_t *: _q2p_packing_angle_short_to_floatbits(DEST, (const int16_t *)(SOURCE)), \
         const float *: _q2p_packing_angle_float_to_floatbits(DEST, (const float *)(SOURCE)))
 
+static inline void _q2p_packing_copy_short_raw(int32_t *dest, const int16_t *src)
+{
+    dest[0] = src[0];
+    dest[1] = src[1];
+    dest[2] = src[2];
+}
+
+static inline void _q2p_packing_copy_int_raw(int32_t *dest, const int32_t *src)
+{
+    memcpy(dest, src, sizeof(int32_t) * 3);
+}
+
+static inline void _q2p_packing_copy_float_raw(int32_t *dest, const float *src)
+{
+    dest[0] = _q2proto_valenc_float2bits(src[0]);
+    dest[1] = _q2proto_valenc_float2bits(src[1]);
+    dest[2] = _q2proto_valenc_float2bits(src[2]);
+}
+
+// Helper macro: copy an input vector, without conversion, for later comparison
+#define _Q2P_PACKING_COPY_VEC_RAW(DEST, SOURCE)                                        \
+    _Generic((SOURCE),                                                                 \
+        const int16_t *: _q2p_packing_copy_short_raw(DEST, (const int16_t *)(SOURCE)), \
+        const int32_t *: _q2p_packing_copy_int_raw(DEST, (const int32_t *)(SOURCE)),   \
+        const float *: _q2p_packing_copy_float_raw(DEST, (const float *)(SOURCE)))
+
 #if defined(__cplusplus)
 } // extern "C"
 #endif
@@ -18,11 +18,45 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 /**\file
  * Server-side functions
+ *
+ * \par Thread safety
+ * q2proto keeps no global mutable state (diagnostic strings are formatted into thread-local buffers,
+ * and trace records go to the trace ring of the calling thread).
+ * Functions operating on distinct server contexts can be called concurrently from different threads,
+ * as long as each thread uses its own I/O arguments and deflate arguments (\c deflate_args).
+ * The q2proto_server_info_t referenced by server contexts is only ever read, so it may be shared.
+ *
+ * A single server context must only be used by one thread at a time, as most functions taking a server context
+ * update it (protocol state, statistics). In particular, q2proto_server_multicast_fanout() writes with the context
+ * of the first recipient for protocols without multicast support, so no other thread may use any of the contexts
+ * passed to it.
+ *
+ * Helper objects that can be shared between clients are not synchronized internally. Calls that only read them
+ * may run concurrently; the following calls modify them and must be serialized by the caller:
+ * - Delta caches: q2proto_delta_cache_init(), q2proto_delta_cache_reset(), q2proto_delta_cache_clear_stats(),
+ *   and every lookup: q2proto_server_write_entity_delta_cached(), and q2proto_server_write_frame_entities()
+ *   if given a cache. Lookups store missed deltas and update the statistics, even on a hit.
+ * - Multicast encodings: q2proto_server_multicast_encode() and q2proto_server_multicast_encode_protocols()
+ *   fill the q2proto_multicast_encoded_t entries; q2proto_multicast_find_encoded() and
+ *   q2proto_server_multicast_write_encoded() only read them.
+ * - Snapshot ring buffers: q2proto_snapshot_ring_init(), q2proto_snapshot_ring_begin_frame(),
+ *   q2proto_snapshot_ring_add_entity(), q2proto_snapshot_ring_set_client() and q2proto_snapshot_ring_set_visible().
+ *   q2proto_snapshot_ring_get_client_snapshot() only reads, but the snapshot it returns is invalidated when
+ *   q2proto_snapshot_ring_begin_frame() replaces the frame.
+ * - Download schedulers: q2proto_download_scheduler_init(), q2proto_download_sched_client_init() and
+ *   q2proto_download_scheduler_run_frame(); the latter also writes to the download states and I/O arguments
+ *   of all scheduled clients.
+ * - Download states: all q2proto_server_download_*() functions except q2proto_server_download_get_progress().
+ *   Download cache entries, on the other hand, are only read by q2proto_server_download_begin_cached(), so one
+ *   entry can serve concurrent downloads.
+ * - Server context pools: q2proto_servercontext_pool_init(), q2proto_servercontext_pool_acquire() and
+ *   q2proto_servercontext_pool_release().
  */
 #ifndef Q2PROTO_SERVER_H_
 #define Q2PROTO_SERVER_H_
 
 #include "q2proto_connect.h"
+#include "q2proto_context_stats.h"
 #include "q2proto_defs.h"
 #include "q2proto_entity_bits.h"
 #include "q2proto_error.h"
@@ -103,6 +137,14 @@ struct q2proto_servercontext_s {
         bool has_playerfog;
     } features;
 
+    /// Identifier of the context in trace records (see q2proto_trace.h). Cleared on setup.
+    uint32_t trace_id;
+
+#if Q2PROTO_CONTEXT_STATS
+    /// Message statistics, see q2proto_server_get_stats()
+    q2proto_context_stats_t Q2PROTO_PRIVATE_API_MEMBER(stats);
+#endif
+
     /// Server information
     const q2proto_server_info_t *Q2PROTO_PRIVATE_API_MEMBER(server_info);
     /// Actual protocol version
@@ -112,11 +154,6 @@ struct q2proto_servercontext_s {
     /// zpacket command (differs between R1Q2/Q2PRO and Q2rePRO protocol)
     uint8_t Q2PROTO_PRIVATE_API_MEMBER(zpacket_cmd);
 
-    /// For Q2P_PROTOCOL_KEX_DEMOS. Bits indicating whether a baseline entity has a solid value != 0
-    q2proto_entity_bits Q2PROTO_PRIVATE_API_MEMBER(kex_demo_baseline_nonzero_solid);
-    /// For Q2P_PROTOCOL_KEX_DEMOS. Bits indicating whether an entity was previously seen to have a solid value != 0
-    q2proto_entity_bits Q2PROTO_PRIVATE_API_MEMBER(kex_demo_edict_nonzero_solid);
-
     /// serverdata filling
     Q2PROTO_PRIVATE_API_FUNC_PTR(q2proto_error_t, fill_serverdata, q2proto_servercontext_t *context,
                                  q2proto_svc_serverdata_t *serverdata);
@@ -129,6 +166,12 @@ struct q2proto_servercontext_s {
     Q2PROTO_PRIVATE_API_FUNC_PTR(void, make_player_state_delta, q2proto_servercontext_t *context,
                                  const q2proto_packed_player_state_t *from, const q2proto_packed_player_state_t *to,
                                  q2proto_svc_playerstate_t *delta);
+    /// Protocol-specific computation of entity state delta size
+    Q2PROTO_PRIVATE_API_FUNC_PTR(q2proto_error_t, entity_delta_size, q2proto_servercontext_t *context,
+                                 uint16_t entnum, const q2proto_entity_state_delta_t *delta, size_t *size);
+    /// Protocol-specific computation of player state size
+    Q2PROTO_PRIVATE_API_FUNC_PTR(q2proto_error_t, playerstate_size, q2proto_servercontext_t *context,
+                                 const q2proto_svc_playerstate_t *playerstate, size_t *size);
 
     /// write message
     Q2PROTO_PRIVATE_API_FUNC_PTR(q2proto_error_t, server_write, q2proto_servercontext_t *context, uintptr_t io_arg,
@@ -146,10 +189,19 @@ struct q2proto_servercontext_s {
 
     /// Current element when writing gamestate
     size_t Q2PROTO_PRIVATE_API_MEMBER(gamestate_pos);
+
+    /* Large, KEX-only members go last: initialization clears everything before them,
+     * but leaves clearing these to the KEX protocol code. */
+    /// For Q2P_PROTOCOL_KEX_DEMOS. Bits indicating whether a baseline entity has a solid value != 0
+    q2proto_entity_bits Q2PROTO_PRIVATE_API_MEMBER(kex_demo_baseline_nonzero_solid);
+    /// For Q2P_PROTOCOL_KEX_DEMOS. Bits indicating whether an entity was previously seen to have a solid value != 0
+    q2proto_entity_bits Q2PROTO_PRIVATE_API_MEMBER(kex_demo_edict_nonzero_solid);
 };
 
 /**
  * Set up a context for server communications with a single client.
+ * A context can be set up again to reuse it for another client. This is cheap: only the parts of the context
+ * used by the protocol are cleared. See also q2proto_servercontext_pool_t.
  * \param context Context structure, filled with context-specific data.
  * \param server_info Server info. Pointer will be stored in the server context for use by protocols.
  * \param connect_info Connection info. Usually produced by q2proto_parse_connect().
@@ -219,11 +271,38 @@ Q2PROTO_PUBLIC_API void q2proto_server_make_player_state_delta(q2proto_servercon
                                                                const q2proto_packed_player_state_t *to,
                                                                q2proto_svc_playerstate_t *delta);
 
+/**
+ * Compute the number of bytes an entity state delta will occupy when written as part of a frame
+ * (ie as a non-removing Q2P_SVC_FRAME_ENTITY_DELTA message), without actually writing it.
+ * Useful to decide which entities fit into a packet before encoding them.
+ * \param context Server communications context.
+ * \param entnum Entity number.
+ * \param delta Entity state delta, usually produced by q2proto_server_make_entity_state_delta().
+ * \param size Receives the encoded size, in bytes.
+ * \returns Error code. Returns the same error as writing the delta would, if it can't be encoded.
+ */
+Q2PROTO_PUBLIC_API q2proto_error_t q2proto_server_entity_delta_size(q2proto_servercontext_t *context, uint16_t entnum,
+                                                                    const q2proto_entity_state_delta_t *delta,
+                                                                    size_t *size);
+/**
+ * Compute the number of bytes a player state delta will occupy when written as part of a Q2P_SVC_FRAME message,
+ * without actually writing it.
+ * \param context Server communications context.
+ * \param playerstate Player state delta, usually produced by q2proto_server_make_player_state_delta().
+ * \param size Receives the encoded size, in bytes.
+ * \returns Error code. Returns the same error as writing the delta would, if it can't be encoded.
+ */
+Q2PROTO_PUBLIC_API q2proto_error_t q2proto_server_playerstate_size(q2proto_servercontext_t *context,
+                                                                   const q2proto_svc_playerstate_t *playerstate,
+                                                                   size_t *size);
+
 /**
  * Write a message for "multicast" server communications, ie send the same binary message to multiple clients.
- * Doesn't need a context, but supports only a restricted set of messages.
- * \param protocol Server protocol.
- * \param server_info Server information.
+ * Doesn't need a context, but supports only a restricted set of messages:
+ * nop, disconnect, reconnect, sound, print, stufftext, configstring, temp entity, muzzleflash and muzzleflash2.
+ * A multicast protocol may be used by several game APIs, so game API specific temp entities (eg Q2PRO's)
+ * are refused; q2proto_server_multicast_fanout() knows the recipients' game API and supports them.
+ * \param multicast_proto Multicast protocol, as returned by q2proto_get_multicast_protocol().
  * \param io_arg "I/O argument", passed to externally provided I/O functions.
  * \param svc_message Message data.
  * \returns Error code
@@ -232,6 +311,110 @@ Q2PROTO_PUBLIC_API q2proto_error_t q2proto_server_multicast_write(q2proto_multic
                                                                   uintptr_t io_arg,
                                                                   const q2proto_svc_message_t *svc_message);
 
+/// A message encoded for "multicast" server communications
+typedef struct q2proto_multicast_encoded_s {
+    /// Multicast protocol the message was encoded for
+    q2proto_multicast_protocol_t multicast_proto;
+    /// Encoded message bytes
+    const void *data;
+    /// Size of encoded message
+    size_t size;
+} q2proto_multicast_encoded_t;
+
+/**
+ * Encode a "multicast" message once, for appending to multiple clients' packets.
+ * The message is written to \a io_arg, typically a scratch buffer; \a encoded references the written bytes.
+ * The position of the written bytes is determined using q2protoio_write_reserve_raw() with a size of 0, so
+ * \a io_arg must write to contiguous memory. The encoded bytes are valid as long as that memory is.
+ * \param multicast_proto Multicast protocol to encode message for.
+ * \param io_arg "I/O argument", passed to externally provided I/O functions.
+ * \param svc_message Message data. Supports the same messages as q2proto_server_multicast_write().
+ * \param encoded Receives reference to encoded message.
+ * \returns Error code
+ */
+Q2PROTO_PUBLIC_API q2proto_error_t q2proto_server_multicast_encode(q2proto_multicast_protocol_t multicast_proto,
+                                                                   uintptr_t io_arg,
+                                                                   const q2proto_svc_message_t *svc_message,
+                                                                   q2proto_multicast_encoded_t *encoded);
+/**
+ * Encode a "multicast" message once for each distinct multicast protocol.
+ * Like q2proto_server_multicast_encode(), but for multiple multicast protocols; duplicates in
+ * \a multicast_protos are only encoded once.
+ * \param multicast_protos Multicast protocols to encode message for.
+ * \param num_multicast_protos Number of multicast protocols.
+ * \param io_arg "I/O argument", passed to externally provided I/O functions.
+ * \param svc_message Message data.
+ * \param encoded Receives references to encoded messages. Needs space for \a num_multicast_protos elements.
+ * \param num_encoded Receives number of encoded messages.
+ * \returns Error code
+ */
+Q2PROTO_PUBLIC_API q2proto_error_t q2proto_server_multicast_encode_protocols(
+    const q2proto_multicast_protocol_t *multicast_protos, size_t num_multicast_protos, uintptr_t io_arg,
+    const q2proto_svc_message_t *svc_message, q2proto_multicast_encoded_t *encoded, size_t *num_encoded);
+/**
+ * Find the message encoded for a multicast protocol.
+ * \param encoded Encoded messages, as returned by q2proto_server_multicast_encode_protocols().
+ * \param num_encoded Number of encoded messages.
+ * \param multicast_proto Multicast protocol to look for.
+ * \returns Encoded message, \c NULL if none was encoded for \a multicast_proto.
+ */
+Q2PROTO_PUBLIC_API const q2proto_multicast_encoded_t *
+q2proto_multicast_find_encoded(const q2proto_multicast_encoded_t *encoded, size_t num_encoded,
+                               q2proto_multicast_protocol_t multicast_proto);
+/**
+ * Append an encoded "multicast" message to a packet.
+ * \param io_arg "I/O argument", passed to externally provided I/O functions.
+ * \param encoded Encoded message.
+ * \returns Error code
+ */
+Q2PROTO_PUBLIC_API q2proto_error_t q2proto_server_multicast_write_encoded(uintptr_t io_arg,
+                                                                          const q2proto_multicast_encoded_t *encoded);
+
+/// Group of recipients receiving an identically encoded message
+typedef struct q2proto_multicast_group_s {
+    /**
+     * Encoded message.
+     * \c multicast_proto is Q2P_PROTOCOL_MULTICAST_INVALID if the recipients' protocol has no "multicast"
+     * support; the message is then encoded for the recipients' protocol specifically.
+     */
+    q2proto_multicast_encoded_t encoded;
+    /// Index of first recipient of this group in the recipient list
+    size_t first_recipient;
+    /// Number of recipients in this group
+    size_t num_recipients;
+
+    /// Context used to encode message, if recipients have no multicast protocol
+    q2proto_servercontext_t *Q2PROTO_PRIVATE_API_MEMBER(context);
+} q2proto_multicast_group_t;
+
+/**
+ * Encode a message for multiple clients, once per distinct encoding.
+ * Clients are grouped by the encoding the message has for them; the message is encoded once per group,
+ * so the encoding cost depends on the number of different client protocols, not the number of clients.
+ * Clients whose protocol doesn't support "multicast" messages (eg KEX) are grouped by protocol and encoded
+ * using the context of the first client in the group.
+ * Only the messages supported by q2proto_server_multicast_write() can be fanned out; messages depending on
+ * per-client state (frames, entity deltas, serverdata...) return Q2P_ERR_INVALID_ARGUMENT.
+ * Each encoded message can be appended to the packets of the group's recipients using
+ * q2proto_server_multicast_write_encoded().
+ * \param contexts Server communications contexts of recipients.
+ * \param num_contexts Number of recipients.
+ * \param io_arg "I/O argument" to encode messages to. See q2proto_server_multicast_encode() for requirements.
+ * \param svc_message Message data.
+ * \param groups Receives recipient groups.
+ * \param max_groups Maximum number of elements in \a groups. Returns Q2P_ERR_BUFFER_TOO_SMALL if more are needed.
+ * \param num_groups Receives number of recipient groups.
+ * \param recipients Receives recipient lists, as indices into \a contexts. Needs space for \a num_contexts elements.
+ *   The recipients of a group are stored at q2proto_multicast_group_t::first_recipient onwards.
+ * \returns Error code
+ */
+Q2PROTO_PUBLIC_API q2proto_error_t q2proto_server_multicast_fanout(q2proto_servercontext_t *const *contexts,
+                                                                   size_t num_contexts, uintptr_t io_arg,
+                                                                   const q2proto_svc_message_t *svc_message,
+                                                                   q2proto_multicast_group_t *groups,
+                                                                   size_t max_groups, size_t *num_groups,
+                                                                   size_t *recipients);
+
 /**
  * Write a position appropriate for the server protocol and server info's game type.
  * \param protocol Server protocol.
@@ -297,6 +480,15 @@ Q2PROTO_PUBLIC_API q2proto_error_t q2proto_server_write_zpacket(q2proto_serverco
                                                                 uintptr_t io_arg, const void *packet_data,
                                                                 size_t packet_len);
 
+/**
+ * Get message statistics of a server context.
+ * \param context Server communications context.
+ * \param stats Receives the statistics.
+ * \returns Error code. Returns \c Q2P_ERR_NOT_IMPLEMENTED if q2proto was built without #Q2PROTO_CONTEXT_STATS.
+ */
+Q2PROTO_PUBLIC_API q2proto_error_t q2proto_server_get_stats(const q2proto_servercontext_t *context,
+                                                            q2proto_context_stats_t *stats);
+
 /// State for download handling
 typedef struct q2proto_server_download_state_s {
     // Server communications context.
@@ -355,6 +547,8 @@ Q2PROTO_PUBLIC_API void q2proto_server_download_end(q2proto_server_download_stat
  * completed. Q2P_ERR_SUCCESS if download message was filled but download continues.
  * For Q2P_ERR_SUCCESS and Q2P_ERR_DOWNLOAD_COMPLETE download message \em must be written.
  * Error code otherwise.
+ * \note If Q2PROTO_WRITE_RAW_SEGMENT is enabled, the download message may reference \a data, which then
+ * must stay valid until the packet was sent.
  */
 Q2PROTO_PUBLIC_API q2proto_error_t q2proto_server_download_data(q2proto_server_download_state_t *state,
                                                                 const uint8_t **data, size_t *remaining,
@@ -396,6 +590,89 @@ Q2PROTO_PUBLIC_API q2proto_error_t q2proto_server_read(q2proto_servercontext_t *
                                                        q2proto_clc_message_t *clc_message);
 /** @} */
 
+/**\name Pre-compressed download cache
+ * Helpers to deflate downloadable data once and serve it to all clients supporting Q2PROTO_DOWNLOAD_COMPRESS_RAW.
+ *
+ * q2proto does not do any file I/O itself, so storing the deflated data (eg in a side file next to the original)
+ * is up to the caller. To detect stale cached data a small header is provided which records the path, size and
+ * modification time of the original file; write it in front of the deflated data and check it when loading.
+ * @{ */
+/// Size of a download cache header
+#define Q2PROTO_DOWNLOAD_CACHE_HEADER_SIZE 24
+
+/// Identifies the source of cached download data
+typedef struct q2proto_download_cache_key_s {
+    /// Path of the original file
+    const char *path;
+    /// Size of the original file
+    uint64_t size;
+    /// Modification time of the original file. Units are up to the caller.
+    int64_t mtime;
+} q2proto_download_cache_key_t;
+
+/// Download data, optionally with a pre-compressed variant
+typedef struct q2proto_download_cache_entry_s {
+    /// Uncompressed data
+    const void *data;
+    /// Size of uncompressed data
+    size_t size;
+    /// Raw deflated data. May be \c NULL if no pre-compressed data is available.
+    const void *deflated;
+    /// Size of raw deflated data
+    size_t deflated_size;
+} q2proto_download_cache_entry_t;
+
+/**
+ * Fill a download cache header.
+ * \param key Key identifying the original file.
+ * \param header Receives the header data.
+ */
+Q2PROTO_PUBLIC_API void q2proto_download_cache_make_header(const q2proto_download_cache_key_t *key,
+                                                           uint8_t header[Q2PROTO_DOWNLOAD_CACHE_HEADER_SIZE]);
+/**
+ * Check whether a download cache header matches the original file.
+ * \param key Key identifying the original file.
+ * \param header Header data.
+ * \param header_size Size of header data. Anything smaller than Q2PROTO_DOWNLOAD_CACHE_HEADER_SIZE is rejected.
+ * \returns Whether the header is valid and matches \a key.
+ */
+Q2PROTO_PUBLIC_API bool q2proto_download_cache_check_header(const q2proto_download_cache_key_t *key,
+                                                            const void *header, size_t header_size);
+/**
+ * Deflate download data, suitable for use with Q2PROTO_DOWNLOAD_COMPRESS_RAW.
+ * \param deflate_args Deflate arguments. Passed through to deflate initialization.
+ * \param data Uncompressed data.
+ * \param size Size of uncompressed data.
+ * \param out Buffer to receive deflated data.
+ * \param out_size Size of output buffer.
+ * \param deflated_size Receives size of deflated data.
+ * \returns Q2P_ERR_BUFFER_TOO_SMALL if the deflated data did not fit into the output buffer.
+ * Passing \a size for \a out_size is sensible, as there's no gain from data that doesn't compress.
+ * Q2P_ERR_DEFLATE_NOT_SUPPORTED if compression support is disabled. Error code otherwise.
+ */
+Q2PROTO_PUBLIC_API q2proto_error_t q2proto_download_cache_deflate(q2protoio_deflate_args_t *deflate_args,
+                                                                  const void *data, size_t size, void *out,
+                                                                  size_t out_size, size_t *deflated_size);
+/**
+ * Initialize stateful download, using pre-compressed data if supported by the client.
+ * Uses Q2PROTO_DOWNLOAD_COMPRESS_RAW with the deflated data if available and if
+ * q2proto_servercontext_t::features.download_compress_raw is \c true; otherwise, the uncompressed data is
+ * used with the \a fallback_compress mode.
+ * \param context Server communications context.
+ * \param entry Download data.
+ * \param fallback_compress Compression mode to use for uncompressed data.
+ * \param deflate_args Deflate arguments. Passed through to deflate initialization if compression is enabled.
+ * \param state Download state object.
+ * \param data Receives pointer to the data to pass to q2proto_server_download_data().
+ * \param remaining Receives size of the data to pass to q2proto_server_download_data().
+ * \returns Error code
+ */
+Q2PROTO_PUBLIC_API q2proto_error_t q2proto_server_download_begin_cached(
+    q2proto_servercontext_t *context, const q2proto_download_cache_entry_t *entry,
+    q2proto_download_compress_t fallback_compress, q2protoio_deflate_args_t *deflate_args,
+    q2proto_server_download_state_t *state, const uint8_t **data, size_t *remaining);
+/** @} */
+
 #if defined(__cplusplus)
 } // extern "C"
 #endif
@@ -0,0 +1,97 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/**\file
+ * Pool of server contexts
+ */
+#ifndef Q2PROTO_SERVER_POOL_H_
+#define Q2PROTO_SERVER_POOL_H_
+
+#include "q2proto_connect.h"
+#include "q2proto_defs.h"
+#include "q2proto_error.h"
+#include "q2proto_server.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/**\name Server context pool
+ * A fixed number of server contexts, handed out to connecting clients and returned on disconnect.
+ * Meant for servers that set up contexts for many, possibly short-lived, connection attempts (eg during a
+ * connection flood): acquiring and releasing a context is O(1) and doesn't allocate, and setting up a reused
+ * context only clears the parts of it the protocol actually uses.
+ *
+ * All memory is provided by the caller. Acquiring and releasing contexts is not synchronized; if clients
+ * connect and disconnect on multiple threads, guard these calls with a lock.
+ * @{ */
+/// Server context pool
+typedef struct q2proto_servercontext_pool_s {
+    /// Server contexts
+    q2proto_servercontext_t *Q2PROTO_PRIVATE_API_MEMBER(contexts);
+    /// Number of server contexts
+    size_t Q2PROTO_PRIVATE_API_MEMBER(num_contexts);
+    /// Indices of free contexts, used as a stack
+    uint32_t *Q2PROTO_PRIVATE_API_MEMBER(free_indices);
+    /// Number of free contexts
+    size_t Q2PROTO_PRIVATE_API_MEMBER(num_free);
+} q2proto_servercontext_pool_t;
+
+/**
+ * Initialize a server context pool.
+ * \param pool Pool to initialize.
+ * \param contexts Server context storage, \a num_contexts entries.
+ * \param free_indices Storage for free list, \a num_contexts entries.
+ * \param num_contexts Number of server contexts.
+ */
+Q2PROTO_PUBLIC_API void q2proto_servercontext_pool_init(q2proto_servercontext_pool_t *pool,
+                                                        q2proto_servercontext_t *contexts, uint32_t *free_indices,
+                                                        size_t num_contexts);
+/**
+ * Take a context from the pool and set it up for a client.
+ * \param pool Server context pool.
+ * \param server_info Server info, see q2proto_init_servercontext().
+ * \param connect_info Connection info, see q2proto_init_servercontext().
+ * \param context Receives the context. Set to \c NULL on failure.
+ * \returns Error code. Returns Q2P_ERR_BUFFER_TOO_SMALL if no context is available.
+ *   If setting up the context fails, it is returned to the pool.
+ */
+Q2PROTO_PUBLIC_API q2proto_error_t q2proto_servercontext_pool_acquire(q2proto_servercontext_pool_t *pool,
+                                                                      const q2proto_server_info_t *server_info,
+                                                                      const q2proto_connect_t *connect_info,
+                                                                      q2proto_servercontext_t **context);
+/**
+ * Return a context to the pool.
+ * \param pool Server context pool.
+ * \param context Context previously obtained from q2proto_servercontext_pool_acquire(). Must not be released twice.
+ * \returns Error code. Returns Q2P_ERR_INVALID_ARGUMENT if the context does not belong to the pool.
+ */
+Q2PROTO_PUBLIC_API q2proto_error_t q2proto_servercontext_pool_release(q2proto_servercontext_pool_t *pool,
+                                                                      q2proto_servercontext_t *context);
+/// Return the number of contexts available in the pool.
+Q2PROTO_PUBLIC_API size_t q2proto_servercontext_pool_num_free(const q2proto_servercontext_pool_t *pool);
+/** @} */
+
+#if defined(__cplusplus)
+} // extern "C"
+#endif
+
+#endif // Q2PROTO_SERVER_POOL_H_
@@ -0,0 +1,236 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/**\file
+ * Packed frame snapshots
+ */
+#ifndef Q2PROTO_SNAPSHOT_H_
+#define Q2PROTO_SNAPSHOT_H_
+
+#include "q2proto_defs.h"
+#include "q2proto_entity_bits.h"
+#include "q2proto_error.h"
+#include "q2proto_packing.h"
+#include "q2proto_server.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/**\name Packed snapshots
+ * A snapshot is the packed state of everything a client sees in a frame: the player state and the
+ * states of all visible entities.
+ * @{ */
+/// Packed frame snapshot
+typedef struct q2proto_packed_snapshot_s {
+    /// Server frame number
+    int32_t serverframe;
+    /// Packed player state
+    const q2proto_packed_player_state_t *player_state;
+    /// Number of entities
+    size_t num_entities;
+    /// Entity numbers, in ascending order
+    const uint16_t *entnums;
+    /// Packed entity states, corresponding to \c entnums
+    const q2proto_packed_entity_state_t *entities;
+    /**
+     * Entity visibility, one bit per entity number, laid out like q2proto_entity_bits.
+     * If not \c NULL, only entities with their bit set are part of the snapshot; this allows multiple
+     * clients to share the same entity arrays.
+     */
+    const uint32_t *visible;
+} q2proto_packed_snapshot_t;
+
+/// Entity baselines, used for entities not present in the "from" snapshot
+typedef struct q2proto_packed_baselines_s {
+    /// Packed baseline states, indexed by entity number. If \c NULL, all baselines are assumed to be "zero".
+    const q2proto_packed_entity_state_t *states;
+    /// Number of baseline states. Baselines for entity numbers past this are assumed to be "zero".
+    size_t num_states;
+} q2proto_packed_baselines_t;
+
+/**
+ * Estimate the encoded size of a frame, delta compressed against another frame.
+ * The estimate covers the parts of a frame that depend on the delta frame: the player state and the
+ * entity deltas. Following the usual server behaviour, entities entering the frame are delta compressed
+ * against their baseline and have their "old origin" written, entities leaving the frame are removed,
+ * and entities that didn't change aren't written at all.
+ * \param context Server communications context.
+ * \param from Snapshot of delta frame. Can be \c NULL to estimate a frame without delta compression.
+ * \param to Snapshot of frame to write.
+ * \param baselines Entity baselines. Can be \c NULL if all baselines are "zero".
+ * \param size Receives the estimated encoded size, in bytes.
+ * \returns Error code
+ */
+Q2PROTO_PUBLIC_API q2proto_error_t q2proto_server_estimate_frame_size(q2proto_servercontext_t *context,
+                                                                      const q2proto_packed_snapshot_t *from,
+                                                                      const q2proto_packed_snapshot_t *to,
+                                                                      const q2proto_packed_baselines_t *baselines,
+                                                                      size_t *size);
+/**
+ * Select the delta frame resulting in the smallest encoded frame.
+ * Usually, the last frame acknowledged by the client is used as the delta frame, but delta compressing
+ * against an earlier acknowledged frame sometimes produces a smaller frame. This function estimates
+ * the encoded size of the current frame for each candidate and picks the cheapest.
+ * \param context Server communications context.
+ * \param current Snapshot of frame to write.
+ * \param candidates Snapshots of candidate delta frames, typically all frames acknowledged by the client
+ *   that are still available. A \c NULL entry stands for "no delta compression".
+ *   On ties, earlier candidates are preferred.
+ * \param num_candidates Number of candidates. Must be at least 1.
+ * \param baselines Entity baselines. Can be \c NULL if all baselines are "zero".
+ * \param best_index Receives the index of the cheapest candidate.
+ * \param best_size Receives the estimated encoded size using the cheapest candidate. Can be \c NULL.
+ * \returns Error code
+ */
+Q2PROTO_PUBLIC_API q2proto_error_t q2proto_server_select_delta_frame(q2proto_servercontext_t *context,
+                                                                      const q2proto_packed_snapshot_t *current,
+                                                                      const q2proto_packed_snapshot_t *const *candidates,
+                                                                      size_t num_candidates,
+                                                                      const q2proto_packed_baselines_t *baselines,
+                                                                      size_t *best_index, size_t *best_size);
+/** @} */
+
+/**\name Snapshot ring buffer
+ * Stores the snapshots of the last few frames for all clients.
+ *
+ * Instead of a copy of all visible entity states for each client and frame, the ring buffer stores all entity
+ * states of a frame once ("world frame") and, for each client, the player state plus the set of visible entities.
+ * A client's snapshot for a frame is resolved in constant time, as a q2proto_packed_snapshot_t referencing the
+ * world frame, filtered by the client's visibility bits.
+ *
+ * Filling a frame (q2proto_snapshot_ring_begin_frame() through q2proto_snapshot_ring_set_visible()) modifies
+ * the ring and must not overlap with other calls on it. Once a frame is filled, any number of threads can
+ * resolve and encode snapshots from it, until the next q2proto_snapshot_ring_begin_frame() call.
+ *
+ * All memory is provided by the caller.
+ * @{ */
+/// Entity states of a frame, shared by all clients. Contents are private.
+typedef struct q2proto_snapshot_world_frame_s {
+    /// Server frame number; negative if unused
+    int32_t Q2PROTO_PRIVATE_API_MEMBER(serverframe);
+    /// Number of entities
+    size_t Q2PROTO_PRIVATE_API_MEMBER(num_entities);
+    /// Entity numbers, in ascending order
+    uint16_t *Q2PROTO_PRIVATE_API_MEMBER(entnums);
+    /// Packed entity states
+    q2proto_packed_entity_state_t *Q2PROTO_PRIVATE_API_MEMBER(entities);
+} q2proto_snapshot_world_frame_t;
+
+/// Per-client data of a frame. Contents are private.
+typedef struct q2proto_snapshot_client_frame_s {
+    /// Server frame number; negative if unused
+    int32_t Q2PROTO_PRIVATE_API_MEMBER(serverframe);
+    /// Packed player state
+    q2proto_packed_player_state_t Q2PROTO_PRIVATE_API_MEMBER(player_state);
+    /// Visible entities
+    q2proto_entity_bits Q2PROTO_PRIVATE_API_MEMBER(visible);
+} q2proto_snapshot_client_frame_t;
+
+/// Snapshot ring buffer
+typedef struct q2proto_snapshot_ring_s {
+    /// Number of frames stored
+    size_t Q2PROTO_PRIVATE_API_MEMBER(num_frames);
+    /// Maximum number of entities per frame
+    size_t Q2PROTO_PRIVATE_API_MEMBER(max_entities);
+    /// Number of clients
+    size_t Q2PROTO_PRIVATE_API_MEMBER(num_clients);
+    /// World frames
+    q2proto_snapshot_world_frame_t *Q2PROTO_PRIVATE_API_MEMBER(world_frames);
+    /// Client frames, \c num_clients entries per frame
+    q2proto_snapshot_client_frame_t *Q2PROTO_PRIVATE_API_MEMBER(client_frames);
+    /// Frame currently being filled; negative if none
+    int32_t Q2PROTO_PRIVATE_API_MEMBER(current_frame);
+} q2proto_snapshot_ring_t;
+
+/**
+ * Initialize a snapshot ring buffer.
+ * \param ring Ring buffer to initialize.
+ * \param num_frames Number of frames to store. Should cover the frames a client may still acknowledge,
+ *   typically the "update backup" value of the server.
+ * \param world_frames World frame storage, \a num_frames entries.
+ * \param entnum_storage Entity number storage, <tt>num_frames * max_entities</tt> entries.
+ * \param entity_storage Entity state storage, <tt>num_frames * max_entities</tt> entries.
+ * \param max_entities Maximum number of entities per frame.
+ * \param client_frames Client frame storage, <tt>num_frames * num_clients</tt> entries.
+ * \param num_clients Number of clients.
+ */
+Q2PROTO_PUBLIC_API void q2proto_snapshot_ring_init(q2proto_snapshot_ring_t *ring, size_t num_frames,
+                                                   q2proto_snapshot_world_frame_t *world_frames,
+                                                   uint16_t *entnum_storage,
+                                                   q2proto_packed_entity_state_t *entity_storage,
+                                                   size_t max_entities, q2proto_snapshot_client_frame_t *client_frames,
+                                                   size_t num_clients);
+/**
+ * Start a new frame, replacing the oldest stored frame.
+ * \param ring Snapshot ring buffer.
+ * \param serverframe Server frame number. Must not be negative, and larger than the previous frame number.
+ * \returns Error code
+ */
+Q2PROTO_PUBLIC_API q2proto_error_t q2proto_snapshot_ring_begin_frame(q2proto_snapshot_ring_t *ring,
+                                                                     int32_t serverframe);
+/**
+ * Add an entity state to the current frame.
+ * \param ring Snapshot ring buffer.
+ * \param entnum Entity number. Entities must be added in ascending order.
+ * \param state Packed entity state.
+ * \returns Error code. Returns Q2P_ERR_BUFFER_TOO_SMALL if the maximum number of entities was reached.
+ */
+Q2PROTO_PUBLIC_API q2proto_error_t q2proto_snapshot_ring_add_entity(q2proto_snapshot_ring_t *ring, uint16_t entnum,
+                                                                    const q2proto_packed_entity_state_t *state);
+/**
+ * Set a client's player state for the current frame. Also clears the client's visible entities.
+ * \param ring Snapshot ring buffer.
+ * \param client Client index.
+ * \param player_state Packed player state.
+ * \returns Error code
+ */
+Q2PROTO_PUBLIC_API q2proto_error_t q2proto_snapshot_ring_set_client(q2proto_snapshot_ring_t *ring, size_t client,
+                                                                    const q2proto_packed_player_state_t *player_state);
+/**
+ * Mark an entity as visible to a client in the current frame.
+ * Must be called after q2proto_snapshot_ring_set_client() for the client.
+ * \param ring Snapshot ring buffer.
+ * \param client Client index.
+ * \param entnum Entity number.
+ * \returns Error code
+ */
+Q2PROTO_PUBLIC_API q2proto_error_t q2proto_snapshot_ring_set_visible(q2proto_snapshot_ring_t *ring, size_t client,
+                                                                     uint16_t entnum);
+/**
+ * Get a client's snapshot of a frame.
+ * \param ring Snapshot ring buffer.
+ * \param client Client index.
+ * \param serverframe Server frame number.
+ * \param snapshot Receives the snapshot. It references data in the ring buffer, and stays valid until the frame
+ *   is replaced.
+ * \returns Whether the frame is available for the client.
+ */
+Q2PROTO_PUBLIC_API bool q2proto_snapshot_ring_get_client_snapshot(const q2proto_snapshot_ring_t *ring, size_t client,
+                                                                  int32_t serverframe,
+                                                                  q2proto_packed_snapshot_t *snapshot);
+/** @} */
+
+#if defined(__cplusplus)
+} // extern "C"
+#endif
+
+#endif // Q2PROTO_SNAPSHOT_H_
@@ -274,6 +274,13 @@ typedef struct q2proto_svc_download_s {
      * May be -1 to indicate an unknown uncompressed size.
      */
     int16_t uncompressed_size;
+    /**
+     * Data may be passed to the I/O layer by reference, instead of being copied into the output buffer.
+     * Only has an effect if Q2PROTO_WRITE_RAW_SEGMENT is enabled.
+     * Is automatically set by q2proto_server_download_data() if the chunk points into the data passed in
+     * (ie the data is not compressed on the fly).
+     */
+    bool data_reference;
 } q2proto_svc_download_t;
 
 /// Contents from a serverdata message
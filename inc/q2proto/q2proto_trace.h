@@ -0,0 +1,155 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/**\file
+ * Binary message tracing
+ */
+#ifndef Q2PROTO_TRACE_H_
+#define Q2PROTO_TRACE_H_
+
+#include "q2proto_defs.h"
+#include "q2proto_error.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/**\name Message tracing
+ * A low-overhead alternative to 'shownet' output, meant to be left enabled in production.
+ *
+ * If built with #Q2PROTO_TRACE, every message successfully read or written through q2proto_client_read(),
+ * q2proto_client_write(), q2proto_server_read() and q2proto_server_write() produces a fixed-size
+ * trace record. Records are pushed into the trace ring of the calling thread, if any
+ * (see q2proto_trace_set_thread_ring()). Threads without a trace ring produce no records.
+ *
+ * A trace ring has a single producer, the thread it is set for, and a single consumer, which may
+ * be another thread, draining records with q2proto_trace_ring_drain(). Neither side blocks: if the ring
+ * is full, new records are dropped and counted.
+ *
+ * Offsets are positions in the I/O argument passed to the function, as reported by q2protoio_trace_position().
+ * Messages read from compressed data are accounted for as a whole, in the message that caused the
+ * compressed data to be read; other messages read from compressed data have a length of 0.
+ * @{ */
+/// Kind of trace event
+typedef enum q2proto_trace_event_e {
+    /// Server message read by client. Record type is a q2proto_svc_message_type_t
+    Q2P_TRACE_SVC_READ,
+    /// Server message written by server. Record type is a q2proto_svc_message_type_t
+    Q2P_TRACE_SVC_WRITE,
+    /// Client message read by server. Record type is a q2proto_clc_message_type_t
+    Q2P_TRACE_CLC_READ,
+    /// Client message written by client. Record type is a q2proto_clc_message_type_t
+    Q2P_TRACE_CLC_WRITE,
+} q2proto_trace_event_t;
+
+/// Trace record
+typedef struct q2proto_trace_record_s {
+    /**
+     * Delta bits: q2proto_entity_state_delta_t::delta_bits for entity deltas and baselines,
+     * q2proto_svc_playerstate_t::delta_bits for frames. 0 for other messages.
+     */
+    uint64_t bits;
+    /// Trace ID of the context (q2proto_clientcontext_t::trace_id, q2proto_servercontext_t::trace_id)
+    uint32_t context_id;
+    /// Position of the message start
+    uint32_t offset;
+    /// Length of the message, in bytes
+    uint32_t length;
+    /// Entity number for entity deltas and baselines, 0 otherwise
+    uint16_t entnum;
+    /// Event kind, a q2proto_trace_event_t value
+    uint8_t event;
+    /// Message type
+    uint8_t type;
+} q2proto_trace_record_t;
+
+/// Single producer, single consumer ring buffer of trace records
+typedef struct q2proto_trace_ring_s {
+    /// Record storage
+    q2proto_trace_record_t *Q2PROTO_PRIVATE_API_MEMBER(records);
+    /// Number of records minus one
+    uint32_t Q2PROTO_PRIVATE_API_MEMBER(mask);
+
+    /**\name Producer side
+     * @{ */
+    /// Total number of records pushed
+    uint32_t Q2PROTO_PRIVATE_API_MEMBER(head);
+    /// Last seen value of \c tail, to avoid touching the consumer cache line on every push
+    uint32_t Q2PROTO_PRIVATE_API_MEMBER(cached_tail);
+    /// Number of records dropped because the ring was full
+    uint32_t Q2PROTO_PRIVATE_API_MEMBER(dropped);
+    /** @} */
+
+    /// Keep producer and consumer data in separate cache lines
+    uint8_t Q2PROTO_PRIVATE_API_MEMBER(padding)[64 - 4 * sizeof(uint32_t)];
+
+    /**\name Consumer side
+     * @{ */
+    /// Total number of records drained
+    uint32_t Q2PROTO_PRIVATE_API_MEMBER(tail);
+    /** @} */
+} q2proto_trace_ring_t;
+
+/**
+ * Set up a trace ring.
+ * \param ring Trace ring.
+ * \param records Record storage. Must stay valid while the ring is used.
+ * \param num_records Number of records in \a records. Must be a power of two.
+ * \returns Error code. Q2P_ERR_INVALID_ARGUMENT if \a num_records is not a power of two.
+ */
+Q2PROTO_PUBLIC_API q2proto_error_t q2proto_trace_ring_init(q2proto_trace_ring_t *ring,
+                                                           q2proto_trace_record_t *records, size_t num_records);
+
+/**
+ * Push a record into the ring. Must only be called from the producer thread.
+ * \returns Whether the record was stored. If the ring is full, the record is dropped.
+ */
+Q2PROTO_PUBLIC_API bool q2proto_trace_ring_push(q2proto_trace_ring_t *ring, const q2proto_trace_record_t *record);
+
+/**
+ * Take records from the ring. Must only be called from the consumer thread.
+ * \param ring Trace ring.
+ * \param records Receives records, oldest first.
+ * \param max_records Maximum number of records to take.
+ * \returns Number of records taken.
+ */
+Q2PROTO_PUBLIC_API size_t q2proto_trace_ring_drain(q2proto_trace_ring_t *ring, q2proto_trace_record_t *records,
+                                                   size_t max_records);
+
+/// Return the number of records dropped because the ring was full. Can be called from any thread.
+Q2PROTO_PUBLIC_API uint32_t q2proto_trace_ring_dropped(const q2proto_trace_ring_t *ring);
+
+/**
+ * Set the trace ring receiving records for the calling thread.
+ * \param ring Trace ring, or \c NULL to stop tracing on this thread.
+ */
+Q2PROTO_PUBLIC_API void q2proto_trace_set_thread_ring(q2proto_trace_ring_t *ring);
+
+/// Return the trace ring receiving records for the calling thread, or \c NULL.
+Q2PROTO_PUBLIC_API q2proto_trace_ring_t *q2proto_trace_get_thread_ring(void);
+/** @} */
+
+#if defined(__cplusplus)
+} // extern "C"
+#endif
+
+#endif // Q2PROTO_TRACE_H_
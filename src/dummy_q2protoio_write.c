@@ -31,3 +31,6 @@ void q2protoio_write_raw(uintptr_t io_arg, const void *data, size_t size, size_t
         *written = 0;
 }
 size_t q2protoio_write_available(uintptr_t io_arg) { return 0; }
+#if Q2PROTO_WRITE_RAW_SEGMENT
+void q2protoio_write_raw_segment(uintptr_t io_arg, const void *data, size_t size) {}
+#endif
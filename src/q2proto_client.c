@@ -250,10 +250,47 @@ q2proto_error_t q2proto_init_clientcontext(q2proto_clientcontext_t *context)
     return Q2P_ERR_SUCCESS;
 }
 
+#if Q2PROTO_CONTEXT_STATS || Q2PROTO_TRACE
+// Count a server message read in the context statistics and emit a trace record for it
+static void client_record_svc_message(q2proto_clientcontext_t *context, q2proto_error_t err, size_t start, size_t end,
+                                      const q2proto_svc_message_t *svc_message)
+{
+    #if Q2PROTO_CONTEXT_STATS
+    q2proto_context_stats_svc_message(&context->stats, err, start, end, svc_message);
+    #endif
+    #if Q2PROTO_TRACE
+    q2proto_trace_ring_t *ring = q2proto_trace_get_thread_ring();
+    if (ring && err == Q2P_ERR_SUCCESS)
+        q2proto_trace_svc_message(ring, Q2P_TRACE_SVC_READ, context->trace_id, start, end, svc_message);
+    #endif
+}
+
+// Count a client message written in the context statistics and emit a trace record for it
+static void client_record_clc_message(q2proto_clientcontext_t *context, q2proto_error_t err, size_t start, size_t end,
+                                      const q2proto_clc_message_t *clc_message)
+{
+    #if Q2PROTO_CONTEXT_STATS
+    q2proto_context_stats_clc_message(&context->stats, err, start, end, clc_message);
+    #endif
+    #if Q2PROTO_TRACE
+    q2proto_trace_ring_t *ring = q2proto_trace_get_thread_ring();
+    if (ring && err == Q2P_ERR_SUCCESS)
+        q2proto_trace_clc_message(ring, Q2P_TRACE_CLC_WRITE, context->trace_id, start, end, clc_message);
+    #endif
+}
+#endif
+
 q2proto_error_t q2proto_client_read(q2proto_clientcontext_t *context, uintptr_t io_arg,
                                     q2proto_svc_message_t *svc_message)
 {
+#if Q2PROTO_CONTEXT_STATS || Q2PROTO_TRACE
+    size_t start = q2protoio_trace_position(io_arg);
+    q2proto_error_t err = context->client_read(context, io_arg, svc_message);
+    client_record_svc_message(context, err, start, q2protoio_trace_position(io_arg), svc_message);
+    return err;
+#else
     return context->client_read(context, io_arg, svc_message);
+#endif
 }
 
 static MAYBE_UNUSED const char *default_server_cmd_string(int command)
@@ -329,7 +366,14 @@ q2proto_error_t q2proto_client_write(q2proto_clientcontext_t *context, uintptr_t
                                      const q2proto_clc_message_t *clc_message)
 {
     q2proto_clientcontext_t *ctx_internal = (q2proto_clientcontext_t *)context;
+#if Q2PROTO_CONTEXT_STATS || Q2PROTO_TRACE
+    size_t start = q2protoio_trace_position(io_arg);
+    q2proto_error_t err = ctx_internal->client_write(ctx_internal, io_arg, clc_message);
+    client_record_clc_message(ctx_internal, err, start, q2protoio_trace_position(io_arg), clc_message);
+    return err;
+#else
     return ctx_internal->client_write(ctx_internal, io_arg, clc_message);
+#endif
 }
 
 uint32_t q2proto_client_pack_solid(q2proto_clientcontext_t *context, const q2proto_vec3_t mins,
@@ -344,6 +388,99 @@ void q2proto_client_unpack_solid(q2proto_clientcontext_t *context, uint32_t soli
     context->unpack_solid(context, solid, mins, maxs);
 }
 
+// Set protocol-specific client context functions, as set up after reading svc_serverdata
+static bool init_client_functions(q2proto_clientcontext_t *context, q2proto_protocol_t protocol)
+{
+    switch (protocol) {
+    case Q2P_PROTOCOL_OLD_DEMO:
+    case Q2P_PROTOCOL_VANILLA:
+        q2proto_vanilla_init_client_functions(context);
+        return true;
+    case Q2P_PROTOCOL_R1Q2:
+        q2proto_r1q2_init_client_functions(context);
+        return true;
+    case Q2P_PROTOCOL_Q2PRO:
+        q2proto_q2pro_init_client_functions(context);
+        return true;
+    case Q2P_PROTOCOL_Q2PRO_EXTENDED_DEMO:
+    case Q2P_PROTOCOL_Q2PRO_EXTENDED_V2_DEMO:
+    case Q2P_PROTOCOL_Q2PRO_EXTENDED_DEMO_PLAYERFOG:
+        q2proto_q2pro_extdemo_init_client_functions(context);
+        return true;
+    case Q2P_PROTOCOL_Q2REPRO:
+        q2proto_q2repro_init_client_functions(context);
+        return true;
+    case Q2P_PROTOCOL_KEX_DEMOS:
+    case Q2P_PROTOCOL_KEX:
+        q2proto_kex_init_client_functions(context);
+        return true;
+    default:
+        return false;
+    }
+}
+
+#define SAVED_FEATURE_BATCH_MOVE     BIT(0)
+#define SAVED_FEATURE_USERINFO_DELTA BIT(1)
+#define SAVED_FEATURE_HAS_UPMOVE     BIT(2)
+#define SAVED_FEATURE_HAS_CLIENTNUM  BIT(3)
+#define SAVED_FEATURE_HAS_SOLID32    BIT(4)
+#define SAVED_FEATURE_HAS_PLAYERFOG  BIT(5)
+
+q2proto_error_t q2proto_client_save_state(const q2proto_clientcontext_t *context, q2proto_client_saved_state_t *state)
+{
+    // The packet parsing function is only the protocol's "top level" one between packets
+    q2proto_clientcontext_t between_packets;
+    between_packets.client_read = NULL;
+    if (!init_client_functions(&between_packets, context->server_protocol)
+        || context->client_read != between_packets.client_read || context->has_inflate_io_arg)
+        return Q2P_ERR_INVALID_ARGUMENT;
+
+    memset(state, 0, sizeof(*state));
+    state->server_protocol = context->server_protocol;
+    state->protocol_version = context->protocol_version;
+    state->server_game_api = context->features.server_game_api;
+    if (context->features.batch_move)
+        state->feature_flags |= SAVED_FEATURE_BATCH_MOVE;
+    if (context->features.userinfo_delta)
+        state->feature_flags |= SAVED_FEATURE_USERINFO_DELTA;
+    if (context->features.has_upmove)
+        state->feature_flags |= SAVED_FEATURE_HAS_UPMOVE;
+    if (context->features.has_clientnum)
+        state->feature_flags |= SAVED_FEATURE_HAS_CLIENTNUM;
+    if (context->features.has_solid32)
+        state->feature_flags |= SAVED_FEATURE_HAS_SOLID32;
+    if (context->features.has_playerfog)
+        state->feature_flags |= SAVED_FEATURE_HAS_PLAYERFOG;
+    memcpy(state->kex_demo_baseline_nonzero_solid, context->kex_demo_baseline_nonzero_solid,
+           sizeof(state->kex_demo_baseline_nonzero_solid));
+    memcpy(state->kex_demo_edict_nonzero_solid, context->kex_demo_edict_nonzero_solid,
+           sizeof(state->kex_demo_edict_nonzero_solid));
+    return Q2P_ERR_SUCCESS;
+}
+
+q2proto_error_t q2proto_client_restore_state(q2proto_clientcontext_t *context,
+                                             const q2proto_client_saved_state_t *state)
+{
+    q2proto_init_clientcontext(context);
+    if (!init_client_functions(context, (q2proto_protocol_t)state->server_protocol))
+        return Q2P_ERR_PROTOCOL_NOT_SUPPORTED;
+
+    context->server_protocol = (q2proto_protocol_t)state->server_protocol;
+    context->protocol_version = state->protocol_version;
+    context->features.server_game_api = (q2proto_game_api_t)state->server_game_api;
+    context->features.batch_move = (state->feature_flags & SAVED_FEATURE_BATCH_MOVE) != 0;
+    context->features.userinfo_delta = (state->feature_flags & SAVED_FEATURE_USERINFO_DELTA) != 0;
+    context->features.has_upmove = (state->feature_flags & SAVED_FEATURE_HAS_UPMOVE) != 0;
+    context->features.has_clientnum = (state->feature_flags & SAVED_FEATURE_HAS_CLIENTNUM) != 0;
+    context->features.has_solid32 = (state->feature_flags & SAVED_FEATURE_HAS_SOLID32) != 0;
+    context->features.has_playerfog = (state->feature_flags & SAVED_FEATURE_HAS_PLAYERFOG) != 0;
+    memcpy(context->kex_demo_baseline_nonzero_solid, state->kex_demo_baseline_nonzero_solid,
+           sizeof(context->kex_demo_baseline_nonzero_solid));
+    memcpy(context->kex_demo_edict_nonzero_solid, state->kex_demo_edict_nonzero_solid,
+           sizeof(context->kex_demo_edict_nonzero_solid));
+    return Q2P_ERR_SUCCESS;
+}
+
 static q2proto_error_t default_client_send(q2proto_clientcontext_t *context, uintptr_t io_arg,
                                            const q2proto_clc_message_t *clc_message)
 {
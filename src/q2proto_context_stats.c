@@ -0,0 +1,137 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#define Q2PROTO_BUILD
+#include "q2proto_internal.h"
+
+#include <string.h>
+
+// Error codes with a counter of their own, in counter order
+static const q2proto_error_t stats_error_codes[Q2PROTO_CONTEXT_STATS_ERROR_OTHER] = {
+    Q2P_ERR_NOT_ENOUGH_PACKET_SPACE,
+    Q2P_ERR_DOWNLOAD_COMPLETE,
+    Q2P_ERR_ALREADY_COMPRESSED,
+    Q2P_ERR_NOT_IMPLEMENTED,
+    Q2P_ERR_INVALID_ARGUMENT,
+    Q2P_ERR_BAD_DATA,
+    Q2P_ERR_BAD_COMMAND,
+    Q2P_ERR_GAMETYPE_UNSUPPORTED,
+    Q2P_ERR_BUFFER_TOO_SMALL,
+    Q2P_ERR_IO_READ,
+    Q2P_ERR_IO_WRITE,
+    Q2P_ERR_NO_ACCEPTABLE_PROTOCOL,
+    Q2P_ERR_EXPECTED_SERVERDATA,
+    Q2P_ERR_PROTOCOL_NOT_SUPPORTED,
+    Q2P_ERR_DEFLATE_NOT_SUPPORTED,
+    Q2P_ERR_MORE_DATA_DEFLATED,
+    Q2P_ERR_INFLATE_FAILED,
+    Q2P_ERR_DEFLATE_FAILED,
+    Q2P_ERR_RAW_COMPRESS_NOT_SUPPORTED,
+};
+
+size_t q2proto_context_stats_error_index(q2proto_error_t err)
+{
+    for (size_t i = 0; i < Q2PROTO_CONTEXT_STATS_ERROR_OTHER; i++) {
+        if (stats_error_codes[i] == err)
+            return i;
+    }
+    return Q2PROTO_CONTEXT_STATS_ERROR_OTHER;
+}
+
+q2proto_error_t q2proto_context_stats_error_code(size_t index)
+{
+    return index < Q2PROTO_CONTEXT_STATS_ERROR_OTHER ? stats_error_codes[index] : Q2P_ERR_SUCCESS;
+}
+
+q2proto_error_t q2proto_server_get_stats(const q2proto_servercontext_t *context, q2proto_context_stats_t *stats)
+{
+#if Q2PROTO_CONTEXT_STATS
+    *stats = context->stats;
+    return Q2P_ERR_SUCCESS;
+#else
+    memset(stats, 0, sizeof(*stats));
+    return Q2P_ERR_NOT_IMPLEMENTED;
+#endif
+}
+
+q2proto_error_t q2proto_client_get_stats(const q2proto_clientcontext_t *context, q2proto_context_stats_t *stats)
+{
+#if Q2PROTO_CONTEXT_STATS
+    *stats = context->stats;
+    return Q2P_ERR_SUCCESS;
+#else
+    memset(stats, 0, sizeof(*stats));
+    return Q2P_ERR_NOT_IMPLEMENTED;
+#endif
+}
+
+#if Q2PROTO_CONTEXT_STATS
+// Count a failed read or write. Reaching the end of input is not a failure.
+static bool stats_count_result(q2proto_context_stats_t *stats, q2proto_error_t err)
+{
+    if (err == Q2P_ERR_SUCCESS)
+        return true;
+    if (err != Q2P_ERR_NO_MORE_INPUT)
+        stats->errors[q2proto_context_stats_error_index(err)]++;
+    return false;
+}
+
+static void stats_count_message(q2proto_message_stats_t *message_stats, size_t start, size_t end)
+{
+    message_stats->count++;
+    message_stats->bytes += end > start ? end - start : 0;
+}
+
+void q2proto_context_stats_svc_message(q2proto_context_stats_t *stats, q2proto_error_t err, size_t start, size_t end,
+                               const q2proto_svc_message_t *svc_message)
+{
+    if (!stats_count_result(stats, err) || (unsigned)svc_message->type >= Q2PROTO_CONTEXT_STATS_NUM_SVC_TYPES)
+        return;
+    stats_count_message(&stats->svc[svc_message->type], start, end);
+    if (svc_message->type == Q2P_SVC_FRAME_ENTITY_DELTA && svc_message->frame_entity_delta.newnum != 0) {
+        if (svc_message->frame_entity_delta.remove)
+            stats->entity_removals++;
+        else
+            stats->entity_deltas++;
+    }
+}
+
+void q2proto_context_stats_clc_message(q2proto_context_stats_t *stats, q2proto_error_t err, size_t start, size_t end,
+                               const q2proto_clc_message_t *clc_message)
+{
+    if (!stats_count_result(stats, err) || (unsigned)clc_message->type >= Q2PROTO_CONTEXT_STATS_NUM_CLC_TYPES)
+        return;
+    stats_count_message(&stats->clc[clc_message->type], start, end);
+}
+
+void q2proto_context_stats_failure(q2proto_context_stats_t *stats, q2proto_error_t err)
+{
+    if (err < 0)
+        stats->errors[q2proto_context_stats_error_index(err)]++;
+}
+
+// zpacket header: command byte, compressed and uncompressed length
+#define ZPACKET_HEADER_SIZE 5
+
+void q2proto_context_stats_zpacket(q2proto_context_stats_t *stats, size_t compressed_len, size_t uncompressed_len)
+{
+    stats->zpackets++;
+    stats->zpacket_compressed_bytes += ZPACKET_HEADER_SIZE + compressed_len;
+    stats->zpacket_uncompressed_bytes += uncompressed_len;
+}
+#endif
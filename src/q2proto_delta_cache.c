@@ -0,0 +1,167 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#define Q2PROTO_BUILD
+#include "q2proto_internal.h"
+
+#include "q2proto/q2proto_delta_cache.h"
+
+void q2proto_delta_cache_init(q2proto_delta_cache_t *cache, q2proto_delta_cache_entry_t *entries, size_t num_entries,
+                              void *storage, size_t storage_size)
+{
+    memset(cache, 0, sizeof(*cache));
+    memset(entries, 0, num_entries * sizeof(*entries));
+    cache->entries = entries;
+    cache->num_entries = num_entries;
+    cache->storage = storage;
+    cache->storage_size = MIN(storage_size, UINT32_MAX);
+    cache->generation = 1;
+}
+
+void q2proto_delta_cache_reset(q2proto_delta_cache_t *cache)
+{
+    cache->storage_used = 0;
+    if (++cache->generation == 0) {
+        // Wrapped around, old slots could appear valid again
+        memset(cache->entries, 0, cache->num_entries * sizeof(*cache->entries));
+        cache->generation = 1;
+    }
+}
+
+void q2proto_delta_cache_clear_stats(q2proto_delta_cache_t *cache)
+{
+    memset(&cache->stats, 0, sizeof(cache->stats));
+}
+
+// FNV-1a, applied to individual values (packed states may contain uninitialized padding)
+#define FNV64_OFFSET_BASIS 14695981039346656037ull
+#define FNV64_PRIME        1099511628211ull
+
+static uint64_t hash_value(uint64_t hash, uint64_t value)
+{
+    for (int i = 0; i < 8; i++) {
+        hash ^= (uint8_t)(value >> (i * 8));
+        hash *= FNV64_PRIME;
+    }
+    return hash;
+}
+
+static uint64_t hash_entity_state(uint64_t hash, const q2proto_packed_entity_state_t *state)
+{
+    if (!state)
+        return hash_value(hash, 0);
+
+    hash = hash_value(hash, 1);
+    hash = hash_value(hash, state->modelindex | (uint64_t)state->modelindex2 << 16
+                                | (uint64_t)state->modelindex3 << 32 | (uint64_t)state->modelindex4 << 48);
+    hash = hash_value(hash, state->frame | (uint64_t)state->skinnum << 16);
+    hash = hash_value(hash, state->effects);
+    hash = hash_value(hash, state->renderfx | (uint64_t)state->solid << 32);
+    for (int i = 0; i < 3; i++) {
+        hash = hash_value(hash, (uint32_t)state->origin[i] | (uint64_t)(uint32_t)state->angles[i] << 32);
+        hash = hash_value(hash, (uint32_t)state->old_origin[i]);
+    }
+    hash = hash_value(hash, state->sound | (uint64_t)state->event << 16);
+#if Q2PROTO_ENTITY_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_ENTITY_LOOP_ALPHA_SCALE_FX64
+    hash = hash_value(hash, state->loop_volume | (uint64_t)state->loop_attenuation << 8 | (uint64_t)state->alpha << 16
+                                | (uint64_t)state->scale << 24);
+#endif
+    return hash;
+}
+
+static bool entry_matches(const q2proto_delta_cache_entry_t *entry, const q2proto_servercontext_t *context,
+                          uint16_t entnum, uint64_t states_hash, bool write_old_origin)
+{
+    return entry->states_hash == states_hash && entry->entnum == entnum && entry->write_old_origin == write_old_origin
+           && entry->protocol == context->protocol && entry->protocol_version == context->protocol_version
+           && entry->server_info == context->server_info;
+}
+
+static q2proto_error_t write_entity_delta(q2proto_servercontext_t *context, uintptr_t io_arg, uint16_t entnum,
+                                          const q2proto_packed_entity_state_t *from,
+                                          const q2proto_packed_entity_state_t *to, bool write_old_origin)
+{
+    q2proto_svc_message_t message = {.type = Q2P_SVC_FRAME_ENTITY_DELTA, .frame_entity_delta = {0}};
+    message.frame_entity_delta.newnum = entnum;
+    q2proto_server_make_entity_state_delta(context, from, to, write_old_origin,
+                                           &message.frame_entity_delta.entity_delta);
+    return q2proto_server_write(context, io_arg, &message);
+}
+
+q2proto_error_t q2proto_server_write_entity_delta_cached(q2proto_delta_cache_t *cache,
+                                                         q2proto_servercontext_t *context, uintptr_t io_arg,
+                                                         uint16_t entnum, const q2proto_packed_entity_state_t *from,
+                                                         const q2proto_packed_entity_state_t *to,
+                                                         bool write_old_origin)
+{
+    if (!cache || cache->num_entries == 0)
+        return write_entity_delta(context, io_arg, entnum, from, to, write_old_origin);
+
+    // KEX demo deltas depend on (and update) per-context state
+    if (context->protocol == Q2P_PROTOCOL_KEX_DEMOS) {
+        cache->stats.bypassed++;
+        return write_entity_delta(context, io_arg, entnum, from, to, write_old_origin);
+    }
+
+    uint64_t states_hash = hash_entity_state(hash_entity_state(FNV64_OFFSET_BASIS, from), to);
+    uint64_t slot_hash = hash_value(states_hash, entnum | (uint64_t)context->protocol << 16);
+
+    // Open addressing, linear probing
+    q2proto_delta_cache_entry_t *free_entry = NULL;
+    size_t slot = slot_hash % cache->num_entries;
+    for (size_t n = 0; n < cache->num_entries; n++) {
+        q2proto_delta_cache_entry_t *entry = &cache->entries[slot];
+        if (entry->generation != cache->generation) {
+            free_entry = entry;
+            break;
+        }
+        if (entry_matches(entry, context, entnum, states_hash, write_old_origin)) {
+            WRITE_CHECKED(server_write, io_arg, raw, cache->storage + entry->offset, entry->size, NULL);
+            cache->stats.hits++;
+            cache->stats.bytes_saved += entry->size;
+            return Q2P_ERR_SUCCESS;
+        }
+        slot = (slot + 1) % cache->num_entries;
+    }
+
+    cache->stats.misses++;
+
+    const uint8_t *start, *end;
+    CHECKED_IO(server_write, io_arg, start = q2protoio_write_reserve_raw(io_arg, 0), "get delta start");
+    CHECKED(server_write, io_arg, write_entity_delta(context, io_arg, entnum, from, to, write_old_origin));
+    CHECKED_IO(server_write, io_arg, end = q2protoio_write_reserve_raw(io_arg, 0), "get delta end");
+
+    size_t size = end - start;
+    if (!free_entry || size > UINT16_MAX || size > cache->storage_size - cache->storage_used) {
+        cache->stats.store_failures++;
+        return Q2P_ERR_SUCCESS;
+    }
+
+    memcpy(cache->storage + cache->storage_used, start, size);
+    free_entry->states_hash = states_hash;
+    free_entry->server_info = context->server_info;
+    free_entry->protocol = context->protocol;
+    free_entry->protocol_version = context->protocol_version;
+    free_entry->generation = cache->generation;
+    free_entry->offset = (uint32_t)cache->storage_used;
+    free_entry->size = (uint16_t)size;
+    free_entry->entnum = entnum;
+    free_entry->write_old_origin = write_old_origin;
+    cache->storage_used += size;
+    return Q2P_ERR_SUCCESS;
+}
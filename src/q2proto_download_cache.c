@@ -0,0 +1,141 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#define Q2PROTO_BUILD
+#include "q2proto_internal.h"
+
+/* Download cache header layout (all values little endian):
+ *   4 bytes  magic, includes format version
+ *   4 bytes  FNV-1a hash of path
+ *   8 bytes  original file size
+ *   8 bytes  original file modification time
+ */
+static const uint8_t download_cache_magic[4] = {'Q', '2', 'D', 1};
+
+static uint32_t download_cache_path_hash(const char *path)
+{
+    uint32_t hash = 2166136261u;
+    if (path) {
+        while (*path) {
+            hash ^= (uint8_t)*path++;
+            hash *= 16777619u;
+        }
+    }
+    return hash;
+}
+
+static void download_cache_put_u64(uint8_t *p, uint64_t value)
+{
+    for (int i = 0; i < 8; i++)
+        p[i] = (uint8_t)(value >> (i * 8));
+}
+
+void q2proto_download_cache_make_header(const q2proto_download_cache_key_t *key,
+                                        uint8_t header[Q2PROTO_DOWNLOAD_CACHE_HEADER_SIZE])
+{
+    uint32_t path_hash = download_cache_path_hash(key->path);
+
+    memcpy(header, download_cache_magic, sizeof(download_cache_magic));
+    header[4] = (uint8_t)path_hash;
+    header[5] = (uint8_t)(path_hash >> 8);
+    header[6] = (uint8_t)(path_hash >> 16);
+    header[7] = (uint8_t)(path_hash >> 24);
+    download_cache_put_u64(header + 8, key->size);
+    download_cache_put_u64(header + 16, (uint64_t)key->mtime);
+}
+
+bool q2proto_download_cache_check_header(const q2proto_download_cache_key_t *key, const void *header,
+                                         size_t header_size)
+{
+    if (header_size < Q2PROTO_DOWNLOAD_CACHE_HEADER_SIZE)
+        return false;
+
+    uint8_t expected[Q2PROTO_DOWNLOAD_CACHE_HEADER_SIZE];
+    q2proto_download_cache_make_header(key, expected);
+    return memcmp(header, expected, sizeof(expected)) == 0;
+}
+
+q2proto_error_t q2proto_download_cache_deflate(q2protoio_deflate_args_t *deflate_args, const void *data, size_t size,
+                                               void *out, size_t out_size, size_t *deflated_size)
+{
+#if Q2PROTO_COMPRESSION_DEFLATE
+    uintptr_t deflate_io_arg;
+    CHECKED(server_write, 0, q2protoio_deflate_begin(deflate_args, out_size, Q2P_INFL_DEFL_RAW, &deflate_io_arg));
+
+    const uint8_t *in_ptr = data;
+    size_t in_remaining = size;
+    uint8_t *out_ptr = out;
+    size_t out_remaining = out_size;
+    q2proto_error_t err = Q2P_ERR_SUCCESS;
+    bool has_more_input;
+    do {
+        size_t in_consumed = 0;
+        q2protoio_write_raw(deflate_io_arg, in_ptr, in_remaining, &in_consumed);
+        err = GET_IO_ERROR(deflate_io_arg);
+        if (err != Q2P_ERR_SUCCESS)
+            break;
+        in_ptr += in_consumed;
+        in_remaining -= in_consumed;
+
+        has_more_input = in_remaining > 0;
+        q2proto_deflate_stream_mode_t stream_flag = has_more_input ? Q2P_DEFLATE_DATA_STREAM : Q2P_DEFLATE_DATA_FINISH;
+        const void *compressed_data;
+        size_t compressed_size;
+        err = q2protoio_deflate_get_data(deflate_io_arg, stream_flag, NULL, &compressed_data, &compressed_size);
+        if (err != Q2P_ERR_SUCCESS)
+            break;
+
+        if (compressed_size > out_remaining || (has_more_input && in_consumed == 0)) {
+            err = Q2P_ERR_BUFFER_TOO_SMALL;
+            break;
+        }
+        memcpy(out_ptr, compressed_data, compressed_size);
+        out_ptr += compressed_size;
+        out_remaining -= compressed_size;
+    } while (has_more_input);
+
+    q2protoio_deflate_end(deflate_io_arg);
+    if (err == Q2P_ERR_SUCCESS)
+        *deflated_size = out_size - out_remaining;
+    return err;
+#else
+    return Q2P_ERR_DEFLATE_NOT_SUPPORTED;
+#endif
+}
+
+q2proto_error_t q2proto_server_download_begin_cached(q2proto_servercontext_t *context,
+                                                     const q2proto_download_cache_entry_t *entry,
+                                                     q2proto_download_compress_t fallback_compress,
+                                                     q2protoio_deflate_args_t *deflate_args,
+                                                     q2proto_server_download_state_t *state, const uint8_t **data,
+                                                     size_t *remaining)
+{
+    if (fallback_compress == Q2PROTO_DOWNLOAD_COMPRESS_RAW)
+        return Q2P_ERR_INVALID_ARGUMENT;
+
+    if (entry->deflated && context->features.download_compress_raw) {
+        *data = entry->deflated;
+        *remaining = entry->deflated_size;
+        return q2proto_server_download_begin(context, entry->deflated_size, Q2PROTO_DOWNLOAD_COMPRESS_RAW,
+                                             deflate_args, state);
+    }
+
+    *data = entry->data;
+    *remaining = entry->size;
+    return q2proto_server_download_begin(context, entry->size, fallback_compress, deflate_args, state);
+}
@@ -0,0 +1,133 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#define Q2PROTO_BUILD
+#include "q2proto_internal.h"
+
+#include "q2proto/q2proto_download_scheduler.h"
+
+// Smallest useful allowance: room for the header of an uncompressed download message and one byte of data
+#define MIN_QUANTUM (SVC_DOWNLOAD_SIZE + 1)
+
+void q2proto_download_scheduler_init(q2proto_download_scheduler_t *scheduler, size_t frame_budget)
+{
+    memset(scheduler, 0, sizeof(*scheduler));
+    scheduler->frame_budget = frame_budget;
+}
+
+void q2proto_download_sched_client_init(q2proto_download_sched_client_t *client,
+                                        q2proto_server_download_state_t *download, uintptr_t io_arg,
+                                        const void *data, size_t size)
+{
+    memset(client, 0, sizeof(*client));
+    client->download = download;
+    client->io_arg = io_arg;
+    client->data = data;
+    client->remaining = size;
+}
+
+static bool sched_client_active(const q2proto_download_sched_client_t *client)
+{
+    return client->download && !client->complete && client->error == Q2P_ERR_SUCCESS;
+}
+
+static q2proto_error_t sched_client_write(q2proto_download_sched_client_t *client, size_t packet_remaining,
+                                          size_t *used)
+{
+    q2proto_svc_message_t message = {.type = Q2P_SVC_DOWNLOAD};
+    q2proto_error_t result;
+    if (client->remaining == 0)
+        result = q2proto_server_download_finish(client->download, &message.download);
+    else
+        result = q2proto_server_download_data(client->download, &client->data, &client->remaining,
+                                              packet_remaining, &message.download);
+    if (result != Q2P_ERR_SUCCESS && result != Q2P_ERR_DOWNLOAD_COMPLETE)
+        return result;
+
+    q2proto_error_t err = q2proto_server_write(client->download->context, client->io_arg, &message);
+    if (err != Q2P_ERR_SUCCESS)
+        return err;
+
+    size_t payload = message.download.size > 0 ? message.download.size : 0;
+    client->bytes_sent += payload;
+    client->frame_bytes += payload;
+    client->messages_sent++;
+    if (result == Q2P_ERR_DOWNLOAD_COMPLETE || client->remaining == 0)
+        client->complete = true;
+
+    *used = q2proto_download_header_size(client->download, &message.download) + payload;
+    return Q2P_ERR_SUCCESS;
+}
+
+q2proto_error_t q2proto_download_scheduler_run_frame(q2proto_download_scheduler_t *scheduler,
+                                                     q2proto_download_sched_client_t *clients, size_t num_clients)
+{
+    if (num_clients == 0)
+        return Q2P_ERR_SUCCESS;
+
+    size_t num_active = 0;
+    for (size_t i = 0; i < num_clients; i++) {
+        clients[i].frame_bytes = 0;
+        if (sched_client_active(&clients[i]))
+            num_active++;
+    }
+    if (num_active == 0)
+        return Q2P_ERR_SUCCESS;
+
+    size_t quantum = scheduler->quantum ? scheduler->quantum : scheduler->frame_budget / num_active;
+    quantum = MAX(quantum, MIN_QUANTUM);
+    size_t budget = scheduler->frame_budget;
+
+    size_t first = scheduler->next_client % num_clients;
+    for (size_t n = 0; n < num_clients; n++) {
+        q2proto_download_sched_client_t *client = &clients[(first + n) % num_clients];
+        if (!sched_client_active(client))
+            continue;
+
+        // Cap carried-over allowance, to limit bursts after stalls
+        client->deficit = MIN(client->deficit + quantum, 2 * quantum);
+
+        size_t packet_remaining = MIN(client->deficit, budget);
+        packet_remaining = MIN(packet_remaining, q2protoio_write_available(client->io_arg));
+        if (packet_remaining < MIN_QUANTUM) {
+            client->frames_stalled++;
+            continue;
+        }
+
+        size_t used = 0;
+        q2proto_error_t err = sched_client_write(client, packet_remaining, &used);
+        if (err == Q2P_ERR_NOT_ENOUGH_PACKET_SPACE) {
+            client->frames_stalled++;
+            continue;
+        } else if (err != Q2P_ERR_SUCCESS) {
+            client->error = err;
+            client->deficit = 0;
+            continue;
+        }
+
+        used = MIN(used, client->deficit);
+        client->deficit -= used;
+        budget -= MIN(used, budget);
+        if (client->complete)
+            client->deficit = 0;
+    }
+
+    // Rotate starting client, so leftovers of an exhausted budget don't always hit the same clients
+    scheduler->next_client = (first + 1) % num_clients;
+    return Q2P_ERR_SUCCESS;
+}
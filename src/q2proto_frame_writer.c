@@ -0,0 +1,136 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#define Q2PROTO_BUILD
+#include "q2proto_internal.h"
+
+#include "q2proto/q2proto_frame_writer.h"
+
+#include <stdlib.h>
+
+// Priority layout: bit 31: player relevant; bits 24-30: change recency; bits 0-23: closeness
+#define PRIORITY_PLAYER_RELEVANT BIT(31)
+#define PRIORITY_RECENCY_SHIFT   24
+#define PRIORITY_RECENCY_MAX     127
+#define PRIORITY_CLOSENESS_MAX   0xffffff
+
+uint32_t q2proto_frame_entity_priority(float distance, uint32_t frames_since_change, bool player_relevant)
+{
+    uint32_t priority = player_relevant ? PRIORITY_PLAYER_RELEVANT : 0;
+    priority |= (PRIORITY_RECENCY_MAX - MIN(frames_since_change, PRIORITY_RECENCY_MAX)) << PRIORITY_RECENCY_SHIFT;
+    uint32_t distance_int = 0;
+    if (distance >= PRIORITY_CLOSENESS_MAX)
+        distance_int = PRIORITY_CLOSENESS_MAX;
+    else if (distance > 0)
+        distance_int = (uint32_t)distance;
+    priority |= PRIORITY_CLOSENESS_MAX - distance_int;
+    return priority;
+}
+
+static int compare_priority(const void *a, const void *b)
+{
+    const q2proto_frame_entity_t *entity_a = a;
+    const q2proto_frame_entity_t *entity_b = b;
+    // Sort by descending priority; on ties, prefer smaller deltas, then lower entity numbers
+    if (entity_a->priority != entity_b->priority)
+        return entity_a->priority > entity_b->priority ? -1 : 1;
+    if (entity_a->size != entity_b->size)
+        return entity_a->size < entity_b->size ? -1 : 1;
+    return (int)entity_a->entnum - (int)entity_b->entnum;
+}
+
+static int compare_entnum(const void *a, const void *b)
+{
+    const q2proto_frame_entity_t *entity_a = a;
+    const q2proto_frame_entity_t *entity_b = b;
+    return (int)entity_a->entnum - (int)entity_b->entnum;
+}
+
+static q2proto_error_t frame_entity_size(q2proto_servercontext_t *context, const q2proto_frame_entity_t *entity,
+                                         size_t *size)
+{
+    if (entity->remove) {
+        *size = q2proto_common_server_entity_bits_size(U_REMOVE, entity->entnum);
+        return Q2P_ERR_SUCCESS;
+    }
+
+    q2proto_entity_state_delta_t delta;
+    q2proto_server_make_entity_state_delta(context, entity->from, entity->to, entity->write_old_origin, &delta);
+    return q2proto_server_entity_delta_size(context, entity->entnum, &delta, size);
+}
+
+static q2proto_error_t write_frame_entity(q2proto_servercontext_t *context, uintptr_t io_arg,
+                                          q2proto_delta_cache_t *cache, const q2proto_frame_entity_t *entity)
+{
+    if (!entity->remove)
+        return q2proto_server_write_entity_delta_cached(cache, context, io_arg, entity->entnum, entity->from,
+                                                        entity->to, entity->write_old_origin);
+
+    q2proto_svc_message_t message = {.type = Q2P_SVC_FRAME_ENTITY_DELTA, .frame_entity_delta = {0}};
+    message.frame_entity_delta.newnum = entity->entnum;
+    message.frame_entity_delta.remove = true;
+    return q2proto_server_write(context, io_arg, &message);
+}
+
+q2proto_error_t q2proto_server_write_frame_entities(q2proto_servercontext_t *context, uintptr_t io_arg,
+                                                    q2proto_delta_cache_t *cache, q2proto_frame_entity_t *entities,
+                                                    size_t num_entities, q2proto_frame_write_result_t *result)
+{
+    size_t terminator_size = q2proto_common_server_entity_bits_size(0, 0);
+    size_t available = q2protoio_write_available(io_arg);
+    if (available < terminator_size)
+        return Q2P_ERR_NOT_ENOUGH_PACKET_SPACE;
+    size_t budget = available - terminator_size;
+
+    for (size_t i = 0; i < num_entities; i++) {
+        size_t size;
+        CHECKED(server_write, io_arg, frame_entity_size(context, &entities[i], &size));
+        entities[i].size = (uint32_t)MIN(size, UINT32_MAX);
+    }
+
+    // Pick deltas by priority
+    qsort(entities, num_entities, sizeof(*entities), compare_priority);
+    for (size_t i = 0; i < num_entities; i++) {
+        q2proto_frame_entity_t *entity = &entities[i];
+        entity->deferred = entity->size > budget;
+        if (!entity->deferred)
+            budget -= entity->size;
+    }
+    // Deltas need to be written in entity order
+    qsort(entities, num_entities, sizeof(*entities), compare_entnum);
+
+    q2proto_frame_write_result_t stats = {0};
+    for (size_t i = 0; i < num_entities; i++) {
+        const q2proto_frame_entity_t *entity = &entities[i];
+        if (entity->deferred) {
+            stats.num_deferred++;
+            continue;
+        }
+        CHECKED(server_write, io_arg, write_frame_entity(context, io_arg, cache, entity));
+        stats.num_written++;
+        stats.bytes_written += entity->size;
+    }
+
+    q2proto_svc_message_t terminator = {.type = Q2P_SVC_FRAME_ENTITY_DELTA, .frame_entity_delta = {0}};
+    CHECKED(server_write, io_arg, q2proto_server_write(context, io_arg, &terminator));
+    stats.bytes_written += terminator_size;
+
+    if (result)
+        *result = stats;
+    return Q2P_ERR_SUCCESS;
+}
@@ -23,6 +23,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "q2proto/q2proto.h"
 
 #include "q2proto_internal_common.h"
+#include "q2proto_internal_context_stats.h"
 #include "q2proto_internal_debug.h"
 #include "q2proto_internal_defs.h"
 #include "q2proto_internal_download.h"
@@ -33,6 +34,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "q2proto_internal_packing.h"
 #include "q2proto_internal_protocol.h"
 #include "q2proto_internal_string.h"
+#include "q2proto_internal_trace.h"
 #include "q2proto_proto_kex.h"
 #include "q2proto_proto_q2pro.h"
 #include "q2proto_proto_q2pro_extdemo.h"
@@ -112,7 +112,8 @@ int q2proto_common_entity_bits_size(uint64_t bits)
     return bits_size;
 }
 
-q2proto_error_t q2proto_common_server_write_entity_bits(uintptr_t io_arg, uint64_t bits, uint16_t entnum)
+// Add entity number and "more bits" flags to entity bits
+static uint64_t server_complete_entity_bits(uint64_t bits, uint16_t entnum)
 {
     if (entnum >= 256)
         bits |= U_NUMBER16;
@@ -125,6 +126,17 @@ q2proto_error_t q2proto_common_server_write_entity_bits(uintptr_t io_arg, uint64
         bits |= U_MOREBITS2 | U_MOREBITS1;
     else if (bits & 0x0000ff00)
         bits |= U_MOREBITS1;
+    return bits;
+}
+
+size_t q2proto_common_server_entity_bits_size(uint64_t bits, uint16_t entnum)
+{
+    return q2proto_common_entity_bits_size(server_complete_entity_bits(bits, entnum));
+}
+
+q2proto_error_t q2proto_common_server_write_entity_bits(uintptr_t io_arg, uint64_t bits, uint16_t entnum)
+{
+    bits = server_complete_entity_bits(bits, entnum);
 
     WRITE_CHECKED(server_write, io_arg, u8, bits & 0xff);
     if (bits & U_MOREBITS1)
@@ -351,6 +363,24 @@ q2proto_error_t q2proto_common_server_write_packed_direction(uintptr_t io_arg, c
     return Q2P_ERR_SUCCESS;
 }
 
+q2proto_error_t q2proto_common_server_write_download_data(uintptr_t io_arg, const q2proto_svc_download_t *download)
+{
+    if (download->size <= 0)
+        return Q2P_ERR_SUCCESS;
+
+#if Q2PROTO_WRITE_RAW_SEGMENT
+    if (download->data_reference) {
+        WRITE_CHECKED(server_write, io_arg, raw_segment, download->data, download->size);
+        return Q2P_ERR_SUCCESS;
+    }
+#endif
+
+    void *p;
+    CHECKED_IO(server_write, io_arg, p = q2protoio_write_reserve_raw(io_arg, download->size), "reserve download data");
+    memcpy(p, download->data, download->size);
+    return Q2P_ERR_SUCCESS;
+}
+
 q2proto_error_t q2proto_common_client_write_nop(uintptr_t io_arg)
 {
     WRITE_CHECKED(client_write, io_arg, u8, clc_nop);
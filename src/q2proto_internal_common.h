@@ -47,10 +47,32 @@ static inline uint64_t q2proto_common_choose_width_flags(uint32_t value, uint64_
         return flag8;
 }
 
+/**
+ * Return number of bytes occupied by a value written with the width indicated by the U_FOO8, U_FOO16 flags
+ * (see q2proto_common_choose_width_flags()).
+ * \param bits Protocol bits.
+ * \param flag8 Flag for 8-bit wide value.
+ * \param flag16 Flag for 16-bit wide value.
+ * \returns Value size in bytes; 0 if no flag is set.
+ */
+static inline size_t q2proto_common_width_flags_size(uint64_t bits, uint64_t flag8, uint64_t flag16)
+{
+    if ((bits & (flag8 | flag16)) == (flag8 | flag16))
+        return 4;
+    else if (bits & flag16)
+        return 2;
+    else if (bits & flag8)
+        return 1;
+    else
+        return 0;
+}
+
 Q2PROTO_PRIVATE_API q2proto_error_t q2proto_common_client_read_entity_bits(uintptr_t io_arg, uint64_t *bits,
                                                                            uint16_t *entnum);
 /// Debug helper: Return number of bytes occupied by given entity bits
 Q2PROTO_PRIVATE_API int q2proto_common_entity_bits_size(uint64_t bits);
+/// Return number of bytes written by q2proto_common_server_write_entity_bits()
+Q2PROTO_PRIVATE_API size_t q2proto_common_server_entity_bits_size(uint64_t bits, uint16_t entnum);
 Q2PROTO_PRIVATE_API q2proto_error_t q2proto_common_server_write_entity_bits(uintptr_t io_arg, uint64_t bits,
                                                                             uint16_t entnum);
 
@@ -104,6 +126,9 @@ q2proto_common_server_write_configstring(uintptr_t io_arg, const q2proto_svc_con
 Q2PROTO_PRIVATE_API q2proto_error_t
 q2proto_common_server_write_centerprint(uintptr_t io_arg, const q2proto_svc_centerprint_t *centerprint);
 Q2PROTO_PRIVATE_API q2proto_error_t q2proto_common_server_write_packed_direction(uintptr_t io_arg, const float dir[3]);
+/// Write the data part of a download message
+Q2PROTO_PRIVATE_API q2proto_error_t q2proto_common_server_write_download_data(uintptr_t io_arg,
+                                                                              const q2proto_svc_download_t *download);
 
 Q2PROTO_PRIVATE_API q2proto_error_t q2proto_common_client_write_nop(uintptr_t io_arg);
 Q2PROTO_PRIVATE_API q2proto_error_t q2proto_common_client_write_userinfo(uintptr_t io_arg,
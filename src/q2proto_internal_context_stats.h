@@ -0,0 +1,53 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/**\file
+ * Context statistics counting
+ */
+#ifndef Q2PROTO_INTERNAL_CONTEXT_STATS_H_
+#define Q2PROTO_INTERNAL_CONTEXT_STATS_H_
+
+#include "q2proto/q2proto.h"
+
+#if Q2PROTO_CONTEXT_STATS
+/**
+ * Count a server message read or written.
+ * \param stats Statistics of the context.
+ * \param err Result of reading or writing the message. Messages are only counted on success.
+ * \param start Position before the message was read or written.
+ * \param end Position after the message was read or written.
+ * \param svc_message Message that was read or written.
+ */
+Q2PROTO_PRIVATE_API void q2proto_context_stats_svc_message(q2proto_context_stats_t *stats, q2proto_error_t err, size_t start,
+                                                   size_t end, const q2proto_svc_message_t *svc_message);
+/// Count a client message read or written. See q2proto_context_stats_svc_message().
+Q2PROTO_PRIVATE_API void q2proto_context_stats_clc_message(q2proto_context_stats_t *stats, q2proto_error_t err, size_t start,
+                                                   size_t end, const q2proto_clc_message_t *clc_message);
+/// Count a failure, if \a err is a negative error code.
+Q2PROTO_PRIVATE_API void q2proto_context_stats_failure(q2proto_context_stats_t *stats, q2proto_error_t err);
+/**
+ * Count a zpacket read or written.
+ * \param stats Statistics of the context.
+ * \param compressed_len Size of the compressed data, excluding the zpacket header.
+ * \param uncompressed_len Size of the data after decompression.
+ */
+Q2PROTO_PRIVATE_API void q2proto_context_stats_zpacket(q2proto_context_stats_t *stats, size_t compressed_len,
+                                               size_t uncompressed_len);
+#endif
+
+#endif // Q2PROTO_INTERNAL_CONTEXT_STATS_H_
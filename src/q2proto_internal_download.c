@@ -42,22 +42,29 @@ q2proto_error_t q2proto_download_common_data(q2proto_server_download_state_t *st
                                              size_t *remaining, size_t packet_remaining,
                                              q2proto_svc_download_t *svc_download)
 {
-    if (packet_remaining < 4)
+    if (packet_remaining < SVC_DOWNLOAD_SIZE)
         return Q2P_ERR_NOT_ENOUGH_PACKET_SPACE;
 
-    size_t download_size = packet_remaining - 4;
+    size_t download_size = packet_remaining - SVC_DOWNLOAD_SIZE;
     download_size = MIN(download_size, *remaining);
     download_size = MIN(download_size, INT16_MAX);
 
     memset(svc_download, 0, sizeof(*svc_download));
     svc_download->data = *data;
     svc_download->size = (int16_t)download_size;
+    svc_download->data_reference = true;
 
     *data += download_size;
     *remaining -= download_size;
     return q2proto_download_common_complete_struct(state, *remaining, svc_download);
 }
 
+size_t q2proto_download_header_size(const q2proto_server_download_state_t *state,
+                                    const q2proto_svc_download_t *svc_download)
+{
+    return svc_download->compressed ? state->context->download_funcs->zdownload_size : SVC_DOWNLOAD_SIZE;
+}
+
 q2proto_error_t q2proto_download_common_finish(q2proto_server_download_state_t *state,
                                                q2proto_svc_download_t *svc_download)
 {
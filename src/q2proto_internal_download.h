@@ -34,6 +34,9 @@ enum {
     Q2PROTO_DOWNLOAD_DATA_RAW_DEFLATE,
 };
 
+/// Size of the header of an (uncompressed) download message: command, size, percentage
+#define SVC_DOWNLOAD_SIZE 4
+
 /**\name Stateful download helpers
  * @{ */
 /// Stateful download function table
@@ -49,6 +52,8 @@ struct q2proto_download_funcs_s {
     q2proto_error_t (*finish)(q2proto_server_download_state_t *state, q2proto_svc_download_t *svc_download);
     /// Fill a download message for an aborted download. \sa q2proto_server_download_aborted
     q2proto_error_t (*abort)(q2proto_server_download_state_t *state, q2proto_svc_download_t *svc_download);
+    /// Size of the header of a compressed download message. 0 if the protocol doesn't support compressed downloads.
+    size_t zdownload_size;
 };
 
 /// Common "begin download" logic
@@ -63,6 +68,9 @@ Q2PROTO_PRIVATE_API q2proto_error_t q2proto_download_common_data(q2proto_server_
                                                                  const uint8_t **data, size_t *remaining,
                                                                  size_t max_message_size,
                                                                  q2proto_svc_download_t *svc_download);
+/// Size of the download message header written for \a svc_download
+Q2PROTO_PRIVATE_API size_t q2proto_download_header_size(const q2proto_server_download_state_t *state,
+                                                        const q2proto_svc_download_t *svc_download);
 /// Default "finish download" implementation
 Q2PROTO_PRIVATE_API q2proto_error_t q2proto_download_common_finish(q2proto_server_download_state_t *state,
                                                                    q2proto_svc_download_t *svc_download);
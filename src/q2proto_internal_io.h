@@ -450,6 +450,8 @@ static inline void q2protoio_write_float(uintptr_t io_arg, float x)
 static inline void q2protoio_write_string(uintptr_t io_arg, const q2proto_string_t *str)
 {
     char *p = (char *)q2protoio_write_reserve_raw(io_arg, str->len + 1);
+    if (!p)
+        return; // error is reported by q2protoio_get_error()
     memcpy(p, str->str, str->len);
     p[str->len] = 0;
 }
@@ -523,6 +525,52 @@ static inline q2proto_error_t server_write_float_coord(uintptr_t io_arg, const f
 
 /** @} */
 
+/**\name Encoded size helpers
+ * Return the number of bytes written by the corresponding write functions
+ * @{ */
+static inline size_t q2protoio_q2pro_i23_size(int32_t x, int32_t prev)
+{
+    int delta = x - prev;
+    return (delta >= -0x4000 && delta < 0x4000) ? 2 : 3;
+}
+
+static inline size_t q2protoio_var_u64_size(uint64_t x)
+{
+    size_t size = 1;
+    while ((x >>= 7) != 0)
+        size++;
+    return size;
+}
+
+static inline size_t q2protoio_var_coords_q2pro_i23_size(const q2proto_var_coords_t *pos)
+{
+    return q2protoio_q2pro_i23_size(q2proto_var_coords_get_int_comp(pos, 0), 0)
+           + q2protoio_q2pro_i23_size(q2proto_var_coords_get_int_comp(pos, 1), 0)
+           + q2protoio_q2pro_i23_size(q2proto_var_coords_get_int_comp(pos, 2), 0);
+}
+
+static inline size_t server_stats_values_size(uint64_t statbits)
+{
+    size_t size = 0;
+    for (; statbits != 0; statbits &= statbits - 1)
+        size += 2;
+    return size;
+}
+
+static inline size_t server_q2pro_extv2_blends_size(const q2proto_color_delta_t *blend,
+                                                    const q2proto_color_delta_t *damage_blend)
+{
+    size_t size = 1;
+    for (int i = 0; i < 4; i++) {
+        if (blend->delta_bits & BIT(i))
+            size++;
+        if (damage_blend->delta_bits & BIT(i))
+            size++;
+    }
+    return size;
+}
+/** @} */
+
 /**\name Parsing helper
  * @{ */
 // helper to combine checking against a protocol flag (U_xxx, PS_xxx) and set the corresponding Q2P_xxx flag
@@ -19,6 +19,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define Q2PROTO_BUILD
 #include "q2proto_internal_maybe_zpacket.h"
 
+#include "q2proto_internal_context_stats.h"
 #include "q2proto_internal_io.h"
 #include "q2proto_internal_protocol.h"
 
@@ -37,6 +38,9 @@ q2proto_error_t q2proto_maybe_zpacket_begin(q2proto_servercontext_t *context, q2
     memset(state, 0, sizeof(*state));
     state->original_io_arg = io_arg;
     state->zpacket_cmd = context->zpacket_cmd;
+    #if Q2PROTO_CONTEXT_STATS
+    state->stats = &context->stats;
+    #endif
     if (deflate_args && context->features.enable_deflate) {
         size_t max_deflated = q2protoio_write_available(io_arg);
         if (max_deflated < MIN_COMPRESS_SIZE)
@@ -71,6 +75,9 @@ q2proto_error_t q2proto_maybe_zpacket_end(q2proto_maybe_zpacket_t *state, uintpt
     WRITE_CHECKED(server_write, state->original_io_arg, u16, uncompressed_len);
     WRITE_CHECKED(server_write, state->original_io_arg, raw, data, compressed_len, NULL);
 
+    #if Q2PROTO_CONTEXT_STATS
+    q2proto_context_stats_zpacket(state->stats, compressed_len, uncompressed_len);
+    #endif
     return q2protoio_deflate_end(new_io_arg);
 
 error:
@@ -30,6 +30,9 @@ typedef struct q2proto_maybe_zpacket_s {
     uintptr_t original_io_arg;
     bool deflate_enabled;
     uint8_t zpacket_cmd;
+    #if Q2PROTO_CONTEXT_STATS
+    q2proto_context_stats_t *stats;
+    #endif
 #else
     char dummy;
 #endif
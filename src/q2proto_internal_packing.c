@@ -22,6 +22,15 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "q2proto_internal_defs.h"
 #include "q2proto_internal_io.h"
 
+#include <stddef.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+    #define PLAYER_STATE_DIFF_SSE2 1
+    #include <emmintrin.h>
+#else
+    #define PLAYER_STATE_DIFF_SSE2 0
+#endif
+
 void q2proto_packing_make_entity_state_delta(const q2proto_packed_entity_state_t *from,
                                              const q2proto_packed_entity_state_t *to, bool write_old_origin,
                                              bool extended_state, q2proto_entity_state_delta_t *delta)
@@ -138,6 +147,174 @@ void q2proto_packing_make_entity_state_delta(const q2proto_packed_entity_state_t
 #endif
 }
 
+/* Player state changes are determined by building a bitmap of all differing bytes of the packed states
+ * (comparing 16 or 8 bytes at a time), and extracting the changed fields from that bitmap. */
+#define PLAYER_STATE_DIFF_WORDS ((sizeof(q2proto_packed_player_state_t) + 63) / 64)
+
+// Return a mask with a bit set for each non-zero byte in x
+static inline uint64_t nonzero_bytes_mask(uint64_t x)
+{
+    // Set high bit of each non-zero byte...
+    x = (((x & 0x7f7f7f7f7f7f7f7fULL) + 0x7f7f7f7f7f7f7f7fULL) | x) & 0x8080808080808080ULL;
+    // ... and gather them into the top byte, in memory order
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    return ((x >> 7) * 0x8040201008040201ULL) >> 56;
+#else
+    return ((x >> 7) * 0x0102040810204080ULL) >> 56;
+#endif
+}
+
+static void player_state_diff_bitmap(const q2proto_packed_player_state_t *from,
+                                     const q2proto_packed_player_state_t *to,
+                                     uint64_t bitmap[PLAYER_STATE_DIFF_WORDS])
+{
+    const uint8_t *a = (const uint8_t *)from;
+    const uint8_t *b = (const uint8_t *)to;
+    size_t n = 0;
+
+    memset(bitmap, 0, PLAYER_STATE_DIFF_WORDS * sizeof(uint64_t));
+#if PLAYER_STATE_DIFF_SSE2
+    for (; n + 16 <= sizeof(*from); n += 16) {
+        __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + n)), _mm_loadu_si128((const __m128i *)(b + n)));
+        uint64_t diff = (uint16_t)~_mm_movemask_epi8(eq);
+        bitmap[n / 64] |= diff << (n % 64);
+    }
+#endif
+    for (; n + 8 <= sizeof(*from); n += 8) {
+        uint64_t x, y;
+        memcpy(&x, a + n, sizeof(x));
+        memcpy(&y, b + n, sizeof(y));
+        bitmap[n / 64] |= nonzero_bytes_mask(x ^ y) << (n % 64);
+    }
+    for (; n < sizeof(*from); n++) {
+        if (a[n] != b[n])
+            bitmap[n / 64] |= BIT_ULL(n % 64);
+    }
+}
+
+// Get changed bytes of a range of the player state (at most 64 bytes), as a bit mask
+static inline uint64_t diff_bytes(const uint64_t bitmap[PLAYER_STATE_DIFF_WORDS], size_t offset, size_t size)
+{
+    size_t word = offset / 64, shift = offset % 64;
+    uint64_t bits = bitmap[word] >> shift;
+    if (shift != 0 && word + 1 < PLAYER_STATE_DIFF_WORDS)
+        bits |= bitmap[word + 1] << (64 - shift);
+    return size < 64 ? bits & (BIT_ULL(size) - 1) : bits;
+}
+
+#define FIELD_DIFF(BITMAP, FIELD)                                         \
+    diff_bytes(BITMAP, offsetof(q2proto_packed_player_state_t, FIELD), \
+               sizeof(((const q2proto_packed_player_state_t *)0)->FIELD))
+
+// Reduce changed bytes of an array to changed array elements
+static inline unsigned diff_components(uint64_t bytes, size_t comp_size, size_t num_comps)
+{
+    uint64_t comp_mask = BIT_ULL(comp_size) - 1;
+    unsigned result = 0;
+    for (size_t c = 0; c < num_comps; c++) {
+        if ((bytes >> (c * comp_size)) & comp_mask)
+            result |= BIT(c);
+    }
+    return result;
+}
+
+// Reduce changed bytes of an array of 2-byte elements to changed array elements
+static inline uint32_t diff_components_16(uint64_t bytes)
+{
+    bytes = (bytes | (bytes >> 1)) & 0x5555555555555555ULL;
+    bytes = (bytes | (bytes >> 1)) & 0x3333333333333333ULL;
+    bytes = (bytes | (bytes >> 2)) & 0x0f0f0f0f0f0f0f0fULL;
+    bytes = (bytes | (bytes >> 4)) & 0x00ff00ff00ff00ffULL;
+    bytes = (bytes | (bytes >> 8)) & 0x0000ffff0000ffffULL;
+    bytes = (bytes | (bytes >> 16)) & 0x00000000ffffffffULL;
+    return (uint32_t)bytes;
+}
+
+void q2proto_packing_player_state_changes(const q2proto_packed_player_state_t *from,
+                                          const q2proto_packed_player_state_t *to,
+                                          q2proto_player_state_changes_t *changes)
+{
+    uint64_t bitmap[PLAYER_STATE_DIFF_WORDS];
+    player_state_diff_bitmap(from, to, bitmap);
+
+    memset(changes, 0, sizeof(*changes));
+
+    uint32_t delta_bits = 0;
+    if (FIELD_DIFF(bitmap, pm_type))
+        delta_bits |= Q2P_PSD_PM_TYPE;
+    if (FIELD_DIFF(bitmap, pm_time))
+        delta_bits |= Q2P_PSD_PM_TIME;
+    if (FIELD_DIFF(bitmap, pm_flags))
+        delta_bits |= Q2P_PSD_PM_FLAGS;
+    if (FIELD_DIFF(bitmap, pm_gravity))
+        delta_bits |= Q2P_PSD_PM_GRAVITY;
+    if (FIELD_DIFF(bitmap, pm_delta_angles))
+        delta_bits |= Q2P_PSD_PM_DELTA_ANGLES;
+    if (FIELD_DIFF(bitmap, viewoffset))
+        delta_bits |= Q2P_PSD_VIEWOFFSET;
+    if (FIELD_DIFF(bitmap, kick_angles))
+        delta_bits |= Q2P_PSD_KICKANGLES;
+    if (FIELD_DIFF(bitmap, gunindex))
+        delta_bits |= Q2P_PSD_GUNINDEX;
+    if (FIELD_DIFF(bitmap, gunframe))
+        delta_bits |= Q2P_PSD_GUNFRAME;
+    if (FIELD_DIFF(bitmap, fov))
+        delta_bits |= Q2P_PSD_FOV;
+    if (FIELD_DIFF(bitmap, rdflags))
+        delta_bits |= Q2P_PSD_RDFLAGS;
+#if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_GUNRATE_VIEWHEIGHT
+    if (FIELD_DIFF(bitmap, pm_viewheight))
+        delta_bits |= Q2P_PSD_PM_VIEWHEIGHT;
+    if (FIELD_DIFF(bitmap, gunrate))
+        delta_bits |= Q2P_PSD_GUNRATE;
+#endif
+#if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_GUNSKIN
+    if (FIELD_DIFF(bitmap, gunskin))
+        delta_bits |= Q2P_PSD_GUNSKIN;
+#endif
+    changes->delta_bits = delta_bits;
+
+    changes->viewangles = diff_components(FIELD_DIFF(bitmap, viewangles), sizeof(to->viewangles[0]), 3);
+    changes->gunoffset = diff_components(FIELD_DIFF(bitmap, gunoffset), sizeof(to->gunoffset[0]), 3);
+    changes->gunangles = diff_components(FIELD_DIFF(bitmap, gunangles), sizeof(to->gunangles[0]), 3);
+    changes->blend = diff_components(FIELD_DIFF(bitmap, blend), sizeof(to->blend[0]), 4);
+#if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_DAMAGE_BLEND
+    changes->damage_blend = diff_components(FIELD_DIFF(bitmap, damage_blend), sizeof(to->damage_blend[0]), 4);
+#endif
+
+    for (size_t i = 0; i < Q2PROTO_STATS; i += 32) {
+        uint64_t stats_bytes = diff_bytes(bitmap, offsetof(q2proto_packed_player_state_t, stats) + i * sizeof(to->stats[0]),
+                                          MIN(Q2PROTO_STATS - i, 32) * sizeof(to->stats[0]));
+        changes->statbits |= (uint64_t)diff_components_16(stats_bytes) << i;
+    }
+
+#if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_FOG
+    changes->fog_color = diff_components(FIELD_DIFF(bitmap, fog_color), 1, 3);
+    changes->heightfog_start_color = diff_components(FIELD_DIFF(bitmap, heightfog_start_color), 1, 3);
+    changes->heightfog_end_color = diff_components(FIELD_DIFF(bitmap, heightfog_end_color), 1, 3);
+    if (FIELD_DIFF(bitmap, fog_density) || FIELD_DIFF(bitmap, fog_skyfactor))
+        changes->fog_flags |= Q2P_FOG_DENSITY_SKYFACTOR;
+    if (FIELD_DIFF(bitmap, heightfog_density))
+        changes->fog_flags |= Q2P_HEIGHTFOG_DENSITY;
+    if (FIELD_DIFF(bitmap, heightfog_falloff))
+        changes->fog_flags |= Q2P_HEIGHTFOG_FALLOFF;
+    if (FIELD_DIFF(bitmap, heightfog_start_dist))
+        changes->fog_flags |= Q2P_HEIGHTFOG_START_DIST;
+    if (FIELD_DIFF(bitmap, heightfog_end_dist))
+        changes->fog_flags |= Q2P_HEIGHTFOG_END_DIST;
+#endif
+}
+
+void q2proto_packing_set_stats_delta(q2proto_svc_playerstate_t *delta, const q2proto_packed_player_state_t *to,
+                                     uint64_t statbits)
+{
+    delta->statbits = statbits;
+    for (int i = 0; statbits != 0; i++, statbits >>= 1) {
+        if (statbits & 1)
+            delta->stats[i] = to->stats[i];
+    }
+}
+
 void q2proto_packing_make_player_state_delta(const q2proto_packed_player_state_t *from,
                                              const q2proto_packed_player_state_t *to, q2proto_svc_playerstate_t *delta)
 {
@@ -146,97 +323,75 @@ void q2proto_packing_make_player_state_delta(const q2proto_packed_player_state_t
     if (!from)
         from = &q2proto_null_packed_player_state;
 
-    if (to->pm_type != from->pm_type) {
-        delta->delta_bits |= Q2P_PSD_PM_TYPE;
+    q2proto_player_state_changes_t changes;
+    q2proto_packing_player_state_changes(from, to, &changes);
+    delta->delta_bits = changes.delta_bits;
+
+    if (delta->delta_bits & Q2P_PSD_PM_TYPE)
         delta->pm_type = to->pm_type;
-    }
 
     q2proto_var_coords_set_int(&delta->pm_origin.write.prev, from->pm_origin);
     q2proto_var_coords_set_int(&delta->pm_origin.write.current, to->pm_origin);
     q2proto_var_coords_set_int(&delta->pm_velocity.write.prev, from->pm_velocity);
     q2proto_var_coords_set_int(&delta->pm_velocity.write.current, to->pm_velocity);
 
-    if (to->pm_time != from->pm_time) {
-        delta->delta_bits |= Q2P_PSD_PM_TIME;
+    if (delta->delta_bits & Q2P_PSD_PM_TIME)
         delta->pm_time = to->pm_time;
-    }
-
-    if (to->pm_flags != from->pm_flags) {
-        delta->delta_bits |= Q2P_PSD_PM_FLAGS;
+    if (delta->delta_bits & Q2P_PSD_PM_FLAGS)
         delta->pm_flags = to->pm_flags;
-    }
-
-    if (to->pm_gravity != from->pm_gravity) {
-        delta->delta_bits |= Q2P_PSD_PM_GRAVITY;
+    if (delta->delta_bits & Q2P_PSD_PM_GRAVITY)
         delta->pm_gravity = to->pm_gravity;
-    }
 
-    if (memcmp(&to->pm_delta_angles, &from->pm_delta_angles, sizeof(to->pm_delta_angles)) != 0) {
-        delta->delta_bits |= Q2P_PSD_PM_DELTA_ANGLES;
+    if (delta->delta_bits & Q2P_PSD_PM_DELTA_ANGLES) {
         q2proto_var_angles_set_short_comp(&delta->pm_delta_angles, 0, to->pm_delta_angles[0] & 0xffff);
         q2proto_var_angles_set_short_comp(&delta->pm_delta_angles, 1, to->pm_delta_angles[1] & 0xffff);
         q2proto_var_angles_set_short_comp(&delta->pm_delta_angles, 2, to->pm_delta_angles[2] & 0xffff);
     }
 
 #if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_GUNRATE_VIEWHEIGHT
-    if (to->pm_viewheight != from->pm_viewheight) {
-        delta->delta_bits |= Q2P_PSD_PM_VIEWHEIGHT;
+    if (delta->delta_bits & Q2P_PSD_PM_VIEWHEIGHT)
         delta->pm_viewheight = to->pm_viewheight;
-    }
 #endif
 
-    if (memcmp(to->viewoffset, from->viewoffset, sizeof(to->viewoffset)) != 0) {
-        delta->delta_bits |= Q2P_PSD_VIEWOFFSET;
+    if (delta->delta_bits & Q2P_PSD_VIEWOFFSET) {
         q2proto_var_small_offsets_set_char_comp(&delta->viewoffset, 0, to->viewoffset[0]);
         q2proto_var_small_offsets_set_char_comp(&delta->viewoffset, 1, to->viewoffset[1]);
         q2proto_var_small_offsets_set_char_comp(&delta->viewoffset, 2, to->viewoffset[2]);
     }
 
-    Q2PROTO_SET_ANGLES_DELTA(delta->viewangles, to->viewangles, from->viewangles, short);
+    delta->viewangles.delta_bits = changes.viewangles;
+    if (delta->viewangles.delta_bits != 0) {
+        q2proto_var_angles_set_short_comp(&delta->viewangles.values, 0, to->viewangles[0]);
+        q2proto_var_angles_set_short_comp(&delta->viewangles.values, 1, to->viewangles[1]);
+        q2proto_var_angles_set_short_comp(&delta->viewangles.values, 2, to->viewangles[2]);
+    }
 
-    if (memcmp(to->kick_angles, from->kick_angles, sizeof(to->kick_angles))) {
-        delta->delta_bits |= Q2P_PSD_KICKANGLES;
+    if (delta->delta_bits & Q2P_PSD_KICKANGLES) {
         q2proto_var_small_angles_set_char_comp(&delta->kick_angles, 0, to->kick_angles[0]);
         q2proto_var_small_angles_set_char_comp(&delta->kick_angles, 1, to->kick_angles[1]);
         q2proto_var_small_angles_set_char_comp(&delta->kick_angles, 2, to->kick_angles[2]);
     }
 
+    delta->blend.delta_bits = changes.blend;
+#if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_DAMAGE_BLEND
+    delta->damage_blend.delta_bits = changes.damage_blend;
+#endif
     for (int c = 0; c < 4; c++) {
-        if (to->blend[c] != from->blend[c]) {
+        if (changes.blend & BIT(c))
             q2proto_var_color_set_byte_comp(&delta->blend.values, c, to->blend[c]);
-            delta->blend.delta_bits |= BIT(c);
-        }
 #if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_DAMAGE_BLEND
-        if (to->damage_blend[c] != from->damage_blend[c]) {
+        if (changes.damage_blend & BIT(c))
             q2proto_var_color_set_byte_comp(&delta->damage_blend.values, c, to->damage_blend[c]);
-            delta->damage_blend.delta_bits |= BIT(c);
-        }
 #endif
     }
 
-    if (to->fov != from->fov) {
-        delta->delta_bits |= Q2P_PSD_FOV;
+    if (delta->delta_bits & Q2P_PSD_FOV)
         delta->fov = to->fov;
-    }
-
-    if (to->rdflags != from->rdflags) {
-        delta->delta_bits |= Q2P_PSD_RDFLAGS;
+    if (delta->delta_bits & Q2P_PSD_RDFLAGS)
         delta->rdflags = to->rdflags;
-    }
-    if (to->gunframe != from->gunframe)
-        delta->delta_bits |= Q2P_PSD_GUNFRAME;
-#if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_GUNRATE_VIEWHEIGHT
-    if (to->gunrate != from->gunrate)
-        delta->delta_bits |= Q2P_PSD_GUNRATE;
-#endif
-    delta->gunoffset.delta_bits = 0;
-    delta->gunangles.delta_bits = 0;
-    for (int c = 0; c < 3; c++) {
-        if (to->gunoffset[c] != from->gunoffset[c])
-            delta->gunoffset.delta_bits |= BIT(c);
-        if (to->gunangles[c] != from->gunangles[c])
-            delta->gunangles.delta_bits |= BIT(c);
-    }
+
+    delta->gunoffset.delta_bits = changes.gunoffset;
+    delta->gunangles.delta_bits = changes.gunangles;
     if ((delta->delta_bits & (Q2P_PSD_GUNFRAME | Q2P_PSD_GUNRATE)) || (delta->gunoffset.delta_bits != 0)
         || (delta->gunangles.delta_bits != 0))
     {
@@ -252,12 +407,6 @@ void q2proto_packing_make_player_state_delta(const q2proto_packed_player_state_t
 #endif
     }
 
-    if (to->gunindex != from->gunindex)
-        delta->delta_bits |= Q2P_PSD_GUNINDEX;
-#if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_GUNSKIN
-    if (to->gunskin != from->gunskin)
-        delta->delta_bits |= Q2P_PSD_GUNSKIN;
-#endif
     if (delta->delta_bits & (Q2P_PSD_GUNINDEX | Q2P_PSD_GUNSKIN)) {
         delta->gunindex = to->gunindex;
 #if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_GUNSKIN
@@ -265,71 +414,43 @@ void q2proto_packing_make_player_state_delta(const q2proto_packed_player_state_t
 #endif
     }
 
-    for (int i = 0; i < Q2PROTO_STATS; i++) {
-        if (to->stats[i] != from->stats[i]) {
-            delta->statbits |= BIT_ULL(i);
-            delta->stats[i] = to->stats[i];
-        }
-    }
+    q2proto_packing_set_stats_delta(delta, to, changes.statbits);
 
 #if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_FOG
-    if (from->fog_color[0] != to->fog_color[0])
-        delta->fog.global.color.delta_bits |= BIT(0);
-    if (from->fog_color[1] != to->fog_color[1])
-        delta->fog.global.color.delta_bits |= BIT(1);
-    if (from->fog_color[2] != to->fog_color[2])
-        delta->fog.global.color.delta_bits |= BIT(2);
+    delta->fog.flags = changes.fog_flags;
+    delta->fog.global.color.delta_bits = changes.fog_color;
     if (delta->fog.global.color.delta_bits != 0) {
         q2proto_var_color_set_byte_comp(&delta->fog.global.color.values, 0, to->fog_color[0]);
         q2proto_var_color_set_byte_comp(&delta->fog.global.color.values, 1, to->fog_color[1]);
         q2proto_var_color_set_byte_comp(&delta->fog.global.color.values, 2, to->fog_color[2]);
     }
-    if (from->fog_density != to->fog_density || from->fog_skyfactor != to->fog_skyfactor) {
+    if (delta->fog.flags & Q2P_FOG_DENSITY_SKYFACTOR) {
         q2proto_var_fraction_set_word(&delta->fog.global.density, to->fog_density);
         q2proto_var_fraction_set_word(&delta->fog.global.skyfactor, to->fog_skyfactor);
-        delta->fog.flags |= Q2P_FOG_DENSITY_SKYFACTOR;
     }
 
-    if (from->heightfog_start_color[0] != to->heightfog_start_color[0])
-        delta->fog.height.start_color.delta_bits |= BIT(0);
-    if (from->heightfog_start_color[1] != to->heightfog_start_color[1])
-        delta->fog.height.start_color.delta_bits |= BIT(1);
-    if (from->heightfog_start_color[2] != to->heightfog_start_color[2])
-        delta->fog.height.start_color.delta_bits |= BIT(2);
+    delta->fog.height.start_color.delta_bits = changes.heightfog_start_color;
     if (delta->fog.height.start_color.delta_bits != 0) {
         q2proto_var_color_set_byte_comp(&delta->fog.height.start_color.values, 0, to->heightfog_start_color[0]);
         q2proto_var_color_set_byte_comp(&delta->fog.height.start_color.values, 1, to->heightfog_start_color[1]);
         q2proto_var_color_set_byte_comp(&delta->fog.height.start_color.values, 2, to->heightfog_start_color[2]);
     }
 
-    if (from->heightfog_end_color[0] != to->heightfog_end_color[0])
-        delta->fog.height.end_color.delta_bits |= BIT(0);
-    if (from->heightfog_end_color[1] != to->heightfog_end_color[1])
-        delta->fog.height.end_color.delta_bits |= BIT(1);
-    if (from->heightfog_end_color[2] != to->heightfog_end_color[2])
-        delta->fog.height.end_color.delta_bits |= BIT(2);
+    delta->fog.height.end_color.delta_bits = changes.heightfog_end_color;
     if (delta->fog.height.end_color.delta_bits != 0) {
         q2proto_var_color_set_byte_comp(&delta->fog.height.end_color.values, 0, to->heightfog_end_color[0]);
         q2proto_var_color_set_byte_comp(&delta->fog.height.end_color.values, 1, to->heightfog_end_color[1]);
         q2proto_var_color_set_byte_comp(&delta->fog.height.end_color.values, 2, to->heightfog_end_color[2]);
     }
 
-    if (from->heightfog_density != to->heightfog_density) {
+    if (delta->fog.flags & Q2P_HEIGHTFOG_DENSITY)
         q2proto_var_fraction_set_word(&delta->fog.height.density, to->heightfog_density);
-        delta->fog.flags |= Q2P_HEIGHTFOG_DENSITY;
-    }
-    if (from->heightfog_falloff != to->heightfog_falloff) {
+    if (delta->fog.flags & Q2P_HEIGHTFOG_FALLOFF)
         q2proto_var_fraction_set_word(&delta->fog.height.falloff, to->heightfog_falloff);
-        delta->fog.flags |= Q2P_HEIGHTFOG_FALLOFF;
-    }
-    if (from->heightfog_start_dist != to->heightfog_start_dist) {
+    if (delta->fog.flags & Q2P_HEIGHTFOG_START_DIST)
         q2proto_var_coord_set_int(&delta->fog.height.start_dist, to->heightfog_start_dist);
-        delta->fog.flags |= Q2P_HEIGHTFOG_START_DIST;
-    }
-    if (from->heightfog_end_dist != to->heightfog_end_dist) {
+    if (delta->fog.flags & Q2P_HEIGHTFOG_END_DIST)
         q2proto_var_coord_set_int(&delta->fog.height.end_dist, to->heightfog_end_dist);
-        delta->fog.flags |= Q2P_HEIGHTFOG_END_DIST;
-    }
 #endif
 }
 
@@ -42,6 +42,51 @@ Q2PROTO_PRIVATE_API void q2proto_packing_make_entity_state_delta(const q2proto_p
                                                                  const q2proto_packed_entity_state_t *to,
                                                                  bool write_old_origin, bool extended_state,
                                                                  q2proto_entity_state_delta_t *delta);
+/// Changed fields of a packed player state
+typedef struct q2proto_player_state_changes_s {
+    /// Changed "simple" fields, as a combination of q2proto_playerstate_delta_flags
+    uint32_t delta_bits;
+    /// Changed viewangles components
+    uint8_t viewangles;
+    /// Changed gunoffset components
+    uint8_t gunoffset;
+    /// Changed gunangles components
+    uint8_t gunangles;
+    /// Changed blend components
+    uint8_t blend;
+    /// Changed damage_blend components
+    uint8_t damage_blend;
+    /// Changed fog_color components
+    uint8_t fog_color;
+    /// Changed heightfog_start_color components
+    uint8_t heightfog_start_color;
+    /// Changed heightfog_end_color components
+    uint8_t heightfog_end_color;
+    /// Changed fog fields, as a combination of q2proto_fog_flags
+    uint32_t fog_flags;
+    /// Changed stats
+    uint64_t statbits;
+} q2proto_player_state_changes_t;
+
+/**
+ * Determine the changed fields between two player states.
+ * Compares the whole packed state at once, then extracts the per-field changes, shared by the player state delta
+ * functions of all protocols.
+ * \param from From/old/previous player state. Must not be \c NULL.
+ * \param to To/new/current player state.
+ * \param changes Receives the changed fields.
+ */
+Q2PROTO_PRIVATE_API void q2proto_packing_player_state_changes(const q2proto_packed_player_state_t *from,
+                                                              const q2proto_packed_player_state_t *to,
+                                                              q2proto_player_state_changes_t *changes);
+/**
+ * Set the changed stats in a player state delta.
+ * \param delta Player state delta.
+ * \param to To/new/current player state.
+ * \param statbits Changed stats, as determined by q2proto_packing_player_state_changes().
+ */
+Q2PROTO_PRIVATE_API void q2proto_packing_set_stats_delta(q2proto_svc_playerstate_t *delta,
+                                                         const q2proto_packed_player_state_t *to, uint64_t statbits);
 /**
  * Compute delta message from changes between two player states.
  * Vanilla, R1Q2, Q2PRO, Q2PRO extended are relatively similar and can be handled with a single function.
@@ -24,16 +24,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "q2proto/q2proto_string.h"
 
-#if defined(_MSC_VER) || defined(__MINGW32__)
-    #include <malloc.h>
-    #if !defined(alloca)
-        #define alloca _alloca
-    #endif
-#elif !defined(__FreeBSD__) && !defined(__OpenBSD__)
-    #include <alloca.h>
-#endif
-
 #include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
 #include <stdlib.h>
 
 static const q2proto_string_t empty_q2proto_string = {};
@@ -58,17 +51,66 @@ static inline const char *q2pschr(const q2proto_string_t *str, char ch)
     return NULL;
 }
 
-// strtol() for q2proto_string_t
+// Value of a digit character, -1 if not a digit
+static inline int q2ps_digit_value(char ch)
+{
+    if (ch >= '0' && ch <= '9')
+        return ch - '0';
+    if (ch >= 'a' && ch <= 'z')
+        return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'Z')
+        return ch - 'A' + 10;
+    return -1;
+}
+
+/* strtol() for q2proto_string_t.
+ * Parses the string in place (no copy to a temporary buffer); as with strtol(), a zero character ends the input. */
 static inline long q2pstol(const q2proto_string_t *str, int base)
 {
-    char *buf = alloca(str->len + 1);
-    memcpy(buf, str->str, str->len);
-    buf[str->len] = 0;
-
-    char *endp;
-    long result = strtol(buf, &endp, base);
-    // detect empty input, invalid digits
-    if (endp == buf || *endp != 0)
+    const char *p = str->str;
+    const char *end = p + str->len;
+    while (p < end && (*p == ' ' || (*p >= '\t' && *p <= '\r')))
+        p++;
+    bool negative = false;
+    if (p < end && (*p == '+' || *p == '-')) {
+        negative = *p == '-';
+        p++;
+    }
+    if ((base == 0 || base == 16) && end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')
+        && q2ps_digit_value(p[2]) >= 0 && q2ps_digit_value(p[2]) < 16)
+    {
+        p += 2;
+        base = 16;
+    } else if (base == 0)
+        base = (p < end && *p == '0') ? 8 : 10;
+
+    unsigned long limit = negative ? (unsigned long)LONG_MAX + 1 : LONG_MAX;
+    unsigned long value = 0;
+    bool overflow = false;
+    const char *digits_start = p;
+    for (; p < end; p++) {
+        int digit = q2ps_digit_value(*p);
+        if (digit < 0 || digit >= base)
+            break;
+        if (value > (limit - digit) / base)
+            overflow = true;
+        else
+            value = value * base + digit;
+    }
+
+    // detect empty input
+    if (p == digits_start) {
+        errno = EINVAL;
+        return 0;
+    }
+    long result;
+    if (overflow) {
+        errno = ERANGE;
+        result = negative ? LONG_MIN : LONG_MAX;
+    } else
+        result = negative ? -(long)(value - 1) - 1 : (long)value;
+    // detect invalid digits
+    if (p < end && *p != 0)
         errno = EINVAL;
     return result;
 }
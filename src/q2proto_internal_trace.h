@@ -0,0 +1,46 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/**\file
+ * Trace record emission
+ */
+#ifndef Q2PROTO_INTERNAL_TRACE_H_
+#define Q2PROTO_INTERNAL_TRACE_H_
+
+#include "q2proto/q2proto.h"
+
+#if Q2PROTO_TRACE
+/**
+ * Emit a trace record for a server message.
+ * \param ring Trace ring of the calling thread.
+ * \param event Trace event kind.
+ * \param context_id Trace ID of the context.
+ * \param start Position before the message was read or written.
+ * \param end Position after the message was read or written.
+ * \param svc_message Message that was read or written.
+ */
+Q2PROTO_PRIVATE_API void q2proto_trace_svc_message(q2proto_trace_ring_t *ring, q2proto_trace_event_t event,
+                                                   uint32_t context_id, size_t start, size_t end,
+                                                   const q2proto_svc_message_t *svc_message);
+/// Emit a trace record for a client message. See q2proto_trace_svc_message().
+Q2PROTO_PRIVATE_API void q2proto_trace_clc_message(q2proto_trace_ring_t *ring, q2proto_trace_event_t event,
+                                                   uint32_t context_id, size_t start, size_t end,
+                                                   const q2proto_clc_message_t *clc_message);
+#endif
+
+#endif // Q2PROTO_INTERNAL_TRACE_H_
@@ -22,8 +22,68 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define Q2PROTO_BUILD
 #include "q2proto_internal.h"
 
-q2proto_error_t q2proto_server_multicast_write(q2proto_multicast_protocol_t multicast_proto, uintptr_t io_arg,
-                                               const q2proto_svc_message_t *svc_message)
+/* Most restrictive game API using a multicast protocol.
+ * Used when the actual game API is unknown, so game API specific messages are only written
+ * if all clients using the multicast protocol can read them. */
+static q2proto_game_api_t multicast_min_game_api(q2proto_multicast_protocol_t multicast_proto)
+{
+    switch (multicast_proto) {
+    case Q2P_PROTOCOL_MULTICAST_INVALID:
+    case Q2P_PROTOCOL_MULTICAST_SHORT:
+        break;
+    case Q2P_PROTOCOL_MULTICAST_Q2PRO_EXT:
+        return Q2PROTO_GAME_Q2PRO_EXTENDED_V2;
+    case Q2P_PROTOCOL_MULTICAST_FLOAT:
+        return Q2PROTO_GAME_RERELEASE;
+    }
+
+    // Also used for Q2PRO extended games, but those are a superset of vanilla
+    return Q2PROTO_GAME_VANILLA;
+}
+
+static q2proto_error_t multicast_write_temp_entity(q2proto_multicast_protocol_t multicast_proto,
+                                                   q2proto_game_api_t game_api, uintptr_t io_arg,
+                                                   const q2proto_svc_temp_entity_t *temp_entity)
+{
+    switch (multicast_proto) {
+    case Q2P_PROTOCOL_MULTICAST_INVALID:
+        break;
+    case Q2P_PROTOCOL_MULTICAST_SHORT:
+        return q2proto_common_server_write_temp_entity_short(io_arg, game_api, temp_entity);
+    case Q2P_PROTOCOL_MULTICAST_Q2PRO_EXT:
+        return q2proto_q2pro_server_write_temp_entity_int23(io_arg, game_api, temp_entity);
+    case Q2P_PROTOCOL_MULTICAST_FLOAT:
+        return q2proto_common_server_write_temp_entity_float(io_arg, game_api, temp_entity);
+    }
+
+    return Q2P_ERR_PROTOCOL_NOT_SUPPORTED;
+}
+
+static q2proto_error_t multicast_write_muzzleflash2(q2proto_multicast_protocol_t multicast_proto, uintptr_t io_arg,
+                                                    const q2proto_svc_muzzleflash_t *muzzleflash)
+{
+    switch (multicast_proto) {
+    case Q2P_PROTOCOL_MULTICAST_INVALID:
+        break;
+    case Q2P_PROTOCOL_MULTICAST_SHORT:
+    case Q2P_PROTOCOL_MULTICAST_Q2PRO_EXT:
+        {
+            // Q2PRO stores upper weapon bits in entity number (only used by extended games)
+            uint16_t entity = muzzleflash->entity | ((muzzleflash->weapon >> 8) << 13);
+            WRITE_CHECKED(server_write, io_arg, u8, svc_muzzleflash2);
+            WRITE_CHECKED(server_write, io_arg, i16, entity);
+            WRITE_CHECKED(server_write, io_arg, u8, muzzleflash->weapon & 0xff);
+            return Q2P_ERR_SUCCESS;
+        }
+    case Q2P_PROTOCOL_MULTICAST_FLOAT:
+        return q2proto_q2repro_server_write_muzzleflash2(io_arg, muzzleflash);
+    }
+
+    return Q2P_ERR_PROTOCOL_NOT_SUPPORTED;
+}
+
+static q2proto_error_t multicast_write(q2proto_multicast_protocol_t multicast_proto, q2proto_game_api_t game_api,
+                                       uintptr_t io_arg, const q2proto_svc_message_t *svc_message)
 {
     switch (svc_message->type) {
     case Q2P_SVC_NOP:
@@ -47,9 +107,210 @@ q2proto_error_t q2proto_server_multicast_write(q2proto_multicast_protocol_t mult
     case Q2P_SVC_CONFIGSTRING:
         return q2proto_common_server_write_configstring(io_arg, &svc_message->configstring);
 
+    case Q2P_SVC_TEMP_ENTITY:
+        return multicast_write_temp_entity(multicast_proto, game_api, io_arg, &svc_message->temp_entity);
+
+    case Q2P_SVC_MUZZLEFLASH:
+        return q2proto_common_server_write_muzzleflash(io_arg, svc_muzzleflash, &svc_message->muzzleflash,
+                                                       MZ_SILENCED);
+
+    case Q2P_SVC_MUZZLEFLASH2:
+        return multicast_write_muzzleflash2(multicast_proto, io_arg, &svc_message->muzzleflash);
+
     default:
         break;
     }
 
     return Q2P_ERR_NOT_IMPLEMENTED;
 }
+
+q2proto_error_t q2proto_server_multicast_write(q2proto_multicast_protocol_t multicast_proto, uintptr_t io_arg,
+                                               const q2proto_svc_message_t *svc_message)
+{
+    return multicast_write(multicast_proto, multicast_min_game_api(multicast_proto), io_arg, svc_message);
+}
+
+static q2proto_error_t multicast_encode(q2proto_multicast_protocol_t multicast_proto, q2proto_game_api_t game_api,
+                                        uintptr_t io_arg, const q2proto_svc_message_t *svc_message,
+                                        q2proto_multicast_encoded_t *encoded)
+{
+    const uint8_t *start, *end;
+    CHECKED_IO(server_write, io_arg, start = q2protoio_write_reserve_raw(io_arg, 0), "get encode start");
+    CHECKED(server_write, io_arg, multicast_write(multicast_proto, game_api, io_arg, svc_message));
+    CHECKED_IO(server_write, io_arg, end = q2protoio_write_reserve_raw(io_arg, 0), "get encode end");
+
+    encoded->multicast_proto = multicast_proto;
+    encoded->data = start;
+    encoded->size = end - start;
+    return Q2P_ERR_SUCCESS;
+}
+
+q2proto_error_t q2proto_server_multicast_encode(q2proto_multicast_protocol_t multicast_proto, uintptr_t io_arg,
+                                                const q2proto_svc_message_t *svc_message,
+                                                q2proto_multicast_encoded_t *encoded)
+{
+    return multicast_encode(multicast_proto, multicast_min_game_api(multicast_proto), io_arg, svc_message, encoded);
+}
+
+q2proto_error_t q2proto_server_multicast_encode_protocols(const q2proto_multicast_protocol_t *multicast_protos,
+                                                          size_t num_multicast_protos, uintptr_t io_arg,
+                                                          const q2proto_svc_message_t *svc_message,
+                                                          q2proto_multicast_encoded_t *encoded,
+                                                          size_t *num_encoded)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < num_multicast_protos; i++) {
+        bool already_encoded = false;
+        for (size_t j = 0; j < n; j++) {
+            if (encoded[j].multicast_proto == multicast_protos[i]) {
+                already_encoded = true;
+                break;
+            }
+        }
+        if (already_encoded)
+            continue;
+
+        q2proto_error_t err = q2proto_server_multicast_encode(multicast_protos[i], io_arg, svc_message, &encoded[n]);
+        if (err != Q2P_ERR_SUCCESS)
+            return err;
+        n++;
+    }
+    *num_encoded = n;
+    return Q2P_ERR_SUCCESS;
+}
+
+const q2proto_multicast_encoded_t *q2proto_multicast_find_encoded(const q2proto_multicast_encoded_t *encoded,
+                                                                  size_t num_encoded,
+                                                                  q2proto_multicast_protocol_t multicast_proto)
+{
+    for (size_t i = 0; i < num_encoded; i++) {
+        if (encoded[i].multicast_proto == multicast_proto)
+            return &encoded[i];
+    }
+    return NULL;
+}
+
+q2proto_error_t q2proto_server_multicast_write_encoded(uintptr_t io_arg, const q2proto_multicast_encoded_t *encoded)
+{
+    WRITE_CHECKED(server_write, io_arg, raw, encoded->data, encoded->size, NULL);
+    return Q2P_ERR_SUCCESS;
+}
+
+static q2proto_multicast_protocol_t context_multicast_protocol(q2proto_servercontext_t *context)
+{
+    return q2proto_get_multicast_protocol(&context->protocol, 1, context->server_info->game_api);
+}
+
+// Check whether a message written for two contexts is identical
+static bool fanout_same_encoding(q2proto_servercontext_t *context, q2proto_multicast_protocol_t multicast_proto,
+                                 const q2proto_multicast_group_t *group)
+{
+    if (multicast_proto != group->encoded.multicast_proto)
+        return false;
+    // Multicast protocols are shared between game APIs, but some messages are specific to a game API
+    const q2proto_servercontext_t *group_context = group->context;
+    if (multicast_proto != Q2P_PROTOCOL_MULTICAST_INVALID)
+        return context->server_info->game_api == group_context->server_info->game_api;
+    // No multicast protocol: require matching protocol & server
+    return context->protocol == group_context->protocol && context->protocol_version == group_context->protocol_version
+           && context->server_info == group_context->server_info;
+}
+
+// Check whether a message is supported by q2proto_server_multicast_write(), ie doesn't depend on per-client state
+static bool multicast_message_supported(q2proto_svc_message_type_t type)
+{
+    switch (type) {
+    case Q2P_SVC_NOP:
+    case Q2P_SVC_DISCONNECT:
+    case Q2P_SVC_RECONNECT:
+    case Q2P_SVC_SOUND:
+    case Q2P_SVC_PRINT:
+    case Q2P_SVC_STUFFTEXT:
+    case Q2P_SVC_CONFIGSTRING:
+    case Q2P_SVC_TEMP_ENTITY:
+    case Q2P_SVC_MUZZLEFLASH:
+    case Q2P_SVC_MUZZLEFLASH2:
+        return true;
+    default:
+        break;
+    }
+    return false;
+}
+
+static q2proto_error_t fanout_encode_group(uintptr_t io_arg, const q2proto_svc_message_t *svc_message,
+                                           q2proto_multicast_group_t *group)
+{
+    if (group->encoded.multicast_proto != Q2P_PROTOCOL_MULTICAST_INVALID)
+        return multicast_encode(group->encoded.multicast_proto, group->context->server_info->game_api, io_arg,
+                                svc_message, &group->encoded);
+
+    // Protocol has no multicast support, encode with context of first recipient
+    const uint8_t *start, *end;
+    CHECKED_IO(server_write, io_arg, start = q2protoio_write_reserve_raw(io_arg, 0), "get encode start");
+    CHECKED(server_write, io_arg, q2proto_server_write(group->context, io_arg, svc_message));
+    CHECKED_IO(server_write, io_arg, end = q2protoio_write_reserve_raw(io_arg, 0), "get encode end");
+    group->encoded.data = start;
+    group->encoded.size = end - start;
+    return Q2P_ERR_SUCCESS;
+}
+
+q2proto_error_t q2proto_server_multicast_fanout(q2proto_servercontext_t *const *contexts, size_t num_contexts,
+                                                uintptr_t io_arg, const q2proto_svc_message_t *svc_message,
+                                                q2proto_multicast_group_t *groups, size_t max_groups,
+                                                size_t *num_groups, size_t *recipients)
+{
+    /* Messages depending on the recipient's state (frames, entity deltas, serverdata...) would be encoded
+     * against the state of the first recipient's context only */
+    if (!multicast_message_supported(svc_message->type))
+        return Q2P_ERR_INVALID_ARGUMENT;
+
+    size_t n = 0;
+
+    // Collect distinct encodings, count recipients
+    for (size_t i = 0; i < num_contexts; i++) {
+        q2proto_multicast_protocol_t multicast_proto = context_multicast_protocol(contexts[i]);
+        size_t g;
+        for (g = 0; g < n; g++) {
+            if (fanout_same_encoding(contexts[i], multicast_proto, &groups[g]))
+                break;
+        }
+        if (g == n) {
+            if (n >= max_groups)
+                return Q2P_ERR_BUFFER_TOO_SMALL;
+            memset(&groups[n], 0, sizeof(groups[n]));
+            groups[n].encoded.multicast_proto = multicast_proto;
+            groups[n].context = contexts[i];
+            n++;
+        }
+        groups[g].num_recipients++;
+    }
+
+    // Assign recipient ranges
+    size_t first = 0;
+    for (size_t g = 0; g < n; g++) {
+        groups[g].first_recipient = first;
+        first += groups[g].num_recipients;
+        groups[g].num_recipients = 0;
+    }
+
+    // Fill recipient lists
+    for (size_t i = 0; i < num_contexts; i++) {
+        q2proto_multicast_protocol_t multicast_proto = context_multicast_protocol(contexts[i]);
+        for (size_t g = 0; g < n; g++) {
+            if (fanout_same_encoding(contexts[i], multicast_proto, &groups[g])) {
+                recipients[groups[g].first_recipient + groups[g].num_recipients++] = i;
+                break;
+            }
+        }
+    }
+
+    // Encode once per group
+    for (size_t g = 0; g < n; g++) {
+        q2proto_error_t err = fanout_encode_group(io_arg, svc_message, &groups[g]);
+        if (err != Q2P_ERR_SUCCESS)
+            return err;
+    }
+
+    *num_groups = n;
+    return Q2P_ERR_SUCCESS;
+}
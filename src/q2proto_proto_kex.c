@@ -42,12 +42,16 @@ static uint32_t kex_pack_solid(q2proto_clientcontext_t *context, const q2proto_v
 static void kex_unpack_solid(q2proto_clientcontext_t *context, uint32_t solid, q2proto_vec3_t mins,
                              q2proto_vec3_t maxs);
 
-q2proto_error_t q2proto_kex_continue_serverdata(q2proto_clientcontext_t *context, uintptr_t io_arg,
-                                                q2proto_svc_serverdata_t *serverdata)
+void q2proto_kex_init_client_functions(q2proto_clientcontext_t *context)
 {
+    context->client_read = kex_client_read;
     context->pack_solid = kex_pack_solid;
     context->unpack_solid = kex_unpack_solid;
+}
 
+q2proto_error_t q2proto_kex_continue_serverdata(q2proto_clientcontext_t *context, uintptr_t io_arg,
+                                                q2proto_svc_serverdata_t *serverdata)
+{
     READ_CHECKED(client_read, io_arg, serverdata->servercount, i32);
     READ_CHECKED(client_read, io_arg, serverdata->attractloop, bool);
     READ_CHECKED(client_read, io_arg, serverdata->server_fps, u8);
@@ -58,7 +62,7 @@ q2proto_error_t q2proto_kex_continue_serverdata(q2proto_clientcontext_t *context
         return Q2P_ERR_BAD_DATA;
     READ_CHECKED(client_read, io_arg, serverdata->levelname, string);
 
-    context->client_read = kex_client_read;
+    q2proto_kex_init_client_functions(context);
     context->server_protocol = q2proto_protocol_from_netver(serverdata->protocol);
     context->protocol_version = serverdata->protocol_version;
     context->features.has_solid32 = true;
@@ -925,6 +929,11 @@ static void kex_server_make_player_state_delta(q2proto_servercontext_t *context,
                                                const q2proto_packed_player_state_t *from,
                                                const q2proto_packed_player_state_t *to,
                                                q2proto_svc_playerstate_t *delta);
+static q2proto_error_t kex_server_entity_delta_size(q2proto_servercontext_t *context, uint16_t entnum,
+                                                    const q2proto_entity_state_delta_t *entity_state_delta,
+                                                    size_t *size);
+static q2proto_error_t kex_server_playerstate_size(q2proto_servercontext_t *context,
+                                                   const q2proto_svc_playerstate_t *playerstate, size_t *size);
 static q2proto_error_t kex_server_write(q2proto_servercontext_t *context, uintptr_t io_arg,
                                         const q2proto_svc_message_t *svc_message);
 static q2proto_error_t kex_server_write_sound(q2proto_servercontext_t *context, uintptr_t io_arg,
@@ -939,6 +948,9 @@ static q2proto_error_t kex_server_write_gamestate(q2proto_servercontext_t *conte
 
 q2proto_error_t q2proto_kex_init_servercontext(q2proto_servercontext_t *context, const q2proto_connect_t *connect_info)
 {
+    memset(context->kex_demo_baseline_nonzero_solid, 0, sizeof(context->kex_demo_baseline_nonzero_solid));
+    memset(context->kex_demo_edict_nonzero_solid, 0, sizeof(context->kex_demo_edict_nonzero_solid));
+
     context->features.enable_deflate = false;
     context->features.download_compress_raw = false;
     context->features.has_beam_old_origin_fix = true; // I guess?
@@ -948,6 +960,8 @@ q2proto_error_t q2proto_kex_init_servercontext(q2proto_servercontext_t *context,
     context->fill_serverdata = kex_server_fill_serverdata;
     context->make_entity_state_delta = kex_server_make_entity_state_delta;
     context->make_player_state_delta = kex_server_make_player_state_delta;
+    context->entity_delta_size = kex_server_entity_delta_size;
+    context->playerstate_size = kex_server_playerstate_size;
     context->server_write = kex_server_write;
     context->server_write_gamestate = kex_server_write_gamestate;
     return Q2P_ERR_SUCCESS;
@@ -956,7 +970,7 @@ q2proto_error_t q2proto_kex_init_servercontext(q2proto_servercontext_t *context,
 static q2proto_error_t kex_server_fill_serverdata(q2proto_servercontext_t *context,
                                                   q2proto_svc_serverdata_t *serverdata)
 {
-    serverdata->protocol = PROTOCOL_KEX;
+    serverdata->protocol = context->protocol == Q2P_PROTOCOL_KEX_DEMOS ? PROTOCOL_KEX_DEMOS : PROTOCOL_KEX;
     return Q2P_ERR_SUCCESS;
 }
 
@@ -1082,10 +1096,12 @@ static void kex_server_make_player_state_delta(q2proto_servercontext_t *context,
     if (!from)
         from = &q2proto_null_packed_player_state;
 
-    if (to->pm_type != from->pm_type) {
-        delta->delta_bits |= Q2P_PSD_PM_TYPE;
+    q2proto_player_state_changes_t changes;
+    q2proto_packing_player_state_changes(from, to, &changes);
+    delta->delta_bits = changes.delta_bits;
+
+    if (delta->delta_bits & Q2P_PSD_PM_TYPE)
         delta->pm_type = to->pm_type;
-    }
 
     for (int c = 0; c < 3; c++) {
         q2proto_var_coords_set_float_comp(&delta->pm_origin.write.prev, c,
@@ -1098,36 +1114,19 @@ static void kex_server_make_player_state_delta(q2proto_servercontext_t *context,
                                           _q2proto_valenc_bits2float(to->pm_velocity[c]));
     }
 
-    if (to->pm_time != from->pm_time) {
-        delta->delta_bits |= Q2P_PSD_PM_TIME;
+    if (delta->delta_bits & Q2P_PSD_PM_TIME)
         delta->pm_time = to->pm_time;
-    }
-
-    if (to->pm_flags != from->pm_flags) {
-        delta->delta_bits |= Q2P_PSD_PM_FLAGS;
+    if (delta->delta_bits & Q2P_PSD_PM_FLAGS)
         delta->pm_flags = to->pm_flags;
-    }
-
-    if (to->pm_gravity != from->pm_gravity) {
-        delta->delta_bits |= Q2P_PSD_PM_GRAVITY;
+    if (delta->delta_bits & Q2P_PSD_PM_GRAVITY)
         delta->pm_gravity = to->pm_gravity;
-    }
 
-    if (memcmp(&to->pm_delta_angles, &from->pm_delta_angles, sizeof(to->pm_delta_angles)) != 0) {
-        delta->delta_bits |= Q2P_PSD_PM_DELTA_ANGLES;
+    if (delta->delta_bits & Q2P_PSD_PM_DELTA_ANGLES) {
         q2proto_var_angles_set_float_comp(&delta->pm_delta_angles, 0, _q2proto_valenc_bits2float(to->pm_delta_angles[0]));
         q2proto_var_angles_set_float_comp(&delta->pm_delta_angles, 1, _q2proto_valenc_bits2float(to->pm_delta_angles[1]));
         q2proto_var_angles_set_float_comp(&delta->pm_delta_angles, 2, _q2proto_valenc_bits2float(to->pm_delta_angles[2]));
     }
 
-
-
-    if (memcmp(to->viewoffset, from->viewoffset, sizeof(to->viewoffset)) != 0)
-        delta->delta_bits |= Q2P_PSD_VIEWOFFSET;
-#if Q2PROTO_PLAYER_STATE_FEATURES >= Q2PROTO_FEATURES_RERELEASE
-    if (to->pm_viewheight != from->pm_viewheight)
-        delta->delta_bits |= Q2P_PSD_PM_VIEWHEIGHT;
-#endif
     if (delta->delta_bits & (Q2P_PSD_VIEWOFFSET | Q2P_PSD_PM_VIEWHEIGHT)) {
         q2proto_var_small_offsets_set_q2repro_viewoffset_comp(&delta->viewoffset, 0, to->viewoffset[0]);
         q2proto_var_small_offsets_set_q2repro_viewoffset_comp(&delta->viewoffset, 1, to->viewoffset[1]);
@@ -1137,55 +1136,35 @@ static void kex_server_make_player_state_delta(q2proto_servercontext_t *context,
 #endif
     }
 
-    delta->viewangles.delta_bits = 0;
+    delta->viewangles.delta_bits = changes.viewangles;
     for (int c = 0; c < 3; c++) {
-        if (to->viewangles[c] != from->viewangles[c])
-            delta->viewangles.delta_bits |= BIT(c);
         q2proto_var_angles_set_float_comp(&delta->viewangles.values, c, _q2proto_valenc_bits2float(to->viewangles[c]));
     }
 
-    if (memcmp(to->kick_angles, from->kick_angles, sizeof(to->kick_angles))) {
-        delta->delta_bits |= Q2P_PSD_KICKANGLES;
+    if (delta->delta_bits & Q2P_PSD_KICKANGLES) {
         q2proto_var_small_angles_set_q2repro_kick_angles_comp(&delta->kick_angles, 0, to->kick_angles[0]);
         q2proto_var_small_angles_set_q2repro_kick_angles_comp(&delta->kick_angles, 1, to->kick_angles[1]);
         q2proto_var_small_angles_set_q2repro_kick_angles_comp(&delta->kick_angles, 2, to->kick_angles[2]);
     }
 
+    delta->blend.delta_bits = changes.blend;
+#if Q2PROTO_PLAYER_STATE_FEATURES >= Q2PROTO_FEATURES_Q2PRO_EXTENDED_V2
+    delta->damage_blend.delta_bits = changes.damage_blend;
+#endif
     for (int c = 0; c < 4; c++) {
-        if (to->blend[c] != from->blend[c])
-            delta->blend.delta_bits |= BIT(c);
         q2proto_var_color_set_byte_comp(&delta->blend.values, c, to->blend[c]);
 #if Q2PROTO_PLAYER_STATE_FEATURES >= Q2PROTO_FEATURES_Q2PRO_EXTENDED_V2
-        if (to->damage_blend[c] != from->damage_blend[c])
-            delta->damage_blend.delta_bits |= BIT(c);
         q2proto_var_color_set_byte_comp(&delta->damage_blend.values, c, to->damage_blend[c]);
 #endif
     }
 
-    if (to->fov != from->fov) {
-        delta->delta_bits |= Q2P_PSD_FOV;
+    if (delta->delta_bits & Q2P_PSD_FOV)
         delta->fov = to->fov;
-    }
-
-    if (to->rdflags != from->rdflags) {
-        delta->delta_bits |= Q2P_PSD_RDFLAGS;
+    if (delta->delta_bits & Q2P_PSD_RDFLAGS)
         delta->rdflags = to->rdflags;
-    }
 
-    if (to->gunframe != from->gunframe)
-        delta->delta_bits |= Q2P_PSD_GUNFRAME;
-    delta->gunoffset.delta_bits = 0;
-    delta->gunangles.delta_bits = 0;
-    for (int c = 0; c < 3; c++) {
-        if (to->gunoffset[c] != from->gunoffset[c])
-            delta->gunoffset.delta_bits |= BIT(c);
-        if (to->gunangles[c] != from->gunangles[c])
-            delta->gunangles.delta_bits |= BIT(c);
-    }
-#if Q2PROTO_PLAYER_STATE_FEATURES >= Q2PROTO_FEATURES_RERELEASE
-    if (to->gunrate != from->gunrate)
-        delta->delta_bits |= Q2P_PSD_GUNRATE;
-#endif
+    delta->gunoffset.delta_bits = changes.gunoffset;
+    delta->gunangles.delta_bits = changes.gunangles;
     if ((delta->delta_bits & (Q2P_PSD_GUNFRAME | Q2P_PSD_GUNRATE)) || (delta->gunoffset.delta_bits != 0)
         || (delta->gunangles.delta_bits != 0))
     {
@@ -1201,12 +1180,6 @@ static void kex_server_make_player_state_delta(q2proto_servercontext_t *context,
 #endif
     }
 
-    if (to->gunindex != from->gunindex)
-        delta->delta_bits |= Q2P_PSD_GUNINDEX;
-#if Q2PROTO_PLAYER_STATE_FEATURES >= Q2PROTO_FEATURES_Q2PRO_EXTENDED
-    if (to->gunskin != from->gunskin)
-        delta->delta_bits |= Q2P_PSD_GUNSKIN;
-#endif
     if (delta->delta_bits & (Q2P_PSD_GUNINDEX | Q2P_PSD_GUNSKIN)) {
         delta->gunindex = to->gunindex;
 #if Q2PROTO_PLAYER_STATE_FEATURES >= Q2PROTO_FEATURES_Q2PRO_EXTENDED
@@ -1214,13 +1187,7 @@ static void kex_server_make_player_state_delta(q2proto_servercontext_t *context,
 #endif
     }
 
-    for (int i = 0; i < Q2PROTO_STATS; i++) {
-        if (to->stats[i] != from->stats[i]) {
-            delta->statbits |= BIT_ULL(i);
-            delta->stats[i] = to->stats[i];
-        }
-    }
-
+    q2proto_packing_set_stats_delta(delta, to, changes.statbits);
 }
 
 static q2proto_error_t kex_server_write_serverdata(q2proto_servercontext_t *context, uintptr_t io_arg,
@@ -1345,10 +1312,7 @@ static q2proto_error_t kex_server_write_locprint(uintptr_t io_arg, const q2proto
     return Q2P_ERR_SUCCESS;
 }
 
-static q2proto_error_t kex_server_write_entity_state_delta(q2proto_servercontext_t *context, uintptr_t io_arg,
-                                                           uint16_t entnum,
-                                                           const q2proto_entity_state_delta_t *entity_state_delta,
-                                                           bool default_solid_nonzero)
+static uint64_t kex_server_entity_state_delta_bits(const q2proto_entity_state_delta_t *entity_state_delta)
 {
     uint64_t bits = 0;
 
@@ -1428,7 +1392,94 @@ static q2proto_error_t kex_server_write_entity_state_delta(q2proto_servercontext
     if (bits >= 0x100000000ull)
         bits |= 0xff00000000ull;
 
-    //----------
+    return bits;
+}
+
+static q2proto_error_t kex_server_entity_delta_size(q2proto_servercontext_t *context, uint16_t entnum,
+                                                    const q2proto_entity_state_delta_t *entity_state_delta,
+                                                    size_t *size)
+{
+    uint64_t bits = kex_server_entity_state_delta_bits(entity_state_delta);
+
+    size_t total = q2proto_common_server_entity_bits_size(bits, entnum);
+    size_t model_size = (bits & U_MODEL16) ? 2 : 1;
+    if (bits & U_MODEL)
+        total += model_size;
+    if (bits & U_MODEL2)
+        total += model_size;
+    if (bits & U_MODEL3)
+        total += model_size;
+    if (bits & U_MODEL4)
+        total += model_size;
+    if (bits & U_FRAME16)
+        total += 2;
+    else if (bits & U_FRAME8)
+        total += 1;
+    total += q2proto_common_width_flags_size(bits, U_SKIN8, U_SKIN16);
+    if (bits & U_KEX_EFFECTS64)
+        total += 4;
+    total += q2proto_common_width_flags_size(bits, U_EFFECTS8, U_EFFECTS16);
+    total += q2proto_common_width_flags_size(bits, U_RENDERFX8, U_RENDERFX16);
+
+    bool nonzero_solid;
+    if (bits & U_SOLID) {
+        total += 4;
+        nonzero_solid = entity_state_delta->solid != 0;
+    } else
+        nonzero_solid = q2proto_get_entity_bit(context->kex_demo_edict_nonzero_solid, entnum);
+
+    bool high_precision_origin = context->protocol != Q2P_PROTOCOL_KEX_DEMOS || nonzero_solid;
+    size_t origin_comp_size = high_precision_origin ? 4 : 2;
+    if (bits & U_ORIGIN1)
+        total += origin_comp_size;
+    if (bits & U_ORIGIN2)
+        total += origin_comp_size;
+    if (bits & U_ORIGIN3)
+        total += origin_comp_size;
+    if (bits & U_OLDORIGIN)
+        total += 3 * origin_comp_size;
+
+    if (bits & U_ANGLE1)
+        total += 4;
+    if (bits & U_ANGLE2)
+        total += 4;
+    if (bits & U_ANGLE3)
+        total += 4;
+    if (bits & U_SOUND) {
+        uint16_t sound_word = entity_state_delta->sound;
+        if (entity_state_delta->delta_bits & Q2P_ESD_LOOP_ATTENUATION)
+            sound_word |= SOUND_FLAG_ATTENUATION;
+        if (entity_state_delta->delta_bits & Q2P_ESD_LOOP_VOLUME)
+            sound_word |= SOUND_FLAG_VOLUME;
+        total += 2;
+        if (sound_word & SOUND_FLAG_VOLUME)
+            total += 1;
+        if (sound_word & SOUND_FLAG_ATTENUATION)
+            total += 1;
+    }
+    if (bits & U_EVENT)
+        total += 1;
+    if (bits & U_ALPHA)
+        total += 1;
+    if (bits & U_SCALE)
+        total += 1;
+    if (bits & U_KEX_INSTANCE)
+        total += 1;
+    if (bits & U_KEX_OWNER)
+        total += 2;
+    if (bits & U_KEX_OLDFRAME)
+        total += 2;
+
+    *size = total;
+    return Q2P_ERR_SUCCESS;
+}
+
+static q2proto_error_t kex_server_write_entity_state_delta(q2proto_servercontext_t *context, uintptr_t io_arg,
+                                                           uint16_t entnum,
+                                                           const q2proto_entity_state_delta_t *entity_state_delta,
+                                                           bool default_solid_nonzero)
+{
+    uint64_t bits = kex_server_entity_state_delta_bits(entity_state_delta);
 
     q2proto_common_server_write_entity_bits(io_arg, bits, entnum);
 
@@ -1611,8 +1662,8 @@ static q2proto_error_t kex_server_write_spawnbaseline(q2proto_servercontext_t *c
     return kex_server_write_spawnbaseline_content(context, io_arg, spawnbaseline);
 }
 
-static q2proto_error_t kex_server_write_playerstate(q2proto_servercontext_t *context, uintptr_t io_arg,
-                                                    const q2proto_svc_playerstate_t *playerstate)
+static q2proto_error_t kex_server_playerstate_flags(const q2proto_svc_playerstate_t *playerstate,
+                                                    uint32_t *playerstate_flags)
 {
     uint32_t flags = 0;
 
@@ -1662,6 +1713,103 @@ static q2proto_error_t kex_server_write_playerstate(q2proto_servercontext_t *con
     if (flags > UINT16_MAX)
         flags |= PS_MOREBITS;
 
+    *playerstate_flags = flags;
+    return Q2P_ERR_SUCCESS;
+}
+
+static uint16_t kex_server_playerstate_gunbits(const q2proto_svc_playerstate_t *playerstate)
+{
+    uint16_t gunbits = 0;
+    if (playerstate->gunoffset.delta_bits & BIT(0))
+        gunbits |= GUNBIT_OFFSET_X;
+    if (playerstate->gunoffset.delta_bits & BIT(1))
+        gunbits |= GUNBIT_OFFSET_Y;
+    if (playerstate->gunoffset.delta_bits & BIT(2))
+        gunbits |= GUNBIT_OFFSET_Z;
+    if (playerstate->gunangles.delta_bits & BIT(0))
+        gunbits |= GUNBIT_ANGLES_X;
+    if (playerstate->gunangles.delta_bits & BIT(1))
+        gunbits |= GUNBIT_ANGLES_Y;
+    if (playerstate->gunangles.delta_bits & BIT(2))
+        gunbits |= GUNBIT_ANGLES_Z;
+#if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_GUNRATE_VIEWHEIGHT
+    if (playerstate->delta_bits & Q2P_PSD_GUNRATE)
+        gunbits |= GUNBIT_GUNRATE;
+#endif
+    return gunbits;
+}
+
+static q2proto_error_t kex_server_playerstate_size(q2proto_servercontext_t *context,
+                                                   const q2proto_svc_playerstate_t *playerstate, size_t *size)
+{
+    uint32_t flags;
+    CHECKED(server_write, 0, kex_server_playerstate_flags(playerstate, &flags));
+
+    size_t total = 1 /* svc_playerinfo */ + 2 /* flags */;
+    if (flags & PS_MOREBITS)
+        total += 2;
+    if (flags & PS_M_TYPE)
+        total += 1;
+    if (flags & PS_M_ORIGIN)
+        total += 12;
+    if (flags & PS_M_VELOCITY)
+        total += 12;
+    if (flags & PS_M_TIME)
+        total += 2;
+    if (flags & PS_M_FLAGS)
+        total += 2;
+    if (flags & PS_M_GRAVITY)
+        total += 2;
+    if (flags & PS_M_DELTA_ANGLES)
+        total += 12;
+    if (flags & PS_VIEWOFFSET)
+        total += 7;
+    if (flags & PS_VIEWANGLES)
+        total += 12;
+    if (flags & PS_KICKANGLES)
+        total += 6;
+    if (flags & PS_WEAPONINDEX)
+        total += 2;
+    if (flags & PS_WEAPONFRAME) {
+        uint16_t gunbits = kex_server_playerstate_gunbits(playerstate);
+        total += 2;
+        if (gunbits & GUNBIT_OFFSET_X)
+            total += 4;
+        if (gunbits & GUNBIT_OFFSET_Y)
+            total += 4;
+        if (gunbits & GUNBIT_OFFSET_Z)
+            total += 4;
+        if (gunbits & GUNBIT_ANGLES_X)
+            total += 4;
+        if (gunbits & GUNBIT_ANGLES_Y)
+            total += 4;
+        if (gunbits & GUNBIT_ANGLES_Z)
+            total += 4;
+        if (gunbits & GUNBIT_GUNRATE)
+            total += 1;
+    }
+    if (flags & PS_BLEND)
+        total += 4;
+    if (flags & PS_FOV)
+        total += 1;
+    if (flags & PS_RDFLAGS)
+        total += 1;
+    total += 8 + server_stats_values_size(playerstate->statbits);
+#if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_DAMAGE_BLEND
+    if (flags & PS_KEX_DAMAGE_BLEND)
+        total += 4;
+#endif
+
+    *size = total;
+    return Q2P_ERR_SUCCESS;
+}
+
+static q2proto_error_t kex_server_write_playerstate(q2proto_servercontext_t *context, uintptr_t io_arg,
+                                                    const q2proto_svc_playerstate_t *playerstate)
+{
+    uint32_t flags;
+    CHECKED(server_write, io_arg, kex_server_playerstate_flags(playerstate, &flags));
+
     //
     // write it
     //
@@ -1735,24 +1883,7 @@ static q2proto_error_t kex_server_write_playerstate(q2proto_servercontext_t *con
     }
 
     if (flags & PS_WEAPONFRAME) {
-        uint16_t gunbits = 0;
-        if (playerstate->gunoffset.delta_bits & BIT(0))
-            gunbits |= GUNBIT_OFFSET_X;
-        if (playerstate->gunoffset.delta_bits & BIT(1))
-            gunbits |= GUNBIT_OFFSET_Y;
-        if (playerstate->gunoffset.delta_bits & BIT(2))
-            gunbits |= GUNBIT_OFFSET_Z;
-        if (playerstate->gunangles.delta_bits & BIT(0))
-            gunbits |= GUNBIT_ANGLES_X;
-        if (playerstate->gunangles.delta_bits & BIT(1))
-            gunbits |= GUNBIT_ANGLES_Y;
-        if (playerstate->gunangles.delta_bits & BIT(2))
-            gunbits |= GUNBIT_ANGLES_Z;
-#if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_GUNRATE_VIEWHEIGHT
-        if (playerstate->delta_bits & Q2P_PSD_GUNRATE)
-            gunbits |= GUNBIT_GUNRATE;
-#endif
-
+        uint16_t gunbits = kex_server_playerstate_gunbits(playerstate);
         uint16_t gunbits_and_frame = gunbits << 9 | playerstate->gunframe;
         WRITE_CHECKED(server_write, io_arg, u16, gunbits_and_frame);
 
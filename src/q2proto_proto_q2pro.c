@@ -93,12 +93,17 @@ static uint32_t q2pro_pack_solid(q2proto_clientcontext_t *context, const q2proto
 static void q2pro_unpack_solid(q2proto_clientcontext_t *context, uint32_t solid, q2proto_vec3_t mins,
                                q2proto_vec3_t maxs);
 
-q2proto_error_t q2proto_q2pro_continue_serverdata(q2proto_clientcontext_t *context, uintptr_t io_arg,
-                                                  q2proto_svc_serverdata_t *serverdata)
+void q2proto_q2pro_init_client_functions(q2proto_clientcontext_t *context)
 {
+    context->client_read = q2pro_client_read;
+    context->client_write = q2pro_client_write;
     context->pack_solid = q2pro_pack_solid;
     context->unpack_solid = q2pro_unpack_solid;
+}
 
+q2proto_error_t q2proto_q2pro_continue_serverdata(q2proto_clientcontext_t *context, uintptr_t io_arg,
+                                                  q2proto_svc_serverdata_t *serverdata)
+{
     READ_CHECKED(client_read, io_arg, serverdata->servercount, i32);
     READ_CHECKED(client_read, io_arg, serverdata->attractloop, bool);
     READ_CHECKED(client_read, io_arg, serverdata->gamedir, string);
@@ -122,8 +127,7 @@ q2proto_error_t q2proto_q2pro_continue_serverdata(q2proto_clientcontext_t *conte
         READ_CHECKED(client_read, io_arg, serverdata->q2pro.waterjump_hack, bool);
     }
 
-    context->client_read = q2pro_client_read;
-    context->client_write = q2pro_client_write;
+    q2proto_q2pro_init_client_functions(context);
     context->server_protocol = Q2P_PROTOCOL_Q2PRO;
     context->protocol_version = serverdata->protocol_version;
     context->features.batch_move = true;
@@ -759,6 +763,7 @@ static q2proto_error_t q2pro_client_read_playerstate(q2proto_clientcontext_t *co
             playerstate->gunindex = gun_index_and_skin & Q2PRO_GUNINDEX_MASK;
 #if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_GUNSKIN
             playerstate->gunskin = gun_index_and_skin >> Q2PRO_GUNINDEX_BITS;
+            playerstate->delta_bits |= Q2P_PSD_GUNSKIN;
 #endif
         } else
             READ_CHECKED(client_read, io_arg, playerstate->gunindex, u8);
@@ -1304,6 +1309,17 @@ static q2proto_error_t q2proto_server_write_maybe_diff_coords_comp(q2proto_serve
     return Q2P_ERR_SUCCESS;
 }
 
+static size_t q2proto_server_maybe_diff_coords_comp_size(q2proto_servercontext_t *context,
+                                                         const q2proto_maybe_diff_coords_t *coord, int comp)
+{
+    if (context->server_info->game_api == Q2PROTO_GAME_Q2PRO_EXTENDED_V2) {
+        int32_t prev_val = q2proto_var_coords_get_int_comp(&coord->write.prev, comp);
+        int32_t curr_val = q2proto_var_coords_get_int_comp(&coord->write.current, comp);
+        return q2protoio_q2pro_i23_size(curr_val, prev_val);
+    } else
+        return 2;
+}
+
 static q2proto_error_t q2pro_server_fill_serverdata(q2proto_servercontext_t *context,
                                                     q2proto_svc_serverdata_t *serverdata);
 static void q2pro_server_make_entity_state_delta(q2proto_servercontext_t *context,
@@ -1314,6 +1330,8 @@ static void q2pro_server_make_player_state_delta(q2proto_servercontext_t *contex
                                                  const q2proto_packed_player_state_t *from,
                                                  const q2proto_packed_player_state_t *to,
                                                  q2proto_svc_playerstate_t *delta);
+static q2proto_error_t q2pro_server_playerstate_size(q2proto_servercontext_t *context,
+                                                     const q2proto_svc_playerstate_t *playerstate, size_t *size);
 static q2proto_error_t q2pro_server_write(q2proto_servercontext_t *context, uintptr_t io_arg,
                                           const q2proto_svc_message_t *svc_message);
 static q2proto_error_t q2pro_server_write_gamestate_stream(q2proto_servercontext_t *context,
@@ -1332,10 +1350,13 @@ static q2proto_error_t q2pro_download_data(q2proto_server_download_state_t *stat
                                            size_t *remaining, size_t packet_remaining,
                                            q2proto_svc_download_t *svc_download);
 
+#define SVC_ZDOWNLOAD_SIZE 4
+
 static const struct q2proto_download_funcs_s q2pro_download_funcs = {.begin = q2pro_download_begin,
                                                                      .data = q2pro_download_data,
                                                                      .finish = q2proto_download_common_finish,
-                                                                     .abort = q2proto_download_common_abort};
+                                                                     .abort = q2proto_download_common_abort,
+                                                                     .zdownload_size = SVC_ZDOWNLOAD_SIZE};
 
 q2proto_error_t q2proto_q2pro_init_servercontext(q2proto_servercontext_t *context,
                                                  const q2proto_connect_t *connect_info)
@@ -1355,6 +1376,8 @@ q2proto_error_t q2proto_q2pro_init_servercontext(q2proto_servercontext_t *contex
     context->fill_serverdata = q2pro_server_fill_serverdata;
     context->make_entity_state_delta = q2pro_server_make_entity_state_delta;
     context->make_player_state_delta = q2pro_server_make_player_state_delta;
+    context->entity_delta_size = q2proto_q2pro_server_entity_delta_size;
+    context->playerstate_size = q2pro_server_playerstate_size;
     context->server_write = q2pro_server_write;
     // Write configstringstream, baselinestream if supported by protocol
     if (context->protocol_version >= PROTOCOL_VERSION_Q2PRO_EXTENDED_LIMITS)
@@ -1508,13 +1531,11 @@ static q2proto_error_t q2pro_server_write_serverdata(uintptr_t io_arg, const q2p
 }
 
 #define WRITE_GAME_POSITION    server_write_int23_coord
-#define WRITE_TEMP_ENTITY_DECL static
-#define WRITE_TEMP_ENTITY_NAME server_write_temp_entity_q2pro_ext_v2
+#define WRITE_TEMP_ENTITY_NAME q2proto_q2pro_server_write_temp_entity_int23
 
 #include "q2proto_write_temp_entity.inc"
 
 #undef WRITE_TEMP_ENTITY_NAME
-#undef WRITE_TEMP_ENTITY_DECL
 #undef WRITE_GAME_POSITION
 
 q2proto_error_t q2proto_q2pro_server_write_temp_entity(q2proto_protocol_t protocol,
@@ -1529,17 +1550,12 @@ q2proto_error_t q2proto_q2pro_server_write_temp_entity(q2proto_protocol_t protoc
     case Q2P_PROTOCOL_Q2PRO_EXTENDED_DEMO:
     case Q2P_PROTOCOL_Q2PRO_EXTENDED_V2_DEMO:
     case Q2P_PROTOCOL_Q2PRO_EXTENDED_DEMO_PLAYERFOG:
-        if (server_info->game_api >= Q2PROTO_GAME_Q2PRO_EXTENDED_V2) {
-            server_write_temp_entity_q2pro_ext_v2(io_arg, server_info->game_api, temp_entity);
-            break;
-        }
+        if (server_info->game_api >= Q2PROTO_GAME_Q2PRO_EXTENDED_V2)
+            return q2proto_q2pro_server_write_temp_entity_int23(io_arg, server_info->game_api, temp_entity);
         // else: fall through to short coords
     default:
-        q2proto_common_server_write_temp_entity_short(io_arg, server_info->game_api, temp_entity);
-        break;
+        return q2proto_common_server_write_temp_entity_short(io_arg, server_info->game_api, temp_entity);
     }
-
-    return Q2P_ERR_SUCCESS;
 }
 
 q2proto_error_t q2proto_q2pro_server_write_sound(q2proto_protocol_t protocol, const q2proto_server_info_t *server_info,
@@ -1566,12 +1582,11 @@ q2proto_error_t q2proto_q2pro_server_write_sound(q2proto_protocol_t protocol, co
     return Q2P_ERR_SUCCESS;
 }
 
-q2proto_error_t q2proto_q2pro_server_write_entity_state_delta(q2proto_servercontext_t *context, uintptr_t io_arg,
-                                                              uint16_t entnum,
-                                                              const q2proto_entity_state_delta_t *entity_state_delta)
+static q2proto_error_t q2pro_server_entity_state_delta_bits(q2proto_servercontext_t *context,
+                                                            const q2proto_entity_state_delta_t *entity_state_delta,
+                                                            uint64_t *entity_bits)
 {
     bool has_q2pro_extensions = context->server_info->game_api != Q2PROTO_GAME_VANILLA;
-    bool has_q2pro_extensions_v2 = context->server_info->game_api == Q2PROTO_GAME_Q2PRO_EXTENDED_V2;
     uint64_t bits = 0;
 
     unsigned origin_changes = q2proto_maybe_diff_coords_write_differs_int(&entity_state_delta->origin);
@@ -1656,7 +1671,96 @@ q2proto_error_t q2proto_q2pro_server_write_entity_state_delta(q2proto_servercont
         bits |= U_SCALE;
     }
 
-    //----------
+    *entity_bits = bits;
+    return Q2P_ERR_SUCCESS;
+}
+
+q2proto_error_t q2proto_q2pro_server_entity_delta_size(q2proto_servercontext_t *context, uint16_t entnum,
+                                                       const q2proto_entity_state_delta_t *entity_state_delta,
+                                                       size_t *size)
+{
+    bool has_q2pro_extensions = context->server_info->game_api != Q2PROTO_GAME_VANILLA;
+    bool has_q2pro_extensions_v2 = context->server_info->game_api == Q2PROTO_GAME_Q2PRO_EXTENDED_V2;
+    uint64_t bits;
+    CHECKED(server_write, 0, q2pro_server_entity_state_delta_bits(context, entity_state_delta, &bits));
+
+    size_t total = q2proto_common_server_entity_bits_size(bits, entnum);
+    size_t model_size = (bits & U_MODEL16) ? 2 : 1;
+    if (bits & U_MODEL)
+        total += model_size;
+    if (bits & U_MODEL2)
+        total += model_size;
+    if (bits & U_MODEL3)
+        total += model_size;
+    if (bits & U_MODEL4)
+        total += model_size;
+    if (bits & U_FRAME16)
+        total += 2;
+    else if (bits & U_FRAME8)
+        total += 1;
+    total += q2proto_common_width_flags_size(bits, U_SKIN8, U_SKIN16);
+    total += q2proto_common_width_flags_size(bits, U_EFFECTS8, U_EFFECTS16);
+    total += q2proto_common_width_flags_size(bits, U_RENDERFX8, U_RENDERFX16);
+    if (bits & U_ORIGIN1)
+        total += q2proto_server_maybe_diff_coords_comp_size(context, &entity_state_delta->origin, 0);
+    if (bits & U_ORIGIN2)
+        total += q2proto_server_maybe_diff_coords_comp_size(context, &entity_state_delta->origin, 1);
+    if (bits & U_ORIGIN3)
+        total += q2proto_server_maybe_diff_coords_comp_size(context, &entity_state_delta->origin, 2);
+    size_t angle_size = (bits & U_ANGLE16) ? 2 : 1;
+    if (bits & U_ANGLE1)
+        total += angle_size;
+    if (bits & U_ANGLE2)
+        total += angle_size;
+    if (bits & U_ANGLE3)
+        total += angle_size;
+    if (bits & U_OLDORIGIN) {
+        if (has_q2pro_extensions_v2)
+            total += q2protoio_var_coords_q2pro_i23_size(&entity_state_delta->old_origin);
+        else
+            total += 6;
+    }
+    if (bits & U_SOUND) {
+        if (has_q2pro_extensions) {
+            total += 2;
+#if Q2PROTO_ENTITY_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_ENTITY_LOOP_ALPHA_SCALE_FX64
+            if (entity_state_delta->delta_bits & Q2P_ESD_LOOP_VOLUME)
+                total += 1;
+            if (entity_state_delta->delta_bits & Q2P_ESD_LOOP_ATTENUATION)
+                total += 1;
+#endif
+        } else {
+            if (entity_state_delta->sound > 255)
+                return Q2P_ERR_BAD_DATA;
+            if (entity_state_delta->delta_bits & (Q2P_ESD_LOOP_ATTENUATION | Q2P_ESD_LOOP_VOLUME))
+                return Q2P_ERR_BAD_DATA;
+            total += 1;
+        }
+    }
+    if (bits & U_EVENT)
+        total += 1;
+    if (bits & U_SOLID)
+        total += 4;
+#if Q2PROTO_ENTITY_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_ENTITY_LOOP_ALPHA_SCALE_FX64
+    total += q2proto_common_width_flags_size(bits, U_MOREFX8, U_MOREFX16);
+    if (bits & U_ALPHA)
+        total += 1;
+    if (bits & U_SCALE)
+        total += 1;
+#endif
+
+    *size = total;
+    return Q2P_ERR_SUCCESS;
+}
+
+q2proto_error_t q2proto_q2pro_server_write_entity_state_delta(q2proto_servercontext_t *context, uintptr_t io_arg,
+                                                              uint16_t entnum,
+                                                              const q2proto_entity_state_delta_t *entity_state_delta)
+{
+    bool has_q2pro_extensions = context->server_info->game_api != Q2PROTO_GAME_VANILLA;
+    bool has_q2pro_extensions_v2 = context->server_info->game_api == Q2PROTO_GAME_Q2PRO_EXTENDED_V2;
+    uint64_t bits;
+    CHECKED(server_write, io_arg, q2pro_server_entity_state_delta_bits(context, entity_state_delta, &bits));
 
     q2proto_common_server_write_entity_bits(io_arg, bits, entnum);
 
@@ -1823,17 +1927,10 @@ static q2proto_error_t q2pro_server_write_download(q2proto_servercontext_t *cont
     WRITE_CHECKED(server_write, io_arg, u8, download->compressed ? svc_r1q2_zdownload : svc_download);
     WRITE_CHECKED(server_write, io_arg, i16, download->size);
     WRITE_CHECKED(server_write, io_arg, u8, download->percent);
-    if (download->size > 0) {
-        void *p;
-        CHECKED_IO(server_write, io_arg, p = q2protoio_write_reserve_raw(io_arg, download->size),
-                   "reserve download data");
-        memcpy(p, download->data, download->size);
-    }
-    return Q2P_ERR_SUCCESS;
+    return q2proto_common_server_write_download_data(io_arg, download);
 }
 
-q2proto_error_t q2proto_q2pro_server_write_playerfog(q2proto_servercontext_t *context, uintptr_t io_arg,
-                                                     const q2proto_svc_fog_t *fog)
+static uint8_t q2pro_server_playerfog_bits(const q2proto_svc_fog_t *fog)
 {
     uint8_t fog_bits = 0;
     if (fog->global.color.delta_bits != 0)
@@ -1852,6 +1949,36 @@ q2proto_error_t q2proto_q2pro_server_write_playerfog(q2proto_servercontext_t *co
         fog_bits |= Q2PRO_FOG_BIT_HEIGHT_START_DIST;
     if (fog->flags & Q2P_HEIGHTFOG_END_DIST)
         fog_bits |= Q2PRO_FOG_BIT_HEIGHT_END_DIST;
+    return fog_bits;
+}
+
+size_t q2proto_q2pro_server_playerfog_size(const q2proto_svc_fog_t *fog)
+{
+    uint8_t fog_bits = q2pro_server_playerfog_bits(fog);
+    size_t total = 1;
+    if (fog_bits & Q2PRO_FOG_BIT_COLOR)
+        total += 3;
+    if (fog_bits & Q2PRO_FOG_BIT_DENSITY)
+        total += 4;
+    if (fog_bits & Q2PRO_FOG_BIT_HEIGHT_DENSITY)
+        total += 2;
+    if (fog_bits & Q2PRO_FOG_BIT_HEIGHT_FALLOFF)
+        total += 2;
+    if (fog_bits & Q2PRO_FOG_BIT_HEIGHT_START_COLOR)
+        total += 3;
+    if (fog_bits & Q2PRO_FOG_BIT_HEIGHT_END_COLOR)
+        total += 3;
+    if (fog_bits & Q2PRO_FOG_BIT_HEIGHT_START_DIST)
+        total += q2protoio_q2pro_i23_size(q2proto_var_coord_get_int(&fog->height.start_dist), 0);
+    if (fog_bits & Q2PRO_FOG_BIT_HEIGHT_END_DIST)
+        total += q2protoio_q2pro_i23_size(q2proto_var_coord_get_int(&fog->height.end_dist), 0);
+    return total;
+}
+
+q2proto_error_t q2proto_q2pro_server_write_playerfog(q2proto_servercontext_t *context, uintptr_t io_arg,
+                                                     const q2proto_svc_fog_t *fog)
+{
+    uint8_t fog_bits = q2pro_server_playerfog_bits(fog);
 
     WRITE_CHECKED(server_write, io_arg, u8, fog_bits);
     if (fog_bits & Q2PRO_FOG_BIT_COLOR) {
@@ -1887,8 +2014,9 @@ q2proto_error_t q2proto_q2pro_server_write_playerfog(q2proto_servercontext_t *co
     return Q2P_ERR_SUCCESS;
 }
 
-static q2proto_error_t q2pro_server_write_playerstate(q2proto_servercontext_t *context, uintptr_t io_arg,
-                                                      const q2proto_svc_playerstate_t *playerstate, uint8_t *extraflags)
+static q2proto_error_t q2pro_server_playerstate_flags(q2proto_servercontext_t *context,
+                                                      const q2proto_svc_playerstate_t *playerstate,
+                                                      uint32_t *playerstate_flags, uint8_t *extraflags)
 {
     bool has_q2pro_extensions = context->server_info->game_api != Q2PROTO_GAME_VANILLA;
     bool has_q2pro_extensions_v2 = context->server_info->game_api == Q2PROTO_GAME_Q2PRO_EXTENDED_V2;
@@ -1980,6 +2108,105 @@ static q2proto_error_t q2pro_server_write_playerstate(q2proto_servercontext_t *c
         flags |= PS_MOREBITS;
     }
 
+    *playerstate_flags = flags;
+    return Q2P_ERR_SUCCESS;
+}
+
+static q2proto_error_t q2pro_server_playerstate_size(q2proto_servercontext_t *context,
+                                                     const q2proto_svc_playerstate_t *playerstate, size_t *size)
+{
+    bool has_q2pro_extensions = context->server_info->game_api != Q2PROTO_GAME_VANILLA;
+    bool has_q2pro_extensions_v2 = context->server_info->game_api == Q2PROTO_GAME_Q2PRO_EXTENDED_V2;
+    uint32_t flags;
+    uint8_t extraflags;
+    CHECKED(server_write, 0, q2pro_server_playerstate_flags(context, playerstate, &flags, &extraflags));
+
+    // extraflags are stored in frame header
+    size_t total = 2 /* flags */;
+    if (flags & PS_MOREBITS)
+        total += 1;
+    if (flags & PS_M_TYPE)
+        total += 1;
+    if (flags & PS_M_ORIGIN) {
+        total += q2proto_server_maybe_diff_coords_comp_size(context, &playerstate->pm_origin, 0);
+        total += q2proto_server_maybe_diff_coords_comp_size(context, &playerstate->pm_origin, 1);
+    }
+    if (extraflags & EPS_M_ORIGIN2)
+        total += q2proto_server_maybe_diff_coords_comp_size(context, &playerstate->pm_origin, 2);
+    if (flags & PS_M_VELOCITY) {
+        total += q2proto_server_maybe_diff_coords_comp_size(context, &playerstate->pm_velocity, 0);
+        total += q2proto_server_maybe_diff_coords_comp_size(context, &playerstate->pm_velocity, 1);
+    }
+    if (extraflags & EPS_M_VELOCITY2)
+        total += q2proto_server_maybe_diff_coords_comp_size(context, &playerstate->pm_velocity, 2);
+    if (flags & PS_M_TIME)
+        total += has_q2pro_extensions_v2 ? 2 : 1;
+    if (flags & PS_M_FLAGS)
+        total += has_q2pro_extensions_v2 ? 2 : 1;
+    if (flags & PS_M_GRAVITY)
+        total += 2;
+    if (flags & PS_M_DELTA_ANGLES)
+        total += 6;
+    if (flags & PS_VIEWOFFSET)
+        total += 3;
+    if (flags & PS_VIEWANGLES)
+        total += 4;
+    if (extraflags & EPS_VIEWANGLE2)
+        total += 2;
+    if (flags & PS_KICKANGLES)
+        total += 3;
+    if (flags & PS_WEAPONINDEX)
+        total += has_q2pro_extensions ? 2 : 1;
+    if (flags & PS_WEAPONFRAME)
+        total += 1;
+    if (extraflags & EPS_GUNOFFSET)
+        total += 3;
+    if (extraflags & EPS_GUNANGLES)
+        total += 3;
+    if (flags & PS_BLEND) {
+        if (has_q2pro_extensions_v2) {
+#if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_DAMAGE_BLEND
+            total += server_q2pro_extv2_blends_size(&playerstate->blend, &playerstate->damage_blend);
+#else
+            const q2proto_color_delta_t null_blend = {0};
+            total += server_q2pro_extv2_blends_size(&playerstate->blend, &null_blend);
+#endif
+        } else
+            total += 4;
+    }
+#if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_FOG
+    if (flags & PS_Q2PRO_PLAYERFOG)
+        total += q2proto_q2pro_server_playerfog_size(&playerstate->fog);
+#endif
+    if (flags & PS_FOV)
+        total += 1;
+    if (flags & PS_RDFLAGS)
+        total += 1;
+    if (extraflags & EPS_STATS) {
+        total += has_q2pro_extensions_v2 ? q2protoio_var_u64_size(playerstate->statbits) : 4;
+        total += server_stats_values_size(playerstate->statbits);
+    }
+    if (extraflags & EPS_CLIENTNUM) {
+        if (context->protocol_version >= PROTOCOL_VERSION_Q2PRO_CLIENTNUM_SHORT)
+            total += 2;
+        else if (playerstate->clientnum > 255)
+            return Q2P_ERR_BAD_DATA;
+        else
+            total += 1;
+    }
+
+    *size = total;
+    return Q2P_ERR_SUCCESS;
+}
+
+static q2proto_error_t q2pro_server_write_playerstate(q2proto_servercontext_t *context, uintptr_t io_arg,
+                                                      const q2proto_svc_playerstate_t *playerstate, uint8_t *extraflags)
+{
+    bool has_q2pro_extensions = context->server_info->game_api != Q2PROTO_GAME_VANILLA;
+    bool has_q2pro_extensions_v2 = context->server_info->game_api == Q2PROTO_GAME_Q2PRO_EXTENDED_V2;
+    uint32_t flags;
+    CHECKED(server_write, io_arg, q2pro_server_playerstate_flags(context, playerstate, &flags, extraflags));
+
     //
     // write it
     //
@@ -2541,8 +2768,6 @@ static q2proto_error_t q2pro_download_begin(q2proto_servercontext_t *context, q2
     return Q2P_ERR_SUCCESS;
 }
 
-#define SVC_ZDOWNLOAD_SIZE 4
-
 static q2proto_error_t q2pro_download_data(q2proto_server_download_state_t *state, const uint8_t **data,
                                            size_t *remaining, size_t packet_remaining,
                                            q2proto_svc_download_t *svc_download)
@@ -2557,6 +2782,7 @@ static q2proto_error_t q2pro_download_data(q2proto_server_download_state_t *stat
         svc_download->data = *data;
         svc_download->size = (int16_t)download_size;
         svc_download->uncompressed_size = -1; // indicates unknown compressed size
+        svc_download->data_reference = true;
 
         *data += download_size;
         *remaining -= download_size;
@@ -2602,6 +2828,7 @@ static q2proto_error_t q2pro_download_data(q2proto_server_download_state_t *stat
         svc_download->data = compressed_data;
         svc_download->size = compressed_size;
         svc_download->uncompressed_size = in_consumed;
+        svc_download->data_reference = false;
 
         return q2proto_download_common_complete_struct(state, *remaining, svc_download);
     }
@@ -38,6 +38,8 @@ Q2PROTO_PRIVATE_API const char *q2proto_q2pro_connect_tail(const q2proto_connect
 Q2PROTO_PRIVATE_API q2proto_error_t q2proto_q2pro_continue_serverdata(q2proto_clientcontext_t *context,
                                                                       uintptr_t io_arg,
                                                                       q2proto_svc_serverdata_t *serverdata);
+/// Set client context functions, for restoring a saved client state
+Q2PROTO_PRIVATE_API void q2proto_q2pro_init_client_functions(q2proto_clientcontext_t *context);
 
 /// Server context setup
 Q2PROTO_PRIVATE_API q2proto_error_t q2proto_q2pro_init_servercontext(q2proto_servercontext_t *context,
@@ -58,6 +60,8 @@ Q2PROTO_PRIVATE_API q2proto_error_t q2proto_q2pro_client_read_playerfog(q2proto_
 Q2PROTO_PRIVATE_API q2proto_error_t
 q2proto_q2pro_server_write_temp_entity(q2proto_protocol_t protocol, const q2proto_server_info_t *server_info,
                                        uintptr_t io_arg, const q2proto_svc_temp_entity_t *temp_entity);
+Q2PROTO_PRIVATE_API q2proto_error_t q2proto_q2pro_server_write_temp_entity_int23(
+    uintptr_t io_arg, q2proto_game_api_t game_api, const q2proto_svc_temp_entity_t *temp_entity);
 Q2PROTO_PRIVATE_API q2proto_error_t q2proto_q2pro_server_write_sound(q2proto_protocol_t protocol,
                                                                      const q2proto_server_info_t *server_info,
                                                                      uintptr_t io_arg,
@@ -65,6 +69,10 @@ Q2PROTO_PRIVATE_API q2proto_error_t q2proto_q2pro_server_write_sound(q2proto_pro
 Q2PROTO_PRIVATE_API q2proto_error_t
 q2proto_q2pro_server_write_entity_state_delta(q2proto_servercontext_t *context, uintptr_t io_arg, uint16_t entnum,
                                               const q2proto_entity_state_delta_t *entity_state_delta);
+Q2PROTO_PRIVATE_API q2proto_error_t q2proto_q2pro_server_entity_delta_size(
+    q2proto_servercontext_t *context, uint16_t entnum, const q2proto_entity_state_delta_t *entity_state_delta,
+    size_t *size);
+Q2PROTO_PRIVATE_API size_t q2proto_q2pro_server_playerfog_size(const q2proto_svc_fog_t *fog);
 Q2PROTO_PRIVATE_API q2proto_error_t q2proto_q2pro_server_write_playerfog(q2proto_servercontext_t *context,
                                                                          uintptr_t io_arg,
                                                                          const q2proto_svc_fog_t *fog);
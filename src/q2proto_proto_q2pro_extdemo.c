@@ -38,15 +38,19 @@ static uint32_t q2pro_extdemo_pack_solid(q2proto_clientcontext_t *context, const
 static void q2pro_extdemo_unpack_solid(q2proto_clientcontext_t *context, uint32_t solid, q2proto_vec3_t mins,
                                        q2proto_vec3_t maxs);
 
+void q2proto_q2pro_extdemo_init_client_functions(q2proto_clientcontext_t *context)
+{
+    context->client_read = q2pro_extdemo_client_read;
+    context->pack_solid = q2pro_extdemo_pack_solid;
+    context->unpack_solid = q2pro_extdemo_unpack_solid;
+}
+
 q2proto_error_t q2proto_q2pro_extdemo_continue_serverdata(q2proto_clientcontext_t *context, uintptr_t io_arg,
                                                           q2proto_svc_serverdata_t *serverdata)
 {
     bool has_q2pro_extensions_v2 = serverdata->protocol >= PROTOCOL_Q2PRO_DEMO_EXT_LIMITS_2;
     bool has_playerfog = serverdata->protocol >= PROTOCOL_Q2PRO_DEMO_EXT_PLAYERFOG;
 
-    context->pack_solid = q2pro_extdemo_pack_solid;
-    context->unpack_solid = q2pro_extdemo_unpack_solid;
-
     READ_CHECKED(client_read, io_arg, serverdata->servercount, i32);
     READ_CHECKED(client_read, io_arg, serverdata->attractloop, bool);
     READ_CHECKED(client_read, io_arg, serverdata->gamedir, string);
@@ -64,8 +68,8 @@ q2proto_error_t q2proto_q2pro_extdemo_continue_serverdata(q2proto_clientcontext_
     serverdata->q2pro.extensions = true;
     serverdata->q2pro.extensions_v2 = has_q2pro_extensions_v2;
 
-    context->client_read = q2pro_extdemo_client_read;
-    context->server_protocol = serverdata->protocol;
+    q2proto_q2pro_extdemo_init_client_functions(context);
+    context->server_protocol = q2proto_protocol_from_netver(serverdata->protocol);
     context->protocol_version = serverdata->protocol_version;
     context->features.batch_move = true;
     context->features.userinfo_delta = true;
@@ -265,7 +269,7 @@ static q2proto_error_t q2pro_extdemo_client_read_playerstate(q2proto_clientconte
                                                              q2proto_svc_playerstate_t *playerstate)
 {
     bool has_q2pro_extensions_v2 = context->features.server_game_api == Q2PROTO_GAME_Q2PRO_EXTENDED_V2;
-    bool has_playerfog = context->server_protocol >= PROTOCOL_Q2PRO_DEMO_EXT_PLAYERFOG;
+    bool has_playerfog = context->features.has_playerfog;
     uint32_t flags;
     READ_CHECKED(client_read, io_arg, flags, u16);
     if (has_playerfog && flags & PS_MOREBITS) {
@@ -336,7 +340,7 @@ static q2proto_error_t q2pro_extdemo_client_read_playerstate(q2proto_clientconte
     if (delta_bits_check(flags, PS_KICKANGLES, &playerstate->delta_bits, Q2P_PSD_KICKANGLES))
         CHECKED(client_read, io_arg, read_var_small_angles(io_arg, &playerstate->kick_angles));
 
-    if (delta_bits_check(flags, PS_WEAPONINDEX, &playerstate->delta_bits, Q2P_PSD_GUNINDEX)) {
+    if (delta_bits_check(flags, PS_WEAPONINDEX, &playerstate->delta_bits, Q2P_PSD_GUNINDEX | Q2P_PSD_GUNSKIN)) {
         uint16_t gun_index_and_skin;
         READ_CHECKED(client_read, io_arg, gun_index_and_skin, u16);
         playerstate->gunindex = gun_index_and_skin & Q2PRO_GUNINDEX_MASK;
@@ -450,6 +454,8 @@ static void q2pro_extdemo_server_make_player_state_delta(q2proto_servercontext_t
                                                          const q2proto_packed_player_state_t *from,
                                                          const q2proto_packed_player_state_t *to,
                                                          q2proto_svc_playerstate_t *delta);
+static q2proto_error_t q2pro_extdemo_server_playerstate_size(q2proto_servercontext_t *context,
+                                                             const q2proto_svc_playerstate_t *playerstate, size_t *size);
 static q2proto_error_t q2pro_extdemo_server_write(q2proto_servercontext_t *context, uintptr_t io_arg,
                                                   const q2proto_svc_message_t *svc_message);
 static q2proto_error_t q2pro_extdemo_server_write_frame(q2proto_servercontext_t *context, uintptr_t io_arg,
@@ -477,6 +483,8 @@ q2proto_error_t q2proto_q2pro_extdemo_init_servercontext(q2proto_servercontext_t
     context->fill_serverdata = q2pro_extdemo_server_fill_serverdata;
     context->make_entity_state_delta = q2pro_extdemo_server_make_entity_state_delta;
     context->make_player_state_delta = q2pro_extdemo_server_make_player_state_delta;
+    context->entity_delta_size = q2proto_q2pro_server_entity_delta_size;
+    context->playerstate_size = q2pro_extdemo_server_playerstate_size;
     context->server_write = q2pro_extdemo_server_write;
     context->server_write_gamestate = q2pro_extdemo_server_write_gamestate;
     return Q2P_ERR_SUCCESS;
@@ -600,8 +608,9 @@ static q2proto_error_t q2pro_extdemo_server_write_spawnbaseline(q2proto_serverco
     return Q2P_ERR_SUCCESS;
 }
 
-static q2proto_error_t q2pro_extdemo_server_write_playerstate(q2proto_servercontext_t *context, uintptr_t io_arg,
-                                                              const q2proto_svc_playerstate_t *playerstate)
+static q2proto_error_t q2pro_extdemo_server_playerstate_flags(q2proto_servercontext_t *context,
+                                                              const q2proto_svc_playerstate_t *playerstate,
+                                                              uint32_t *playerstate_flags)
 {
     bool has_q2pro_extensions_v2 = context->server_info->game_api == Q2PROTO_GAME_Q2PRO_EXTENDED_V2;
     bool has_morebits = context->protocol >= Q2P_PROTOCOL_Q2PRO_EXTENDED_DEMO_PLAYERFOG;
@@ -668,6 +677,92 @@ static q2proto_error_t q2pro_extdemo_server_write_playerstate(q2proto_servercont
         flags |= PS_MOREBITS;
     }
 
+    *playerstate_flags = flags;
+    return Q2P_ERR_SUCCESS;
+}
+
+static size_t q2pro_extdemo_server_coords_size(q2proto_servercontext_t *context,
+                                               const q2proto_maybe_diff_coords_t *coord)
+{
+    if (context->server_info->game_api != Q2PROTO_GAME_Q2PRO_EXTENDED_V2)
+        return 6;
+
+    size_t total = 0;
+    for (int c = 0; c < 3; c++) {
+        int32_t prev_val = q2proto_var_coords_get_int_comp(&coord->write.prev, c);
+        int32_t curr_val = q2proto_var_coords_get_int_comp(&coord->write.current, c);
+        total += q2protoio_q2pro_i23_size(curr_val, prev_val);
+    }
+    return total;
+}
+
+static q2proto_error_t q2pro_extdemo_server_playerstate_size(q2proto_servercontext_t *context,
+                                                             const q2proto_svc_playerstate_t *playerstate, size_t *size)
+{
+    bool has_q2pro_extensions_v2 = context->server_info->game_api == Q2PROTO_GAME_Q2PRO_EXTENDED_V2;
+    uint32_t flags;
+    CHECKED(server_write, 0, q2pro_extdemo_server_playerstate_flags(context, playerstate, &flags));
+
+    size_t total = 1 /* svc_playerinfo */ + 2 /* flags */;
+    if (flags & PS_MOREBITS)
+        total += 1;
+    if (flags & PS_M_TYPE)
+        total += 1;
+    if (flags & PS_M_ORIGIN)
+        total += q2pro_extdemo_server_coords_size(context, &playerstate->pm_origin);
+    if (flags & PS_M_VELOCITY)
+        total += q2pro_extdemo_server_coords_size(context, &playerstate->pm_velocity);
+    if (flags & PS_M_TIME)
+        total += has_q2pro_extensions_v2 ? 2 : 1;
+    if (flags & PS_M_FLAGS)
+        total += has_q2pro_extensions_v2 ? 2 : 1;
+    if (flags & PS_M_GRAVITY)
+        total += 2;
+    if (flags & PS_M_DELTA_ANGLES)
+        total += 6;
+    if (flags & PS_VIEWOFFSET)
+        total += 3;
+    if (flags & PS_VIEWANGLES)
+        total += 6;
+    if (flags & PS_KICKANGLES)
+        total += 3;
+    if (flags & PS_WEAPONINDEX)
+        total += 2;
+    if (flags & PS_WEAPONFRAME)
+        total += 7;
+    if (flags & PS_BLEND) {
+        if (has_q2pro_extensions_v2) {
+#if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_DAMAGE_BLEND
+            total += server_q2pro_extv2_blends_size(&playerstate->blend, &playerstate->damage_blend);
+#else
+            const q2proto_color_delta_t null_blend = {0};
+            total += server_q2pro_extv2_blends_size(&playerstate->blend, &null_blend);
+#endif
+        } else
+            total += 4;
+    }
+#if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_FOG
+    if (flags & PS_Q2PRO_PLAYERFOG)
+        total += q2proto_q2pro_server_playerfog_size(&playerstate->fog);
+#endif
+    if (flags & PS_FOV)
+        total += 1;
+    if (flags & PS_RDFLAGS)
+        total += 1;
+    total += has_q2pro_extensions_v2 ? q2protoio_var_u64_size(playerstate->statbits) : 4;
+    total += server_stats_values_size(playerstate->statbits);
+
+    *size = total;
+    return Q2P_ERR_SUCCESS;
+}
+
+static q2proto_error_t q2pro_extdemo_server_write_playerstate(q2proto_servercontext_t *context, uintptr_t io_arg,
+                                                              const q2proto_svc_playerstate_t *playerstate)
+{
+    bool has_q2pro_extensions_v2 = context->server_info->game_api == Q2PROTO_GAME_Q2PRO_EXTENDED_V2;
+    uint32_t flags;
+    CHECKED(server_write, io_arg, q2pro_extdemo_server_playerstate_flags(context, playerstate, &flags));
+
     //
     // write it
     //
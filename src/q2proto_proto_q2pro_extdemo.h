@@ -30,6 +30,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 Q2PROTO_PRIVATE_API q2proto_error_t q2proto_q2pro_extdemo_continue_serverdata(q2proto_clientcontext_t *context,
                                                                               uintptr_t io_arg,
                                                                               q2proto_svc_serverdata_t *serverdata);
+/// Set client context functions, for restoring a saved client state
+Q2PROTO_PRIVATE_API void q2proto_q2pro_extdemo_init_client_functions(q2proto_clientcontext_t *context);
 
 /// Server context setup (Note: Only supports writing server messages)
 Q2PROTO_PRIVATE_API q2proto_error_t q2proto_q2pro_extdemo_init_servercontext(q2proto_servercontext_t *context,
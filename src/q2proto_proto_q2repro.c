@@ -119,12 +119,17 @@ static uint32_t q2repro_pack_solid(q2proto_clientcontext_t *context, const q2pro
 static void q2repro_unpack_solid(q2proto_clientcontext_t *context, uint32_t solid, q2proto_vec3_t mins,
                                  q2proto_vec3_t maxs);
 
-q2proto_error_t q2proto_q2repro_continue_serverdata(q2proto_clientcontext_t *context, uintptr_t io_arg,
-                                                    q2proto_svc_serverdata_t *serverdata)
+void q2proto_q2repro_init_client_functions(q2proto_clientcontext_t *context)
 {
+    context->client_read = q2repro_client_read;
+    context->client_write = q2repro_client_write;
     context->pack_solid = q2repro_pack_solid;
     context->unpack_solid = q2repro_unpack_solid;
+}
 
+q2proto_error_t q2proto_q2repro_continue_serverdata(q2proto_clientcontext_t *context, uintptr_t io_arg,
+                                                    q2proto_svc_serverdata_t *serverdata)
+{
     READ_CHECKED(client_read, io_arg, serverdata->servercount, i32);
     READ_CHECKED(client_read, io_arg, serverdata->attractloop, bool);
     READ_CHECKED(client_read, io_arg, serverdata->gamedir, string);
@@ -149,8 +154,7 @@ q2proto_error_t q2proto_q2repro_continue_serverdata(q2proto_clientcontext_t *con
         serverdata->server_fps = (((int)serverdata->server_fps + 5) / 10) * 10;
     }
 
-    context->client_read = q2repro_client_read;
-    context->client_write = q2repro_client_write;
+    q2proto_q2repro_init_client_functions(context);
     context->server_protocol = Q2P_PROTOCOL_Q2REPRO;
     context->protocol_version = serverdata->protocol_version;
     context->features.batch_move = true;
@@ -684,7 +688,7 @@ static q2proto_error_t q2repro_client_read_playerstate(q2proto_clientcontext_t *
     if (delta_bits_check(flags, PS_KICKANGLES, &playerstate->delta_bits, Q2P_PSD_KICKANGLES))
         CHECKED(client_read, io_arg, read_kickangles_q2repro(io_arg, &playerstate->kick_angles));
 
-    if (delta_bits_check(flags, PS_WEAPONINDEX, &playerstate->delta_bits, Q2P_PSD_GUNINDEX)) {
+    if (delta_bits_check(flags, PS_WEAPONINDEX, &playerstate->delta_bits, Q2P_PSD_GUNINDEX | Q2P_PSD_GUNSKIN)) {
         uint16_t gun_index_and_skin;
         READ_CHECKED(client_read, io_arg, gun_index_and_skin, u16);
         playerstate->gunindex = gun_index_and_skin & Q2PRO_GUNINDEX_MASK;
@@ -1329,6 +1333,11 @@ static void q2repro_server_make_player_state_delta(q2proto_servercontext_t *cont
                                                    const q2proto_packed_player_state_t *from,
                                                    const q2proto_packed_player_state_t *to,
                                                    q2proto_svc_playerstate_t *delta);
+static q2proto_error_t q2repro_server_entity_delta_size(q2proto_servercontext_t *context, uint16_t entnum,
+                                                        const q2proto_entity_state_delta_t *entity_state_delta,
+                                                        size_t *size);
+static q2proto_error_t q2repro_server_playerstate_size(q2proto_servercontext_t *context,
+                                                       const q2proto_svc_playerstate_t *playerstate, size_t *size);
 static q2proto_error_t q2repro_server_write(q2proto_servercontext_t *context, uintptr_t io_arg,
                                             const q2proto_svc_message_t *svc_message);
 static q2proto_error_t q2repro_server_write_gamestate(q2proto_servercontext_t *context,
@@ -1344,10 +1353,13 @@ static q2proto_error_t q2repro_download_data(q2proto_server_download_state_t *st
                                              size_t *remaining, size_t packet_remaining,
                                              q2proto_svc_download_t *svc_download);
 
+#define SVC_ZDOWNLOAD_SIZE 4
+
 static const struct q2proto_download_funcs_s q2repro_download_funcs = {.begin = q2repro_download_begin,
                                                                        .data = q2repro_download_data,
                                                                        .finish = q2proto_download_common_finish,
-                                                                       .abort = q2proto_download_common_abort};
+                                                                       .abort = q2proto_download_common_abort,
+                                                                       .zdownload_size = SVC_ZDOWNLOAD_SIZE};
 
 q2proto_error_t q2proto_q2repro_init_servercontext(q2proto_servercontext_t *context,
                                                    const q2proto_connect_t *connect_info)
@@ -1362,6 +1374,8 @@ q2proto_error_t q2proto_q2repro_init_servercontext(q2proto_servercontext_t *cont
     context->fill_serverdata = q2repro_server_fill_serverdata;
     context->make_entity_state_delta = q2repro_server_make_entity_state_delta;
     context->make_player_state_delta = q2repro_server_make_player_state_delta;
+    context->entity_delta_size = q2repro_server_entity_delta_size;
+    context->playerstate_size = q2repro_server_playerstate_size;
     context->server_write = q2repro_server_write;
     context->server_write_gamestate = q2repro_server_write_gamestate;
     context->server_read = q2repro_server_read;
@@ -1509,10 +1523,12 @@ static void q2repro_server_make_player_state_delta(q2proto_servercontext_t *cont
     if (!from)
         from = &q2proto_null_packed_player_state;
 
-    if (to->pm_type != from->pm_type) {
-        delta->delta_bits |= Q2P_PSD_PM_TYPE;
+    q2proto_player_state_changes_t changes;
+    q2proto_packing_player_state_changes(from, to, &changes);
+    delta->delta_bits = changes.delta_bits;
+
+    if (delta->delta_bits & Q2P_PSD_PM_TYPE)
         delta->pm_type = to->pm_type;
-    }
 
     for (int c = 0; c < 3; c++) {
         q2proto_var_coords_set_float_comp(&delta->pm_origin.write.prev, c,
@@ -1525,77 +1541,58 @@ static void q2repro_server_make_player_state_delta(q2proto_servercontext_t *cont
                                           _q2proto_valenc_bits2float(to->pm_velocity[c]));
     }
 
-    if (to->pm_time != from->pm_time) {
-        delta->delta_bits |= Q2P_PSD_PM_TIME;
+    if (delta->delta_bits & Q2P_PSD_PM_TIME)
         delta->pm_time = to->pm_time;
-    }
-
-    if (to->pm_flags != from->pm_flags) {
-        delta->delta_bits |= Q2P_PSD_PM_FLAGS;
+    if (delta->delta_bits & Q2P_PSD_PM_FLAGS)
         delta->pm_flags = to->pm_flags;
-    }
-
-    if (to->pm_gravity != from->pm_gravity) {
-        delta->delta_bits |= Q2P_PSD_PM_GRAVITY;
+    if (delta->delta_bits & Q2P_PSD_PM_GRAVITY)
         delta->pm_gravity = to->pm_gravity;
-    }
 
-    if (memcmp(&to->pm_delta_angles, &from->pm_delta_angles, sizeof(to->pm_delta_angles)) != 0) {
-        delta->delta_bits |= Q2P_PSD_PM_DELTA_ANGLES;
+    if (delta->delta_bits & Q2P_PSD_PM_DELTA_ANGLES) {
         q2proto_var_angles_set_short_comp(&delta->pm_delta_angles, 0, to->pm_delta_angles[0] & 0xffff);
         q2proto_var_angles_set_short_comp(&delta->pm_delta_angles, 1, to->pm_delta_angles[1] & 0xffff);
         q2proto_var_angles_set_short_comp(&delta->pm_delta_angles, 2, to->pm_delta_angles[2] & 0xffff);
     }
 
-    if (memcmp(to->viewoffset, from->viewoffset, sizeof(to->viewoffset)) != 0) {
-        delta->delta_bits |= Q2P_PSD_VIEWOFFSET;
+    if (delta->delta_bits & Q2P_PSD_VIEWOFFSET) {
         q2proto_var_small_offsets_set_q2repro_viewoffset_comp(&delta->viewoffset, 0, to->viewoffset[0]);
         q2proto_var_small_offsets_set_q2repro_viewoffset_comp(&delta->viewoffset, 1, to->viewoffset[1]);
         q2proto_var_small_offsets_set_q2repro_viewoffset_comp(&delta->viewoffset, 2, to->viewoffset[2]);
     }
 
-    Q2PROTO_SET_ANGLES_DELTA(delta->viewangles, to->viewangles, from->viewangles, short);
+    delta->viewangles.delta_bits = changes.viewangles;
+    if (delta->viewangles.delta_bits != 0) {
+        q2proto_var_angles_set_short_comp(&delta->viewangles.values, 0, to->viewangles[0]);
+        q2proto_var_angles_set_short_comp(&delta->viewangles.values, 1, to->viewangles[1]);
+        q2proto_var_angles_set_short_comp(&delta->viewangles.values, 2, to->viewangles[2]);
+    }
 
-    if (memcmp(to->kick_angles, from->kick_angles, sizeof(to->kick_angles))) {
-        delta->delta_bits |= Q2P_PSD_KICKANGLES;
+    if (delta->delta_bits & Q2P_PSD_KICKANGLES) {
         q2proto_var_small_angles_set_q2repro_kick_angles_comp(&delta->kick_angles, 0, to->kick_angles[0]);
         q2proto_var_small_angles_set_q2repro_kick_angles_comp(&delta->kick_angles, 1, to->kick_angles[1]);
         q2proto_var_small_angles_set_q2repro_kick_angles_comp(&delta->kick_angles, 2, to->kick_angles[2]);
     }
 
+    delta->blend.delta_bits = changes.blend;
+#if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_DAMAGE_BLEND
+    delta->damage_blend.delta_bits = changes.damage_blend;
+#endif
     for (int c = 0; c < 4; c++) {
-        if (to->blend[c] != from->blend[c]) {
+        if (changes.blend & BIT(c))
             q2proto_var_color_set_byte_comp(&delta->blend.values, c, to->blend[c]);
-            delta->blend.delta_bits |= BIT(c);
-        }
 #if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_DAMAGE_BLEND
-        if (to->damage_blend[c] != from->damage_blend[c]) {
+        if (changes.damage_blend & BIT(c))
             q2proto_var_color_set_byte_comp(&delta->damage_blend.values, c, to->damage_blend[c]);
-            delta->damage_blend.delta_bits |= BIT(c);
-        }
 #endif
     }
 
-    if (to->fov != from->fov) {
-        delta->delta_bits |= Q2P_PSD_FOV;
+    if (delta->delta_bits & Q2P_PSD_FOV)
         delta->fov = to->fov;
-    }
-
-    if (to->rdflags != from->rdflags) {
-        delta->delta_bits |= Q2P_PSD_RDFLAGS;
+    if (delta->delta_bits & Q2P_PSD_RDFLAGS)
         delta->rdflags = to->rdflags;
-    }
 
-    if (to->gunframe != from->gunframe)
-        delta->delta_bits |= Q2P_PSD_GUNFRAME;
-    delta->gunoffset.delta_bits = 0;
-    delta->gunangles.delta_bits = 0;
-    for (int c = 0; c < 3; c++) {
-        if (to->gunoffset[c] != from->gunoffset[c])
-            delta->gunoffset.delta_bits |= BIT(c);
-        if (to->gunangles[c] != from->gunangles[c])
-            delta->gunangles.delta_bits |= BIT(c);
-    }
+    delta->gunoffset.delta_bits = changes.gunoffset;
+    delta->gunangles.delta_bits = changes.gunangles;
     if ((delta->delta_bits & Q2P_PSD_GUNFRAME) || (delta->gunoffset.delta_bits != 0)
         || (delta->gunangles.delta_bits != 0))
     {
@@ -1608,12 +1605,6 @@ static void q2repro_server_make_player_state_delta(q2proto_servercontext_t *cont
         q2proto_var_small_angles_set_q2repro_gunangles_comp(&delta->gunangles.values, 2, to->gunangles[2]);
     }
 
-    if (to->gunindex != from->gunindex)
-        delta->delta_bits |= Q2P_PSD_GUNINDEX;
-#if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_GUNSKIN
-    if (to->gunskin != from->gunskin)
-        delta->delta_bits |= Q2P_PSD_GUNSKIN;
-#endif
     if (delta->delta_bits & (Q2P_PSD_GUNINDEX | Q2P_PSD_GUNSKIN)) {
         delta->gunindex = to->gunindex;
 #if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_GUNSKIN
@@ -1621,23 +1612,13 @@ static void q2repro_server_make_player_state_delta(q2proto_servercontext_t *cont
 #endif
     }
 
-    for (int i = 0; i < Q2PROTO_STATS; i++) {
-        if (to->stats[i] != from->stats[i]) {
-            delta->statbits |= BIT_ULL(i);
-            delta->stats[i] = to->stats[i];
-        }
-    }
+    q2proto_packing_set_stats_delta(delta, to, changes.statbits);
 
 #if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_GUNRATE_VIEWHEIGHT
-    if (to->gunrate != from->gunrate) {
-        delta->delta_bits |= Q2P_PSD_GUNRATE;
+    if (delta->delta_bits & Q2P_PSD_GUNRATE)
         delta->gunrate = to->gunrate;
-    }
-
-    if (to->pm_viewheight != from->pm_viewheight) {
-        delta->delta_bits |= Q2P_PSD_PM_VIEWHEIGHT;
+    if (delta->delta_bits & Q2P_PSD_PM_VIEWHEIGHT)
         delta->pm_viewheight = to->pm_viewheight;
-    }
 #endif
 }
 
@@ -1773,9 +1754,7 @@ static q2proto_error_t q2repro_server_write_serverdata(q2proto_servercontext_t *
     return Q2P_ERR_SUCCESS;
 }
 
-static q2proto_error_t q2proto_q2repro_server_write_entity_state_delta(
-    q2proto_servercontext_t *context, uintptr_t io_arg, uint16_t entnum,
-    const q2proto_entity_state_delta_t *entity_state_delta)
+static uint64_t q2repro_server_entity_state_delta_bits(const q2proto_entity_state_delta_t *entity_state_delta)
 {
     uint64_t bits = 0;
 
@@ -1850,7 +1829,77 @@ static q2proto_error_t q2proto_q2repro_server_write_entity_state_delta(
     if (entity_state_delta->delta_bits & Q2P_ESD_SCALE)
         bits |= U_SCALE;
 
-    //----------
+    return bits;
+}
+
+static q2proto_error_t q2repro_server_entity_delta_size(q2proto_servercontext_t *context, uint16_t entnum,
+                                                        const q2proto_entity_state_delta_t *entity_state_delta,
+                                                        size_t *size)
+{
+    uint64_t bits = q2repro_server_entity_state_delta_bits(entity_state_delta);
+
+    size_t total = q2proto_common_server_entity_bits_size(bits, entnum);
+    size_t model_size = (bits & U_MODEL16) ? 2 : 1;
+    if (bits & U_MODEL)
+        total += model_size;
+    if (bits & U_MODEL2)
+        total += model_size;
+    if (bits & U_MODEL3)
+        total += model_size;
+    if (bits & U_MODEL4)
+        total += model_size;
+    if (bits & U_FRAME16)
+        total += 2;
+    else if (bits & U_FRAME8)
+        total += 1;
+    total += q2proto_common_width_flags_size(bits, U_SKIN8, U_SKIN16);
+    total += q2proto_common_width_flags_size(bits, U_EFFECTS8, U_EFFECTS16);
+    total += q2proto_common_width_flags_size(bits, U_RENDERFX8, U_RENDERFX16);
+    if (bits & U_ORIGIN1)
+        total += 4;
+    if (bits & U_ORIGIN2)
+        total += 4;
+    if (bits & U_ORIGIN3)
+        total += 4;
+    size_t angle_size = (bits & U_ANGLE16) ? 2 : 1;
+    if (bits & U_ANGLE1)
+        total += angle_size;
+    if (bits & U_ANGLE2)
+        total += angle_size;
+    if (bits & U_ANGLE3)
+        total += angle_size;
+    if (bits & U_OLDORIGIN)
+        total += 12;
+    if (bits & U_SOUND) {
+        total += 2;
+#if Q2PROTO_ENTITY_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_ENTITY_LOOP_ALPHA_SCALE_FX64
+        if (entity_state_delta->delta_bits & Q2P_ESD_LOOP_VOLUME)
+            total += 1;
+        if (entity_state_delta->delta_bits & Q2P_ESD_LOOP_ATTENUATION)
+            total += 1;
+#endif
+    }
+    if (bits & U_EVENT)
+        total += 1;
+    if (bits & U_SOLID)
+        total += 4;
+#if Q2PROTO_ENTITY_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_ENTITY_LOOP_ALPHA_SCALE_FX64
+    total += q2proto_common_width_flags_size(bits, U_MOREFX8, U_MOREFX16);
+    if (bits & U_ALPHA)
+        total += 1;
+    if (bits & U_SCALE)
+        total += 1;
+#endif
+
+    *size = total;
+    return Q2P_ERR_SUCCESS;
+}
+
+static q2proto_error_t q2proto_q2repro_server_write_entity_state_delta(
+    q2proto_servercontext_t *context, uintptr_t io_arg, uint16_t entnum,
+    const q2proto_entity_state_delta_t *entity_state_delta)
+{
+    uint64_t bits = q2repro_server_entity_state_delta_bits(entity_state_delta);
 
     q2proto_common_server_write_entity_bits(io_arg, bits, entnum);
 
@@ -1994,18 +2043,11 @@ static q2proto_error_t q2repro_server_write_download(q2proto_servercontext_t *co
     WRITE_CHECKED(server_write, io_arg, u8, cmd);
     WRITE_CHECKED(server_write, io_arg, i16, download->size);
     WRITE_CHECKED(server_write, io_arg, u8, download->percent);
-    if (download->size > 0) {
-        void *p;
-        CHECKED_IO(server_write, io_arg, p = q2protoio_write_reserve_raw(io_arg, download->size),
-                   "reserve download data");
-        memcpy(p, download->data, download->size);
-    }
-    return Q2P_ERR_SUCCESS;
+    return q2proto_common_server_write_download_data(io_arg, download);
 }
 
-static q2proto_error_t q2repro_server_write_playerstate(q2proto_servercontext_t *context, uintptr_t io_arg,
-                                                        const q2proto_svc_playerstate_t *playerstate,
-                                                        uint8_t *extraflags)
+static q2proto_error_t q2repro_server_playerstate_flags(const q2proto_svc_playerstate_t *playerstate,
+                                                        uint16_t *playerstate_flags, uint8_t *extraflags)
 {
     uint16_t flags = 0;
     *extraflags = 0;
@@ -2070,6 +2112,87 @@ static q2proto_error_t q2repro_server_write_playerstate(q2proto_servercontext_t
         return Q2P_ERR_BAD_DATA;
 #endif
 
+    *playerstate_flags = flags;
+    return Q2P_ERR_SUCCESS;
+}
+
+static q2proto_error_t q2repro_server_playerstate_size(q2proto_servercontext_t *context,
+                                                       const q2proto_svc_playerstate_t *playerstate, size_t *size)
+{
+    uint16_t flags;
+    uint8_t extraflags;
+    CHECKED(server_write, 0, q2repro_server_playerstate_flags(playerstate, &flags, &extraflags));
+
+    // extraflags are stored in frame header
+    size_t total = 2 /* flags */;
+    if (flags & PS_M_TYPE)
+        total += 1;
+    if (flags & PS_M_ORIGIN)
+        total += 8;
+    if (extraflags & EPS_M_ORIGIN2)
+        total += 4;
+    if (flags & PS_M_VELOCITY)
+        total += 8;
+    if (extraflags & EPS_M_VELOCITY2)
+        total += 4;
+    if (flags & PS_M_TIME)
+        total += 2;
+    if (flags & PS_M_FLAGS)
+        total += 2;
+    if (flags & PS_M_GRAVITY)
+        total += 2;
+    if (flags & PS_M_DELTA_ANGLES)
+        total += 6;
+    if (flags & PS_VIEWOFFSET)
+        total += 6;
+    if (flags & PS_VIEWANGLES)
+        total += 4;
+    if (extraflags & EPS_VIEWANGLE2)
+        total += 2;
+    if (flags & PS_KICKANGLES)
+        total += 6;
+    if (flags & PS_WEAPONINDEX)
+        total += 2;
+    if (flags & PS_WEAPONFRAME)
+        total += 2;
+    if (extraflags & EPS_GUNOFFSET)
+        total += 6;
+    if (extraflags & EPS_GUNANGLES)
+        total += 6;
+    if (flags & PS_BLEND) {
+#if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_DAMAGE_BLEND
+        total += server_q2pro_extv2_blends_size(&playerstate->blend, &playerstate->damage_blend);
+#else
+        const q2proto_color_delta_t null_blend = {0};
+        total += server_q2pro_extv2_blends_size(&playerstate->blend, &null_blend);
+#endif
+    }
+    if (flags & PS_FOV)
+        total += 1;
+    if (flags & PS_RDFLAGS)
+        total += 1;
+    if (extraflags & EPS_STATS)
+        total += 8 + server_stats_values_size(playerstate->statbits);
+#if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_GUNRATE_VIEWHEIGHT
+    if (extraflags & EPS_GUNRATE)
+        total += 1;
+    if (flags & PS_RR_VIEWHEIGHT)
+        total += 1;
+#endif
+    if (extraflags & EPS_CLIENTNUM)
+        total += 2;
+
+    *size = total;
+    return Q2P_ERR_SUCCESS;
+}
+
+static q2proto_error_t q2repro_server_write_playerstate(q2proto_servercontext_t *context, uintptr_t io_arg,
+                                                        const q2proto_svc_playerstate_t *playerstate,
+                                                        uint8_t *extraflags)
+{
+    uint16_t flags;
+    CHECKED(server_write, io_arg, q2repro_server_playerstate_flags(playerstate, &flags, extraflags));
+
     //
     // write it
     //
@@ -2743,8 +2866,6 @@ static q2proto_error_t q2repro_download_begin(q2proto_servercontext_t *context,
     return Q2P_ERR_SUCCESS;
 }
 
-#define SVC_ZDOWNLOAD_SIZE 4
-
 static q2proto_error_t q2repro_download_data(q2proto_server_download_state_t *state, const uint8_t **data,
                                              size_t *remaining, size_t packet_remaining,
                                              q2proto_svc_download_t *svc_download)
@@ -2759,6 +2880,7 @@ static q2proto_error_t q2repro_download_data(q2proto_server_download_state_t *st
         svc_download->data = *data;
         svc_download->size = (int16_t)download_size;
         svc_download->uncompressed_size = -1; // indicates unknown compressed size
+        svc_download->data_reference = true;
 
         *data += download_size;
         *remaining -= download_size;
@@ -2804,6 +2926,7 @@ static q2proto_error_t q2repro_download_data(q2proto_server_download_state_t *st
         svc_download->data = compressed_data;
         svc_download->size = compressed_size;
         svc_download->uncompressed_size = in_consumed;
+        svc_download->data_reference = false;
 
         return q2proto_download_common_complete_struct(state, *remaining, svc_download);
     }
@@ -38,6 +38,8 @@ Q2PROTO_PRIVATE_API const char *q2proto_q2repro_connect_tail(const q2proto_conne
 Q2PROTO_PRIVATE_API q2proto_error_t q2proto_q2repro_continue_serverdata(q2proto_clientcontext_t *context,
                                                                         uintptr_t io_arg,
                                                                         q2proto_svc_serverdata_t *serverdata);
+/// Set client context functions, for restoring a saved client state
+Q2PROTO_PRIVATE_API void q2proto_q2repro_init_client_functions(q2proto_clientcontext_t *context);
 
 // Functions to read messages written by rerelease game DLL
 Q2PROTO_PRIVATE_API q2proto_error_t q2proto_q2repro_client_read_damage(uintptr_t io_arg, q2proto_svc_damage_t *damage);
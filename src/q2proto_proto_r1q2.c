@@ -69,12 +69,17 @@ static uint32_t r1q2_pack_solid(q2proto_clientcontext_t *context, const q2proto_
 static void r1q2_unpack_solid(q2proto_clientcontext_t *context, uint32_t solid, q2proto_vec3_t mins,
                               q2proto_vec3_t maxs);
 
-q2proto_error_t q2proto_r1q2_continue_serverdata(q2proto_clientcontext_t *context, uintptr_t io_arg,
-                                                 q2proto_svc_serverdata_t *serverdata)
+void q2proto_r1q2_init_client_functions(q2proto_clientcontext_t *context)
 {
+    context->client_read = r1q2_client_read;
+    context->client_write = r1q2_client_write;
     context->pack_solid = r1q2_pack_solid;
     context->unpack_solid = r1q2_unpack_solid;
+}
 
+q2proto_error_t q2proto_r1q2_continue_serverdata(q2proto_clientcontext_t *context, uintptr_t io_arg,
+                                                 q2proto_svc_serverdata_t *serverdata)
+{
     READ_CHECKED(client_read, io_arg, serverdata->servercount, i32);
     READ_CHECKED(client_read, io_arg, serverdata->attractloop, bool);
     READ_CHECKED(client_read, io_arg, serverdata->gamedir, string);
@@ -85,8 +90,7 @@ q2proto_error_t q2proto_r1q2_continue_serverdata(q2proto_clientcontext_t *contex
     CHECKED_IO(client_read, io_arg, q2protoio_read_u8(io_arg), "skip advanced deltas");
     READ_CHECKED(client_read, io_arg, serverdata->strafejump_hack, bool);
 
-    context->client_read = r1q2_client_read;
-    context->client_write = r1q2_client_write;
+    q2proto_r1q2_init_client_functions(context);
     context->server_protocol = Q2P_PROTOCOL_R1Q2;
     context->protocol_version = serverdata->protocol_version;
 
@@ -569,6 +573,9 @@ q2proto_error_t r1q2_client_read_zpacket(q2proto_clientcontext_t *context, uintp
     CHECKED(client_read, io_arg, q2protoio_inflate_data(io_arg, inflate_io_arg, compressed_len));
     context->has_inflate_io_arg = true;
     context->inflate_io_arg = inflate_io_arg;
+    #if Q2PROTO_CONTEXT_STATS
+    q2proto_context_stats_zpacket(&context->stats, compressed_len, uncompressed_len);
+    #endif
     return Q2P_ERR_SUCCESS;
 #else
     return Q2P_ERR_DEFLATE_NOT_SUPPORTED;
@@ -789,6 +796,11 @@ static void r1q2_server_make_player_state_delta(q2proto_servercontext_t *context
                                                 const q2proto_packed_player_state_t *from,
                                                 const q2proto_packed_player_state_t *to,
                                                 q2proto_svc_playerstate_t *delta);
+static q2proto_error_t r1q2_server_entity_delta_size(q2proto_servercontext_t *context, uint16_t entnum,
+                                                     const q2proto_entity_state_delta_t *entity_state_delta,
+                                                     size_t *size);
+static q2proto_error_t r1q2_server_playerstate_size(q2proto_servercontext_t *context,
+                                                    const q2proto_svc_playerstate_t *playerstate, size_t *size);
 static q2proto_error_t r1q2_server_write(q2proto_servercontext_t *context, uintptr_t io_arg,
                                          const q2proto_svc_message_t *svc_message);
 static q2proto_error_t r1q2_server_write_gamestate(q2proto_servercontext_t *context,
@@ -804,10 +816,13 @@ static q2proto_error_t r1q2_download_data(q2proto_server_download_state_t *state
                                           size_t *remaining, size_t packet_remaining,
                                           q2proto_svc_download_t *svc_download);
 
+#define SVC_ZDOWNLOAD_SIZE 6
+
 static const struct q2proto_download_funcs_s r1q2_download_funcs = {.begin = r1q2_download_begin,
                                                                     .data = r1q2_download_data,
                                                                     .finish = q2proto_download_common_finish,
-                                                                    .abort = q2proto_download_common_abort};
+                                                                    .abort = q2proto_download_common_abort,
+                                                                    .zdownload_size = SVC_ZDOWNLOAD_SIZE};
 
 q2proto_error_t q2proto_r1q2_init_servercontext(q2proto_servercontext_t *context, const q2proto_connect_t *connect_info)
 {
@@ -822,6 +837,8 @@ q2proto_error_t q2proto_r1q2_init_servercontext(q2proto_servercontext_t *context
     context->fill_serverdata = r1q2_server_fill_serverdata;
     context->make_entity_state_delta = r1q2_server_make_entity_state_delta;
     context->make_player_state_delta = r1q2_server_make_player_state_delta;
+    context->entity_delta_size = r1q2_server_entity_delta_size;
+    context->playerstate_size = r1q2_server_playerstate_size;
     context->server_write = r1q2_server_write;
     context->server_write_gamestate = r1q2_server_write_gamestate;
     context->server_read = r1q2_server_read;
@@ -950,9 +967,8 @@ static q2proto_error_t r1q2_server_write_serverdata(uintptr_t io_arg, const q2pr
     return Q2P_ERR_SUCCESS;
 }
 
-static q2proto_error_t r1q2_server_write_entity_state_delta(q2proto_servercontext_t *context, uintptr_t io_arg,
-                                                            uint16_t entnum,
-                                                            const q2proto_entity_state_delta_t *entity_state_delta)
+static q2proto_error_t r1q2_server_entity_state_delta_bits(const q2proto_entity_state_delta_t *entity_state_delta,
+                                                           uint32_t *entity_bits)
 {
     uint32_t bits = 0;
 
@@ -1016,7 +1032,79 @@ static q2proto_error_t r1q2_server_write_entity_state_delta(q2proto_servercontex
     if (entity_state_delta->delta_bits & (Q2P_ESD_ALPHA | Q2P_ESD_SCALE))
         return Q2P_ERR_BAD_DATA;
 
-    //----------
+    *entity_bits = bits;
+    return Q2P_ERR_SUCCESS;
+}
+
+static q2proto_error_t r1q2_server_entity_delta_size(q2proto_servercontext_t *context, uint16_t entnum,
+                                                     const q2proto_entity_state_delta_t *entity_state_delta,
+                                                     size_t *size)
+{
+    uint32_t bits;
+    CHECKED(server_write, 0, r1q2_server_entity_state_delta_bits(entity_state_delta, &bits));
+
+    size_t total = q2proto_common_server_entity_bits_size(bits, entnum);
+    if (bits & U_MODEL) {
+        if (entity_state_delta->modelindex > 255)
+            return Q2P_ERR_BAD_DATA;
+        total += 1;
+    }
+    if (bits & U_MODEL2) {
+        if (entity_state_delta->modelindex2 > 255)
+            return Q2P_ERR_BAD_DATA;
+        total += 1;
+    }
+    if (bits & U_MODEL3) {
+        if (entity_state_delta->modelindex3 > 255)
+            return Q2P_ERR_BAD_DATA;
+        total += 1;
+    }
+    if (bits & U_MODEL4) {
+        if (entity_state_delta->modelindex4 > 255)
+            return Q2P_ERR_BAD_DATA;
+        total += 1;
+    }
+    if (bits & U_FRAME16)
+        total += 2;
+    else if (bits & U_FRAME8)
+        total += 1;
+    total += q2proto_common_width_flags_size(bits, U_SKIN8, U_SKIN16);
+    total += q2proto_common_width_flags_size(bits, U_EFFECTS8, U_EFFECTS16);
+    total += q2proto_common_width_flags_size(bits, U_RENDERFX8, U_RENDERFX16);
+    if (bits & U_ORIGIN1)
+        total += 2;
+    if (bits & U_ORIGIN2)
+        total += 2;
+    if (bits & U_ORIGIN3)
+        total += 2;
+    if (bits & U_ANGLE1)
+        total += 1;
+    if (bits & U_ANGLE2)
+        total += 1;
+    if (bits & U_ANGLE3)
+        total += 1;
+    if (bits & U_OLDORIGIN)
+        total += 6;
+    if (bits & U_SOUND) {
+        if (entity_state_delta->sound > 255)
+            return Q2P_ERR_BAD_DATA;
+        total += 1;
+    }
+    if (bits & U_EVENT)
+        total += 1;
+    if (bits & U_SOLID)
+        total += context->protocol_version >= PROTOCOL_VERSION_R1Q2_LONG_SOLID ? 4 : 2;
+
+    *size = total;
+    return Q2P_ERR_SUCCESS;
+}
+
+static q2proto_error_t r1q2_server_write_entity_state_delta(q2proto_servercontext_t *context, uintptr_t io_arg,
+                                                            uint16_t entnum,
+                                                            const q2proto_entity_state_delta_t *entity_state_delta)
+{
+    uint32_t bits;
+    CHECKED(server_write, io_arg, r1q2_server_entity_state_delta_bits(entity_state_delta, &bits));
 
     q2proto_common_server_write_entity_bits(io_arg, bits, entnum);
 
@@ -1125,17 +1213,11 @@ static q2proto_error_t r1q2_server_write_download(q2proto_servercontext_t *conte
     WRITE_CHECKED(server_write, io_arg, u8, download->percent);
     if (download->compressed)
         WRITE_CHECKED(server_write, io_arg, i16, download->uncompressed_size);
-    if (download->size > 0) {
-        void *p;
-        CHECKED_IO(server_write, io_arg, p = q2protoio_write_reserve_raw(io_arg, download->size),
-                   "reserve download data");
-        memcpy(p, download->data, download->size);
-    }
-    return Q2P_ERR_SUCCESS;
+    return q2proto_common_server_write_download_data(io_arg, download);
 }
 
-static q2proto_error_t r1q2_server_write_playerstate(uintptr_t io_arg, const q2proto_svc_playerstate_t *playerstate,
-                                                     uint8_t *extraflags)
+static q2proto_error_t r1q2_server_playerstate_flags(const q2proto_svc_playerstate_t *playerstate,
+                                                     uint16_t *playerstate_flags, uint8_t *extraflags)
 {
     uint16_t flags = 0;
     *extraflags = 0;
@@ -1211,6 +1293,75 @@ static q2proto_error_t r1q2_server_write_playerstate(uintptr_t io_arg, const q2p
         return Q2P_ERR_BAD_DATA;
 #endif
 
+    *playerstate_flags = flags;
+    return Q2P_ERR_SUCCESS;
+}
+
+static q2proto_error_t r1q2_server_playerstate_size(q2proto_servercontext_t *context,
+                                                    const q2proto_svc_playerstate_t *playerstate, size_t *size)
+{
+    uint16_t flags;
+    uint8_t extraflags;
+    CHECKED(server_write, 0, r1q2_server_playerstate_flags(playerstate, &flags, &extraflags));
+
+    // extraflags are stored in frame header
+    size_t total = 2 /* flags */;
+    if (flags & PS_M_TYPE)
+        total += 1;
+    if (flags & PS_M_ORIGIN)
+        total += 4;
+    if (extraflags & EPS_M_ORIGIN2)
+        total += 2;
+    if (flags & PS_M_VELOCITY)
+        total += 4;
+    if (extraflags & EPS_M_VELOCITY2)
+        total += 2;
+    if (flags & PS_M_TIME)
+        total += 1;
+    if (flags & PS_M_FLAGS)
+        total += 1;
+    if (flags & PS_M_GRAVITY)
+        total += 2;
+    if (flags & PS_M_DELTA_ANGLES)
+        total += 6;
+    if (flags & PS_VIEWOFFSET)
+        total += 3;
+    if (flags & PS_VIEWANGLES)
+        total += 4;
+    if (extraflags & EPS_VIEWANGLE2)
+        total += 2;
+    if (flags & PS_KICKANGLES)
+        total += 3;
+    if (flags & PS_WEAPONINDEX) {
+        if (playerstate->gunindex > 255)
+            return Q2P_ERR_BAD_DATA;
+        total += 1;
+    }
+    if (flags & PS_WEAPONFRAME)
+        total += 1;
+    if (extraflags & EPS_GUNOFFSET)
+        total += 3;
+    if (extraflags & EPS_GUNANGLES)
+        total += 3;
+    if (flags & PS_BLEND)
+        total += 4;
+    if (flags & PS_FOV)
+        total += 1;
+    if (flags & PS_RDFLAGS)
+        total += 1;
+    if (extraflags & EPS_STATS)
+        total += 4 + server_stats_values_size(playerstate->statbits);
+
+    *size = total;
+    return Q2P_ERR_SUCCESS;
+}
+
+static q2proto_error_t r1q2_server_write_playerstate(uintptr_t io_arg, const q2proto_svc_playerstate_t *playerstate,
+                                                     uint8_t *extraflags)
+{
+    uint16_t flags;
+    CHECKED(server_write, io_arg, r1q2_server_playerstate_flags(playerstate, &flags, extraflags));
+
     //
     // write it
     //
@@ -1555,8 +1706,6 @@ static q2proto_error_t r1q2_download_begin(q2proto_servercontext_t *context, q2p
     return Q2P_ERR_SUCCESS;
 }
 
-#define SVC_ZDOWNLOAD_SIZE 6
-
 static q2proto_error_t r1q2_download_data(q2proto_server_download_state_t *state, const uint8_t **data,
                                           size_t *remaining, size_t packet_remaining,
                                           q2proto_svc_download_t *svc_download)
@@ -1597,6 +1746,7 @@ static q2proto_error_t r1q2_download_data(q2proto_server_download_state_t *state
         svc_download->data = compressed_data;
         svc_download->size = compressed_size;
         svc_download->uncompressed_size = in_consumed;
+        svc_download->data_reference = false;
 
         return q2proto_download_common_complete_struct(state, *remaining, svc_download);
     }
@@ -40,6 +40,8 @@ Q2PROTO_PRIVATE_API const char *q2proto_r1q2_connect_tail(const q2proto_connect_
 /// Client context setup
 Q2PROTO_PRIVATE_API q2proto_error_t q2proto_r1q2_continue_serverdata(q2proto_clientcontext_t *context, uintptr_t io_arg,
                                                                      q2proto_svc_serverdata_t *serverdata);
+/// Set client context functions, for restoring a saved client state
+Q2PROTO_PRIVATE_API void q2proto_r1q2_init_client_functions(q2proto_clientcontext_t *context);
 
 /// Server context setup
 Q2PROTO_PRIVATE_API q2proto_error_t q2proto_r1q2_init_servercontext(q2proto_servercontext_t *context,
@@ -39,20 +39,24 @@ static uint32_t vanilla_pack_solid(q2proto_clientcontext_t *context, const q2pro
 static void vanilla_unpack_solid(q2proto_clientcontext_t *context, uint32_t solid, q2proto_vec3_t mins,
                                  q2proto_vec3_t maxs);
 
-q2proto_error_t q2proto_vanilla_continue_serverdata(q2proto_clientcontext_t *context, uintptr_t io_arg,
-                                                    q2proto_svc_serverdata_t *serverdata)
+void q2proto_vanilla_init_client_functions(q2proto_clientcontext_t *context)
 {
+    context->client_read = vanilla_client_read;
+    context->client_write = vanilla_client_write;
     context->pack_solid = vanilla_pack_solid;
     context->unpack_solid = vanilla_unpack_solid;
+}
 
+q2proto_error_t q2proto_vanilla_continue_serverdata(q2proto_clientcontext_t *context, uintptr_t io_arg,
+                                                    q2proto_svc_serverdata_t *serverdata)
+{
     READ_CHECKED(client_read, io_arg, serverdata->servercount, i32);
     READ_CHECKED(client_read, io_arg, serverdata->attractloop, bool);
     READ_CHECKED(client_read, io_arg, serverdata->gamedir, string);
     READ_CHECKED(client_read, io_arg, serverdata->clientnum, i16);
     READ_CHECKED(client_read, io_arg, serverdata->levelname, string);
 
-    context->client_read = vanilla_client_read;
-    context->client_write = vanilla_client_write;
+    q2proto_vanilla_init_client_functions(context);
     context->server_protocol = serverdata->protocol == PROTOCOL_OLD_DEMO ? Q2P_PROTOCOL_OLD_DEMO : Q2P_PROTOCOL_VANILLA;
 
     context->features.has_upmove = true;
@@ -563,6 +567,11 @@ static void vanilla_server_make_player_state_delta(q2proto_servercontext_t *cont
                                                    const q2proto_packed_player_state_t *from,
                                                    const q2proto_packed_player_state_t *to,
                                                    q2proto_svc_playerstate_t *delta);
+static q2proto_error_t vanilla_server_entity_delta_size(q2proto_servercontext_t *context, uint16_t entnum,
+                                                        const q2proto_entity_state_delta_t *entity_state_delta,
+                                                        size_t *size);
+static q2proto_error_t vanilla_server_playerstate_size(q2proto_servercontext_t *context,
+                                                       const q2proto_svc_playerstate_t *playerstate, size_t *size);
 static q2proto_error_t vanilla_server_write(q2proto_servercontext_t *context, uintptr_t io_arg,
                                             const q2proto_svc_message_t *svc_message);
 static q2proto_error_t vanilla_server_write_gamestate(q2proto_servercontext_t *context,
@@ -585,6 +594,8 @@ q2proto_error_t q2proto_vanilla_init_servercontext(q2proto_servercontext_t *cont
     context->fill_serverdata = vanilla_server_fill_serverdata;
     context->make_entity_state_delta = vanilla_server_make_entity_state_delta;
     context->make_player_state_delta = vanilla_server_make_player_state_delta;
+    context->entity_delta_size = vanilla_server_entity_delta_size;
+    context->playerstate_size = vanilla_server_playerstate_size;
     context->server_write = vanilla_server_write;
     context->server_write_gamestate = vanilla_server_write_gamestate;
     context->server_read = vanilla_server_read;
@@ -707,8 +718,8 @@ static q2proto_error_t vanilla_server_write_serverdata(uintptr_t io_arg, const q
     return Q2P_ERR_SUCCESS;
 }
 
-static q2proto_error_t vanilla_server_write_entity_state_delta(uintptr_t io_arg, uint16_t entnum,
-                                                               const q2proto_entity_state_delta_t *entity_state_delta)
+static q2proto_error_t vanilla_server_entity_state_delta_bits(const q2proto_entity_state_delta_t *entity_state_delta,
+                                                              uint32_t *entity_bits)
 {
     uint32_t bits = 0;
 
@@ -772,7 +783,78 @@ static q2proto_error_t vanilla_server_write_entity_state_delta(uintptr_t io_arg,
     if (entity_state_delta->delta_bits & (Q2P_ESD_ALPHA | Q2P_ESD_SCALE))
         return Q2P_ERR_BAD_DATA;
 
-    //----------
+    *entity_bits = bits;
+    return Q2P_ERR_SUCCESS;
+}
+
+static q2proto_error_t vanilla_server_entity_delta_size(q2proto_servercontext_t *context, uint16_t entnum,
+                                                        const q2proto_entity_state_delta_t *entity_state_delta,
+                                                        size_t *size)
+{
+    uint32_t bits;
+    CHECKED(server_write, 0, vanilla_server_entity_state_delta_bits(entity_state_delta, &bits));
+
+    size_t total = q2proto_common_server_entity_bits_size(bits, entnum);
+    if (bits & U_MODEL) {
+        if (entity_state_delta->modelindex > 255)
+            return Q2P_ERR_BAD_DATA;
+        total += 1;
+    }
+    if (bits & U_MODEL2) {
+        if (entity_state_delta->modelindex2 > 255)
+            return Q2P_ERR_BAD_DATA;
+        total += 1;
+    }
+    if (bits & U_MODEL3) {
+        if (entity_state_delta->modelindex3 > 255)
+            return Q2P_ERR_BAD_DATA;
+        total += 1;
+    }
+    if (bits & U_MODEL4) {
+        if (entity_state_delta->modelindex4 > 255)
+            return Q2P_ERR_BAD_DATA;
+        total += 1;
+    }
+    if (bits & U_FRAME16)
+        total += 2;
+    else if (bits & U_FRAME8)
+        total += 1;
+    total += q2proto_common_width_flags_size(bits, U_SKIN8, U_SKIN16);
+    total += q2proto_common_width_flags_size(bits, U_EFFECTS8, U_EFFECTS16);
+    total += q2proto_common_width_flags_size(bits, U_RENDERFX8, U_RENDERFX16);
+    if (bits & U_ORIGIN1)
+        total += 2;
+    if (bits & U_ORIGIN2)
+        total += 2;
+    if (bits & U_ORIGIN3)
+        total += 2;
+    if (bits & U_ANGLE1)
+        total += 1;
+    if (bits & U_ANGLE2)
+        total += 1;
+    if (bits & U_ANGLE3)
+        total += 1;
+    if (bits & U_OLDORIGIN)
+        total += 6;
+    if (bits & U_SOUND) {
+        if (entity_state_delta->sound > 255)
+            return Q2P_ERR_BAD_DATA;
+        total += 1;
+    }
+    if (bits & U_EVENT)
+        total += 1;
+    if (bits & U_SOLID)
+        total += 2;
+
+    *size = total;
+    return Q2P_ERR_SUCCESS;
+}
+
+static q2proto_error_t vanilla_server_write_entity_state_delta(uintptr_t io_arg, uint16_t entnum,
+                                                               const q2proto_entity_state_delta_t *entity_state_delta)
+{
+    uint32_t bits;
+    CHECKED(server_write, io_arg, vanilla_server_entity_state_delta_bits(entity_state_delta, &bits));
 
     q2proto_common_server_write_entity_bits(io_arg, bits, entnum);
 
@@ -874,16 +956,11 @@ static q2proto_error_t vanilla_server_write_download(uintptr_t io_arg, const q2p
     WRITE_CHECKED(server_write, io_arg, u8, svc_download);
     WRITE_CHECKED(server_write, io_arg, i16, download->size);
     WRITE_CHECKED(server_write, io_arg, u8, download->percent);
-    if (download->size > 0) {
-        void *p;
-        CHECKED_IO(server_write, io_arg, p = q2protoio_write_reserve_raw(io_arg, download->size),
-                   "reserve download data");
-        memcpy(p, download->data, download->size);
-    }
-    return Q2P_ERR_SUCCESS;
+    return q2proto_common_server_write_download_data(io_arg, download);
 }
 
-static q2proto_error_t vanilla_server_write_playerstate(uintptr_t io_arg, const q2proto_svc_playerstate_t *playerstate)
+static q2proto_error_t vanilla_server_playerstate_flags(const q2proto_svc_playerstate_t *playerstate,
+                                                        uint16_t *playerstate_flags)
 {
     uint16_t flags = 0;
 
@@ -948,6 +1025,61 @@ static q2proto_error_t vanilla_server_write_playerstate(uintptr_t io_arg, const
         return Q2P_ERR_BAD_DATA;
 #endif
 
+    *playerstate_flags = flags;
+    return Q2P_ERR_SUCCESS;
+}
+
+static q2proto_error_t vanilla_server_playerstate_size(q2proto_servercontext_t *context,
+                                                       const q2proto_svc_playerstate_t *playerstate, size_t *size)
+{
+    uint16_t flags;
+    CHECKED(server_write, 0, vanilla_server_playerstate_flags(playerstate, &flags));
+
+    size_t total = 1 /* svc_playerinfo */ + 2 /* flags */;
+    if (flags & PS_M_TYPE)
+        total += 1;
+    if (flags & PS_M_ORIGIN)
+        total += 6;
+    if (flags & PS_M_VELOCITY)
+        total += 6;
+    if (flags & PS_M_TIME)
+        total += 1;
+    if (flags & PS_M_FLAGS)
+        total += 1;
+    if (flags & PS_M_GRAVITY)
+        total += 2;
+    if (flags & PS_M_DELTA_ANGLES)
+        total += 6;
+    if (flags & PS_VIEWOFFSET)
+        total += 3;
+    if (flags & PS_VIEWANGLES)
+        total += 6;
+    if (flags & PS_KICKANGLES)
+        total += 3;
+    if (flags & PS_WEAPONINDEX) {
+        if (playerstate->gunindex > 255)
+            return Q2P_ERR_BAD_DATA;
+        total += 1;
+    }
+    if (flags & PS_WEAPONFRAME)
+        total += 7;
+    if (flags & PS_BLEND)
+        total += 4;
+    if (flags & PS_FOV)
+        total += 1;
+    if (flags & PS_RDFLAGS)
+        total += 1;
+    total += 4 + server_stats_values_size(playerstate->statbits);
+
+    *size = total;
+    return Q2P_ERR_SUCCESS;
+}
+
+static q2proto_error_t vanilla_server_write_playerstate(uintptr_t io_arg, const q2proto_svc_playerstate_t *playerstate)
+{
+    uint16_t flags;
+    CHECKED(server_write, io_arg, vanilla_server_playerstate_flags(playerstate, &flags));
+
     //
     // write it
     //
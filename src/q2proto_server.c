@@ -86,15 +86,22 @@ q2proto_error_t q2proto_get_challenge_extras(char *buf, size_t buf_size, const q
     }
 
     /* Sort protocol versions, lowest to highest.
-     * (Not sure it's actually required, but it's the traditional way) */
-    int *protocol_vers = (int *)alloca(num_accepted_protocols * sizeof(int));
+     * (Not sure it's actually required, but it's the traditional way)
+     * Duplicates are skipped, so there are at most Q2P_NUM_PROTOCOLS versions. */
+    int protocol_vers[Q2P_NUM_PROTOCOLS];
+    size_t num_protocol_vers = 0;
     for (size_t i = 0; i < num_accepted_protocols; i++) {
-        protocol_vers[i] = q2proto_get_protocol_netver(accepted_protocols[i]);
+        int netver = q2proto_get_protocol_netver(accepted_protocols[i]);
+        bool duplicate = false;
+        for (size_t j = 0; j < num_protocol_vers; j++)
+            duplicate |= protocol_vers[j] == netver;
+        if (!duplicate && num_protocol_vers < Q2P_NUM_PROTOCOLS)
+            protocol_vers[num_protocol_vers++] = netver;
     }
-    qsort(protocol_vers, num_accepted_protocols, sizeof(int), compare_ints);
+    qsort(protocol_vers, num_protocol_vers, sizeof(int), compare_ints);
 
     q2proto_snprintf_update(&buf, &buf_size, "p=%d", protocol_vers[0]);
-    for (size_t i = 1; i < num_accepted_protocols; i++) {
+    for (size_t i = 1; i < num_protocol_vers; i++) {
         q2proto_snprintf_update(&buf, &buf_size, ",%d", protocol_vers[i]);
     }
     return Q2P_ERR_SUCCESS;
@@ -191,7 +198,8 @@ q2proto_error_t q2proto_parse_connect(const char *connect_args, const q2proto_pr
 q2proto_error_t q2proto_init_servercontext(q2proto_servercontext_t *context, const q2proto_server_info_t *server_info,
                                            const q2proto_connect_t *connect_info)
 {
-    memset(context, 0, sizeof(*context));
+    // KEX-only members at the end are cleared by the KEX code, if needed
+    memset(context, 0, offsetof(q2proto_servercontext_t, kex_demo_baseline_nonzero_solid));
     context->server_info = server_info;
     context->protocol = connect_info->protocol;
 
@@ -259,7 +267,7 @@ q2proto_error_t q2proto_init_servercontext_demo(q2proto_servercontext_t *context
 
     size_t demo_packet_size = server_info->default_packet_length ? server_info->default_packet_length
                                                                  : 1390; // Default to Vanilla Q2 limit if none is given
-    demo_packet_size = MAX(server_info->default_packet_length, MIN_DEMO_PACKET); // ensure a minimal packet size
+    demo_packet_size = MAX(demo_packet_size, MIN_DEMO_PACKET); // ensure a minimal packet size
     connect_info.protocol = protocol;
     connect_info.packet_length = demo_packet_size;
     switch (protocol)
@@ -303,6 +311,18 @@ void q2proto_server_make_player_state_delta(q2proto_servercontext_t *context, co
     context->make_player_state_delta(context, from, to, delta);
 }
 
+q2proto_error_t q2proto_server_entity_delta_size(q2proto_servercontext_t *context, uint16_t entnum,
+                                                 const q2proto_entity_state_delta_t *delta, size_t *size)
+{
+    return context->entity_delta_size(context, entnum, delta, size);
+}
+
+q2proto_error_t q2proto_server_playerstate_size(q2proto_servercontext_t *context,
+                                                const q2proto_svc_playerstate_t *playerstate, size_t *size)
+{
+    return context->playerstate_size(context, playerstate, size);
+}
+
 q2proto_error_t q2proto_server_write_pos(q2proto_multicast_protocol_t multicast_proto, uintptr_t io_arg,
                                          const q2proto_vec3_t pos)
 {
@@ -329,20 +349,66 @@ q2proto_error_t q2proto_server_write_pos(q2proto_multicast_protocol_t multicast_
     return Q2P_ERR_PROTOCOL_NOT_SUPPORTED;
 }
 
+#if Q2PROTO_CONTEXT_STATS || Q2PROTO_TRACE
+// Count a server message written in the context statistics and emit a trace record for it
+static void server_record_svc_message(q2proto_servercontext_t *context, q2proto_error_t err, size_t start, size_t end,
+                                      const q2proto_svc_message_t *svc_message)
+{
+    #if Q2PROTO_CONTEXT_STATS
+    q2proto_context_stats_svc_message(&context->stats, err, start, end, svc_message);
+    #endif
+    #if Q2PROTO_TRACE
+    q2proto_trace_ring_t *ring = q2proto_trace_get_thread_ring();
+    if (ring && err == Q2P_ERR_SUCCESS)
+        q2proto_trace_svc_message(ring, Q2P_TRACE_SVC_WRITE, context->trace_id, start, end, svc_message);
+    #endif
+}
+
+// Count a client message read in the context statistics and emit a trace record for it
+static void server_record_clc_message(q2proto_servercontext_t *context, q2proto_error_t err, size_t start, size_t end,
+                                      const q2proto_clc_message_t *clc_message)
+{
+    #if Q2PROTO_CONTEXT_STATS
+    q2proto_context_stats_clc_message(&context->stats, err, start, end, clc_message);
+    #endif
+    #if Q2PROTO_TRACE
+    q2proto_trace_ring_t *ring = q2proto_trace_get_thread_ring();
+    if (ring && err == Q2P_ERR_SUCCESS)
+        q2proto_trace_clc_message(ring, Q2P_TRACE_CLC_READ, context->trace_id, start, end, clc_message);
+    #endif
+}
+#endif
+
 q2proto_error_t q2proto_server_write(q2proto_servercontext_t *context, uintptr_t io_arg,
                                      const q2proto_svc_message_t *svc_message)
 {
+#if Q2PROTO_CONTEXT_STATS || Q2PROTO_TRACE
+    size_t start = q2protoio_trace_position(io_arg);
+    q2proto_error_t err = context->server_write(context, io_arg, svc_message);
+    server_record_svc_message(context, err, start, q2protoio_trace_position(io_arg), svc_message);
+    return err;
+#else
     return context->server_write(context, io_arg, svc_message);
+#endif
 }
 
 q2proto_error_t q2proto_server_write_gamestate(q2proto_servercontext_t *context, q2protoio_deflate_args_t *deflate_args,
                                                uintptr_t io_arg, const q2proto_gamestate_t *gamestate)
 {
+#if Q2PROTO_CONTEXT_STATS
+    size_t start = q2protoio_trace_position(io_arg);
+    q2proto_error_t err = context->server_write_gamestate(context, deflate_args, io_arg, gamestate);
+    size_t end = q2protoio_trace_position(io_arg);
+    context->stats.gamestate_bytes += end > start ? end - start : 0;
+    q2proto_context_stats_failure(&context->stats, err);
+    return err;
+#else
     return context->server_write_gamestate(context, deflate_args, io_arg, gamestate);
+#endif
 }
 
-q2proto_error_t q2proto_server_write_zpacket(q2proto_servercontext_t *context, q2protoio_deflate_args_t *deflate_args,
-                                             uintptr_t io_arg, const void *packet_data, size_t packet_len)
+static q2proto_error_t server_write_zpacket(q2proto_servercontext_t *context, q2protoio_deflate_args_t *deflate_args,
+                                            uintptr_t io_arg, const void *packet_data, size_t packet_len)
 {
 #if Q2PROTO_COMPRESSION_DEFLATE
     if (!context->features.enable_deflate)
@@ -380,6 +446,9 @@ q2proto_error_t q2proto_server_write_zpacket(q2proto_servercontext_t *context, q
 
     CHECKED(server_write, io_arg, q2protoio_deflate_end(deflate_io_arg));
 
+    #if Q2PROTO_CONTEXT_STATS
+    q2proto_context_stats_zpacket(&context->stats, compressed_len, packet_len);
+    #endif
     return Q2P_ERR_SUCCESS;
 
 #else
@@ -387,6 +456,16 @@ q2proto_error_t q2proto_server_write_zpacket(q2proto_servercontext_t *context, q
 #endif
 }
 
+q2proto_error_t q2proto_server_write_zpacket(q2proto_servercontext_t *context, q2protoio_deflate_args_t *deflate_args,
+                                             uintptr_t io_arg, const void *packet_data, size_t packet_len)
+{
+    q2proto_error_t err = server_write_zpacket(context, deflate_args, io_arg, packet_data, packet_len);
+#if Q2PROTO_CONTEXT_STATS
+    q2proto_context_stats_failure(&context->stats, err);
+#endif
+    return err;
+}
+
 q2proto_error_t q2proto_server_download_begin(q2proto_servercontext_t *context, size_t total_size,
                                               q2proto_download_compress_t compress,
                                               q2protoio_deflate_args_t *deflate_args,
@@ -445,5 +524,12 @@ void q2proto_server_download_get_progress(const q2proto_server_download_state_t
 q2proto_error_t q2proto_server_read(q2proto_servercontext_t *context, uintptr_t io_arg,
                                     q2proto_clc_message_t *clc_message)
 {
+#if Q2PROTO_CONTEXT_STATS || Q2PROTO_TRACE
+    size_t start = q2protoio_trace_position(io_arg);
+    q2proto_error_t err = context->server_read(context, io_arg, clc_message);
+    server_record_clc_message(context, err, start, q2protoio_trace_position(io_arg), clc_message);
+    return err;
+#else
     return context->server_read(context, io_arg, clc_message);
+#endif
 }
@@ -0,0 +1,66 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#define Q2PROTO_BUILD
+#include "q2proto_internal.h"
+
+#include "q2proto/q2proto_server_pool.h"
+
+void q2proto_servercontext_pool_init(q2proto_servercontext_pool_t *pool, q2proto_servercontext_t *contexts,
+                                     uint32_t *free_indices, size_t num_contexts)
+{
+    pool->contexts = contexts;
+    pool->num_contexts = num_contexts;
+    pool->free_indices = free_indices;
+    pool->num_free = num_contexts;
+    // Hand out contexts in ascending order
+    for (size_t i = 0; i < num_contexts; i++)
+        free_indices[i] = (uint32_t)(num_contexts - 1 - i);
+}
+
+q2proto_error_t q2proto_servercontext_pool_acquire(q2proto_servercontext_pool_t *pool,
+                                                   const q2proto_server_info_t *server_info,
+                                                   const q2proto_connect_t *connect_info,
+                                                   q2proto_servercontext_t **context)
+{
+    *context = NULL;
+    if (pool->num_free == 0)
+        return Q2P_ERR_BUFFER_TOO_SMALL;
+
+    q2proto_servercontext_t *new_context = &pool->contexts[pool->free_indices[pool->num_free - 1]];
+    q2proto_error_t err = q2proto_init_servercontext(new_context, server_info, connect_info);
+    if (err != Q2P_ERR_SUCCESS)
+        return err;
+
+    pool->num_free--;
+    *context = new_context;
+    return Q2P_ERR_SUCCESS;
+}
+
+q2proto_error_t q2proto_servercontext_pool_release(q2proto_servercontext_pool_t *pool,
+                                                   q2proto_servercontext_t *context)
+{
+    if (context < pool->contexts || context >= pool->contexts + pool->num_contexts
+        || pool->num_free >= pool->num_contexts)
+        return Q2P_ERR_INVALID_ARGUMENT;
+
+    pool->free_indices[pool->num_free++] = (uint32_t)(context - pool->contexts);
+    return Q2P_ERR_SUCCESS;
+}
+
+size_t q2proto_servercontext_pool_num_free(const q2proto_servercontext_pool_t *pool) { return pool->num_free; }
@@ -0,0 +1,238 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#define Q2PROTO_BUILD
+#include "q2proto_internal.h"
+
+#include "q2proto/q2proto_snapshot.h"
+
+static const q2proto_packed_entity_state_t *get_baseline(const q2proto_packed_baselines_t *baselines,
+                                                         uint16_t entnum)
+{
+    if (!baselines || !baselines->states || entnum >= baselines->num_states)
+        return NULL;
+    return &baselines->states[entnum];
+}
+
+static q2proto_error_t entity_delta_size(q2proto_servercontext_t *context, uint16_t entnum,
+                                         const q2proto_packed_entity_state_t *from,
+                                         const q2proto_packed_entity_state_t *to, bool write_old_origin,
+                                         size_t *size)
+{
+    q2proto_entity_state_delta_t delta;
+    q2proto_server_make_entity_state_delta(context, from, to, write_old_origin, &delta);
+    CHECKED(server_write, 0, q2proto_server_entity_delta_size(context, entnum, &delta, size));
+    // A delta consisting of just the entity bits & number means "no change", which isn't written
+    if (*size <= q2proto_common_server_entity_bits_size(0, entnum))
+        *size = 0;
+    return Q2P_ERR_SUCCESS;
+}
+
+// Get index of first visible entity in snapshot, starting at index
+static size_t snapshot_next_entity(const q2proto_packed_snapshot_t *snapshot, size_t index)
+{
+    if (!snapshot)
+        return 0;
+    while (index < snapshot->num_entities && snapshot->visible
+           && !q2proto_get_entity_bit(snapshot->visible, snapshot->entnums[index]))
+        index++;
+    return index;
+}
+
+/* Estimate frame size, but stop once size_limit is exceeded.
+ * (*size is only guaranteed to be > size_limit in that case.) */
+static q2proto_error_t estimate_frame_size(q2proto_servercontext_t *context, const q2proto_packed_snapshot_t *from,
+                                           const q2proto_packed_snapshot_t *to,
+                                           const q2proto_packed_baselines_t *baselines, size_t size_limit,
+                                           size_t *size)
+{
+    q2proto_svc_playerstate_t playerstate;
+    q2proto_server_make_player_state_delta(context, from ? from->player_state : NULL, to->player_state,
+                                           &playerstate);
+    size_t total;
+    CHECKED(server_write, 0, q2proto_server_playerstate_size(context, &playerstate, &total));
+
+    size_t from_num = from ? from->num_entities : 0;
+    size_t from_idx = snapshot_next_entity(from, 0), to_idx = snapshot_next_entity(to, 0);
+    while ((from_idx < from_num || to_idx < to->num_entities) && total <= size_limit) {
+        uint16_t from_entnum = from_idx < from_num ? from->entnums[from_idx] : UINT16_MAX;
+        uint16_t to_entnum = to_idx < to->num_entities ? to->entnums[to_idx] : UINT16_MAX;
+        size_t entity_size;
+        if (to_idx >= to->num_entities || (from_idx < from_num && from_entnum < to_entnum)) {
+            // Entity left frame
+            entity_size = q2proto_common_server_entity_bits_size(U_REMOVE, from_entnum);
+            from_idx = snapshot_next_entity(from, from_idx + 1);
+        } else if (from_idx >= from_num || to_entnum < from_entnum) {
+            // Entity entered frame
+            CHECKED(server_write, 0,
+                    entity_delta_size(context, to_entnum, get_baseline(baselines, to_entnum),
+                                      &to->entities[to_idx], true, &entity_size));
+            to_idx = snapshot_next_entity(to, to_idx + 1);
+        } else {
+            CHECKED(server_write, 0,
+                    entity_delta_size(context, to_entnum, &from->entities[from_idx], &to->entities[to_idx], false,
+                                      &entity_size));
+            from_idx = snapshot_next_entity(from, from_idx + 1);
+            to_idx = snapshot_next_entity(to, to_idx + 1);
+        }
+        total += entity_size;
+    }
+
+    *size = total;
+    return Q2P_ERR_SUCCESS;
+}
+
+q2proto_error_t q2proto_server_estimate_frame_size(q2proto_servercontext_t *context,
+                                                   const q2proto_packed_snapshot_t *from,
+                                                   const q2proto_packed_snapshot_t *to,
+                                                   const q2proto_packed_baselines_t *baselines, size_t *size)
+{
+    return estimate_frame_size(context, from, to, baselines, SIZE_MAX, size);
+}
+
+q2proto_error_t q2proto_server_select_delta_frame(q2proto_servercontext_t *context,
+                                                  const q2proto_packed_snapshot_t *current,
+                                                  const q2proto_packed_snapshot_t *const *candidates,
+                                                  size_t num_candidates, const q2proto_packed_baselines_t *baselines,
+                                                  size_t *best_index, size_t *best_size)
+{
+    if (num_candidates == 0)
+        return Q2P_ERR_INVALID_ARGUMENT;
+
+    size_t best = 0;
+    size_t best_estimate = SIZE_MAX;
+    for (size_t i = 0; i < num_candidates; i++) {
+        size_t estimate;
+        // Candidates can't win once they exceed the best estimate so far
+        CHECKED(server_write, 0,
+                estimate_frame_size(context, candidates[i], current, baselines, best_estimate, &estimate));
+        if (estimate < best_estimate) {
+            best = i;
+            best_estimate = estimate;
+        }
+    }
+
+    *best_index = best;
+    if (best_size)
+        *best_size = best_estimate;
+    return Q2P_ERR_SUCCESS;
+}
+
+void q2proto_snapshot_ring_init(q2proto_snapshot_ring_t *ring, size_t num_frames,
+                                q2proto_snapshot_world_frame_t *world_frames, uint16_t *entnum_storage,
+                                q2proto_packed_entity_state_t *entity_storage, size_t max_entities,
+                                q2proto_snapshot_client_frame_t *client_frames, size_t num_clients)
+{
+    memset(ring, 0, sizeof(*ring));
+    ring->num_frames = num_frames;
+    ring->max_entities = max_entities;
+    ring->num_clients = num_clients;
+    ring->world_frames = world_frames;
+    ring->client_frames = client_frames;
+    ring->current_frame = -1;
+
+    for (size_t i = 0; i < num_frames; i++) {
+        world_frames[i].serverframe = -1;
+        world_frames[i].num_entities = 0;
+        world_frames[i].entnums = entnum_storage + i * max_entities;
+        world_frames[i].entities = entity_storage + i * max_entities;
+    }
+    for (size_t i = 0; i < num_frames * num_clients; i++)
+        client_frames[i].serverframe = -1;
+}
+
+static q2proto_snapshot_client_frame_t *get_client_frame(const q2proto_snapshot_ring_t *ring, size_t client,
+                                                         int32_t serverframe)
+{
+    return &ring->client_frames[((size_t)serverframe % ring->num_frames) * ring->num_clients + client];
+}
+
+q2proto_error_t q2proto_snapshot_ring_begin_frame(q2proto_snapshot_ring_t *ring, int32_t serverframe)
+{
+    if (ring->num_frames == 0 || serverframe < 0 || serverframe <= ring->current_frame)
+        return Q2P_ERR_INVALID_ARGUMENT;
+
+    q2proto_snapshot_world_frame_t *world_frame = &ring->world_frames[(size_t)serverframe % ring->num_frames];
+    world_frame->serverframe = serverframe;
+    world_frame->num_entities = 0;
+    ring->current_frame = serverframe;
+    return Q2P_ERR_SUCCESS;
+}
+
+q2proto_error_t q2proto_snapshot_ring_add_entity(q2proto_snapshot_ring_t *ring, uint16_t entnum,
+                                                 const q2proto_packed_entity_state_t *state)
+{
+    if (ring->current_frame < 0)
+        return Q2P_ERR_INVALID_ARGUMENT;
+
+    q2proto_snapshot_world_frame_t *world_frame = &ring->world_frames[(size_t)ring->current_frame % ring->num_frames];
+    if (world_frame->num_entities > 0 && entnum <= world_frame->entnums[world_frame->num_entities - 1])
+        return Q2P_ERR_INVALID_ARGUMENT;
+    if (world_frame->num_entities >= ring->max_entities)
+        return Q2P_ERR_BUFFER_TOO_SMALL;
+
+    world_frame->entnums[world_frame->num_entities] = entnum;
+    memcpy(&world_frame->entities[world_frame->num_entities], state, sizeof(*state));
+    world_frame->num_entities++;
+    return Q2P_ERR_SUCCESS;
+}
+
+q2proto_error_t q2proto_snapshot_ring_set_client(q2proto_snapshot_ring_t *ring, size_t client,
+                                                 const q2proto_packed_player_state_t *player_state)
+{
+    if (ring->current_frame < 0 || client >= ring->num_clients)
+        return Q2P_ERR_INVALID_ARGUMENT;
+
+    q2proto_snapshot_client_frame_t *client_frame = get_client_frame(ring, client, ring->current_frame);
+    client_frame->serverframe = ring->current_frame;
+    memcpy(&client_frame->player_state, player_state, sizeof(*player_state));
+    memset(client_frame->visible, 0, sizeof(client_frame->visible));
+    return Q2P_ERR_SUCCESS;
+}
+
+q2proto_error_t q2proto_snapshot_ring_set_visible(q2proto_snapshot_ring_t *ring, size_t client, uint16_t entnum)
+{
+    if (ring->current_frame < 0 || client >= ring->num_clients || entnum >= Q2PROTO_MAX_ENTITIES)
+        return Q2P_ERR_INVALID_ARGUMENT;
+
+    q2proto_snapshot_client_frame_t *client_frame = get_client_frame(ring, client, ring->current_frame);
+    if (client_frame->serverframe != ring->current_frame)
+        return Q2P_ERR_INVALID_ARGUMENT;
+    q2proto_set_entity_bit(client_frame->visible, entnum, true);
+    return Q2P_ERR_SUCCESS;
+}
+
+bool q2proto_snapshot_ring_get_client_snapshot(const q2proto_snapshot_ring_t *ring, size_t client,
+                                               int32_t serverframe, q2proto_packed_snapshot_t *snapshot)
+{
+    if (ring->num_frames == 0 || serverframe < 0 || client >= ring->num_clients)
+        return false;
+
+    const q2proto_snapshot_world_frame_t *world_frame = &ring->world_frames[(size_t)serverframe % ring->num_frames];
+    const q2proto_snapshot_client_frame_t *client_frame = get_client_frame(ring, client, serverframe);
+    if (world_frame->serverframe != serverframe || client_frame->serverframe != serverframe)
+        return false;
+
+    snapshot->serverframe = serverframe;
+    snapshot->player_state = &client_frame->player_state;
+    snapshot->num_entities = world_frame->num_entities;
+    snapshot->entnums = world_frame->entnums;
+    snapshot->entities = world_frame->entities;
+    snapshot->visible = client_frame->visible;
+    return true;
+}
@@ -0,0 +1,128 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#define Q2PROTO_BUILD
+#include "q2proto_internal.h"
+
+#include "q2proto/q2proto_trace.h"
+
+#include <string.h>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+    #include <intrin.h>
+
+// Interlocked operations are full barriers, on all architectures
+static inline uint32_t load_acquire(uint32_t *p) { return (uint32_t)_InterlockedOr((volatile long *)p, 0); }
+static inline void store_release(uint32_t *p, uint32_t value) { _InterlockedExchange((volatile long *)p, (long)value); }
+static inline uint32_t load_relaxed(const uint32_t *p) { return *(const volatile uint32_t *)p; }
+#else
+static inline uint32_t load_acquire(uint32_t *p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+static inline void store_release(uint32_t *p, uint32_t value) { __atomic_store_n(p, value, __ATOMIC_RELEASE); }
+static inline uint32_t load_relaxed(const uint32_t *p) { return __atomic_load_n(p, __ATOMIC_RELAXED); }
+#endif
+
+static _Thread_local q2proto_trace_ring_t *thread_ring;
+
+q2proto_error_t q2proto_trace_ring_init(q2proto_trace_ring_t *ring, q2proto_trace_record_t *records,
+                                        size_t num_records)
+{
+    if (num_records == 0 || (num_records & (num_records - 1)) != 0 || num_records > 0x80000000u)
+        return Q2P_ERR_INVALID_ARGUMENT;
+
+    memset(ring, 0, sizeof(*ring));
+    ring->records = records;
+    ring->mask = (uint32_t)(num_records - 1);
+    return Q2P_ERR_SUCCESS;
+}
+
+bool q2proto_trace_ring_push(q2proto_trace_ring_t *ring, const q2proto_trace_record_t *record)
+{
+    uint32_t head = ring->head;
+    if (head - ring->cached_tail > ring->mask) {
+        ring->cached_tail = load_acquire(&ring->tail);
+        if (head - ring->cached_tail > ring->mask) {
+            store_release(&ring->dropped, ring->dropped + 1);
+            return false;
+        }
+    }
+    ring->records[head & ring->mask] = *record;
+    store_release(&ring->head, head + 1);
+    return true;
+}
+
+size_t q2proto_trace_ring_drain(q2proto_trace_ring_t *ring, q2proto_trace_record_t *records, size_t max_records)
+{
+    uint32_t tail = ring->tail;
+    uint32_t available = load_acquire(&ring->head) - tail;
+    size_t count = available < max_records ? available : max_records;
+    for (size_t i = 0; i < count; i++)
+        records[i] = ring->records[(tail + (uint32_t)i) & ring->mask];
+    store_release(&ring->tail, tail + (uint32_t)count);
+    return count;
+}
+
+uint32_t q2proto_trace_ring_dropped(const q2proto_trace_ring_t *ring) { return load_relaxed(&ring->dropped); }
+
+void q2proto_trace_set_thread_ring(q2proto_trace_ring_t *ring) { thread_ring = ring; }
+
+q2proto_trace_ring_t *q2proto_trace_get_thread_ring(void) { return thread_ring; }
+
+#if Q2PROTO_TRACE
+static void init_record(q2proto_trace_record_t *record, q2proto_trace_event_t event, uint32_t context_id, size_t start,
+                        size_t end, int type)
+{
+    record->bits = 0;
+    record->context_id = context_id;
+    record->offset = (uint32_t)start;
+    record->length = end > start ? (uint32_t)(end - start) : 0;
+    record->entnum = 0;
+    record->event = (uint8_t)event;
+    record->type = (uint8_t)type;
+}
+
+void q2proto_trace_svc_message(q2proto_trace_ring_t *ring, q2proto_trace_event_t event, uint32_t context_id,
+                               size_t start, size_t end, const q2proto_svc_message_t *svc_message)
+{
+    q2proto_trace_record_t record;
+    init_record(&record, event, context_id, start, end, svc_message->type);
+    switch (svc_message->type) {
+    case Q2P_SVC_FRAME:
+        record.bits = svc_message->frame.playerstate.delta_bits;
+        break;
+    case Q2P_SVC_FRAME_ENTITY_DELTA:
+        record.entnum = svc_message->frame_entity_delta.newnum;
+        record.bits = svc_message->frame_entity_delta.entity_delta.delta_bits;
+        break;
+    case Q2P_SVC_SPAWNBASELINE:
+        record.entnum = svc_message->spawnbaseline.entnum;
+        record.bits = svc_message->spawnbaseline.delta_state.delta_bits;
+        break;
+    default:
+        break;
+    }
+    q2proto_trace_ring_push(ring, &record);
+}
+
+void q2proto_trace_clc_message(q2proto_trace_ring_t *ring, q2proto_trace_event_t event, uint32_t context_id,
+                               size_t start, size_t end, const q2proto_clc_message_t *clc_message)
+{
+    q2proto_trace_record_t record;
+    init_record(&record, event, context_id, start, end, clc_message->type);
+    q2proto_trace_ring_push(ring, &record);
+}
+#endif
@@ -19,9 +19,14 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // Use this for single source q2proto builds
 
 #include "q2proto_client.c"
+#include "q2proto_context_stats.c"
 #include "q2proto_coords.c"
 #include "q2proto_crc.c"
+#include "q2proto_delta_cache.c"
+#include "q2proto_download_cache.c"
+#include "q2proto_download_scheduler.c"
 #include "q2proto_error.c"
+#include "q2proto_frame_writer.c"
 #include "q2proto_internal_common.c"
 #include "q2proto_internal_debug.c"
 #include "q2proto_internal_download.c"
@@ -37,6 +42,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "q2proto_proto_vanilla.c"
 #include "q2proto_protocol.c"
 #include "q2proto_server.c"
+#include "q2proto_server_pool.c"
+#include "q2proto_snapshot.c"
 #include "q2proto_solid.c"
 #include "q2proto_sound.c"
 #include "q2proto_string.c"
+#include "q2proto_trace.c"
@@ -27,8 +27,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 typedef q2proto_vec3_t vec3_t;
 
-#define Q2P_PACK_ENTITY_FUNCTION_NAME PackEntity
-#define Q2P_PACK_ENTITY_TYPE          q2repro_entity_state_t *
+#define Q2P_PACK_ENTITY_FUNCTION_NAME            PackEntity
+#define Q2P_PACK_ENTITY_TYPE                     q2repro_entity_state_t *
+#define Q2P_PACK_ENTITY_IF_CHANGED_FUNCTION_NAME PackEntityIfChanged
 
 #include "q2proto/q2proto_packing_entitystate_impl.inc"
 
@@ -50,6 +51,8 @@ int main(int argc, char **argv)
     q2repro_entity_state_t ent = {0};
     q2proto_packed_entity_state_t packed_ent;
     PackEntity(&server_context, &ent, &packed_ent);
+    q2proto_entity_pack_cache_t ent_cache = {0};
+    PackEntityIfChanged(&server_context, &ent, &ent_cache, &packed_ent);
 
     q2repro_player_state_t player = {0};
     q2proto_packed_player_state_t packed_player;
@@ -0,0 +1,368 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "q2proto/q2proto.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Statistics test: checks the counters of a server context after writing frames and zpackets.
+ * Needs to be built with Q2PROTO_CONTEXT_STATS and Q2PROTO_COMPRESSION_DEFLATE.
+ */
+
+#define MAX_OUTPUT   0x10000
+#define NUM_ENTITIES 16
+
+#if Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_RERELEASE
+    #define TEST_GAME_API Q2PROTO_GAME_RERELEASE
+#elif Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_Q2PRO_EXTENDED_V2
+    #define TEST_GAME_API Q2PROTO_GAME_Q2PRO_EXTENDED_V2
+#elif Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_Q2PRO_EXTENDED
+    #define TEST_GAME_API Q2PROTO_GAME_Q2PRO_EXTENDED
+#else
+    #define TEST_GAME_API Q2PROTO_GAME_VANILLA
+#endif
+
+typedef struct test_io_s {
+    uint8_t data[MAX_OUTPUT];
+    size_t size;
+    size_t limit;
+    q2proto_error_t err;
+} test_io_t;
+
+static void *test_io_reserve(uintptr_t io_arg, size_t size)
+{
+    test_io_t *io = (test_io_t *)io_arg;
+    if (size > io->limit - io->size) {
+        io->err = Q2P_ERR_NOT_ENOUGH_PACKET_SPACE;
+        return NULL;
+    }
+    void *p = io->data + io->size;
+    io->size += size;
+    return p;
+}
+
+void q2protoio_write_u8(uintptr_t io_arg, uint8_t x)
+{
+    uint8_t *p = test_io_reserve(io_arg, 1);
+    if (p)
+        p[0] = x;
+}
+
+void q2protoio_write_u16(uintptr_t io_arg, uint16_t x)
+{
+    uint8_t *p = test_io_reserve(io_arg, 2);
+    if (p) {
+        p[0] = x & 0xff;
+        p[1] = x >> 8;
+    }
+}
+
+void q2protoio_write_u32(uintptr_t io_arg, uint32_t x)
+{
+    q2protoio_write_u16(io_arg, x & 0xffff);
+    q2protoio_write_u16(io_arg, x >> 16);
+}
+
+void q2protoio_write_u64(uintptr_t io_arg, uint64_t x)
+{
+    q2protoio_write_u32(io_arg, x & 0xffffffff);
+    q2protoio_write_u32(io_arg, x >> 32);
+}
+
+void *q2protoio_write_reserve_raw(uintptr_t io_arg, size_t size) { return test_io_reserve(io_arg, size); }
+
+void q2protoio_write_raw(uintptr_t io_arg, const void *data, size_t size, size_t *written)
+{
+    test_io_t *io = (test_io_t *)io_arg;
+    size_t n = size;
+    if (written && n > io->limit - io->size)
+        n = io->limit - io->size;
+    void *p = test_io_reserve(io_arg, n);
+    if (p)
+        memcpy(p, data, n);
+    if (written)
+        *written = p ? n : 0;
+}
+
+size_t q2protoio_write_available(uintptr_t io_arg)
+{
+    test_io_t *io = (test_io_t *)io_arg;
+    return io->limit - io->size;
+}
+
+q2proto_error_t q2protoio_get_error(uintptr_t io_arg)
+{
+    test_io_t *io = (test_io_t *)io_arg;
+    q2proto_error_t err = io->err;
+    io->err = Q2P_ERR_SUCCESS;
+    return err;
+}
+
+size_t q2protoio_trace_position(uintptr_t io_arg)
+{
+    test_io_t *io = (test_io_t *)io_arg;
+    return io->size;
+}
+
+// Pass-through "deflate": deflated data is the input, unchanged
+struct q2protoio_deflate_args_s {
+    test_io_t io;
+};
+
+q2proto_error_t q2protoio_deflate_begin(q2protoio_deflate_args_t *deflate_args, size_t max_deflated,
+                                        q2proto_inflate_deflate_header_mode_t header_mode, uintptr_t *deflate_io_arg)
+{
+    deflate_args->io.size = 0;
+    deflate_args->io.limit = max_deflated < MAX_OUTPUT ? max_deflated : MAX_OUTPUT;
+    *deflate_io_arg = (uintptr_t)&deflate_args->io;
+    return Q2P_ERR_SUCCESS;
+}
+
+q2proto_error_t q2protoio_deflate_get_data(uintptr_t deflate_io_arg, q2proto_deflate_stream_mode_t stream_mode,
+                                           size_t *in_size, const void **out, size_t *out_size)
+{
+    test_io_t *io = (test_io_t *)deflate_io_arg;
+    if (in_size)
+        *in_size = io->size;
+    *out = io->data;
+    *out_size = io->size;
+    io->size = 0;
+    return Q2P_ERR_SUCCESS;
+}
+
+q2proto_error_t q2protoio_deflate_end(uintptr_t deflate_io_arg) { return Q2P_ERR_SUCCESS; }
+
+static int failures = 0;
+
+#define CHECK(COND, ...)          \
+    do {                          \
+        if (!(COND)) {            \
+            printf(__VA_ARGS__);  \
+            printf("\n");         \
+            failures++;           \
+        }                         \
+    } while (0)
+
+static void test_error_index(void)
+{
+    for (size_t i = 0; i < Q2PROTO_CONTEXT_STATS_ERROR_OTHER; i++) {
+        q2proto_error_t err = q2proto_context_stats_error_code(i);
+        CHECK(err != Q2P_ERR_SUCCESS && err != Q2P_ERR_NO_MORE_INPUT, "errors: counter %zu has bad code %d", i,
+              err);
+        CHECK(q2proto_context_stats_error_index(err) == i, "errors: code %d maps to counter %zu, expected %zu", err,
+              q2proto_context_stats_error_index(err), i);
+    }
+    CHECK(q2proto_context_stats_error_index((q2proto_error_t)-12345) == Q2PROTO_CONTEXT_STATS_ERROR_OTHER,
+          "errors: unknown code has own counter");
+    CHECK(q2proto_context_stats_error_code(Q2PROTO_CONTEXT_STATS_ERROR_OTHER) == Q2P_ERR_SUCCESS, "errors: 'other' counter has code");
+}
+
+// Write a frame updating entities 1..num_entities and removing entity num_entities + 1
+static q2proto_error_t write_frame(q2proto_servercontext_t *context, test_io_t *io,
+                                   const q2proto_packed_entity_state_t *entities, int num_entities)
+{
+    q2proto_packed_player_state_t player = {0};
+    player.pm_gravity = 800;
+    player.fov = 90;
+
+    q2proto_svc_message_t message = {.type = Q2P_SVC_FRAME, .frame = {0}};
+    message.frame.serverframe = 1;
+    message.frame.deltaframe = -1;
+    q2proto_server_make_player_state_delta(context, NULL, &player, &message.frame.playerstate);
+    q2proto_error_t err = q2proto_server_write(context, (uintptr_t)io, &message);
+    if (err != Q2P_ERR_SUCCESS)
+        return err;
+
+    for (uint16_t entnum = 1; entnum <= num_entities; entnum++) {
+        q2proto_svc_message_t entity_message = {.type = Q2P_SVC_FRAME_ENTITY_DELTA, .frame_entity_delta = {0}};
+        entity_message.frame_entity_delta.newnum = entnum;
+        q2proto_server_make_entity_state_delta(context, NULL, &entities[entnum], true,
+                                               &entity_message.frame_entity_delta.entity_delta);
+        err = q2proto_server_write(context, (uintptr_t)io, &entity_message);
+        if (err != Q2P_ERR_SUCCESS)
+            return err;
+    }
+
+    q2proto_svc_message_t remove_message = {.type = Q2P_SVC_FRAME_ENTITY_DELTA, .frame_entity_delta = {0}};
+    remove_message.frame_entity_delta.newnum = num_entities + 1;
+    remove_message.frame_entity_delta.remove = true;
+    err = q2proto_server_write(context, (uintptr_t)io, &remove_message);
+    if (err != Q2P_ERR_SUCCESS)
+        return err;
+
+    q2proto_svc_message_t terminator = {.type = Q2P_SVC_FRAME_ENTITY_DELTA, .frame_entity_delta = {0}};
+    return q2proto_server_write(context, (uintptr_t)io, &terminator);
+}
+
+static void test_frame_stats(void)
+{
+    static test_io_t io;
+    q2proto_server_info_t server_info = {.game_api = TEST_GAME_API, .default_packet_length = MAX_OUTPUT};
+    q2proto_servercontext_t context;
+    size_t max_msg_len;
+    q2proto_error_t err = q2proto_init_servercontext_demo(&context, Q2P_PROTOCOL_INVALID, &server_info, &max_msg_len);
+    if (err != Q2P_ERR_SUCCESS) {
+        printf("frame: context init failed: %s\n", q2proto_error_string(err));
+        failures++;
+        return;
+    }
+
+    q2proto_context_stats_t stats;
+    CHECK(q2proto_server_get_stats(&context, &stats) == Q2P_ERR_SUCCESS, "frame: getting stats failed");
+    CHECK(stats.svc[Q2P_SVC_FRAME].count == 0 && stats.entity_deltas == 0, "frame: stats not cleared on setup");
+
+    q2proto_packed_entity_state_t entities[NUM_ENTITIES];
+    memset(entities, 0, sizeof(entities));
+    for (int e = 1; e < NUM_ENTITIES; e++) {
+        entities[e].modelindex = e;
+        entities[e].origin[0] = e * 64;
+    }
+
+    // Two frames, to check counters accumulate
+    io.size = 0;
+    io.limit = MAX_OUTPUT;
+    for (int i = 0; i < 2; i++) {
+        err = write_frame(&context, &io, entities, NUM_ENTITIES - 2);
+        CHECK(err == Q2P_ERR_SUCCESS, "frame: write failed: %s", q2proto_error_string(err));
+    }
+
+    q2proto_server_get_stats(&context, &stats);
+    CHECK(stats.svc[Q2P_SVC_FRAME].count == 2, "frame: %u frames counted, expected 2",
+          (unsigned)stats.svc[Q2P_SVC_FRAME].count);
+    CHECK(stats.svc[Q2P_SVC_FRAME_ENTITY_DELTA].count == 2 * NUM_ENTITIES,
+          "frame: %u entity messages counted, expected %d", (unsigned)stats.svc[Q2P_SVC_FRAME_ENTITY_DELTA].count,
+          2 * NUM_ENTITIES);
+    CHECK(stats.entity_deltas == 2 * (NUM_ENTITIES - 2), "frame: %u entity deltas counted, expected %d",
+          (unsigned)stats.entity_deltas, 2 * (NUM_ENTITIES - 2));
+    CHECK(stats.entity_removals == 2, "frame: %u entity removals counted, expected 2",
+          (unsigned)stats.entity_removals);
+    uint64_t total_bytes = 0;
+    for (int t = 0; t < Q2PROTO_CONTEXT_STATS_NUM_SVC_TYPES; t++)
+        total_bytes += stats.svc[t].bytes;
+    CHECK(total_bytes == io.size, "frame: %u bytes counted, %zu written", (unsigned)total_bytes, io.size);
+    for (int e = 0; e < Q2PROTO_CONTEXT_STATS_NUM_ERRORS; e++)
+        CHECK(stats.errors[e] == 0, "frame: unexpected error count for %d", q2proto_context_stats_error_code(e));
+
+    // Overflow the packet: error is counted, message is not
+    io.size = 0;
+    io.limit = 8;
+    err = write_frame(&context, &io, entities, NUM_ENTITIES - 2);
+    CHECK(err == Q2P_ERR_NOT_ENOUGH_PACKET_SPACE, "overflow: unexpected result: %s", q2proto_error_string(err));
+
+    q2proto_context_stats_t overflow_stats;
+    q2proto_server_get_stats(&context, &overflow_stats);
+    CHECK(overflow_stats.errors[q2proto_context_stats_error_index(Q2P_ERR_NOT_ENOUGH_PACKET_SPACE)] == 1,
+          "overflow: error not counted");
+    CHECK(overflow_stats.svc[Q2P_SVC_FRAME].count == stats.svc[Q2P_SVC_FRAME].count
+              && overflow_stats.svc[Q2P_SVC_FRAME].bytes == stats.svc[Q2P_SVC_FRAME].bytes,
+          "overflow: failed message counted");
+
+    // Other contexts are unaffected
+    q2proto_servercontext_t other_context;
+    q2proto_init_servercontext_demo(&other_context, Q2P_PROTOCOL_INVALID, &server_info, &max_msg_len);
+    q2proto_server_get_stats(&other_context, &stats);
+    CHECK(stats.svc[Q2P_SVC_FRAME].count == 0, "frame: stats shared between contexts");
+}
+
+// Set up a server context for the first protocol supporting zpackets
+static bool init_zpacket_context(q2proto_servercontext_t *context, const q2proto_server_info_t *server_info)
+{
+    q2proto_protocol_t protocols[Q2P_NUM_PROTOCOLS];
+    size_t num_protocols = q2proto_get_protocols_for_gametypes(protocols, Q2P_NUM_PROTOCOLS, &server_info->game_api, 1);
+    for (size_t i = 0; i < num_protocols; i++) {
+        q2proto_connect_t connect;
+        memset(&connect, 0, sizeof(connect));
+        connect.protocol = protocols[i];
+        connect.userinfo = q2proto_make_string("\\name\\stats");
+        connect.packet_length = MAX_OUTPUT;
+        connect.has_zlib = true;
+        if (q2proto_complete_connect(&connect) != Q2P_ERR_SUCCESS
+            || q2proto_init_servercontext(context, server_info, &connect) != Q2P_ERR_SUCCESS)
+            continue;
+        if (context->features.enable_deflate)
+            return true;
+    }
+    return false;
+}
+
+static void test_zpacket_stats(void)
+{
+    static test_io_t packet, io;
+    static struct q2protoio_deflate_args_s deflate_args;
+    q2proto_server_info_t server_info = {.game_api = TEST_GAME_API, .default_packet_length = MAX_OUTPUT};
+    q2proto_servercontext_t context;
+    if (!init_zpacket_context(&context, &server_info)) {
+        printf("zpacket: no protocol supporting zpackets\n");
+        failures++;
+        return;
+    }
+
+    q2proto_svc_message_t print = {.type = Q2P_SVC_PRINT};
+    print.print.level = 2;
+    print.print.string = q2proto_make_string("compress me, compress me, compress me\n");
+    packet.size = 0;
+    packet.limit = MAX_OUTPUT;
+    for (int i = 0; i < 4; i++)
+        q2proto_server_write(&context, (uintptr_t)&packet, &print);
+
+    io.size = 0;
+    io.limit = MAX_OUTPUT;
+    q2proto_error_t err =
+        q2proto_server_write_zpacket(&context, &deflate_args, (uintptr_t)&io, packet.data, packet.size);
+    CHECK(err == Q2P_ERR_SUCCESS, "zpacket: write failed: %s", q2proto_error_string(err));
+
+    // Compressing a zpacket again is refused, but not counted as an error
+    size_t zpacket_size = io.size;
+    err = q2proto_server_write_zpacket(&context, &deflate_args, (uintptr_t)&io, io.data, zpacket_size);
+    CHECK(err == Q2P_ERR_ALREADY_COMPRESSED, "zpacket: recompression: unexpected result: %s",
+          q2proto_error_string(err));
+
+    q2proto_context_stats_t stats;
+    q2proto_server_get_stats(&context, &stats);
+    CHECK(stats.svc[Q2P_SVC_PRINT].count == 4 && stats.svc[Q2P_SVC_PRINT].bytes == packet.size,
+          "zpacket: %u prints with %u bytes counted, expected 4 with %zu bytes",
+          (unsigned)stats.svc[Q2P_SVC_PRINT].count, (unsigned)stats.svc[Q2P_SVC_PRINT].bytes, packet.size);
+    CHECK(stats.zpackets == 1, "zpacket: %u zpackets counted, expected 1", (unsigned)stats.zpackets);
+    CHECK(stats.zpacket_compressed_bytes == zpacket_size, "zpacket: %u compressed bytes counted, %zu written",
+          (unsigned)stats.zpacket_compressed_bytes, zpacket_size);
+    CHECK(stats.zpacket_uncompressed_bytes == packet.size, "zpacket: %u uncompressed bytes counted, expected %zu",
+          (unsigned)stats.zpacket_uncompressed_bytes, packet.size);
+    for (int e = 0; e < Q2PROTO_CONTEXT_STATS_NUM_ERRORS; e++)
+        CHECK(stats.errors[e] == 0, "zpacket: unexpected error count for %d", q2proto_context_stats_error_code(e));
+
+    // Not enough packet space: neither zpacket nor error is counted, as that is a positive error code
+    io.size = 0;
+    io.limit = 4;
+    err = q2proto_server_write_zpacket(&context, &deflate_args, (uintptr_t)&io, packet.data, packet.size);
+    CHECK(err == Q2P_ERR_NOT_ENOUGH_PACKET_SPACE, "zpacket: overflow: unexpected result: %s",
+          q2proto_error_string(err));
+    q2proto_server_get_stats(&context, &stats);
+    CHECK(stats.zpackets == 1, "zpacket: overflow: failed zpacket counted");
+    CHECK(stats.errors[q2proto_context_stats_error_index(Q2P_ERR_NOT_ENOUGH_PACKET_SPACE)] == 0,
+          "zpacket: overflow: error counted");
+}
+
+int main(int argc, char **argv)
+{
+    test_error_index();
+    test_frame_stats();
+    test_zpacket_stats();
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,326 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "q2proto/q2proto.h"
+
+#include "../roundtrip/roundtrip_io.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Entity delta cache test: writes entity deltas for a number of clients, using every protocol usable with the
+ * game API, through one shared cache. The output of each client must be identical to writing the deltas without
+ * the cache, and the cache statistics must show that deltas were encoded once per protocol and frame.
+ * Also checks that cached deltas are only used for the same protocol and "old origin" flag, that resetting the cache
+ * discards deltas, that a cache too small to hold all deltas still produces
+ * correct output, and that stateful KEX demo contexts bypass the cache.
+ */
+
+#if Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_RERELEASE
+    #define TEST_GAME_API Q2PROTO_GAME_RERELEASE
+#elif Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_Q2PRO_EXTENDED_V2
+    #define TEST_GAME_API Q2PROTO_GAME_Q2PRO_EXTENDED_V2
+#elif Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_Q2PRO_EXTENDED
+    #define TEST_GAME_API Q2PROTO_GAME_Q2PRO_EXTENDED
+#else
+    #define TEST_GAME_API Q2PROTO_GAME_VANILLA
+#endif
+
+#define NUM_FRAMES           16
+#define NUM_ENTITIES         64
+#define CLIENTS_PER_PROTOCOL 3
+#define MAX_OUTPUT           0x10000
+#define CACHE_ENTRIES        1024
+#define CACHE_STORAGE        0x10000
+
+static int failures;
+
+#define CHECK(COND, ...)         \
+    do {                         \
+        if (!(COND)) {           \
+            printf(__VA_ARGS__); \
+            printf("\n");        \
+            failures++;          \
+        }                        \
+    } while (0)
+
+static uint64_t rng_state = 0x2545f4914f6cdd1dULL;
+
+static uint32_t rng_next(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t)(rng_state >> 16);
+}
+
+static int32_t random_range(int32_t min, int32_t max) { return min + (int32_t)(rng_next() % (uint32_t)(max - min + 1)); }
+
+static bool random_chance(unsigned one_in) { return rng_next() % one_in == 0; }
+
+static q2proto_server_info_t server_info;
+static q2proto_packed_entity_state_t world_entities[NUM_FRAMES][NUM_ENTITIES];
+
+static q2proto_delta_cache_entry_t cache_entries[CACHE_ENTRIES];
+static uint8_t cache_storage[CACHE_STORAGE];
+
+static void make_world(void)
+{
+    memset(world_entities, 0, sizeof(world_entities));
+    for (int e = 0; e < NUM_ENTITIES; e++) {
+        q2proto_packed_entity_state_t *ent = &world_entities[0][e];
+        ent->modelindex = random_range(1, 255);
+        ent->skinnum = random_range(0, 15);
+        ent->effects = random_range(0, 0xffff);
+        ent->solid = random_range(0, 0xffff);
+        for (int i = 0; i < 3; i++)
+            ent->origin[i] = random_range(-32768, 32767);
+    }
+    for (int f = 1; f < NUM_FRAMES; f++) {
+        for (int e = 0; e < NUM_ENTITIES; e++) {
+            q2proto_packed_entity_state_t *ent = &world_entities[f][e];
+            *ent = world_entities[f - 1][e];
+            memcpy(ent->old_origin, ent->origin, sizeof(ent->origin));
+            for (int i = 0; i < 3; i++) {
+                if (random_chance(2))
+                    ent->origin[i] = random_range(-32768, 32767);
+                if (random_chance(8))
+                    ent->angles[i] = random_range(0, 65535);
+            }
+            ent->frame = (ent->frame + 1) % 200;
+            ent->event = random_chance(16) ? random_range(1, 8) : 0;
+        }
+    }
+}
+
+static q2proto_error_t write_entity_delta(q2proto_servercontext_t *context, uintptr_t io_arg, uint16_t entnum,
+                                          const q2proto_packed_entity_state_t *from,
+                                          const q2proto_packed_entity_state_t *to, bool write_old_origin)
+{
+    q2proto_svc_message_t message = {.type = Q2P_SVC_FRAME_ENTITY_DELTA, .frame_entity_delta = {0}};
+    message.frame_entity_delta.newnum = entnum;
+    q2proto_server_make_entity_state_delta(context, from, to, write_old_origin,
+                                           &message.frame_entity_delta.entity_delta);
+    return q2proto_server_write(context, io_arg, &message);
+}
+
+/* Write all entity deltas of a frame, with and without the cache, and compare the output.
+ * Entity 0 is never sent; every 4th entity is delta'd from the baseline, with the old origin. */
+static void write_frame(const char *name, q2proto_delta_cache_t *cache, q2proto_servercontext_t *context, int frame,
+                        roundtrip_buffer_t *cached_buf, roundtrip_buffer_t *uncached_buf)
+{
+    roundtrip_buffer_clear(cached_buf);
+    roundtrip_buffer_clear(uncached_buf);
+    for (uint16_t entnum = 1; entnum < NUM_ENTITIES; entnum++) {
+        bool from_baseline = frame == 0 || entnum % 4 == 0;
+        const q2proto_packed_entity_state_t *from = from_baseline ? NULL : &world_entities[frame - 1][entnum];
+        const q2proto_packed_entity_state_t *to = &world_entities[frame][entnum];
+        q2proto_error_t err = q2proto_server_write_entity_delta_cached(cache, context, roundtrip_io_arg(cached_buf),
+                                                                       entnum, from, to, from_baseline);
+        if (err == Q2P_ERR_SUCCESS)
+            err = write_entity_delta(context, roundtrip_io_arg(uncached_buf), entnum, from, to, from_baseline);
+        if (err != Q2P_ERR_SUCCESS) {
+            CHECK(false, "%s: frame %d, entity %u: write failed: %s", name, frame, entnum, q2proto_error_string(err));
+            return;
+        }
+    }
+    CHECK(cached_buf->size == uncached_buf->size && memcmp(cached_buf->data, uncached_buf->data, cached_buf->size) == 0,
+          "%s: frame %d: cached output differs (%zu bytes, expected %zu)", name, frame, cached_buf->size,
+          uncached_buf->size);
+}
+
+static bool init_context(q2proto_servercontext_t *context, q2proto_protocol_t protocol)
+{
+    size_t max_msg_len;
+    q2proto_error_t err = q2proto_init_servercontext_demo(context, protocol, &server_info, &max_msg_len);
+    CHECK(err == Q2P_ERR_SUCCESS, "protocol %d: context init failed: %s", protocol, q2proto_error_string(err));
+    return err == Q2P_ERR_SUCCESS;
+}
+
+// All protocols share a cache; each protocol must encode a delta once per frame, other clients get cache hits
+static void test_shared_cache(const q2proto_protocol_t *protocols, size_t num_protocols, roundtrip_buffer_t *cached_buf,
+                              roundtrip_buffer_t *uncached_buf)
+{
+    static q2proto_servercontext_t contexts[Q2P_NUM_PROTOCOLS][CLIENTS_PER_PROTOCOL];
+    for (size_t p = 0; p < num_protocols; p++) {
+        for (int c = 0; c < CLIENTS_PER_PROTOCOL; c++) {
+            if (!init_context(&contexts[p][c], protocols[p]))
+                return;
+        }
+    }
+
+    q2proto_delta_cache_t cache;
+    q2proto_delta_cache_init(&cache, cache_entries, CACHE_ENTRIES, cache_storage, CACHE_STORAGE);
+    for (int frame = 0; frame < NUM_FRAMES; frame++) {
+        q2proto_delta_cache_reset(&cache);
+        q2proto_delta_cache_clear_stats(&cache);
+        uint64_t encoded_bytes = 0;
+        for (int c = 0; c < CLIENTS_PER_PROTOCOL; c++) {
+            for (size_t p = 0; p < num_protocols; p++) {
+                char name[32];
+                snprintf(name, sizeof(name), "protocol %d, client %d", protocols[p], c);
+                write_frame(name, &cache, &contexts[p][c], frame, cached_buf, uncached_buf);
+                if (c > 0)
+                    encoded_bytes += cached_buf->size;
+            }
+        }
+
+        uint32_t num_deltas = (NUM_ENTITIES - 1) * (uint32_t)num_protocols;
+        CHECK(cache.stats.misses == num_deltas && cache.stats.hits == num_deltas * (CLIENTS_PER_PROTOCOL - 1),
+              "frame %d: %u misses, %u hits, expected %u and %u", frame, cache.stats.misses, cache.stats.hits,
+              num_deltas, num_deltas * (CLIENTS_PER_PROTOCOL - 1));
+        CHECK(cache.stats.store_failures == 0 && cache.stats.bypassed == 0, "frame %d: %u store failures, %u bypassed",
+              frame, cache.stats.store_failures, cache.stats.bypassed);
+        CHECK(cache.stats.bytes_saved == encoded_bytes, "frame %d: %llu bytes saved, expected %llu", frame,
+              (unsigned long long)cache.stats.bytes_saved, (unsigned long long)encoded_bytes);
+    }
+
+    // Statistics accumulate until cleared, resetting discards deltas
+    q2proto_delta_cache_reset(&cache);
+    write_frame("after reset", &cache, &contexts[0][0], NUM_FRAMES - 1, cached_buf, uncached_buf);
+    CHECK(cache.stats.hits == (NUM_ENTITIES - 1) * (uint32_t)num_protocols * (CLIENTS_PER_PROTOCOL - 1),
+          "after reset: %u hits", cache.stats.hits);
+    CHECK(cache.stats.misses == (NUM_ENTITIES - 1) * (uint32_t)(num_protocols + 1), "after reset: %u misses",
+          cache.stats.misses);
+}
+
+/* With a single slot, all lookups hit the same slot, so a cached delta must only be used if protocol and
+ * "old origin" flag match */
+static void test_cache_key(const q2proto_protocol_t *protocols, size_t num_protocols, roundtrip_buffer_t *cached_buf,
+                           roundtrip_buffer_t *uncached_buf)
+{
+    static q2proto_servercontext_t contexts[Q2P_NUM_PROTOCOLS];
+    for (size_t p = 0; p < num_protocols; p++) {
+        if (!init_context(&contexts[p], protocols[p]))
+            return;
+    }
+
+    q2proto_delta_cache_t cache;
+    q2proto_delta_cache_init(&cache, cache_entries, 1, cache_storage, CACHE_STORAGE);
+    const q2proto_packed_entity_state_t *from = &world_entities[0][1];
+    const q2proto_packed_entity_state_t *to = &world_entities[1][1];
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t p = 0; p < num_protocols; p++) {
+            for (int write_old_origin = 0; write_old_origin < 2; write_old_origin++) {
+                roundtrip_buffer_clear(cached_buf);
+                roundtrip_buffer_clear(uncached_buf);
+                q2proto_error_t err = q2proto_server_write_entity_delta_cached(
+                    &cache, &contexts[p], roundtrip_io_arg(cached_buf), 1, from, to, write_old_origin);
+                if (err == Q2P_ERR_SUCCESS)
+                    err = write_entity_delta(&contexts[p], roundtrip_io_arg(uncached_buf), 1, from, to,
+                                             write_old_origin);
+                CHECK(err == Q2P_ERR_SUCCESS, "key: protocol %d: write failed: %s", protocols[p],
+                      q2proto_error_string(err));
+                CHECK(cached_buf->size == uncached_buf->size
+                          && memcmp(cached_buf->data, uncached_buf->data, cached_buf->size) == 0,
+                      "key: protocol %d, old origin %d: cached output differs", protocols[p], write_old_origin);
+            }
+        }
+    }
+    // Only the first delta is stored, and only found again in the second pass
+    CHECK(cache.stats.hits == 1 && cache.stats.misses == 4 * num_protocols - 1,
+          "key: %u hits, %u misses, expected 1 and %zu", cache.stats.hits, cache.stats.misses, 4 * num_protocols - 1);
+}
+
+// A cache that can't store all deltas must still produce correct output
+static void test_small_cache(q2proto_protocol_t protocol, size_t num_entries, size_t storage_size,
+                             roundtrip_buffer_t *cached_buf, roundtrip_buffer_t *uncached_buf)
+{
+    q2proto_servercontext_t context;
+    if (!init_context(&context, protocol))
+        return;
+
+    char name[64];
+    snprintf(name, sizeof(name), "protocol %d, %zu entries, %zu bytes", protocol, num_entries, storage_size);
+    q2proto_delta_cache_t cache;
+    q2proto_delta_cache_init(&cache, cache_entries, num_entries, cache_storage, storage_size);
+    for (int frame = 0; frame < NUM_FRAMES; frame++) {
+        q2proto_delta_cache_reset(&cache);
+        for (int c = 0; c < 2; c++)
+            write_frame(name, &cache, &context, frame, cached_buf, uncached_buf);
+    }
+    CHECK(cache.stats.store_failures > 0, "%s: no store failures", name);
+    CHECK(cache.stats.hits + cache.stats.misses == 2 * NUM_FRAMES * (NUM_ENTITIES - 1), "%s: %u hits, %u misses", name,
+          cache.stats.hits, cache.stats.misses);
+}
+
+#if Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_RERELEASE
+// KEX demo deltas depend on per-context state, so they must not be cached
+static void test_kex_demo_bypass(roundtrip_buffer_t *cached_buf, roundtrip_buffer_t *uncached_buf)
+{
+    q2proto_connect_t connect;
+    memset(&connect, 0, sizeof(connect));
+    connect.protocol = Q2P_PROTOCOL_KEX_DEMOS;
+    connect.packet_length = MAX_OUTPUT;
+    q2proto_servercontext_t context;
+    q2proto_error_t err = q2proto_init_servercontext(&context, &server_info, &connect);
+    if (err != Q2P_ERR_SUCCESS) {
+        CHECK(false, "KEX demo: context init failed: %s", q2proto_error_string(err));
+        return;
+    }
+
+    q2proto_delta_cache_t cache;
+    q2proto_delta_cache_init(&cache, cache_entries, CACHE_ENTRIES, cache_storage, CACHE_STORAGE);
+    for (uint16_t entnum = 1; entnum < NUM_ENTITIES && err == Q2P_ERR_SUCCESS; entnum++) {
+        err = q2proto_server_write_entity_delta_cached(&cache, &context, roundtrip_io_arg(cached_buf), entnum, NULL,
+                                                       &world_entities[0][entnum], true);
+    }
+    CHECK(err == Q2P_ERR_SUCCESS, "KEX demo: write failed: %s", q2proto_error_string(err));
+    CHECK(cache.stats.bypassed == NUM_ENTITIES - 1 && cache.stats.hits == 0 && cache.stats.misses == 0,
+          "KEX demo: %u bypassed, %u hits, %u misses", cache.stats.bypassed, cache.stats.hits, cache.stats.misses);
+}
+#endif
+
+int main(void)
+{
+    server_info.game_api = TEST_GAME_API;
+    server_info.default_packet_length = MAX_OUTPUT;
+
+    q2proto_protocol_t protocols[Q2P_NUM_PROTOCOLS];
+    size_t num_protocols = q2proto_get_protocols_for_gametypes(protocols, Q2P_NUM_PROTOCOLS, &server_info.game_api, 1);
+    if (num_protocols == 0) {
+        printf("no protocols for game API\n");
+        return 1;
+    }
+
+    make_world();
+
+    roundtrip_buffer_t cached_buf, uncached_buf;
+    if (!roundtrip_buffer_init(&cached_buf, MAX_OUTPUT) || !roundtrip_buffer_init(&uncached_buf, MAX_OUTPUT)) {
+        printf("out of memory\n");
+        return 1;
+    }
+
+    test_shared_cache(protocols, num_protocols, &cached_buf, &uncached_buf);
+    test_cache_key(protocols, num_protocols, &cached_buf, &uncached_buf);
+    for (size_t p = 0; p < num_protocols; p++) {
+        // Out of slots
+        test_small_cache(protocols[p], 16, CACHE_STORAGE, &cached_buf, &uncached_buf);
+        // Out of storage
+        test_small_cache(protocols[p], CACHE_ENTRIES, 256, &cached_buf, &uncached_buf);
+    }
+#if Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_RERELEASE
+    roundtrip_buffer_clear(&cached_buf);
+    test_kex_demo_bypass(&cached_buf, &uncached_buf);
+#endif
+
+    roundtrip_buffer_free(&cached_buf);
+    roundtrip_buffer_free(&uncached_buf);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,294 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "q2proto/q2proto.h"
+
+#include "../roundtrip/roundtrip_io.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Delta size test: for every protocol usable with the game API, make deltas between random entity and player
+ * states and compare the sizes reported by q2proto_server_entity_delta_size() and
+ * q2proto_server_playerstate_size() with the number of bytes actually written.
+ * Entity deltas are written as Q2P_SVC_FRAME_ENTITY_DELTA messages, which must have exactly the reported size.
+ * Player state deltas are written as part of a Q2P_SVC_FRAME message, so the frame size minus the reported player
+ * state size must be the same for all player state deltas.
+ *
+ * Field values are picked from different magnitudes, as protocols choose encodings based on the value range.
+ * Some values are out of range for some protocols; for those deltas, the size queries must return the same error
+ * as writing.
+ */
+
+#if Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_RERELEASE
+    #define TEST_GAME_API Q2PROTO_GAME_RERELEASE
+#elif Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_Q2PRO_EXTENDED_V2
+    #define TEST_GAME_API Q2PROTO_GAME_Q2PRO_EXTENDED_V2
+#elif Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_Q2PRO_EXTENDED
+    #define TEST_GAME_API Q2PROTO_GAME_Q2PRO_EXTENDED
+#else
+    #define TEST_GAME_API Q2PROTO_GAME_VANILLA
+#endif
+
+#define NUM_DELTAS 2000
+#define MAX_OUTPUT 0x8000
+
+static int failures;
+
+#define CHECK(COND, ...)         \
+    do {                         \
+        if (!(COND)) {           \
+            printf(__VA_ARGS__); \
+            printf("\n");        \
+            failures++;          \
+        }                        \
+    } while (0)
+
+static uint64_t rng_state = 0x2545f4914f6cdd1dULL;
+
+static uint32_t rng_next(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t)(rng_state >> 16);
+}
+
+static int32_t random_range(int32_t min, int32_t max) { return min + (int32_t)(rng_next() % (uint32_t)(max - min + 1)); }
+
+static bool random_chance(unsigned one_in) { return rng_next() % one_in == 0; }
+
+// Random value, with a magnitude fitting 8, 16 or 32 bits
+static uint32_t random_bits(void)
+{
+    switch (rng_next() % 3) {
+    case 0:
+        return rng_next() & 0xff;
+    case 1:
+        return rng_next() & 0xffff;
+    default:
+        return rng_next() ^ (rng_next() << 16);
+    }
+}
+
+// Randomly change some fields of an entity
+static void change_entity(q2proto_packed_entity_state_t *ent)
+{
+    if (random_chance(4))
+        ent->modelindex = random_bits() & 0xff;
+    if (random_chance(8))
+        ent->modelindex2 = random_bits() & 0xff;
+    if (random_chance(8))
+        ent->modelindex3 = random_bits() & 0xff;
+    if (random_chance(8))
+        ent->modelindex4 = random_bits() & 0xff;
+    if (random_chance(2))
+        ent->frame = random_bits() & 0x1ff;
+    if (random_chance(4))
+        ent->skinnum = random_bits();
+    if (random_chance(4))
+        ent->effects = random_bits();
+    if (random_chance(4))
+        ent->renderfx = random_bits();
+    for (int i = 0; i < 3; i++) {
+        if (random_chance(2))
+            ent->origin[i] = random_range(-32768, 32767);
+        if (random_chance(4))
+            ent->angles[i] = random_range(0, 65535);
+        if (random_chance(4))
+            ent->old_origin[i] = random_range(-32768, 32767);
+    }
+    if (random_chance(4))
+        ent->sound = random_bits() & 0xff;
+    if (random_chance(4))
+        ent->event = random_range(0, 8);
+    if (random_chance(4))
+        ent->solid = random_bits();
+#if Q2PROTO_ENTITY_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_ENTITY_LOOP_ALPHA_SCALE_FX64
+    if (random_chance(4))
+        ent->effects |= (uint64_t)random_bits() << 32;
+    if (random_chance(4))
+        ent->loop_volume = random_bits();
+    if (random_chance(4))
+        ent->loop_attenuation = random_bits();
+    if (random_chance(4))
+        ent->alpha = random_bits();
+    if (random_chance(4))
+        ent->scale = random_bits();
+#endif
+}
+
+// Randomly change some fields of a player state
+static void change_player(q2proto_packed_player_state_t *ps)
+{
+    if (random_chance(8))
+        ps->pm_type = random_range(0, 4);
+    // Some protocols only support 8 bit values
+    if (random_chance(8))
+        ps->pm_time = random_chance(16) ? random_bits() : random_bits() & 0xff;
+    if (random_chance(8))
+        ps->pm_flags = random_chance(16) ? random_bits() : random_bits() & 0xff;
+    if (random_chance(8))
+        ps->pm_gravity = random_bits();
+    for (int i = 0; i < 3; i++) {
+        if (random_chance(2))
+            ps->pm_origin[i] = random_range(-32768, 32767);
+        if (random_chance(2))
+            ps->pm_velocity[i] = random_range(-32768, 32767);
+        if (random_chance(8))
+            ps->pm_delta_angles[i] = random_range(-32768, 32767);
+        if (random_chance(4))
+            ps->viewoffset[i] = random_range(-128, 127);
+        if (random_chance(2))
+            ps->viewangles[i] = random_range(-32768, 32767);
+        if (random_chance(4))
+            ps->kick_angles[i] = random_range(-128, 127);
+        if (random_chance(8))
+            ps->gunoffset[i] = random_range(-128, 127);
+        if (random_chance(8))
+            ps->gunangles[i] = random_range(-128, 127);
+    }
+    if (random_chance(8))
+        ps->gunindex = random_bits() & 0xff;
+    if (random_chance(2))
+        ps->gunframe = random_bits() & 0xff;
+    for (int i = 0; i < 4; i++) {
+        if (random_chance(8))
+            ps->blend[i] = random_bits();
+    }
+    if (random_chance(8))
+        ps->fov = random_bits();
+    if (random_chance(8))
+        ps->rdflags = random_bits();
+    for (int i = 0; i < 4; i++) {
+        if (random_chance(2))
+            ps->stats[random_range(0, 31)] = random_bits();
+    }
+}
+
+static void test_entity_sizes(const char *name, q2proto_servercontext_t *context, roundtrip_buffer_t *buf)
+{
+    q2proto_packed_entity_state_t from, to;
+    memset(&from, 0, sizeof(from));
+    memset(&to, 0, sizeof(to));
+    change_entity(&to);
+    int num_written = 0;
+    for (int i = 0; i < NUM_DELTAS; i++) {
+        from = to;
+        change_entity(&to);
+        // Entity numbers above 255 need more bits
+        uint16_t entnum = random_chance(2) ? random_range(1, 255) : random_range(256, 1023);
+        bool write_old_origin = random_chance(4);
+        bool from_baseline = random_chance(8);
+
+        q2proto_svc_message_t message = {.type = Q2P_SVC_FRAME_ENTITY_DELTA, .frame_entity_delta = {0}};
+        message.frame_entity_delta.newnum = entnum;
+        q2proto_server_make_entity_state_delta(context, from_baseline ? NULL : &from, &to, write_old_origin,
+                                               &message.frame_entity_delta.entity_delta);
+        size_t size = 0;
+        q2proto_error_t size_err =
+            q2proto_server_entity_delta_size(context, entnum, &message.frame_entity_delta.entity_delta, &size);
+        roundtrip_buffer_clear(buf);
+        q2proto_error_t write_err = q2proto_server_write(context, roundtrip_io_arg(buf), &message);
+        CHECK(size_err == write_err, "%s: entity delta %d: size query returned %s, writing returned %s", name, i,
+              q2proto_error_string(size_err), q2proto_error_string(write_err));
+        if (size_err != Q2P_ERR_SUCCESS || write_err != Q2P_ERR_SUCCESS)
+            continue;
+        num_written++;
+        CHECK(size == buf->size, "%s: entity delta %d (entity %u): size %zu, wrote %zu bytes", name, i, entnum, size,
+              buf->size);
+    }
+    CHECK(num_written >= NUM_DELTAS / 2, "%s: only %d entity deltas written", name, num_written);
+}
+
+static void test_playerstate_sizes(const char *name, q2proto_servercontext_t *context, roundtrip_buffer_t *buf)
+{
+    q2proto_packed_player_state_t from, to;
+    memset(&from, 0, sizeof(from));
+    memset(&to, 0, sizeof(to));
+    change_player(&to);
+    int num_written = 0;
+    size_t other_size = 0;
+    for (int i = 0; i < NUM_DELTAS; i++) {
+        from = to;
+        change_player(&to);
+        // Every so often, send an unchanged player state
+        if (random_chance(16))
+            from = to;
+
+        q2proto_svc_message_t message = {.type = Q2P_SVC_FRAME, .frame = {0}};
+        message.frame.serverframe = 1000 + i;
+        message.frame.deltaframe = 999 + i;
+        q2proto_server_make_player_state_delta(context, &from, &to, &message.frame.playerstate);
+        size_t size = 0;
+        q2proto_error_t size_err = q2proto_server_playerstate_size(context, &message.frame.playerstate, &size);
+        roundtrip_buffer_clear(buf);
+        q2proto_error_t write_err = q2proto_server_write(context, roundtrip_io_arg(buf), &message);
+        CHECK(size_err == write_err, "%s: player state delta %d: size query returned %s, writing returned %s", name,
+              i, q2proto_error_string(size_err), q2proto_error_string(write_err));
+        if (size_err != Q2P_ERR_SUCCESS || write_err != Q2P_ERR_SUCCESS)
+            continue;
+        if (size > buf->size) {
+            CHECK(false, "%s: player state delta %d: size %zu, frame is %zu bytes", name, i, size, buf->size);
+            continue;
+        }
+        if (num_written++ == 0)
+            other_size = buf->size - size;
+        CHECK(buf->size - size == other_size, "%s: player state delta %d: size %zu, frame is %zu bytes, expected %zu",
+              name, i, size, buf->size, size + other_size);
+    }
+    CHECK(num_written >= NUM_DELTAS / 2, "%s: only %d player state deltas written", name, num_written);
+}
+
+int main(void)
+{
+    q2proto_server_info_t server_info = {0};
+    server_info.game_api = TEST_GAME_API;
+    server_info.default_packet_length = MAX_OUTPUT;
+
+    q2proto_protocol_t protocols[Q2P_NUM_PROTOCOLS];
+    size_t num_protocols = q2proto_get_protocols_for_gametypes(protocols, Q2P_NUM_PROTOCOLS, &server_info.game_api, 1);
+    if (num_protocols == 0) {
+        printf("no protocols for game API\n");
+        return 1;
+    }
+
+    roundtrip_buffer_t buf;
+    if (!roundtrip_buffer_init(&buf, MAX_OUTPUT)) {
+        printf("out of memory\n");
+        return 1;
+    }
+
+    for (size_t p = 0; p < num_protocols; p++) {
+        char name[32];
+        snprintf(name, sizeof(name), "protocol %d", protocols[p]);
+        q2proto_servercontext_t context;
+        size_t max_msg_len;
+        q2proto_error_t err = q2proto_init_servercontext_demo(&context, protocols[p], &server_info, &max_msg_len);
+        if (err != Q2P_ERR_SUCCESS) {
+            CHECK(false, "%s: context init failed: %s", name, q2proto_error_string(err));
+            continue;
+        }
+        test_entity_sizes(name, &context, &buf);
+        test_playerstate_sizes(name, &context, &buf);
+    }
+
+    roundtrip_buffer_free(&buf);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,93 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "q2proto/q2proto.h"
+
+#include <stdio.h>
+
+/*
+ * Demo context test: checks the packet length reported by q2proto_init_servercontext_demo()
+ * for every protocol supported by the build flavor.
+ */
+
+#if Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_RERELEASE
+    #define TEST_GAME_API Q2PROTO_GAME_RERELEASE
+#elif Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_Q2PRO_EXTENDED_V2
+    #define TEST_GAME_API Q2PROTO_GAME_Q2PRO_EXTENDED_V2
+#elif Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_Q2PRO_EXTENDED
+    #define TEST_GAME_API Q2PROTO_GAME_Q2PRO_EXTENDED
+#else
+    #define TEST_GAME_API Q2PROTO_GAME_VANILLA
+#endif
+
+#define MIN_DEMO_PACKET 512
+#define MAX_DEMO_PACKET 0x8000
+
+static int failures = 0;
+
+/* Expected packet length for a demo written with a default packet length of 'default_packet_length' */
+static size_t expected_packet_length(q2proto_protocol_t protocol, int default_packet_length)
+{
+    switch (protocol) {
+    case Q2P_PROTOCOL_OLD_DEMO:
+    case Q2P_PROTOCOL_VANILLA:
+    case Q2P_PROTOCOL_R1Q2:
+        if (default_packet_length == 0)
+            return 1390;
+        return default_packet_length < MIN_DEMO_PACKET ? MIN_DEMO_PACKET : default_packet_length;
+    default:
+        return MAX_DEMO_PACKET;
+    }
+}
+
+static void test_packet_length(q2proto_protocol_t protocol, int default_packet_length)
+{
+    q2proto_server_info_t server_info = {0};
+    server_info.game_api = TEST_GAME_API;
+    server_info.default_packet_length = default_packet_length;
+
+    q2proto_servercontext_t context;
+    size_t max_msg_len = 0;
+    q2proto_error_t err = q2proto_init_servercontext_demo(&context, protocol, &server_info, &max_msg_len);
+    if (err != Q2P_ERR_SUCCESS) {
+        printf("protocol %d, default packet length %d: init failed with %d\n", protocol, default_packet_length, err);
+        failures++;
+        return;
+    }
+    size_t expected = expected_packet_length(protocol, default_packet_length);
+    if (max_msg_len != expected) {
+        printf("protocol %d, default packet length %d: packet length %zu, expected %zu\n", protocol,
+               default_packet_length, max_msg_len, expected);
+        failures++;
+    }
+}
+
+int main(void)
+{
+    static const int default_packet_lengths[] = {0, 100, MIN_DEMO_PACKET, 1024, 1390, 4096};
+
+    q2proto_game_api_t game_api = TEST_GAME_API;
+    q2proto_protocol_t protocols[Q2P_NUM_PROTOCOLS];
+    size_t num_protocols = q2proto_get_protocols_for_gametypes(protocols, Q2P_NUM_PROTOCOLS, &game_api, 1);
+    for (size_t i = 0; i < num_protocols; i++) {
+        for (size_t j = 0; j < sizeof(default_packet_lengths) / sizeof(default_packet_lengths[0]); j++)
+            test_packet_length(protocols[i], default_packet_lengths[j]);
+    }
+
+    return failures == 0 ? 0 : 1;
+}
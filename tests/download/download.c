@@ -0,0 +1,490 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "q2proto/q2proto.h"
+
+#include "../roundtrip/roundtrip_io.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Download test: runs the download scheduler for every protocol usable with the game API, with uncompressed,
+ * compressed and pre-compressed downloads, and checks that the bytes written per frame fill the frame budget
+ * (or the packet, if that is smaller) exactly, ie the scheduler charges each message with its actual size.
+ * Uncompressed downloads are decoded with a client context and compared with the original data.
+ *
+ * The download cache helpers are tested as well: headers must only match the key they were made for, deflated
+ * data must round trip through the output buffer, and cached downloads must use the pre-compressed data exactly
+ * when the protocol supports it.
+ *
+ * If built with Q2PROTO_WRITE_RAW_SEGMENT, download data written by reference is checked to reference the
+ * original data in order, and packets are decoded with the referenced data put in place.
+ *
+ * "Compression" is done by a pass-through deflate implementation which stores the data unchanged: the tests
+ * only look at message sizes, and this makes the compressed sizes predictable.
+ */
+
+#if Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_RERELEASE
+    #define TEST_GAME_API Q2PROTO_GAME_RERELEASE
+#elif Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_Q2PRO_EXTENDED_V2
+    #define TEST_GAME_API Q2PROTO_GAME_Q2PRO_EXTENDED_V2
+#elif Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_Q2PRO_EXTENDED
+    #define TEST_GAME_API Q2PROTO_GAME_Q2PRO_EXTENDED
+#else
+    #define TEST_GAME_API Q2PROTO_GAME_VANILLA
+#endif
+
+#define PACKET_LENGTH 1390
+#define DOWNLOAD_SIZE 20000
+#define MAX_CLIENTS   2
+#define MAX_FRAMES    1000
+
+static int failures;
+
+#define CHECK(COND, ...)         \
+    do {                         \
+        if (!(COND)) {           \
+            printf(__VA_ARGS__); \
+            printf("\n");        \
+            failures++;          \
+        }                        \
+    } while (0)
+
+// Pass-through "deflate": deflated data is the input, unchanged
+struct q2protoio_deflate_args_s {
+    roundtrip_buffer_t buf;
+    size_t allocated;
+};
+
+q2proto_error_t q2protoio_deflate_begin(q2protoio_deflate_args_t *deflate_args, size_t max_deflated,
+                                        q2proto_inflate_deflate_header_mode_t header_mode, uintptr_t *deflate_io_arg)
+{
+    deflate_args->buf.size = 0;
+    deflate_args->buf.capacity = max_deflated < deflate_args->allocated ? max_deflated : deflate_args->allocated;
+    *deflate_io_arg = roundtrip_io_arg(&deflate_args->buf);
+    return Q2P_ERR_SUCCESS;
+}
+
+q2proto_error_t q2protoio_deflate_get_data(uintptr_t deflate_io_arg, q2proto_deflate_stream_mode_t stream_mode,
+                                           size_t *in_size, const void **out, size_t *out_size)
+{
+    roundtrip_buffer_t *buf = (roundtrip_buffer_t *)deflate_io_arg;
+    if (in_size)
+        *in_size = buf->size;
+    *out = buf->data;
+    *out_size = buf->size;
+    buf->size = 0;
+    return Q2P_ERR_SUCCESS;
+}
+
+q2proto_error_t q2protoio_deflate_end(uintptr_t deflate_io_arg) { return Q2P_ERR_SUCCESS; }
+
+static const char *compress_name(q2proto_download_compress_t compress)
+{
+    switch (compress) {
+    case Q2PROTO_DOWNLOAD_COMPRESS_NEVER:
+        return "uncompressed";
+    case Q2PROTO_DOWNLOAD_COMPRESS_AUTO:
+        return "compressed";
+    case Q2PROTO_DOWNLOAD_COMPRESS_RAW:
+        return "pre-compressed";
+    }
+    return "?";
+}
+
+static uint8_t download_data[DOWNLOAD_SIZE];
+
+static uint8_t deflated_data[DOWNLOAD_SIZE];
+static size_t deflated_size;
+
+// A downloading client
+typedef struct download_client_s {
+    q2proto_protocol_t protocol;
+    // Compression mode actually used for the download
+    q2proto_download_compress_t compress;
+    // Data passed to the scheduler
+    const uint8_t *source;
+    size_t source_size;
+    q2proto_servercontext_t context;
+    q2proto_server_download_state_t download;
+    struct q2protoio_deflate_args_s deflate_args;
+    roundtrip_buffer_t packet;
+
+    q2proto_clientcontext_t client_context;
+    uint8_t received[DOWNLOAD_SIZE];
+    size_t received_size;
+    // Offset into source data the next segment is expected to reference
+    size_t segment_offset;
+} download_client_t;
+
+static download_client_t clients[MAX_CLIENTS];
+static q2proto_download_sched_client_t sched_clients[MAX_CLIENTS];
+
+// Size of the packet written to \a buf
+static size_t packet_bytes(const roundtrip_buffer_t *buf)
+{
+#if Q2PROTO_WRITE_RAW_SEGMENT
+    return buf->size + buf->segment_bytes;
+#else
+    return buf->size;
+#endif
+}
+
+// Have the client read serverdata, so it can decode download messages
+static q2proto_error_t client_read_serverdata(download_client_t *client)
+{
+    roundtrip_buffer_t buf;
+    if (!roundtrip_buffer_init(&buf, PACKET_LENGTH))
+        return Q2P_ERR_BUFFER_TOO_SMALL;
+
+    q2proto_svc_message_t message = {.type = Q2P_SVC_SERVERDATA, .serverdata = {0}};
+    q2proto_error_t err = q2proto_server_fill_serverdata(&client->context, &message.serverdata);
+    message.serverdata.servercount = 0x1234;
+    message.serverdata.gamedir = q2proto_make_string("baseq2");
+    message.serverdata.clientnum = 1;
+    message.serverdata.levelname = q2proto_make_string("download");
+    if (message.serverdata.server_fps == 0)
+        message.serverdata.server_fps = 10;
+    if (err == Q2P_ERR_SUCCESS)
+        err = q2proto_init_clientcontext(&client->client_context);
+    if (err == Q2P_ERR_SUCCESS)
+        err = q2proto_server_write(&client->context, roundtrip_io_arg(&buf), &message);
+    if (err == Q2P_ERR_SUCCESS) {
+        roundtrip_buffer_t read_buf;
+        roundtrip_buffer_init_read(&read_buf, buf.data, buf.size);
+        while (err == Q2P_ERR_SUCCESS)
+            err = q2proto_client_read(&client->client_context, roundtrip_io_arg(&read_buf), &message);
+        if (err == Q2P_ERR_NO_MORE_INPUT)
+            err = Q2P_ERR_SUCCESS;
+    }
+    roundtrip_buffer_free(&buf);
+    return err;
+}
+
+// Check segments of a packet, decode it if the download is uncompressed
+static void client_check_packet(download_client_t *client)
+{
+#if Q2PROTO_WRITE_RAW_SEGMENT
+    for (size_t i = 0; i < client->packet.num_segments; i++) {
+        const roundtrip_segment_t *segment = &client->packet.segments[i];
+        CHECK(segment->data == client->source + client->segment_offset,
+              "protocol %d, %s: segment references offset %td, expected %zu", client->protocol,
+              compress_name(client->compress), (const uint8_t *)segment->data - client->source,
+              client->segment_offset);
+        client->segment_offset += segment->size;
+    }
+#endif
+
+    if (client->compress != Q2PROTO_DOWNLOAD_COMPRESS_NEVER)
+        return;
+
+    static uint8_t packet_data[PACKET_LENGTH];
+#if Q2PROTO_WRITE_RAW_SEGMENT
+    size_t size = roundtrip_buffer_gather(&client->packet, packet_data);
+#else
+    size_t size = client->packet.size;
+    memcpy(packet_data, client->packet.data, size);
+#endif
+    roundtrip_buffer_t read_buf;
+    roundtrip_buffer_init_read(&read_buf, packet_data, size);
+    q2proto_svc_message_t message;
+    q2proto_error_t err;
+    while ((err = q2proto_client_read(&client->client_context, roundtrip_io_arg(&read_buf), &message))
+           == Q2P_ERR_SUCCESS)
+    {
+        if (message.type != Q2P_SVC_DOWNLOAD) {
+            CHECK(false, "protocol %d: decoded message type %d", client->protocol, message.type);
+            continue;
+        }
+        if (message.download.size <= 0)
+            continue;
+        if ((size_t)message.download.size > DOWNLOAD_SIZE - client->received_size) {
+            CHECK(false, "protocol %d: received too much data", client->protocol);
+            return;
+        }
+        memcpy(client->received + client->received_size, message.download.data, message.download.size);
+        client->received_size += message.download.size;
+    }
+    CHECK(err == Q2P_ERR_NO_MORE_INPUT, "protocol %d: decoding failed: %s", client->protocol,
+          q2proto_error_string(err));
+}
+
+static void client_free(download_client_t *client)
+{
+    q2proto_server_download_end(&client->download);
+    roundtrip_buffer_free(&client->packet);
+    // Deflate buffer capacity was limited by q2protoio_deflate_begin()
+    client->deflate_args.buf.capacity = client->deflate_args.allocated;
+    roundtrip_buffer_free(&client->deflate_args.buf);
+}
+
+/* Set up a client and begin its download. If \a cache_entry is given, the download is started from it, with
+ * \a compress as the fallback mode. */
+static bool client_init(size_t index, q2proto_protocol_t protocol, q2proto_download_compress_t compress,
+                        const q2proto_download_cache_entry_t *cache_entry, size_t packet_size)
+{
+    download_client_t *client = &clients[index];
+    memset(client, 0, sizeof(*client));
+    client->protocol = protocol;
+    client->compress = compress;
+    client->source = download_data;
+    client->source_size = DOWNLOAD_SIZE;
+
+    static q2proto_server_info_t server_info;
+    server_info.game_api = TEST_GAME_API;
+    server_info.default_packet_length = PACKET_LENGTH;
+
+    q2proto_connect_t connect;
+    memset(&connect, 0, sizeof(connect));
+    connect.protocol = protocol;
+    connect.qport = 1234;
+    connect.challenge = 5678;
+    connect.userinfo = q2proto_make_string("\\name\\download");
+    connect.packet_length = PACKET_LENGTH;
+    connect.has_zlib = true;
+    q2proto_error_t err = q2proto_complete_connect(&connect);
+    if (err == Q2P_ERR_SUCCESS)
+        err = q2proto_init_servercontext(&client->context, &server_info, &connect);
+    if (err != Q2P_ERR_SUCCESS) {
+        CHECK(false, "protocol %d: context init failed: %s", protocol, q2proto_error_string(err));
+        return false;
+    }
+    err = client_read_serverdata(client);
+    if (err != Q2P_ERR_SUCCESS) {
+        CHECK(false, "protocol %d: serverdata exchange failed: %s", protocol, q2proto_error_string(err));
+        return false;
+    }
+
+    bool have_buffers = roundtrip_buffer_init(&client->deflate_args.buf, PACKET_LENGTH);
+    client->deflate_args.allocated = client->deflate_args.buf.capacity;
+    have_buffers = have_buffers && roundtrip_buffer_init(&client->packet, packet_size);
+    if (!have_buffers) {
+        CHECK(false, "out of memory");
+        client_free(client);
+        return false;
+    }
+
+    if (cache_entry) {
+        err = q2proto_server_download_begin_cached(&client->context, cache_entry, compress, &client->deflate_args,
+                                                   &client->download, &client->source, &client->source_size);
+        // Pre-compressed data must be used exactly if available and supported
+        if (cache_entry->deflated && client->context.features.download_compress_raw)
+            client->compress = Q2PROTO_DOWNLOAD_COMPRESS_RAW;
+        const void *expected_source =
+            client->compress == Q2PROTO_DOWNLOAD_COMPRESS_RAW ? cache_entry->deflated : cache_entry->data;
+        CHECK(err != Q2P_ERR_SUCCESS || client->source == expected_source,
+              "protocol %d, %s: cached download uses wrong data", protocol, compress_name(client->compress));
+    } else
+        err = q2proto_server_download_begin(&client->context, DOWNLOAD_SIZE, compress, &client->deflate_args,
+                                            &client->download);
+    if (err != Q2P_ERR_SUCCESS) {
+        CHECK(false, "protocol %d: download begin failed: %s", protocol, q2proto_error_string(err));
+        client_free(client);
+        return false;
+    }
+    q2proto_download_sched_client_init(&sched_clients[index], &client->download, roundtrip_io_arg(&client->packet),
+                                       client->source, client->source_size);
+    return true;
+}
+
+/* Run scheduler frames until all downloads completed. Each frame, the bytes written to all clients must add up to
+ * the smaller of frame budget and total packet space, unless a download completed in that frame. */
+static void test_scheduler(q2proto_protocol_t protocol, q2proto_download_compress_t compress,
+                           const q2proto_download_cache_entry_t *cache_entry, size_t num_clients, size_t frame_budget,
+                           size_t packet_size)
+{
+    size_t num_initialized = 0;
+    while (num_initialized < num_clients) {
+        if (!client_init(num_initialized, protocol, compress, cache_entry, packet_size))
+            goto done;
+        num_initialized++;
+    }
+    const char *name = compress_name(clients[0].compress);
+
+    q2proto_download_scheduler_t scheduler;
+    q2proto_download_scheduler_init(&scheduler, frame_budget);
+
+    size_t expected = frame_budget < packet_size * num_clients ? frame_budget : packet_size * num_clients;
+    for (int frame = 0; frame < MAX_FRAMES; frame++) {
+        size_t num_complete_before = 0;
+        for (size_t i = 0; i < num_clients; i++) {
+            roundtrip_buffer_clear(&clients[i].packet);
+            num_complete_before += sched_clients[i].complete;
+        }
+
+        q2proto_error_t err = q2proto_download_scheduler_run_frame(&scheduler, sched_clients, num_clients);
+        if (err != Q2P_ERR_SUCCESS) {
+            CHECK(false, "protocol %d, %s: scheduler failed: %s", protocol, name, q2proto_error_string(err));
+            goto done;
+        }
+
+        size_t written = 0, num_complete = 0;
+        for (size_t i = 0; i < num_clients; i++) {
+            CHECK(sched_clients[i].error == Q2P_ERR_SUCCESS, "protocol %d, %s: client %zu error: %s", protocol, name,
+                  i, q2proto_error_string(sched_clients[i].error));
+            client_check_packet(&clients[i]);
+            written += packet_bytes(&clients[i].packet);
+            num_complete += sched_clients[i].complete;
+        }
+        if (num_complete == num_clients)
+            break;
+
+        if (num_complete == num_complete_before)
+            CHECK(written == expected, "protocol %d, %s, %zu client(s): frame %d: wrote %zu bytes, expected %zu",
+                  protocol, name, num_clients, frame, written, expected);
+        else
+            CHECK(written <= expected, "protocol %d, %s, %zu client(s): frame %d: wrote %zu bytes, at most %zu",
+                  protocol, name, num_clients, frame, written, expected);
+    }
+
+    for (size_t i = 0; i < num_clients; i++) {
+        CHECK(sched_clients[i].complete, "protocol %d, %s: client %zu did not complete", protocol, name, i);
+        if (clients[i].compress == Q2PROTO_DOWNLOAD_COMPRESS_NEVER) {
+            CHECK(sched_clients[i].bytes_sent == DOWNLOAD_SIZE, "protocol %d, %s: client %zu sent %llu bytes",
+                  protocol, name, i, (unsigned long long)sched_clients[i].bytes_sent);
+            CHECK(clients[i].received_size == DOWNLOAD_SIZE
+                      && memcmp(clients[i].received, download_data, DOWNLOAD_SIZE) == 0,
+                  "protocol %d, %s: client %zu received wrong data", protocol, name, i);
+        }
+#if Q2PROTO_WRITE_RAW_SEGMENT
+        // Data deflated on the fly is copied, all other data is referenced
+        bool deflated =
+            clients[i].compress == Q2PROTO_DOWNLOAD_COMPRESS_AUTO && clients[i].context.features.enable_deflate;
+        size_t expected_referenced = deflated ? 0 : clients[i].source_size;
+        CHECK(clients[i].segment_offset == expected_referenced,
+              "protocol %d, %s: client %zu: %zu bytes referenced, expected %zu", protocol, name, i,
+              clients[i].segment_offset, expected_referenced);
+#endif
+    }
+
+done:
+    for (size_t i = 0; i < num_initialized; i++)
+        client_free(&clients[i]);
+}
+
+static void test_protocol(q2proto_protocol_t protocol, q2proto_download_compress_t compress)
+{
+    // Limited by frame budget
+    test_scheduler(protocol, compress, NULL, 1, 1000, PACKET_LENGTH);
+    // Limited by packet size
+    test_scheduler(protocol, compress, NULL, 1, 100000, 1000);
+    // Budget shared between clients
+    test_scheduler(protocol, compress, NULL, 2, 1000, PACKET_LENGTH);
+    test_scheduler(protocol, compress, NULL, 2, 1234, PACKET_LENGTH);
+}
+
+static void test_cache_header(void)
+{
+    q2proto_download_cache_key_t key = {.path = "maps/q2dm1.bsp", .size = DOWNLOAD_SIZE, .mtime = 1234567890};
+    uint8_t header[Q2PROTO_DOWNLOAD_CACHE_HEADER_SIZE];
+    q2proto_download_cache_make_header(&key, header);
+    CHECK(q2proto_download_cache_check_header(&key, header, sizeof(header)), "cache header: no match");
+    CHECK(!q2proto_download_cache_check_header(&key, header, sizeof(header) - 1), "cache header: short header");
+
+    q2proto_download_cache_key_t other_key = key;
+    other_key.path = "maps/q2dm2.bsp";
+    CHECK(!q2proto_download_cache_check_header(&other_key, header, sizeof(header)), "cache header: path mismatch");
+    other_key = key;
+    other_key.size++;
+    CHECK(!q2proto_download_cache_check_header(&other_key, header, sizeof(header)), "cache header: size mismatch");
+    other_key = key;
+    other_key.mtime = -key.mtime;
+    CHECK(!q2proto_download_cache_check_header(&other_key, header, sizeof(header)), "cache header: mtime mismatch");
+
+    header[3] ^= 0xff;
+    CHECK(!q2proto_download_cache_check_header(&key, header, sizeof(header)), "cache header: bad magic");
+}
+
+// Deflate download_data into deflated_data. Input is larger than the deflate buffer, so it's deflated in chunks.
+static void test_cache_deflate(void)
+{
+    struct q2protoio_deflate_args_s deflate_args;
+    if (!roundtrip_buffer_init(&deflate_args.buf, PACKET_LENGTH)) {
+        CHECK(false, "out of memory");
+        return;
+    }
+    deflate_args.allocated = deflate_args.buf.capacity;
+
+    size_t size = 0;
+    q2proto_error_t err = q2proto_download_cache_deflate(&deflate_args, download_data, DOWNLOAD_SIZE, deflated_data,
+                                                         DOWNLOAD_SIZE - 1, &size);
+    CHECK(err == Q2P_ERR_BUFFER_TOO_SMALL, "cache deflate: too small buffer: %s", q2proto_error_string(err));
+
+    err = q2proto_download_cache_deflate(&deflate_args, download_data, DOWNLOAD_SIZE, deflated_data, DOWNLOAD_SIZE,
+                                         &deflated_size);
+    CHECK(err == Q2P_ERR_SUCCESS, "cache deflate failed: %s", q2proto_error_string(err));
+    CHECK(deflated_size == DOWNLOAD_SIZE && memcmp(deflated_data, download_data, DOWNLOAD_SIZE) == 0,
+          "cache deflate: wrong data, %zu bytes", deflated_size);
+
+    deflate_args.buf.capacity = deflate_args.allocated;
+    roundtrip_buffer_free(&deflate_args.buf);
+}
+
+static void test_protocol_cached(q2proto_protocol_t protocol)
+{
+    q2proto_download_cache_entry_t entry = {.data = download_data, .size = DOWNLOAD_SIZE};
+    // Without pre-compressed data, the fallback mode is used
+    test_scheduler(protocol, Q2PROTO_DOWNLOAD_COMPRESS_NEVER, &entry, 1, 1000, PACKET_LENGTH);
+
+    entry.deflated = deflated_data;
+    entry.deflated_size = deflated_size;
+    test_scheduler(protocol, Q2PROTO_DOWNLOAD_COMPRESS_NEVER, &entry, 1, 1000, PACKET_LENGTH);
+    test_scheduler(protocol, Q2PROTO_DOWNLOAD_COMPRESS_AUTO, &entry, 2, 1234, PACKET_LENGTH);
+
+    // Pre-compressed data can't be a fallback
+    if (client_init(0, protocol, Q2PROTO_DOWNLOAD_COMPRESS_NEVER, NULL, PACKET_LENGTH)) {
+        const uint8_t *data;
+        size_t remaining;
+        q2proto_server_download_end(&clients[0].download);
+        q2proto_error_t err = q2proto_server_download_begin_cached(
+            &clients[0].context, &entry, Q2PROTO_DOWNLOAD_COMPRESS_RAW, &clients[0].deflate_args,
+            &clients[0].download, &data, &remaining);
+        CHECK(err == Q2P_ERR_INVALID_ARGUMENT, "protocol %d: raw fallback: %s", protocol, q2proto_error_string(err));
+        client_free(&clients[0]);
+    }
+}
+
+int main(void)
+{
+    for (size_t i = 0; i < DOWNLOAD_SIZE; i++)
+        download_data[i] = (uint8_t)(i * 7 + (i >> 8));
+
+    test_cache_header();
+    test_cache_deflate();
+
+    q2proto_game_api_t game_api = TEST_GAME_API;
+    q2proto_protocol_t protocols[Q2P_NUM_PROTOCOLS];
+    size_t num_protocols = q2proto_get_protocols_for_gametypes(protocols, Q2P_NUM_PROTOCOLS, &game_api, 1);
+    for (size_t i = 0; i < num_protocols; i++) {
+        test_protocol(protocols[i], Q2PROTO_DOWNLOAD_COMPRESS_NEVER);
+        test_protocol(protocols[i], Q2PROTO_DOWNLOAD_COMPRESS_AUTO);
+
+        // Pre-compressed data is only supported by some protocols
+        if (client_init(0, protocols[i], Q2PROTO_DOWNLOAD_COMPRESS_NEVER, NULL, PACKET_LENGTH)) {
+            bool compress_raw = clients[0].context.features.download_compress_raw;
+            client_free(&clients[0]);
+            if (compress_raw)
+                test_protocol(protocols[i], Q2PROTO_DOWNLOAD_COMPRESS_RAW);
+        }
+
+        test_protocol_cached(protocols[i]);
+    }
+
+    return failures == 0 ? 0 : 1;
+}
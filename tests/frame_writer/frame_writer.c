@@ -0,0 +1,341 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "q2proto/q2proto.h"
+
+#include "../roundtrip/roundtrip_io.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Frame writer test: for every protocol usable with the game API, write random frame entity deltas, with random
+ * (distinct) priorities, into packets of different sizes. Checks that
+ * - the deltas picked match a greedy selection by priority, using the sizes of the deltas written individually,
+ * - the output is the same as writing the picked deltas plus the terminator with q2proto_server_write(),
+ * - the result statistics match the output, and entities are sorted by entity number again.
+ * Also checks the ordering of q2proto_frame_entity_priority() results.
+ */
+
+#if Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_RERELEASE
+    #define TEST_GAME_API Q2PROTO_GAME_RERELEASE
+#elif Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_Q2PRO_EXTENDED_V2
+    #define TEST_GAME_API Q2PROTO_GAME_Q2PRO_EXTENDED_V2
+#elif Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_Q2PRO_EXTENDED
+    #define TEST_GAME_API Q2PROTO_GAME_Q2PRO_EXTENDED
+#else
+    #define TEST_GAME_API Q2PROTO_GAME_VANILLA
+#endif
+
+#define NUM_ENTITIES  200
+#define MAX_OUTPUT    0x8000
+#define CACHE_ENTRIES 1024
+
+static int failures;
+
+#define CHECK(COND, ...)         \
+    do {                         \
+        if (!(COND)) {           \
+            printf(__VA_ARGS__); \
+            printf("\n");        \
+            failures++;          \
+        }                        \
+    } while (0)
+
+static uint64_t rng_state = 0x2545f4914f6cdd1dULL;
+
+static uint32_t rng_next(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t)(rng_state >> 16);
+}
+
+static int32_t random_range(int32_t min, int32_t max) { return min + (int32_t)(rng_next() % (uint32_t)(max - min + 1)); }
+
+static bool random_chance(unsigned one_in) { return rng_next() % one_in == 0; }
+
+static q2proto_packed_entity_state_t old_states[NUM_ENTITIES];
+static q2proto_packed_entity_state_t new_states[NUM_ENTITIES];
+static q2proto_frame_entity_t frame_entities[NUM_ENTITIES];
+// Size of each delta, written individually
+static size_t delta_sizes[NUM_ENTITIES];
+
+static q2proto_delta_cache_entry_t cache_entries[CACHE_ENTRIES];
+static uint8_t cache_storage[MAX_OUTPUT];
+
+static void random_entity(q2proto_packed_entity_state_t *ent)
+{
+    ent->modelindex = random_range(1, 255);
+    ent->frame = random_range(0, 255);
+    ent->skinnum = random_range(0, 15);
+    ent->effects = random_chance(2) ? random_range(0, 0xffff) : 0;
+    ent->solid = random_range(0, 0xffff);
+    for (int i = 0; i < 3; i++) {
+        ent->origin[i] = random_range(-32768, 32767);
+        ent->angles[i] = random_chance(2) ? random_range(0, 65535) : 0;
+    }
+}
+
+// Make random deltas: changed, unchanged, new and removed entities, with distinct priorities
+static void make_frame_entities(void)
+{
+    memset(old_states, 0, sizeof(old_states));
+    memset(new_states, 0, sizeof(new_states));
+    for (int i = 0; i < NUM_ENTITIES; i++) {
+        q2proto_frame_entity_t *entity = &frame_entities[i];
+        memset(entity, 0, sizeof(*entity));
+        entity->entnum = 1 + i * 3 + random_range(0, 2);
+        // Low bits make priorities distinct
+        entity->priority = (rng_next() << 8) | (uint32_t)i;
+
+        random_entity(&old_states[i]);
+        new_states[i] = old_states[i];
+        switch (rng_next() % 4) {
+        case 0:
+            entity->remove = true;
+            entity->from = &old_states[i];
+            break;
+        case 1:
+            // New entity
+            random_entity(&new_states[i]);
+            entity->from = NULL;
+            entity->to = &new_states[i];
+            entity->write_old_origin = true;
+            break;
+        case 2:
+            // Unchanged
+            entity->from = &old_states[i];
+            entity->to = &new_states[i];
+            break;
+        default:
+            memcpy(new_states[i].old_origin, old_states[i].origin, sizeof(old_states[i].origin));
+            new_states[i].origin[0] += random_range(-100, 100);
+            new_states[i].frame = (old_states[i].frame + 1) % 256;
+            if (random_chance(2))
+                new_states[i].effects ^= 1u << random_range(0, 15);
+            entity->from = &old_states[i];
+            entity->to = &new_states[i];
+            break;
+        }
+    }
+}
+
+static q2proto_error_t write_frame_entity(q2proto_servercontext_t *context, uintptr_t io_arg,
+                                          const q2proto_frame_entity_t *entity)
+{
+    q2proto_svc_message_t message = {.type = Q2P_SVC_FRAME_ENTITY_DELTA, .frame_entity_delta = {0}};
+    message.frame_entity_delta.newnum = entity->entnum;
+    if (entity->remove)
+        message.frame_entity_delta.remove = true;
+    else
+        q2proto_server_make_entity_state_delta(context, entity->from, entity->to, entity->write_old_origin,
+                                               &message.frame_entity_delta.entity_delta);
+    return q2proto_server_write(context, io_arg, &message);
+}
+
+static q2proto_error_t write_terminator(q2proto_servercontext_t *context, uintptr_t io_arg)
+{
+    q2proto_svc_message_t terminator = {.type = Q2P_SVC_FRAME_ENTITY_DELTA, .frame_entity_delta = {0}};
+    return q2proto_server_write(context, io_arg, &terminator);
+}
+
+static bool measure_sizes(q2proto_servercontext_t *context, roundtrip_buffer_t *buf, size_t *terminator_size)
+{
+    for (int i = 0; i < NUM_ENTITIES; i++) {
+        roundtrip_buffer_clear(buf);
+        q2proto_error_t err = write_frame_entity(context, roundtrip_io_arg(buf), &frame_entities[i]);
+        if (err != Q2P_ERR_SUCCESS) {
+            CHECK(false, "entity %u: write failed: %s", frame_entities[i].entnum, q2proto_error_string(err));
+            return false;
+        }
+        delta_sizes[i] = buf->size;
+    }
+    roundtrip_buffer_clear(buf);
+    q2proto_error_t err = write_terminator(context, roundtrip_io_arg(buf));
+    CHECK(err == Q2P_ERR_SUCCESS, "terminator write failed: %s", q2proto_error_string(err));
+    *terminator_size = buf->size;
+    return err == Q2P_ERR_SUCCESS;
+}
+
+// Greedy selection by priority: visit entities by descending priority, defer those that don't fit anymore
+static void compute_expected_deferred(size_t budget, bool *deferred)
+{
+    bool visited[NUM_ENTITIES] = {0};
+    for (int n = 0; n < NUM_ENTITIES; n++) {
+        int best = -1;
+        for (int i = 0; i < NUM_ENTITIES; i++) {
+            if (!visited[i] && (best < 0 || frame_entities[i].priority > frame_entities[best].priority))
+                best = i;
+        }
+        visited[best] = true;
+        deferred[best] = delta_sizes[best] > budget;
+        if (!deferred[best])
+            budget -= delta_sizes[best];
+    }
+}
+
+static void test_packet(const char *name, q2proto_servercontext_t *context, q2proto_delta_cache_t *cache,
+                        size_t terminator_size, size_t capacity)
+{
+    roundtrip_buffer_t buf, reference_buf;
+    if (!roundtrip_buffer_init(&buf, capacity) || !roundtrip_buffer_init(&reference_buf, MAX_OUTPUT)) {
+        CHECK(false, "out of memory");
+        return;
+    }
+
+    bool expected_deferred[NUM_ENTITIES];
+    compute_expected_deferred(capacity - terminator_size, expected_deferred);
+
+    q2proto_frame_entity_t entities[NUM_ENTITIES];
+    memcpy(entities, frame_entities, sizeof(entities));
+    q2proto_frame_write_result_t result;
+    q2proto_error_t err =
+        q2proto_server_write_frame_entities(context, roundtrip_io_arg(&buf), cache, entities, NUM_ENTITIES, &result);
+    if (err != Q2P_ERR_SUCCESS) {
+        CHECK(false, "%s, %zu bytes: write failed: %s", name, capacity, q2proto_error_string(err));
+        goto done;
+    }
+
+    uint32_t num_deferred = 0;
+    for (int i = 0; i < NUM_ENTITIES; i++) {
+        CHECK(entities[i].entnum == frame_entities[i].entnum && entities[i].priority == frame_entities[i].priority,
+              "%s, %zu bytes: entity %d out of order", name, capacity, i);
+        CHECK(entities[i].deferred == expected_deferred[i], "%s, %zu bytes: entity %u %s, expected %s", name,
+              capacity, entities[i].entnum, entities[i].deferred ? "deferred" : "written",
+              expected_deferred[i] ? "deferred" : "written");
+        num_deferred += entities[i].deferred;
+        if (!entities[i].deferred)
+            err = write_frame_entity(context, roundtrip_io_arg(&reference_buf), &entities[i]);
+        if (err != Q2P_ERR_SUCCESS) {
+            CHECK(false, "%s: reference write failed: %s", name, q2proto_error_string(err));
+            goto done;
+        }
+    }
+    write_terminator(context, roundtrip_io_arg(&reference_buf));
+
+    CHECK(result.num_deferred == num_deferred && result.num_written == NUM_ENTITIES - num_deferred,
+          "%s, %zu bytes: %u written, %u deferred, expected %u deferred", name, capacity, result.num_written,
+          result.num_deferred, num_deferred);
+    CHECK(result.bytes_written == buf.size && buf.size <= capacity, "%s, %zu bytes: %u bytes reported, %zu written",
+          name, capacity, result.bytes_written, buf.size);
+    CHECK(buf.size == reference_buf.size && memcmp(buf.data, reference_buf.data, buf.size) == 0,
+          "%s, %zu bytes: output differs from reference", name, capacity);
+
+done:
+    roundtrip_buffer_free(&buf);
+    roundtrip_buffer_free(&reference_buf);
+}
+
+static void test_protocol(q2proto_protocol_t protocol, const q2proto_server_info_t *server_info,
+                          roundtrip_buffer_t *scratch_buf)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "protocol %d", protocol);
+    q2proto_servercontext_t context;
+    size_t max_msg_len;
+    q2proto_error_t err = q2proto_init_servercontext_demo(&context, protocol, server_info, &max_msg_len);
+    if (err != Q2P_ERR_SUCCESS) {
+        CHECK(false, "%s: context init failed: %s", name, q2proto_error_string(err));
+        return;
+    }
+
+    size_t terminator_size, total_size = 0;
+    if (!measure_sizes(&context, scratch_buf, &terminator_size))
+        return;
+    for (int i = 0; i < NUM_ENTITIES; i++)
+        total_size += delta_sizes[i];
+
+    // Everything fits, nothing fits, and a range of sizes in between
+    test_packet(name, &context, NULL, terminator_size, total_size + terminator_size);
+    test_packet(name, &context, NULL, terminator_size, terminator_size);
+    for (size_t capacity = terminator_size + 1; capacity < total_size; capacity += total_size / 16 + 1)
+        test_packet(name, &context, NULL, terminator_size, capacity);
+
+    // Output with a delta cache must be the same
+    q2proto_delta_cache_t cache;
+    q2proto_delta_cache_init(&cache, cache_entries, CACHE_ENTRIES, cache_storage, sizeof(cache_storage));
+    for (int pass = 0; pass < 2; pass++)
+        test_packet(name, &context, &cache, terminator_size, total_size / 2);
+    CHECK(cache.stats.hits > 0, "%s: no delta cache hits", name);
+
+    // Not even the terminator fits
+    roundtrip_buffer_t buf;
+    if (roundtrip_buffer_init(&buf, terminator_size - 1)) {
+        q2proto_frame_entity_t entities[NUM_ENTITIES];
+        memcpy(entities, frame_entities, sizeof(entities));
+        err = q2proto_server_write_frame_entities(&context, roundtrip_io_arg(&buf), NULL, entities, NUM_ENTITIES,
+                                                  NULL);
+        CHECK(err == Q2P_ERR_NOT_ENOUGH_PACKET_SPACE, "%s: no space for terminator: %s", name,
+              q2proto_error_string(err));
+        roundtrip_buffer_free(&buf);
+    }
+}
+
+static void test_priority(void)
+{
+    // Player relevance beats everything, then recency, then distance
+    uint32_t relevant = q2proto_frame_entity_priority(100000.f, 1000, true);
+    uint32_t recent = q2proto_frame_entity_priority(100000.f, 0, false);
+    uint32_t recent_close = q2proto_frame_entity_priority(10.f, 0, false);
+    uint32_t old_close = q2proto_frame_entity_priority(0.f, 10, false);
+    CHECK(relevant > recent_close, "priority: player relevance doesn't win");
+    CHECK(recent > old_close, "priority: recency doesn't beat distance");
+    CHECK(recent_close > recent, "priority: closer entity doesn't win");
+    CHECK(q2proto_frame_entity_priority(10.f, 5, false) > q2proto_frame_entity_priority(10.f, 6, false),
+          "priority: more recent change doesn't win");
+
+    // Out of range values are clamped
+    CHECK(q2proto_frame_entity_priority(-5.f, 0, false) == q2proto_frame_entity_priority(0.f, 0, false),
+          "priority: negative distance");
+    CHECK(q2proto_frame_entity_priority(1e30f, 0, false) == q2proto_frame_entity_priority(1e20f, 0, false),
+          "priority: huge distance");
+    CHECK(q2proto_frame_entity_priority(10.f, 1000, false) == q2proto_frame_entity_priority(10.f, UINT32_MAX, false),
+          "priority: old change");
+    CHECK(q2proto_frame_entity_priority(10.f, 1000, false) < q2proto_frame_entity_priority(10.f, 0, false),
+          "priority: recency saturation");
+}
+
+int main(void)
+{
+    q2proto_server_info_t server_info = {0};
+    server_info.game_api = TEST_GAME_API;
+    server_info.default_packet_length = MAX_OUTPUT;
+
+    q2proto_protocol_t protocols[Q2P_NUM_PROTOCOLS];
+    size_t num_protocols = q2proto_get_protocols_for_gametypes(protocols, Q2P_NUM_PROTOCOLS, &server_info.game_api, 1);
+    if (num_protocols == 0) {
+        printf("no protocols for game API\n");
+        return 1;
+    }
+
+    roundtrip_buffer_t scratch_buf;
+    if (!roundtrip_buffer_init(&scratch_buf, MAX_OUTPUT)) {
+        printf("out of memory\n");
+        return 1;
+    }
+
+    test_priority();
+    make_frame_entities();
+    for (size_t p = 0; p < num_protocols; p++)
+        test_protocol(protocols[p], &server_info, &scratch_buf);
+
+    roundtrip_buffer_free(&scratch_buf);
+    return failures == 0 ? 0 : 1;
+}
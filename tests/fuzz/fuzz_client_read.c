@@ -0,0 +1,61 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * Fuzzer for q2proto_client_read().
+ * The input is a demo: a sequence of packets, each preceded by its little-endian 32-bit length.
+ * The svc_*.dm2 files produced by the round trip test serve as the seed corpus.
+ */
+
+#include "q2proto/q2proto.h"
+
+#include "../roundtrip/roundtrip_io.h"
+
+#include <string.h>
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    q2proto_clientcontext_t context;
+    if (q2proto_init_clientcontext(&context) != Q2P_ERR_SUCCESS)
+        return 0;
+
+    size_t pos = 0;
+    while (size - pos >= 4) {
+        const uint8_t *p = data + pos;
+        uint32_t block_size = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+        pos += 4;
+        if (block_size > size - pos)
+            break;
+
+        roundtrip_buffer_t block;
+        roundtrip_buffer_init_read(&block, data + pos, block_size);
+        pos += block_size;
+        // Bound the number of messages per packet, in case a reader fails to make progress
+        for (size_t n = 0; n <= block_size * 2; n++) {
+            q2proto_svc_message_t message;
+            q2proto_error_t err = q2proto_client_read(&context, roundtrip_io_arg(&block), &message);
+            if (err == Q2P_ERR_NO_MORE_INPUT)
+                break;
+            if (err != Q2P_ERR_SUCCESS)
+                return 0;
+        }
+    }
+    return 0;
+}
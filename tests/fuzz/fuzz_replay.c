@@ -0,0 +1,106 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * Driver for fuzz targets, used when building without libFuzzer:
+ * runs LLVMFuzzerTestOneInput() on each file given on the command line.
+ * With "-n <count>", every input is run <count> times and the time taken is reported,
+ * so a saved corpus doubles as a benchmark.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static uint8_t *read_file(const char *path, size_t *size)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return NULL;
+    uint8_t *data = NULL;
+    size_t capacity = 0;
+    *size = 0;
+    while (true) {
+        if (*size == capacity) {
+            capacity = capacity ? capacity * 2 : 0x10000;
+            uint8_t *new_data = realloc(data, capacity);
+            if (!new_data) {
+                free(data);
+                fclose(f);
+                return NULL;
+            }
+            data = new_data;
+        }
+        size_t n = fread(data + *size, 1, capacity - *size, f);
+        if (n == 0)
+            break;
+        *size += n;
+    }
+    bool ok = !ferror(f);
+    fclose(f);
+    if (!ok) {
+        free(data);
+        return NULL;
+    }
+    return data;
+}
+
+int main(int argc, char **argv)
+{
+    int first_file = 1;
+    long count = 1;
+    if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+        count = strtol(argv[2], NULL, 10);
+        first_file = 3;
+    }
+    if (first_file >= argc || count < 1) {
+        fprintf(stderr, "usage: %s [-n <count>] <input>...\n", argv[0]);
+        return 1;
+    }
+
+    int result = 0;
+    double total_time = 0;
+    size_t total_size = 0;
+    for (int i = first_file; i < argc; i++) {
+        size_t size;
+        uint8_t *data = read_file(argv[i], &size);
+        if (!data) {
+            fprintf(stderr, "%s: failed to read\n", argv[i]);
+            result = 1;
+            continue;
+        }
+        clock_t start = clock();
+        for (long n = 0; n < count; n++)
+            LLVMFuzzerTestOneInput(data, size);
+        double time = (double)(clock() - start) / CLOCKS_PER_SEC;
+        free(data);
+
+        if (count > 1)
+            printf("%s: %zu bytes, %.3f ms per run\n", argv[i], size, time * 1000 / count);
+        total_time += time;
+        total_size += size * count;
+    }
+    if (count > 1 && total_time > 0)
+        printf("total: %.1f MB/s\n", total_size / total_time / (1024 * 1024));
+    return result;
+}
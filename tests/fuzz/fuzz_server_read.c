@@ -0,0 +1,76 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * Fuzzer for q2proto_server_read().
+ * The first input byte selects one of the network protocols for the game API of the build flavor,
+ * the remaining bytes are client messages.
+ * The clc_*.bin files produced by the round trip test serve as the seed corpus.
+ */
+
+#include "q2proto/q2proto.h"
+
+#include "../roundtrip/roundtrip_io.h"
+#include "../roundtrip/roundtrip_state.h"
+
+#include <string.h>
+
+#define PACKET_LENGTH 1390
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    static q2proto_server_info_t server_info;
+    static q2proto_protocol_t protocols[Q2P_NUM_PROTOCOLS];
+    static size_t num_protocols;
+    if (num_protocols == 0) {
+        server_info.game_api = TEST_GAME_API;
+        server_info.default_packet_length = PACKET_LENGTH;
+        num_protocols = q2proto_get_protocols_for_gametypes(protocols, Q2P_NUM_PROTOCOLS, &server_info.game_api, 1);
+        if (num_protocols == 0)
+            return 0;
+    }
+
+    if (size < 1)
+        return 0;
+
+    q2proto_connect_t connect;
+    memset(&connect, 0, sizeof(connect));
+    connect.protocol = protocols[data[0] % num_protocols];
+    connect.qport = 1234;
+    connect.challenge = 5678;
+    connect.userinfo = q2proto_make_string("\\name\\fuzz");
+    connect.packet_length = PACKET_LENGTH;
+    if (q2proto_complete_connect(&connect) != Q2P_ERR_SUCCESS)
+        return 0;
+    q2proto_servercontext_t context;
+    if (q2proto_init_servercontext(&context, &server_info, &connect) != Q2P_ERR_SUCCESS)
+        return 0;
+
+    roundtrip_buffer_t in;
+    roundtrip_buffer_init_read(&in, data + 1, size - 1);
+    // Bound the number of messages, in case a reader fails to make progress
+    for (size_t n = 0; n < size * 2; n++) {
+        q2proto_clc_message_t message;
+        q2proto_error_t err = q2proto_server_read(&context, roundtrip_io_arg(&in), &message);
+        if (err != Q2P_ERR_SUCCESS)
+            break;
+    }
+    return 0;
+}
@@ -0,0 +1,351 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "q2proto/q2proto.h"
+
+#include "../roundtrip/roundtrip_io.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Multicast test: fans out messages to recipients using every protocol usable with the game API (plus the
+ * demo protocols, which have no multicast support) with q2proto_server_multicast_fanout(), then decodes the
+ * bytes of each group with a client context for every recipient of the group and checks the decoded messages.
+ * Also checks that messages depending on per-client state are refused, and that game API specific messages
+ * are only written for recipients whose game API supports them.
+ */
+
+#if Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_RERELEASE
+    #define TEST_GAME_API Q2PROTO_GAME_RERELEASE
+#elif Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_Q2PRO_EXTENDED_V2
+    #define TEST_GAME_API Q2PROTO_GAME_Q2PRO_EXTENDED_V2
+#elif Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_Q2PRO_EXTENDED
+    #define TEST_GAME_API Q2PROTO_GAME_Q2PRO_EXTENDED
+#else
+    #define TEST_GAME_API Q2PROTO_GAME_VANILLA
+#endif
+
+// Demo protocols for the game API, in addition to the network protocols
+static const q2proto_protocol_t demo_protocols[] = {
+#if Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_RERELEASE
+    Q2P_PROTOCOL_KEX_DEMOS,
+    Q2P_PROTOCOL_KEX,
+#elif Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_Q2PRO_EXTENDED_V2
+    Q2P_PROTOCOL_Q2PRO_EXTENDED_DEMO_PLAYERFOG,
+#elif Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_Q2PRO_EXTENDED
+    Q2P_PROTOCOL_Q2PRO_EXTENDED_DEMO,
+#endif
+};
+
+// Temp entity types, from q2proto_internal_protocol.h
+#define TE_GUNSHOT            0
+#define TE_Q2PRO_DAMAGE_DEALT 128
+
+#define PACKET_LENGTH 1390
+#define MAX_RECIPIENTS (Q2P_NUM_PROTOCOLS * 2)
+
+static int failures;
+
+#define CHECK(COND, ...)         \
+    do {                         \
+        if (!(COND)) {           \
+            printf(__VA_ARGS__); \
+            printf("\n");        \
+            failures++;          \
+        }                        \
+    } while (0)
+
+static q2proto_server_info_t server_info;
+
+// A recipient: server context sending to it and client context decoding what was sent
+typedef struct recipient_s {
+    q2proto_protocol_t protocol;
+    q2proto_servercontext_t server_context;
+    q2proto_clientcontext_t client_context;
+} recipient_t;
+
+static recipient_t recipients[MAX_RECIPIENTS];
+static q2proto_servercontext_t *recipient_contexts[MAX_RECIPIENTS];
+static size_t num_recipients;
+
+// Set up a recipient, and have its client read the serverdata
+static bool add_recipient(const q2proto_server_info_t *recipient_server_info, q2proto_protocol_t protocol)
+{
+    recipient_t *recipient = &recipients[num_recipients];
+    recipient->protocol = protocol;
+
+    q2proto_connect_t connect;
+    memset(&connect, 0, sizeof(connect));
+    connect.protocol = protocol;
+    connect.qport = 1234;
+    connect.challenge = 5678;
+    connect.userinfo = q2proto_make_string("\\name\\multicast");
+    connect.packet_length = PACKET_LENGTH;
+    q2proto_error_t err = q2proto_complete_connect(&connect);
+    // Demo protocols can't be "connected", but are set up the same way
+    if (err == Q2P_ERR_SUCCESS || err == Q2P_ERR_PROTOCOL_NOT_SUPPORTED)
+        err = q2proto_init_servercontext(&recipient->server_context, recipient_server_info, &connect);
+    if (err == Q2P_ERR_SUCCESS)
+        err = q2proto_init_clientcontext(&recipient->client_context);
+    if (err != Q2P_ERR_SUCCESS) {
+        CHECK(false, "protocol %d: context init failed: %s", protocol, q2proto_error_string(err));
+        return false;
+    }
+
+    roundtrip_buffer_t buf;
+    if (!roundtrip_buffer_init(&buf, PACKET_LENGTH)) {
+        CHECK(false, "out of memory");
+        return false;
+    }
+    q2proto_svc_message_t message = {.type = Q2P_SVC_SERVERDATA, .serverdata = {0}};
+    err = q2proto_server_fill_serverdata(&recipient->server_context, &message.serverdata);
+    message.serverdata.servercount = 0x1234;
+    message.serverdata.gamedir = q2proto_make_string("baseq2");
+    message.serverdata.clientnum = 1;
+    message.serverdata.levelname = q2proto_make_string("multicast");
+    if (message.serverdata.server_fps == 0)
+        message.serverdata.server_fps = 10;
+    if (err == Q2P_ERR_SUCCESS)
+        err = q2proto_server_write(&recipient->server_context, roundtrip_io_arg(&buf), &message);
+    if (err == Q2P_ERR_SUCCESS) {
+        roundtrip_buffer_t read_buf;
+        roundtrip_buffer_init_read(&read_buf, buf.data, buf.size);
+        while (err == Q2P_ERR_SUCCESS)
+            err = q2proto_client_read(&recipient->client_context, roundtrip_io_arg(&read_buf), &message);
+        if (err == Q2P_ERR_NO_MORE_INPUT)
+            err = Q2P_ERR_SUCCESS;
+    }
+    roundtrip_buffer_free(&buf);
+    if (err != Q2P_ERR_SUCCESS) {
+        CHECK(false, "protocol %d: serverdata exchange failed: %s", protocol, q2proto_error_string(err));
+        return false;
+    }
+
+    recipient_contexts[num_recipients] = &recipient->server_context;
+    num_recipients++;
+    return true;
+}
+
+static bool string_equal(const q2proto_string_t *a, const q2proto_string_t *b)
+{
+    return a->len == b->len && (a->len == 0 || memcmp(a->str, b->str, a->len) == 0);
+}
+
+static bool vec3_equal(const q2proto_vec3_t a, const q2proto_vec3_t b)
+{
+    return a[0] == b[0] && a[1] == b[1] && a[2] == b[2];
+}
+
+// Check a message decoded by a recipient against the message that was fanned out
+static void check_decoded(const char *name, const recipient_t *recipient, const q2proto_svc_message_t *sent,
+                          const q2proto_svc_message_t *decoded)
+{
+    if (decoded->type != sent->type) {
+        CHECK(false, "%s, protocol %d: decoded message type %d, expected %d", name, recipient->protocol,
+              decoded->type, sent->type);
+        return;
+    }
+    switch (sent->type) {
+    case Q2P_SVC_PRINT:
+        CHECK(decoded->print.level == sent->print.level && string_equal(&decoded->print.string, &sent->print.string),
+              "%s, protocol %d: print mismatch", name, recipient->protocol);
+        break;
+    case Q2P_SVC_STUFFTEXT:
+        CHECK(string_equal(&decoded->stufftext.string, &sent->stufftext.string),
+              "%s, protocol %d: stufftext mismatch", name, recipient->protocol);
+        break;
+    case Q2P_SVC_CONFIGSTRING:
+        CHECK(decoded->configstring.index == sent->configstring.index
+                  && string_equal(&decoded->configstring.value, &sent->configstring.value),
+              "%s, protocol %d: configstring mismatch", name, recipient->protocol);
+        break;
+    case Q2P_SVC_TEMP_ENTITY:
+        CHECK(decoded->temp_entity.type == sent->temp_entity.type
+                  && vec3_equal(decoded->temp_entity.position1, sent->temp_entity.position1)
+                  && vec3_equal(decoded->temp_entity.direction, sent->temp_entity.direction)
+                  && decoded->temp_entity.count == sent->temp_entity.count,
+              "%s, protocol %d: temp entity mismatch", name, recipient->protocol);
+        break;
+    case Q2P_SVC_MUZZLEFLASH2:
+        CHECK(decoded->muzzleflash.entity == sent->muzzleflash.entity
+                  && decoded->muzzleflash.weapon == sent->muzzleflash.weapon,
+              "%s, protocol %d: muzzleflash2 mismatch", name, recipient->protocol);
+        break;
+    default:
+        CHECK(false, "%s: unexpected message type %d", name, sent->type);
+        break;
+    }
+}
+
+// Fan out a message to all recipients, decode each group's bytes for every recipient of the group
+static void test_fanout(const char *name, const q2proto_svc_message_t *message)
+{
+    roundtrip_buffer_t scratch;
+    if (!roundtrip_buffer_init(&scratch, PACKET_LENGTH)) {
+        CHECK(false, "out of memory");
+        return;
+    }
+    q2proto_multicast_group_t groups[MAX_RECIPIENTS];
+    size_t num_groups = 0;
+    size_t recipient_list[MAX_RECIPIENTS];
+    q2proto_error_t err = q2proto_server_multicast_fanout(recipient_contexts, num_recipients,
+                                                          roundtrip_io_arg(&scratch), message, groups,
+                                                          MAX_RECIPIENTS, &num_groups, recipient_list);
+    if (err != Q2P_ERR_SUCCESS) {
+        CHECK(false, "%s: fanout failed: %s", name, q2proto_error_string(err));
+        roundtrip_buffer_free(&scratch);
+        return;
+    }
+
+    size_t times_received[MAX_RECIPIENTS] = {0};
+    for (size_t g = 0; g < num_groups; g++) {
+        const q2proto_multicast_group_t *group = &groups[g];
+        for (size_t i = 0; i < group->num_recipients; i++) {
+            size_t r = recipient_list[group->first_recipient + i];
+            recipient_t *recipient = &recipients[r];
+            times_received[r]++;
+
+            roundtrip_buffer_t read_buf;
+            roundtrip_buffer_init_read(&read_buf, group->encoded.data, group->encoded.size);
+            q2proto_svc_message_t decoded;
+            err = q2proto_client_read(&recipient->client_context, roundtrip_io_arg(&read_buf), &decoded);
+            if (err != Q2P_ERR_SUCCESS) {
+                CHECK(false, "%s, protocol %d: decoding failed: %s", name, recipient->protocol,
+                      q2proto_error_string(err));
+                continue;
+            }
+            check_decoded(name, recipient, message, &decoded);
+            err = q2proto_client_read(&recipient->client_context, roundtrip_io_arg(&read_buf), &decoded);
+            CHECK(err == Q2P_ERR_NO_MORE_INPUT, "%s, protocol %d: trailing data after message", name,
+                  recipient->protocol);
+        }
+    }
+    for (size_t r = 0; r < num_recipients; r++)
+        CHECK(times_received[r] == 1, "%s, protocol %d: received %zu times", name, recipients[r].protocol,
+              times_received[r]);
+
+    roundtrip_buffer_free(&scratch);
+}
+
+// Fan out a message which can't be written for all recipients
+static void test_fanout_fails(const char *name, const q2proto_svc_message_t *message, q2proto_error_t expected_err)
+{
+    roundtrip_buffer_t scratch;
+    if (!roundtrip_buffer_init(&scratch, PACKET_LENGTH)) {
+        CHECK(false, "out of memory");
+        return;
+    }
+    q2proto_multicast_group_t groups[MAX_RECIPIENTS];
+    size_t num_groups = 0;
+    size_t recipient_list[MAX_RECIPIENTS];
+    q2proto_error_t err = q2proto_server_multicast_fanout(recipient_contexts, num_recipients,
+                                                          roundtrip_io_arg(&scratch), message, groups,
+                                                          MAX_RECIPIENTS, &num_groups, recipient_list);
+    CHECK(err == expected_err, "%s: fanout returned %s, expected %s", name, q2proto_error_string(err),
+          q2proto_error_string(expected_err));
+    roundtrip_buffer_free(&scratch);
+}
+
+int main(void)
+{
+    server_info.game_api = TEST_GAME_API;
+    server_info.default_packet_length = PACKET_LENGTH;
+
+    q2proto_protocol_t protocols[Q2P_NUM_PROTOCOLS];
+    size_t num_protocols = q2proto_get_protocols_for_gametypes(protocols, Q2P_NUM_PROTOCOLS, &server_info.game_api, 1);
+    // Two recipients per network protocol, to have groups with multiple recipients
+    for (size_t i = 0; i < num_protocols; i++) {
+        add_recipient(&server_info, protocols[i]);
+        add_recipient(&server_info, protocols[i]);
+    }
+    for (size_t i = 0; i < sizeof(demo_protocols) / sizeof(demo_protocols[0]); i++)
+        add_recipient(&server_info, demo_protocols[i]);
+
+    q2proto_svc_message_t print = {.type = Q2P_SVC_PRINT};
+    print.print.level = 2;
+    print.print.string = q2proto_make_string("multicast print\n");
+    test_fanout("print", &print);
+
+    q2proto_svc_message_t stufftext = {.type = Q2P_SVC_STUFFTEXT};
+    stufftext.stufftext.string = q2proto_make_string("echo multicast\n");
+    test_fanout("stufftext", &stufftext);
+
+    q2proto_svc_message_t configstring = {.type = Q2P_SVC_CONFIGSTRING};
+    configstring.configstring.index = 33;
+    configstring.configstring.value = q2proto_make_string("models/multicast.md2");
+    test_fanout("configstring", &configstring);
+
+    q2proto_svc_message_t temp_entity = {.type = Q2P_SVC_TEMP_ENTITY};
+    temp_entity.temp_entity.type = TE_GUNSHOT;
+    temp_entity.temp_entity.position1[0] = 128;
+    temp_entity.temp_entity.position1[1] = -256.5f;
+    temp_entity.temp_entity.position1[2] = 32.125f;
+    temp_entity.temp_entity.direction[2] = 1;
+    test_fanout("temp entity", &temp_entity);
+
+    q2proto_svc_message_t muzzleflash2 = {.type = Q2P_SVC_MUZZLEFLASH2};
+    muzzleflash2.muzzleflash.entity = 17;
+    muzzleflash2.muzzleflash.weapon = 42;
+    test_fanout("muzzleflash2", &muzzleflash2);
+
+    /* Q2PRO-specific temp entity: the "short" multicast protocol is shared by vanilla and Q2PRO extended games,
+     * so it can only be written if the game API is known to support it */
+    q2proto_svc_message_t damage_dealt = {.type = Q2P_SVC_TEMP_ENTITY};
+    damage_dealt.temp_entity.type = TE_Q2PRO_DAMAGE_DEALT;
+    damage_dealt.temp_entity.count = 25;
+    {
+        roundtrip_buffer_t scratch;
+        if (roundtrip_buffer_init(&scratch, PACKET_LENGTH)) {
+            q2proto_error_t err =
+                q2proto_server_multicast_write(Q2P_PROTOCOL_MULTICAST_SHORT, roundtrip_io_arg(&scratch), &damage_dealt);
+            CHECK(err == Q2P_ERR_BAD_DATA, "q2pro temp entity: multicast write returned %s, expected bad data",
+                  q2proto_error_string(err));
+            roundtrip_buffer_free(&scratch);
+        } else
+            CHECK(false, "out of memory");
+    }
+#if Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_Q2PRO_EXTENDED \
+    || Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_Q2PRO_EXTENDED_V2
+    test_fanout("q2pro temp entity", &damage_dealt);
+    // Mix in recipients of a vanilla game
+    static q2proto_server_info_t vanilla_server_info;
+    vanilla_server_info.game_api = Q2PROTO_GAME_VANILLA;
+    vanilla_server_info.default_packet_length = PACKET_LENGTH;
+    add_recipient(&vanilla_server_info, Q2P_PROTOCOL_Q2PRO);
+    add_recipient(&vanilla_server_info, Q2P_PROTOCOL_VANILLA);
+    test_fanout("print, mixed game APIs", &print);
+    test_fanout_fails("q2pro temp entity, mixed game APIs", &damage_dealt, Q2P_ERR_BAD_DATA);
+#else
+    test_fanout_fails("q2pro temp entity", &damage_dealt, Q2P_ERR_BAD_DATA);
+#endif
+
+    q2proto_svc_message_t frame = {.type = Q2P_SVC_FRAME};
+    frame.frame.serverframe = 1;
+    frame.frame.deltaframe = -1;
+    test_fanout_fails("frame", &frame, Q2P_ERR_INVALID_ARGUMENT);
+
+    q2proto_svc_message_t entity_delta = {.type = Q2P_SVC_FRAME_ENTITY_DELTA};
+    entity_delta.frame_entity_delta.newnum = 1;
+    test_fanout_fails("frame entity delta", &entity_delta, Q2P_ERR_INVALID_ARGUMENT);
+
+    q2proto_svc_message_t serverdata = {.type = Q2P_SVC_SERVERDATA};
+    test_fanout_fails("serverdata", &serverdata, Q2P_ERR_INVALID_ARGUMENT);
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,304 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "q2proto/q2proto.h"
+
+#include "../roundtrip/roundtrip_state.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * "Pack if changed" test: for every protocol usable with the game APIs supported by the build flavor, check that
+ * the generated function
+ * - packs on first use of a zeroed cache, and again after the cache was zeroed,
+ * - reports no change, and leaves the packed state alone, if the entity state is unchanged,
+ * - reports a change if any single field of the entity state changed, even if just in the least significant bit
+ *   of a float,
+ * - reports a change if the packing flavor or game API differ from the previous call,
+ * and that the packed state is always the same as the one produced by the regular packing function.
+ */
+
+#define MAX_CONTEXTS (Q2P_NUM_PROTOCOLS * 4)
+
+static int failures;
+
+// Contexts reference the server info, so keep one per game API around
+static q2proto_server_info_t server_infos[TEST_GAME_API + 1];
+static q2proto_servercontext_t contexts[MAX_CONTEXTS];
+static char context_names[MAX_CONTEXTS][32];
+static size_t num_contexts;
+
+#define CHECK(COND, ...)         \
+    do {                         \
+        if (!(COND)) {           \
+            printf(__VA_ARGS__); \
+            printf("\n");        \
+            failures++;          \
+        }                        \
+    } while (0)
+
+static uint64_t rng_state = 0x2545f4914f6cdd1dULL;
+
+static uint32_t rng_next(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t)(rng_state >> 16);
+}
+
+static int32_t random_range(int32_t min, int32_t max) { return min + (int32_t)(rng_next() % (uint32_t)(max - min + 1)); }
+
+static void random_entity(roundtrip_entity_state_t *ent)
+{
+    memset(ent, 0, sizeof(*ent));
+    ent->modelindex = random_range(1, 255);
+    ent->modelindex2 = random_range(0, 255);
+    ent->modelindex3 = random_range(0, 255);
+    ent->modelindex4 = random_range(0, 255);
+    ent->frame = random_range(0, 255);
+    ent->skinnum = random_range(0, 15);
+    ent->effects = random_range(0, 0xffff);
+    ent->renderfx = random_range(0, 0xffff);
+    for (int i = 0; i < 3; i++) {
+        ent->origin[i] = random_range(-32768, 32767) / 8.0f;
+        ent->angles[i] = random_range(0, 359);
+        ent->old_origin[i] = random_range(-32768, 32767) / 8.0f;
+    }
+    ent->sound = random_range(0, 255);
+    ent->loop_volume = random_range(0, 255) / 255.0f;
+    ent->loop_attenuation = random_range(0, 255) / 64.0f;
+    ent->event = random_range(0, 8);
+    ent->solid = random_range(0, 0xffff);
+    ent->alpha = random_range(1, 255) / 255.0f;
+    ent->scale = random_range(1, 255) / 64.0f;
+}
+
+// Change the least significant bit of a float
+static void nudge_float(float *f)
+{
+    uint32_t bits;
+    memcpy(&bits, f, sizeof(bits));
+    bits ^= 1;
+    memcpy(f, &bits, sizeof(bits));
+}
+
+/* Change one field of an entity state, selected by index.
+ * Returns the field name, or NULL if the index is past the last field. */
+static const char *change_field(roundtrip_entity_state_t *ent, int field)
+{
+    switch (field) {
+    case 0:
+        ent->modelindex++;
+        return "modelindex";
+    case 1:
+        ent->modelindex2++;
+        return "modelindex2";
+    case 2:
+        ent->modelindex3++;
+        return "modelindex3";
+    case 3:
+        ent->modelindex4++;
+        return "modelindex4";
+    case 4:
+        ent->frame++;
+        return "frame";
+    case 5:
+        ent->skinnum++;
+        return "skinnum";
+    case 6:
+        ent->effects ^= 1;
+        return "effects";
+    case 7:
+        ent->renderfx ^= 1;
+        return "renderfx";
+    case 8:
+    case 9:
+    case 10:
+        nudge_float(&ent->origin[field - 8]);
+        return "origin";
+    case 11:
+    case 12:
+    case 13:
+        nudge_float(&ent->angles[field - 11]);
+        return "angles";
+    case 14:
+    case 15:
+    case 16:
+        nudge_float(&ent->old_origin[field - 14]);
+        return "old_origin";
+    case 17:
+        ent->sound++;
+        return "sound";
+    case 18:
+        ent->event ^= 1;
+        return "event";
+    case 19:
+        ent->solid ^= 1;
+        return "solid";
+#if Q2PROTO_ENTITY_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_ENTITY_LOOP_ALPHA_SCALE_FX64
+    case 20:
+        ent->effects ^= 1ull << 40;
+        return "effects (upper bits)";
+    case 21:
+        nudge_float(&ent->loop_volume);
+        return "loop_volume";
+    case 22:
+        nudge_float(&ent->loop_attenuation);
+        return "loop_attenuation";
+    case 23:
+        nudge_float(&ent->alpha);
+        return "alpha";
+    case 24:
+        nudge_float(&ent->scale);
+        return "scale";
+#endif
+    }
+    return NULL;
+}
+
+static void check_pack(const char *name, const char *what, q2proto_servercontext_t *context,
+                       const roundtrip_entity_state_t *ent, q2proto_entity_pack_cache_t *cache,
+                       q2proto_packed_entity_state_t *packed, bool expect_changed)
+{
+    q2proto_packed_entity_state_t previous;
+    memcpy(&previous, packed, sizeof(previous));
+    bool changed = roundtrip_pack_entity_if_changed(context, ent, cache, packed);
+    CHECK(changed == expect_changed, "%s: %s: reported %s", name, what, changed ? "changed" : "unchanged");
+    if (!changed)
+        CHECK(memcmp(packed, &previous, sizeof(previous)) == 0, "%s: %s: packed state modified, but reported unchanged",
+              name, what);
+
+    q2proto_packed_entity_state_t expected;
+    roundtrip_pack_entity(context, ent, &expected);
+    CHECK(memcmp(packed, &expected, sizeof(expected)) == 0, "%s: %s: packed state differs from regular packing", name,
+          what);
+}
+
+static void test_fields(const char *name, q2proto_servercontext_t *context)
+{
+    roundtrip_entity_state_t ent;
+    random_entity(&ent);
+    q2proto_entity_pack_cache_t cache;
+    memset(&cache, 0, sizeof(cache));
+    q2proto_packed_entity_state_t packed;
+    memset(&packed, 0, sizeof(packed));
+
+    check_pack(name, "first pack", context, &ent, &cache, &packed, true);
+    check_pack(name, "unchanged", context, &ent, &cache, &packed, false);
+    const char *field;
+    for (int i = 0; (field = change_field(&ent, i)) != NULL; i++) {
+        check_pack(name, field, context, &ent, &cache, &packed, true);
+        check_pack(name, field, context, &ent, &cache, &packed, false);
+    }
+
+    memset(&cache, 0, sizeof(cache));
+    check_pack(name, "cache reset", context, &ent, &cache, &packed, true);
+    check_pack(name, "cache reset", context, &ent, &cache, &packed, false);
+
+    // An all-zero entity state must be packed as well
+    memset(&ent, 0, sizeof(ent));
+    memset(&cache, 0, sizeof(cache));
+    memset(&packed, 0xff, sizeof(packed));
+    check_pack(name, "zero state", context, &ent, &cache, &packed, true);
+}
+
+// Switch between contexts with the same cache: must repack if packing flavor or game API differ
+static void test_context_switch(void)
+{
+    roundtrip_entity_state_t ent;
+    random_entity(&ent);
+    int num_switches = 0, num_flavor_switches = 0;
+    for (size_t a = 0; a < num_contexts; a++) {
+        q2proto_game_api_t game_api_a;
+        _q2proto_packing_flavor_t flavor_a = _q2proto_get_packing_flavor(&contexts[a], &game_api_a);
+        for (size_t b = 0; b < num_contexts; b++) {
+            q2proto_game_api_t game_api_b;
+            _q2proto_packing_flavor_t flavor_b = _q2proto_get_packing_flavor(&contexts[b], &game_api_b);
+            bool expect_changed = flavor_a != flavor_b || game_api_a != game_api_b;
+            char what[48];
+            snprintf(what, sizeof(what), "switch from %.31s", context_names[a]);
+
+            q2proto_entity_pack_cache_t cache;
+            memset(&cache, 0, sizeof(cache));
+            q2proto_packed_entity_state_t packed;
+            memset(&packed, 0, sizeof(packed));
+            check_pack(context_names[a], "first pack", &contexts[a], &ent, &cache, &packed, true);
+            check_pack(context_names[b], what, &contexts[b], &ent, &cache, &packed, expect_changed);
+            if (expect_changed)
+                num_switches++;
+            if (flavor_a != flavor_b && game_api_a == game_api_b)
+                num_flavor_switches++;
+        }
+    }
+    // Vanilla builds only have one game API, and all protocols pack the same
+    CHECK(num_switches > 0 || TEST_GAME_API == Q2PROTO_GAME_VANILLA,
+          "no context switches changing packing flavor or game API");
+    // Only the rerelease game API can be used with different packing flavors
+    CHECK(num_flavor_switches > 0 || TEST_GAME_API != Q2PROTO_GAME_RERELEASE,
+          "no context switches changing just the packing flavor");
+}
+
+static void add_context(q2proto_error_t err)
+{
+    if (err != Q2P_ERR_SUCCESS) {
+        CHECK(false, "%s: context init failed: %s", context_names[num_contexts], q2proto_error_string(err));
+        return;
+    }
+    test_fields(context_names[num_contexts], &contexts[num_contexts]);
+    num_contexts++;
+}
+
+int main(void)
+{
+    // All game APIs up to the one matching the build flavor
+    for (int game_api = Q2PROTO_GAME_VANILLA; game_api <= TEST_GAME_API; game_api++) {
+        q2proto_server_info_t *server_info = &server_infos[game_api];
+        server_info->game_api = game_api;
+        server_info->default_packet_length = 1400;
+
+        q2proto_protocol_t protocols[Q2P_NUM_PROTOCOLS];
+        size_t num_protocols =
+            q2proto_get_protocols_for_gametypes(protocols, Q2P_NUM_PROTOCOLS, &server_info->game_api, 1);
+        for (size_t p = 0; p < num_protocols && num_contexts < MAX_CONTEXTS; p++) {
+            size_t max_msg_len;
+            snprintf(context_names[num_contexts], sizeof(context_names[num_contexts]), "game API %d, protocol %d",
+                     game_api, protocols[p]);
+            add_context(
+                q2proto_init_servercontext_demo(&contexts[num_contexts], protocols[p], server_info, &max_msg_len));
+        }
+    }
+#if Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_RERELEASE
+    // KEX demos aren't in the protocol list, but pack differently from the other rerelease protocol
+    q2proto_connect_t connect;
+    memset(&connect, 0, sizeof(connect));
+    connect.protocol = Q2P_PROTOCOL_KEX_DEMOS;
+    connect.packet_length = 1400;
+    snprintf(context_names[num_contexts], sizeof(context_names[num_contexts]), "KEX demo");
+    add_context(q2proto_init_servercontext(&contexts[num_contexts], &server_infos[Q2PROTO_GAME_RERELEASE], &connect));
+#endif
+    if (num_contexts == 0) {
+        printf("no protocols for game API\n");
+        return 1;
+    }
+
+    test_context_switch();
+
+    return failures == 0 ? 0 : 1;
+}
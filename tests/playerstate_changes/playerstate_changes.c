@@ -0,0 +1,155 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "q2proto_internal_packing.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Randomized equivalence test: compare the player state changes, as determined by
+ * q2proto_packing_player_state_changes(), with a straightforward field-by-field comparison.
+ */
+
+#define NUM_ITERATIONS 100000
+
+static uint64_t rng_state = 0x2545f4914f6cdd1dULL;
+
+static uint32_t rng_next(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t)(rng_state >> 16);
+}
+
+static unsigned compare_components(const void *from, const void *to, size_t comp_size, size_t num_comps)
+{
+    unsigned result = 0;
+    for (size_t c = 0; c < num_comps; c++) {
+        if (memcmp((const char *)from + c * comp_size, (const char *)to + c * comp_size, comp_size) != 0)
+            result |= BIT(c);
+    }
+    return result;
+}
+
+static void reference_changes(const q2proto_packed_player_state_t *from, const q2proto_packed_player_state_t *to,
+                              q2proto_player_state_changes_t *changes)
+{
+    memset(changes, 0, sizeof(*changes));
+
+    if (to->pm_type != from->pm_type)
+        changes->delta_bits |= Q2P_PSD_PM_TYPE;
+    if (to->pm_time != from->pm_time)
+        changes->delta_bits |= Q2P_PSD_PM_TIME;
+    if (to->pm_flags != from->pm_flags)
+        changes->delta_bits |= Q2P_PSD_PM_FLAGS;
+    if (to->pm_gravity != from->pm_gravity)
+        changes->delta_bits |= Q2P_PSD_PM_GRAVITY;
+    if (memcmp(to->pm_delta_angles, from->pm_delta_angles, sizeof(to->pm_delta_angles)) != 0)
+        changes->delta_bits |= Q2P_PSD_PM_DELTA_ANGLES;
+    if (memcmp(to->viewoffset, from->viewoffset, sizeof(to->viewoffset)) != 0)
+        changes->delta_bits |= Q2P_PSD_VIEWOFFSET;
+    if (memcmp(to->kick_angles, from->kick_angles, sizeof(to->kick_angles)) != 0)
+        changes->delta_bits |= Q2P_PSD_KICKANGLES;
+    if (to->gunindex != from->gunindex)
+        changes->delta_bits |= Q2P_PSD_GUNINDEX;
+    if (to->gunframe != from->gunframe)
+        changes->delta_bits |= Q2P_PSD_GUNFRAME;
+    if (to->fov != from->fov)
+        changes->delta_bits |= Q2P_PSD_FOV;
+    if (to->rdflags != from->rdflags)
+        changes->delta_bits |= Q2P_PSD_RDFLAGS;
+#if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_GUNRATE_VIEWHEIGHT
+    if (to->pm_viewheight != from->pm_viewheight)
+        changes->delta_bits |= Q2P_PSD_PM_VIEWHEIGHT;
+    if (to->gunrate != from->gunrate)
+        changes->delta_bits |= Q2P_PSD_GUNRATE;
+#endif
+#if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_GUNSKIN
+    if (to->gunskin != from->gunskin)
+        changes->delta_bits |= Q2P_PSD_GUNSKIN;
+#endif
+
+    changes->viewangles = compare_components(from->viewangles, to->viewangles, sizeof(to->viewangles[0]), 3);
+    changes->gunoffset = compare_components(from->gunoffset, to->gunoffset, sizeof(to->gunoffset[0]), 3);
+    changes->gunangles = compare_components(from->gunangles, to->gunangles, sizeof(to->gunangles[0]), 3);
+    changes->blend = compare_components(from->blend, to->blend, sizeof(to->blend[0]), 4);
+#if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_DAMAGE_BLEND
+    changes->damage_blend = compare_components(from->damage_blend, to->damage_blend, sizeof(to->damage_blend[0]), 4);
+#endif
+
+    for (int i = 0; i < Q2PROTO_STATS; i++) {
+        if (to->stats[i] != from->stats[i])
+            changes->statbits |= BIT_ULL(i);
+    }
+
+#if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_FOG
+    changes->fog_color = compare_components(from->fog_color, to->fog_color, 1, 3);
+    changes->heightfog_start_color =
+        compare_components(from->heightfog_start_color, to->heightfog_start_color, 1, 3);
+    changes->heightfog_end_color = compare_components(from->heightfog_end_color, to->heightfog_end_color, 1, 3);
+    if (to->fog_density != from->fog_density || to->fog_skyfactor != from->fog_skyfactor)
+        changes->fog_flags |= Q2P_FOG_DENSITY_SKYFACTOR;
+    if (to->heightfog_density != from->heightfog_density)
+        changes->fog_flags |= Q2P_HEIGHTFOG_DENSITY;
+    if (to->heightfog_falloff != from->heightfog_falloff)
+        changes->fog_flags |= Q2P_HEIGHTFOG_FALLOFF;
+    if (to->heightfog_start_dist != from->heightfog_start_dist)
+        changes->fog_flags |= Q2P_HEIGHTFOG_START_DIST;
+    if (to->heightfog_end_dist != from->heightfog_end_dist)
+        changes->fog_flags |= Q2P_HEIGHTFOG_END_DIST;
+#endif
+}
+
+static void random_bytes(void *p, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        ((uint8_t *)p)[i] = (uint8_t)rng_next();
+}
+
+int main(int argc, char **argv)
+{
+    int failures = 0;
+
+    for (int i = 0; i < NUM_ITERATIONS; i++) {
+        q2proto_packed_player_state_t from, to;
+        random_bytes(&from, sizeof(from));
+        memcpy(&to, &from, sizeof(to));
+        // Mostly flip a few random bits, as for typical frame-to-frame changes; sometimes change everything
+        if (rng_next() % 16 != 0) {
+            unsigned num_changes = rng_next() % 8;
+            for (unsigned c = 0; c < num_changes; c++)
+                ((uint8_t *)&to)[rng_next() % sizeof(to)] ^= (uint8_t)BIT(rng_next() % 8);
+        } else
+            random_bytes(&to, sizeof(to));
+
+        q2proto_player_state_changes_t expected, actual;
+        reference_changes(&from, &to, &expected);
+        q2proto_packing_player_state_changes(&from, &to, &actual);
+        if (memcmp(&expected, &actual, sizeof(expected)) != 0) {
+            printf("iteration %d: mismatch (delta_bits %08x/%08x, statbits %016llx/%016llx)\n", i,
+                   expected.delta_bits, actual.delta_bits, (unsigned long long)expected.statbits,
+                   (unsigned long long)actual.statbits);
+            if (++failures >= 10)
+                break;
+        }
+    }
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,380 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "q2proto/q2proto.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Regression checks for fixed library issues.
+ * Each check runs for all protocols supported by the game API of the build flavor.
+ */
+
+#define MAX_OUTPUT    0x10000
+#define PACKET_LENGTH 1390
+
+#if Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_RERELEASE
+    #define TEST_GAME_API Q2PROTO_GAME_RERELEASE
+#elif Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_Q2PRO_EXTENDED_V2
+    #define TEST_GAME_API Q2PROTO_GAME_Q2PRO_EXTENDED_V2
+#elif Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_Q2PRO_EXTENDED
+    #define TEST_GAME_API Q2PROTO_GAME_Q2PRO_EXTENDED
+#else
+    #define TEST_GAME_API Q2PROTO_GAME_VANILLA
+#endif
+
+// Demo protocols for the game API, in addition to the network protocols
+static const q2proto_protocol_t demo_protocols[] = {
+#if Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_RERELEASE
+    Q2P_PROTOCOL_KEX_DEMOS,
+    Q2P_PROTOCOL_KEX,
+#elif Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_Q2PRO_EXTENDED_V2
+    Q2P_PROTOCOL_Q2PRO_EXTENDED_V2_DEMO,
+    Q2P_PROTOCOL_Q2PRO_EXTENDED_DEMO_PLAYERFOG,
+#elif Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_Q2PRO_EXTENDED
+    Q2P_PROTOCOL_Q2PRO_EXTENDED_DEMO,
+#else
+    Q2P_PROTOCOL_VANILLA,
+#endif
+};
+
+typedef struct test_io_s {
+    uint8_t data[MAX_OUTPUT];
+    size_t size;
+    size_t limit;
+    size_t pos;
+    q2proto_error_t err;
+} test_io_t;
+
+static void test_io_reset(test_io_t *io, size_t limit)
+{
+    io->size = 0;
+    io->limit = limit;
+    io->pos = 0;
+    io->err = Q2P_ERR_SUCCESS;
+}
+
+static void *test_io_reserve(uintptr_t io_arg, size_t size)
+{
+    test_io_t *io = (test_io_t *)io_arg;
+    if (size > io->limit - io->size) {
+        io->err = Q2P_ERR_NOT_ENOUGH_PACKET_SPACE;
+        return NULL;
+    }
+    void *p = io->data + io->size;
+    io->size += size;
+    return p;
+}
+
+void q2protoio_write_u8(uintptr_t io_arg, uint8_t x)
+{
+    uint8_t *p = test_io_reserve(io_arg, 1);
+    if (p)
+        p[0] = x;
+}
+
+void q2protoio_write_u16(uintptr_t io_arg, uint16_t x)
+{
+    uint8_t *p = test_io_reserve(io_arg, 2);
+    if (p) {
+        p[0] = x & 0xff;
+        p[1] = x >> 8;
+    }
+}
+
+void q2protoio_write_u32(uintptr_t io_arg, uint32_t x)
+{
+    q2protoio_write_u16(io_arg, x & 0xffff);
+    q2protoio_write_u16(io_arg, x >> 16);
+}
+
+void q2protoio_write_u64(uintptr_t io_arg, uint64_t x)
+{
+    q2protoio_write_u32(io_arg, x & 0xffffffff);
+    q2protoio_write_u32(io_arg, x >> 32);
+}
+
+void *q2protoio_write_reserve_raw(uintptr_t io_arg, size_t size) { return test_io_reserve(io_arg, size); }
+
+void q2protoio_write_raw(uintptr_t io_arg, const void *data, size_t size, size_t *written)
+{
+    test_io_t *io = (test_io_t *)io_arg;
+    size_t n = size;
+    if (written && n > io->limit - io->size)
+        n = io->limit - io->size;
+    void *p = test_io_reserve(io_arg, n);
+    if (p && n > 0)
+        memcpy(p, data, n);
+    if (written)
+        *written = p ? n : 0;
+}
+
+size_t q2protoio_write_available(uintptr_t io_arg)
+{
+    test_io_t *io = (test_io_t *)io_arg;
+    return io->limit - io->size;
+}
+
+static const uint8_t *test_io_read(uintptr_t io_arg, size_t size)
+{
+    test_io_t *io = (test_io_t *)io_arg;
+    if (size > io->size - io->pos) {
+        io->pos = io->size;
+        io->err = Q2P_ERR_IO_READ;
+        return NULL;
+    }
+    const uint8_t *p = io->data + io->pos;
+    io->pos += size;
+    return p;
+}
+
+uint8_t q2protoio_read_u8(uintptr_t io_arg)
+{
+    const uint8_t *p = test_io_read(io_arg, 1);
+    return p ? p[0] : (uint8_t)-1;
+}
+
+uint16_t q2protoio_read_u16(uintptr_t io_arg)
+{
+    const uint8_t *p = test_io_read(io_arg, 2);
+    return p ? (uint16_t)(p[0] | (p[1] << 8)) : (uint16_t)-1;
+}
+
+uint32_t q2protoio_read_u32(uintptr_t io_arg)
+{
+    const uint8_t *p = test_io_read(io_arg, 4);
+    return p ? p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24) : (uint32_t)-1;
+}
+
+uint64_t q2protoio_read_u64(uintptr_t io_arg)
+{
+    uint64_t lo = q2protoio_read_u32(io_arg);
+    uint64_t hi = q2protoio_read_u32(io_arg);
+    return lo | (hi << 32);
+}
+
+q2proto_string_t q2protoio_read_string(uintptr_t io_arg)
+{
+    test_io_t *io = (test_io_t *)io_arg;
+    q2proto_string_t str = {.str = NULL, .len = 0};
+    const uint8_t *end = memchr(io->data + io->pos, 0, io->size - io->pos);
+    if (!end) {
+        io->pos = io->size;
+        io->err = Q2P_ERR_IO_READ;
+        return str;
+    }
+    str.str = (const char *)io->data + io->pos;
+    str.len = end - (io->data + io->pos);
+    io->pos += str.len + 1;
+    return str;
+}
+
+const void *q2protoio_read_raw(uintptr_t io_arg, size_t size, size_t *readcount)
+{
+    test_io_t *io = (test_io_t *)io_arg;
+    size_t n = size;
+    if (readcount && n > io->size - io->pos)
+        n = io->size - io->pos;
+    const void *p = test_io_read(io_arg, n);
+    if (readcount)
+        *readcount = p ? n : 0;
+    return p;
+}
+
+size_t q2protoio_read_available(uintptr_t io_arg)
+{
+    test_io_t *io = (test_io_t *)io_arg;
+    return io->size - io->pos;
+}
+
+q2proto_error_t q2protoio_get_error(uintptr_t io_arg)
+{
+    test_io_t *io = (test_io_t *)io_arg;
+    q2proto_error_t err = io->err;
+    io->err = Q2P_ERR_SUCCESS;
+    return err;
+}
+
+static int failures = 0;
+
+#define CHECK(COND, ...)          \
+    do {                          \
+        if (!(COND)) {            \
+            printf(__VA_ARGS__);  \
+            printf("\n");         \
+            failures++;           \
+        }                         \
+    } while (0)
+
+static test_io_t io;
+static q2proto_server_info_t server_info;
+
+static q2proto_error_t init_server_context(q2proto_servercontext_t *context, q2proto_protocol_t protocol)
+{
+    q2proto_connect_t connect;
+    memset(&connect, 0, sizeof(connect));
+    connect.protocol = protocol;
+    connect.qport = 1234;
+    connect.challenge = 5678;
+    connect.userinfo = q2proto_make_string("\\name\\regression");
+    connect.packet_length = PACKET_LENGTH;
+    q2proto_error_t err = q2proto_complete_connect(&connect);
+    // Demo protocols can't be "connected", but are set up the same way
+    if (err != Q2P_ERR_SUCCESS && err != Q2P_ERR_PROTOCOL_NOT_SUPPORTED)
+        return err;
+    return q2proto_init_servercontext(context, &server_info, &connect);
+}
+
+// Write serverdata with the server context, read it with the client context
+static q2proto_error_t exchange_serverdata(q2proto_servercontext_t *server_context,
+                                           q2proto_clientcontext_t *client_context)
+{
+    q2proto_svc_message_t message = {.type = Q2P_SVC_SERVERDATA, .serverdata = {0}};
+    q2proto_error_t err = q2proto_server_fill_serverdata(server_context, &message.serverdata);
+    if (err != Q2P_ERR_SUCCESS)
+        return err;
+    message.serverdata.servercount = 0x1234;
+    message.serverdata.gamedir = q2proto_make_string("baseq2");
+    message.serverdata.clientnum = 1;
+    message.serverdata.levelname = q2proto_make_string("regression");
+    if (message.serverdata.server_fps == 0)
+        message.serverdata.server_fps = 10;
+
+    test_io_reset(&io, PACKET_LENGTH);
+    err = q2proto_server_write(server_context, (uintptr_t)&io, &message);
+    if (err != Q2P_ERR_SUCCESS)
+        return err;
+    return q2proto_client_read(client_context, (uintptr_t)&io, &message);
+}
+
+/* The Q2PRO, Q2PRO extended demo and Q2rePRO readers decoded the gun skin,
+ * but did not set Q2P_PSD_GUNSKIN. */
+static void check_gunskin_delta(q2proto_protocol_t protocol)
+{
+    q2proto_servercontext_t server_context;
+    q2proto_clientcontext_t client_context;
+    if (init_server_context(&server_context, protocol) != Q2P_ERR_SUCCESS
+        || q2proto_init_clientcontext(&client_context) != Q2P_ERR_SUCCESS
+        || exchange_serverdata(&server_context, &client_context) != Q2P_ERR_SUCCESS)
+    {
+        printf("gunskin: protocol %d: setup failed\n", protocol);
+        failures++;
+        return;
+    }
+
+    static const uint8_t areabits[4];
+    q2proto_svc_message_t message = {.type = Q2P_SVC_FRAME, .frame = {0}};
+    message.frame.serverframe = 1;
+    message.frame.deltaframe = -1;
+    message.frame.areabits_len = sizeof(areabits);
+    message.frame.areabits = areabits;
+    message.frame.playerstate.delta_bits = Q2P_PSD_GUNINDEX;
+    message.frame.playerstate.gunindex = 5;
+#if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_GUNSKIN
+    message.frame.playerstate.delta_bits |= Q2P_PSD_GUNSKIN;
+    message.frame.playerstate.gunskin = 3;
+#endif
+    test_io_reset(&io, PACKET_LENGTH);
+    q2proto_error_t err = q2proto_server_write(&server_context, (uintptr_t)&io, &message);
+    CHECK(err == Q2P_ERR_SUCCESS, "gunskin: protocol %d: writing frame failed: %s", protocol,
+          q2proto_error_string(err));
+
+    memset(&message, 0, sizeof(message));
+    err = q2proto_client_read(&client_context, (uintptr_t)&io, &message);
+    CHECK(err == Q2P_ERR_SUCCESS && message.type == Q2P_SVC_FRAME, "gunskin: protocol %d: reading frame failed: %s",
+          protocol, q2proto_error_string(err));
+    CHECK(message.frame.playerstate.gunindex == 5 && (message.frame.playerstate.delta_bits & Q2P_PSD_GUNINDEX),
+          "gunskin: protocol %d: gun index not read", protocol);
+#if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_GUNSKIN
+    // Protocols without gun skin support are expected to drop it
+    if (message.frame.playerstate.gunskin != 0)
+        CHECK(message.frame.playerstate.delta_bits & Q2P_PSD_GUNSKIN, "gunskin: protocol %d: delta bit not set",
+              protocol);
+#endif
+}
+
+/* KEX demo contexts announced PROTOCOL_KEX in serverdata,
+ * so their demos were read with the wrong coordinate encoding. */
+static void check_serverdata_protocol(q2proto_protocol_t protocol)
+{
+    if (protocol == Q2P_PROTOCOL_Q2PRO_EXTENDED_V2_DEMO)
+        return; // always written as the current extended demo version
+
+    q2proto_servercontext_t server_context;
+    if (init_server_context(&server_context, protocol) != Q2P_ERR_SUCCESS) {
+        printf("serverdata: protocol %d: setup failed\n", protocol);
+        failures++;
+        return;
+    }
+
+    q2proto_svc_serverdata_t serverdata;
+    memset(&serverdata, 0, sizeof(serverdata));
+    q2proto_error_t err = q2proto_server_fill_serverdata(&server_context, &serverdata);
+    CHECK(err == Q2P_ERR_SUCCESS, "serverdata: protocol %d: filling serverdata failed: %s", protocol,
+          q2proto_error_string(err));
+    int netver = q2proto_get_protocol_netver(protocol);
+    CHECK(serverdata.protocol == netver, "serverdata: protocol %d: announced version %d, expected %d", protocol,
+          serverdata.protocol, netver);
+}
+
+/* q2protoio_write_string() wrote through a NULL pointer when the output buffer was full. */
+static void check_string_overflow(q2proto_protocol_t protocol)
+{
+    q2proto_servercontext_t server_context;
+    if (init_server_context(&server_context, protocol) != Q2P_ERR_SUCCESS) {
+        printf("string overflow: protocol %d: setup failed\n", protocol);
+        failures++;
+        return;
+    }
+
+    q2proto_svc_message_t message = {.type = Q2P_SVC_PRINT, .print = {0}};
+    message.print.level = 2;
+    message.print.string = q2proto_make_string("this string does not fit");
+    test_io_reset(&io, 8);
+    q2proto_error_t err = q2proto_server_write(&server_context, (uintptr_t)&io, &message);
+    CHECK(err != Q2P_ERR_SUCCESS, "string overflow: protocol %d: write succeeded", protocol);
+}
+
+static void check_protocol(q2proto_protocol_t protocol)
+{
+    check_gunskin_delta(protocol);
+    check_serverdata_protocol(protocol);
+    check_string_overflow(protocol);
+}
+
+int main(void)
+{
+    server_info.game_api = TEST_GAME_API;
+    server_info.default_packet_length = PACKET_LENGTH;
+
+    q2proto_protocol_t protocols[Q2P_NUM_PROTOCOLS];
+    size_t num_protocols = q2proto_get_protocols_for_gametypes(protocols, Q2P_NUM_PROTOCOLS, &server_info.game_api, 1);
+    for (size_t i = 0; i < num_protocols; i++)
+        check_protocol(protocols[i]);
+    for (size_t i = 0; i < sizeof(demo_protocols) / sizeof(demo_protocols[0]); i++) {
+        bool is_network = false;
+        for (size_t j = 0; j < num_protocols; j++)
+            is_network |= demo_protocols[i] == protocols[j];
+        if (!is_network)
+            check_protocol(demo_protocols[i]);
+    }
+
+    return failures == 0 ? 0 : 1;
+}
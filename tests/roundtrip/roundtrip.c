@@ -0,0 +1,1230 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "q2proto/q2proto.h"
+
+#include "roundtrip_io.h"
+#include "roundtrip_state.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Round trip test: for every protocol usable with the game API, generate a randomized, but valid,
+ * message stream (serverdata, gamestate, frames interspersed with other messages) with
+ * q2proto_server_write(), then read it back with q2proto_client_read() and check that the client
+ * arrives at the same state the server wrote. The stream is also read back with a client context state
+ * saved after the first frame and restored into a new context, which must decode the rest identically.
+ * Frames, entity deltas and baselines are checked on the state level: the client applies the deltas
+ * it reads, and the result must pack to the same packed state the server encoded.
+ * Other messages are checked by encoding the message read by the client and the message originally
+ * written with a second server context, which must produce identical data.
+ * Afterwards, the same is done in the other direction with randomized client messages, written with
+ * q2proto_client_write() and read with q2proto_server_read().
+ *
+ * If a directory is given on the command line, the generated streams are saved there:
+ * - svc_<protocol>.dm2: server messages, as a demo (sequence of packets, each preceded by its
+ *   little-endian 32-bit length, terminated by a length of -1). These can be replayed by the demo tools
+ *   and are the corpus for the fuzz_client_read fuzzer.
+ * - clc_<protocol>.bin: client messages, preceded by one byte selecting the protocol. These are the corpus
+ *   for the fuzz_server_read fuzzer.
+ */
+
+#define NUM_FRAMES        64
+#define NUM_ENTITIES      48
+#define NUM_CONFIGSTRINGS 96
+#define NUM_CLC_MESSAGES  256
+#define MAX_MISC_MESSAGES 1024
+#define PACKET_LENGTH     1390
+#define STREAM_CAPACITY   0x200000
+#define SCRATCH_CAPACITY  0x10000
+#define STRING_POOL_SIZE  0x40000
+#define MAX_CS_INDEX      0x2000
+
+// Demo protocols for the game API, in addition to the network protocols
+static const q2proto_protocol_t demo_protocols[] = {
+#if Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_RERELEASE
+    Q2P_PROTOCOL_KEX_DEMOS,
+    Q2P_PROTOCOL_KEX,
+#elif Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_Q2PRO_EXTENDED_V2
+    // Q2P_PROTOCOL_Q2PRO_EXTENDED_V2_DEMO can't carry the player fog the generated states use
+    Q2P_PROTOCOL_Q2PRO_EXTENDED_DEMO_PLAYERFOG,
+#elif Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_Q2PRO_EXTENDED
+    Q2P_PROTOCOL_Q2PRO_EXTENDED_DEMO,
+#else
+    Q2P_PROTOCOL_VANILLA,
+#endif
+};
+
+static int failures;
+
+#define CHECK(COND, ...)         \
+    do {                         \
+        if (!(COND)) {           \
+            printf(__VA_ARGS__); \
+            printf("\n");        \
+            failures++;          \
+        }                        \
+    } while (0)
+
+static uint64_t rng_state = 0x2545f4914f6cdd1dULL;
+
+static uint32_t rng_next(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t)(rng_state >> 16);
+}
+
+static int32_t random_range(int32_t min, int32_t max) { return min + (int32_t)(rng_next() % (uint32_t)(max - min + 1)); }
+
+static bool random_chance(unsigned one_in) { return rng_next() % one_in == 0; }
+
+/* Random values for "game" states. These are chosen from the values the protocols can transmit exactly,
+ * so the state reconstructed by the client must pack to exactly the same data. */
+static float random_coord(void) { return random_range(-32000, 32000) / 8.f; }
+static float random_angle8(void) { return random_range(-128, 127) * (360.f / 256); }
+static float random_angle16(void) { return random_range(-32768, 32767) * (360.f / 65536); }
+static float random_small(void) { return random_range(-128, 127) * 0.25f; }
+static float random_byte_fraction(void) { return random_range(0, 255) / 255.f; }
+
+static char string_pool[STRING_POOL_SIZE];
+static size_t string_pool_used;
+
+static q2proto_string_t random_string(size_t min_len, size_t max_len)
+{
+    static const char chars[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 _-.";
+    size_t len = random_range(min_len, max_len);
+    if (len + 1 > STRING_POOL_SIZE - string_pool_used)
+        string_pool_used = 0;
+    char *str = string_pool + string_pool_used;
+    for (size_t i = 0; i < len; i++)
+        str[i] = chars[rng_next() % (sizeof(chars) - 1)];
+    str[len] = 0;
+    string_pool_used += len + 1;
+    return (q2proto_string_t){.str = str, .len = len};
+}
+
+static bool string_equal(const q2proto_string_t *a, const q2proto_string_t *b)
+{
+    return a->len == b->len && (a->len == 0 || memcmp(a->str, b->str, a->len) == 0);
+}
+
+// World, as seen by the server
+static struct {
+    roundtrip_entity_state_t baselines[NUM_ENTITIES];
+    roundtrip_entity_state_t entities[NUM_FRAMES][NUM_ENTITIES];
+    bool visible[NUM_FRAMES][NUM_ENTITIES];
+    roundtrip_player_state_t players[NUM_FRAMES];
+    uint8_t areabits[NUM_FRAMES][4];
+    q2proto_svc_configstring_t configstrings[NUM_CONFIGSTRINGS];
+} world;
+
+static void random_entity(roundtrip_entity_state_t *ent)
+{
+    ent->modelindex = random_range(1, 255);
+    ent->modelindex2 = random_chance(4) ? random_range(1, 255) : 0;
+    ent->modelindex3 = random_chance(8) ? random_range(1, 255) : 0;
+    ent->modelindex4 = random_chance(16) ? random_range(1, 255) : 0;
+    ent->frame = random_range(0, 1023);
+    ent->skinnum = random_chance(4) ? random_range(0, 0xffff) : random_range(0, 15);
+    ent->effects = rng_next();
+#if Q2PROTO_ENTITY_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_ENTITY_LOOP_ALPHA_SCALE_FX64
+    ent->effects |= (uint64_t)rng_next() << 32;
+#endif
+    // Avoid renderfx bits which cause protocols to handle entities specially
+    ent->renderfx = random_range(0, 0xffff) & ~0x80;
+    ent->sound = random_chance(4) ? random_range(1, 255) : 0;
+    ent->solid = random_range(0, 0xffff);
+#if Q2PROTO_ENTITY_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_ENTITY_LOOP_ALPHA_SCALE_FX64
+    // Loop parameters are only sent along with a sound change, so derive them from the sound
+    ent->loop_volume = ent->sound ? ((ent->sound * 37) & 0xff) / 255.f : 0;
+    ent->loop_attenuation = ent->sound ? q2proto_sound_decode_loop_attenuation((ent->sound * 101) & 0xff) : 0;
+    ent->alpha = random_byte_fraction();
+    ent->scale = random_range(0, 255) / 16.f;
+#endif
+}
+
+// Apply typical frame-to-frame changes
+static void update_entity(roundtrip_entity_state_t *ent)
+{
+    for (int i = 0; i < 3; i++) {
+        if (random_chance(2))
+            ent->origin[i] = random_coord();
+        if (random_chance(8))
+            ent->angles[i] = random_angle8();
+    }
+    ent->frame = (ent->frame + 1) % 1024;
+    ent->event = random_chance(16) ? random_range(1, 255) : 0;
+    if (random_chance(32))
+        random_entity(ent);
+}
+
+static void random_player(roundtrip_player_state_t *ps)
+{
+    ps->pmove.pm_type = random_range(0, 4);
+    ps->pmove.pm_time = random_range(0, 255);
+    ps->pmove.pm_flags = random_range(0, 255);
+    ps->pmove.gravity = random_range(0, 800);
+#if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_GUNRATE_VIEWHEIGHT
+    ps->pmove.viewheight = random_range(-32, 64);
+    ps->gunrate = random_range(0, 255);
+#endif
+    ps->gunindex = random_range(1, 255);
+#if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_GUNSKIN
+    // Only 3 bits are transmitted
+    ps->gunskin = random_range(0, 7);
+#endif
+    ps->fov = random_range(60, 120);
+    ps->rdflags = random_range(0, 255);
+    for (int i = 0; i < 3; i++) {
+        ps->pmove.delta_angles[i] = random_angle16();
+        ps->viewoffset[i] = random_small();
+        ps->gunoffset[i] = random_small();
+        // Q2rePRO only transmits gun angles in the range of +-8 degrees
+        ps->gunangles[i] = random_range(-32, 31) * 0.25f;
+    }
+    for (int i = 0; i < 4; i++) {
+        ps->blend[i] = random_byte_fraction();
+#if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_DAMAGE_BLEND
+        ps->damage_blend[i] = random_byte_fraction();
+#endif
+    }
+#if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_FOG
+    for (int i = 0; i < 3; i++) {
+        ps->fog.color[i] = random_byte_fraction();
+        ps->heightfog.start_color[i] = random_byte_fraction();
+        ps->heightfog.end_color[i] = random_byte_fraction();
+    }
+    ps->fog.density = random_byte_fraction();
+    ps->fog.sky_factor = random_byte_fraction();
+    ps->heightfog.density = random_byte_fraction();
+    ps->heightfog.falloff = random_byte_fraction();
+    ps->heightfog.start_dist = random_range(0, 4000);
+    ps->heightfog.end_dist = random_range(0, 4000);
+#endif
+}
+
+// Apply typical frame-to-frame changes
+static void update_player(roundtrip_player_state_t *ps)
+{
+    for (int i = 0; i < 3; i++) {
+        ps->pmove.velocity[i] = random_range(-2048, 2047) / 8.f;
+        ps->pmove.origin[i] = random_coord();
+        if (random_chance(2))
+            ps->viewangles[i] = random_angle16();
+        ps->kick_angles[i] = random_chance(8) ? random_small() : 0;
+    }
+    ps->gunframe = (ps->gunframe + 1) % 256;
+    for (int i = 0; i < 4; i++) {
+        if (random_chance(8))
+            ps->stats[random_range(0, ps->num_stats - 1)] = random_range(-32768, 32767);
+    }
+    if (random_chance(32))
+        random_player(ps);
+}
+
+static void make_world(void)
+{
+    memset(&world, 0, sizeof(world));
+    // Entity 0 is never sent
+    for (int e = 1; e < NUM_ENTITIES; e++) {
+        roundtrip_entity_state_t *baseline = &world.baselines[e];
+        random_entity(baseline);
+        for (int i = 0; i < 3; i++) {
+            baseline->origin[i] = random_coord();
+            baseline->angles[i] = random_angle8();
+            // old_origin is only sent when entities enter, so keep it fixed
+            baseline->old_origin[i] = random_coord();
+        }
+        world.entities[0][e] = *baseline;
+        update_entity(&world.entities[0][e]);
+        world.visible[0][e] = !random_chance(4);
+    }
+    world.players[0].num_stats = TEST_GAME_API >= Q2PROTO_GAME_Q2PRO_EXTENDED_V2 ? Q2PROTO_STATS : 32;
+    random_player(&world.players[0]);
+    update_player(&world.players[0]);
+    for (int f = 1; f < NUM_FRAMES; f++) {
+        for (int e = 1; e < NUM_ENTITIES; e++) {
+            world.entities[f][e] = world.entities[f - 1][e];
+            if (!random_chance(4))
+                update_entity(&world.entities[f][e]);
+            world.visible[f][e] = random_chance(8) ? !world.visible[f - 1][e] : world.visible[f - 1][e];
+        }
+        world.players[f] = world.players[f - 1];
+        update_player(&world.players[f]);
+    }
+    for (int f = 0; f < NUM_FRAMES; f++) {
+        for (int i = 0; i < 4; i++)
+            world.areabits[f][i] = rng_next();
+    }
+    for (int i = 0; i < NUM_CONFIGSTRINGS; i++) {
+        world.configstrings[i].index = i;
+        world.configstrings[i].value = random_string(1, 48);
+    }
+}
+
+static const char *protocol_name(q2proto_protocol_t protocol)
+{
+    switch (protocol) {
+    case Q2P_PROTOCOL_INVALID:
+    case Q2P_NUM_PROTOCOLS:
+        break;
+    case Q2P_PROTOCOL_OLD_DEMO:
+        return "old_demo";
+    case Q2P_PROTOCOL_VANILLA:
+        return "vanilla";
+    case Q2P_PROTOCOL_R1Q2:
+        return "r1q2";
+    case Q2P_PROTOCOL_Q2PRO:
+        return "q2pro";
+    case Q2P_PROTOCOL_Q2PRO_EXTENDED_DEMO:
+        return "q2pro_extended_demo";
+    case Q2P_PROTOCOL_Q2PRO_EXTENDED_V2_DEMO:
+        return "q2pro_extended_v2_demo";
+    case Q2P_PROTOCOL_Q2PRO_EXTENDED_DEMO_PLAYERFOG:
+        return "q2pro_extended_demo_playerfog";
+    case Q2P_PROTOCOL_Q2REPRO:
+        return "q2repro";
+    case Q2P_PROTOCOL_KEX_DEMOS:
+        return "kex_demos";
+    case Q2P_PROTOCOL_KEX:
+        return "kex";
+    }
+    return "invalid";
+}
+
+// Messages other than frames, configstrings and baselines, in the order they were written
+static q2proto_svc_message_t misc_messages[MAX_MISC_MESSAGES];
+static size_t num_misc_messages;
+
+static q2proto_server_info_t server_info;
+static q2proto_servercontext_t server_context;
+// Second server context, used to encode messages for comparison
+static q2proto_servercontext_t mirror_context;
+static roundtrip_buffer_t packet;
+static roundtrip_buffer_t svc_stream;
+static roundtrip_buffer_t scratch[2];
+
+static q2proto_error_t init_server_context(q2proto_servercontext_t *context, q2proto_protocol_t protocol)
+{
+    q2proto_connect_t connect;
+    memset(&connect, 0, sizeof(connect));
+    connect.protocol = protocol;
+    connect.qport = 1234;
+    connect.challenge = 5678;
+    connect.userinfo = q2proto_make_string("\\name\\roundtrip");
+    connect.packet_length = PACKET_LENGTH;
+    q2proto_error_t err = q2proto_complete_connect(&connect);
+    // Demo protocols can't be "connected", but are set up the same way
+    if (err != Q2P_ERR_SUCCESS && err != Q2P_ERR_PROTOCOL_NOT_SUPPORTED)
+        return err;
+    return q2proto_init_servercontext(context, &server_info, &connect);
+}
+
+static void append_block(roundtrip_buffer_t *stream, const void *data, uint32_t size)
+{
+    uint8_t *p = stream->data + stream->size;
+    p[0] = size & 0xff;
+    p[1] = (size >> 8) & 0xff;
+    p[2] = (size >> 16) & 0xff;
+    p[3] = size >> 24;
+    if (size != (uint32_t)-1)
+        memcpy(p + 4, data, size);
+    stream->size += 4 + (size != (uint32_t)-1 ? size : 0);
+}
+
+static bool flush_packet(void)
+{
+    if (packet.size == 0)
+        return true;
+    if (svc_stream.capacity - svc_stream.size < packet.size + 8) {
+        printf("stream capacity exceeded\n");
+        return false;
+    }
+    append_block(&svc_stream, packet.data, packet.size);
+    packet.size = 0;
+    return true;
+}
+
+// Write a message, starting a new packet if it doesn't fit into the current one
+static q2proto_error_t write_message(const q2proto_svc_message_t *message)
+{
+    size_t mark = packet.size;
+    q2proto_error_t err = q2proto_server_write(&server_context, roundtrip_io_arg(&packet), message);
+    if (err == Q2P_ERR_NOT_ENOUGH_PACKET_SPACE && mark > 0) {
+        packet.size = mark;
+        packet.err = Q2P_ERR_SUCCESS;
+        if (!flush_packet())
+            return Q2P_ERR_NOT_ENOUGH_PACKET_SPACE;
+        mark = 0;
+        err = q2proto_server_write(&server_context, roundtrip_io_arg(&packet), message);
+    }
+    if (err != Q2P_ERR_SUCCESS) {
+        packet.size = mark;
+        packet.err = Q2P_ERR_SUCCESS;
+    }
+    return err;
+}
+
+static void random_misc_message(q2proto_svc_message_t *message)
+{
+    static const q2proto_svc_message_type_t types[] = {
+        Q2P_SVC_MUZZLEFLASH, Q2P_SVC_MUZZLEFLASH2, Q2P_SVC_TEMP_ENTITY, Q2P_SVC_NOP,    Q2P_SVC_SOUND,
+        Q2P_SVC_PRINT,       Q2P_SVC_STUFFTEXT,    Q2P_SVC_CENTERPRINT, Q2P_SVC_LAYOUT, Q2P_SVC_INVENTORY,
+        Q2P_SVC_SETTING,     Q2P_SVC_DAMAGE,       Q2P_SVC_FOG,         Q2P_SVC_POI,    Q2P_SVC_HELP_PATH,
+        Q2P_SVC_ACHIEVEMENT, Q2P_SVC_LOCPRINT,
+    };
+
+    memset(message, 0, sizeof(*message));
+    message->type = types[rng_next() % (sizeof(types) / sizeof(types[0]))];
+    switch (message->type) {
+    case Q2P_SVC_MUZZLEFLASH:
+    case Q2P_SVC_MUZZLEFLASH2:
+        message->muzzleflash.entity = random_range(1, NUM_ENTITIES - 1);
+        message->muzzleflash.weapon = random_range(0, 127);
+        message->muzzleflash.silenced = message->type == Q2P_SVC_MUZZLEFLASH && random_chance(2);
+        break;
+    case Q2P_SVC_TEMP_ENTITY:
+        // Not all types are supported by all protocols; unsupported ones are skipped when writing
+        message->temp_entity.type = random_range(0, 40);
+        for (int i = 0; i < 3; i++) {
+            message->temp_entity.position1[i] = random_coord();
+            message->temp_entity.position2[i] = random_coord();
+            message->temp_entity.offset[i] = random_coord();
+        }
+        message->temp_entity.direction[random_range(0, 2)] = random_chance(2) ? 1 : -1;
+        message->temp_entity.count = random_range(0, 255);
+        message->temp_entity.color = random_range(0, 255);
+        message->temp_entity.entity1 = random_range(1, NUM_ENTITIES - 1);
+        message->temp_entity.entity2 = random_range(1, NUM_ENTITIES - 1);
+        message->temp_entity.time = random_range(0, 10000);
+        break;
+    case Q2P_SVC_SOUND:
+        message->sound.flags = random_range(0, 31);
+        message->sound.index = random_range(1, 255);
+        message->sound.volume = random_range(0, 255);
+        message->sound.attenuation = random_range(0, 255);
+        message->sound.timeofs = random_range(0, 255);
+        message->sound.entity = random_range(1, NUM_ENTITIES - 1);
+        message->sound.channel = random_range(0, 7);
+        for (int i = 0; i < 3; i++)
+            q2proto_var_coords_set_float_comp(&message->sound.pos, i, random_coord());
+        break;
+    case Q2P_SVC_PRINT:
+        message->print.level = random_range(0, 3);
+        message->print.string = random_string(0, 200);
+        break;
+    case Q2P_SVC_STUFFTEXT:
+        message->stufftext.string = random_string(0, 200);
+        break;
+    case Q2P_SVC_CENTERPRINT:
+        message->centerprint.message = random_string(0, 200);
+        break;
+    case Q2P_SVC_LAYOUT:
+        message->layout.layout_str = random_string(0, 400);
+        break;
+    case Q2P_SVC_INVENTORY:
+        for (int i = 0; i < Q2PROTO_INVENTORY_ITEMS; i++)
+            message->inventory.inventory[i] = random_chance(4) ? random_range(-32768, 32767) : 0;
+        break;
+    case Q2P_SVC_SETTING:
+        message->setting.index = random_range(0, 16);
+        message->setting.value = rng_next();
+        break;
+    case Q2P_SVC_DAMAGE:
+        message->damage.count = random_range(1, Q2PROTO_MAX_DAMAGE_INDICATORS);
+        for (int i = 0; i < message->damage.count; i++) {
+            message->damage.damage[i].damage = random_range(0, 31);
+            message->damage.damage[i].health = random_chance(2);
+            message->damage.damage[i].armor = random_chance(2);
+            message->damage.damage[i].shield = random_chance(2);
+            message->damage.damage[i].direction[random_range(0, 2)] = random_chance(2) ? 1 : -1;
+        }
+        break;
+    case Q2P_SVC_FOG:
+        message->fog.flags = random_range(0, 63);
+        q2proto_var_fraction_set_float(&message->fog.global.density, random_byte_fraction());
+        q2proto_var_fraction_set_float(&message->fog.global.skyfactor, random_byte_fraction());
+        q2proto_var_fraction_set_float(&message->fog.height.falloff, random_byte_fraction());
+        q2proto_var_fraction_set_float(&message->fog.height.density, random_byte_fraction());
+        q2proto_var_coord_set_float(&message->fog.height.start_dist, random_range(0, 4000));
+        q2proto_var_coord_set_float(&message->fog.height.end_dist, random_range(0, 4000));
+        message->fog.global.time = random_range(0, 10000);
+        message->fog.global.color.delta_bits = random_range(0, 7);
+        message->fog.height.start_color.delta_bits = random_range(0, 7);
+        message->fog.height.end_color.delta_bits = random_range(0, 7);
+        for (int i = 0; i < 3; i++) {
+            q2proto_var_color_set_float_comp(&message->fog.global.color.values, i, random_byte_fraction());
+            q2proto_var_color_set_float_comp(&message->fog.height.start_color.values, i, random_byte_fraction());
+            q2proto_var_color_set_float_comp(&message->fog.height.end_color.values, i, random_byte_fraction());
+        }
+        break;
+    case Q2P_SVC_POI:
+        message->poi.key = random_range(0, 0xffff);
+        message->poi.time = random_range(0, 0xffff);
+        for (int i = 0; i < 3; i++)
+            message->poi.pos[i] = random_coord();
+        message->poi.image = random_range(0, 255);
+        message->poi.color = random_range(0, 255);
+        message->poi.flags = random_range(0, 3);
+        break;
+    case Q2P_SVC_HELP_PATH:
+        message->help_path.start = random_chance(2);
+        for (int i = 0; i < 3; i++)
+            message->help_path.pos[i] = random_coord();
+        message->help_path.dir[random_range(0, 2)] = random_chance(2) ? 1 : -1;
+        break;
+    case Q2P_SVC_ACHIEVEMENT:
+        message->achievement.id = random_string(1, 32);
+        break;
+    case Q2P_SVC_LOCPRINT:
+        message->locprint.flags = random_range(0, 3);
+        message->locprint.base = random_string(1, 64);
+        message->locprint.num_args = random_range(0, Q2PROTO_MAX_LOCALIZATION_ARGS);
+        for (int i = 0; i < message->locprint.num_args; i++)
+            message->locprint.args[i] = random_string(0, 32);
+        break;
+    default:
+        break;
+    }
+}
+
+static q2proto_error_t write_entity_delta(uint16_t entnum, const q2proto_packed_entity_state_t *from,
+                                          const q2proto_packed_entity_state_t *to, bool entering)
+{
+    q2proto_svc_message_t message = {.type = Q2P_SVC_FRAME_ENTITY_DELTA, .frame_entity_delta = {0}};
+    message.frame_entity_delta.newnum = entnum;
+    if (to)
+        q2proto_server_make_entity_state_delta(&server_context, from, to, entering,
+                                               &message.frame_entity_delta.entity_delta);
+    else
+        message.frame_entity_delta.remove = true;
+    return q2proto_server_write(&server_context, roundtrip_io_arg(&packet), &message);
+}
+
+// Write a frame, as delta from the previous frame, into a packet of its own
+static q2proto_error_t write_frame(int frame)
+{
+    if (!flush_packet())
+        return Q2P_ERR_NOT_ENOUGH_PACKET_SPACE;
+
+    q2proto_packed_player_state_t player_from, player_to;
+    memset(&player_from, 0, sizeof(player_from));
+    memset(&player_to, 0, sizeof(player_to));
+    if (frame > 0)
+        roundtrip_pack_player(&server_context, &world.players[frame - 1], &player_from);
+    roundtrip_pack_player(&server_context, &world.players[frame], &player_to);
+
+    q2proto_svc_message_t message = {.type = Q2P_SVC_FRAME, .frame = {0}};
+    message.frame.serverframe = frame + 1;
+    message.frame.deltaframe = frame > 0 ? frame : -1;
+    message.frame.areabits_len = sizeof(world.areabits[frame]);
+    message.frame.areabits = world.areabits[frame];
+    q2proto_server_make_player_state_delta(&server_context, frame > 0 ? &player_from : NULL, &player_to,
+                                           &message.frame.playerstate);
+    q2proto_error_t err = q2proto_server_write(&server_context, roundtrip_io_arg(&packet), &message);
+    if (err != Q2P_ERR_SUCCESS)
+        return err;
+
+    for (uint16_t entnum = 1; entnum < NUM_ENTITIES; entnum++) {
+        bool old_visible = frame > 0 && world.visible[frame - 1][entnum];
+        bool new_visible = world.visible[frame][entnum];
+        if (!old_visible && !new_visible)
+            continue;
+        q2proto_packed_entity_state_t from, to;
+        memset(&from, 0, sizeof(from));
+        memset(&to, 0, sizeof(to));
+        if (old_visible)
+            roundtrip_pack_entity(&server_context, &world.entities[frame - 1][entnum], &from);
+        else
+            roundtrip_pack_entity(&server_context, &world.baselines[entnum], &from);
+        if (new_visible) {
+            roundtrip_pack_entity(&server_context, &world.entities[frame][entnum], &to);
+            if (old_visible && memcmp(&from, &to, sizeof(from)) == 0)
+                continue;
+        }
+        err = write_entity_delta(entnum, &from, new_visible ? &to : NULL, !old_visible);
+        if (err != Q2P_ERR_SUCCESS)
+            return err;
+    }
+
+    q2proto_svc_message_t terminator = {.type = Q2P_SVC_FRAME_ENTITY_DELTA, .frame_entity_delta = {0}};
+    return q2proto_server_write(&server_context, roundtrip_io_arg(&packet), &terminator);
+}
+
+static bool write_gamestate(void)
+{
+    q2proto_svc_message_t message = {.type = Q2P_SVC_SERVERDATA, .serverdata = {0}};
+    q2proto_error_t err = q2proto_server_fill_serverdata(&server_context, &message.serverdata);
+    if (err != Q2P_ERR_SUCCESS) {
+        printf("filling serverdata failed: %s\n", q2proto_error_string(err));
+        return false;
+    }
+    message.serverdata.servercount = 0x1234;
+    message.serverdata.gamedir = q2proto_make_string("baseq2");
+    message.serverdata.clientnum = 1;
+    message.serverdata.levelname = q2proto_make_string("roundtrip");
+    if (message.serverdata.server_fps == 0)
+        message.serverdata.server_fps = 10;
+    err = write_message(&message);
+    if (err != Q2P_ERR_SUCCESS) {
+        printf("writing serverdata failed: %s\n", q2proto_error_string(err));
+        return false;
+    }
+
+    static q2proto_svc_spawnbaseline_t spawnbaselines[NUM_ENTITIES];
+    for (int e = 1; e < NUM_ENTITIES; e++) {
+        q2proto_packed_entity_state_t packed;
+        memset(&packed, 0, sizeof(packed));
+        roundtrip_pack_entity(&server_context, &world.baselines[e], &packed);
+        spawnbaselines[e - 1].entnum = e;
+        q2proto_server_make_entity_state_delta(&server_context, NULL, &packed, true, &spawnbaselines[e - 1].delta_state);
+    }
+
+    q2proto_gamestate_t gamestate = {.num_configstrings = NUM_CONFIGSTRINGS,
+                                     .configstrings = world.configstrings,
+                                     .num_spawnbaselines = NUM_ENTITIES - 1,
+                                     .spawnbaselines = spawnbaselines};
+    while (true) {
+        err = q2proto_server_write_gamestate(&server_context, NULL, roundtrip_io_arg(&packet), &gamestate);
+        if (err == Q2P_ERR_SUCCESS)
+            break;
+        if (err != Q2P_ERR_NOT_ENOUGH_PACKET_SPACE || packet.size == 0) {
+            printf("writing gamestate failed: %s\n", q2proto_error_string(err));
+            return false;
+        }
+        packet.err = Q2P_ERR_SUCCESS;
+        if (!flush_packet())
+            return false;
+    }
+    return true;
+}
+
+// Generate the server message stream for a protocol
+static bool write_svc_stream(void)
+{
+    num_misc_messages = 0;
+    svc_stream.size = 0;
+    packet.size = 0;
+    packet.err = Q2P_ERR_SUCCESS;
+
+    if (!write_gamestate())
+        return false;
+
+    for (int frame = 0; frame < NUM_FRAMES; frame++) {
+        q2proto_error_t err = write_frame(frame);
+        if (err != Q2P_ERR_SUCCESS) {
+            printf("frame %d: write failed: %s\n", frame, q2proto_error_string(err));
+            return false;
+        }
+
+        int num_misc = random_range(0, 8);
+        for (int i = 0; i < num_misc && num_misc_messages < MAX_MISC_MESSAGES; i++) {
+            q2proto_svc_message_t *message = &misc_messages[num_misc_messages];
+            random_misc_message(message);
+            size_t old_stream_size = svc_stream.size;
+            size_t mark = packet.size;
+            err = write_message(message);
+            // Messages not supported by the protocol are skipped
+            if (err != Q2P_ERR_SUCCESS)
+                continue;
+            // Also skip messages a protocol silently drops
+            if (svc_stream.size == old_stream_size && packet.size == mark)
+                continue;
+            num_misc_messages++;
+        }
+    }
+
+    if (!flush_packet())
+        return false;
+    append_block(&svc_stream, NULL, (uint32_t)-1);
+    return true;
+}
+
+// State reconstructed by the client
+static struct {
+    roundtrip_entity_state_t baselines[NUM_ENTITIES];
+    bool has_baseline[NUM_ENTITIES];
+    roundtrip_entity_state_t entities[NUM_ENTITIES];
+    bool present[NUM_ENTITIES];
+    roundtrip_player_state_t player;
+    q2proto_string_t configstrings[MAX_CS_INDEX];
+    bool has_configstring[MAX_CS_INDEX];
+    bool have_serverdata;
+    int current_frame;
+    bool in_frame;
+    int frames_checked;
+    size_t misc_checked;
+} client;
+
+static bool entity_state_equal(const roundtrip_entity_state_t *a, const roundtrip_entity_state_t *b)
+{
+    q2proto_packed_entity_state_t packed_a, packed_b;
+    memset(&packed_a, 0, sizeof(packed_a));
+    memset(&packed_b, 0, sizeof(packed_b));
+    roundtrip_pack_entity(&mirror_context, a, &packed_a);
+    roundtrip_pack_entity(&mirror_context, b, &packed_b);
+    return memcmp(&packed_a, &packed_b, sizeof(packed_a)) == 0;
+}
+
+static bool player_state_equal(const roundtrip_player_state_t *a, const roundtrip_player_state_t *b)
+{
+    q2proto_packed_player_state_t packed_a, packed_b;
+    memset(&packed_a, 0, sizeof(packed_a));
+    memset(&packed_b, 0, sizeof(packed_b));
+    roundtrip_pack_player(&mirror_context, a, &packed_a);
+    roundtrip_pack_player(&mirror_context, b, &packed_b);
+    return memcmp(&packed_a, &packed_b, sizeof(packed_a)) == 0;
+}
+
+// Check client state against server state after a frame was read
+static void check_frame(const char *name)
+{
+    int frame = client.current_frame;
+    CHECK(player_state_equal(&client.player, &world.players[frame]), "%s: frame %d: player state mismatch", name,
+          frame);
+    for (int e = 1; e < NUM_ENTITIES; e++) {
+        CHECK(client.present[e] == world.visible[frame][e], "%s: frame %d: entity %d presence mismatch", name, frame,
+              e);
+        if (client.present[e] && world.visible[frame][e])
+            CHECK(entity_state_equal(&client.entities[e], &world.entities[frame][e]),
+                  "%s: frame %d: entity %d state mismatch", name, frame, e);
+    }
+    client.frames_checked++;
+}
+
+// Encode a message with the mirror context
+static q2proto_error_t encode_message(roundtrip_buffer_t *buf, const q2proto_svc_message_t *message)
+{
+    buf->size = 0;
+    buf->err = Q2P_ERR_SUCCESS;
+    return q2proto_server_write(&mirror_context, roundtrip_io_arg(buf), message);
+}
+
+static void check_misc_message(const char *name, const q2proto_svc_message_t *message)
+{
+    if (client.misc_checked >= num_misc_messages) {
+        CHECK(false, "%s: unexpected message %s", name, q2proto_svc_message_str(message->type));
+        return;
+    }
+    const q2proto_svc_message_t *expected = &misc_messages[client.misc_checked++];
+    if (message->type != expected->type) {
+        CHECK(false, "%s: message %zu: got %s, expected %s", name, client.misc_checked - 1,
+              q2proto_svc_message_str(message->type), q2proto_svc_message_str(expected->type));
+        return;
+    }
+
+    q2proto_error_t err_read = encode_message(&scratch[0], message);
+    q2proto_error_t err_expected = encode_message(&scratch[1], expected);
+    CHECK(err_read == Q2P_ERR_SUCCESS && err_expected == Q2P_ERR_SUCCESS, "%s: message %zu (%s): encode failed: %s, %s",
+          name, client.misc_checked - 1, q2proto_svc_message_str(message->type), q2proto_error_string(err_read),
+          q2proto_error_string(err_expected));
+    CHECK(scratch[0].size == scratch[1].size && memcmp(scratch[0].data, scratch[1].data, scratch[0].size) == 0,
+          "%s: message %zu (%s): contents mismatch", name, client.misc_checked - 1,
+          q2proto_svc_message_str(message->type));
+}
+
+static bool handle_svc_message(const char *name, const q2proto_svc_message_t *message)
+{
+    if (!client.have_serverdata && message->type != Q2P_SVC_SERVERDATA) {
+        CHECK(false, "%s: expected serverdata, got %s", name, q2proto_svc_message_str(message->type));
+        return false;
+    }
+
+    switch (message->type) {
+    case Q2P_SVC_SERVERDATA:
+        CHECK(!client.have_serverdata, "%s: duplicate serverdata", name);
+        client.have_serverdata = true;
+        CHECK(message->serverdata.servercount == 0x1234, "%s: servercount mismatch", name);
+        CHECK(message->serverdata.clientnum == 1, "%s: clientnum mismatch", name);
+        {
+            q2proto_string_t gamedir = q2proto_make_string("baseq2");
+            q2proto_string_t levelname = q2proto_make_string("roundtrip");
+            CHECK(string_equal(&message->serverdata.gamedir, &gamedir), "%s: gamedir mismatch", name);
+            CHECK(string_equal(&message->serverdata.levelname, &levelname), "%s: levelname mismatch", name);
+        }
+        return true;
+    case Q2P_SVC_CONFIGSTRING:
+        if (message->configstring.index >= MAX_CS_INDEX) {
+            CHECK(false, "%s: configstring index %d out of range", name, message->configstring.index);
+            return false;
+        }
+        client.configstrings[message->configstring.index] = message->configstring.value;
+        client.has_configstring[message->configstring.index] = true;
+        return true;
+    case Q2P_SVC_SPAWNBASELINE:
+        {
+            uint16_t entnum = message->spawnbaseline.entnum;
+            if (entnum == 0 || entnum >= NUM_ENTITIES) {
+                CHECK(false, "%s: baseline entity %d out of range", name, entnum);
+                return false;
+            }
+            memset(&client.baselines[entnum], 0, sizeof(client.baselines[entnum]));
+            roundtrip_apply_entity_delta(&client.baselines[entnum], &message->spawnbaseline.delta_state);
+            client.has_baseline[entnum] = true;
+        }
+        return true;
+    case Q2P_SVC_FRAME:
+        {
+            int frame = client.in_frame ? -1 : message->frame.serverframe - 1;
+            if (frame != client.frames_checked) {
+                CHECK(false, "%s: unexpected frame %d", name, message->frame.serverframe);
+                return false;
+            }
+            CHECK(message->frame.deltaframe == (frame > 0 ? frame : -1), "%s: frame %d: deltaframe mismatch", name,
+                  frame);
+            CHECK(message->frame.areabits_len == sizeof(world.areabits[frame])
+                      && memcmp(message->frame.areabits, world.areabits[frame], sizeof(world.areabits[frame])) == 0,
+                  "%s: frame %d: areabits mismatch", name, frame);
+            roundtrip_apply_player_delta(&client.player, &message->frame.playerstate);
+            client.current_frame = frame;
+            client.in_frame = true;
+        }
+        return true;
+    case Q2P_SVC_FRAME_ENTITY_DELTA:
+        {
+            const q2proto_svc_frame_entity_delta_t *delta = &message->frame_entity_delta;
+            if (!client.in_frame || delta->newnum >= NUM_ENTITIES) {
+                CHECK(false, "%s: unexpected entity delta for %d", name, delta->newnum);
+                return false;
+            }
+            if (delta->newnum == 0) {
+                client.in_frame = false;
+                check_frame(name);
+            } else if (delta->remove) {
+                client.present[delta->newnum] = false;
+            } else {
+                if (!client.present[delta->newnum])
+                    client.entities[delta->newnum] = client.baselines[delta->newnum];
+                roundtrip_apply_entity_delta(&client.entities[delta->newnum], &delta->entity_delta);
+                client.present[delta->newnum] = true;
+            }
+        }
+        return true;
+    default:
+        check_misc_message(name, message);
+        return true;
+    }
+}
+
+/* Set up \a block for reading the packet of the server message stream at \a pos.
+ * Returns 1 if a packet was found, 0 at the end of the stream, -1 if the stream is truncated. */
+static int next_svc_block(size_t *pos, roundtrip_buffer_t *block)
+{
+    if (svc_stream.size - *pos < 4)
+        return -1;
+    const uint8_t *p = svc_stream.data + *pos;
+    uint32_t block_size = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+    *pos += 4;
+    if (block_size == (uint32_t)-1)
+        return 0;
+    if (svc_stream.size - *pos < block_size)
+        return -1;
+    roundtrip_buffer_init_read(block, svc_stream.data + *pos, block_size);
+    *pos += block_size;
+    return 1;
+}
+
+// Read back the server message stream with a client context
+static bool read_svc_stream(const char *name, q2proto_clientcontext_t *client_context)
+{
+    memset(&client, 0, sizeof(client));
+    client.player.num_stats = world.players[0].num_stats;
+
+    size_t pos = 0;
+    while (true) {
+        roundtrip_buffer_t block;
+        int next = next_svc_block(&pos, &block);
+        if (next < 0) {
+            CHECK(false, "%s: truncated stream", name);
+            return false;
+        }
+        if (next == 0)
+            break;
+
+        size_t block_size = block.size;
+        while (true) {
+            q2proto_svc_message_t message;
+            q2proto_error_t err = q2proto_client_read(client_context, roundtrip_io_arg(&block), &message);
+            if (err == Q2P_ERR_NO_MORE_INPUT)
+                break;
+            if (err != Q2P_ERR_SUCCESS) {
+                CHECK(false, "%s: read failed at offset %zu: %s", name, pos - block_size + block.pos,
+                      q2proto_error_string(err));
+                return false;
+            }
+            if (!handle_svc_message(name, &message))
+                return false;
+        }
+        CHECK(!client.in_frame, "%s: frame %d not terminated in packet", name, client.current_frame);
+    }
+
+    CHECK(client.frames_checked == NUM_FRAMES, "%s: %d of %d frames read", name, client.frames_checked, NUM_FRAMES);
+    CHECK(client.misc_checked == num_misc_messages, "%s: %zu of %zu messages read", name, client.misc_checked,
+          num_misc_messages);
+    for (int i = 0; i < NUM_CONFIGSTRINGS; i++) {
+        uint16_t index = world.configstrings[i].index;
+        CHECK(client.has_configstring[index] && string_equal(&client.configstrings[index], &world.configstrings[i].value),
+              "%s: configstring %d mismatch", name, index);
+    }
+    for (int e = 1; e < NUM_ENTITIES; e++) {
+        CHECK(client.has_baseline[e] && entity_state_equal(&client.baselines[e], &world.baselines[e]),
+              "%s: baseline %d mismatch", name, e);
+    }
+    return true;
+}
+
+/* Read the server message stream up to the first frame, save the client state, and read on. Then restore the
+ * saved state into a new client context, and check that it decodes the rest of the stream identically. */
+static void check_save_restore(const char *name)
+{
+    q2proto_clientcontext_t reading_context, restored_context;
+    q2proto_init_clientcontext(&reading_context);
+    q2proto_client_saved_state_t saved_state;
+    CHECK(q2proto_client_save_state(&reading_context, &saved_state) == Q2P_ERR_INVALID_ARGUMENT,
+          "%s: state saved before serverdata", name);
+
+    size_t pos = 0;
+    roundtrip_buffer_t block;
+    bool frame_read = false;
+    while (!frame_read) {
+        if (next_svc_block(&pos, &block) <= 0) {
+            CHECK(false, "%s: save/restore: no frame in stream", name);
+            return;
+        }
+        q2proto_svc_message_t message;
+        while (q2proto_client_read(&reading_context, roundtrip_io_arg(&block), &message) == Q2P_ERR_SUCCESS)
+            frame_read |= message.type == Q2P_SVC_FRAME;
+    }
+
+    q2proto_error_t err = q2proto_client_save_state(&reading_context, &saved_state);
+    if (err == Q2P_ERR_SUCCESS)
+        err = q2proto_client_restore_state(&restored_context, &saved_state);
+    if (err != Q2P_ERR_SUCCESS) {
+        CHECK(false, "%s: save/restore failed: %s", name, q2proto_error_string(err));
+        return;
+    }
+    CHECK(memcmp(&restored_context.features, &reading_context.features, sizeof(reading_context.features)) == 0,
+          "%s: restored features differ", name);
+
+    // Both contexts read the same data, so decoded messages, including pointers into the data, must be identical
+    size_t num_messages = 0;
+    while (next_svc_block(&pos, &block) > 0) {
+        roundtrip_buffer_t restored_block = block;
+        while (true) {
+            q2proto_svc_message_t message, restored_message;
+            q2proto_error_t err_reading = q2proto_client_read(&reading_context, roundtrip_io_arg(&block), &message);
+            q2proto_error_t err_restored =
+                q2proto_client_read(&restored_context, roundtrip_io_arg(&restored_block), &restored_message);
+            if (err_reading != err_restored) {
+                CHECK(false, "%s: save/restore: message %zu: read results %s, %s", name, num_messages,
+                      q2proto_error_string(err_reading), q2proto_error_string(err_restored));
+                return;
+            }
+            if (err_reading != Q2P_ERR_SUCCESS)
+                break;
+            if (memcmp(&message, &restored_message, sizeof(message)) != 0) {
+                CHECK(false, "%s: save/restore: message %zu (%s) differs", name, num_messages,
+                      q2proto_svc_message_str(message.type));
+                return;
+            }
+            num_messages++;
+        }
+    }
+    CHECK(num_messages > 0, "%s: save/restore: no messages after first frame", name);
+}
+
+// Client messages, in the order they were written
+static q2proto_clc_message_t clc_messages[NUM_CLC_MESSAGES];
+static size_t num_clc_messages;
+
+static void random_move_delta(q2proto_clientcontext_t *client_context, q2proto_clc_move_delta_t *move)
+{
+    move->delta_bits = random_range(0, 0xff);
+    if (!client_context->features.has_upmove)
+        move->delta_bits &= ~Q2P_CMD_MOVE_UP;
+    for (int i = 0; i < 3; i++) {
+        q2proto_var_angles_set_short_comp(&move->angles, i, random_range(-32768, 32767));
+        q2proto_var_coords_set_float_comp(&move->move, i, random_range(-400, 400));
+    }
+    // Only BUTTON_ATTACK, BUTTON_USE and BUTTON_ANY; other bits are used for move compression flags
+    move->buttons = random_range(0, 255) & 0x83;
+    move->impulse = random_range(0, 255);
+    move->msec = random_range(0, 255);
+    move->lightlevel = random_range(0, 255);
+}
+
+static void random_clc_message(q2proto_clientcontext_t *client_context, q2proto_clc_message_t *message)
+{
+    static const q2proto_clc_message_type_t types[] = {
+        Q2P_CLC_NOP,       Q2P_CLC_MOVE,    Q2P_CLC_BATCH_MOVE,     Q2P_CLC_USERINFO,
+        Q2P_CLC_STRINGCMD, Q2P_CLC_SETTING, Q2P_CLC_USERINFO_DELTA,
+    };
+
+    memset(message, 0, sizeof(*message));
+    message->type = types[rng_next() % (sizeof(types) / sizeof(types[0]))];
+    if (message->type == Q2P_CLC_BATCH_MOVE && !client_context->features.batch_move)
+        message->type = Q2P_CLC_MOVE;
+    if (message->type == Q2P_CLC_USERINFO_DELTA && !client_context->features.userinfo_delta)
+        message->type = Q2P_CLC_USERINFO;
+    switch (message->type) {
+    case Q2P_CLC_MOVE:
+        message->move.lastframe = random_range(-1, NUM_FRAMES);
+        for (int i = 0; i < 3; i++)
+            random_move_delta(client_context, &message->move.moves[i]);
+        message->move.sequence = rng_next();
+        break;
+    case Q2P_CLC_BATCH_MOVE:
+        message->batch_move.lastframe = random_range(-1, NUM_FRAMES);
+        message->batch_move.num_dups = random_range(0, Q2PROTO_MAX_CLC_BATCH_MOVE_FRAMES - 2);
+        uint8_t lightlevel = random_range(0, 255);
+        for (int f = 0; f <= message->batch_move.num_dups; f++) {
+            q2proto_clc_batch_move_frame_t *batch_frame = &message->batch_move.batch_frames[f];
+            batch_frame->num_cmds = random_range(1, 4);
+            for (int i = 0; i < batch_frame->num_cmds; i++) {
+                random_move_delta(client_context, &batch_frame->moves[i]);
+                // Batched moves carry no impulse, and a single light level for all commands
+                batch_frame->moves[i].delta_bits &= ~Q2P_CMD_IMPULSE;
+                batch_frame->moves[i].lightlevel = lightlevel;
+            }
+        }
+        break;
+    case Q2P_CLC_USERINFO:
+        message->userinfo.str = random_string(0, 200);
+        break;
+    case Q2P_CLC_STRINGCMD:
+        message->stringcmd.cmd = random_string(0, 200);
+        break;
+    case Q2P_CLC_SETTING:
+        message->setting.index = random_range(0, 16);
+        message->setting.value = random_range(-32768, 32767);
+        break;
+    case Q2P_CLC_USERINFO_DELTA:
+        message->userinfo_delta.name = random_string(1, 16);
+        message->userinfo_delta.value = random_string(0, 64);
+        break;
+    default:
+        break;
+    }
+}
+
+static bool move_delta_equal(const q2proto_clc_move_delta_t *a, const q2proto_clc_move_delta_t *b)
+{
+    if (a->delta_bits != b->delta_bits || a->msec != b->msec || a->lightlevel != b->lightlevel)
+        return false;
+    for (int i = 0; i < 3; i++) {
+        if ((a->delta_bits & (Q2P_CMD_ANGLE0 << i))
+            && q2proto_var_angles_get_short_comp(&a->angles, i) != q2proto_var_angles_get_short_comp(&b->angles, i))
+            return false;
+        if ((a->delta_bits & (Q2P_CMD_MOVE_FORWARD << i))
+            && q2proto_var_coords_get_float_comp(&a->move, i) != q2proto_var_coords_get_float_comp(&b->move, i))
+            return false;
+    }
+    if ((a->delta_bits & Q2P_CMD_BUTTONS) && a->buttons != b->buttons)
+        return false;
+    if ((a->delta_bits & Q2P_CMD_IMPULSE) && a->impulse != b->impulse)
+        return false;
+    return true;
+}
+
+static bool clc_message_equal(const q2proto_clc_message_t *a, const q2proto_clc_message_t *b)
+{
+    if (a->type != b->type)
+        return false;
+    switch (a->type) {
+    case Q2P_CLC_MOVE:
+        if (a->move.lastframe != b->move.lastframe)
+            return false;
+        for (int i = 0; i < 3; i++) {
+            if (!move_delta_equal(&a->move.moves[i], &b->move.moves[i]))
+                return false;
+        }
+        return true;
+    case Q2P_CLC_BATCH_MOVE:
+        if (a->batch_move.lastframe != b->batch_move.lastframe || a->batch_move.num_dups != b->batch_move.num_dups)
+            return false;
+        for (int f = 0; f <= a->batch_move.num_dups; f++) {
+            const q2proto_clc_batch_move_frame_t *frame_a = &a->batch_move.batch_frames[f];
+            const q2proto_clc_batch_move_frame_t *frame_b = &b->batch_move.batch_frames[f];
+            if (frame_a->num_cmds != frame_b->num_cmds)
+                return false;
+            for (int i = 0; i < frame_a->num_cmds; i++) {
+                if (!move_delta_equal(&frame_a->moves[i], &frame_b->moves[i]))
+                    return false;
+            }
+        }
+        return true;
+    case Q2P_CLC_USERINFO:
+        return string_equal(&a->userinfo.str, &b->userinfo.str);
+    case Q2P_CLC_STRINGCMD:
+        return string_equal(&a->stringcmd.cmd, &b->stringcmd.cmd);
+    case Q2P_CLC_SETTING:
+        return a->setting.index == b->setting.index && a->setting.value == b->setting.value;
+    case Q2P_CLC_USERINFO_DELTA:
+        return string_equal(&a->userinfo_delta.name, &b->userinfo_delta.name)
+               && string_equal(&a->userinfo_delta.value, &b->userinfo_delta.value);
+    default:
+        return true;
+    }
+}
+
+// Generate client messages, read them back with the server context
+static bool roundtrip_clc(const char *name, q2proto_clientcontext_t *client_context, roundtrip_buffer_t *clc_stream)
+{
+    num_clc_messages = 0;
+    clc_stream->size = 0;
+    clc_stream->err = Q2P_ERR_SUCCESS;
+    for (int i = 0; i < NUM_CLC_MESSAGES; i++) {
+        q2proto_clc_message_t *message = &clc_messages[num_clc_messages];
+        random_clc_message(client_context, message);
+        size_t mark = clc_stream->size;
+        q2proto_error_t err = q2proto_client_write(client_context, roundtrip_io_arg(clc_stream), message);
+        // Messages not supported by the protocol are skipped
+        if (err != Q2P_ERR_SUCCESS) {
+            clc_stream->size = mark;
+            clc_stream->err = Q2P_ERR_SUCCESS;
+            continue;
+        }
+        if (clc_stream->size > mark)
+            num_clc_messages++;
+    }
+
+    roundtrip_buffer_t in;
+    roundtrip_buffer_init_read(&in, clc_stream->data, clc_stream->size);
+    size_t num_read = 0;
+    while (true) {
+        q2proto_clc_message_t message;
+        q2proto_error_t err = q2proto_server_read(&server_context, roundtrip_io_arg(&in), &message);
+        if (err == Q2P_ERR_NO_MORE_INPUT)
+            break;
+        if (err != Q2P_ERR_SUCCESS) {
+            CHECK(false, "%s: clc read failed at offset %zu: %s", name, in.pos, q2proto_error_string(err));
+            return false;
+        }
+        if (num_read >= num_clc_messages) {
+            CHECK(false, "%s: unexpected clc message %s", name, q2proto_clc_message_str(message.type));
+            return false;
+        }
+        const q2proto_clc_message_t *expected = &clc_messages[num_read++];
+        CHECK(clc_message_equal(&message, expected), "%s: clc message %zu (%s, expected %s) mismatch", name,
+              num_read - 1, q2proto_clc_message_str(message.type), q2proto_clc_message_str(expected->type));
+    }
+    CHECK(num_read == num_clc_messages, "%s: %zu of %zu clc messages read", name, num_read, num_clc_messages);
+    return true;
+}
+
+static void save_file(const char *dir, const char *prefix, const char *name, const char *ext, uint8_t selector,
+                      bool with_selector, const roundtrip_buffer_t *buf)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s_%s.%s", dir, prefix, name, ext);
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        CHECK(false, "failed to open %s", path);
+        return;
+    }
+    bool ok = !with_selector || fwrite(&selector, 1, 1, f) == 1;
+    ok &= fwrite(buf->data, 1, buf->size, f) == buf->size;
+    ok &= fclose(f) == 0;
+    CHECK(ok, "failed to write %s", path);
+}
+
+static void roundtrip_protocol(q2proto_protocol_t protocol, int network_index, const char *corpus_dir)
+{
+    const char *name = protocol_name(protocol);
+    q2proto_error_t err = init_server_context(&server_context, protocol);
+    if (err == Q2P_ERR_SUCCESS)
+        err = init_server_context(&mirror_context, protocol);
+    if (err != Q2P_ERR_SUCCESS) {
+        CHECK(false, "%s: context init failed: %s", name, q2proto_error_string(err));
+        return;
+    }
+
+    if (!write_svc_stream()) {
+        CHECK(false, "%s: writing messages failed", name);
+        return;
+    }
+
+    q2proto_clientcontext_t client_context;
+    err = q2proto_init_clientcontext(&client_context);
+    if (err != Q2P_ERR_SUCCESS) {
+        CHECK(false, "%s: client context init failed: %s", name, q2proto_error_string(err));
+        return;
+    }
+    if (!read_svc_stream(name, &client_context))
+        return;
+    CHECK(client_context.features.server_game_api == TEST_GAME_API, "%s: game API mismatch", name);
+    check_save_restore(name);
+    if (corpus_dir)
+        save_file(corpus_dir, "svc", name, "dm2", 0, false, &svc_stream);
+
+    // Client messages only apply to network protocols
+    if (network_index < 0)
+        return;
+    roundtrip_buffer_t clc_stream;
+    if (!roundtrip_buffer_init(&clc_stream, STREAM_CAPACITY)) {
+        CHECK(false, "out of memory");
+        return;
+    }
+    if (roundtrip_clc(name, &client_context, &clc_stream) && corpus_dir)
+        save_file(corpus_dir, "clc", name, "bin", network_index, true, &clc_stream);
+    roundtrip_buffer_free(&clc_stream);
+}
+
+int main(int argc, char **argv)
+{
+    const char *corpus_dir = argc > 1 ? argv[1] : NULL;
+
+    server_info.game_api = TEST_GAME_API;
+    server_info.default_packet_length = PACKET_LENGTH;
+
+    if (!roundtrip_buffer_init(&packet, PACKET_LENGTH) || !roundtrip_buffer_init(&svc_stream, STREAM_CAPACITY)
+        || !roundtrip_buffer_init(&scratch[0], SCRATCH_CAPACITY) || !roundtrip_buffer_init(&scratch[1], SCRATCH_CAPACITY))
+    {
+        printf("out of memory\n");
+        return 1;
+    }
+
+    make_world();
+
+    q2proto_protocol_t protocols[Q2P_NUM_PROTOCOLS];
+    size_t num_protocols = q2proto_get_protocols_for_gametypes(protocols, Q2P_NUM_PROTOCOLS, &server_info.game_api, 1);
+    if (num_protocols == 0) {
+        printf("no protocols for game API\n");
+        return 1;
+    }
+    for (size_t i = 0; i < num_protocols; i++)
+        roundtrip_protocol(protocols[i], (int)i, corpus_dir);
+    for (size_t i = 0; i < sizeof(demo_protocols) / sizeof(demo_protocols[0]); i++) {
+        bool is_network = false;
+        for (size_t j = 0; j < num_protocols; j++)
+            is_network |= demo_protocols[i] == protocols[j];
+        if (!is_network)
+            roundtrip_protocol(demo_protocols[i], -1, corpus_dir);
+    }
+
+    roundtrip_buffer_free(&scratch[1]);
+    roundtrip_buffer_free(&scratch[0]);
+    roundtrip_buffer_free(&svc_stream);
+    roundtrip_buffer_free(&packet);
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,246 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "roundtrip_io.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+bool roundtrip_buffer_init(roundtrip_buffer_t *buf, size_t capacity)
+{
+    memset(buf, 0, sizeof(*buf));
+    buf->data = malloc(capacity);
+    buf->capacity = buf->data ? capacity : 0;
+    return buf->data != NULL;
+}
+
+void roundtrip_buffer_init_read(roundtrip_buffer_t *buf, const void *data, size_t size)
+{
+    memset(buf, 0, sizeof(*buf));
+    buf->data = (uint8_t *)data;
+    buf->size = size;
+}
+
+void roundtrip_buffer_free(roundtrip_buffer_t *buf)
+{
+    if (buf->capacity > 0)
+        free(buf->data);
+    memset(buf, 0, sizeof(*buf));
+}
+
+void roundtrip_buffer_clear(roundtrip_buffer_t *buf)
+{
+    buf->size = 0;
+    buf->pos = 0;
+    buf->err = Q2P_ERR_SUCCESS;
+#if Q2PROTO_WRITE_RAW_SEGMENT
+    buf->num_segments = 0;
+    buf->segment_bytes = 0;
+#endif
+}
+
+#if Q2PROTO_WRITE_RAW_SEGMENT
+size_t roundtrip_buffer_gather(const roundtrip_buffer_t *buf, uint8_t *out)
+{
+    size_t pos = 0, out_size = 0;
+    for (size_t i = 0; i < buf->num_segments; i++) {
+        const roundtrip_segment_t *segment = &buf->segments[i];
+        memcpy(out + out_size, buf->data + pos, segment->pos - pos);
+        out_size += segment->pos - pos;
+        memcpy(out + out_size, segment->data, segment->size);
+        out_size += segment->size;
+        pos = segment->pos;
+    }
+    memcpy(out + out_size, buf->data + pos, buf->size - pos);
+    return out_size + buf->size - pos;
+}
+#endif
+
+q2proto_error_t q2protoio_get_error(uintptr_t io_arg)
+{
+    roundtrip_buffer_t *buf = (roundtrip_buffer_t *)io_arg;
+    q2proto_error_t err = buf->err;
+    buf->err = Q2P_ERR_SUCCESS;
+    return err;
+}
+
+// Return pointer to next \a size bytes to read, NULL if not enough data is available
+static const uint8_t *buffer_read(roundtrip_buffer_t *buf, size_t size)
+{
+    if (size > buf->size - buf->pos) {
+        buf->pos = buf->size;
+        buf->err = Q2P_ERR_IO_READ;
+        return NULL;
+    }
+    const uint8_t *p = buf->data + buf->pos;
+    buf->pos += size;
+    return p;
+}
+
+uint8_t q2protoio_read_u8(uintptr_t io_arg)
+{
+    const uint8_t *p = buffer_read((roundtrip_buffer_t *)io_arg, 1);
+    return p ? p[0] : (uint8_t)-1;
+}
+
+uint16_t q2protoio_read_u16(uintptr_t io_arg)
+{
+    const uint8_t *p = buffer_read((roundtrip_buffer_t *)io_arg, 2);
+    return p ? (uint16_t)(p[0] | (p[1] << 8)) : (uint16_t)-1;
+}
+
+uint32_t q2protoio_read_u32(uintptr_t io_arg)
+{
+    const uint8_t *p = buffer_read((roundtrip_buffer_t *)io_arg, 4);
+    return p ? p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24) : (uint32_t)-1;
+}
+
+uint64_t q2protoio_read_u64(uintptr_t io_arg)
+{
+    const uint8_t *p = buffer_read((roundtrip_buffer_t *)io_arg, 8);
+    if (!p)
+        return (uint64_t)-1;
+    uint64_t x = 0;
+    for (int i = 7; i >= 0; i--)
+        x = (x << 8) | p[i];
+    return x;
+}
+
+q2proto_string_t q2protoio_read_string(uintptr_t io_arg)
+{
+    roundtrip_buffer_t *buf = (roundtrip_buffer_t *)io_arg;
+    q2proto_string_t str = {.str = NULL, .len = 0};
+    if (buf->pos >= buf->size) {
+        buf->err = Q2P_ERR_IO_READ;
+        return str;
+    }
+    str.str = (const char *)buf->data + buf->pos;
+    const uint8_t *end = memchr(buf->data + buf->pos, 0, buf->size - buf->pos);
+    if (!end) {
+        str.len = buf->size - buf->pos;
+        buf->pos = buf->size;
+        buf->err = Q2P_ERR_IO_READ;
+        return str;
+    }
+    str.len = end - (buf->data + buf->pos);
+    buf->pos += str.len + 1;
+    return str;
+}
+
+const void *q2protoio_read_raw(uintptr_t io_arg, size_t size, size_t *readcount)
+{
+    roundtrip_buffer_t *buf = (roundtrip_buffer_t *)io_arg;
+    size_t n = size;
+    if (readcount && n > buf->size - buf->pos)
+        n = buf->size - buf->pos;
+    const void *p = buffer_read(buf, n);
+    if (readcount)
+        *readcount = p ? n : 0;
+    return p;
+}
+
+size_t q2protoio_read_available(uintptr_t io_arg)
+{
+    roundtrip_buffer_t *buf = (roundtrip_buffer_t *)io_arg;
+    return buf->size - buf->pos;
+}
+
+// Space left for writing
+static size_t buffer_available(const roundtrip_buffer_t *buf)
+{
+#if Q2PROTO_WRITE_RAW_SEGMENT
+    return buf->capacity - buf->size - buf->segment_bytes;
+#else
+    return buf->capacity - buf->size;
+#endif
+}
+
+static void *buffer_reserve(roundtrip_buffer_t *buf, size_t size)
+{
+    if (size > buffer_available(buf)) {
+        buf->err = Q2P_ERR_NOT_ENOUGH_PACKET_SPACE;
+        return NULL;
+    }
+    void *p = buf->data + buf->size;
+    buf->size += size;
+    return p;
+}
+
+void q2protoio_write_u8(uintptr_t io_arg, uint8_t x)
+{
+    uint8_t *p = buffer_reserve((roundtrip_buffer_t *)io_arg, 1);
+    if (p)
+        p[0] = x;
+}
+
+void q2protoio_write_u16(uintptr_t io_arg, uint16_t x)
+{
+    uint8_t *p = buffer_reserve((roundtrip_buffer_t *)io_arg, 2);
+    if (p) {
+        p[0] = x & 0xff;
+        p[1] = x >> 8;
+    }
+}
+
+void q2protoio_write_u32(uintptr_t io_arg, uint32_t x)
+{
+    q2protoio_write_u16(io_arg, x & 0xffff);
+    q2protoio_write_u16(io_arg, x >> 16);
+}
+
+void q2protoio_write_u64(uintptr_t io_arg, uint64_t x)
+{
+    q2protoio_write_u32(io_arg, x & 0xffffffff);
+    q2protoio_write_u32(io_arg, x >> 32);
+}
+
+void *q2protoio_write_reserve_raw(uintptr_t io_arg, size_t size)
+{
+    return buffer_reserve((roundtrip_buffer_t *)io_arg, size);
+}
+
+void q2protoio_write_raw(uintptr_t io_arg, const void *data, size_t size, size_t *written)
+{
+    roundtrip_buffer_t *buf = (roundtrip_buffer_t *)io_arg;
+    size_t n = size;
+    if (written && n > buffer_available(buf))
+        n = buffer_available(buf);
+    void *p = buffer_reserve(buf, n);
+    if (p && n > 0)
+        memcpy(p, data, n);
+    if (written)
+        *written = p ? n : 0;
+}
+
+size_t q2protoio_write_available(uintptr_t io_arg) { return buffer_available((roundtrip_buffer_t *)io_arg); }
+
+#if Q2PROTO_WRITE_RAW_SEGMENT
+void q2protoio_write_raw_segment(uintptr_t io_arg, const void *data, size_t size)
+{
+    roundtrip_buffer_t *buf = (roundtrip_buffer_t *)io_arg;
+    if (size > buffer_available(buf) || buf->num_segments >= ROUNDTRIP_MAX_SEGMENTS) {
+        buf->err = Q2P_ERR_NOT_ENOUGH_PACKET_SPACE;
+        return;
+    }
+    roundtrip_segment_t *segment = &buf->segments[buf->num_segments++];
+    segment->pos = buf->size;
+    segment->data = data;
+    segment->size = size;
+    buf->segment_bytes += size;
+}
+#endif
@@ -0,0 +1,89 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/* In-memory I/O for round trip tests and fuzzers: messages are written to and read from a flat buffer.
+ * Provides the q2protoio_read_* and q2protoio_write_* functions.
+ * If built with Q2PROTO_WRITE_RAW_SEGMENT, data written with q2protoio_write_raw_segment() is only referenced,
+ * like an iovec for sendmsg(), and put in place by roundtrip_buffer_gather(). */
+
+#ifndef ROUNDTRIP_IO_H_
+#define ROUNDTRIP_IO_H_
+
+#include "q2proto/q2proto.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if Q2PROTO_WRITE_RAW_SEGMENT
+/// Maximum number of segments per buffer
+#define ROUNDTRIP_MAX_SEGMENTS 16
+
+/// Data referenced by q2protoio_write_raw_segment()
+typedef struct roundtrip_segment_s {
+    /// Amount of buffer data preceding the segment
+    size_t pos;
+    /// Referenced data
+    const void *data;
+    /// Size of referenced data
+    size_t size;
+} roundtrip_segment_t;
+#endif
+
+/// Message buffer
+typedef struct roundtrip_buffer_s {
+    /// Buffer data
+    uint8_t *data;
+    /// Amount of data written to the buffer
+    size_t size;
+    /// Size of allocated data. Writing beyond it fails with Q2P_ERR_NOT_ENOUGH_PACKET_SPACE.
+    size_t capacity;
+    /// Read position
+    size_t pos;
+    /// Error of last I/O operation
+    q2proto_error_t err;
+#if Q2PROTO_WRITE_RAW_SEGMENT
+    /// Referenced data, in order of writing
+    roundtrip_segment_t segments[ROUNDTRIP_MAX_SEGMENTS];
+    /// Number of segments
+    size_t num_segments;
+    /// Total size of segments. Counts against the capacity.
+    size_t segment_bytes;
+#endif
+} roundtrip_buffer_t;
+
+/// Set up a buffer for writing, with the given capacity. Returns \c false if allocation failed.
+bool roundtrip_buffer_init(roundtrip_buffer_t *buf, size_t capacity);
+/// Set up a buffer for reading the given data. The data is referenced, not copied.
+void roundtrip_buffer_init_read(roundtrip_buffer_t *buf, const void *data, size_t size);
+/// Free data allocated by roundtrip_buffer_init().
+void roundtrip_buffer_free(roundtrip_buffer_t *buf);
+/// Discard written data, to start writing a new packet
+void roundtrip_buffer_clear(roundtrip_buffer_t *buf);
+#if Q2PROTO_WRITE_RAW_SEGMENT
+/**
+ * Copy written data, with segments in place, to \a out, which must be large enough for the buffer capacity.
+ * Returns the size of the data.
+ */
+size_t roundtrip_buffer_gather(const roundtrip_buffer_t *buf, uint8_t *out);
+#endif
+
+/// Return I/O argument for a buffer
+static inline uintptr_t roundtrip_io_arg(roundtrip_buffer_t *buf) { return (uintptr_t)buf; }
+
+#endif // ROUNDTRIP_IO_H_
@@ -0,0 +1,164 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "roundtrip_state.h"
+
+#define Q2P_PACK_ENTITY_FUNCTION_NAME            roundtrip_pack_entity
+#define Q2P_PACK_ENTITY_TYPE                     roundtrip_entity_state_t *
+#define Q2P_PACK_ENTITY_IF_CHANGED_FUNCTION_NAME roundtrip_pack_entity_if_changed
+
+#include "q2proto/q2proto_packing_entitystate_impl.inc"
+
+#define Q2P_PACK_PLAYER_FUNCTION_NAME     roundtrip_pack_player
+#define Q2P_PACK_PLAYER_TYPE              roundtrip_player_state_t *
+#define Q2P_PACK_PLAYER_STATS_NUM(PLAYER) ((PLAYER)->num_stats)
+
+#include "q2proto/q2proto_packing_playerstate_impl.inc"
+
+void roundtrip_apply_entity_delta(roundtrip_entity_state_t *state, const q2proto_entity_state_delta_t *delta)
+{
+    if (delta->delta_bits & Q2P_ESD_MODELINDEX)
+        state->modelindex = delta->modelindex;
+    if (delta->delta_bits & Q2P_ESD_MODELINDEX2)
+        state->modelindex2 = delta->modelindex2;
+    if (delta->delta_bits & Q2P_ESD_MODELINDEX3)
+        state->modelindex3 = delta->modelindex3;
+    if (delta->delta_bits & Q2P_ESD_MODELINDEX4)
+        state->modelindex4 = delta->modelindex4;
+    if (delta->delta_bits & Q2P_ESD_FRAME)
+        state->frame = delta->frame;
+    if (delta->delta_bits & Q2P_ESD_SKINNUM)
+        state->skinnum = delta->skinnum;
+    if (delta->delta_bits & Q2P_ESD_EFFECTS)
+        state->effects = (state->effects & ~0xffffffffull) | delta->effects;
+#if Q2PROTO_ENTITY_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_ENTITY_LOOP_ALPHA_SCALE_FX64
+    if (delta->delta_bits & Q2P_ESD_EFFECTS_MORE)
+        state->effects = (state->effects & 0xffffffffull) | ((uint64_t)delta->effects_more << 32);
+#endif
+    if (delta->delta_bits & Q2P_ESD_RENDERFX)
+        state->renderfx = delta->renderfx;
+    q2proto_maybe_read_diff_apply_float(&delta->origin, state->origin);
+    for (int c = 0; c < 3; c++) {
+        if (delta->angle.delta_bits & (1 << c))
+            state->angles[c] = q2proto_var_angles_get_float_comp(&delta->angle.values, c);
+    }
+    if (delta->delta_bits & Q2P_ESD_OLD_ORIGIN)
+        q2proto_var_coords_get_float(&delta->old_origin, state->old_origin);
+    if (delta->delta_bits & Q2P_ESD_SOUND)
+        state->sound = delta->sound;
+#if Q2PROTO_ENTITY_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_ENTITY_LOOP_ALPHA_SCALE_FX64
+    if (delta->delta_bits & Q2P_ESD_LOOP_VOLUME)
+        state->loop_volume = delta->loop_volume / 255.f;
+    if (delta->delta_bits & Q2P_ESD_LOOP_ATTENUATION)
+        state->loop_attenuation = q2proto_sound_decode_loop_attenuation(delta->loop_attenuation);
+#endif
+    // Events only last a single frame
+    state->event = (delta->delta_bits & Q2P_ESD_EVENT) ? delta->event : 0;
+    if (delta->delta_bits & Q2P_ESD_SOLID)
+        state->solid = delta->solid;
+#if Q2PROTO_ENTITY_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_ENTITY_LOOP_ALPHA_SCALE_FX64
+    if (delta->delta_bits & Q2P_ESD_ALPHA)
+        state->alpha = delta->alpha / 255.f;
+    if (delta->delta_bits & Q2P_ESD_SCALE)
+        state->scale = delta->scale / 16.f;
+#endif
+}
+
+void roundtrip_apply_player_delta(roundtrip_player_state_t *state, const q2proto_svc_playerstate_t *delta)
+{
+    if (delta->delta_bits & Q2P_PSD_PM_TYPE)
+        state->pmove.pm_type = delta->pm_type;
+    q2proto_maybe_read_diff_apply_float(&delta->pm_origin, state->pmove.origin);
+    q2proto_maybe_read_diff_apply_float(&delta->pm_velocity, state->pmove.velocity);
+    if (delta->delta_bits & Q2P_PSD_PM_TIME)
+        state->pmove.pm_time = delta->pm_time;
+    if (delta->delta_bits & Q2P_PSD_PM_FLAGS)
+        state->pmove.pm_flags = delta->pm_flags;
+    if (delta->delta_bits & Q2P_PSD_PM_GRAVITY)
+        state->pmove.gravity = delta->pm_gravity;
+    if (delta->delta_bits & Q2P_PSD_PM_DELTA_ANGLES)
+        q2proto_var_angles_get_float(&delta->pm_delta_angles, state->pmove.delta_angles);
+#if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_GUNRATE_VIEWHEIGHT
+    if (delta->delta_bits & Q2P_PSD_PM_VIEWHEIGHT)
+        state->pmove.viewheight = delta->pm_viewheight;
+#endif
+    if (delta->delta_bits & Q2P_PSD_VIEWOFFSET)
+        q2proto_var_small_offsets_get_float(&delta->viewoffset, state->viewoffset);
+    if (delta->delta_bits & Q2P_PSD_KICKANGLES)
+        q2proto_var_small_angles_get_float(&delta->kick_angles, state->kick_angles);
+    for (int c = 0; c < 3; c++) {
+        if (delta->viewangles.delta_bits & (1 << c))
+            state->viewangles[c] = q2proto_var_angles_get_float_comp(&delta->viewangles.values, c);
+        if (delta->gunoffset.delta_bits & (1 << c))
+            state->gunoffset[c] = q2proto_var_small_offsets_get_float_comp(&delta->gunoffset.values, c);
+        if (delta->gunangles.delta_bits & (1 << c))
+            state->gunangles[c] = q2proto_var_small_angles_get_float_comp(&delta->gunangles.values, c);
+    }
+    if (delta->delta_bits & Q2P_PSD_GUNINDEX)
+        state->gunindex = delta->gunindex;
+#if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_GUNSKIN
+    if (delta->delta_bits & Q2P_PSD_GUNSKIN)
+        state->gunskin = delta->gunskin;
+#endif
+    if (delta->delta_bits & Q2P_PSD_GUNFRAME)
+        state->gunframe = delta->gunframe;
+    for (int c = 0; c < 4; c++) {
+        if (delta->blend.delta_bits & (1 << c))
+            state->blend[c] = q2proto_var_color_get_float_comp(&delta->blend.values, c);
+#if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_DAMAGE_BLEND
+        if (delta->damage_blend.delta_bits & (1 << c))
+            state->damage_blend[c] = q2proto_var_color_get_float_comp(&delta->damage_blend.values, c);
+#endif
+    }
+    if (delta->delta_bits & Q2P_PSD_FOV)
+        state->fov = delta->fov;
+    if (delta->delta_bits & Q2P_PSD_RDFLAGS)
+        state->rdflags = delta->rdflags;
+    for (int i = 0; i < Q2PROTO_STATS; i++) {
+        if (delta->statbits & (1ull << i))
+            state->stats[i] = delta->stats[i];
+    }
+#if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_GUNRATE_VIEWHEIGHT
+    if (delta->delta_bits & Q2P_PSD_GUNRATE)
+        state->gunrate = delta->gunrate;
+#endif
+
+#if Q2PROTO_PLAYER_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_PLAYER_FOG
+    const q2proto_svc_fog_t *fog = &delta->fog;
+    if (fog->flags & Q2P_FOG_DENSITY_SKYFACTOR) {
+        state->fog.density = q2proto_var_fraction_get_float(&fog->global.density);
+        state->fog.sky_factor = q2proto_var_fraction_get_float(&fog->global.skyfactor);
+    }
+    if (fog->flags & Q2P_HEIGHTFOG_FALLOFF)
+        state->heightfog.falloff = q2proto_var_fraction_get_float(&fog->height.falloff);
+    if (fog->flags & Q2P_HEIGHTFOG_DENSITY)
+        state->heightfog.density = q2proto_var_fraction_get_float(&fog->height.density);
+    if (fog->flags & Q2P_HEIGHTFOG_START_DIST)
+        state->heightfog.start_dist = q2proto_var_coord_get_float(&fog->height.start_dist);
+    if (fog->flags & Q2P_HEIGHTFOG_END_DIST)
+        state->heightfog.end_dist = q2proto_var_coord_get_float(&fog->height.end_dist);
+    for (int c = 0; c < 3; c++) {
+        if (fog->global.color.delta_bits & (1 << c))
+            state->fog.color[c] = q2proto_var_color_get_float_comp(&fog->global.color.values, c);
+        if (fog->height.start_color.delta_bits & (1 << c))
+            state->heightfog.start_color[c] = q2proto_var_color_get_float_comp(&fog->height.start_color.values, c);
+        if (fog->height.end_color.delta_bits & (1 << c))
+            state->heightfog.end_color[c] = q2proto_var_color_get_float_comp(&fog->height.end_color.values, c);
+    }
+#endif
+}
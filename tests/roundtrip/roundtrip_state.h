@@ -0,0 +1,118 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/* Entity and player states in "game" representation, as the server packs them and as the client
+ * reconstructs them from deltas. */
+
+#ifndef ROUNDTRIP_STATE_H_
+#define ROUNDTRIP_STATE_H_
+
+#include "q2proto/q2proto.h"
+
+/// Game API matching the state features of the build flavor
+#if Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_RERELEASE
+    #define TEST_GAME_API Q2PROTO_GAME_RERELEASE
+#elif Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_Q2PRO_EXTENDED_V2
+    #define TEST_GAME_API Q2PROTO_GAME_Q2PRO_EXTENDED_V2
+#elif Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_Q2PRO_EXTENDED
+    #define TEST_GAME_API Q2PROTO_GAME_Q2PRO_EXTENDED
+#else
+    #define TEST_GAME_API Q2PROTO_GAME_VANILLA
+#endif
+
+/// Entity state, in "game" representation
+typedef struct roundtrip_entity_state_s {
+    uint16_t modelindex;
+    uint16_t modelindex2;
+    uint16_t modelindex3;
+    uint16_t modelindex4;
+    uint16_t frame;
+    uint32_t skinnum;
+    uint64_t effects;
+    uint32_t renderfx;
+    q2proto_vec3_t origin;
+    q2proto_vec3_t angles;
+    q2proto_vec3_t old_origin;
+    uint16_t sound;
+    float loop_volume;
+    float loop_attenuation;
+    uint8_t event;
+    uint32_t solid;
+    float alpha;
+    float scale;
+} roundtrip_entity_state_t;
+
+/// Player state, in "game" representation
+typedef struct roundtrip_player_state_s {
+    struct {
+        uint8_t pm_type;
+        q2proto_vec3_t origin;
+        q2proto_vec3_t velocity;
+        uint16_t pm_time;
+        uint16_t pm_flags;
+        int16_t gravity;
+        q2proto_vec3_t delta_angles;
+        int8_t viewheight;
+    } pmove;
+    q2proto_vec3_t viewoffset;
+    q2proto_vec3_t viewangles;
+    q2proto_vec3_t kick_angles;
+    uint16_t gunindex;
+    uint8_t gunskin;
+    uint16_t gunframe;
+    q2proto_vec3_t gunoffset;
+    q2proto_vec3_t gunangles;
+    float blend[4];
+    float damage_blend[4];
+    uint8_t fov;
+    uint8_t rdflags;
+    int16_t stats[Q2PROTO_STATS];
+    /// Number of stats supported by the game API
+    int num_stats;
+    uint8_t gunrate;
+    struct {
+        float color[3];
+        float density;
+        float sky_factor;
+    } fog;
+    struct {
+        float start_color[3];
+        float end_color[3];
+        float density;
+        float falloff;
+        float start_dist;
+        float end_dist;
+    } heightfog;
+} roundtrip_player_state_t;
+
+/// Pack an entity state for the given server context
+void roundtrip_pack_entity(q2proto_servercontext_t *context, const roundtrip_entity_state_t *entity_state,
+                           q2proto_packed_entity_state_t *entity_packed);
+/// Pack an entity state for the given server context, if it changed since the last call
+bool roundtrip_pack_entity_if_changed(q2proto_servercontext_t *context, const roundtrip_entity_state_t *entity_state,
+                                      q2proto_entity_pack_cache_t *cache, q2proto_packed_entity_state_t *entity_packed);
+/// Pack a player state for the given server context
+void roundtrip_pack_player(q2proto_servercontext_t *context, const roundtrip_player_state_t *player_state,
+                           q2proto_packed_player_state_t *player_packed);
+
+/// Apply an entity state delta, as read by a client, to an entity state
+void roundtrip_apply_entity_delta(roundtrip_entity_state_t *state, const q2proto_entity_state_delta_t *delta);
+/// Apply a player state delta, as read by a client, to a player state
+void roundtrip_apply_player_delta(roundtrip_player_state_t *state, const q2proto_svc_playerstate_t *delta);
+
+#endif // ROUNDTRIP_STATE_H_
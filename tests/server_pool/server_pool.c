@@ -0,0 +1,153 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "q2proto/q2proto.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Server context pool test: acquires contexts until the pool is exhausted, releases and reacquires them,
+ * and checks that failed setups and invalid releases leave the pool unchanged.
+ */
+
+#if Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_RERELEASE
+    #define TEST_GAME_API Q2PROTO_GAME_RERELEASE
+#elif Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_Q2PRO_EXTENDED_V2
+    #define TEST_GAME_API Q2PROTO_GAME_Q2PRO_EXTENDED_V2
+#elif Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_Q2PRO_EXTENDED
+    #define TEST_GAME_API Q2PROTO_GAME_Q2PRO_EXTENDED
+#else
+    #define TEST_GAME_API Q2PROTO_GAME_VANILLA
+#endif
+
+#define POOL_SIZE 4
+
+static int failures;
+
+#define CHECK(COND, ...)         \
+    do {                         \
+        if (!(COND)) {           \
+            printf(__VA_ARGS__); \
+            printf("\n");        \
+            failures++;          \
+        }                        \
+    } while (0)
+
+static q2proto_servercontext_t pool_contexts[POOL_SIZE];
+static uint32_t pool_free_indices[POOL_SIZE];
+
+static q2proto_server_info_t server_info;
+
+static void make_connect(q2proto_connect_t *connect, q2proto_protocol_t protocol)
+{
+    memset(connect, 0, sizeof(*connect));
+    connect->protocol = protocol;
+    connect->qport = 1234;
+    connect->challenge = 5678;
+    connect->userinfo = q2proto_make_string("\\name\\pool");
+    connect->packet_length = 1390;
+}
+
+int main(void)
+{
+    server_info.game_api = TEST_GAME_API;
+    server_info.default_packet_length = 1390;
+
+    q2proto_protocol_t protocols[Q2P_NUM_PROTOCOLS];
+    size_t num_protocols = q2proto_get_protocols_for_gametypes(protocols, Q2P_NUM_PROTOCOLS, &server_info.game_api, 1);
+    if (num_protocols == 0) {
+        printf("no protocols for game API\n");
+        return 1;
+    }
+
+    q2proto_servercontext_pool_t pool;
+    q2proto_servercontext_pool_init(&pool, pool_contexts, pool_free_indices, POOL_SIZE);
+    CHECK(q2proto_servercontext_pool_num_free(&pool) == POOL_SIZE, "init: %zu contexts free",
+          q2proto_servercontext_pool_num_free(&pool));
+
+    // Acquire until exhausted, using all protocols in turn
+    q2proto_servercontext_t *acquired[POOL_SIZE];
+    for (size_t i = 0; i < POOL_SIZE; i++) {
+        q2proto_connect_t connect;
+        make_connect(&connect, protocols[i % num_protocols]);
+        q2proto_error_t err = q2proto_complete_connect(&connect);
+        if (err == Q2P_ERR_SUCCESS)
+            err = q2proto_servercontext_pool_acquire(&pool, &server_info, &connect, &acquired[i]);
+        CHECK(err == Q2P_ERR_SUCCESS, "acquire %zu: %s", i, q2proto_error_string(err));
+        if (err != Q2P_ERR_SUCCESS)
+            return 1;
+        CHECK(acquired[i] == &pool_contexts[i], "acquire %zu: got context %td", i, acquired[i] - pool_contexts);
+        CHECK(q2proto_servercontext_pool_num_free(&pool) == POOL_SIZE - 1 - i, "acquire %zu: %zu contexts free", i,
+              q2proto_servercontext_pool_num_free(&pool));
+    }
+
+    q2proto_connect_t connect;
+    make_connect(&connect, protocols[0]);
+    q2proto_complete_connect(&connect);
+    q2proto_servercontext_t *context = &pool_contexts[0];
+    q2proto_error_t err = q2proto_servercontext_pool_acquire(&pool, &server_info, &connect, &context);
+    CHECK(err == Q2P_ERR_BUFFER_TOO_SMALL, "exhausted: unexpected result %s", q2proto_error_string(err));
+    CHECK(context == NULL, "exhausted: context returned");
+
+    // Released contexts are handed out again, freshly set up
+    acquired[2]->trace_id = 42;
+    err = q2proto_servercontext_pool_release(&pool, acquired[2]);
+    CHECK(err == Q2P_ERR_SUCCESS, "release: %s", q2proto_error_string(err));
+    CHECK(q2proto_servercontext_pool_num_free(&pool) == 1, "release: %zu contexts free",
+          q2proto_servercontext_pool_num_free(&pool));
+    err = q2proto_servercontext_pool_acquire(&pool, &server_info, &connect, &context);
+    CHECK(err == Q2P_ERR_SUCCESS && context == acquired[2], "reacquire: %s, context %td", q2proto_error_string(err),
+          context ? context - pool_contexts : -1);
+    CHECK(context == NULL || context->trace_id == 0, "reacquire: context not set up");
+    CHECK(q2proto_servercontext_pool_num_free(&pool) == 0, "reacquire: %zu contexts free",
+          q2proto_servercontext_pool_num_free(&pool));
+
+    // Contexts not belonging to the pool are refused
+    q2proto_servercontext_t foreign_context;
+    err = q2proto_servercontext_pool_release(&pool, &foreign_context);
+    CHECK(err == Q2P_ERR_INVALID_ARGUMENT, "foreign release: unexpected result %s", q2proto_error_string(err));
+    CHECK(q2proto_servercontext_pool_num_free(&pool) == 0, "foreign release: %zu contexts free",
+          q2proto_servercontext_pool_num_free(&pool));
+
+    // Release all; the most recently released context is handed out first
+    for (size_t i = 0; i < POOL_SIZE; i++) {
+        err = q2proto_servercontext_pool_release(&pool, acquired[i]);
+        CHECK(err == Q2P_ERR_SUCCESS, "release %zu: %s", i, q2proto_error_string(err));
+    }
+    CHECK(q2proto_servercontext_pool_num_free(&pool) == POOL_SIZE, "release all: %zu contexts free",
+          q2proto_servercontext_pool_num_free(&pool));
+    err = q2proto_servercontext_pool_release(&pool, acquired[0]);
+    CHECK(err == Q2P_ERR_INVALID_ARGUMENT, "release to full pool: unexpected result %s", q2proto_error_string(err));
+
+    // A failed setup returns the context to the pool
+    q2proto_connect_t bad_connect;
+    make_connect(&bad_connect, Q2P_PROTOCOL_INVALID);
+    context = &pool_contexts[0];
+    err = q2proto_servercontext_pool_acquire(&pool, &server_info, &bad_connect, &context);
+    CHECK(err != Q2P_ERR_SUCCESS, "bad setup: acquire succeeded");
+    CHECK(context == NULL, "bad setup: context returned");
+    CHECK(q2proto_servercontext_pool_num_free(&pool) == POOL_SIZE, "bad setup: %zu contexts free",
+          q2proto_servercontext_pool_num_free(&pool));
+
+    err = q2proto_servercontext_pool_acquire(&pool, &server_info, &connect, &context);
+    CHECK(err == Q2P_ERR_SUCCESS && context == acquired[POOL_SIZE - 1], "acquire after release: %s, context %td",
+          q2proto_error_string(err), context ? context - pool_contexts : -1);
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,599 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "q2proto/q2proto.h"
+
+#include "../roundtrip/roundtrip_io.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Snapshot test: for every protocol usable with the game API, generate a sequence of random snapshots and check
+ * - frame size estimates against the size of the entity deltas actually written (plus the player state size),
+ *   with and without delta frame, baselines and visibility bits,
+ * - that the delta frame selection picks the candidate with the smallest estimate, preferring earlier candidates
+ *   on ties,
+ * - that a snapshot ring buffer, filled with the frames for a few clients with different visibility, resolves to
+ *   the same snapshots as ones built by hand, and keeps frames only as long as expected.
+ */
+
+#if Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_RERELEASE
+    #define TEST_GAME_API Q2PROTO_GAME_RERELEASE
+#elif Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_Q2PRO_EXTENDED_V2
+    #define TEST_GAME_API Q2PROTO_GAME_Q2PRO_EXTENDED_V2
+#elif Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_Q2PRO_EXTENDED
+    #define TEST_GAME_API Q2PROTO_GAME_Q2PRO_EXTENDED
+#else
+    #define TEST_GAME_API Q2PROTO_GAME_VANILLA
+#endif
+
+#define NUM_FRAMES    16
+#define NUM_SLOTS     64
+#define NUM_BASELINES 128
+#define MAX_OUTPUT    0x8000
+#define RING_FRAMES   4
+#define NUM_CLIENTS   3
+#define FIRST_FRAME   100
+
+static int failures;
+
+#define CHECK(COND, ...)         \
+    do {                         \
+        if (!(COND)) {           \
+            printf(__VA_ARGS__); \
+            printf("\n");        \
+            failures++;          \
+        }                        \
+    } while (0)
+
+static uint64_t rng_state = 0x2545f4914f6cdd1dULL;
+
+static uint32_t rng_next(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t)(rng_state >> 16);
+}
+
+static int32_t random_range(int32_t min, int32_t max) { return min + (int32_t)(rng_next() % (uint32_t)(max - min + 1)); }
+
+static bool random_chance(unsigned one_in) { return rng_next() % one_in == 0; }
+
+static void set_entity_visible(q2proto_entity_bits bits, unsigned entnum)
+{
+    bits[entnum >> 5] |= 1u << (entnum & 0x1f);
+}
+
+static bool get_entity_visible(const q2proto_entity_bits bits, unsigned entnum)
+{
+    return (bits[entnum >> 5] & (1u << (entnum & 0x1f))) != 0;
+}
+
+// A generated frame: entities present, and their states
+typedef struct test_frame_s {
+    q2proto_packed_player_state_t player_state;
+    size_t num_entities;
+    uint16_t entnums[NUM_SLOTS];
+    q2proto_packed_entity_state_t entities[NUM_SLOTS];
+    // Random visibility bits, for filtered snapshots
+    q2proto_entity_bits visible;
+    // Visible entities only
+    size_t num_visible;
+    uint16_t visible_entnums[NUM_SLOTS];
+    q2proto_packed_entity_state_t visible_entities[NUM_SLOTS];
+} test_frame_t;
+
+static test_frame_t frames[NUM_FRAMES];
+static q2proto_packed_entity_state_t baseline_states[NUM_BASELINES];
+
+// A client's view of a generated frame, for the snapshot ring
+typedef struct test_client_frame_s {
+    // Whether the client is set in the frame
+    bool set;
+    q2proto_packed_player_state_t player_state;
+    // Visibility bits, as passed to the ring; may include entities not in the frame
+    q2proto_entity_bits visible;
+    // Visible entities only
+    size_t num_entities;
+    uint16_t entnums[NUM_SLOTS];
+    q2proto_packed_entity_state_t entities[NUM_SLOTS];
+} test_client_frame_t;
+
+static test_client_frame_t client_frames[NUM_FRAMES][NUM_CLIENTS];
+
+static void random_entity(q2proto_packed_entity_state_t *ent)
+{
+    memset(ent, 0, sizeof(*ent));
+    ent->modelindex = random_range(1, 255);
+    ent->frame = random_range(0, 255);
+    ent->skinnum = random_range(0, 15);
+    ent->solid = random_range(0, 0xffff);
+    for (int i = 0; i < 3; i++) {
+        ent->origin[i] = random_range(-32768, 32767);
+        ent->angles[i] = random_chance(2) ? random_range(0, 65535) : 0;
+    }
+}
+
+/* Entities occupy random slots, with entity numbers 2 * slot + 1 (so baselines are reached for some entities only).
+ * Between frames, entities may appear, disappear, change or stay the same. */
+static void make_frames(void)
+{
+    static q2proto_packed_entity_state_t slot_states[NUM_SLOTS];
+    bool slot_used[NUM_SLOTS] = {0};
+    for (int s = 0; s < NUM_SLOTS; s++) {
+        random_entity(&slot_states[s]);
+        slot_used[s] = random_chance(2);
+    }
+    for (int b = 0; b < NUM_BASELINES; b++) {
+        if (random_chance(2))
+            random_entity(&baseline_states[b]);
+        else
+            memset(&baseline_states[b], 0, sizeof(baseline_states[b]));
+    }
+
+    for (int f = 0; f < NUM_FRAMES; f++) {
+        test_frame_t *frame = &frames[f];
+        memset(frame, 0, sizeof(*frame));
+        if (f > 0)
+            frame->player_state = frames[f - 1].player_state;
+        for (int i = 0; i < 3; i++) {
+            frame->player_state.pm_origin[i] += random_range(-64, 64);
+            frame->player_state.viewangles[i] = random_range(-32768, 32767);
+        }
+        frame->player_state.stats[random_range(0, 31)] = random_range(0, 1000);
+
+        for (int s = 0; s < NUM_SLOTS; s++) {
+            if (random_chance(8)) {
+                slot_used[s] = !slot_used[s];
+                random_entity(&slot_states[s]);
+            } else if (random_chance(2)) {
+                memcpy(slot_states[s].old_origin, slot_states[s].origin, sizeof(slot_states[s].origin));
+                slot_states[s].origin[random_range(0, 2)] += random_range(1, 100);
+                slot_states[s].frame = (slot_states[s].frame + 1) % 256;
+            }
+            if (!slot_used[s])
+                continue;
+            uint16_t entnum = 2 * s + 1;
+            frame->entnums[frame->num_entities] = entnum;
+            frame->entities[frame->num_entities] = slot_states[s];
+            frame->num_entities++;
+            if (random_chance(4))
+                continue;
+            set_entity_visible(frame->visible, entnum);
+            frame->visible_entnums[frame->num_visible] = entnum;
+            frame->visible_entities[frame->num_visible] = slot_states[s];
+            frame->num_visible++;
+        }
+    }
+}
+
+/* Client 0 sees the visible entities of the frame, client 1 sees all entities, client 2 sees a random set of
+ * entities (including some not in the frame) and misses every third frame.
+ * Every client has a different player state. */
+static void make_client_frames(void)
+{
+    for (int f = 0; f < NUM_FRAMES; f++) {
+        const test_frame_t *frame = &frames[f];
+        for (int c = 0; c < NUM_CLIENTS; c++) {
+            test_client_frame_t *client_frame = &client_frames[f][c];
+            memset(client_frame, 0, sizeof(*client_frame));
+            client_frame->set = c != 2 || f % 3 != 2;
+            client_frame->player_state = frames[(f + c) % NUM_FRAMES].player_state;
+            if (c == 0)
+                memcpy(client_frame->visible, frame->visible, sizeof(client_frame->visible));
+            for (int s = 0; s < NUM_SLOTS; s++) {
+                if (c == 1 || (c == 2 && random_chance(2)))
+                    set_entity_visible(client_frame->visible, 2 * s + 1);
+                if (c == 2 && random_chance(4))
+                    set_entity_visible(client_frame->visible, 2 * s);
+            }
+            for (size_t i = 0; i < frame->num_entities; i++) {
+                if (!get_entity_visible(client_frame->visible, frame->entnums[i]))
+                    continue;
+                client_frame->entnums[client_frame->num_entities] = frame->entnums[i];
+                client_frame->entities[client_frame->num_entities] = frame->entities[i];
+                client_frame->num_entities++;
+            }
+        }
+    }
+}
+
+static q2proto_packed_snapshot_t make_snapshot(int f)
+{
+    q2proto_packed_snapshot_t snapshot = {.serverframe = f,
+                                          .player_state = &frames[f].player_state,
+                                          .num_entities = frames[f].num_entities,
+                                          .entnums = frames[f].entnums,
+                                          .entities = frames[f].entities};
+    return snapshot;
+}
+
+// Snapshot with all entities, filtered by visibility bits
+static q2proto_packed_snapshot_t make_filtered_snapshot(int f)
+{
+    q2proto_packed_snapshot_t snapshot = make_snapshot(f);
+    snapshot.visible = frames[f].visible;
+    return snapshot;
+}
+
+// Snapshot with just the visible entities
+static q2proto_packed_snapshot_t make_visible_snapshot(int f)
+{
+    q2proto_packed_snapshot_t snapshot = {.serverframe = f,
+                                          .player_state = &frames[f].player_state,
+                                          .num_entities = frames[f].num_visible,
+                                          .entnums = frames[f].visible_entnums,
+                                          .entities = frames[f].visible_entities};
+    return snapshot;
+}
+
+static q2proto_error_t write_entity_delta(q2proto_servercontext_t *context, roundtrip_buffer_t *buf, uint16_t entnum,
+                                          const q2proto_packed_entity_state_t *from,
+                                          const q2proto_packed_entity_state_t *to, bool write_old_origin)
+{
+    q2proto_svc_message_t message = {.type = Q2P_SVC_FRAME_ENTITY_DELTA, .frame_entity_delta = {0}};
+    message.frame_entity_delta.newnum = entnum;
+    if (to)
+        q2proto_server_make_entity_state_delta(context, from, to, write_old_origin,
+                                               &message.frame_entity_delta.entity_delta);
+    else
+        message.frame_entity_delta.remove = true;
+    return q2proto_server_write(context, roundtrip_io_arg(buf), &message);
+}
+
+/* Size of a frame written like the estimate describes it: entering entities are delta'd from their baseline,
+ * with old origin; leaving entities are removed; unchanged entities are skipped.
+ * Snapshots must not use visibility bits. */
+static bool written_frame_size(q2proto_servercontext_t *context, const q2proto_packed_snapshot_t *from,
+                               const q2proto_packed_snapshot_t *to, const q2proto_packed_baselines_t *baselines,
+                               roundtrip_buffer_t *buf, size_t *size)
+{
+    q2proto_svc_playerstate_t playerstate;
+    q2proto_server_make_player_state_delta(context, from ? from->player_state : NULL, to->player_state,
+                                           &playerstate);
+    q2proto_error_t err = q2proto_server_playerstate_size(context, &playerstate, size);
+
+    roundtrip_buffer_clear(buf);
+    size_t from_num = from ? from->num_entities : 0;
+    size_t from_idx = 0, to_idx = 0;
+    while (err == Q2P_ERR_SUCCESS && (from_idx < from_num || to_idx < to->num_entities)) {
+        uint16_t from_entnum = from_idx < from_num ? from->entnums[from_idx] : UINT16_MAX;
+        uint16_t to_entnum = to_idx < to->num_entities ? to->entnums[to_idx] : UINT16_MAX;
+        if (from_entnum < to_entnum) {
+            err = write_entity_delta(context, buf, from_entnum, NULL, NULL, false);
+            from_idx++;
+        } else if (to_entnum < from_entnum) {
+            const q2proto_packed_entity_state_t *baseline = NULL;
+            if (baselines && to_entnum < baselines->num_states)
+                baseline = &baselines->states[to_entnum];
+            err = write_entity_delta(context, buf, to_entnum, baseline, &to->entities[to_idx], true);
+            to_idx++;
+        } else {
+            const q2proto_packed_entity_state_t *from_state = &from->entities[from_idx];
+            const q2proto_packed_entity_state_t *to_state = &to->entities[to_idx];
+            if (memcmp(from_state, to_state, sizeof(*to_state)) != 0)
+                err = write_entity_delta(context, buf, to_entnum, from_state, to_state, false);
+            from_idx++;
+            to_idx++;
+        }
+    }
+    CHECK(err == Q2P_ERR_SUCCESS, "reference frame write failed: %s", q2proto_error_string(err));
+    *size += buf->size;
+    return err == Q2P_ERR_SUCCESS;
+}
+
+static void check_estimate(const char *name, q2proto_servercontext_t *context, int from_frame, int to_frame,
+                           const q2proto_packed_baselines_t *baselines, roundtrip_buffer_t *buf)
+{
+    q2proto_packed_snapshot_t from = make_snapshot(from_frame >= 0 ? from_frame : 0);
+    q2proto_packed_snapshot_t to = make_snapshot(to_frame);
+    const q2proto_packed_snapshot_t *from_ptr = from_frame >= 0 ? &from : NULL;
+
+    size_t expected, estimate = 0;
+    if (!written_frame_size(context, from_ptr, &to, baselines, buf, &expected))
+        return;
+    q2proto_error_t err = q2proto_server_estimate_frame_size(context, from_ptr, &to, baselines, &estimate);
+    CHECK(err == Q2P_ERR_SUCCESS && estimate == expected, "%s: frame %d -> %d%s: estimate %zu (%s), expected %zu",
+          name, from_frame, to_frame, baselines ? " with baselines" : "", estimate, q2proto_error_string(err),
+          expected);
+
+    // Filtering by visibility bits must be the same as leaving out invisible entities
+    q2proto_packed_snapshot_t from_visible = make_visible_snapshot(from_frame >= 0 ? from_frame : 0);
+    q2proto_packed_snapshot_t to_visible = make_visible_snapshot(to_frame);
+    q2proto_packed_snapshot_t from_filtered = make_filtered_snapshot(from_frame >= 0 ? from_frame : 0);
+    q2proto_packed_snapshot_t to_filtered = make_filtered_snapshot(to_frame);
+    if (!written_frame_size(context, from_frame >= 0 ? &from_visible : NULL, &to_visible, baselines, buf, &expected))
+        return;
+    err = q2proto_server_estimate_frame_size(context, from_frame >= 0 ? &from_filtered : NULL, &to_filtered,
+                                             baselines, &estimate);
+    CHECK(err == Q2P_ERR_SUCCESS && estimate == expected,
+          "%s: frame %d -> %d%s, visible entities: estimate %zu (%s), expected %zu", name, from_frame, to_frame,
+          baselines ? " with baselines" : "", estimate, q2proto_error_string(err), expected);
+}
+
+static void check_select(const char *name, q2proto_servercontext_t *context, int current_frame,
+                         const q2proto_packed_baselines_t *baselines)
+{
+    q2proto_packed_snapshot_t current = make_filtered_snapshot(current_frame);
+    q2proto_packed_snapshot_t snapshots[NUM_FRAMES];
+    const q2proto_packed_snapshot_t *candidates[NUM_FRAMES + 2];
+    size_t num_candidates = 0;
+    for (int f = 0; f < current_frame; f++) {
+        snapshots[f] = make_filtered_snapshot(f);
+        candidates[num_candidates++] = &snapshots[f];
+    }
+    // No delta frame; and a duplicate, which must not win over the original
+    candidates[num_candidates++] = NULL;
+    if (current_frame > 0)
+        candidates[num_candidates++] = &snapshots[current_frame - 1];
+
+    size_t expected_index = 0, expected_size = SIZE_MAX;
+    for (size_t i = 0; i < num_candidates; i++) {
+        size_t estimate;
+        q2proto_error_t err =
+            q2proto_server_estimate_frame_size(context, candidates[i], &current, baselines, &estimate);
+        if (err != Q2P_ERR_SUCCESS) {
+            CHECK(false, "%s: frame %d: estimate failed: %s", name, current_frame, q2proto_error_string(err));
+            return;
+        }
+        if (estimate < expected_size) {
+            expected_index = i;
+            expected_size = estimate;
+        }
+    }
+
+    size_t best_index = SIZE_MAX, best_size = 0;
+    q2proto_error_t err = q2proto_server_select_delta_frame(context, &current, candidates, num_candidates, baselines,
+                                                            &best_index, &best_size);
+    CHECK(err == Q2P_ERR_SUCCESS && best_index == expected_index && best_size == expected_size,
+          "%s: frame %d: selected candidate %zu (%zu bytes, %s), expected %zu (%zu bytes)", name, current_frame,
+          best_index, best_size, q2proto_error_string(err), expected_index, expected_size);
+
+    // Size is optional
+    err = q2proto_server_select_delta_frame(context, &current, candidates, num_candidates, baselines, &best_index,
+                                            NULL);
+    CHECK(err == Q2P_ERR_SUCCESS && best_index == expected_index, "%s: frame %d: selection without size differs",
+          name, current_frame);
+}
+
+static q2proto_packed_snapshot_t make_client_snapshot(int f, int client)
+{
+    q2proto_packed_snapshot_t snapshot = {.serverframe = FIRST_FRAME + f,
+                                          .player_state = &client_frames[f][client].player_state,
+                                          .num_entities = client_frames[f][client].num_entities,
+                                          .entnums = client_frames[f][client].entnums,
+                                          .entities = client_frames[f][client].entities};
+    return snapshot;
+}
+
+static void fill_ring_frame(const char *name, q2proto_snapshot_ring_t *ring, int f)
+{
+    const test_frame_t *frame = &frames[f];
+    q2proto_error_t err = q2proto_snapshot_ring_begin_frame(ring, FIRST_FRAME + f);
+    CHECK(err == Q2P_ERR_SUCCESS, "%s: ring frame %d: begin failed: %s", name, f, q2proto_error_string(err));
+    for (size_t i = 0; i < frame->num_entities; i++) {
+        err = q2proto_snapshot_ring_add_entity(ring, frame->entnums[i], &frame->entities[i]);
+        CHECK(err == Q2P_ERR_SUCCESS, "%s: ring frame %d: adding entity %u failed: %s", name, f, frame->entnums[i],
+              q2proto_error_string(err));
+    }
+    if (frame->num_entities > 0) {
+        err = q2proto_snapshot_ring_add_entity(ring, frame->entnums[frame->num_entities - 1], &frame->entities[0]);
+        CHECK(err == Q2P_ERR_INVALID_ARGUMENT, "%s: ring frame %d: adding entity out of order: %s", name, f,
+              q2proto_error_string(err));
+    }
+
+    for (int c = 0; c < NUM_CLIENTS; c++) {
+        const test_client_frame_t *client_frame = &client_frames[f][c];
+        if (!client_frame->set) {
+            err = q2proto_snapshot_ring_set_visible(ring, c, 1);
+            CHECK(err == Q2P_ERR_INVALID_ARGUMENT, "%s: ring frame %d: visibility for unset client %d: %s", name, f,
+                  c, q2proto_error_string(err));
+            continue;
+        }
+        // Setting a client again must drop the visibility set before
+        if (c == 0) {
+            q2proto_snapshot_ring_set_client(ring, c, &frames[0].player_state);
+            for (unsigned entnum = 0; entnum < 2 * NUM_SLOTS; entnum++)
+                q2proto_snapshot_ring_set_visible(ring, c, entnum);
+        }
+        err = q2proto_snapshot_ring_set_client(ring, c, &client_frame->player_state);
+        CHECK(err == Q2P_ERR_SUCCESS, "%s: ring frame %d: setting client %d failed: %s", name, f, c,
+              q2proto_error_string(err));
+        for (unsigned entnum = 0; entnum < 2 * NUM_SLOTS; entnum++) {
+            if (!get_entity_visible(client_frame->visible, entnum))
+                continue;
+            err = q2proto_snapshot_ring_set_visible(ring, c, entnum);
+            CHECK(err == Q2P_ERR_SUCCESS, "%s: ring frame %d: setting entity %u visible for client %d failed: %s",
+                  name, f, entnum, c, q2proto_error_string(err));
+        }
+    }
+}
+
+// Check a client's snapshot from the ring against the hand built one
+static void check_ring_snapshot(const char *name, const q2proto_snapshot_ring_t *ring, int f, int client)
+{
+    const test_client_frame_t *client_frame = &client_frames[f][client];
+    q2proto_packed_snapshot_t snapshot;
+    if (!q2proto_snapshot_ring_get_client_snapshot(ring, client, FIRST_FRAME + f, &snapshot)) {
+        CHECK(false, "%s: ring frame %d: snapshot for client %d not available", name, f, client);
+        return;
+    }
+    CHECK(snapshot.serverframe == FIRST_FRAME + f, "%s: ring frame %d: client %d: snapshot of frame %d", name, f,
+          client, snapshot.serverframe);
+    CHECK(memcmp(snapshot.player_state, &client_frame->player_state, sizeof(client_frame->player_state)) == 0,
+          "%s: ring frame %d: client %d: player state differs", name, f, client);
+
+    size_t num_visible = 0;
+    for (size_t i = 0; i < snapshot.num_entities; i++) {
+        if (snapshot.visible && !get_entity_visible(snapshot.visible, snapshot.entnums[i]))
+            continue;
+        if (num_visible >= client_frame->num_entities) {
+            num_visible++;
+            continue;
+        }
+        CHECK(snapshot.entnums[i] == client_frame->entnums[num_visible]
+                  && memcmp(&snapshot.entities[i], &client_frame->entities[num_visible], sizeof(snapshot.entities[i]))
+                         == 0,
+              "%s: ring frame %d: client %d: visible entity %zu is %u, expected %u", name, f, client, num_visible,
+              snapshot.entnums[i], client_frame->entnums[num_visible]);
+        num_visible++;
+    }
+    CHECK(num_visible == client_frame->num_entities, "%s: ring frame %d: client %d: %zu visible entities, expected %zu",
+          name, f, client, num_visible, client_frame->num_entities);
+}
+
+static void test_ring(const char *name, q2proto_servercontext_t *context, const q2proto_packed_baselines_t *baselines,
+                      roundtrip_buffer_t *buf)
+{
+    static q2proto_snapshot_world_frame_t world_frames[RING_FRAMES];
+    static uint16_t entnum_storage[RING_FRAMES * NUM_SLOTS];
+    static q2proto_packed_entity_state_t entity_storage[RING_FRAMES * NUM_SLOTS];
+    static q2proto_snapshot_client_frame_t ring_client_frames[RING_FRAMES * NUM_CLIENTS];
+    q2proto_snapshot_ring_t ring;
+    q2proto_snapshot_ring_init(&ring, RING_FRAMES, world_frames, entnum_storage, entity_storage, NUM_SLOTS,
+                               ring_client_frames, NUM_CLIENTS);
+
+    q2proto_packed_snapshot_t snapshot;
+    q2proto_error_t err = q2proto_snapshot_ring_add_entity(&ring, 1, &frames[0].entities[0]);
+    CHECK(err == Q2P_ERR_INVALID_ARGUMENT, "%s: ring: adding entity before first frame: %s", name,
+          q2proto_error_string(err));
+    err = q2proto_snapshot_ring_set_client(&ring, 0, &frames[0].player_state);
+    CHECK(err == Q2P_ERR_INVALID_ARGUMENT, "%s: ring: setting client before first frame: %s", name,
+          q2proto_error_string(err));
+    CHECK(!q2proto_snapshot_ring_get_client_snapshot(&ring, 0, 0, &snapshot), "%s: ring: empty ring has frame 0",
+          name);
+    err = q2proto_snapshot_ring_begin_frame(&ring, -1);
+    CHECK(err == Q2P_ERR_INVALID_ARGUMENT, "%s: ring: negative frame: %s", name, q2proto_error_string(err));
+
+    for (int f = 0; f < NUM_FRAMES; f++) {
+        fill_ring_frame(name, &ring, f);
+
+        // Frames still stored must resolve to the expected snapshots; older frames must be gone
+        for (int g = f - RING_FRAMES; g <= f; g++) {
+            if (g < 0)
+                continue;
+            for (int c = 0; c < NUM_CLIENTS; c++) {
+                bool available = g > f - RING_FRAMES && client_frames[g][c].set;
+                if (available)
+                    check_ring_snapshot(name, &ring, g, c);
+                else
+                    CHECK(!q2proto_snapshot_ring_get_client_snapshot(&ring, c, FIRST_FRAME + g, &snapshot),
+                          "%s: ring frame %d: client %d: frame %d should not be available", name, f, c, g);
+            }
+        }
+
+        // Ring snapshots must estimate like the hand built ones encode
+        for (int c = 0; c < NUM_CLIENTS; c++) {
+            q2proto_packed_snapshot_t from, to;
+            if (f == 0 || !client_frames[f - 1][c].set || !client_frames[f][c].set
+                || !q2proto_snapshot_ring_get_client_snapshot(&ring, c, FIRST_FRAME + f - 1, &from)
+                || !q2proto_snapshot_ring_get_client_snapshot(&ring, c, FIRST_FRAME + f, &to))
+                continue;
+            q2proto_packed_snapshot_t expected_from = make_client_snapshot(f - 1, c);
+            q2proto_packed_snapshot_t expected_to = make_client_snapshot(f, c);
+            size_t expected, estimate = 0;
+            if (!written_frame_size(context, &expected_from, &expected_to, baselines, buf, &expected))
+                continue;
+            err = q2proto_server_estimate_frame_size(context, &from, &to, baselines, &estimate);
+            CHECK(err == Q2P_ERR_SUCCESS && estimate == expected,
+                  "%s: ring frame %d: client %d: estimate %zu (%s), expected %zu", name, f, c, estimate,
+                  q2proto_error_string(err), expected);
+        }
+    }
+
+    err = q2proto_snapshot_ring_begin_frame(&ring, FIRST_FRAME + NUM_FRAMES - 1);
+    CHECK(err == Q2P_ERR_INVALID_ARGUMENT, "%s: ring: repeated frame: %s", name, q2proto_error_string(err));
+    err = q2proto_snapshot_ring_set_client(&ring, NUM_CLIENTS, &frames[0].player_state);
+    CHECK(err == Q2P_ERR_INVALID_ARGUMENT, "%s: ring: setting client out of range: %s", name,
+          q2proto_error_string(err));
+    err = q2proto_snapshot_ring_set_visible(&ring, 0, Q2PROTO_MAX_ENTITIES);
+    CHECK(err == Q2P_ERR_INVALID_ARGUMENT, "%s: ring: entity out of range: %s", name, q2proto_error_string(err));
+    CHECK(!q2proto_snapshot_ring_get_client_snapshot(&ring, NUM_CLIENTS, FIRST_FRAME + NUM_FRAMES - 1, &snapshot),
+          "%s: ring: snapshot for client out of range", name);
+
+    // Entity limit
+    q2proto_snapshot_ring_init(&ring, RING_FRAMES, world_frames, entnum_storage, entity_storage, 2, ring_client_frames,
+                               NUM_CLIENTS);
+    q2proto_snapshot_ring_begin_frame(&ring, 0);
+    q2proto_snapshot_ring_add_entity(&ring, 1, &frames[0].entities[0]);
+    q2proto_snapshot_ring_add_entity(&ring, 2, &frames[0].entities[0]);
+    err = q2proto_snapshot_ring_add_entity(&ring, 3, &frames[0].entities[0]);
+    CHECK(err == Q2P_ERR_BUFFER_TOO_SMALL, "%s: ring: adding entity over limit: %s", name, q2proto_error_string(err));
+}
+
+static void test_protocol(q2proto_protocol_t protocol, const q2proto_server_info_t *server_info,
+                          roundtrip_buffer_t *buf)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "protocol %d", protocol);
+    q2proto_servercontext_t context;
+    size_t max_msg_len;
+    q2proto_error_t err = q2proto_init_servercontext_demo(&context, protocol, server_info, &max_msg_len);
+    if (err != Q2P_ERR_SUCCESS) {
+        CHECK(false, "%s: context init failed: %s", name, q2proto_error_string(err));
+        return;
+    }
+
+    q2proto_packed_baselines_t baselines = {.states = baseline_states, .num_states = NUM_BASELINES};
+    for (int f = 0; f < NUM_FRAMES; f++) {
+        check_estimate(name, &context, -1, f, NULL, buf);
+        check_estimate(name, &context, -1, f, &baselines, buf);
+        for (int from = f > 4 ? f - 4 : 0; from <= f; from++) {
+            check_estimate(name, &context, from, f, NULL, buf);
+            check_estimate(name, &context, from, f, &baselines, buf);
+        }
+        check_select(name, &context, f, &baselines);
+    }
+
+    test_ring(name, &context, &baselines, buf);
+
+    q2proto_packed_snapshot_t current = make_snapshot(0);
+    size_t best_index;
+    err = q2proto_server_select_delta_frame(&context, &current, NULL, 0, NULL, &best_index, NULL);
+    CHECK(err == Q2P_ERR_INVALID_ARGUMENT, "%s: no candidates: %s", name, q2proto_error_string(err));
+}
+
+int main(void)
+{
+    q2proto_server_info_t server_info = {0};
+    server_info.game_api = TEST_GAME_API;
+    server_info.default_packet_length = MAX_OUTPUT;
+
+    q2proto_protocol_t protocols[Q2P_NUM_PROTOCOLS];
+    size_t num_protocols = q2proto_get_protocols_for_gametypes(protocols, Q2P_NUM_PROTOCOLS, &server_info.game_api, 1);
+    if (num_protocols == 0) {
+        printf("no protocols for game API\n");
+        return 1;
+    }
+
+    roundtrip_buffer_t buf;
+    if (!roundtrip_buffer_init(&buf, MAX_OUTPUT)) {
+        printf("out of memory\n");
+        return 1;
+    }
+
+    make_frames();
+    make_client_frames();
+    for (size_t p = 0; p < num_protocols; p++)
+        test_protocol(protocols[p], &server_info, &buf);
+
+    roundtrip_buffer_free(&buf);
+    return failures == 0 ? 0 : 1;
+}
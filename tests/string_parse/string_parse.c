@@ -0,0 +1,142 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "q2proto_internal_string.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * String parsing test: checks q2pstol() against strtol(), for signs, prefixes, overflow, invalid digits and
+ * empty input. strtol() gets a zero-terminated copy of the input; q2pstol() the string in place, which is
+ * not zero-terminated in general.
+ * q2pstol() additionally reports trailing non-digits and empty input with EINVAL.
+ */
+
+static int failures;
+
+#define CHECK(COND, ...)         \
+    do {                         \
+        if (!(COND)) {           \
+            printf(__VA_ARGS__); \
+            printf("\n");        \
+            failures++;          \
+        }                        \
+    } while (0)
+
+#define MAX_INPUT 64
+
+// Compare q2pstol() on the first len characters of str with strtol() on a copy
+static void test_input(const char *str, size_t len, int base)
+{
+    char terminated[MAX_INPUT + 1];
+    memcpy(terminated, str, len);
+    terminated[len] = 0;
+
+    char *strtol_end;
+    errno = 0;
+    long expected = strtol(terminated, &strtol_end, base);
+    int expected_errno = errno;
+    if (strtol_end == terminated || *strtol_end != 0)
+        expected_errno = EINVAL;
+
+    // Make sure parsing stops at the end of the string, rather than at the terminator
+    char unterminated[MAX_INPUT + 1];
+    memcpy(unterminated, str, len);
+    unterminated[len] = '7';
+    q2proto_string_t q2p_str = {.str = unterminated, .len = len};
+    errno = 0;
+    long result = q2pstol(&q2p_str, base);
+    int result_errno = errno;
+
+    CHECK(result == expected && result_errno == expected_errno,
+          "\"%s\", base %d: q2pstol() returned %ld (errno %d), strtol() returned %ld (errno %d)", terminated, base,
+          result, result_errno, expected, expected_errno);
+}
+
+static const char *const inputs[] = {
+    // Plain numbers and signs
+    "0",
+    "42",
+    "-42",
+    "+42",
+    "-0",
+    "  17",
+    "\t\n-8",
+    "1f",
+    "ff",
+    "FF",
+    "zz",
+    "777",
+    "010",
+    "09",
+    // Hex prefixes
+    "0x1F",
+    "-0x1f",
+    "0X",
+    "0x",
+    "0xg",
+    " 0x10",
+    // Range limits
+    "2147483647",
+    "2147483648",
+    "-2147483649",
+    "9223372036854775807",
+    "9223372036854775808",
+    "-9223372036854775808",
+    "-9223372036854775809",
+    "99999999999999999999999",
+    "-99999999999999999999999",
+    "0x7fffffffffffffff",
+    "0x8000000000000000",
+    "-0x8000000000000000",
+    "zzzzzzzzzzzzzzzz",
+    // Non-digits
+    "12abc",
+    "12 ",
+    "1.5",
+    "abc",
+    "--1",
+    "+-1",
+    // Empty input
+    "",
+    " ",
+    "-",
+    "+",
+};
+
+static const int bases[] = {0, 8, 10, 16, 36};
+
+int main(void)
+{
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+        for (size_t b = 0; b < sizeof(bases) / sizeof(bases[0]); b++)
+            test_input(inputs[i], strlen(inputs[i]), bases[b]);
+    }
+
+    // Zero character ends the input
+    static const char embedded_zero[] = "12\0" "34";
+    test_input(embedded_zero, sizeof(embedded_zero) - 1, 10);
+    // Input shorter than underlying string
+    test_input("12345", 3, 10);
+    test_input("-9223372036854775808", 19, 10);
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,604 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "q2proto/q2proto.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <pthread.h>
+#endif
+
+#if Q2PROTO_COMPRESSION_DEFLATE
+    #include <zlib.h>
+#endif
+
+/*
+ * Thread safety stress test: encode frames for a number of clients, each with its own server context,
+ * from multiple threads at the same time. All threads share the same (read-only) server info and world data.
+ * The output for each client must match the output of a single-threaded run.
+ * If built with deflate support, every other frame is also compressed into a zpacket, using zlib via the
+ * deflate implementation helper, with separate deflate arguments for each thread.
+ * Also meant to be run with a thread sanitizer.
+ */
+
+#define NUM_THREADS     8
+#define NUM_CLIENTS     40
+#define NUM_FRAMES      100
+#define NUM_ENTITIES    64
+#define NUM_REPETITIONS 4
+#define MAX_OUTPUT      0x10000
+
+#if Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_RERELEASE
+    #define TEST_GAME_API Q2PROTO_GAME_RERELEASE
+#elif Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_Q2PRO_EXTENDED_V2
+    #define TEST_GAME_API Q2PROTO_GAME_Q2PRO_EXTENDED_V2
+#elif Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_Q2PRO_EXTENDED
+    #define TEST_GAME_API Q2PROTO_GAME_Q2PRO_EXTENDED
+#else
+    #define TEST_GAME_API Q2PROTO_GAME_VANILLA
+#endif
+
+// Per-thread output
+typedef struct test_io_s {
+    uint8_t data[MAX_OUTPUT];
+    size_t size;
+    q2proto_error_t err;
+#if Q2PROTO_COMPRESSION_DEFLATE
+    // Set if this output receives data to be deflated
+    q2protoio_deflate_args_t *deflate;
+    // Maximum size of deflated data
+    size_t max_deflated;
+#endif
+} test_io_t;
+
+static void *test_io_reserve(uintptr_t io_arg, size_t size)
+{
+    test_io_t *io = (test_io_t *)io_arg;
+    if (size > MAX_OUTPUT - io->size) {
+        io->err = Q2P_ERR_NOT_ENOUGH_PACKET_SPACE;
+        return NULL;
+    }
+    void *p = io->data + io->size;
+    io->size += size;
+    return p;
+}
+
+void q2protoio_write_u8(uintptr_t io_arg, uint8_t x)
+{
+    uint8_t *p = test_io_reserve(io_arg, 1);
+    if (p)
+        p[0] = x;
+}
+
+void q2protoio_write_u16(uintptr_t io_arg, uint16_t x)
+{
+    uint8_t *p = test_io_reserve(io_arg, 2);
+    if (p) {
+        p[0] = x & 0xff;
+        p[1] = x >> 8;
+    }
+}
+
+void q2protoio_write_u32(uintptr_t io_arg, uint32_t x)
+{
+    q2protoio_write_u16(io_arg, x & 0xffff);
+    q2protoio_write_u16(io_arg, x >> 16);
+}
+
+void q2protoio_write_u64(uintptr_t io_arg, uint64_t x)
+{
+    q2protoio_write_u32(io_arg, x & 0xffffffff);
+    q2protoio_write_u32(io_arg, x >> 32);
+}
+
+void *q2protoio_write_reserve_raw(uintptr_t io_arg, size_t size) { return test_io_reserve(io_arg, size); }
+
+void q2protoio_write_raw(uintptr_t io_arg, const void *data, size_t size, size_t *written)
+{
+    test_io_t *io = (test_io_t *)io_arg;
+    size_t n = size;
+    if (written && n > MAX_OUTPUT - io->size)
+        n = MAX_OUTPUT - io->size;
+    void *p = test_io_reserve(io_arg, n);
+    if (p)
+        memcpy(p, data, n);
+    if (written)
+        *written = p ? n : 0;
+}
+
+#if Q2PROTO_COMPRESSION_DEFLATE
+static void q2p_inflate_deflate_error(const char *message, int z_error)
+{
+    printf("%s: %s\n", message, zError(z_error));
+}
+
+    #define Q2PROTO_DEFLATE_IMPL_HELPER_API static
+    #include "q2proto/q2proto_deflate_impl_helper.inc"
+
+// Deflate state, one per thread
+struct q2protoio_deflate_args_s {
+    q2proto_deflate_impl_helper_args_t helper;
+    // Receives the data to deflate
+    test_io_t io;
+    uint8_t *z_buffer;
+};
+
+static bool deflate_args_init(q2protoio_deflate_args_t *deflate_args)
+{
+    uLong z_buffer_size = compressBound(MAX_OUTPUT);
+    deflate_args->z_buffer = malloc(z_buffer_size);
+    if (!deflate_args->z_buffer)
+        return false;
+    deflate_args->io.deflate = NULL;
+    q2proto_deflate_impl_helper_init(&deflate_args->helper, NULL, deflate_args->z_buffer, z_buffer_size);
+    return true;
+}
+
+static void deflate_args_destroy(q2protoio_deflate_args_t *deflate_args)
+{
+    q2proto_deflate_impl_helper_destroy(&deflate_args->helper);
+    free(deflate_args->z_buffer);
+}
+
+q2proto_error_t q2protoio_deflate_begin(q2protoio_deflate_args_t *deflate_args, size_t max_deflated,
+                                        q2proto_inflate_deflate_header_mode_t header_mode, uintptr_t *deflate_io_arg)
+{
+    // One stream per deflate args
+    if (deflate_args->io.deflate)
+        return Q2P_ERR_INVALID_ARGUMENT;
+
+    q2proto_error_t err = q2proto_deflate_impl_helper_begin(&deflate_args->helper, header_mode, deflate_args->io.data);
+    if (err != Q2P_ERR_SUCCESS)
+        return err;
+
+    deflate_args->io.size = 0;
+    deflate_args->io.err = Q2P_ERR_SUCCESS;
+    deflate_args->io.deflate = deflate_args;
+    deflate_args->io.max_deflated = max_deflated;
+    *deflate_io_arg = (uintptr_t)&deflate_args->io;
+    return Q2P_ERR_SUCCESS;
+}
+
+q2proto_error_t q2protoio_deflate_get_data(uintptr_t deflate_io_arg, q2proto_deflate_stream_mode_t stream_mode,
+                                           size_t *in_size, const void **out, size_t *out_size)
+{
+    test_io_t *io = (test_io_t *)deflate_io_arg;
+    if (!io->deflate)
+        return Q2P_ERR_INVALID_ARGUMENT;
+
+    q2proto_error_t err = q2proto_deflate_impl_helper_get_data(&io->deflate->helper, (uint32_t)io->size, stream_mode,
+                                                               in_size, out, out_size, io->data);
+    if (err != Q2P_ERR_SUCCESS)
+        return err;
+
+    io->size = 0;
+    return Q2P_ERR_SUCCESS;
+}
+
+q2proto_error_t q2protoio_deflate_end(uintptr_t deflate_io_arg)
+{
+    test_io_t *io = (test_io_t *)deflate_io_arg;
+    if (!io->deflate)
+        return Q2P_ERR_INVALID_ARGUMENT;
+    io->deflate = NULL;
+    return Q2P_ERR_SUCCESS;
+}
+#endif
+
+size_t q2protoio_write_available(uintptr_t io_arg)
+{
+    test_io_t *io = (test_io_t *)io_arg;
+#if Q2PROTO_COMPRESSION_DEFLATE
+    if (io->deflate)
+        return q2proto_deflate_impl_helper_remaining(&io->deflate->helper, io->size, io->max_deflated);
+#endif
+    return MAX_OUTPUT - io->size;
+}
+
+q2proto_error_t q2protoio_get_error(uintptr_t io_arg)
+{
+    test_io_t *io = (test_io_t *)io_arg;
+    q2proto_error_t err = io->err;
+    io->err = Q2P_ERR_SUCCESS;
+    return err;
+}
+
+// Shared, read-only world data
+static q2proto_server_info_t server_info;
+static q2proto_packed_entity_state_t world_entities[NUM_FRAMES][NUM_ENTITIES];
+static q2proto_packed_player_state_t world_players[NUM_FRAMES][NUM_CLIENTS];
+static q2proto_protocol_t client_protocols[NUM_CLIENTS];
+
+static uint32_t expected_hashes[NUM_CLIENTS];
+static uint32_t actual_hashes[NUM_REPETITIONS][NUM_CLIENTS];
+
+static uint64_t rng_state = 0x2545f4914f6cdd1dULL;
+
+static uint32_t rng_next(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t)(rng_state >> 16);
+}
+
+static int32_t random_range(int32_t min, int32_t max) { return min + (int32_t)(rng_next() % (uint32_t)(max - min + 1)); }
+
+static bool random_chance(unsigned one_in) { return rng_next() % one_in == 0; }
+
+static void random_entity(q2proto_packed_entity_state_t *ent)
+{
+    ent->modelindex = random_range(1, 255);
+    ent->modelindex2 = random_chance(4) ? random_range(1, 255) : 0;
+    ent->skinnum = random_range(0, 15);
+    ent->effects = random_range(0, 0xffff);
+    ent->renderfx = random_range(0, 0xffff);
+    ent->sound = random_chance(4) ? random_range(1, 255) : 0;
+    ent->solid = random_range(0, 0xffff);
+#if Q2PROTO_ENTITY_STATE_FEATURES & Q2PROTO_FEATURE_FLAG_ENTITY_LOOP_ALPHA_SCALE_FX64
+    ent->loop_volume = random_range(0, 255);
+    ent->loop_attenuation = random_range(0, 255);
+    ent->alpha = random_range(0, 255);
+    ent->scale = random_range(0, 255);
+#endif
+}
+
+// Apply typical frame-to-frame changes
+static void update_entity(q2proto_packed_entity_state_t *ent)
+{
+    memcpy(ent->old_origin, ent->origin, sizeof(ent->origin));
+    for (int i = 0; i < 3; i++) {
+        if (random_chance(2))
+            ent->origin[i] = random_range(-32768, 32767);
+        if (random_chance(8))
+            ent->angles[i] = random_range(0, 65535);
+    }
+    ent->frame = (ent->frame + 1) % 200;
+    ent->event = random_chance(16) ? random_range(1, 8) : 0;
+    if (random_chance(32))
+        random_entity(ent);
+}
+
+static void random_player(q2proto_packed_player_state_t *ps)
+{
+    ps->pm_type = random_range(0, 4);
+    ps->pm_flags = random_range(0, 255);
+    ps->pm_gravity = random_range(0, 800);
+    ps->gunindex = random_range(1, 255);
+    ps->fov = random_range(60, 120);
+    ps->rdflags = random_range(0, 15);
+    for (int i = 0; i < 3; i++) {
+        ps->pm_delta_angles[i] = random_range(-32768, 32767);
+        ps->viewoffset[i] = random_range(-128, 127);
+        ps->gunoffset[i] = random_range(-128, 127);
+        ps->gunangles[i] = random_range(-128, 127);
+    }
+    for (int i = 0; i < 4; i++)
+        ps->blend[i] = random_range(0, 255);
+}
+
+// Apply typical frame-to-frame changes
+static void update_player(q2proto_packed_player_state_t *ps)
+{
+    for (int i = 0; i < 3; i++) {
+        ps->pm_velocity[i] = random_range(-2048, 2047);
+        ps->pm_origin[i] += ps->pm_velocity[i] / 8;
+        if (random_chance(2))
+            ps->viewangles[i] = random_range(-32768, 32767);
+        ps->kick_angles[i] = random_chance(8) ? random_range(-128, 127) : 0;
+    }
+    ps->gunframe = (ps->gunframe + 1) % 100;
+    for (int i = 0; i < 4; i++) {
+        if (random_chance(8))
+            ps->stats[random_range(0, 31)] = random_range(-32768, 32767);
+    }
+    if (random_chance(32))
+        random_player(ps);
+}
+
+static void make_world(void)
+{
+    memset(world_entities, 0, sizeof(world_entities));
+    memset(world_players, 0, sizeof(world_players));
+    for (int e = 0; e < NUM_ENTITIES; e++)
+        random_entity(&world_entities[0][e]);
+    for (int c = 0; c < NUM_CLIENTS; c++)
+        random_player(&world_players[0][c]);
+    for (int f = 1; f < NUM_FRAMES; f++) {
+        for (int e = 0; e < NUM_ENTITIES; e++) {
+            world_entities[f][e] = world_entities[f - 1][e];
+            update_entity(&world_entities[f][e]);
+        }
+        for (int c = 0; c < NUM_CLIENTS; c++) {
+            world_players[f][c] = world_players[f - 1][c];
+            update_player(&world_players[f][c]);
+        }
+    }
+}
+
+static bool entity_visible(int client, int frame, int entnum)
+{
+    return (entnum + client + frame / 10) % 3 != 0;
+}
+
+static uint32_t hash_data(uint32_t hash, const uint8_t *data, size_t size)
+{
+    // FNV-1a
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static q2proto_error_t write_entity_delta(q2proto_servercontext_t *context, test_io_t *io, uint16_t entnum,
+                                          const q2proto_packed_entity_state_t *from,
+                                          const q2proto_packed_entity_state_t *to)
+{
+    q2proto_svc_message_t message = {.type = Q2P_SVC_FRAME_ENTITY_DELTA, .frame_entity_delta = {0}};
+    message.frame_entity_delta.newnum = entnum;
+    if (to)
+        q2proto_server_make_entity_state_delta(context, from, to, !from, &message.frame_entity_delta.entity_delta);
+    else
+        message.frame_entity_delta.remove = true;
+    return q2proto_server_write(context, (uintptr_t)io, &message);
+}
+
+static q2proto_error_t write_frame(q2proto_servercontext_t *context, test_io_t *io, int client, int frame)
+{
+    q2proto_svc_message_t message = {.type = Q2P_SVC_FRAME, .frame = {0}};
+    message.frame.serverframe = frame;
+    message.frame.deltaframe = frame - 1;
+    q2proto_server_make_player_state_delta(context, frame > 0 ? &world_players[frame - 1][client] : NULL,
+                                           &world_players[frame][client], &message.frame.playerstate);
+    q2proto_error_t err = q2proto_server_write(context, (uintptr_t)io, &message);
+    if (err != Q2P_ERR_SUCCESS)
+        return err;
+
+    // Entity 0 is never sent
+    for (uint16_t entnum = 1; entnum < NUM_ENTITIES; entnum++) {
+        bool old_visible = frame > 0 && entity_visible(client, frame - 1, entnum);
+        bool new_visible = entity_visible(client, frame, entnum);
+        if (!old_visible && !new_visible)
+            continue;
+        const q2proto_packed_entity_state_t *from = old_visible ? &world_entities[frame - 1][entnum] : NULL;
+        const q2proto_packed_entity_state_t *to = new_visible ? &world_entities[frame][entnum] : NULL;
+        err = write_entity_delta(context, io, entnum, from, to);
+        if (err != Q2P_ERR_SUCCESS)
+            return err;
+    }
+
+    q2proto_svc_message_t terminator = {.type = Q2P_SVC_FRAME_ENTITY_DELTA, .frame_entity_delta = {0}};
+    return q2proto_server_write(context, (uintptr_t)io, &terminator);
+}
+
+// Per-thread encoding state
+typedef struct thread_state_s {
+    test_io_t io;
+#if Q2PROTO_COMPRESSION_DEFLATE
+    test_io_t zpacket_io;
+    q2protoio_deflate_args_t deflate_args;
+    // Number of frames sent as zpacket
+    int num_zpackets;
+#endif
+} thread_state_t;
+
+static thread_state_t *thread_state_create(void)
+{
+    thread_state_t *state = malloc(sizeof(thread_state_t));
+    if (!state)
+        return NULL;
+    state->io.err = Q2P_ERR_SUCCESS;
+#if Q2PROTO_COMPRESSION_DEFLATE
+    state->io.deflate = NULL;
+    state->zpacket_io.err = Q2P_ERR_SUCCESS;
+    state->zpacket_io.deflate = NULL;
+    state->num_zpackets = 0;
+    if (!deflate_args_init(&state->deflate_args)) {
+        free(state);
+        return NULL;
+    }
+#endif
+    return state;
+}
+
+static void thread_state_destroy(thread_state_t *state)
+{
+#if Q2PROTO_COMPRESSION_DEFLATE
+    deflate_args_destroy(&state->deflate_args);
+#endif
+    free(state);
+}
+
+#if Q2PROTO_COMPRESSION_DEFLATE
+// Compress a frame into a zpacket. Sets the data to send, which is the original frame if it can't be compressed.
+static bool write_zpacket(q2proto_servercontext_t *context, thread_state_t *state, int client, int frame,
+                          const uint8_t **data, size_t *size)
+{
+    state->zpacket_io.size = 0;
+    q2proto_error_t err = q2proto_server_write_zpacket(context, &state->deflate_args, (uintptr_t)&state->zpacket_io,
+                                                       state->io.data, state->io.size);
+    if (err == Q2P_ERR_SUCCESS) {
+        state->num_zpackets++;
+        *data = state->zpacket_io.data;
+        *size = state->zpacket_io.size;
+        return true;
+    }
+    *data = state->io.data;
+    *size = state->io.size;
+    if (err == Q2P_ERR_ALREADY_COMPRESSED || err == Q2P_ERR_DEFLATE_NOT_SUPPORTED)
+        return true;
+    printf("client %d, frame %d: zpacket write failed: %s\n", client, frame, q2proto_error_string(err));
+    return false;
+}
+#endif
+
+// Encode all frames for a client, returns hash of output
+static bool encode_client(thread_state_t *state, int client, uint32_t *hash)
+{
+    test_io_t *io = &state->io;
+    q2proto_servercontext_t context;
+    size_t max_msg_len;
+    q2proto_error_t err = q2proto_init_servercontext_demo(&context, client_protocols[client], &server_info, &max_msg_len);
+    if (err != Q2P_ERR_SUCCESS) {
+        printf("client %d: context init failed: %s\n", client, q2proto_error_string(err));
+        return false;
+    }
+
+    *hash = 2166136261u;
+    for (int frame = 0; frame < NUM_FRAMES; frame++) {
+        io->size = 0;
+        err = write_frame(&context, io, client, frame);
+        if (err != Q2P_ERR_SUCCESS) {
+            printf("client %d, frame %d: write failed: %s\n", client, frame, q2proto_error_string(err));
+            return false;
+        }
+        const uint8_t *data = io->data;
+        size_t size = io->size;
+#if Q2PROTO_COMPRESSION_DEFLATE
+        if (frame % 2 == 1 && !write_zpacket(&context, state, client, frame, &data, &size))
+            return false;
+#endif
+        *hash = hash_data(*hash, data, size);
+    }
+    return true;
+}
+
+typedef struct thread_args_s {
+    int first_client;
+    int repetition;
+    bool success;
+} thread_args_t;
+
+static void encode_thread(thread_args_t *args)
+{
+    thread_state_t *state = thread_state_create();
+    if (!state)
+        return;
+    args->success = true;
+    for (int client = args->first_client; client < NUM_CLIENTS; client += NUM_THREADS)
+        args->success &= encode_client(state, client, &actual_hashes[args->repetition][client]);
+    thread_state_destroy(state);
+}
+
+// Use native threads, as C11 threads are not supported everywhere (and not understood by all thread sanitizers)
+#if defined(_WIN32)
+typedef HANDLE test_thread_t;
+
+static DWORD WINAPI thread_func(LPVOID arg)
+{
+    encode_thread(arg);
+    return 0;
+}
+
+static bool start_thread(test_thread_t *thread, thread_args_t *args)
+{
+    *thread = CreateThread(NULL, 0, thread_func, args, 0, NULL);
+    return *thread != NULL;
+}
+
+static void join_thread(test_thread_t thread)
+{
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+#else
+typedef pthread_t test_thread_t;
+
+static void *thread_func(void *arg)
+{
+    encode_thread(arg);
+    return NULL;
+}
+
+static bool start_thread(test_thread_t *thread, thread_args_t *args)
+{
+    return pthread_create(thread, NULL, thread_func, args) == 0;
+}
+
+static void join_thread(test_thread_t thread) { pthread_join(thread, NULL); }
+#endif
+
+int main(int argc, char **argv)
+{
+    server_info.game_api = TEST_GAME_API;
+    server_info.default_packet_length = MAX_OUTPUT;
+
+    q2proto_protocol_t protocols[Q2P_NUM_PROTOCOLS];
+    size_t num_protocols = q2proto_get_protocols_for_gametypes(protocols, Q2P_NUM_PROTOCOLS, &server_info.game_api, 1);
+    if (num_protocols == 0) {
+        printf("no protocols for game API\n");
+        return 1;
+    }
+    for (int c = 0; c < NUM_CLIENTS; c++)
+        client_protocols[c] = protocols[c % num_protocols];
+
+    make_world();
+
+    // Single-threaded reference run
+    thread_state_t *reference_state = thread_state_create();
+    if (!reference_state) {
+        printf("out of memory\n");
+        return 1;
+    }
+    for (int c = 0; c < NUM_CLIENTS; c++) {
+        if (!encode_client(reference_state, c, &expected_hashes[c]))
+            return 1;
+    }
+#if Q2PROTO_COMPRESSION_DEFLATE
+    // Each game API can be used with some protocol supporting zpackets
+    if (reference_state->num_zpackets == 0) {
+        printf("no frames sent as zpacket\n");
+        return 1;
+    }
+#endif
+    thread_state_destroy(reference_state);
+
+    int failures = 0;
+    for (int rep = 0; rep < NUM_REPETITIONS; rep++) {
+        test_thread_t threads[NUM_THREADS];
+        thread_args_t args[NUM_THREADS];
+        for (int t = 0; t < NUM_THREADS; t++) {
+            args[t] = (thread_args_t){.first_client = t, .repetition = rep, .success = false};
+            if (!start_thread(&threads[t], &args[t])) {
+                printf("failed to create thread\n");
+                return 1;
+            }
+        }
+        for (int t = 0; t < NUM_THREADS; t++) {
+            join_thread(threads[t]);
+            if (!args[t].success)
+                failures++;
+        }
+        for (int c = 0; c < NUM_CLIENTS; c++) {
+            if (actual_hashes[rep][c] != expected_hashes[c]) {
+                printf("repetition %d, client %d: output mismatch (%08x, expected %08x)\n", rep, c,
+                       actual_hashes[rep][c], expected_hashes[c]);
+                failures++;
+            }
+        }
+    }
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,357 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "q2proto/q2proto.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <pthread.h>
+#endif
+
+/*
+ * Trace test: checks trace ring semantics, draining a ring concurrently with a producer thread,
+ * and the trace records emitted when writing a frame.
+ * Needs to be built with Q2PROTO_TRACE.
+ */
+
+#define MAX_OUTPUT       0x10000
+#define NUM_ENTITIES     16
+#define STRESS_RING_SIZE 256
+#define STRESS_RECORDS   1000000
+
+#if Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_RERELEASE
+    #define TEST_GAME_API Q2PROTO_GAME_RERELEASE
+#elif Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_Q2PRO_EXTENDED_V2
+    #define TEST_GAME_API Q2PROTO_GAME_Q2PRO_EXTENDED_V2
+#elif Q2PROTO_ENTITY_STATE_FEATURES == Q2PROTO_FEATURES_Q2PRO_EXTENDED
+    #define TEST_GAME_API Q2PROTO_GAME_Q2PRO_EXTENDED
+#else
+    #define TEST_GAME_API Q2PROTO_GAME_VANILLA
+#endif
+
+typedef struct test_io_s {
+    uint8_t data[MAX_OUTPUT];
+    size_t size;
+    q2proto_error_t err;
+} test_io_t;
+
+static void *test_io_reserve(uintptr_t io_arg, size_t size)
+{
+    test_io_t *io = (test_io_t *)io_arg;
+    if (size > MAX_OUTPUT - io->size) {
+        io->err = Q2P_ERR_NOT_ENOUGH_PACKET_SPACE;
+        return NULL;
+    }
+    void *p = io->data + io->size;
+    io->size += size;
+    return p;
+}
+
+void q2protoio_write_u8(uintptr_t io_arg, uint8_t x)
+{
+    uint8_t *p = test_io_reserve(io_arg, 1);
+    if (p)
+        p[0] = x;
+}
+
+void q2protoio_write_u16(uintptr_t io_arg, uint16_t x)
+{
+    uint8_t *p = test_io_reserve(io_arg, 2);
+    if (p) {
+        p[0] = x & 0xff;
+        p[1] = x >> 8;
+    }
+}
+
+void q2protoio_write_u32(uintptr_t io_arg, uint32_t x)
+{
+    q2protoio_write_u16(io_arg, x & 0xffff);
+    q2protoio_write_u16(io_arg, x >> 16);
+}
+
+void q2protoio_write_u64(uintptr_t io_arg, uint64_t x)
+{
+    q2protoio_write_u32(io_arg, x & 0xffffffff);
+    q2protoio_write_u32(io_arg, x >> 32);
+}
+
+void *q2protoio_write_reserve_raw(uintptr_t io_arg, size_t size) { return test_io_reserve(io_arg, size); }
+
+void q2protoio_write_raw(uintptr_t io_arg, const void *data, size_t size, size_t *written)
+{
+    test_io_t *io = (test_io_t *)io_arg;
+    size_t n = size;
+    if (written && n > MAX_OUTPUT - io->size)
+        n = MAX_OUTPUT - io->size;
+    void *p = test_io_reserve(io_arg, n);
+    if (p)
+        memcpy(p, data, n);
+    if (written)
+        *written = p ? n : 0;
+}
+
+size_t q2protoio_write_available(uintptr_t io_arg)
+{
+    test_io_t *io = (test_io_t *)io_arg;
+    return MAX_OUTPUT - io->size;
+}
+
+q2proto_error_t q2protoio_get_error(uintptr_t io_arg)
+{
+    test_io_t *io = (test_io_t *)io_arg;
+    q2proto_error_t err = io->err;
+    io->err = Q2P_ERR_SUCCESS;
+    return err;
+}
+
+size_t q2protoio_trace_position(uintptr_t io_arg)
+{
+    test_io_t *io = (test_io_t *)io_arg;
+    return io->size;
+}
+
+static int failures = 0;
+
+#define CHECK(COND, ...)          \
+    do {                          \
+        if (!(COND)) {            \
+            printf(__VA_ARGS__);  \
+            printf("\n");         \
+            failures++;           \
+        }                         \
+    } while (0)
+
+static void test_ring_basics(void)
+{
+    q2proto_trace_ring_t ring;
+    q2proto_trace_record_t records[8];
+    CHECK(q2proto_trace_ring_init(&ring, records, 6) == Q2P_ERR_INVALID_ARGUMENT,
+          "ring: non-power-of-two size accepted");
+    CHECK(q2proto_trace_ring_init(&ring, records, 8) == Q2P_ERR_SUCCESS, "ring: init failed");
+
+    // Fill ring, then overflow
+    for (uint32_t i = 0; i < 10; i++) {
+        q2proto_trace_record_t record = {.bits = i};
+        bool pushed = q2proto_trace_ring_push(&ring, &record);
+        CHECK(pushed == (i < 8), "ring: push %u: unexpected result", i);
+    }
+    CHECK(q2proto_trace_ring_dropped(&ring) == 2, "ring: %u records dropped, expected 2",
+          q2proto_trace_ring_dropped(&ring));
+
+    // Partial drain, then wrap around
+    q2proto_trace_record_t out[8];
+    size_t n = q2proto_trace_ring_drain(&ring, out, 5);
+    CHECK(n == 5, "ring: drained %zu records, expected 5", n);
+    for (size_t i = 0; i < n; i++)
+        CHECK(out[i].bits == i, "ring: record %zu out of order", i);
+    for (uint32_t i = 10; i < 15; i++) {
+        q2proto_trace_record_t record = {.bits = i};
+        CHECK(q2proto_trace_ring_push(&ring, &record), "ring: push %u after drain failed", i);
+    }
+    n = q2proto_trace_ring_drain(&ring, out, 8);
+    CHECK(n == 8, "ring: drained %zu records, expected 8", n);
+    static const uint64_t expected[8] = {5, 6, 7, 10, 11, 12, 13, 14};
+    for (size_t i = 0; i < n; i++)
+        CHECK(out[i].bits == expected[i], "ring: record %zu is %u, expected %u", i, (unsigned)out[i].bits,
+              (unsigned)expected[i]);
+    CHECK(q2proto_trace_ring_drain(&ring, out, 8) == 0, "ring: not empty");
+}
+
+// Producer pushes a sequence of records, consumer drains concurrently
+static q2proto_trace_ring_t stress_ring;
+static q2proto_trace_record_t stress_records[STRESS_RING_SIZE];
+
+static void stress_producer(void)
+{
+    for (uint32_t i = 0; i < STRESS_RECORDS; i++) {
+        q2proto_trace_record_t record = {.bits = i, .context_id = ~i};
+        q2proto_trace_ring_push(&stress_ring, &record);
+    }
+}
+
+// Use native threads, as C11 threads are not supported everywhere (and not understood by all thread sanitizers)
+#if defined(_WIN32)
+typedef HANDLE test_thread_t;
+
+static DWORD WINAPI thread_func(LPVOID arg)
+{
+    stress_producer();
+    return 0;
+}
+
+static bool start_thread(test_thread_t *thread)
+{
+    *thread = CreateThread(NULL, 0, thread_func, NULL, 0, NULL);
+    return *thread != NULL;
+}
+
+static void join_thread(test_thread_t thread)
+{
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+#else
+typedef pthread_t test_thread_t;
+
+static void *thread_func(void *arg)
+{
+    stress_producer();
+    return NULL;
+}
+
+static bool start_thread(test_thread_t *thread) { return pthread_create(thread, NULL, thread_func, NULL) == 0; }
+
+static void join_thread(test_thread_t thread) { pthread_join(thread, NULL); }
+#endif
+
+static void consume(uint64_t *num_received, int64_t *last)
+{
+    q2proto_trace_record_t out[64];
+    size_t n;
+    while ((n = q2proto_trace_ring_drain(&stress_ring, out, 64)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            // Records must arrive in order (some may be missing) and intact
+            CHECK((int64_t)out[i].bits > *last && out[i].context_id == ~(uint32_t)out[i].bits,
+                  "stress: bad record %u after %d", (unsigned)out[i].bits, (int)*last);
+            *last = (int64_t)out[i].bits;
+        }
+        *num_received += n;
+    }
+}
+
+static void test_ring_stress(void)
+{
+    q2proto_trace_ring_init(&stress_ring, stress_records, STRESS_RING_SIZE);
+    test_thread_t thread;
+    if (!start_thread(&thread)) {
+        printf("failed to create thread\n");
+        failures++;
+        return;
+    }
+    uint64_t num_received = 0;
+    int64_t last = -1;
+    while (num_received + q2proto_trace_ring_dropped(&stress_ring) < STRESS_RECORDS)
+        consume(&num_received, &last);
+    join_thread(thread);
+    consume(&num_received, &last);
+    CHECK(num_received + q2proto_trace_ring_dropped(&stress_ring) == STRESS_RECORDS,
+          "stress: %u received + %u dropped, expected %u", (unsigned)num_received,
+          q2proto_trace_ring_dropped(&stress_ring), STRESS_RECORDS);
+}
+
+static q2proto_error_t write_frame(q2proto_servercontext_t *context, test_io_t *io,
+                                   const q2proto_packed_entity_state_t *entities)
+{
+    q2proto_packed_player_state_t player = {0};
+    player.pm_gravity = 800;
+    player.fov = 90;
+
+    q2proto_svc_message_t message = {.type = Q2P_SVC_FRAME, .frame = {0}};
+    message.frame.serverframe = 1;
+    message.frame.deltaframe = -1;
+    q2proto_server_make_player_state_delta(context, NULL, &player, &message.frame.playerstate);
+    q2proto_error_t err = q2proto_server_write(context, (uintptr_t)io, &message);
+    if (err != Q2P_ERR_SUCCESS)
+        return err;
+
+    for (uint16_t entnum = 1; entnum < NUM_ENTITIES; entnum++) {
+        q2proto_svc_message_t entity_message = {.type = Q2P_SVC_FRAME_ENTITY_DELTA, .frame_entity_delta = {0}};
+        entity_message.frame_entity_delta.newnum = entnum;
+        q2proto_server_make_entity_state_delta(context, NULL, &entities[entnum], true,
+                                               &entity_message.frame_entity_delta.entity_delta);
+        err = q2proto_server_write(context, (uintptr_t)io, &entity_message);
+        if (err != Q2P_ERR_SUCCESS)
+            return err;
+    }
+
+    q2proto_svc_message_t terminator = {.type = Q2P_SVC_FRAME_ENTITY_DELTA, .frame_entity_delta = {0}};
+    return q2proto_server_write(context, (uintptr_t)io, &terminator);
+}
+
+static void test_frame_records(void)
+{
+    static test_io_t io;
+    q2proto_server_info_t server_info = {.game_api = TEST_GAME_API, .default_packet_length = MAX_OUTPUT};
+    q2proto_servercontext_t context;
+    size_t max_msg_len;
+    q2proto_error_t err = q2proto_init_servercontext_demo(&context, Q2P_PROTOCOL_INVALID, &server_info, &max_msg_len);
+    if (err != Q2P_ERR_SUCCESS) {
+        printf("frame: context init failed: %s\n", q2proto_error_string(err));
+        failures++;
+        return;
+    }
+    context.trace_id = 42;
+
+    q2proto_packed_entity_state_t entities[NUM_ENTITIES];
+    memset(entities, 0, sizeof(entities));
+    for (int e = 1; e < NUM_ENTITIES; e++) {
+        entities[e].modelindex = e;
+        entities[e].origin[0] = e * 64;
+    }
+
+    static q2proto_trace_record_t records[64];
+    q2proto_trace_ring_t ring;
+    q2proto_trace_ring_init(&ring, records, 64);
+    q2proto_trace_set_thread_ring(&ring);
+    io.size = 0;
+    err = write_frame(&context, &io, entities);
+    q2proto_trace_set_thread_ring(NULL);
+    CHECK(err == Q2P_ERR_SUCCESS, "frame: write failed: %s", q2proto_error_string(err));
+
+    q2proto_trace_record_t out[64];
+    size_t n = q2proto_trace_ring_drain(&ring, out, 64);
+    CHECK(n == NUM_ENTITIES + 1, "frame: %zu records, expected %d", n, NUM_ENTITIES + 1);
+    uint32_t expected_offset = 0;
+    for (size_t i = 0; i < n; i++) {
+        CHECK(out[i].event == Q2P_TRACE_SVC_WRITE, "frame: record %zu: unexpected event %u", i, out[i].event);
+        CHECK(out[i].context_id == 42, "frame: record %zu: unexpected context id %u", i, out[i].context_id);
+        CHECK(out[i].offset == expected_offset, "frame: record %zu: offset %u, expected %u", i, out[i].offset,
+              expected_offset);
+        CHECK(out[i].length > 0, "frame: record %zu: empty", i);
+        expected_offset += out[i].length;
+    }
+    CHECK(expected_offset == io.size, "frame: records cover %u bytes, %zu written", expected_offset, io.size);
+    if (n == NUM_ENTITIES + 1) {
+        CHECK(out[0].type == Q2P_SVC_FRAME && out[0].bits != 0, "frame: bad frame record");
+        for (int e = 1; e < NUM_ENTITIES; e++)
+            CHECK(out[e].type == Q2P_SVC_FRAME_ENTITY_DELTA && out[e].entnum == e && out[e].bits != 0,
+                  "frame: bad entity record %d", e);
+        CHECK(out[NUM_ENTITIES].type == Q2P_SVC_FRAME_ENTITY_DELTA && out[NUM_ENTITIES].entnum == 0,
+              "frame: bad terminator record");
+    }
+
+    // No ring for the thread: no records
+    q2proto_trace_ring_init(&ring, records, 64);
+    io.size = 0;
+    write_frame(&context, &io, entities);
+    CHECK(q2proto_trace_ring_drain(&ring, out, 64) == 0, "frame: records emitted without thread ring");
+}
+
+int main(int argc, char **argv)
+{
+    test_ring_basics();
+    test_ring_stress();
+    test_frame_records();
+    return failures == 0 ? 0 : 1;
+}
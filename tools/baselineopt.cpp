@@ -0,0 +1,346 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/* Spawn baseline optimizer:
+ * Replays demos and picks, per entity number, the baseline that minimizes the total size of
+ * "first sight" entity deltas (which are delta compressed against the baseline). */
+
+#include "democonvert.h"
+#include "demofile.hpp"
+#include "demostate.hpp"
+#include "q2protoio.hpp"
+#include "toolutil.hpp"
+
+#include "expected.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fmt/format.h>
+#include <map>
+#include <optional>
+#include "scope.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Maximum number of distinct first sight states considered as baselines, per entity
+static constexpr size_t max_candidates = 64;
+
+/// Entity state, along with its packed representation
+struct entity_sample
+{
+    democonvert_entity_state_t state;
+    q2proto_packed_entity_state_t packed;
+    /// Number of times this state was seen
+    uint64_t count = 0;
+};
+
+/// First sight states of an entity number
+struct entity_samples
+{
+    std::vector<entity_sample> samples;
+    /// Map packed state bytes to index in samples
+    std::map<std::string, size_t> index;
+};
+
+class baseline_optimizer
+{
+    q2proto_protocol_t protocol;
+    q2proto_server_info_t server_info = {};
+    std::optional<q2proto_servercontext_t> server_context;
+
+    /// Baselines from the first level seen
+    std::map<uint16_t, democonvert_entity_state_t> orig_baselines;
+    bool have_orig_baselines = false;
+    /// State of the current demo
+    demo_state state;
+
+    std::map<uint16_t, entity_samples> first_sights;
+
+    void pack(const democonvert_entity_state_t& state, q2proto_packed_entity_state_t& packed)
+    {
+        democonvert_pack_entity(&*server_context, &state, &packed);
+    }
+
+    void add_first_sight(uint16_t entnum, const democonvert_entity_state_t& state)
+    {
+        entity_sample sample{state};
+        // Baselines and first sights can't carry events
+        sample.state.event = 0;
+        pack(sample.state, sample.packed);
+
+        auto& samples = first_sights[entnum];
+        auto key = std::string(reinterpret_cast<const char*>(&sample.packed), sizeof(sample.packed));
+        auto [it, inserted] = samples.index.try_emplace(key, samples.samples.size());
+        if (inserted)
+            samples.samples.push_back(sample);
+        samples.samples[it->second].count++;
+    }
+
+    bool init_server_context(q2proto_game_api_t game_api)
+    {
+        if (server_context) {
+            if (server_info.game_api != game_api) {
+                fmt::println(stderr, "all demos must use the same game API");
+                return false;
+            }
+            return true;
+        }
+
+        server_info.game_api = game_api;
+        q2proto_servercontext_t context;
+        size_t max_msg_len;
+        if (!check_q2proto_result(q2proto_init_servercontext_demo(&context, protocol, &server_info, &max_msg_len),
+                                  "failed to initialize server context"))
+            return false;
+        server_context = context;
+        return true;
+    }
+
+public:
+    baseline_optimizer(q2proto_protocol_t protocol) : protocol(protocol) {}
+
+    bool handle_message(const q2proto_clientcontext_t& demo_context, const q2proto_svc_message_t& msg)
+    {
+        // Entity entering the frame: delta is against baseline
+        bool first_sight = msg.type == Q2P_SVC_FRAME_ENTITY_DELTA && msg.frame_entity_delta.newnum != 0
+                           && !msg.frame_entity_delta.remove && !state.visible.test(msg.frame_entity_delta.newnum);
+        if (msg.type == Q2P_SVC_SERVERDATA) {
+            if (!init_server_context(demo_context.features.server_game_api))
+                return false;
+            if (!orig_baselines.empty())
+                have_orig_baselines = true;
+        }
+        if (!state.handle_message(demo_context, msg))
+            return false;
+
+        if (msg.type == Q2P_SVC_SPAWNBASELINE && !have_orig_baselines)
+            orig_baselines[msg.spawnbaseline.entnum] = state.baselines[msg.spawnbaseline.entnum];
+        else if (first_sight)
+            add_first_sight(msg.frame_entity_delta.newnum, state.entities[msg.frame_entity_delta.newnum]);
+        return true;
+    }
+
+    /// Total size of first sight deltas, if \a baseline is used
+    nonstd::expected<uint64_t, q2proto_error_t> first_sight_cost(uint16_t entnum,
+                                                                 const q2proto_packed_entity_state_t* baseline,
+                                                                 const entity_samples& samples)
+    {
+        uint64_t cost = 0;
+        for (const auto& sample : samples.samples) {
+            q2proto_entity_state_delta_t delta;
+            q2proto_server_make_entity_state_delta(&*server_context, baseline, &sample.packed, true, &delta);
+            size_t size;
+            auto err = q2proto_server_entity_delta_size(&*server_context, entnum, &delta, &size);
+            if (err != Q2P_ERR_SUCCESS)
+                return nonstd::make_unexpected(err);
+            cost += size * sample.count;
+        }
+        return cost;
+    }
+
+    struct result
+    {
+        uint16_t entnum;
+        democonvert_entity_state_t baseline;
+        uint64_t orig_cost;
+        uint64_t best_cost;
+    };
+
+    nonstd::expected<std::vector<result>, q2proto_error_t> optimize()
+    {
+        std::vector<result> results;
+        if (!server_context)
+            return results;
+
+        for (auto& [entnum, samples] : first_sights) {
+            democonvert_entity_state_t orig_state = {};
+            auto orig_it = orig_baselines.find(entnum);
+            if (orig_it != orig_baselines.end())
+                orig_state = orig_it->second;
+            q2proto_packed_entity_state_t orig_packed;
+            pack(orig_state, orig_packed);
+
+            auto orig_cost = first_sight_cost(entnum, &orig_packed, samples);
+            if (!orig_cost)
+                return nonstd::make_unexpected(orig_cost.error());
+
+            result entity_result{entnum, orig_state, *orig_cost, *orig_cost};
+
+            // Consider the most frequently seen states
+            std::vector<const entity_sample*> candidates;
+            for (const auto& sample : samples.samples)
+                candidates.push_back(&sample);
+            std::ranges::stable_sort(candidates, std::greater{}, &entity_sample::count);
+            if (candidates.size() > max_candidates)
+                candidates.resize(max_candidates);
+
+            for (const auto* candidate : candidates) {
+                auto cost = first_sight_cost(entnum, &candidate->packed, samples);
+                if (!cost)
+                    return nonstd::make_unexpected(cost.error());
+                if (*cost < entity_result.best_cost) {
+                    entity_result.best_cost = *cost;
+                    entity_result.baseline = candidate->state;
+                }
+            }
+            results.push_back(entity_result);
+        }
+        return results;
+    }
+};
+
+static nonstd::expected<void, int> read_demo(const char* filename, baseline_optimizer& optimizer)
+{
+    q2proto_clientcontext_t demo_context;
+    if (!check_q2proto_result(q2proto_init_clientcontext(&demo_context), "failed to initialize client context"))
+        return nonstd::make_unexpected(-4);
+
+    demo_file_reader demo_file;
+    auto open_result = demo_file.open(filename);
+    if (!open_result)
+        return open_result;
+
+    while (true) {
+        std::span<const std::byte> block;
+        auto read_result = demo_file.read_block(block);
+        if (!read_result)
+            return nonstd::make_unexpected(read_result.error());
+        if (!*read_result)
+            break;
+
+        auto io_ctx = io_context(block.data(), uint32_t(block.size()));
+        uintptr_t io_arg = reinterpret_cast<uintptr_t>(&io_ctx);
+
+        q2proto_svc_message_t msg;
+        while (true) {
+            auto client_read_result = q2proto_client_read(&demo_context, io_arg, &msg);
+            if (client_read_result == Q2P_ERR_NO_MORE_INPUT)
+                break;
+            else if (!check_q2proto_result(client_read_result, "failed to read message"))
+                return nonstd::make_unexpected(-5);
+            if (!optimizer.handle_message(demo_context, msg))
+                return nonstd::make_unexpected(-6);
+        }
+    }
+    return {};
+}
+
+static std::string format_vec(const q2proto_vec3_t v) { return fmt::format("{},{},{}", v[0], v[1], v[2]); }
+
+static std::string format_baseline(uint16_t entnum, const democonvert_entity_state_t& state)
+{
+    std::string str = fmt::format("{}", entnum);
+    auto out = std::back_inserter(str);
+#define FIELD(NAME)                                   \
+    if (state.NAME != 0)                              \
+        fmt::format_to(out, " " #NAME "={}", state.NAME);
+#define VEC_FIELD(NAME)                                                   \
+    if (state.NAME[0] != 0 || state.NAME[1] != 0 || state.NAME[2] != 0) \
+        fmt::format_to(out, " " #NAME "={}", format_vec(state.NAME));
+    FIELD(modelindex)
+    FIELD(modelindex2)
+    FIELD(modelindex3)
+    FIELD(modelindex4)
+    FIELD(frame)
+    FIELD(skinnum)
+    FIELD(effects)
+    FIELD(renderfx)
+    VEC_FIELD(origin)
+    VEC_FIELD(angles)
+    VEC_FIELD(old_origin)
+    FIELD(sound)
+    FIELD(loop_volume)
+    FIELD(loop_attenuation)
+    FIELD(solid)
+    FIELD(alpha)
+    FIELD(scale)
+#undef FIELD
+#undef VEC_FIELD
+    return str;
+}
+
+int main(int argc, const char* argv[])
+{
+    q2proto_protocol_t protocol = Q2P_PROTOCOL_INVALID;
+    const char* output_name = nullptr;
+    std::vector<const char*> demo_names;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg(argv[i]);
+        if (arg == "-p" && i + 1 < argc) {
+            protocol = q2proto_protocol_from_netver(atoi(argv[++i]));
+            if (protocol == Q2P_PROTOCOL_INVALID) {
+                fmt::println(stderr, "unknown protocol {}", argv[i]);
+                return -1;
+            }
+        } else if (arg == "-o" && i + 1 < argc)
+            output_name = argv[++i];
+        else
+            demo_names.push_back(argv[i]);
+    }
+    if (demo_names.empty()) {
+        fmt::println(stderr, "Syntax: {} [-p protocol] [-o output] [demofile...]", argv[0]);
+        fmt::println(stderr, "  -p protocol  Protocol number to optimize for. Default: demo protocol for game API");
+        fmt::println(stderr, "  -o output    Baseline override file to write. Default: standard output");
+        fmt::println(stderr, "All demos should be recorded on the same map.");
+        return -1;
+    }
+
+    baseline_optimizer optimizer(protocol);
+    for (const auto* demo_name : demo_names) {
+        auto read_result = read_demo(demo_name, optimizer);
+        if (!read_result) {
+            fmt::println(stderr, "failed to process \"{}\"", demo_name);
+            return read_result.error();
+        }
+    }
+
+    auto results = optimizer.optimize();
+    if (!results) {
+        check_q2proto_result(results.error(), "failed to compute delta sizes");
+        return -4;
+    }
+
+    FILE* output = stdout;
+    if (output_name) {
+        output = fopen(output_name, "w");
+        if (!output)
+            return print_io_error(errno, "failed to open \"{}\"", output_name);
+    }
+    auto close_output = nonstd::make_scope_exit([&] {
+        if (output != stdout)
+            fclose(output);
+    });
+
+    uint64_t total_orig = 0, total_best = 0;
+    size_t num_changed = 0;
+    fmt::println(output, "// q2proto baseline overrides");
+    fmt::println(output, "// <entnum> <field>=<value>...; fields not listed are zero");
+    for (const auto& result : *results) {
+        total_orig += result.orig_cost;
+        total_best += result.best_cost;
+        if (result.best_cost >= result.orig_cost)
+            continue;
+        fmt::println(output, "{}", format_baseline(result.entnum, result.baseline));
+        num_changed++;
+    }
+
+    fmt::println(stderr, "{} entities seen, {} baselines changed", results->size(), num_changed);
+    fmt::println(stderr, "first sight delta bytes: {} -> {}", total_orig, total_best);
+    return 0;
+}
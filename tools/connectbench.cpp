@@ -0,0 +1,126 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/* Connect benchmark:
+ * Measures how many "connect" commands per second can be parsed and turned into server contexts, as happens
+ * for every connection attempt. Server contexts are taken from a context pool and returned right away,
+ * like a server rejecting a flood of bogus connection attempts would. */
+
+#include "q2protoio.hpp"
+#include "toolutil.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fmt/format.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "q2proto/q2proto.h"
+
+// Build arguments of "connect" command, as sent by a client
+static std::string make_connect_args(q2proto_protocol_t protocol, int qport, int32_t challenge)
+{
+    q2proto_connect_t connect = {};
+    connect.protocol = protocol;
+    connect.qport = qport;
+    connect.challenge = challenge;
+    connect.userinfo = q2proto_make_string("\\name\\player\\skin\\male/grunt\\rate\\25000\\msg\\1\\hand\\2\\fov\\90");
+    connect.packet_length = 1390;
+    q2proto_complete_connect(&connect);
+
+    char buf[512];
+    size_t need_size;
+    if (!check_q2proto_result(q2proto_get_connect_arguments(buf, sizeof(buf), &need_size, &connect),
+                              "failed to build connect arguments"))
+        return {};
+    return buf;
+}
+
+int main(int argc, const char* argv[])
+{
+    size_t num_iterations = 1000000;
+    size_t pool_size = 256;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg(argv[i]);
+        if (arg == "-n" && i + 1 < argc)
+            num_iterations = std::max(1, atoi(argv[++i]));
+        else if (arg == "-s" && i + 1 < argc)
+            pool_size = std::max(1, atoi(argv[++i]));
+        else {
+            fmt::println(stderr, "Syntax: {} [-n iterations] [-s pool size]", argv[0]);
+            fmt::println(stderr, "  -n iterations  Number of connects per protocol. Default: 1000000");
+            fmt::println(stderr, "  -s pool size   Number of contexts in pool. Default: 256");
+            return -1;
+        }
+    }
+
+    const q2proto_protocol_t protocols[] = {Q2P_PROTOCOL_VANILLA, Q2P_PROTOCOL_R1Q2, Q2P_PROTOCOL_Q2PRO,
+                                            Q2P_PROTOCOL_Q2REPRO};
+    q2proto_server_info_t server_info = {};
+    server_info.default_packet_length = 1390;
+
+    std::vector<q2proto_servercontext_t> contexts(pool_size);
+    std::vector<uint32_t> free_indices(pool_size);
+    q2proto_servercontext_pool_t pool;
+    q2proto_servercontext_pool_init(&pool, contexts.data(), free_indices.data(), pool_size);
+
+    fmt::println("{:>10} {:>14} {:>14}", "protocol", "parse/s", "connect/s");
+    for (auto protocol : protocols) {
+        if (auto game_api = most_capable_game_api(protocol))
+            server_info.game_api = *game_api;
+
+        // A handful of distinct connect strings, to avoid measuring a single, perfectly predicted input
+        std::vector<std::string> connect_args;
+        for (int i = 0; i < 16; i++)
+            connect_args.push_back(make_connect_args(protocol, 1000 + i * 37, 0x12345678 + i * 7919));
+        if (connect_args[0].empty())
+            return -2;
+
+        // Parse only
+        q2proto_connect_t parsed;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < num_iterations; i++) {
+            const auto& args = connect_args[i % connect_args.size()];
+            if (!check_q2proto_result(q2proto_parse_connect(args.c_str(), &protocol, 1, &server_info, &parsed),
+                                      "failed to parse \"{}\"", args))
+                return -3;
+        }
+        std::chrono::duration<double> parse_time = std::chrono::steady_clock::now() - start;
+
+        // Parse and set up context
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < num_iterations; i++) {
+            const auto& args = connect_args[i % connect_args.size()];
+            q2proto_servercontext_t *context;
+            if (!check_q2proto_result(q2proto_parse_connect(args.c_str(), &protocol, 1, &server_info, &parsed),
+                                      "failed to parse \"{}\"", args)
+                || !check_q2proto_result(q2proto_servercontext_pool_acquire(&pool, &server_info, &parsed, &context),
+                                         "failed to set up context"))
+                return -3;
+            q2proto_servercontext_pool_release(&pool, context);
+        }
+        std::chrono::duration<double> connect_time = std::chrono::steady_clock::now() - start;
+
+        fmt::println("{:>10} {:>14.0f} {:>14.0f}", q2proto_get_protocol_netver(protocol),
+                     double(num_iterations) / parse_time.count(), double(num_iterations) / connect_time.count());
+    }
+
+    return 0;
+}
@@ -0,0 +1,277 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/* Demo archiver:
+ * Converts raw demos to chunked, compressed demo archives (see demofile.hpp) and back.
+ * Archives can be read directly by the demo tools, including seeking. */
+
+#include "demofile.hpp"
+#include "toolutil.hpp"
+
+#include "expected.hpp"
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <fmt/format.h>
+#include <ranges>
+#include "scope.hpp"
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include <zlib.h>
+
+// Default number of blocks per chunk
+static constexpr uint32_t default_blocks_per_chunk = 256;
+
+/// Writes a demo archive
+class archive_writer
+{
+    FILE* out_file;
+    uint32_t blocks_per_chunk;
+    int level;
+
+    demo_archive::header header = {};
+    std::vector<demo_archive::chunk_entry> chunks;
+    uint64_t file_offset = demo_archive::header_size;
+
+    /// Raw data of current chunk
+    std::vector<std::byte> chunk_data;
+    uint32_t chunk_blocks = 0;
+    std::vector<std::byte> compressed_data;
+
+    nonstd::expected<void, int> flush_chunk()
+    {
+        if (chunk_data.empty())
+            return {};
+
+        uLongf compressed_size = compressBound(uLong(chunk_data.size()));
+        compressed_data.resize(compressed_size);
+        int z_result = compress2(reinterpret_cast<Bytef*>(compressed_data.data()), &compressed_size,
+                                 reinterpret_cast<const Bytef*>(chunk_data.data()), uLong(chunk_data.size()), level);
+        if (z_result != Z_OK) {
+            fmt::println(stderr, "failed to compress chunk: {}", zError(z_result));
+            return nonstd::make_unexpected(-7);
+        }
+        auto result = write_file(out_file, compressed_data.data(), compressed_size);
+        if (!result)
+            return result;
+
+        chunks.push_back({header.raw_size, file_offset, uint32_t(compressed_size), uint32_t(chunk_data.size())});
+        header.raw_size += chunk_data.size();
+        file_offset += compressed_size;
+        chunk_data.clear();
+        chunk_blocks = 0;
+        return {};
+    }
+
+public:
+    archive_writer(FILE* out_file, uint32_t blocks_per_chunk, int level)
+        : out_file(out_file), blocks_per_chunk(blocks_per_chunk), level(level)
+    {
+        header.blocks_per_chunk = blocks_per_chunk;
+    }
+
+    nonstd::expected<void, int> begin()
+    {
+        // Placeholder, rewritten by finish()
+        std::byte header_buf[demo_archive::header_size] = {};
+        return write_file(out_file, header_buf, sizeof(header_buf));
+    }
+
+    nonstd::expected<void, int> add_block(std::span<const std::byte> block)
+    {
+        uint32_t block_size = uint32_t(block.size());
+        if constexpr (std::endian::native != std::endian::little)
+            block_size = std::byteswap(block_size);
+        const auto* size_bytes = reinterpret_cast<const std::byte*>(&block_size);
+        chunk_data.insert(chunk_data.end(), size_bytes, size_bytes + sizeof(block_size));
+        chunk_data.insert(chunk_data.end(), block.begin(), block.end());
+        if (++chunk_blocks >= blocks_per_chunk)
+            return flush_chunk();
+        return {};
+    }
+
+    nonstd::expected<void, int> finish()
+    {
+        auto result = flush_chunk();
+        if (!result)
+            return result;
+
+        std::vector<std::byte> index_buf(chunks.size() * demo_archive::index_entry_size);
+        for (size_t i = 0; i < chunks.size(); i++)
+            demo_archive::write_index_entry(index_buf.data() + i * demo_archive::index_entry_size, chunks[i]);
+        result = write_file(out_file, index_buf.data(), index_buf.size());
+        if (!result)
+            return result;
+
+        header.num_chunks = uint32_t(chunks.size());
+        header.index_offset = file_offset;
+        std::byte header_buf[demo_archive::header_size];
+        demo_archive::write_header(header_buf, header);
+        if (fseek(out_file, 0, SEEK_SET) != 0)
+            return nonstd::make_unexpected(print_io_error(errno, "seek error"));
+        return write_file(out_file, header_buf, sizeof(header_buf));
+    }
+
+    size_t num_chunks() const { return chunks.size(); }
+    uint64_t raw_size() const { return header.raw_size; }
+    uint64_t archive_size() const { return file_offset + chunks.size() * demo_archive::index_entry_size; }
+};
+
+static nonstd::expected<void, int> create_archive(demo_file_reader& reader, FILE* out_file, uint32_t blocks_per_chunk,
+                                                  int level)
+{
+    archive_writer writer(out_file, blocks_per_chunk, level);
+    auto result = writer.begin();
+    if (!result)
+        return result;
+
+    while (true) {
+        std::span<const std::byte> block;
+        auto block_result = reader.read_block(block);
+        if (!block_result)
+            return nonstd::make_unexpected(block_result.error());
+        if (!*block_result)
+            break;
+        result = writer.add_block(block);
+        if (!result)
+            return result;
+    }
+    result = writer.finish();
+    if (!result)
+        return result;
+
+    fmt::println(stderr, "{} bytes -> {} bytes ({:.1f}%), {} chunks", writer.raw_size(), writer.archive_size(),
+                 writer.raw_size() > 0 ? 100.0 * double(writer.archive_size()) / double(writer.raw_size()) : 0.0,
+                 writer.num_chunks());
+    return {};
+}
+
+static nonstd::expected<void, int> extract_archive(demo_file_reader& reader, FILE* out_file)
+{
+    uint64_t raw_size = 0;
+    while (true) {
+        std::span<const std::byte> block;
+        auto block_result = reader.read_block(block);
+        if (!block_result)
+            return nonstd::make_unexpected(block_result.error());
+        if (!*block_result)
+            break;
+
+        uint32_t block_size = uint32_t(block.size());
+        if constexpr (std::endian::native != std::endian::little)
+            block_size = std::byteswap(block_size);
+        auto result = write_file(out_file, &block_size, sizeof(block_size));
+        if (result)
+            result = write_file(out_file, block.data(), block.size());
+        if (!result)
+            return result;
+        raw_size += sizeof(block_size) + block.size();
+    }
+
+    uint32_t end_marker = (uint32_t)-1;
+    fmt::println(stderr, "{} bytes", raw_size + sizeof(end_marker));
+    return write_file(out_file, &end_marker, sizeof(end_marker));
+}
+
+static void list_archive(const demo_file_reader& reader)
+{
+    if (!reader.is_archive()) {
+        fmt::println("not a demo archive");
+        return;
+    }
+    const auto& header = reader.get_archive_header();
+    fmt::println("{} chunks of up to {} blocks", header.num_chunks, header.blocks_per_chunk);
+    fmt::println("{:>6} {:>12} {:>12} {:>10} {:>10}", "chunk", "raw offset", "file offset", "raw size", "compressed");
+    uint64_t compressed_size = 0;
+    for (const auto& [index, chunk] : std::views::enumerate(reader.archive_chunks())) {
+        fmt::println("{:>6} {:>12} {:>12} {:>10} {:>10}", index, chunk.raw_offset, chunk.file_offset, chunk.raw_size,
+                     chunk.compressed_size);
+        compressed_size += chunk.compressed_size;
+    }
+    fmt::println("raw size {}, compressed size {}", header.raw_size, compressed_size);
+}
+
+int main(int argc, const char* argv[])
+{
+    uint32_t blocks_per_chunk = default_blocks_per_chunk;
+    int level = Z_BEST_COMPRESSION;
+    bool extract = false, list = false;
+    const char* output_name = nullptr;
+    const char* demo_name = nullptr;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg(argv[i]);
+        if (arg == "-b" && i + 1 < argc) {
+            blocks_per_chunk = uint32_t(atoi(argv[++i]));
+            if (blocks_per_chunk == 0) {
+                fmt::println(stderr, "invalid number of blocks per chunk {}", argv[i]);
+                return -1;
+            }
+        } else if (arg == "-z" && i + 1 < argc) {
+            level = atoi(argv[++i]);
+            if (level < Z_NO_COMPRESSION || level > Z_BEST_COMPRESSION) {
+                fmt::println(stderr, "invalid compression level {}", argv[i]);
+                return -1;
+            }
+        } else if (arg == "-x")
+            extract = true;
+        else if (arg == "-l")
+            list = true;
+        else if (arg == "-o" && i + 1 < argc)
+            output_name = argv[++i];
+        else
+            demo_name = argv[i];
+    }
+    if (!demo_name || (!output_name && !list)) {
+        fmt::println(stderr, "Syntax: {} [-b blocks] [-z level] [-x] [-l] -o output demofile", argv[0]);
+        fmt::println(stderr, "  -b blocks  Blocks per chunk. Default: {}", default_blocks_per_chunk);
+        fmt::println(stderr, "  -z level   Compression level (0-9). Default: {}", Z_BEST_COMPRESSION);
+        fmt::println(stderr, "  -x         Extract a demo archive into a raw demo");
+        fmt::println(stderr, "  -l         List chunks of a demo archive");
+        fmt::println(stderr, "  -o output  Output file");
+        fmt::println(stderr, "Without -x or -l, an archive is created from a raw demo or another archive.");
+        return -1;
+    }
+
+    demo_file_reader reader;
+    auto result = reader.open(demo_name);
+    if (!result)
+        return result.error();
+
+    if (list) {
+        list_archive(reader);
+        return 0;
+    }
+
+    auto* out_file = fopen(output_name, "wb");
+    if (!out_file)
+        return print_io_error(errno, "failed to open \"{}\"", output_name);
+    auto close_out = nonstd::make_scope_exit([&] { fclose(out_file); });
+
+    auto start_time = std::chrono::steady_clock::now();
+    if (extract)
+        result = extract_archive(reader, out_file);
+    else
+        result = create_archive(reader, out_file, blocks_per_chunk, level);
+    if (!result)
+        return result.error();
+    std::chrono::duration<double> time = std::chrono::steady_clock::now() - start_time;
+    fmt::println(stderr, "{:.3f} s", time.count());
+    return 0;
+}
@@ -0,0 +1,557 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/* Demo converter:
+ * Streams messages read from a demo into a demo server context for another protocol.
+ * Most messages are passed through as-is. Entity and player states are tracked in "game"
+ * representation, re-packed for the target protocol, and delta compressed against what was
+ * actually written; frames that exceed the target packet length defer entity deltas to later frames.
+ * The game API (and thus the configstring layout) of the source demo is kept, unless overridden. */
+
+#include "democonvert.h"
+#include "demofile.hpp"
+#include "demostate.hpp"
+#include "q2protoio.hpp"
+#include "q2protoio_write.hpp"
+#include "toolutil.hpp"
+
+#include "expected.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fmt/format.h>
+#include <map>
+#include <memory>
+#include "scope.hpp"
+#include <string_view>
+#include <vector>
+
+/// Conversion statistics
+struct convert_stats
+{
+    uint64_t bytes_in = 0, bytes_out = 0;
+    uint32_t blocks_in = 0, blocks_out = 0;
+    uint32_t frames_in = 0, frames_out = 0, frames_dropped = 0;
+    /// Number of entity deltas deferred to a later frame due to lack of packet space
+    uint64_t deferred_entities = 0;
+    /// Messages not supported by the target protocol, by type
+    std::map<q2proto_svc_message_type_t, uint32_t> skipped;
+};
+
+class demo_converter
+{
+    q2proto_protocol_t target_protocol;
+    int packet_length;
+    int game_api_override;
+    FILE* out_file;
+
+    /// Source demo context
+    q2proto_clientcontext_t source_context;
+    q2proto_server_info_t server_info = {};
+    /// Target demo context
+    q2proto_servercontext_t context;
+    bool have_serverdata = false;
+    /// Client context that read back the target serverdata, for target solid packing
+    q2proto_clientcontext_t loopback_context;
+    /// Whether solid values need conversion between source and target
+    bool convert_solids = false;
+    uint32_t source_bsp_solid = 0, target_bsp_solid = 0;
+
+    /// Output block
+    std::unique_ptr<write_io_context> out;
+
+    /// Source game state, in game representation. Entities changed in the current frame need re-packing.
+    demo_state state;
+    /// Entities which had an old_origin sent in the current frame
+    entity_set force_old_origin;
+
+    /**\name Packed states
+     * @{ */
+    std::vector<q2proto_packed_entity_state_t> baselines_packed =
+        std::vector<q2proto_packed_entity_state_t>(Q2PROTO_MAX_ENTITIES);
+    std::vector<q2proto_packed_entity_state_t> entities_packed =
+        std::vector<q2proto_packed_entity_state_t>(Q2PROTO_MAX_ENTITIES);
+    /** @} */
+
+    /**\name Last written frame, as seen by the demo player
+     * @{ */
+    bool have_sent_frame = false;
+    int32_t sent_serverframe = -1;
+    std::vector<q2proto_packed_entity_state_t> sent_packed =
+        std::vector<q2proto_packed_entity_state_t>(Q2PROTO_MAX_ENTITIES);
+    entity_set sent_visible;
+    q2proto_packed_player_state_t sent_player = {};
+    int16_t sent_clientnum = 0;
+    /** @} */
+
+    std::vector<q2proto_frame_entity_t> frame_entities;
+
+    uintptr_t out_io_arg() const { return reinterpret_cast<uintptr_t>(out.get()); }
+
+    /// Discard output written after \a mark
+    void rollback(size_t mark)
+    {
+        out->size = mark;
+        out->err = Q2P_ERR_SUCCESS;
+    }
+
+    uint32_t convert_solid(uint32_t solid)
+    {
+        if (!convert_solids || solid == 0)
+            return solid;
+        if (solid == source_bsp_solid)
+            return target_bsp_solid;
+        q2proto_vec3_t mins, maxs;
+        q2proto_client_unpack_solid(&source_context, solid, mins, maxs);
+        return q2proto_client_pack_solid(&loopback_context, mins, maxs);
+    }
+
+    /// Pack an entity state for the target protocol
+    void pack_entity(const democonvert_entity_state_t& entity_state, q2proto_packed_entity_state_t& packed)
+    {
+        if (!convert_solids) {
+            democonvert_pack_entity(&context, &entity_state, &packed);
+            return;
+        }
+        auto converted = entity_state;
+        converted.solid = convert_solid(entity_state.solid);
+        democonvert_pack_entity(&context, &converted, &packed);
+    }
+
+    /// Solid encodings used by protocols
+    enum class solid_encoding
+    {
+        /// 16 bit (vanilla)
+        packed16,
+        /// 32 bit, R1Q2 encoding
+        packed32_r1q2,
+        /// 32 bit, Q2PRO v2 encoding
+        packed32_q2pro_v2,
+    };
+
+    /// Determine solid encoding of a client context that read serverdata with protocol \a protocol_netver
+    static solid_encoding get_solid_encoding(const q2proto_clientcontext_t& client_context, int protocol_netver)
+    {
+        if (!client_context.features.has_solid32)
+            return solid_encoding::packed16;
+        switch (q2proto_protocol_from_netver(protocol_netver)) {
+        case Q2P_PROTOCOL_R1Q2:
+            return solid_encoding::packed32_r1q2;
+        case Q2P_PROTOCOL_Q2PRO:
+            return client_context.features.server_game_api >= Q2PROTO_GAME_Q2PRO_EXTENDED
+                       ? solid_encoding::packed32_q2pro_v2
+                       : solid_encoding::packed32_r1q2;
+        default:
+            return solid_encoding::packed32_q2pro_v2;
+        }
+    }
+
+    void setup_solid_conversion(int source_protocol_netver, int target_protocol_netver)
+    {
+        source_bsp_solid = source_context.features.has_solid32 ? 255 : 31;
+        target_bsp_solid = loopback_context.features.has_solid32 ? 255 : 31;
+        convert_solids = get_solid_encoding(source_context, source_protocol_netver)
+                         != get_solid_encoding(loopback_context, target_protocol_netver);
+    }
+
+    void reset_state()
+    {
+        std::ranges::fill(baselines_packed, q2proto_packed_entity_state_t{});
+        // Player states are packed with the stats of the target game API
+        state.player.num_stats = server_info.game_api >= Q2PROTO_GAME_Q2PRO_EXTENDED_V2 ? Q2PROTO_STATS : 32;
+        force_old_origin.clear();
+        have_sent_frame = false;
+        sent_serverframe = -1;
+        sent_visible.clear();
+    }
+
+    nonstd::expected<void, int> flush()
+    {
+        if (out->size == 0)
+            return {};
+        uint32_t block_size = uint32_t(out->size);
+        if constexpr (std::endian::native != std::endian::little)
+            block_size = std::byteswap(block_size);
+        auto result = write_file(out_file, &block_size, sizeof(block_size));
+        if (result)
+            result = write_file(out_file, out->buffer.data(), out->size);
+        stats.blocks_out++;
+        stats.bytes_out += sizeof(block_size) + out->size;
+        out->clear();
+        return result;
+    }
+
+    /// Write a message to the current block, starting a new block if the current one is full
+    nonstd::expected<q2proto_error_t, int> write_message(const q2proto_svc_message_t& msg)
+    {
+        auto mark = out->size;
+        auto err = q2proto_server_write(&context, out_io_arg(), &msg);
+        if (err == Q2P_ERR_NOT_ENOUGH_PACKET_SPACE && mark > 0) {
+            rollback(mark);
+            auto result = flush();
+            if (!result)
+                return nonstd::make_unexpected(result.error());
+            mark = 0;
+            err = q2proto_server_write(&context, out_io_arg(), &msg);
+        }
+        if (err != Q2P_ERR_SUCCESS)
+            rollback(mark);
+        return err;
+    }
+
+    nonstd::expected<void, int> handle_serverdata(const q2proto_svc_serverdata_t& serverdata)
+    {
+        // Context setup may change the maximum message length, so finish the current block
+        if (out) {
+            auto result = flush();
+            if (!result)
+                return result;
+        }
+
+        server_info.game_api = game_api_override >= 0 ? q2proto_game_api_t(game_api_override)
+                                                      : source_context.features.server_game_api;
+        server_info.default_packet_length = packet_length;
+        size_t max_msg_len;
+        if (!check_q2proto_result(q2proto_init_servercontext_demo(&context, target_protocol, &server_info, &max_msg_len),
+                                  "failed to initialize server context"))
+            return nonstd::make_unexpected(-6);
+        if (!out || out->buffer.size() != max_msg_len)
+            out = std::make_unique<write_io_context>(uint32_t(max_msg_len));
+
+        q2proto_svc_message_t msg = {.type = Q2P_SVC_SERVERDATA, .serverdata = {}};
+        if (!check_q2proto_result(q2proto_server_fill_serverdata(&context, &msg.serverdata),
+                                  "failed to fill serverdata"))
+            return nonstd::make_unexpected(-6);
+        msg.serverdata.servercount = serverdata.servercount;
+        msg.serverdata.attractloop = serverdata.attractloop;
+        msg.serverdata.gamedir = serverdata.gamedir;
+        msg.serverdata.clientnum = serverdata.clientnum;
+        msg.serverdata.levelname = serverdata.levelname;
+        msg.serverdata.strafejump_hack = serverdata.strafejump_hack;
+        if (serverdata.server_fps != 0)
+            msg.serverdata.server_fps = serverdata.server_fps;
+        msg.serverdata.r1q2.enhanced = serverdata.r1q2.enhanced;
+        msg.serverdata.q2pro.server_state = serverdata.q2pro.server_state;
+        msg.serverdata.q2pro.qw_mode = serverdata.q2pro.qw_mode;
+        msg.serverdata.q2pro.waterjump_hack = serverdata.q2pro.waterjump_hack;
+
+        auto write_result = write_message(msg);
+        if (!write_result)
+            return nonstd::make_unexpected(write_result.error());
+        if (!check_q2proto_result(*write_result, "failed to write serverdata"))
+            return nonstd::make_unexpected(-6);
+        have_serverdata = true;
+
+        // Read back the serverdata, to learn about target solid encoding
+        auto written = out->written();
+        auto io_ctx = io_context(written.data(), written.size());
+        q2proto_svc_message_t loopback_msg;
+        if (!check_q2proto_result(q2proto_init_clientcontext(&loopback_context), "failed to initialize client context")
+            || !check_q2proto_result(
+                q2proto_client_read(&loopback_context, reinterpret_cast<uintptr_t>(&io_ctx), &loopback_msg),
+                "failed to read back serverdata"))
+            return nonstd::make_unexpected(-6);
+        setup_solid_conversion(serverdata.protocol, loopback_msg.serverdata.protocol);
+
+        reset_state();
+        return {};
+    }
+
+    nonstd::expected<void, int> handle_spawnbaseline(const q2proto_svc_spawnbaseline_t& spawnbaseline)
+    {
+        auto entnum = spawnbaseline.entnum;
+        pack_entity(state.baselines[entnum], baselines_packed[entnum]);
+
+        q2proto_svc_message_t msg = {.type = Q2P_SVC_SPAWNBASELINE, .spawnbaseline = {}};
+        msg.spawnbaseline.entnum = entnum;
+        q2proto_server_make_entity_state_delta(&context, nullptr, &baselines_packed[entnum],
+                                               (spawnbaseline.delta_state.delta_bits & Q2P_ESD_OLD_ORIGIN) != 0,
+                                               &msg.spawnbaseline.delta_state);
+        return write_or_skip(msg);
+    }
+
+    void begin_frame(const q2proto_svc_frame_t& frame)
+    {
+        stats.frames_in++;
+        // Uncompressed source frame: write an uncompressed frame as well
+        if (frame.deltaframe < 0) {
+            have_sent_frame = false;
+            sent_visible.clear();
+        }
+    }
+
+    /// Write frame message and entity deltas to the current block
+    q2proto_error_t write_frame(q2proto_frame_write_result_t& write_result)
+    {
+        q2proto_svc_message_t msg = {.type = Q2P_SVC_FRAME, .frame = state.frame};
+        msg.frame.deltaframe = have_sent_frame ? sent_serverframe : -1;
+        msg.frame.areabits = state.areabits.data();
+        msg.frame.areabits_len = uint8_t(state.areabits.size());
+        q2proto_packed_player_state_t player_packed;
+        democonvert_pack_player(&context, &state.player, &player_packed);
+        q2proto_server_make_player_state_delta(&context, have_sent_frame ? &sent_player : nullptr, &player_packed,
+                                               &msg.frame.playerstate);
+        if (context.features.playerstate_clientnum && (!have_sent_frame || state.clientnum != sent_clientnum)) {
+            msg.frame.playerstate.delta_bits |= Q2P_PSD_CLIENTNUM;
+            msg.frame.playerstate.clientnum = state.clientnum;
+        }
+        auto err = q2proto_server_write(&context, out_io_arg(), &msg);
+        if (err != Q2P_ERR_SUCCESS)
+            return err;
+
+        for (auto& frame_entity : frame_entities)
+            frame_entity.deferred = false;
+        return q2proto_server_write_frame_entities(&context, out_io_arg(), nullptr, frame_entities.data(),
+                                                   frame_entities.size(), &write_result);
+    }
+
+    nonstd::expected<void, int> end_frame()
+    {
+        for (auto entnum : state.changed()) {
+            if (state.visible.test(entnum))
+                pack_entity(state.entities[entnum], entities_packed[entnum]);
+        }
+
+        // Collect entity deltas against the last written frame
+        static const entity_set no_entities;
+        frame_entities.clear();
+        entity_set::for_each_union(state.visible, have_sent_frame ? sent_visible : no_entities, [&](uint16_t entnum) {
+            bool new_visible = state.visible.test(entnum);
+            bool old_visible = have_sent_frame && sent_visible.test(entnum);
+            if (new_visible && old_visible
+                && memcmp(&entities_packed[entnum], &sent_packed[entnum], sizeof(q2proto_packed_entity_state_t)) == 0)
+                return;
+            q2proto_frame_entity_t frame_entity = {};
+            frame_entity.entnum = entnum;
+            frame_entity.remove = !new_visible;
+            frame_entity.write_old_origin = !old_visible || force_old_origin.test(entnum);
+            frame_entity.from = old_visible ? &sent_packed[entnum] : &baselines_packed[entnum];
+            frame_entity.to = &entities_packed[entnum];
+            frame_entities.push_back(frame_entity);
+        });
+
+        for (auto entnum : state.changed())
+            force_old_origin.set(entnum, false);
+        state.clear_changed();
+
+        auto mark = out->size;
+        q2proto_frame_write_result_t write_result;
+        auto err = write_frame(write_result);
+        // Retry in an empty block if the frame didn't fit completely
+        if ((err == Q2P_ERR_NOT_ENOUGH_PACKET_SPACE || (err == Q2P_ERR_SUCCESS && write_result.num_deferred > 0))
+            && mark > 0)
+        {
+            rollback(mark);
+            auto result = flush();
+            if (!result)
+                return result;
+            mark = 0;
+            err = write_frame(write_result);
+        }
+        if (err != Q2P_ERR_SUCCESS) {
+            // Drop frame; the next frame is delta compressed against the last written one
+            rollback(mark);
+            stats.frames_dropped++;
+            return {};
+        }
+
+        stats.frames_out++;
+        stats.deferred_entities += write_result.num_deferred;
+        democonvert_pack_player(&context, &state.player, &sent_player);
+        sent_clientnum = state.clientnum;
+        sent_serverframe = state.frame.serverframe;
+        have_sent_frame = true;
+        for (const auto& frame_entity : frame_entities) {
+            if (frame_entity.deferred)
+                continue;
+            sent_visible.set(frame_entity.entnum, !frame_entity.remove);
+            if (!frame_entity.remove)
+                sent_packed[frame_entity.entnum] = entities_packed[frame_entity.entnum];
+        }
+        return {};
+    }
+
+    /// Write a message, skipping it if it's not supported by the target protocol
+    nonstd::expected<void, int> write_or_skip(const q2proto_svc_message_t& msg)
+    {
+        auto write_result = write_message(msg);
+        if (!write_result)
+            return nonstd::make_unexpected(write_result.error());
+        if (*write_result != Q2P_ERR_SUCCESS)
+            stats.skipped[msg.type]++;
+        return {};
+    }
+
+public:
+    convert_stats stats;
+
+    demo_converter(q2proto_protocol_t target_protocol, int packet_length, int game_api_override, FILE* out_file)
+        : target_protocol(target_protocol), packet_length(packet_length), game_api_override(game_api_override),
+          out_file(out_file)
+    {
+    }
+
+    bool init()
+    {
+        return check_q2proto_result(q2proto_init_clientcontext(&source_context), "failed to initialize client context");
+    }
+
+    nonstd::expected<void, int> handle_message(const q2proto_svc_message_t& msg)
+    {
+        auto state_result = state.handle_message(source_context, msg);
+        if (!state_result)
+            return state_result;
+
+        if (msg.type == Q2P_SVC_SERVERDATA)
+            return handle_serverdata(msg.serverdata);
+        if (!have_serverdata) {
+            stats.skipped[msg.type]++;
+            return {};
+        }
+
+        switch (msg.type) {
+        case Q2P_SVC_SPAWNBASELINE:
+            return handle_spawnbaseline(msg.spawnbaseline);
+        case Q2P_SVC_FRAME:
+            begin_frame(msg.frame);
+            return {};
+        case Q2P_SVC_FRAME_ENTITY_DELTA:
+            if (msg.frame_entity_delta.newnum == 0)
+                return end_frame();
+            if (msg.frame_entity_delta.entity_delta.delta_bits & Q2P_ESD_OLD_ORIGIN)
+                force_old_origin.set(msg.frame_entity_delta.newnum, true);
+            return {};
+        default:
+            return write_or_skip(msg);
+        }
+    }
+
+    nonstd::expected<void, int> convert(demo_file_reader& demo_file)
+    {
+        while (true) {
+            std::span<const std::byte> block;
+            auto read_result = demo_file.read_block(block);
+            if (!read_result)
+                return nonstd::make_unexpected(read_result.error());
+            if (!*read_result)
+                break;
+            stats.blocks_in++;
+            stats.bytes_in += sizeof(uint32_t) + block.size();
+
+            auto io_ctx = io_context(block.data(), uint32_t(block.size()));
+            uintptr_t io_arg = reinterpret_cast<uintptr_t>(&io_ctx);
+
+            q2proto_svc_message_t msg;
+            while (true) {
+                auto client_read_result = q2proto_client_read(&source_context, io_arg, &msg);
+                if (client_read_result == Q2P_ERR_NO_MORE_INPUT)
+                    break;
+                else if (!check_q2proto_result(client_read_result, "failed to read message"))
+                    return nonstd::make_unexpected(-5);
+                auto result = handle_message(msg);
+                if (!result)
+                    return result;
+            }
+
+            // Keep block boundaries, and thus demo timing, where possible
+            if (out) {
+                auto result = flush();
+                if (!result)
+                    return result;
+            }
+        }
+
+        uint32_t end_marker = (uint32_t)-1;
+        stats.bytes_out += sizeof(end_marker);
+        return write_file(out_file, &end_marker, sizeof(end_marker));
+    }
+};
+
+int main(int argc, const char* argv[])
+{
+    q2proto_protocol_t protocol = Q2P_PROTOCOL_INVALID;
+    int packet_length = 0;
+    int game_api = -1;
+    const char* output_name = nullptr;
+    const char* demo_name = nullptr;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg(argv[i]);
+        if (arg == "-p" && i + 1 < argc) {
+            protocol = q2proto_protocol_from_netver(atoi(argv[++i]));
+            if (protocol == Q2P_PROTOCOL_INVALID) {
+                fmt::println(stderr, "unknown protocol {}", argv[i]);
+                return -1;
+            }
+        } else if (arg == "-g" && i + 1 < argc) {
+            game_api = atoi(argv[++i]);
+            if (game_api < Q2PROTO_GAME_VANILLA || game_api > Q2PROTO_GAME_RERELEASE) {
+                fmt::println(stderr, "unknown game API {}", argv[i]);
+                return -1;
+            }
+        } else if (arg == "-l" && i + 1 < argc)
+            packet_length = atoi(argv[++i]);
+        else if (arg == "-o" && i + 1 < argc)
+            output_name = argv[++i];
+        else
+            demo_name = argv[i];
+    }
+    if (!demo_name || !output_name || protocol == Q2P_PROTOCOL_INVALID) {
+        fmt::println(stderr, "Syntax: {} -p protocol [-g game_api] [-l packet_length] -o output demofile", argv[0]);
+        fmt::println(stderr, "  -p protocol       Protocol number of the converted demo");
+        fmt::println(stderr, "  -g game_api       Game API of the converted demo (0: vanilla, 1: Q2PRO extended,");
+        fmt::println(stderr, "                    2: Q2PRO extended v2, 3: rerelease). Default: game API of the demo");
+        fmt::println(stderr, "  -l packet_length  Packet length of the converted demo. Default: protocol default");
+        fmt::println(stderr, "  -o output         Converted demo file");
+        fmt::println(stderr, "Configstrings are not remapped, so -g should only be used for compatible layouts.");
+        return -1;
+    }
+
+    demo_file_reader demo_file;
+    auto open_result = demo_file.open(demo_name);
+    if (!open_result)
+        return open_result.error();
+
+    auto* out_file = fopen(output_name, "wb");
+    if (!out_file)
+        return print_io_error(errno, "failed to open \"{}\"", output_name);
+    auto close_out = nonstd::make_scope_exit([&] { fclose(out_file); });
+
+    auto converter = std::make_unique<demo_converter>(protocol, packet_length, game_api, out_file);
+    if (!converter->init())
+        return -4;
+
+    auto start_time = std::chrono::steady_clock::now();
+    auto result = converter->convert(demo_file);
+    if (!result) {
+        fmt::println(stderr, "failed to convert \"{}\"", demo_name);
+        return result.error();
+    }
+    std::chrono::duration<double> convert_time = std::chrono::steady_clock::now() - start_time;
+
+    const auto& stats = converter->stats;
+    fmt::println(stderr, "{} bytes in {} blocks -> {} bytes in {} blocks, {:.3f} s", stats.bytes_in, stats.blocks_in,
+                 stats.bytes_out, stats.blocks_out, convert_time.count());
+    fmt::println(stderr, "{} frames -> {} frames ({} dropped), {} entity deltas deferred", stats.frames_in,
+                 stats.frames_out, stats.frames_dropped, stats.deferred_entities);
+    for (const auto& [type, count] : stats.skipped)
+        fmt::println(stderr, "skipped {} {} message(s)", count, q2proto_svc_message_str(type));
+    return 0;
+}
@@ -0,0 +1,105 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef DEMOCONVERT_H_
+#define DEMOCONVERT_H_
+
+#include "q2proto/q2proto.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/// Entity state, as reconstructed from a demo, in "game" representation
+typedef struct democonvert_entity_state_s {
+    uint16_t modelindex;
+    uint16_t modelindex2;
+    uint16_t modelindex3;
+    uint16_t modelindex4;
+    uint16_t frame;
+    uint32_t skinnum;
+    uint64_t effects;
+    uint32_t renderfx;
+    q2proto_vec3_t origin;
+    q2proto_vec3_t angles;
+    q2proto_vec3_t old_origin;
+    uint16_t sound;
+    float loop_volume;
+    float loop_attenuation;
+    uint8_t event;
+    /// Solid value, as encoded by the demo protocol
+    uint32_t solid;
+    float alpha;
+    float scale;
+} democonvert_entity_state_t;
+
+/// Player state, as reconstructed from a demo, in "game" representation
+typedef struct democonvert_player_state_s {
+    struct {
+        uint8_t pm_type;
+        q2proto_vec3_t origin;
+        q2proto_vec3_t velocity;
+        uint16_t pm_time;
+        uint16_t pm_flags;
+        int16_t gravity;
+        q2proto_vec3_t delta_angles;
+        int8_t viewheight;
+    } pmove;
+    q2proto_vec3_t viewoffset;
+    q2proto_vec3_t viewangles;
+    q2proto_vec3_t kick_angles;
+    uint16_t gunindex;
+    uint8_t gunskin;
+    uint16_t gunframe;
+    q2proto_vec3_t gunoffset;
+    q2proto_vec3_t gunangles;
+    float blend[4];
+    float damage_blend[4];
+    uint8_t fov;
+    uint8_t rdflags;
+    int16_t stats[Q2PROTO_STATS];
+    /// Number of stats supported by the target game API
+    int num_stats;
+    uint8_t gunrate;
+    struct {
+        float color[3];
+        float density;
+        float sky_factor;
+    } fog;
+    struct {
+        float start_color[3];
+        float end_color[3];
+        float density;
+        float falloff;
+        float start_dist;
+        float end_dist;
+    } heightfog;
+} democonvert_player_state_t;
+
+/// Pack an entity state for the given server context
+void democonvert_pack_entity(q2proto_servercontext_t *context, const democonvert_entity_state_t *entity_state,
+                             q2proto_packed_entity_state_t *entity_packed);
+/// Pack a player state for the given server context
+void democonvert_pack_player(q2proto_servercontext_t *context, const democonvert_player_state_t *player_state,
+                             q2proto_packed_player_state_t *player_packed);
+
+#if defined(__cplusplus)
+} // extern "C"
+#endif
+
+#endif // DEMOCONVERT_H_
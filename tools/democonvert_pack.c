@@ -0,0 +1,31 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// Packing functions are generated from C code, so they live in a separate source file
+#include "democonvert.h"
+
+#define Q2P_PACK_ENTITY_FUNCTION_NAME democonvert_pack_entity
+#define Q2P_PACK_ENTITY_TYPE          democonvert_entity_state_t *
+
+#include "q2proto/q2proto_packing_entitystate_impl.inc"
+
+#define Q2P_PACK_PLAYER_FUNCTION_NAME     democonvert_pack_player
+#define Q2P_PACK_PLAYER_TYPE              democonvert_player_state_t *
+#define Q2P_PACK_PLAYER_STATS_NUM(PLAYER) ((PLAYER)->num_stats)
+
+#include "q2proto/q2proto_packing_playerstate_impl.inc"
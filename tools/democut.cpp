@@ -0,0 +1,760 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/* Demo cutter:
+ * Extracts frame ranges ("clips") from demos and concatenates them into a single demo.
+ * Frames are delta compressed against earlier frames, so a clip can't simply start at some packet.
+ * Instead, the game state at the first frame of a clip is reconstructed and written as a gamestate
+ * (serverdata, configstrings, baselines) plus a single uncompressed frame; all following packets
+ * of the clip are copied verbatim. Packets with frames delta compressed against a frame the output lacks
+ * (eg one from before the splice) are re-encoded with an uncompressed frame instead. When a clip is from the same map as the previous one, only
+ * changed configstrings and baselines are written instead of a complete gamestate.
+ * Clips are written with the protocol of their source demo, so all clips must use the same protocol. */
+
+#include "democonvert.h"
+#include "demofile.hpp"
+#include "demostate.hpp"
+#include "q2protoio.hpp"
+#include "q2protoio_write.hpp"
+#include "toolutil.hpp"
+
+#include "expected.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fmt/format.h>
+#include <limits>
+#include <map>
+#include <memory>
+#include "scope.hpp"
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// Configstrings identifying the map, at the same index for all supported game APIs
+static constexpr uint16_t cs_mapchecksum = 31;
+static constexpr uint16_t cs_worldmodel = 33;
+
+static std::string to_string(const q2proto_string_t& str) { return std::string(str.str, str.len); }
+
+/// Range of frames to extract from a demo
+struct clip_spec
+{
+    const char* demo_name;
+    /// First and last frame, counted from 0
+    uint32_t first_frame = 0, last_frame = std::numeric_limits<uint32_t>::max();
+};
+
+/// Map a clip is from. Clips with the same identity can be joined without a new gamestate.
+struct map_identity
+{
+    int32_t protocol = 0;
+    uint16_t protocol_version = 0;
+    q2proto_game_api_t game_api = Q2PROTO_GAME_VANILLA;
+    std::string gamedir, levelname, mapchecksum, worldmodel;
+
+    bool operator==(const map_identity&) const = default;
+};
+
+/// Frame read from a block
+struct block_frame
+{
+    int32_t serverframe;
+    int32_t deltaframe;
+};
+
+/// Reads a demo and reconstructs the game state, block by block
+class clip_source
+{
+    demo_file_reader file;
+
+public:
+    q2proto_clientcontext_t context;
+    /// Data of the current block
+    std::span<const std::byte> block;
+    /// Number of frames decoded before the current block
+    uint32_t block_first_frame = 0;
+    /// Frames in the current block
+    std::vector<block_frame> block_frames;
+    /// Messages in the current block, except frames and entity deltas
+    std::vector<q2proto_svc_message_t> block_messages;
+    /// Number of messages in block_messages that preceded the first frame of the block
+    size_t block_messages_before_frame = 0;
+    /// Whether the current block contains a serverdata message
+    bool block_has_serverdata = false;
+
+    /**\name Reconstructed game state
+     * @{ */
+    bool have_serverdata = false;
+    q2proto_svc_serverdata_t serverdata = {};
+    std::string gamedir, levelname;
+    /// Commands sent between serverdata and the first frame, eg "precache"
+    std::vector<std::string> header_commands;
+    bool in_header = false;
+    demo_state state;
+    /** @} */
+
+    nonstd::expected<void, int> open(const char* filename)
+    {
+        auto result = file.open(filename);
+        if (!result)
+            return result;
+        if (!check_q2proto_result(q2proto_init_clientcontext(&context), "failed to initialize client context"))
+            return nonstd::make_unexpected(-4);
+        return {};
+    }
+
+    map_identity identity() const
+    {
+        map_identity id{serverdata.protocol, serverdata.protocol_version, context.features.server_game_api, gamedir,
+                        levelname};
+        if (auto it = state.configstrings.find(cs_mapchecksum); it != state.configstrings.end())
+            id.mapchecksum = it->second;
+        if (auto it = state.configstrings.find(cs_worldmodel); it != state.configstrings.end())
+            id.worldmodel = it->second;
+        return id;
+    }
+
+    /// Read and process the next block. Returns \c false at the end of the demo.
+    nonstd::expected<bool, int> read_block()
+    {
+        auto block_result = file.read_block(block);
+        if (!block_result || !*block_result)
+            return block_result;
+        block_first_frame = state.num_frames;
+        block_frames.clear();
+        block_messages.clear();
+        block_messages_before_frame = 0;
+        block_has_serverdata = false;
+
+        auto io_ctx = io_context(block.data(), uint32_t(block.size()));
+        uintptr_t io_arg = reinterpret_cast<uintptr_t>(&io_ctx);
+
+        q2proto_svc_message_t msg;
+        while (true) {
+            auto client_read_result = q2proto_client_read(&context, io_arg, &msg);
+            if (client_read_result == Q2P_ERR_NO_MORE_INPUT)
+                break;
+            else if (!check_q2proto_result(client_read_result, "failed to read message"))
+                return nonstd::make_unexpected(-5);
+            auto state_result = state.handle_message(context, msg);
+            if (!state_result)
+                return nonstd::make_unexpected(state_result.error());
+
+            switch (msg.type) {
+            case Q2P_SVC_SERVERDATA:
+                have_serverdata = true;
+                block_has_serverdata = true;
+                serverdata = msg.serverdata;
+                gamedir = to_string(msg.serverdata.gamedir);
+                levelname = to_string(msg.serverdata.levelname);
+                serverdata.gamedir = {gamedir.data(), gamedir.size()};
+                serverdata.levelname = {levelname.data(), levelname.size()};
+                header_commands.clear();
+                in_header = true;
+                break;
+            case Q2P_SVC_STUFFTEXT:
+                if (in_header) {
+                    // Written as part of the gamestate
+                    header_commands.push_back(to_string(msg.stufftext.string));
+                    continue;
+                }
+                break;
+            case Q2P_SVC_FRAME:
+                in_header = false;
+                if (block_frames.empty())
+                    block_messages_before_frame = block_messages.size();
+                block_frames.push_back({msg.frame.serverframe, msg.frame.deltaframe});
+                continue;
+            case Q2P_SVC_FRAME_ENTITY_DELTA:
+                continue;
+            default:
+                break;
+            }
+            block_messages.push_back(msg);
+        }
+        if (block_frames.empty())
+            block_messages_before_frame = block_messages.size();
+        return true;
+    }
+};
+
+/// Cutting statistics
+struct cut_stats
+{
+    uint64_t bytes_in = 0, bytes_out = 0;
+    /// Bytes of blocks copied verbatim
+    uint64_t bytes_copied = 0;
+    uint32_t clips = 0, gamestates = 0, frames_copied = 0;
+    /// Blocks with frames delta compressed against frames missing from the output, re-encoded
+    uint32_t blocks_reencoded = 0;
+    /// Messages in splice blocks that could not be written, by type
+    std::map<q2proto_svc_message_type_t, uint32_t> skipped;
+};
+
+class demo_cutter
+{
+    int packet_length;
+    FILE* out_file;
+
+    q2proto_server_info_t server_info = {};
+    q2proto_servercontext_t context;
+    std::unique_ptr<write_io_context> out;
+    std::unique_ptr<q2protoio_deflate_args_t> deflate_args;
+
+    /**\name State of the output, as seen by the demo player
+     * @{ */
+    bool have_protocol = false;
+    int32_t out_protocol = 0;
+    uint16_t out_protocol_version = 0;
+    bool have_gamestate = false;
+    map_identity out_map;
+    std::map<uint16_t, std::string> out_configstrings;
+    std::vector<democonvert_entity_state_t> out_baselines =
+        std::vector<democonvert_entity_state_t>(Q2PROTO_MAX_ENTITIES);
+    entity_set out_has_baseline;
+    /// Frames written since the last splice, indexed by server frame number modulo demo_update_backup
+    std::array<int32_t, demo_update_backup> out_frames;
+    /** @} */
+
+    uintptr_t out_io_arg() const { return reinterpret_cast<uintptr_t>(out.get()); }
+
+    nonstd::expected<void, int> flush()
+    {
+        if (out->size == 0)
+            return {};
+        uint32_t block_size = uint32_t(out->size);
+        if constexpr (std::endian::native != std::endian::little)
+            block_size = std::byteswap(block_size);
+        auto result = write_file(out_file, &block_size, sizeof(block_size));
+        if (result)
+            result = write_file(out_file, out->buffer.data(), out->size);
+        stats.bytes_out += sizeof(block_size) + out->size;
+        out->clear();
+        return result;
+    }
+
+    /// Write a message to the current block, starting a new block if the current one is full
+    nonstd::expected<q2proto_error_t, int> write_message(const q2proto_svc_message_t& msg)
+    {
+        auto mark = out->size;
+        auto err = q2proto_server_write(&context, out_io_arg(), &msg);
+        if (err == Q2P_ERR_NOT_ENOUGH_PACKET_SPACE && mark > 0) {
+            out->size = mark;
+            out->err = Q2P_ERR_SUCCESS;
+            auto result = flush();
+            if (!result)
+                return nonstd::make_unexpected(result.error());
+            mark = 0;
+            err = q2proto_server_write(&context, out_io_arg(), &msg);
+        }
+        if (err != Q2P_ERR_SUCCESS) {
+            out->size = mark;
+            out->err = Q2P_ERR_SUCCESS;
+        }
+        return err;
+    }
+
+    /// Write a message that must not be skipped
+    nonstd::expected<void, int> write_required(const q2proto_svc_message_t& msg)
+    {
+        auto result = write_message(msg);
+        if (!result)
+            return nonstd::make_unexpected(result.error());
+        if (!check_q2proto_result(*result, "failed to write {} message", q2proto_svc_message_str(msg.type)))
+            return nonstd::make_unexpected(-6);
+        return {};
+    }
+
+    /// Set up server context for the protocol of \a source, checking it will produce compatible output
+    nonstd::expected<void, int> init_context(const clip_source& source, q2proto_svc_serverdata_t& serverdata)
+    {
+        server_info.game_api = source.context.features.server_game_api;
+        server_info.default_packet_length = packet_length;
+
+        /* The demo protocol is usually the one matching the serverdata protocol number,
+         * but some "extended" demo protocols are only picked from the game API. */
+        for (auto protocol : {q2proto_protocol_from_netver(source.serverdata.protocol), Q2P_PROTOCOL_INVALID}) {
+            size_t max_msg_len;
+            if (q2proto_init_servercontext_demo(&context, protocol, &server_info, &max_msg_len) != Q2P_ERR_SUCCESS)
+                continue;
+            serverdata = {};
+            if (q2proto_server_fill_serverdata(&context, &serverdata) != Q2P_ERR_SUCCESS)
+                continue;
+            if (serverdata.protocol != source.serverdata.protocol
+                || serverdata.protocol_version != source.serverdata.protocol_version)
+                continue;
+
+            if (!out || out->buffer.size() != max_msg_len) {
+                out = std::make_unique<write_io_context>(uint32_t(max_msg_len));
+                deflate_args = std::make_unique<q2protoio_deflate_args_t>(uint32_t(max_msg_len));
+            }
+            return {};
+        }
+
+        fmt::println(stderr, "can't write protocol {} version {}", source.serverdata.protocol,
+                     source.serverdata.protocol_version);
+        return nonstd::make_unexpected(-6);
+    }
+
+    /// Write serverdata, header commands, configstrings and baselines of \a source
+    nonstd::expected<void, int> write_gamestate(const clip_source& source)
+    {
+        q2proto_svc_message_t msg = {.type = Q2P_SVC_SERVERDATA, .serverdata = {}};
+        auto result = init_context(source, msg.serverdata);
+        if (!result)
+            return result;
+        const auto& src_serverdata = source.serverdata;
+        msg.serverdata.servercount = src_serverdata.servercount;
+        msg.serverdata.attractloop = src_serverdata.attractloop;
+        msg.serverdata.gamedir = src_serverdata.gamedir;
+        msg.serverdata.clientnum = src_serverdata.clientnum;
+        msg.serverdata.levelname = src_serverdata.levelname;
+        msg.serverdata.strafejump_hack = src_serverdata.strafejump_hack;
+        if (src_serverdata.server_fps != 0)
+            msg.serverdata.server_fps = src_serverdata.server_fps;
+        msg.serverdata.r1q2.enhanced = src_serverdata.r1q2.enhanced;
+        msg.serverdata.q2pro.server_state = src_serverdata.q2pro.server_state;
+        msg.serverdata.q2pro.qw_mode = src_serverdata.q2pro.qw_mode;
+        msg.serverdata.q2pro.waterjump_hack = src_serverdata.q2pro.waterjump_hack;
+        result = write_required(msg);
+        if (!result)
+            return result;
+
+        std::vector<q2proto_svc_configstring_t> configstrings;
+        configstrings.reserve(source.state.configstrings.size());
+        for (const auto& [index, value] : source.state.configstrings)
+            configstrings.push_back({index, {value.data(), value.size()}});
+
+        std::vector<q2proto_svc_spawnbaseline_t> spawnbaselines;
+        source.state.has_baseline.for_each([&](uint16_t entnum) {
+            q2proto_packed_entity_state_t packed;
+            democonvert_pack_entity(&context, &source.state.baselines[entnum], &packed);
+            q2proto_svc_spawnbaseline_t baseline = {.entnum = entnum};
+            q2proto_server_make_entity_state_delta(&context, nullptr, &packed, true, &baseline.delta_state);
+            spawnbaselines.push_back(baseline);
+        });
+
+        q2proto_gamestate_t gamestate = {configstrings.size(), configstrings.data(), spawnbaselines.size(),
+                                         spawnbaselines.data()};
+        while (true) {
+            auto err = q2proto_server_write_gamestate(&context, deflate_args.get(), out_io_arg(), &gamestate);
+            if (err == Q2P_ERR_SUCCESS)
+                break;
+            if (err != Q2P_ERR_NOT_ENOUGH_PACKET_SPACE || out->size == 0) {
+                check_q2proto_result(err, "failed to write gamestate");
+                return nonstd::make_unexpected(-6);
+            }
+            out->err = Q2P_ERR_SUCCESS;
+            result = flush();
+            if (!result)
+                return result;
+        }
+
+        for (const auto& command : source.header_commands) {
+            q2proto_svc_message_t stufftext = {.type = Q2P_SVC_STUFFTEXT, .stufftext = {}};
+            stufftext.stufftext.string = {command.data(), command.size()};
+            result = write_required(stufftext);
+            if (!result)
+                return result;
+        }
+
+        have_gamestate = true;
+        stats.gamestates++;
+        return {};
+    }
+
+    /// Write configstrings and baselines of \a source that differ from the output state
+    nonstd::expected<void, int> write_gamestate_changes(const clip_source& source)
+    {
+        static const std::string empty_string;
+        auto write_configstring = [&](uint16_t index, const std::string& value) {
+            q2proto_svc_message_t msg = {.type = Q2P_SVC_CONFIGSTRING, .configstring = {}};
+            msg.configstring.index = index;
+            msg.configstring.value = {value.data(), value.size()};
+            return write_required(msg);
+        };
+        for (const auto& [index, value] : source.state.configstrings) {
+            auto out_it = out_configstrings.find(index);
+            if (out_it != out_configstrings.end() && out_it->second == value)
+                continue;
+            auto result = write_configstring(index, value);
+            if (!result)
+                return result;
+        }
+        for (const auto& [index, value] : out_configstrings) {
+            if (source.state.configstrings.contains(index) || value.empty())
+                continue;
+            auto result = write_configstring(index, empty_string);
+            if (!result)
+                return result;
+        }
+
+        nonstd::expected<void, int> result;
+        const auto& source_state = source.state;
+        entity_set::for_each_union(source_state.has_baseline, out_has_baseline, [&](uint16_t entnum) {
+            if (!result)
+                return;
+            // A missing baseline is equivalent to an all-zero state
+            static const democonvert_entity_state_t no_baseline = {};
+            q2proto_packed_entity_state_t source_packed, out_packed;
+            democonvert_pack_entity(&context,
+                                    source_state.has_baseline.test(entnum) ? &source_state.baselines[entnum]
+                                                                           : &no_baseline,
+                                    &source_packed);
+            democonvert_pack_entity(&context, out_has_baseline.test(entnum) ? &out_baselines[entnum] : &no_baseline,
+                                    &out_packed);
+            if (memcmp(&source_packed, &out_packed, sizeof(q2proto_packed_entity_state_t)) == 0)
+                return;
+            q2proto_svc_message_t msg = {.type = Q2P_SVC_SPAWNBASELINE, .spawnbaseline = {}};
+            msg.spawnbaseline.entnum = entnum;
+            q2proto_server_make_entity_state_delta(&context, nullptr, &source_packed, true,
+                                                   &msg.spawnbaseline.delta_state);
+            result = write_required(msg);
+        });
+        return result;
+    }
+
+    /// Write the current frame of \a source, uncompressed
+    q2proto_error_t write_full_frame(const demo_state& source, q2proto_frame_write_result_t& write_result)
+    {
+        q2proto_svc_message_t msg = {.type = Q2P_SVC_FRAME, .frame = source.frame};
+        msg.frame.deltaframe = -1;
+        msg.frame.areabits = source.areabits.data();
+        msg.frame.areabits_len = uint8_t(source.areabits.size());
+        q2proto_packed_player_state_t player_packed;
+        democonvert_pack_player(&context, &source.player, &player_packed);
+        q2proto_server_make_player_state_delta(&context, nullptr, &player_packed, &msg.frame.playerstate);
+        if (context.features.playerstate_clientnum) {
+            msg.frame.playerstate.delta_bits |= Q2P_PSD_CLIENTNUM;
+            msg.frame.playerstate.clientnum = source.clientnum;
+        }
+        auto err = q2proto_server_write(&context, out_io_arg(), &msg);
+        if (err != Q2P_ERR_SUCCESS)
+            return err;
+
+        // Baseline and current state of each entity. Reserved up front, as frame entities point into it
+        std::vector<q2proto_packed_entity_state_t> packed;
+        packed.reserve(2 * Q2PROTO_MAX_ENTITIES);
+        std::vector<q2proto_frame_entity_t> frame_entities;
+        source.visible.for_each([&](uint16_t entnum) {
+            auto& baseline_packed = packed.emplace_back();
+            democonvert_pack_entity(&context, &source.baselines[entnum], &baseline_packed);
+            auto& entity_packed = packed.emplace_back();
+            democonvert_pack_entity(&context, &source.entities[entnum], &entity_packed);
+
+            q2proto_frame_entity_t frame_entity = {};
+            frame_entity.entnum = entnum;
+            frame_entity.write_old_origin = true;
+            frame_entity.from = &baseline_packed;
+            frame_entity.to = &entity_packed;
+            frame_entities.push_back(frame_entity);
+        });
+        return q2proto_server_write_frame_entities(&context, out_io_arg(), nullptr, frame_entities.data(),
+                                                   frame_entities.size(), &write_result);
+    }
+
+    /// Write the current frame of \a source, uncompressed, surrounded by the other messages of the block
+    nonstd::expected<void, int> write_block_with_full_frame(const clip_source& source, bool skip_gamestate)
+    {
+        auto write_messages = [&](auto begin, auto end) -> nonstd::expected<void, int> {
+            for (auto it = begin; it != end; ++it) {
+                const auto& msg = *it;
+                if (skip_gamestate
+                    && (msg.type == Q2P_SVC_SERVERDATA || msg.type == Q2P_SVC_CONFIGSTRING
+                        || msg.type == Q2P_SVC_SPAWNBASELINE))
+                    continue;
+                auto write_result = write_message(msg);
+                if (!write_result)
+                    return nonstd::make_unexpected(write_result.error());
+                if (*write_result != Q2P_ERR_SUCCESS)
+                    stats.skipped[msg.type]++;
+            }
+            return {};
+        };
+
+        // Messages preceding the frame, eg configstring changes
+        auto frame_pos = source.block_messages.begin() + ptrdiff_t(source.block_messages_before_frame);
+        auto result = write_messages(source.block_messages.begin(), frame_pos);
+        if (!result)
+            return result;
+
+        // The frame has to fit into a single block
+        for (bool retried = false;; retried = true) {
+            auto mark = out->size;
+            q2proto_frame_write_result_t write_result;
+            auto err = write_full_frame(source.state, write_result);
+            if (err == Q2P_ERR_SUCCESS && write_result.num_deferred == 0)
+                break;
+            out->size = mark;
+            out->err = Q2P_ERR_SUCCESS;
+            if (retried || mark == 0) {
+                fmt::println(stderr, "frame {} doesn't fit into a packet, try a larger packet length",
+                             source.state.num_frames - 1);
+                return nonstd::make_unexpected(-6);
+            }
+            result = flush();
+            if (!result)
+                return result;
+        }
+        auto serverframe = source.state.frame.serverframe;
+        out_frames[size_t(serverframe) % demo_update_backup] = serverframe;
+
+        // Pass through the remaining messages of the block, eg sounds or prints
+        result = write_messages(frame_pos, source.block_messages.end());
+        if (!result)
+            return result;
+        return flush();
+    }
+
+    /// Write the block starting a clip: gamestate or changes, the current frame, and other messages of the block
+    nonstd::expected<void, int> write_splice(const clip_source& source)
+    {
+        auto source_map = source.identity();
+        bool same_map = have_gamestate && source_map == out_map;
+        auto result = same_map ? write_gamestate_changes(source) : write_gamestate(source);
+        if (!result)
+            return result;
+
+        // Frames from before the splice can't be used for delta compression
+        out_frames.fill(-1);
+        result = write_block_with_full_frame(source, true);
+        if (!result)
+            return result;
+
+        out_map = source_map;
+        out_configstrings = source.state.configstrings;
+        out_baselines = source.state.baselines;
+        out_has_baseline = source.state.has_baseline;
+        return {};
+    }
+
+    /**
+     * Check whether a block can be copied verbatim: all frames must be delta compressed against frames
+     * present in the output. If so, record the frames of the block as written.
+     */
+    bool check_copy_block(const clip_source& source)
+    {
+        auto frames = out_frames;
+        // A new map starts over, with an uncompressed frame
+        if (source.block_has_serverdata)
+            frames.fill(-1);
+        for (const auto& frame : source.block_frames) {
+            if (frame.deltaframe >= 0 && frames[size_t(frame.deltaframe) % demo_update_backup] != frame.deltaframe)
+                return false;
+            frames[size_t(frame.serverframe) % demo_update_backup] = frame.serverframe;
+        }
+        out_frames = frames;
+        return true;
+    }
+
+    /// Update output state from a block that was copied or re-encoded
+    void update_output_state(const clip_source& source)
+    {
+        for (const auto& msg : source.block_messages) {
+            switch (msg.type) {
+            case Q2P_SVC_SERVERDATA:
+                // Map change inside a clip: always write a new gamestate for the next clip
+                have_gamestate = false;
+                break;
+            case Q2P_SVC_CONFIGSTRING:
+                out_configstrings[msg.configstring.index] = to_string(msg.configstring.value);
+                break;
+            case Q2P_SVC_SPAWNBASELINE:
+                out_baselines[msg.spawnbaseline.entnum] = source.state.baselines[msg.spawnbaseline.entnum];
+                out_has_baseline.set(msg.spawnbaseline.entnum, true);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+public:
+    cut_stats stats;
+
+    demo_cutter(int packet_length, FILE* out_file) : packet_length(packet_length), out_file(out_file) {}
+
+    nonstd::expected<void, int> add_clip(const clip_spec& clip)
+    {
+        clip_source source;
+        auto result = source.open(clip.demo_name);
+        if (!result)
+            return result;
+
+        // Decode up to and including the first frame of the clip
+        while (source.state.num_frames <= clip.first_frame) {
+            auto block_result = source.read_block();
+            if (!block_result)
+                return nonstd::make_unexpected(block_result.error());
+            if (!*block_result) {
+                fmt::println(stderr, "\"{}\": frame {} is past the end of the demo ({} frames)", clip.demo_name,
+                             clip.first_frame, source.state.num_frames);
+                return nonstd::make_unexpected(-8);
+            }
+            stats.bytes_in += sizeof(uint32_t) + source.block.size();
+        }
+        if (!source.have_serverdata) {
+            fmt::println(stderr, "\"{}\": no serverdata", clip.demo_name);
+            return nonstd::make_unexpected(-5);
+        }
+
+        // Demo players don't support protocol changes within a demo
+        if (have_protocol
+            && (source.serverdata.protocol != out_protocol || source.serverdata.protocol_version != out_protocol_version))
+        {
+            fmt::println(stderr, "\"{}\": protocol {} version {} differs from protocol {} version {} of earlier clips",
+                         clip.demo_name, source.serverdata.protocol, source.serverdata.protocol_version, out_protocol,
+                         out_protocol_version);
+            return nonstd::make_unexpected(-7);
+        }
+        have_protocol = true;
+        out_protocol = source.serverdata.protocol;
+        out_protocol_version = source.serverdata.protocol_version;
+
+        result = write_splice(source);
+        if (!result)
+            return result;
+
+        // Copy the rest of the clip verbatim, where possible
+        while (true) {
+            auto block_result = source.read_block();
+            if (!block_result)
+                return nonstd::make_unexpected(block_result.error());
+            if (!*block_result || source.block_first_frame > clip.last_frame)
+                break;
+            stats.bytes_in += sizeof(uint32_t) + source.block.size();
+
+            if (!check_copy_block(source)) {
+                // Frame is delta compressed against a frame from before the splice, or one that was dropped
+                result = write_block_with_full_frame(source, false);
+                if (!result)
+                    return result;
+                stats.blocks_reencoded++;
+                update_output_state(source);
+                continue;
+            }
+
+            uint32_t block_size = uint32_t(source.block.size());
+            if constexpr (std::endian::native != std::endian::little)
+                block_size = std::byteswap(block_size);
+            result = write_file(out_file, &block_size, sizeof(block_size));
+            if (result)
+                result = write_file(out_file, source.block.data(), source.block.size());
+            if (!result)
+                return result;
+            stats.bytes_copied += sizeof(block_size) + source.block.size();
+            stats.bytes_out += sizeof(block_size) + source.block.size();
+            stats.frames_copied += source.state.num_frames - source.block_first_frame;
+            update_output_state(source);
+        }
+        stats.clips++;
+        return {};
+    }
+
+    nonstd::expected<void, int> finish()
+    {
+        uint32_t end_marker = (uint32_t)-1;
+        stats.bytes_out += sizeof(end_marker);
+        return write_file(out_file, &end_marker, sizeof(end_marker));
+    }
+};
+
+/// Parse frame range of the form "first:last", either may be omitted
+static bool parse_frame_range(std::string_view range, clip_spec& clip)
+{
+    auto colon = range.find(':');
+    if (colon == std::string_view::npos) {
+        fmt::println(stderr, "invalid frame range \"{}\"", range);
+        return false;
+    }
+    auto first = range.substr(0, colon), last = range.substr(colon + 1);
+    clip.first_frame = 0;
+    clip.last_frame = std::numeric_limits<uint32_t>::max();
+    if ((!first.empty() && !parse_number(first, clip.first_frame))
+        || (!last.empty() && !parse_number(last, clip.last_frame)) || clip.last_frame < clip.first_frame) {
+        fmt::println(stderr, "invalid frame range \"{}\"", range);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, const char* argv[])
+{
+    int packet_length = 0;
+    const char* output_name = nullptr;
+    std::vector<clip_spec> clips;
+    clip_spec next_clip = {};
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg(argv[i]);
+        if (arg == "-l" && i + 1 < argc)
+            packet_length = atoi(argv[++i]);
+        else if (arg == "-o" && i + 1 < argc)
+            output_name = argv[++i];
+        else if (arg == "-r" && i + 1 < argc) {
+            if (!parse_frame_range(argv[++i], next_clip))
+                return -1;
+        } else {
+            next_clip.demo_name = argv[i];
+            clips.push_back(next_clip);
+            next_clip = {};
+        }
+    }
+    if (clips.empty() || !output_name) {
+        fmt::println(stderr, "Syntax: {} [-l packet_length] -o output [-r first:last] demofile [[-r first:last] demofile...]",
+                     argv[0]);
+        fmt::println(stderr, "  -l packet_length  Packet length for re-encoded blocks. Default: protocol default");
+        fmt::println(stderr, "  -o output         Output demo file");
+        fmt::println(stderr, "  -r first:last     Frames (counted from 0) of the following demo to extract.");
+        fmt::println(stderr, "                    Either may be omitted. Default: whole demo");
+        fmt::println(stderr, "Clips are concatenated in the given order.");
+        return -1;
+    }
+
+    auto* out_file = fopen(output_name, "wb");
+    if (!out_file)
+        return print_io_error(errno, "failed to open \"{}\"", output_name);
+    auto close_out = nonstd::make_scope_exit([&] { fclose(out_file); });
+
+    auto cutter = std::make_unique<demo_cutter>(packet_length, out_file);
+    auto start_time = std::chrono::steady_clock::now();
+    for (const auto& clip : clips) {
+        auto result = cutter->add_clip(clip);
+        if (!result) {
+            fmt::println(stderr, "failed to extract clip from \"{}\"", clip.demo_name);
+            return result.error();
+        }
+    }
+    auto result = cutter->finish();
+    if (!result)
+        return result.error();
+    std::chrono::duration<double> cut_time = std::chrono::steady_clock::now() - start_time;
+
+    const auto& stats = cutter->stats;
+    fmt::println(stderr, "{} clips, {} gamestates: {} bytes read, {} bytes written ({} copied verbatim), {:.3f} s",
+                 stats.clips, stats.gamestates, stats.bytes_in, stats.bytes_out, stats.bytes_copied, cut_time.count());
+    fmt::println(stderr, "{} frames copied verbatim, {} blocks re-encoded", stats.frames_copied,
+                 stats.blocks_reencoded);
+    for (const auto& [type, count] : stats.skipped)
+        fmt::println(stderr, "skipped {} {} message(s)", count, q2proto_svc_message_str(type));
+    return 0;
+}
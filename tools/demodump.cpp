@@ -16,8 +16,13 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 
+#include "demofile.hpp"
+#include "q2protodbg.hpp"
 #include "q2protoio.hpp"
+#include "toolutil.hpp"
 
+#include <bitset>
+#include <cmath>
 #include "expected.hpp"
 #include <fmt/format.h>
 #include <fmt/ranges.h>
@@ -1107,6 +1112,129 @@ struct PrintStructContext
         PrintTraits<T>::members(print_ctx, x);
     }
 };
+
+// Append a string to a JSON document. Game strings are treated as Latin-1, everything else as UTF-8.
+static void json_string(std::string &out, std::string_view str, bool latin1 = false)
+{
+    out.push_back('"');
+    for (char c : str) {
+        auto uc = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\') {
+            out.push_back('\\');
+            out.push_back(c);
+        } else if (uc < 0x20 || (latin1 && uc >= 0x80))
+            fmt::format_to(std::back_inserter(out), "\\u{:04x}", uc);
+        else
+            out.push_back(c);
+    }
+    out.push_back('"');
+}
+
+template <typename T>
+concept is_map = requires { typename T::key_type; typename T::mapped_type; };
+
+// Append a value to a JSON document, as a "native" JSON type where possible
+template <typename T> static void json_value(std::string &out, const T &x)
+{
+    using elem_type = std::remove_cv_t<std::remove_extent_t<T>>;
+    if constexpr (std::is_same_v<T, bool>)
+        out.append(x ? "true" : "false");
+    else if constexpr (std::is_enum_v<T>)
+        json_value(out, static_cast<std::underlying_type_t<T>>(x));
+    else if constexpr (std::is_integral_v<T>)
+        fmt::format_to(std::back_inserter(out), "{}", x);
+    else if constexpr (std::is_floating_point_v<T>) {
+        if (std::isfinite(x))
+            fmt::format_to(std::back_inserter(out), "{}", x);
+        else
+            out.append("null");
+    } else if constexpr (std::is_same_v<T, q2proto_string_t>)
+        json_string(out, std::string_view(x.str, x.len), true);
+    else if constexpr (std::is_array_v<T> && !std::is_same_v<elem_type, char>) {
+        out.push_back('[');
+        for (size_t i = 0; i < std::extent_v<T>; i++) {
+            if (i > 0)
+                out.push_back(',');
+            json_value(out, x[i]);
+        }
+        out.push_back(']');
+    } else if constexpr (std::is_convertible_v<const T &, std::string_view>)
+        json_string(out, x);
+    else if constexpr (std::is_same_v<T, q2proto_var_coords_t>) {
+        out.push_back('[');
+        for (int c = 0; c < 3; c++) {
+            if (c > 0)
+                out.push_back(',');
+            json_value(out, q2proto_var_coords_get_float_comp(&x, c));
+        }
+        out.push_back(']');
+    } else if constexpr (std::is_same_v<T, q2proto_maybe_diff_coords_t>) {
+        // Only the transmitted components, as an object
+        out.push_back('{');
+        bool first = true;
+        for (int c = 0; c < 3; c++) {
+            if ((x.read.value.delta_bits & (1 << c)) == 0)
+                continue;
+            if (!first)
+                out.push_back(',');
+            first = false;
+            fmt::format_to(std::back_inserter(out), "\"{:c}\":", 'x' + c);
+            json_value(out, q2proto_var_coords_get_float_comp(&x.read.value.values, c));
+        }
+        if (x.read.diff_bits != 0)
+            fmt::format_to(std::back_inserter(out), "{}\"diff_bits\":{}", first ? "" : ",", x.read.diff_bits);
+        out.push_back('}');
+    } else if constexpr (is_map<T>) {
+        out.push_back('{');
+        bool first = true;
+        for (const auto &[key, value] : x) {
+            if (!first)
+                out.push_back(',');
+            first = false;
+            json_string(out, fmt::to_string(key));
+            out.push_back(':');
+            json_value(out, value);
+        }
+        out.push_back('}');
+    } else
+        json_string(out, PrintTraits<T>::format(x));
+}
+
+struct JsonContext
+{
+    std::string &out;
+    bool first = true;
+
+    JsonContext(std::string &out) : out(out) {}
+
+    void key(std::string_view name)
+    {
+        if (!first)
+            out.push_back(',');
+        first = false;
+        json_string(out, name);
+        out.push_back(':');
+    }
+
+    template <typename T, typename = std::enable_if_t<!trait_has_members<T>>> void field(std::string_view name, const T &x, std::string format(const T&) = PrintTraits<T>::format)
+    {
+        key(name);
+        // Custom formatters typically turn flags into something readable, so keep that
+        if (format == PrintTraits<T>::format)
+            json_value(out, x);
+        else
+            json_string(out, format(x));
+    }
+
+    template <typename T, typename = std::enable_if_t<trait_has_members<T>>> void field(std::string_view name, const T &x)
+    {
+        key(name);
+        out.push_back('{');
+        auto json_ctx = JsonContext(out);
+        PrintTraits<T>::members(json_ctx, x);
+        out.push_back('}');
+    }
+};
 } // namespace print_struct_detail
 
 template <typename T>
@@ -1118,9 +1246,17 @@ static void PrintStruct(const T &val)
     PrintTraits<T>::members(print_ctx, val);
 }
 
-static void print_message(const q2proto_svc_message_t& msg)
+template <typename T>
+static void JsonStruct(std::string &out, const T &val)
+{
+    auto json_ctx = print_struct_detail::JsonContext(out);
+    PrintTraits<T>::members(json_ctx, val);
+}
+
+// Call 'func' with the message-specific part of 'msg'. Returns false if the message has no contents.
+template<typename Func>
+static bool visit_message(const q2proto_svc_message_t& msg, Func&& func)
 {
-    fmt::println("{:<8}{}:", "", msg.type);
     switch(msg.type)
     {
     case Q2P_SVC_INVALID:
@@ -1128,167 +1264,284 @@ static void print_message(const q2proto_svc_message_t& msg)
     case Q2P_SVC_DISCONNECT:
     case Q2P_SVC_RECONNECT:
         // nothing to print
-        break;
+        return false;
     case Q2P_SVC_MUZZLEFLASH:
     case Q2P_SVC_MUZZLEFLASH2:
-        PrintStruct(msg.muzzleflash);
-        break;
+        func(msg.muzzleflash);
+        return true;
     case Q2P_SVC_TEMP_ENTITY:
-        PrintStruct(msg.temp_entity);
-        break;
+        func(msg.temp_entity);
+        return true;
     case Q2P_SVC_SOUND:
-        PrintStruct(msg.sound);
-        break;
+        func(msg.sound);
+        return true;
     case Q2P_SVC_PRINT:
-        PrintStruct(msg.print);
-        break;
+        func(msg.print);
+        return true;
     case Q2P_SVC_STUFFTEXT:
-        PrintStruct(msg.stufftext);
-        break;
+        func(msg.stufftext);
+        return true;
     case Q2P_SVC_SERVERDATA:
-        PrintStruct(msg.serverdata);
-        break;
+        func(msg.serverdata);
+        return true;
     case Q2P_SVC_CONFIGSTRING:
-        PrintStruct(msg.configstring);
-        break;
+        func(msg.configstring);
+        return true;
     case Q2P_SVC_SPAWNBASELINE:
-        PrintStruct(msg.spawnbaseline);
-        break;
+        func(msg.spawnbaseline);
+        return true;
     case Q2P_SVC_CENTERPRINT:
-        PrintStruct(msg.centerprint);
-        break;
+        func(msg.centerprint);
+        return true;
     case Q2P_SVC_DOWNLOAD:
-        PrintStruct(msg.download);
-        break;
+        func(msg.download);
+        return true;
     case Q2P_SVC_FRAME:
-        PrintStruct(msg.frame);
-        break;
+        func(msg.frame);
+        return true;
     case Q2P_SVC_INVENTORY:
-        PrintStruct(msg.inventory);
-        break;
+        func(msg.inventory);
+        return true;
     case Q2P_SVC_LAYOUT:
-        PrintStruct(msg.layout);
-        break;
+        func(msg.layout);
+        return true;
     case Q2P_SVC_FRAME_ENTITY_DELTA:
-        PrintStruct(msg.frame_entity_delta);
-        break;
+        func(msg.frame_entity_delta);
+        return true;
     case Q2P_SVC_SETTING:
-        PrintStruct(msg.setting);
-        break;
+        func(msg.setting);
+        return true;
     case Q2P_SVC_DAMAGE:
-        PrintStruct(msg.damage);
-        break;
+        func(msg.damage);
+        return true;
     case Q2P_SVC_FOG:
-        PrintStruct(msg.fog);
-        break;
+        func(msg.fog);
+        return true;
     case Q2P_SVC_POI:
-        PrintStruct(msg.poi);
-        break;
+        func(msg.poi);
+        return true;
     case Q2P_SVC_HELP_PATH:
-        PrintStruct(msg.help_path);
-        break;
+        func(msg.help_path);
+        return true;
     case Q2P_SVC_ACHIEVEMENT:
-        PrintStruct(msg.achievement);
-        break;
+        func(msg.achievement);
+        return true;
     case Q2P_SVC_LOCPRINT:
-        PrintStruct(msg.locprint);
-        break;
-    default:
-        fmt::println("TODO: support message type {}", msg.type);
+        func(msg.locprint);
+        return true;
     }
+    return false;
 }
 
-// Print stdio error
-template<typename... T>
-static int print_io_error(int code, fmt::format_string<T...> fmt, T&&... args)
+static void print_message(const q2proto_svc_message_t& msg)
 {
-    auto ec = std::make_error_code(static_cast<std::errc>(code));
-    fmt::print(stderr, fmt, std::forward<T>(args)...);
-    fmt::println(stderr, ": {:s}", ec);
-    return ec.value();
+    fmt::println("{:<8}{}:", "", msg.type);
+    if (msg.type > Q2P_SVC_LOCPRINT)
+        fmt::println("TODO: support message type {}", msg.type);
+    else
+        visit_message(msg, [](const auto &x) { PrintStruct(x); });
 }
 
-// Print q2proto error
-template<typename... T>
-static void print_q2proto_error(q2proto_error_t err, fmt::format_string<T...> fmt, T&&... args)
+// Append a message as a single NDJSON record to 'out'
+static void json_message(std::string &out, long demo_pos, int32_t serverframe, const q2proto_svc_message_t &msg)
 {
-    fmt::print(stderr, fmt, std::forward<T>(args)...);
-    fmt::println(stderr, ": {}", q2proto_error_string(err));
+    fmt::format_to(std::back_inserter(out), "{{\"pos\":{},\"frame\":{},\"type\":\"{}\",\"data\":{{", demo_pos,
+                   serverframe, msg.type);
+    visit_message(msg, [&](const auto &x) { JsonStruct(out, x); });
+    out.append("}}\n");
 }
 
-// Check result of a q2proto call
-template<typename... T>
-static bool check_q2proto_result(q2proto_error_t result, fmt::format_string<T...> fmt, T&&... args)
+// Check result of a q2proto call, exit in case of error
+#define CHECK_Q2PROTO(EXPR)                                \
+    if (!check_q2proto_result((EXPR), "failed {}", #EXPR)) \
+        return -4;
+
+// Selection of messages to output
+struct message_filter
 {
-    if (result != Q2P_ERR_SUCCESS) {
-        print_q2proto_error(result, std::move(fmt), std::forward<T>(args)...);
-        return false;
+    // Message types to output. If empty, output all types.
+    std::bitset<Q2P_SVC_LOCPRINT + 1> types;
+    // Entities to output messages for. If empty, don't filter by entity.
+    std::bitset<65536> entities;
+    // Server frames range to output
+    int32_t first_frame = std::numeric_limits<int32_t>::min(), last_frame = std::numeric_limits<int32_t>::max();
+
+    bool active() const
+    {
+        return types.any() || entities.any() || first_frame != std::numeric_limits<int32_t>::min()
+               || last_frame != std::numeric_limits<int32_t>::max();
+    }
+
+    bool match_entity(const q2proto_svc_message_t &msg) const
+    {
+        switch (msg.type) {
+        case Q2P_SVC_MUZZLEFLASH:
+        case Q2P_SVC_MUZZLEFLASH2:
+            return msg.muzzleflash.entity >= 0 && entities.test(msg.muzzleflash.entity);
+        case Q2P_SVC_TEMP_ENTITY:
+            return (msg.temp_entity.entity1 > 0 && entities.test(msg.temp_entity.entity1))
+                   || (msg.temp_entity.entity2 > 0 && entities.test(msg.temp_entity.entity2));
+        case Q2P_SVC_SOUND:
+            return (msg.sound.flags & SND_ENT) != 0 && entities.test(msg.sound.entity);
+        case Q2P_SVC_SPAWNBASELINE:
+            return entities.test(msg.spawnbaseline.entnum);
+        case Q2P_SVC_FRAME_ENTITY_DELTA:
+            return entities.test(msg.frame_entity_delta.newnum);
+        default:
+            // Message doesn't refer to an entity
+            return false;
+        }
+    }
+
+    bool match(const q2proto_svc_message_t &msg, int32_t serverframe) const
+    {
+        if (serverframe < first_frame || serverframe > last_frame)
+            return false;
+        if (types.any() && (msg.type > Q2P_SVC_LOCPRINT || !types.test(msg.type)))
+            return false;
+        if (entities.any() && !match_entity(msg))
+            return false;
+        return true;
+    }
+};
+
+// Parse comma-separated list of message type names into 'filter'
+static bool parse_type_list(std::string_view list, message_filter &filter)
+{
+    for (auto name_range : std::views::split(list, ',')) {
+        std::string_view name(name_range.begin(), name_range.end());
+        bool found = false;
+        for (int type = 0; type <= Q2P_SVC_LOCPRINT; type++) {
+            auto type_name = fmt::format("{}", static_cast<q2proto_svc_message_type_t>(type));
+            if (std::ranges::equal(name, type_name, [](char a, char b) { return toupper(a) == toupper(b); })) {
+                filter.types.set(type);
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            fmt::println(stderr, "unknown message type \"{}\"", name);
+            return false;
+        }
     }
     return true;
 }
 
-// Check result of a q2proto call, exit in case of error
-#define CHECK_Q2PROTO(EXPR)                                \
-    if (!check_q2proto_result((EXPR), "failed {}", #EXPR)) \
-        return -4;
+// Parse comma-separated list of entity numbers into 'filter'
+static bool parse_entity_list(std::string_view list, message_filter &filter)
+{
+    for (auto num_range : std::views::split(list, ',')) {
+        std::string_view num(num_range.begin(), num_range.end());
+        int entnum;
+        if (!parse_number(num, entnum) || entnum < 0 || entnum >= int(filter.entities.size())) {
+            fmt::println(stderr, "invalid entity number \"{}\"", num);
+            return false;
+        }
+        filter.entities.set(entnum);
+    }
+    return true;
+}
 
-static nonstd::expected<void, int> read_file(FILE* f, void* buf, size_t size)
+// Parse frame range of the form "first:last", either may be omitted
+static bool parse_frame_range(std::string_view range, message_filter &filter)
 {
-    size_t num_read = fread(buf, size, 1, f);
-    if (num_read != 1) {
-        if (feof(f)) {
-            fmt::println(stderr, "unexpected end of file");
-            return nonstd::make_unexpected(-2);
-        } else
-            return nonstd::make_unexpected(print_io_error(errno, "read error"));
+    auto colon = range.find(':');
+    if (colon == std::string_view::npos) {
+        fmt::println(stderr, "invalid frame range \"{}\"", range);
+        return false;
     }
-    return {};
+    auto first = range.substr(0, colon), last = range.substr(colon + 1);
+    if ((!first.empty() && !parse_number(first, filter.first_frame))
+        || (!last.empty() && !parse_number(last, filter.last_frame)) || filter.last_frame < filter.first_frame) {
+        fmt::println(stderr, "invalid frame range \"{}\"", range);
+        return false;
+    }
+    return true;
 }
 
 int main(int argc, const char* argv[])
 {
-    if (argc != 2) {
-        fmt::println(stderr, "Syntax: {} [demofile]", argv[0]);
+    const char *demo_filename = nullptr;
+    bool ndjson = false;
+    message_filter filter;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg(argv[i]);
+        if (arg == "-f" && i + 1 < argc) {
+            std::string_view format(argv[++i]);
+            if (format == "ndjson")
+                ndjson = true;
+            else if (format != "text") {
+                fmt::println(stderr, "unknown output format \"{}\"", format);
+                return -1;
+            }
+        } else if (arg == "-t" && i + 1 < argc) {
+            if (!parse_type_list(argv[++i], filter))
+                return -1;
+        } else if (arg == "-e" && i + 1 < argc) {
+            if (!parse_entity_list(argv[++i], filter))
+                return -1;
+        } else if (arg == "-r" && i + 1 < argc) {
+            if (!parse_frame_range(argv[++i], filter))
+                return -1;
+        } else if (!demo_filename)
+            demo_filename = argv[i];
+        else {
+            demo_filename = nullptr;
+            break;
+        }
+    }
+    if (!demo_filename) {
+        fmt::println(stderr, "Syntax: {} [-f text|ndjson] [-t type,...] [-e entnum,...] [-r first:last] demofile",
+                     argv[0]);
+        fmt::println(stderr, "  -f format      Output format: 'text' (default) or 'ndjson' (one JSON object per message)");
+        fmt::println(stderr, "  -t type,...    Only output messages of the given types (eg FRAME,SOUND)");
+        fmt::println(stderr, "  -e entnum,...  Only output messages referring to the given entities");
+        fmt::println(stderr, "  -r first:last  Only output messages in the given server frame range. Either may be omitted");
         return -1;
     }
 
+    bool filtered = filter.active();
+    // "shownet" output can't be filtered, and is not structured, so disable it in those cases
+    q2protodbg_shownet_enabled = !ndjson && !filtered;
+
     q2proto_clientcontext_t demo_context;
     if (!check_q2proto_result(q2proto_init_clientcontext(&demo_context), "failed to initialize client context"))
         return -4;
 
-    auto *demo_file = fopen(argv[1], "rb");
-    if (!demo_file) {
-        return print_io_error(errno, "failed to open \"{}\"", argv[1]);
-    }
-
-    auto close_file = nonstd::make_scope_exit([&] { fclose(demo_file); });
-
-    static constexpr size_t max_packet_size = 0x10000;
-    auto buf = std::unique_ptr<std::byte>(new std::byte[max_packet_size]);
+    demo_file_reader demo_file;
+    auto open_result = demo_file.open(demo_filename);
+    if (!open_result)
+        return open_result.error();
+
+    // NDJSON output is collected and written in larger chunks
+    static constexpr size_t json_flush_size = 0x10000;
+    std::string json_out;
+    auto flush_json = [&]() {
+        fwrite(json_out.data(), 1, json_out.size(), stdout);
+        json_out.clear();
+    };
 
+    int32_t serverframe = -1;
     while (true) {
-        auto demo_pos = ftell(demo_file);
-        fmt::println("file position: {}", demo_pos);
+        auto demo_pos = demo_file.tell();
+        bool pos_printed = false;
+        auto print_pos = [&]() {
+            if (!ndjson && !pos_printed) {
+                fmt::println("file position: {}", demo_pos);
+                pos_printed = true;
+            }
+        };
+        if (!filtered)
+            print_pos();
 
-        uint32_t packet_size;
-        auto read_result = read_file(demo_file, &packet_size, sizeof(packet_size));
+        std::span<const std::byte> block;
+        auto read_result = demo_file.read_block(block);
         if (!read_result)
             return read_result.error();
-        if constexpr (std::endian::native != std::endian::little)
-            packet_size = std::byteswap(packet_size);
-
-        if (packet_size == (uint32_t)-1)
+        if (!*read_result)
             break;
-        if (packet_size > max_packet_size) {
-            fmt::println(stderr, "packet too large ({} > {})", packet_size, max_packet_size);
-            return -3;
-        }
-
-        read_result = read_file(demo_file, buf.get(), packet_size);
-        if (!read_result)
-            return read_result.error();
 
-        auto io_ctx = io_context(buf.get(), packet_size);
+        auto io_ctx = io_context(block.data(), uint32_t(block.size()));
         uintptr_t io_arg = reinterpret_cast<uintptr_t>(&io_ctx);
 
         q2proto_svc_message_t msg;
@@ -1298,12 +1551,29 @@ int main(int argc, const char* argv[])
                 break;
             else if (!check_q2proto_result(client_read_result, "failed to read message"))
                 return -5;
-            print_message(msg);
+
+            if (msg.type == Q2P_SVC_SERVERDATA)
+                serverframe = -1;
+            else if (msg.type == Q2P_SVC_FRAME)
+                serverframe = msg.frame.serverframe;
+            // Skip filtered messages before doing any formatting work
+            if (filtered && !filter.match(msg, serverframe))
+                continue;
+
+            if (ndjson) {
+                json_message(json_out, demo_pos, serverframe, msg);
+                if (json_out.size() >= json_flush_size)
+                    flush_json();
+            } else {
+                print_pos();
+                print_message(msg);
+            }
         }
     }
-    fmt::println("--- end of stream ---");
-
-    close_file.release();
+    if (ndjson)
+        flush_json();
+    else
+        fmt::println("--- end of stream ---");
 
     return 0;
-}
\ No newline at end of file
+}
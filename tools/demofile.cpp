@@ -0,0 +1,236 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "demofile.hpp"
+#include "toolutil.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <fmt/format.h>
+#include <system_error>
+
+#include <zlib.h>
+
+template<typename T>
+static void store_le(std::byte* buf, T value)
+{
+    if constexpr (std::endian::native != std::endian::little)
+        value = std::byteswap(value);
+    memcpy(buf, &value, sizeof(T));
+}
+
+template<typename T>
+static T load_le(const std::byte* buf)
+{
+    T value;
+    memcpy(&value, buf, sizeof(T));
+    if constexpr (std::endian::native != std::endian::little)
+        value = std::byteswap(value);
+    return value;
+}
+
+namespace demo_archive {
+void write_header(std::byte* buf, const header& hdr)
+{
+    memcpy(buf, magic, sizeof(magic));
+    store_le<uint32_t>(buf + 4, version);
+    store_le<uint32_t>(buf + 8, hdr.blocks_per_chunk);
+    store_le<uint32_t>(buf + 12, hdr.num_chunks);
+    store_le<uint64_t>(buf + 16, hdr.index_offset);
+    store_le<uint64_t>(buf + 24, hdr.raw_size);
+}
+
+void write_index_entry(std::byte* buf, const chunk_entry& entry)
+{
+    store_le<uint64_t>(buf, entry.raw_offset);
+    store_le<uint64_t>(buf + 8, entry.file_offset);
+    store_le<uint32_t>(buf + 16, entry.compressed_size);
+    store_le<uint32_t>(buf + 20, entry.raw_size);
+}
+} // namespace demo_archive
+
+demo_file_reader::~demo_file_reader()
+{
+    if (file)
+        fclose(file);
+}
+
+nonstd::expected<void, int> demo_file_reader::open(const char* filename)
+{
+    file = fopen(filename, "rb");
+    if (!file)
+        return nonstd::make_unexpected(print_io_error(errno, "failed to open \"{}\"", filename));
+
+    char file_magic[sizeof(demo_archive::magic)];
+    archive = fread(file_magic, sizeof(file_magic), 1, file) == 1
+              && memcmp(file_magic, demo_archive::magic, sizeof(file_magic)) == 0;
+    if (archive)
+        return open_archive(filename);
+
+    block_buf.reset(new std::byte[max_block_size]);
+    return seek(0);
+}
+
+nonstd::expected<void, int> demo_file_reader::open_archive(const char* filename)
+{
+    std::byte header_buf[demo_archive::header_size];
+    if (fseek(file, 0, SEEK_SET) != 0)
+        return nonstd::make_unexpected(print_io_error(errno, "seek error"));
+    auto result = read_file(file, header_buf, sizeof(header_buf));
+    if (!result)
+        return result;
+    if (load_le<uint32_t>(header_buf + 4) != demo_archive::version) {
+        fmt::println(stderr, "\"{}\": unsupported demo archive version", filename);
+        return nonstd::make_unexpected(-7);
+    }
+    archive_header.blocks_per_chunk = load_le<uint32_t>(header_buf + 8);
+    archive_header.num_chunks = load_le<uint32_t>(header_buf + 12);
+    archive_header.index_offset = load_le<uint64_t>(header_buf + 16);
+    archive_header.raw_size = load_le<uint64_t>(header_buf + 24);
+
+    std::vector<std::byte> index_buf(size_t(archive_header.num_chunks) * demo_archive::index_entry_size);
+    if (fseek(file, long(archive_header.index_offset), SEEK_SET) != 0)
+        return nonstd::make_unexpected(print_io_error(errno, "seek error"));
+    result = read_file(file, index_buf.data(), index_buf.size());
+    if (!result)
+        return result;
+
+    chunks.resize(archive_header.num_chunks);
+    uint64_t expected_raw_offset = 0;
+    for (size_t i = 0; i < chunks.size(); i++) {
+        const auto* entry_buf = index_buf.data() + i * demo_archive::index_entry_size;
+        auto& chunk = chunks[i];
+        chunk.raw_offset = load_le<uint64_t>(entry_buf);
+        chunk.file_offset = load_le<uint64_t>(entry_buf + 8);
+        chunk.compressed_size = load_le<uint32_t>(entry_buf + 16);
+        chunk.raw_size = load_le<uint32_t>(entry_buf + 20);
+        // Chunks must cover the raw demo without gaps
+        if (chunk.raw_offset != expected_raw_offset || chunk.raw_size == 0) {
+            fmt::println(stderr, "\"{}\": corrupt chunk index", filename);
+            return nonstd::make_unexpected(-7);
+        }
+        expected_raw_offset += chunk.raw_size;
+    }
+    if (expected_raw_offset != archive_header.raw_size) {
+        fmt::println(stderr, "\"{}\": corrupt chunk index", filename);
+        return nonstd::make_unexpected(-7);
+    }
+    return seek(0);
+}
+
+nonstd::expected<void, int> demo_file_reader::load_chunk(size_t index)
+{
+    if (index == current_chunk)
+        return {};
+
+    const auto& chunk = chunks[index];
+    compressed_data.resize(chunk.compressed_size);
+    if (fseek(file, long(chunk.file_offset), SEEK_SET) != 0)
+        return nonstd::make_unexpected(print_io_error(errno, "seek error"));
+    auto result = read_file(file, compressed_data.data(), compressed_data.size());
+    if (!result)
+        return result;
+
+    chunk_data.resize(chunk.raw_size);
+    uLongf dest_len = chunk.raw_size;
+    int z_result = uncompress(reinterpret_cast<Bytef*>(chunk_data.data()), &dest_len,
+                              reinterpret_cast<const Bytef*>(compressed_data.data()), chunk.compressed_size);
+    if (z_result != Z_OK || dest_len != chunk.raw_size) {
+        fmt::println(stderr, "failed to decompress chunk {}", index);
+        current_chunk = SIZE_MAX;
+        return nonstd::make_unexpected(-7);
+    }
+    current_chunk = index;
+    return {};
+}
+
+nonstd::expected<void, int> demo_file_reader::seek(uint64_t raw_offset)
+{
+    if (!archive) {
+        if (fseek(file, long(raw_offset), SEEK_SET) != 0)
+            return nonstd::make_unexpected(print_io_error(errno, "seek error"));
+        offset = raw_offset;
+        return {};
+    }
+
+    if (raw_offset > archive_header.raw_size) {
+        fmt::println(stderr, "seek past end of demo archive");
+        return nonstd::make_unexpected(-7);
+    }
+    offset = raw_offset;
+    // Chunk is loaded lazily when reading
+    return {};
+}
+
+nonstd::expected<bool, int> demo_file_reader::read_block(std::span<const std::byte>& block)
+{
+    if (!archive) {
+        uint32_t block_size;
+        if (fread(&block_size, sizeof(block_size), 1, file) != 1) {
+            // Tolerate demos that just end without an end marker
+            if (feof(file))
+                return false;
+            return nonstd::make_unexpected(print_io_error(errno, "read error"));
+        }
+        if constexpr (std::endian::native != std::endian::little)
+            block_size = std::byteswap(block_size);
+
+        if (block_size == (uint32_t)-1)
+            return false;
+        if (block_size > max_block_size) {
+            fmt::println(stderr, "packet too large ({} > {})", block_size, max_block_size);
+            return nonstd::make_unexpected(-3);
+        }
+
+        auto result = read_file(file, block_buf.get(), block_size);
+        if (!result)
+            return nonstd::make_unexpected(result.error());
+        offset += sizeof(block_size) + block_size;
+        block = std::span<const std::byte>(block_buf.get(), block_size);
+        return true;
+    }
+
+    if (offset >= archive_header.raw_size)
+        return false;
+
+    // Find chunk containing the offset
+    auto chunk_it = std::ranges::upper_bound(chunks, offset, std::less{}, &demo_archive::chunk_entry::raw_offset);
+    size_t chunk_index = size_t(std::prev(chunk_it) - chunks.begin());
+    auto result = load_chunk(chunk_index);
+    if (!result)
+        return nonstd::make_unexpected(result.error());
+
+    // Blocks never cross chunk boundaries
+    const auto& chunk = chunks[chunk_index];
+    size_t pos = size_t(offset - chunk.raw_offset);
+    if (chunk.raw_size - pos < sizeof(uint32_t)) {
+        fmt::println(stderr, "truncated block in chunk {}", chunk_index);
+        return nonstd::make_unexpected(-7);
+    }
+    uint32_t block_size = load_le<uint32_t>(chunk_data.data() + pos);
+    pos += sizeof(uint32_t);
+    if (block_size > max_block_size || block_size > chunk.raw_size - pos) {
+        fmt::println(stderr, "truncated block in chunk {}", chunk_index);
+        return nonstd::make_unexpected(-7);
+    }
+    offset += sizeof(block_size) + block_size;
+    block = std::span<const std::byte>(chunk_data.data() + pos, block_size);
+    return true;
+}
@@ -0,0 +1,134 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/* Demo file reading, for raw demos and chunked demo archives.
+ *
+ * Raw demos are a sequence of blocks, each a little-endian 32-bit length followed by the block data,
+ * terminated by a length of -1.
+ *
+ * Demo archives store the same data (without the end marker) in "chunks" of whole blocks, each chunk
+ * compressed independently with zlib. A chunk index at the end of the file maps offsets in the raw demo
+ * to chunks, so seeking only requires decompressing a single chunk. Offsets in the raw demo are used for
+ * positions in both formats, so positions (eg from a demoindex keyframe index) are interchangeable.
+ *
+ * Archive layout, all values little-endian:
+ * - Header: magic "Q2DZ", version (u32), blocks per chunk (u32), number of chunks (u32),
+ *   index offset (u64), raw demo size (u64)
+ * - Compressed chunks
+ * - Chunk index, one entry per chunk: raw demo offset (u64), file offset (u64),
+ *   compressed size (u32), raw size (u32) */
+
+#ifndef DEMOFILE_HPP_
+#define DEMOFILE_HPP_
+
+#include "expected.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace demo_archive {
+static constexpr char magic[4] = {'Q', '2', 'D', 'Z'};
+static constexpr uint32_t version = 1;
+static constexpr size_t header_size = 4 + 4 + 4 + 4 + 8 + 8;
+static constexpr size_t index_entry_size = 8 + 8 + 4 + 4;
+
+struct header
+{
+    uint32_t blocks_per_chunk;
+    uint32_t num_chunks;
+    uint64_t index_offset;
+    uint64_t raw_size;
+};
+
+struct chunk_entry
+{
+    /// Offset of chunk data in raw demo
+    uint64_t raw_offset;
+    /// Offset of compressed chunk in archive
+    uint64_t file_offset;
+    uint32_t compressed_size;
+    uint32_t raw_size;
+};
+
+/// Serialize header into \a buf, which must have room for header_size bytes
+void write_header(std::byte* buf, const header& hdr);
+/// Serialize chunk index entry into \a buf, which must have room for index_entry_size bytes
+void write_index_entry(std::byte* buf, const chunk_entry& entry);
+} // namespace demo_archive
+
+/// Reads blocks from a raw demo or demo archive
+class demo_file_reader
+{
+    FILE* file = nullptr;
+    bool archive = false;
+    /// Raw demo offset of next block
+    uint64_t offset = 0;
+
+    /// Raw demo: buffer for the current block
+    std::unique_ptr<std::byte[]> block_buf;
+
+    /**\name Demo archive state
+     * @{ */
+    demo_archive::header archive_header = {};
+    std::vector<demo_archive::chunk_entry> chunks;
+    /// Index of chunk in chunk_data, if any
+    size_t current_chunk = SIZE_MAX;
+    std::vector<std::byte> chunk_data;
+    std::vector<std::byte> compressed_data;
+    /** @} */
+
+    nonstd::expected<void, int> open_archive(const char* filename);
+    nonstd::expected<void, int> load_chunk(size_t index);
+
+public:
+    /// Largest supported block size
+    static constexpr size_t max_block_size = 0x10000;
+
+    demo_file_reader() = default;
+    demo_file_reader(const demo_file_reader&) = delete;
+    ~demo_file_reader();
+
+    demo_file_reader& operator=(const demo_file_reader&) = delete;
+
+    /// Open a raw demo or demo archive
+    nonstd::expected<void, int> open(const char* filename);
+
+    /// Whether the file is a demo archive
+    bool is_archive() const { return archive; }
+    /// Chunk index of a demo archive
+    std::span<const demo_archive::chunk_entry> archive_chunks() const { return chunks; }
+    /// Header of a demo archive
+    const demo_archive::header& get_archive_header() const { return archive_header; }
+
+    /// Raw demo offset of the next block
+    uint64_t tell() const { return offset; }
+    /// Continue reading from a block at the given raw demo offset
+    nonstd::expected<void, int> seek(uint64_t raw_offset);
+
+    /**
+     * Read the next block. Returns \c false at the end of the demo.
+     * \a block stays valid until the next read_block() or seek() call.
+     */
+    nonstd::expected<bool, int> read_block(std::span<const std::byte>& block);
+};
+
+#endif // DEMOFILE_HPP_
@@ -0,0 +1,615 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/* Demo keyframe index:
+ * Frames in a demo are delta compressed against earlier frames, so seeking to some frame normally
+ * requires decoding the demo from the start. The index records "keyframes" at regular intervals:
+ * the position in the demo file, the saved client context state and the reconstructed game state.
+ * Seeking then only requires decoding forward from the nearest preceding keyframe.
+ *
+ * Demo offsets are raw demo offsets, so an index works for both a raw demo and its demo archive.
+ *
+ * The index is stored in a "sidecar" file next to the demo. It uses the native byte order and
+ * structure layout, so it's meant to be used on the machine that created it. */
+
+#include "q2proto/q2proto.h"
+#include "democonvert.h"
+#include "demofile.hpp"
+#include "demostate.hpp"
+#include "q2protoio.hpp"
+#include "toolutil.hpp"
+
+#include "expected.hpp"
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fmt/format.h>
+#include <map>
+#include <memory>
+#include "scope.hpp"
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Default interval between keyframes, in frames
+static constexpr uint32_t default_interval = 100;
+
+/* The states are compared field by field, as copying doesn't necessarily preserve
+ * structure padding */
+template<typename T, size_t N>
+static bool same_array(const T (&a)[N], const T (&b)[N])
+{
+    return std::ranges::equal(a, b);
+}
+
+static bool operator==(const democonvert_entity_state_t& a, const democonvert_entity_state_t& b)
+{
+    return a.modelindex == b.modelindex && a.modelindex2 == b.modelindex2 && a.modelindex3 == b.modelindex3
+           && a.modelindex4 == b.modelindex4 && a.frame == b.frame && a.skinnum == b.skinnum && a.effects == b.effects
+           && a.renderfx == b.renderfx && same_array(a.origin, b.origin) && same_array(a.angles, b.angles)
+           && same_array(a.old_origin, b.old_origin) && a.sound == b.sound && a.loop_volume == b.loop_volume
+           && a.loop_attenuation == b.loop_attenuation && a.event == b.event && a.solid == b.solid
+           && a.alpha == b.alpha && a.scale == b.scale;
+}
+
+static bool operator==(const democonvert_player_state_t& a, const democonvert_player_state_t& b)
+{
+    return a.pmove.pm_type == b.pmove.pm_type && same_array(a.pmove.origin, b.pmove.origin)
+           && same_array(a.pmove.velocity, b.pmove.velocity) && a.pmove.pm_time == b.pmove.pm_time
+           && a.pmove.pm_flags == b.pmove.pm_flags && a.pmove.gravity == b.pmove.gravity
+           && same_array(a.pmove.delta_angles, b.pmove.delta_angles) && a.pmove.viewheight == b.pmove.viewheight
+           && same_array(a.viewoffset, b.viewoffset) && same_array(a.viewangles, b.viewangles)
+           && same_array(a.kick_angles, b.kick_angles) && a.gunindex == b.gunindex && a.gunskin == b.gunskin
+           && a.gunframe == b.gunframe && same_array(a.gunoffset, b.gunoffset) && same_array(a.gunangles, b.gunangles)
+           && same_array(a.blend, b.blend) && same_array(a.damage_blend, b.damage_blend) && a.fov == b.fov
+           && a.rdflags == b.rdflags && same_array(a.stats, b.stats) && a.num_stats == b.num_stats
+           && a.gunrate == b.gunrate && same_array(a.fog.color, b.fog.color) && a.fog.density == b.fog.density
+           && a.fog.sky_factor == b.fog.sky_factor && same_array(a.heightfog.start_color, b.heightfog.start_color)
+           && same_array(a.heightfog.end_color, b.heightfog.end_color) && a.heightfog.density == b.heightfog.density
+           && a.heightfog.falloff == b.heightfog.falloff && a.heightfog.start_dist == b.heightfog.start_dist
+           && a.heightfog.end_dist == b.heightfog.end_dist;
+}
+
+static bool operator==(const demo_frame& a, const demo_frame& b)
+{
+    return a.serverframe == b.serverframe && a.player == b.player && a.clientnum == b.clientnum
+           && a.areabits == b.areabits
+           && std::ranges::equal(a.entities, b.entities, [](const auto& x, const auto& y) {
+                  return x.entnum == y.entnum && x.state == y.state;
+              });
+}
+
+/// Compare game states, as far as they are stored in the index
+static bool same_state(const demo_state& a, const demo_state& b)
+{
+    if (a.num_frames != b.num_frames || a.frame.serverframe != b.frame.serverframe
+        || a.frame.deltaframe != b.frame.deltaframe || a.frame_complete != b.frame_complete
+        || a.configstrings != b.configstrings || a.recent_frames != b.recent_frames || a.areabits != b.areabits
+        || !(a.player == b.player) || a.clientnum != b.clientnum)
+        return false;
+    bool same = true;
+    entity_set::for_each_union(a.has_baseline, b.has_baseline, [&](uint16_t entnum) {
+        same = same && a.has_baseline.test(entnum) == b.has_baseline.test(entnum) && a.baselines[entnum] == b.baselines[entnum];
+    });
+    entity_set::for_each_union(a.visible, b.visible, [&](uint16_t entnum) {
+        same = same && a.visible.test(entnum) == b.visible.test(entnum) && a.entities[entnum] == b.entities[entnum];
+    });
+    return same;
+}
+
+/// Reads a demo, block by block
+class demo_reader
+{
+    demo_file_reader file;
+
+public:
+    q2proto_clientcontext_t context;
+    /// File position of next block
+    uint64_t offset = 0;
+
+    nonstd::expected<void, int> open(const char* filename)
+    {
+        auto result = file.open(filename);
+        if (!result)
+            return result;
+        return rewind();
+    }
+
+    /// Restart reading from the beginning of the demo
+    nonstd::expected<void, int> rewind()
+    {
+        if (!check_q2proto_result(q2proto_init_clientcontext(&context), "failed to initialize client context"))
+            return nonstd::make_unexpected(-4);
+        return seek(0);
+    }
+
+    nonstd::expected<void, int> seek(uint64_t new_offset)
+    {
+        auto result = file.seek(new_offset);
+        if (!result)
+            return result;
+        offset = new_offset;
+        return {};
+    }
+
+    /// Read and process the next block. Returns \c false at the end of the demo
+    nonstd::expected<bool, int> read_block(demo_state& state)
+    {
+        std::span<const std::byte> block;
+        auto block_result = file.read_block(block);
+        if (!block_result || !*block_result)
+            return block_result;
+        offset = file.tell();
+
+        auto io_ctx = io_context(block.data(), uint32_t(block.size()));
+        uintptr_t io_arg = reinterpret_cast<uintptr_t>(&io_ctx);
+
+        q2proto_svc_message_t msg;
+        while (true) {
+            auto client_read_result = q2proto_client_read(&context, io_arg, &msg);
+            if (client_read_result == Q2P_ERR_NO_MORE_INPUT)
+                break;
+            else if (!check_q2proto_result(client_read_result, "failed to read message"))
+                return nonstd::make_unexpected(-5);
+            auto state_result = state.handle_message(context, msg);
+            if (!state_result)
+                return nonstd::make_unexpected(state_result.error());
+        }
+        return true;
+    }
+};
+
+/**\name Index file format
+ * - Header
+ * - Keyframe records
+ * - Keyframe table, one entry per keyframe record, ordered by frame
+ * @{ */
+static constexpr char index_magic[4] = {'Q', '2', 'D', 'X'};
+static constexpr uint32_t index_version = 2;
+
+struct index_header
+{
+    char magic[4];
+    uint32_t version;
+    /// Structure sizes, to reject indices created by a different build
+    uint32_t saved_state_size;
+    uint32_t entity_state_size;
+    uint32_t player_state_size;
+    /// Number of keyframes
+    uint32_t num_keyframes;
+    /// Offset of keyframe table
+    uint64_t table_offset;
+};
+
+struct keyframe_entry
+{
+    /// Number of frames decoded up to the keyframe
+    uint32_t num_frames;
+    /// Server frame number of last decoded frame
+    int32_t serverframe;
+    /// Demo file position to continue reading from
+    uint64_t demo_offset;
+    /// Position of keyframe record in index file
+    uint64_t record_offset;
+};
+/** @} */
+
+static void init_header(index_header& header)
+{
+    memcpy(header.magic, index_magic, sizeof(header.magic));
+    header.version = index_version;
+    header.saved_state_size = sizeof(q2proto_client_saved_state_t);
+    header.entity_state_size = sizeof(democonvert_entity_state_t);
+    header.player_state_size = sizeof(democonvert_player_state_t);
+}
+
+/// Write a vector of trivially copyable elements, preceded by the element count
+template<typename T>
+static nonstd::expected<void, int> write_vector(FILE* f, const std::vector<T>& vec)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    uint32_t count = uint32_t(vec.size());
+    auto result = write_file(f, &count, sizeof(count));
+    if (result)
+        result = write_file(f, vec.data(), vec.size() * sizeof(T));
+    return result;
+}
+
+template<typename T>
+static nonstd::expected<void, int> read_vector(FILE* f, std::vector<T>& vec)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    uint32_t count;
+    auto result = read_file(f, &count, sizeof(count));
+    if (!result)
+        return result;
+    vec.resize(count);
+    return read_file(f, vec.data(), vec.size() * sizeof(T));
+}
+
+static nonstd::expected<void, int> write_configstrings(FILE* f, const std::map<uint16_t, std::string>& map)
+{
+    uint32_t count = uint32_t(map.size());
+    auto result = write_file(f, &count, sizeof(count));
+    for (auto it = map.begin(); result && it != map.end(); ++it) {
+        uint32_t len = uint32_t(it->second.size());
+        result = write_file(f, &it->first, sizeof(it->first));
+        if (result)
+            result = write_file(f, &len, sizeof(len));
+        if (result)
+            result = write_file(f, it->second.data(), len);
+    }
+    return result;
+}
+
+static nonstd::expected<void, int> read_configstrings(FILE* f, std::map<uint16_t, std::string>& map)
+{
+    map.clear();
+    uint32_t count;
+    auto result = read_file(f, &count, sizeof(count));
+    for (uint32_t i = 0; result && i < count; i++) {
+        uint16_t key;
+        uint32_t len;
+        result = read_file(f, &key, sizeof(key));
+        if (result)
+            result = read_file(f, &len, sizeof(len));
+        if (result) {
+            auto& value = map[key];
+            value.resize(len);
+            result = read_file(f, value.data(), len);
+        }
+    }
+    return result;
+}
+
+/**
+ * Write the game state of a keyframe: configstrings, baselines and the kept frames.
+ * The current frame is one of the kept frames, so it's not stored separately.
+ */
+static nonstd::expected<void, int> write_game_state(FILE* f, const demo_state& state)
+{
+    std::vector<demo_frame_entity> baselines;
+    state.has_baseline.for_each([&](uint16_t entnum) { baselines.push_back({entnum, state.baselines[entnum]}); });
+
+    auto result = write_file(f, &state.frame, sizeof(state.frame));
+    if (result)
+        result = write_configstrings(f, state.configstrings);
+    if (result)
+        result = write_vector(f, baselines);
+    for (const auto& recent_frame : state.recent_frames) {
+        if (result)
+            result = write_file(f, &recent_frame.serverframe, sizeof(recent_frame.serverframe));
+        if (result)
+            result = write_file(f, &recent_frame.player, sizeof(recent_frame.player));
+        if (result)
+            result = write_file(f, &recent_frame.clientnum, sizeof(recent_frame.clientnum));
+        if (result)
+            result = write_vector(f, recent_frame.areabits);
+        if (result)
+            result = write_vector(f, recent_frame.entities);
+    }
+    return result;
+}
+
+static nonstd::expected<void, int> read_game_state(FILE* f, demo_state& state)
+{
+    q2proto_svc_frame_t frame;
+    std::vector<demo_frame_entity> baselines;
+    auto result = read_file(f, &frame, sizeof(frame));
+    if (result)
+        result = read_configstrings(f, state.configstrings);
+    if (result)
+        result = read_vector(f, baselines);
+    for (auto& recent_frame : state.recent_frames) {
+        if (result)
+            result = read_file(f, &recent_frame.serverframe, sizeof(recent_frame.serverframe));
+        if (result)
+            result = read_file(f, &recent_frame.player, sizeof(recent_frame.player));
+        if (result)
+            result = read_file(f, &recent_frame.clientnum, sizeof(recent_frame.clientnum));
+        if (result)
+            result = read_vector(f, recent_frame.areabits);
+        if (result)
+            result = read_vector(f, recent_frame.entities);
+    }
+    if (!result)
+        return result;
+
+    for (const auto& [entnum, baseline] : baselines) {
+        state.baselines[entnum] = baseline;
+        state.has_baseline.set(entnum, true);
+    }
+    if (!state.select_frame(frame.serverframe)) {
+        fmt::println(stderr, "keyframe: frame {} is missing", frame.serverframe);
+        return nonstd::make_unexpected(-7);
+    }
+    state.frame = frame;
+    return {};
+}
+
+static nonstd::expected<void, int> build_index(const char* demo_name, const char* index_name, uint32_t interval)
+{
+    demo_reader reader;
+    auto result = reader.open(demo_name);
+    if (!result)
+        return result;
+
+    auto* index_file = fopen(index_name, "wb");
+    if (!index_file)
+        return nonstd::make_unexpected(print_io_error(errno, "failed to open \"{}\"", index_name));
+    auto close_index = nonstd::make_scope_exit([&] { fclose(index_file); });
+
+    index_header header = {};
+    init_header(header);
+    result = write_file(index_file, &header, sizeof(header));
+    if (!result)
+        return result;
+
+    std::vector<keyframe_entry> keyframes;
+    demo_state state;
+    uint32_t last_keyframe = 0;
+    uint64_t record_offset = sizeof(header);
+    while (true) {
+        auto block_result = reader.read_block(state);
+        if (!block_result)
+            return nonstd::make_unexpected(block_result.error());
+        if (!*block_result)
+            break;
+        // Only frames read completely are kept, so keyframes can only be placed after one
+        if (state.num_frames < last_keyframe + interval || !state.frame_complete)
+            continue;
+
+        // Client state can't be saved in some cases, eg before the first serverdata; just try again on the next block
+        q2proto_client_saved_state_t saved_state;
+        if (q2proto_client_save_state(&reader.context, &saved_state) != Q2P_ERR_SUCCESS)
+            continue;
+
+        keyframes.push_back({state.num_frames, state.frame.serverframe, reader.offset, record_offset});
+        result = write_file(index_file, &saved_state, sizeof(saved_state));
+        if (result)
+            result = write_game_state(index_file, state);
+        if (!result)
+            return result;
+        record_offset = uint64_t(ftell(index_file));
+        last_keyframe = state.num_frames;
+    }
+
+    header.num_keyframes = uint32_t(keyframes.size());
+    header.table_offset = record_offset;
+    result = write_file(index_file, keyframes.data(), keyframes.size() * sizeof(keyframe_entry));
+    if (result && fseek(index_file, 0, SEEK_SET) != 0)
+        return nonstd::make_unexpected(print_io_error(errno, "seek error"));
+    if (result)
+        result = write_file(index_file, &header, sizeof(header));
+    if (!result)
+        return result;
+
+    fmt::println(stderr, "{} frames, {} keyframes", state.num_frames, keyframes.size());
+    return {};
+}
+
+/// Keyframe index, as loaded from an index file
+class demo_index
+{
+    FILE* file = nullptr;
+    std::vector<keyframe_entry> keyframes;
+
+public:
+    ~demo_index()
+    {
+        if (file)
+            fclose(file);
+    }
+
+    nonstd::expected<void, int> load(const char* index_name)
+    {
+        file = fopen(index_name, "rb");
+        if (!file)
+            return nonstd::make_unexpected(print_io_error(errno, "failed to open \"{}\"", index_name));
+
+        index_header header, expected_header = {};
+        init_header(expected_header);
+        auto result = read_file(file, &header, sizeof(header));
+        if (!result)
+            return result;
+        if (memcmp(header.magic, expected_header.magic, sizeof(header.magic)) != 0
+            || header.version != expected_header.version
+            || header.saved_state_size != expected_header.saved_state_size
+            || header.entity_state_size != expected_header.entity_state_size
+            || header.player_state_size != expected_header.player_state_size)
+        {
+            fmt::println(stderr, "\"{}\": not a demo index, or incompatible", index_name);
+            return nonstd::make_unexpected(-7);
+        }
+
+        keyframes.resize(header.num_keyframes);
+        if (fseek(file, long(header.table_offset), SEEK_SET) != 0)
+            return nonstd::make_unexpected(print_io_error(errno, "seek error"));
+        return read_file(file, keyframes.data(), keyframes.size() * sizeof(keyframe_entry));
+    }
+
+    size_t num_keyframes() const { return keyframes.size(); }
+
+    /// Seek to a frame. Afterwards, \a state contains the state after the frame was decoded
+    nonstd::expected<void, int> seek(demo_reader& reader, uint32_t frame, demo_state& state)
+    {
+        // Find last keyframe not past the target frame
+        auto it = std::ranges::upper_bound(keyframes, frame + 1, std::less{}, &keyframe_entry::num_frames);
+        state = demo_state{};
+        if (it == keyframes.begin()) {
+            auto result = reader.rewind();
+            if (!result)
+                return result;
+        } else {
+            const auto& keyframe = *std::prev(it);
+            if (fseek(file, long(keyframe.record_offset), SEEK_SET) != 0)
+                return nonstd::make_unexpected(print_io_error(errno, "seek error"));
+            q2proto_client_saved_state_t saved_state;
+            auto result = read_file(file, &saved_state, sizeof(saved_state));
+            if (result)
+                result = read_game_state(file, state);
+            if (!result)
+                return result;
+            state.num_frames = keyframe.num_frames;
+
+            if (!check_q2proto_result(q2proto_client_restore_state(&reader.context, &saved_state),
+                                      "failed to restore client state"))
+                return nonstd::make_unexpected(-4);
+            result = reader.seek(keyframe.demo_offset);
+            if (!result)
+                return result;
+        }
+
+        while (state.num_frames <= frame) {
+            auto block_result = reader.read_block(state);
+            if (!block_result)
+                return nonstd::make_unexpected(block_result.error());
+            if (!*block_result) {
+                fmt::println(stderr, "frame {} is past the end of the demo ({} frames)", frame, state.num_frames);
+                return nonstd::make_unexpected(-8);
+            }
+        }
+        return {};
+    }
+};
+
+// Compare seeking via the index with sequential decoding, for every frame
+static nonstd::expected<void, int> check_index(const char* demo_name, const char* index_name)
+{
+    demo_index index;
+    auto result = index.load(index_name);
+    if (!result)
+        return result;
+
+    demo_reader sequential_reader, seek_reader;
+    result = sequential_reader.open(demo_name);
+    if (result)
+        result = seek_reader.open(demo_name);
+    if (!result)
+        return result;
+
+    demo_state sequential_state;
+    uint32_t num_checked = 0, num_mismatches = 0;
+    while (true) {
+        uint32_t prev_frames = sequential_state.num_frames;
+        auto block_result = sequential_reader.read_block(sequential_state);
+        if (!block_result)
+            return nonstd::make_unexpected(block_result.error());
+        if (!*block_result)
+            break;
+        if (sequential_state.num_frames == prev_frames)
+            continue;
+
+        demo_state seek_state;
+        result = index.seek(seek_reader, sequential_state.num_frames - 1, seek_state);
+        if (!result)
+            return result;
+        num_checked++;
+        if (!same_state(seek_state, sequential_state)) {
+            fmt::println(stderr, "frame {}: state after seeking differs", sequential_state.num_frames - 1);
+            num_mismatches++;
+        }
+    }
+
+    fmt::println(stderr, "{} frames checked, {} mismatches", num_checked, num_mismatches);
+    if (num_mismatches != 0)
+        return nonstd::make_unexpected(-9);
+    return {};
+}
+
+static nonstd::expected<void, int> seek_to_frame(const char* demo_name, const char* index_name, uint32_t frame)
+{
+    demo_index index;
+    auto result = index.load(index_name);
+    if (!result)
+        return result;
+
+    demo_reader reader;
+    result = reader.open(demo_name);
+    if (!result)
+        return result;
+
+    auto start_time = std::chrono::steady_clock::now();
+    demo_state state;
+    result = index.seek(reader, frame, state);
+    if (!result)
+        return result;
+    std::chrono::duration<double, std::milli> seek_time = std::chrono::steady_clock::now() - start_time;
+
+    size_t num_entities = 0;
+    state.visible.for_each([&](uint16_t) { num_entities++; });
+    fmt::println("frame {}: serverframe {}, {} entities, {} configstrings", frame, state.frame.serverframe,
+                 num_entities, state.configstrings.size());
+    fmt::println("player origin: {},{},{}", state.player.pmove.origin[0], state.player.pmove.origin[1],
+                 state.player.pmove.origin[2]);
+    fmt::println(stderr, "seek took {:.3f} ms ({} keyframes)", seek_time.count(), index.num_keyframes());
+    return {};
+}
+
+int main(int argc, const char* argv[])
+{
+    uint32_t interval = default_interval;
+    const char* index_name = nullptr;
+    const char* demo_name = nullptr;
+    long seek_frame = -1;
+    bool check = false;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg(argv[i]);
+        if (arg == "-i" && i + 1 < argc) {
+            interval = uint32_t(atoi(argv[++i]));
+            if (interval == 0) {
+                fmt::println(stderr, "invalid keyframe interval {}", argv[i]);
+                return -1;
+            }
+        } else if (arg == "-x" && i + 1 < argc)
+            index_name = argv[++i];
+        else if (arg == "-s" && i + 1 < argc)
+            seek_frame = atol(argv[++i]);
+        else if (arg == "-c")
+            check = true;
+        else
+            demo_name = argv[i];
+    }
+    if (!demo_name) {
+        fmt::println(stderr, "Syntax: {} [-i interval] [-x index] [-s frame] [-c] demofile", argv[0]);
+        fmt::println(stderr, "  -i interval  Frames between keyframes. Default: {}", default_interval);
+        fmt::println(stderr, "  -x index     Index file. Default: demo file name with \".idx\" appended");
+        fmt::println(stderr, "  -s frame     Seek to frame (counted from 0) using an existing index");
+        fmt::println(stderr, "  -c           Check seeking to each frame against sequential decoding");
+        fmt::println(stderr, "Without -s or -c, the index is created.");
+        return -1;
+    }
+
+    std::string default_index_name;
+    if (!index_name) {
+        default_index_name = fmt::format("{}.idx", demo_name);
+        index_name = default_index_name.c_str();
+    }
+
+    nonstd::expected<void, int> result;
+    if (seek_frame >= 0)
+        result = seek_to_frame(demo_name, index_name, uint32_t(seek_frame));
+    else if (check)
+        result = check_index(demo_name, index_name);
+    else
+        result = build_index(demo_name, index_name, interval);
+    return result ? 0 : result.error();
+}
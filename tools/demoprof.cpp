@@ -0,0 +1,801 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/* Demo bandwidth profiler:
+ * Decodes demos and reports what the bytes are spent on: byte totals per message type, how often
+ * each entity and player state field is sent (from the delta bits the readers report), how often
+ * each stat changes, and size histograms of frames and entity deltas.
+ * Byte counts are taken from the raw demo data, so demo archives are profiled like the demos they hold.
+ * Compressed data (svc_zpacket) is accounted for separately; messages read from it are counted with their
+ * decompressed size, and shares are relative to the demo size with compressed data counted decompressed.
+ * Field bytes are what leaving a field out of a delta would save, as computed by the exact size queries of a
+ * server context for the demo protocol, for deltas between the reconstructed states. The bytes of a vector are
+ * split evenly among its changed components. Protocols without server support get no field bytes.
+ * Demos are processed in parallel, one demo per thread at a time. */
+
+#include "q2proto/q2proto.h"
+#include "democonvert.h"
+#include "demofile.hpp"
+#include "demostate.hpp"
+#include "q2protoio.hpp"
+#include "toolutil.hpp"
+
+#include "expected.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <fmt/format.h>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+static constexpr size_t num_message_types = Q2P_SVC_LOCPRINT + 1;
+
+/**\name Profiled fields
+ * @{ */
+enum entity_field
+{
+    EF_ORIGIN_X,
+    EF_ORIGIN_Y,
+    EF_ORIGIN_Z,
+    EF_ANGLE_X,
+    EF_ANGLE_Y,
+    EF_ANGLE_Z,
+    EF_MODELINDEX,
+    EF_MODELINDEX2,
+    EF_MODELINDEX3,
+    EF_MODELINDEX4,
+    EF_FRAME,
+    EF_SKINNUM,
+    EF_EFFECTS,
+    EF_EFFECTS_MORE,
+    EF_RENDERFX,
+    EF_OLD_ORIGIN,
+    EF_SOUND,
+    EF_LOOP_VOLUME,
+    EF_LOOP_ATTENUATION,
+    EF_EVENT,
+    EF_SOLID,
+    EF_ALPHA,
+    EF_SCALE,
+    EF_REMOVE,
+
+    NUM_ENTITY_FIELDS
+};
+
+static const char* const entity_field_names[NUM_ENTITY_FIELDS] = {
+    "origin_x", "origin_y", "origin_z", "angle_x", "angle_y", "angle_z", "modelindex", "modelindex2",
+    "modelindex3", "modelindex4", "frame", "skinnum", "effects", "effects_more", "renderfx", "old_origin",
+    "sound", "loop_volume", "loop_attenuation", "event", "solid", "alpha", "scale", "remove",
+};
+
+// Entity fields directly corresponding to a delta bit
+static constexpr std::pair<entity_field, uint32_t> entity_field_bits[] = {
+    {EF_MODELINDEX, Q2P_ESD_MODELINDEX},
+    {EF_MODELINDEX2, Q2P_ESD_MODELINDEX2},
+    {EF_MODELINDEX3, Q2P_ESD_MODELINDEX3},
+    {EF_MODELINDEX4, Q2P_ESD_MODELINDEX4},
+    {EF_FRAME, Q2P_ESD_FRAME},
+    {EF_SKINNUM, Q2P_ESD_SKINNUM},
+    {EF_EFFECTS, Q2P_ESD_EFFECTS},
+    {EF_EFFECTS_MORE, Q2P_ESD_EFFECTS_MORE},
+    {EF_RENDERFX, Q2P_ESD_RENDERFX},
+    {EF_OLD_ORIGIN, Q2P_ESD_OLD_ORIGIN},
+    {EF_SOUND, Q2P_ESD_SOUND},
+    {EF_LOOP_VOLUME, Q2P_ESD_LOOP_VOLUME},
+    {EF_LOOP_ATTENUATION, Q2P_ESD_LOOP_ATTENUATION},
+    {EF_EVENT, Q2P_ESD_EVENT},
+    {EF_SOLID, Q2P_ESD_SOLID},
+    {EF_ALPHA, Q2P_ESD_ALPHA},
+    {EF_SCALE, Q2P_ESD_SCALE},
+};
+
+enum player_field
+{
+    PF_PM_TYPE,
+    PF_PM_ORIGIN_X,
+    PF_PM_ORIGIN_Y,
+    PF_PM_ORIGIN_Z,
+    PF_PM_VELOCITY_X,
+    PF_PM_VELOCITY_Y,
+    PF_PM_VELOCITY_Z,
+    PF_PM_TIME,
+    PF_PM_FLAGS,
+    PF_PM_GRAVITY,
+    PF_PM_DELTA_ANGLES,
+    PF_PM_VIEWHEIGHT,
+    PF_VIEWOFFSET,
+    PF_VIEWANGLE_X,
+    PF_VIEWANGLE_Y,
+    PF_VIEWANGLE_Z,
+    PF_KICKANGLES,
+    PF_GUNINDEX,
+    PF_GUNSKIN,
+    PF_GUNFRAME,
+    PF_GUNOFFSET,
+    PF_GUNANGLES,
+    PF_BLEND,
+    PF_DAMAGE_BLEND,
+    PF_FOV,
+    PF_RDFLAGS,
+    PF_STATS,
+    PF_GUNRATE,
+    PF_CLIENTNUM,
+    PF_FOG,
+
+    NUM_PLAYER_FIELDS
+};
+
+static const char* const player_field_names[NUM_PLAYER_FIELDS] = {
+    "pm_type", "pm_origin_x", "pm_origin_y", "pm_origin_z", "pm_velocity_x", "pm_velocity_y", "pm_velocity_z",
+    "pm_time", "pm_flags", "pm_gravity", "pm_delta_angles", "pm_viewheight", "viewoffset", "viewangle_x",
+    "viewangle_y", "viewangle_z", "kick_angles", "gunindex", "gunskin", "gunframe", "gunoffset", "gunangles",
+    "blend", "damage_blend", "fov", "rdflags", "stats", "gunrate", "clientnum", "fog",
+};
+
+// Player fields directly corresponding to a delta bit
+static constexpr std::pair<player_field, uint32_t> player_field_bits[] = {
+    {PF_PM_TYPE, Q2P_PSD_PM_TYPE},
+    {PF_PM_TIME, Q2P_PSD_PM_TIME},
+    {PF_PM_FLAGS, Q2P_PSD_PM_FLAGS},
+    {PF_PM_GRAVITY, Q2P_PSD_PM_GRAVITY},
+    {PF_PM_DELTA_ANGLES, Q2P_PSD_PM_DELTA_ANGLES},
+    {PF_PM_VIEWHEIGHT, Q2P_PSD_PM_VIEWHEIGHT},
+    {PF_VIEWOFFSET, Q2P_PSD_VIEWOFFSET},
+    {PF_KICKANGLES, Q2P_PSD_KICKANGLES},
+    {PF_GUNINDEX, Q2P_PSD_GUNINDEX},
+    {PF_GUNSKIN, Q2P_PSD_GUNSKIN},
+    {PF_GUNFRAME, Q2P_PSD_GUNFRAME},
+    {PF_FOV, Q2P_PSD_FOV},
+    {PF_RDFLAGS, Q2P_PSD_RDFLAGS},
+    {PF_GUNRATE, Q2P_PSD_GUNRATE},
+    {PF_CLIENTNUM, Q2P_PSD_CLIENTNUM},
+};
+/** @} */
+
+/// Histogram over power-of-two buckets: bucket N counts values in [2^(N-1), 2^N - 1]; bucket 0 counts zeroes
+struct histogram
+{
+    static constexpr size_t num_buckets = 18;
+    std::array<uint64_t, num_buckets> buckets = {};
+
+    void add(uint64_t value) { buckets[std::min<size_t>(std::bit_width(value), num_buckets - 1)]++; }
+    void merge(const histogram& other)
+    {
+        for (size_t i = 0; i < num_buckets; i++)
+            buckets[i] += other.buckets[i];
+    }
+    static uint64_t bucket_min(size_t bucket) { return bucket == 0 ? 0 : 1ull << (bucket - 1); }
+    static uint64_t bucket_max(size_t bucket) { return bucket == 0 ? 0 : (1ull << bucket) - 1; }
+};
+
+struct message_counter
+{
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+};
+
+/// Profile of one or more demos
+struct profile
+{
+    uint64_t bytes = 0;
+    uint64_t blocks = 0;
+    uint64_t frames = 0;
+    std::array<message_counter, num_message_types> messages = {};
+    /// Compressed data: count and bytes as stored, including headers
+    message_counter zpackets;
+    /// Bytes of messages read from compressed data
+    uint64_t zpacket_inflated_bytes = 0;
+    /// Number of entity deltas (excluding end of frame markers)
+    uint64_t entity_deltas = 0;
+    std::array<uint64_t, NUM_ENTITY_FIELDS> entity_fields = {};
+    std::array<uint64_t, NUM_ENTITY_FIELDS> entity_field_bytes = {};
+    std::array<uint64_t, NUM_PLAYER_FIELDS> player_fields = {};
+    std::array<uint64_t, NUM_PLAYER_FIELDS> player_field_bytes = {};
+    std::array<uint64_t, Q2PROTO_STATS> stats = {};
+    /// Bytes per frame, including entity deltas
+    histogram frame_bytes;
+    /// Bytes per entity delta
+    histogram entity_delta_bytes;
+    /// Number of fields per entity delta
+    histogram entity_delta_fields;
+
+    void merge(const profile& other)
+    {
+        bytes += other.bytes;
+        blocks += other.blocks;
+        frames += other.frames;
+        for (size_t i = 0; i < num_message_types; i++) {
+            messages[i].count += other.messages[i].count;
+            messages[i].bytes += other.messages[i].bytes;
+        }
+        zpackets.count += other.zpackets.count;
+        zpackets.bytes += other.zpackets.bytes;
+        zpacket_inflated_bytes += other.zpacket_inflated_bytes;
+        entity_deltas += other.entity_deltas;
+        for (size_t i = 0; i < NUM_ENTITY_FIELDS; i++) {
+            entity_fields[i] += other.entity_fields[i];
+            entity_field_bytes[i] += other.entity_field_bytes[i];
+        }
+        for (size_t i = 0; i < NUM_PLAYER_FIELDS; i++) {
+            player_fields[i] += other.player_fields[i];
+            player_field_bytes[i] += other.player_field_bytes[i];
+        }
+        for (size_t i = 0; i < Q2PROTO_STATS; i++)
+            stats[i] += other.stats[i];
+        frame_bytes.merge(other.frame_bytes);
+        entity_delta_bytes.merge(other.entity_delta_bytes);
+        entity_delta_fields.merge(other.entity_delta_fields);
+    }
+
+    /// Demo size, with compressed data counted with its decompressed size
+    uint64_t decoded_bytes() const { return bytes - zpackets.bytes + zpacket_inflated_bytes; }
+};
+
+/**
+ * Charge \a fields with the bytes saved by applying \a remove to \a delta, split evenly.
+ * \a size_of computes the size of a delta, returning \c false if it can't be encoded.
+ */
+template<typename Delta, typename SizeFunc, typename RemoveFunc>
+static void charge_fields(uint64_t* field_bytes, const Delta& delta, size_t full_size, SizeFunc&& size_of,
+                          std::span<const int> fields, RemoveFunc&& remove)
+{
+    if (fields.empty())
+        return;
+    Delta reduced = delta;
+    remove(reduced);
+    size_t reduced_size;
+    if (!size_of(reduced, reduced_size) || reduced_size >= full_size)
+        return;
+    uint64_t saved = full_size - reduced_size;
+    for (size_t i = 0; i < fields.size(); i++)
+        field_bytes[fields[i]] += saved / fields.size() + (i < saved % fields.size() ? 1 : 0);
+}
+
+/// Charge the components of a coordinate delta, given the first component's field
+template<typename Delta, typename SizeFunc>
+static void charge_coords(uint64_t* field_bytes, const Delta& delta, size_t full_size, SizeFunc&& size_of,
+                          int first_field, q2proto_maybe_diff_coords_t Delta::*coords)
+{
+    int changed[3];
+    size_t num_changed = 0;
+    for (int c = 0; c < 3; c++) {
+        if (q2proto_var_coords_get_int_comp(&(delta.*coords).write.prev, c)
+            != q2proto_var_coords_get_int_comp(&(delta.*coords).write.current, c))
+            changed[num_changed++] = first_field + c;
+    }
+    charge_fields(field_bytes, delta, full_size, size_of, std::span(changed, num_changed),
+                  [&](Delta& d) { (d.*coords).write.current = (d.*coords).write.prev; });
+}
+
+/// Charge the components of an angle delta, given the first component's field
+template<typename Delta, typename SizeFunc>
+static void charge_angles(uint64_t* field_bytes, const Delta& delta, size_t full_size, SizeFunc&& size_of,
+                          int first_field, q2proto_angles_delta_t Delta::*angles)
+{
+    int changed[3];
+    size_t num_changed = 0;
+    for (int c = 0; c < 3; c++) {
+        if ((delta.*angles).delta_bits & (1 << c))
+            changed[num_changed++] = first_field + c;
+    }
+    charge_fields(field_bytes, delta, full_size, size_of, std::span(changed, num_changed),
+                  [&](Delta& d) { (d.*angles).delta_bits = 0; });
+}
+
+/// Profiles a single demo
+class demo_profiler
+{
+    profile& prof;
+    /// Bytes of the frame currently being read
+    uint64_t current_frame_bytes = 0;
+
+    /// Reconstructed game state
+    demo_state state;
+    /**\name Server context for the demo protocol, for field sizes
+     * @{ */
+    q2proto_server_info_t server_info = {};
+    q2proto_servercontext_t size_context;
+    bool have_size_context = false;
+    /** @} */
+
+    void setup_size_context(const q2proto_clientcontext_t& context, const q2proto_svc_serverdata_t& serverdata)
+    {
+        server_info.game_api = context.features.server_game_api;
+        auto protocol = q2proto_protocol_from_netver(serverdata.protocol);
+        // Demo-only protocols are picked from the game API
+        if (protocol == q2proto_get_demo_protocol(&server_info))
+            protocol = Q2P_PROTOCOL_INVALID;
+        size_t max_msg_len;
+        have_size_context =
+            q2proto_init_servercontext_demo(&size_context, protocol, &server_info, &max_msg_len) == Q2P_ERR_SUCCESS;
+    }
+
+    void add_entity_field_bytes(uint16_t entnum, const democonvert_entity_state_t& from,
+                                const democonvert_entity_state_t& to, bool write_old_origin)
+    {
+        q2proto_packed_entity_state_t from_packed, to_packed;
+        democonvert_pack_entity(&size_context, &from, &from_packed);
+        democonvert_pack_entity(&size_context, &to, &to_packed);
+        q2proto_entity_state_delta_t delta;
+        q2proto_server_make_entity_state_delta(&size_context, &from_packed, &to_packed, write_old_origin, &delta);
+
+        auto size_of = [&](const q2proto_entity_state_delta_t& d, size_t& size) {
+            return q2proto_server_entity_delta_size(&size_context, entnum, &d, &size) == Q2P_ERR_SUCCESS;
+        };
+        size_t full_size;
+        if (!size_of(delta, full_size))
+            return;
+        auto* field_bytes = prof.entity_field_bytes.data();
+        charge_coords(field_bytes, delta, full_size, size_of, EF_ORIGIN_X, &q2proto_entity_state_delta_t::origin);
+        charge_angles(field_bytes, delta, full_size, size_of, EF_ANGLE_X, &q2proto_entity_state_delta_t::angle);
+        for (const auto& [field, bit] : entity_field_bits) {
+            if (bit == 0 || !(delta.delta_bits & bit))
+                continue;
+            int fields[] = {field};
+            charge_fields(field_bytes, delta, full_size, size_of, fields,
+                          [bit](q2proto_entity_state_delta_t& d) { d.delta_bits &= ~bit; });
+        }
+    }
+
+    void add_player_field_bytes(const democonvert_player_state_t* from, const democonvert_player_state_t& to)
+    {
+        q2proto_packed_player_state_t from_packed, to_packed;
+        if (from)
+            democonvert_pack_player(&size_context, from, &from_packed);
+        democonvert_pack_player(&size_context, &to, &to_packed);
+        q2proto_svc_playerstate_t delta;
+        q2proto_server_make_player_state_delta(&size_context, from ? &from_packed : nullptr, &to_packed, &delta);
+
+        auto size_of = [&](const q2proto_svc_playerstate_t& d, size_t& size) {
+            return q2proto_server_playerstate_size(&size_context, &d, &size) == Q2P_ERR_SUCCESS;
+        };
+        size_t full_size;
+        if (!size_of(delta, full_size))
+            return;
+        auto* field_bytes = prof.player_field_bytes.data();
+        charge_coords(field_bytes, delta, full_size, size_of, PF_PM_ORIGIN_X, &q2proto_svc_playerstate_t::pm_origin);
+        charge_coords(field_bytes, delta, full_size, size_of, PF_PM_VELOCITY_X,
+                      &q2proto_svc_playerstate_t::pm_velocity);
+        charge_angles(field_bytes, delta, full_size, size_of, PF_VIEWANGLE_X, &q2proto_svc_playerstate_t::viewangles);
+        for (const auto& [field, bit] : player_field_bits) {
+            if (bit == 0 || !(delta.delta_bits & bit))
+                continue;
+            int fields[] = {field};
+            charge_fields(field_bytes, delta, full_size, size_of, fields,
+                          [bit](q2proto_svc_playerstate_t& d) { d.delta_bits &= ~bit; });
+        }
+        auto charge_one = [&](int field, bool changed, auto&& remove) {
+            int fields[] = {field};
+            if (changed)
+                charge_fields(field_bytes, delta, full_size, size_of, fields, remove);
+        };
+        charge_one(PF_GUNOFFSET, delta.gunoffset.delta_bits != 0,
+                   [](q2proto_svc_playerstate_t& d) { d.gunoffset.delta_bits = 0; });
+        charge_one(PF_GUNANGLES, delta.gunangles.delta_bits != 0,
+                   [](q2proto_svc_playerstate_t& d) { d.gunangles.delta_bits = 0; });
+        charge_one(PF_BLEND, delta.blend.delta_bits != 0,
+                   [](q2proto_svc_playerstate_t& d) { d.blend.delta_bits = 0; });
+        charge_one(PF_DAMAGE_BLEND, delta.damage_blend.delta_bits != 0,
+                   [](q2proto_svc_playerstate_t& d) { d.damage_blend.delta_bits = 0; });
+        charge_one(PF_STATS, delta.statbits != 0, [](q2proto_svc_playerstate_t& d) { d.statbits = 0; });
+        charge_one(PF_FOG,
+                   delta.fog.flags != 0 || delta.fog.global.color.delta_bits != 0
+                       || delta.fog.height.start_color.delta_bits != 0 || delta.fog.height.end_color.delta_bits != 0,
+                   [](q2proto_svc_playerstate_t& d) { d.fog = {}; });
+    }
+
+    /// Update the reconstructed state, and charge field bytes of frames and entity deltas
+    nonstd::expected<void, int> update_state(const q2proto_clientcontext_t& context, const q2proto_svc_message_t& msg)
+    {
+        std::optional<democonvert_player_state_t> from_player;
+        std::optional<democonvert_entity_state_t> from_entity;
+        if (msg.type == Q2P_SVC_FRAME) {
+            if (const auto* delta_frame = state.find_frame(msg.frame.deltaframe))
+                from_player = delta_frame->player;
+        } else if (msg.type == Q2P_SVC_FRAME_ENTITY_DELTA && msg.frame_entity_delta.newnum != 0
+                   && !msg.frame_entity_delta.remove) {
+            auto entnum = msg.frame_entity_delta.newnum;
+            from_entity = state.visible.test(entnum) ? state.entities[entnum] : state.baselines[entnum];
+        }
+
+        auto result = state.handle_message(context, msg);
+        if (!result)
+            return result;
+
+        if (msg.type == Q2P_SVC_SERVERDATA)
+            setup_size_context(context, msg.serverdata);
+        else if (!have_size_context)
+            return {};
+        else if (msg.type == Q2P_SVC_FRAME)
+            add_player_field_bytes(from_player ? &*from_player : nullptr, state.player);
+        else if (from_entity) {
+            auto entnum = msg.frame_entity_delta.newnum;
+            add_entity_field_bytes(entnum, *from_entity, state.entities[entnum],
+                                   msg.frame_entity_delta.entity_delta.delta_bits & Q2P_ESD_OLD_ORIGIN);
+        }
+        return {};
+    }
+
+    void add_entity_delta(const q2proto_svc_frame_entity_delta_t& delta, uint32_t size)
+    {
+        prof.entity_delta_bytes.add(size);
+        prof.entity_deltas++;
+        if (delta.remove) {
+            prof.entity_fields[EF_REMOVE]++;
+            prof.entity_delta_fields.add(1);
+            return;
+        }
+        const auto& entity_delta = delta.entity_delta;
+        uint32_t num_fields = 0;
+        auto count = [&](int field) {
+            prof.entity_fields[field]++;
+            num_fields++;
+        };
+        for (int c = 0; c < 3; c++) {
+            if (entity_delta.origin.read.value.delta_bits & (1 << c))
+                count(EF_ORIGIN_X + c);
+            if (entity_delta.angle.delta_bits & (1 << c))
+                count(EF_ANGLE_X + c);
+        }
+        for (const auto& [field, bit] : entity_field_bits) {
+            if (bit != 0 && (entity_delta.delta_bits & bit))
+                count(field);
+        }
+        prof.entity_delta_fields.add(num_fields);
+    }
+
+    void add_playerstate(const q2proto_svc_playerstate_t& playerstate)
+    {
+        for (const auto& [field, bit] : player_field_bits) {
+            if (bit != 0 && (playerstate.delta_bits & bit))
+                prof.player_fields[field]++;
+        }
+        for (int c = 0; c < 3; c++) {
+            if (playerstate.pm_origin.read.value.delta_bits & (1 << c))
+                prof.player_fields[PF_PM_ORIGIN_X + c]++;
+            if (playerstate.pm_velocity.read.value.delta_bits & (1 << c))
+                prof.player_fields[PF_PM_VELOCITY_X + c]++;
+            if (playerstate.viewangles.delta_bits & (1 << c))
+                prof.player_fields[PF_VIEWANGLE_X + c]++;
+        }
+        if (playerstate.gunoffset.delta_bits != 0)
+            prof.player_fields[PF_GUNOFFSET]++;
+        if (playerstate.gunangles.delta_bits != 0)
+            prof.player_fields[PF_GUNANGLES]++;
+        if (playerstate.blend.delta_bits != 0)
+            prof.player_fields[PF_BLEND]++;
+        if (playerstate.damage_blend.delta_bits != 0)
+            prof.player_fields[PF_DAMAGE_BLEND]++;
+        if (playerstate.statbits != 0)
+            prof.player_fields[PF_STATS]++;
+        if (playerstate.fog.flags != 0 || playerstate.fog.global.color.delta_bits != 0
+            || playerstate.fog.height.start_color.delta_bits != 0 || playerstate.fog.height.end_color.delta_bits != 0)
+            prof.player_fields[PF_FOG]++;
+        for (uint64_t bits = playerstate.statbits; bits != 0; bits &= bits - 1)
+            prof.stats[std::countr_zero(bits)]++;
+    }
+
+    void add_message(const q2proto_svc_message_t& msg, uint32_t size)
+    {
+        auto& counter = prof.messages[msg.type];
+        counter.bytes += size;
+
+        switch (msg.type) {
+        case Q2P_SVC_FRAME:
+            counter.count++;
+            prof.frames++;
+            current_frame_bytes = size;
+            add_playerstate(msg.frame.playerstate);
+            break;
+        case Q2P_SVC_FRAME_ENTITY_DELTA:
+            current_frame_bytes += size;
+            // End of frame marker: bytes count towards entity deltas, but it's not a delta itself
+            if (msg.frame_entity_delta.newnum == 0) {
+                prof.frame_bytes.add(current_frame_bytes);
+                break;
+            }
+            counter.count++;
+            add_entity_delta(msg.frame_entity_delta, size);
+            break;
+        default:
+            counter.count++;
+            break;
+        }
+    }
+
+public:
+    explicit demo_profiler(profile& prof) : prof(prof) {}
+
+    nonstd::expected<void, int> run(const char* filename)
+    {
+        q2proto_clientcontext_t context;
+        if (!check_q2proto_result(q2proto_init_clientcontext(&context), "failed to initialize client context"))
+            return nonstd::make_unexpected(-4);
+
+        demo_file_reader demo_file;
+        auto open_result = demo_file.open(filename);
+        if (!open_result)
+            return open_result;
+
+        while (true) {
+            std::span<const std::byte> block;
+            auto read_result = demo_file.read_block(block);
+            if (!read_result)
+                return nonstd::make_unexpected(read_result.error());
+            if (!*read_result)
+                break;
+            prof.bytes += sizeof(uint32_t) + block.size();
+            prof.blocks++;
+
+            auto io_ctx = io_context(block.data(), uint32_t(block.size()));
+            uintptr_t io_arg = reinterpret_cast<uintptr_t>(&io_ctx);
+
+            q2proto_svc_message_t msg;
+            while (true) {
+                uint32_t start_pos = io_ctx.pos;
+                uint32_t start_inflates = io_ctx.num_inflates;
+                uint64_t start_inflated = io_ctx.inflated_bytes();
+                auto client_read_result = q2proto_client_read(&context, io_arg, &msg);
+                if (client_read_result == Q2P_ERR_NO_MORE_INPUT)
+                    break;
+                else if (!check_q2proto_result(client_read_result, "failed to read message"))
+                    return nonstd::make_unexpected(-5);
+                auto state_result = update_state(context, msg);
+                if (!state_result)
+                    return state_result;
+                auto inflated = uint32_t(io_ctx.inflated_bytes() - start_inflated);
+                if (inflated != 0) {
+                    // Message was read from compressed data. Bytes read from the block are compressed data
+                    prof.zpackets.count += io_ctx.num_inflates - start_inflates;
+                    prof.zpackets.bytes += io_ctx.pos - start_pos;
+                    prof.zpacket_inflated_bytes += inflated;
+                    add_message(msg, inflated);
+                } else
+                    add_message(msg, io_ctx.pos - start_pos);
+            }
+        }
+        return {};
+    }
+};
+
+/// Profile of an individual demo
+struct demo_result
+{
+    const char* filename;
+    profile prof;
+    bool ok = false;
+};
+
+static void profile_demos(std::vector<demo_result>& results, unsigned num_threads)
+{
+    std::atomic<size_t> next_demo = 0;
+    auto work = [&] {
+        while (true) {
+            size_t index = next_demo++;
+            if (index >= results.size())
+                break;
+            auto& result = results[index];
+            demo_profiler profiler(result.prof);
+            result.ok = bool(profiler.run(result.filename));
+            if (!result.ok)
+                fmt::println(stderr, "failed to process \"{}\"", result.filename);
+        }
+    };
+
+    std::vector<std::jthread> threads;
+    for (unsigned t = 1; t < num_threads; t++)
+        threads.emplace_back(work);
+    work();
+}
+
+static std::string json_string(std::string_view str)
+{
+    std::string result = "\"";
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+            result += c;
+        } else if (uint8_t(c) < 0x20)
+            result += fmt::format("\\u{:04x}", c);
+        else
+            result += c;
+    }
+    result += '"';
+    return result;
+}
+
+static std::string percentage(uint64_t part, uint64_t total)
+{
+    return total != 0 ? fmt::format("{:.1f}%", 100.0 * double(part) / double(total)) : "-";
+}
+
+static void print_histogram_text(std::string_view title, const histogram& hist)
+{
+    fmt::println("{}:", title);
+    for (size_t i = 0; i < histogram::num_buckets; i++) {
+        if (hist.buckets[i] != 0)
+            fmt::println("  {:>6}-{:<6} {:>12}", histogram::bucket_min(i), histogram::bucket_max(i), hist.buckets[i]);
+    }
+}
+
+static void print_text(const profile& prof)
+{
+    fmt::println("{} bytes in {} blocks, {} frames", prof.bytes, prof.blocks, prof.frames);
+
+    fmt::println("{:<20} {:>12} {:>14} {:>7}", "message", "count", "bytes", "share");
+    std::vector<size_t> order;
+    for (size_t i = 0; i < num_message_types; i++) {
+        if (prof.messages[i].count != 0 || prof.messages[i].bytes != 0)
+            order.push_back(i);
+    }
+    std::ranges::sort(order, std::greater{}, [&](size_t i) { return prof.messages[i].bytes; });
+    for (auto i : order) {
+        fmt::println("{:<20} {:>12} {:>14} {:>7}", q2proto_svc_message_str(q2proto_svc_message_type_t(i)),
+                     prof.messages[i].count, prof.messages[i].bytes,
+                     percentage(prof.messages[i].bytes, prof.decoded_bytes()));
+    }
+    if (prof.zpackets.count != 0) {
+        fmt::println("{} zpackets: {} bytes, {} bytes decompressed", prof.zpackets.count, prof.zpackets.bytes,
+                     prof.zpacket_inflated_bytes);
+    }
+
+    fmt::println("{:<20} {:>12} {:>7} {:>14}", "entity field", "count", "deltas", "bytes");
+    for (size_t i = 0; i < NUM_ENTITY_FIELDS; i++) {
+        if (prof.entity_fields[i] != 0 || prof.entity_field_bytes[i] != 0)
+            fmt::println("{:<20} {:>12} {:>7} {:>14}", entity_field_names[i], prof.entity_fields[i],
+                         percentage(prof.entity_fields[i], prof.entity_deltas), prof.entity_field_bytes[i]);
+    }
+
+    fmt::println("{:<20} {:>12} {:>7} {:>14}", "player field", "count", "frames", "bytes");
+    for (size_t i = 0; i < NUM_PLAYER_FIELDS; i++) {
+        if (prof.player_fields[i] != 0 || prof.player_field_bytes[i] != 0)
+            fmt::println("{:<20} {:>12} {:>7} {:>14}", player_field_names[i], prof.player_fields[i],
+                         percentage(prof.player_fields[i], prof.frames), prof.player_field_bytes[i]);
+    }
+
+    fmt::println("{:<20} {:>12} {:>7}", "stat", "changes", "frames");
+    for (size_t i = 0; i < Q2PROTO_STATS; i++) {
+        if (prof.stats[i] != 0)
+            fmt::println("{:<20} {:>12} {:>7}", i, prof.stats[i], percentage(prof.stats[i], prof.frames));
+    }
+
+    print_histogram_text("frame bytes", prof.frame_bytes);
+    print_histogram_text("entity delta bytes", prof.entity_delta_bytes);
+    print_histogram_text("entity delta fields", prof.entity_delta_fields);
+}
+
+static void print_json_histogram(std::string& out, const histogram& hist)
+{
+    out += '[';
+    bool first = true;
+    for (size_t i = 0; i < histogram::num_buckets; i++) {
+        if (hist.buckets[i] == 0)
+            continue;
+        fmt::format_to(std::back_inserter(out), "{}{{\"min\":{},\"max\":{},\"count\":{}}}", first ? "" : ",",
+                       histogram::bucket_min(i), histogram::bucket_max(i), hist.buckets[i]);
+        first = false;
+    }
+    out += ']';
+}
+
+static std::string profile_json(const profile& prof)
+{
+    std::string out;
+    auto it = std::back_inserter(out);
+    fmt::format_to(it, "{{\"bytes\":{},\"blocks\":{},\"frames\":{},\"messages\":{{", prof.bytes, prof.blocks,
+                   prof.frames);
+    bool first = true;
+    for (size_t i = 0; i < num_message_types; i++) {
+        if (prof.messages[i].count == 0 && prof.messages[i].bytes == 0)
+            continue;
+        fmt::format_to(it, "{}{}:{{\"count\":{},\"bytes\":{}}}", first ? "" : ",",
+                       json_string(q2proto_svc_message_str(q2proto_svc_message_type_t(i))), prof.messages[i].count,
+                       prof.messages[i].bytes);
+        first = false;
+    }
+    fmt::format_to(it, "}},\"zpackets\":{{\"count\":{},\"bytes\":{},\"inflated_bytes\":{}}}", prof.zpackets.count,
+                   prof.zpackets.bytes, prof.zpacket_inflated_bytes);
+    fmt::format_to(it, ",\"entity_deltas\":{},\"entity_fields\":{{", prof.entity_deltas);
+    for (size_t i = 0; i < NUM_ENTITY_FIELDS; i++)
+        fmt::format_to(it, "{}\"{}\":{}", i == 0 ? "" : ",", entity_field_names[i], prof.entity_fields[i]);
+    out += "},\"entity_field_bytes\":{";
+    for (size_t i = 0; i < NUM_ENTITY_FIELDS; i++)
+        fmt::format_to(it, "{}\"{}\":{}", i == 0 ? "" : ",", entity_field_names[i], prof.entity_field_bytes[i]);
+    out += "},\"player_fields\":{";
+    for (size_t i = 0; i < NUM_PLAYER_FIELDS; i++)
+        fmt::format_to(it, "{}\"{}\":{}", i == 0 ? "" : ",", player_field_names[i], prof.player_fields[i]);
+    out += "},\"player_field_bytes\":{";
+    for (size_t i = 0; i < NUM_PLAYER_FIELDS; i++)
+        fmt::format_to(it, "{}\"{}\":{}", i == 0 ? "" : ",", player_field_names[i], prof.player_field_bytes[i]);
+    out += "},\"stats\":[";
+    for (size_t i = 0; i < Q2PROTO_STATS; i++)
+        fmt::format_to(it, "{}{}", i == 0 ? "" : ",", prof.stats[i]);
+    out += "],\"histograms\":{\"frame_bytes\":";
+    print_json_histogram(out, prof.frame_bytes);
+    out += ",\"entity_delta_bytes\":";
+    print_json_histogram(out, prof.entity_delta_bytes);
+    out += ",\"entity_delta_fields\":";
+    print_json_histogram(out, prof.entity_delta_fields);
+    out += "}}";
+    return out;
+}
+
+static void print_json(const std::vector<demo_result>& results, const profile& total, bool per_demo)
+{
+    fmt::print("{{\"demos\":[");
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto& result = results[i];
+        fmt::print("{}{{\"name\":{},\"ok\":{}", i == 0 ? "" : ",", json_string(result.filename), result.ok);
+        if (per_demo)
+            fmt::print(",\"profile\":{}", profile_json(result.prof));
+        fmt::print("}}");
+    }
+    fmt::println("],\"total\":{}}}", profile_json(total));
+}
+
+int main(int argc, const char* argv[])
+{
+    unsigned num_threads = std::max(1u, std::thread::hardware_concurrency());
+    bool json = false, per_demo = false;
+    std::vector<demo_result> results;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg(argv[i]);
+        if (arg == "-t" && i + 1 < argc)
+            num_threads = unsigned(std::max(1, atoi(argv[++i])));
+        else if (arg == "-j")
+            json = true;
+        else if (arg == "-d")
+            per_demo = true;
+        else
+            results.push_back({argv[i]});
+    }
+    if (results.empty()) {
+        fmt::println(stderr, "Syntax: {} [-t threads] [-j] [-d] demofile...", argv[0]);
+        fmt::println(stderr, "  -t threads  Number of demos to process in parallel. Default: number of cores");
+        fmt::println(stderr, "  -j          Print JSON instead of text");
+        fmt::println(stderr, "  -d          With -j, also print a profile for each demo");
+        return -1;
+    }
+
+    auto start_time = std::chrono::steady_clock::now();
+    profile_demos(results, num_threads);
+    std::chrono::duration<double> profile_time = std::chrono::steady_clock::now() - start_time;
+
+    profile total;
+    size_t num_failed = 0;
+    for (const auto& result : results) {
+        total.merge(result.prof);
+        if (!result.ok)
+            num_failed++;
+    }
+
+    if (json)
+        print_json(results, total, per_demo);
+    else
+        print_text(total);
+    fmt::println(stderr, "{} demos ({} failed), {} bytes, {:.3f} s", results.size(), num_failed, total.bytes,
+                 profile_time.count());
+    return num_failed == 0 ? 0 : -5;
+}
@@ -0,0 +1,496 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/* Server replay harness:
+ * Benchmarks the server write path with recorded data. The entity and player states of a demo
+ * are reconstructed, then replayed like a server would: each frame is packed once per protocol,
+ * and encoded for a number of simulated clients, each delta compressing against the last frame
+ * it acknowledged. Clients can lose frames, so deltas from older frames and full updates occur.
+ * Encode time, bytes out and compression ratio are measured for every frame.
+ * Only the first map of a demo is replayed. Solid values are replayed as recorded. */
+
+#include "democonvert.h"
+#include "demofile.hpp"
+#include "demostate.hpp"
+#include "q2protoio.hpp"
+#include "q2protoio_write.hpp"
+#include "toolutil.hpp"
+
+#include "expected.hpp"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fmt/format.h>
+#include <memory>
+#include <random>
+#include "scope.hpp"
+#include <string_view>
+#include <vector>
+
+// Size of encoding buffers
+static constexpr uint32_t max_msg_len = 0x10000;
+// Number of frames a server keeps per client, for delta compression
+static constexpr size_t update_backup = 16;
+
+/// Frame reconstructed from a demo
+struct recorded_frame
+{
+    int32_t serverframe;
+    democonvert_player_state_t player;
+    int16_t clientnum;
+    std::vector<uint8_t> areabits;
+    /// Range of visible entities in demo_recording::entities
+    size_t first_entity, num_entities;
+};
+
+/// Game state of all frames of a demo, in game representation
+class demo_recording
+{
+    q2proto_clientcontext_t context;
+    bool have_serverdata = false;
+    /// Set when a second map starts
+    bool finished = false;
+
+    nonstd::expected<void, int> handle_message(const q2proto_svc_message_t& msg);
+
+public:
+    q2proto_game_api_t game_api = Q2PROTO_GAME_VANILLA;
+    /// Reconstructed state, with baselines of the replayed map
+    demo_state state;
+    std::vector<recorded_frame> frames;
+    std::vector<demo_frame_entity> entities;
+    uint64_t demo_bytes = 0;
+
+    nonstd::expected<void, int> load(const char* filename);
+};
+
+nonstd::expected<void, int> demo_recording::handle_message(const q2proto_svc_message_t& msg)
+{
+    if (msg.type == Q2P_SVC_SERVERDATA) {
+        if (have_serverdata) {
+            finished = true;
+            return {};
+        }
+        have_serverdata = true;
+        game_api = context.features.server_game_api;
+    }
+    auto result = state.handle_message(context, msg);
+    if (!result)
+        return result;
+
+    // Record completed frames
+    if (msg.type == Q2P_SVC_FRAME_ENTITY_DELTA && msg.frame_entity_delta.newnum == 0) {
+        recorded_frame frame{state.frame.serverframe, state.player, state.clientnum, state.areabits, entities.size(), 0};
+        state.visible.for_each([&](uint16_t entnum) { entities.push_back({entnum, state.entities[entnum]}); });
+        frame.num_entities = entities.size() - frame.first_entity;
+        frames.push_back(std::move(frame));
+    }
+    return {};
+}
+
+nonstd::expected<void, int> demo_recording::load(const char* filename)
+{
+    demo_file_reader file;
+    auto result = file.open(filename);
+    if (!result)
+        return result;
+    if (!check_q2proto_result(q2proto_init_clientcontext(&context), "failed to initialize client context"))
+        return nonstd::make_unexpected(-4);
+
+    while (!finished) {
+        std::span<const std::byte> block;
+        auto block_result = file.read_block(block);
+        if (!block_result)
+            return nonstd::make_unexpected(block_result.error());
+        if (!*block_result)
+            break;
+        demo_bytes += sizeof(uint32_t) + block.size();
+
+        auto io_ctx = io_context(block.data(), uint32_t(block.size()));
+        uintptr_t io_arg = reinterpret_cast<uintptr_t>(&io_ctx);
+
+        q2proto_svc_message_t msg;
+        while (!finished) {
+            auto client_read_result = q2proto_client_read(&context, io_arg, &msg);
+            if (client_read_result == Q2P_ERR_NO_MORE_INPUT)
+                break;
+            else if (!check_q2proto_result(client_read_result, "failed to read message"))
+                return nonstd::make_unexpected(-5);
+            result = handle_message(msg);
+            if (!result)
+                return result;
+        }
+    }
+    if (finished)
+        fmt::println(stderr, "demo contains multiple maps, only replaying the first");
+    return {};
+}
+
+/// Measurements for one frame, over all clients
+struct frame_result
+{
+    uint32_t num_entities = 0;
+    /// Time spent packing the frame
+    uint64_t pack_ns = 0;
+    /// Time spent encoding the frame for all clients
+    uint64_t encode_ns = 0;
+    /// Encoded size before compression
+    uint64_t raw_bytes = 0;
+    /// Encoded size after compression
+    uint64_t out_bytes = 0;
+    /// Number of clients that received a full update
+    uint32_t full_updates = 0;
+};
+
+/// Replays a recording for simulated clients of one protocol
+class replay_encoder
+{
+    /// Frame, as packed by the server
+    struct packed_frame
+    {
+        int32_t serverframe;
+        q2proto_packed_player_state_t player;
+        std::vector<uint16_t> entnums;
+        std::vector<q2proto_packed_entity_state_t> entities;
+    };
+
+    /// Simulated client
+    struct client
+    {
+        q2proto_servercontext_t context;
+        std::minstd_rand rng;
+        /// Index of last acknowledged frame, -1 if none
+        ptrdiff_t acked = -1;
+    };
+
+    const demo_recording& rec;
+    q2proto_protocol_t protocol;
+    bool compress;
+    uint32_t loss_percent;
+    q2proto_server_info_t server_info = {};
+    std::vector<client> clients;
+    std::vector<q2proto_packed_entity_state_t> baselines_packed =
+        std::vector<q2proto_packed_entity_state_t>(Q2PROTO_MAX_ENTITIES);
+    std::array<packed_frame, update_backup> backup;
+
+    write_io_context scratch{max_msg_len};
+    write_io_context out{max_msg_len};
+    q2protoio_deflate_args_t deflate_args{max_msg_len};
+
+    void pack_frame(size_t frame_index);
+    q2proto_error_t write_entity_delta(client& cl, uintptr_t io_arg, uint16_t entnum,
+                                       const q2proto_packed_entity_state_t* from, const q2proto_packed_entity_state_t* to,
+                                       bool write_old_origin);
+    q2proto_error_t write_frame(client& cl, write_io_context& io, size_t frame_index, const packed_frame* from,
+                                const packed_frame& to);
+    q2proto_error_t encode_client(client& cl, size_t frame_index, frame_result& result);
+
+public:
+    std::vector<frame_result> results;
+
+    replay_encoder(const demo_recording& rec, q2proto_protocol_t protocol, bool compress, uint32_t loss_percent)
+        : rec(rec), protocol(protocol), compress(compress), loss_percent(loss_percent)
+    {
+        server_info.game_api = rec.game_api;
+        server_info.default_packet_length = max_msg_len;
+    }
+
+    q2proto_error_t init(size_t num_clients);
+    bool run();
+};
+
+q2proto_error_t replay_encoder::init(size_t num_clients)
+{
+    clients = std::vector<client>(num_clients);
+    for (size_t c = 0; c < clients.size(); c++) {
+        size_t max_len;
+        auto err = q2proto_init_servercontext_demo(&clients[c].context, protocol, &server_info, &max_len);
+        if (err != Q2P_ERR_SUCCESS)
+            return err;
+        clients[c].rng.seed(uint32_t(c + 1));
+    }
+
+    // Packing only depends on the protocol, so any client context will do
+    for (size_t entnum = 0; entnum < Q2PROTO_MAX_ENTITIES; entnum++) {
+        if (rec.state.has_baseline.test(uint16_t(entnum)))
+            democonvert_pack_entity(&clients[0].context, &rec.state.baselines[entnum], &baselines_packed[entnum]);
+    }
+    return Q2P_ERR_SUCCESS;
+}
+
+void replay_encoder::pack_frame(size_t frame_index)
+{
+    const auto& frame = rec.frames[frame_index];
+    auto& packed = backup[frame_index % update_backup];
+    auto* context = &clients[0].context;
+    packed.serverframe = frame.serverframe;
+    democonvert_pack_player(context, &frame.player, &packed.player);
+    packed.entnums.resize(frame.num_entities);
+    packed.entities.resize(frame.num_entities);
+    for (size_t i = 0; i < frame.num_entities; i++) {
+        const auto& entity = rec.entities[frame.first_entity + i];
+        packed.entnums[i] = entity.entnum;
+        democonvert_pack_entity(context, &entity.state, &packed.entities[i]);
+    }
+}
+
+q2proto_error_t replay_encoder::write_entity_delta(client& cl, uintptr_t io_arg, uint16_t entnum,
+                                                   const q2proto_packed_entity_state_t* from,
+                                                   const q2proto_packed_entity_state_t* to, bool write_old_origin)
+{
+    q2proto_svc_message_t message = {.type = Q2P_SVC_FRAME_ENTITY_DELTA, .frame_entity_delta = {}};
+    message.frame_entity_delta.newnum = entnum;
+    if (to)
+        q2proto_server_make_entity_state_delta(&cl.context, from, to, write_old_origin,
+                                               &message.frame_entity_delta.entity_delta);
+    else
+        message.frame_entity_delta.remove = true;
+    return q2proto_server_write(&cl.context, io_arg, &message);
+}
+
+q2proto_error_t replay_encoder::write_frame(client& cl, write_io_context& io, size_t frame_index,
+                                            const packed_frame* from, const packed_frame& to)
+{
+    auto io_arg = reinterpret_cast<uintptr_t>(&io);
+    const auto& frame = rec.frames[frame_index];
+
+    q2proto_svc_message_t message = {.type = Q2P_SVC_FRAME, .frame = {}};
+    message.frame.serverframe = to.serverframe;
+    message.frame.deltaframe = from ? from->serverframe : -1;
+    message.frame.areabits_len = uint8_t(frame.areabits.size());
+    message.frame.areabits = frame.areabits.data();
+    q2proto_server_make_player_state_delta(&cl.context, from ? &from->player : nullptr, &to.player,
+                                           &message.frame.playerstate);
+    if (cl.context.features.playerstate_clientnum && !from) {
+        message.frame.playerstate.delta_bits |= Q2P_PSD_CLIENTNUM;
+        message.frame.playerstate.clientnum = frame.clientnum;
+    }
+    q2proto_error_t err = q2proto_server_write(&cl.context, io_arg, &message);
+    if (err != Q2P_ERR_SUCCESS)
+        return err;
+
+    // Walk old and new entities in entity number order
+    static const packed_frame no_frame = {};
+    const auto& old_frame = from ? *from : no_frame;
+    size_t old_index = 0, new_index = 0;
+    while (old_index < old_frame.entnums.size() || new_index < to.entnums.size()) {
+        uint32_t oldnum = old_index < old_frame.entnums.size() ? old_frame.entnums[old_index] : UINT32_MAX;
+        uint32_t newnum = new_index < to.entnums.size() ? to.entnums[new_index] : UINT32_MAX;
+        if (oldnum == newnum) {
+            const auto& old_state = old_frame.entities[old_index++];
+            const auto& new_state = to.entities[new_index++];
+            if (memcmp(&old_state, &new_state, sizeof(q2proto_packed_entity_state_t)) == 0)
+                continue;
+            err = write_entity_delta(cl, io_arg, uint16_t(newnum), &old_state, &new_state, false);
+        } else if (newnum < oldnum) {
+            // Entity entering the frame: delta against baseline
+            const auto* baseline = rec.state.has_baseline.test(uint16_t(newnum)) ? &baselines_packed[newnum] : nullptr;
+            err = write_entity_delta(cl, io_arg, uint16_t(newnum), baseline, &to.entities[new_index++], true);
+        } else {
+            err = write_entity_delta(cl, io_arg, uint16_t(oldnum), nullptr, nullptr, false);
+            old_index++;
+        }
+        if (err != Q2P_ERR_SUCCESS)
+            return err;
+    }
+
+    q2proto_svc_message_t terminator = {.type = Q2P_SVC_FRAME_ENTITY_DELTA, .frame_entity_delta = {}};
+    return q2proto_server_write(&cl.context, io_arg, &terminator);
+}
+
+q2proto_error_t replay_encoder::encode_client(client& cl, size_t frame_index, frame_result& result)
+{
+    // Delta compress against last acknowledged frame, if still available
+    const packed_frame* from = nullptr;
+    if (cl.acked >= 0 && frame_index - size_t(cl.acked) < update_backup)
+        from = &backup[size_t(cl.acked) % update_backup];
+    else
+        result.full_updates++;
+    const auto& to = backup[frame_index % update_backup];
+
+    out.clear();
+    q2proto_error_t err;
+    if (compress) {
+        scratch.clear();
+        err = write_frame(cl, scratch, frame_index, from, to);
+        if (err != Q2P_ERR_SUCCESS)
+            return err;
+        auto data = scratch.written();
+        result.raw_bytes += data.size();
+        err = q2proto_server_write_zpacket(&cl.context, &deflate_args, reinterpret_cast<uintptr_t>(&out), data.data(),
+                                           data.size());
+        if (err == Q2P_ERR_ALREADY_COMPRESSED || err == Q2P_ERR_DEFLATE_NOT_SUPPORTED) {
+            // Didn't compress well, or compression not supported by protocol: send uncompressed
+            q2protoio_write_raw(reinterpret_cast<uintptr_t>(&out), data.data(), data.size(), nullptr);
+            err = out.err;
+        }
+        if (err != Q2P_ERR_SUCCESS)
+            return err;
+    } else {
+        err = write_frame(cl, out, frame_index, from, to);
+        if (err != Q2P_ERR_SUCCESS)
+            return err;
+        result.raw_bytes += out.size;
+    }
+    result.out_bytes += out.size;
+
+    if (cl.rng() % 100 >= loss_percent)
+        cl.acked = ptrdiff_t(frame_index);
+    return Q2P_ERR_SUCCESS;
+}
+
+bool replay_encoder::run()
+{
+    results.assign(rec.frames.size(), {});
+    for (size_t frame_index = 0; frame_index < rec.frames.size(); frame_index++) {
+        auto& result = results[frame_index];
+        result.num_entities = uint32_t(rec.frames[frame_index].num_entities);
+
+        auto start_time = std::chrono::steady_clock::now();
+        pack_frame(frame_index);
+        auto pack_time = std::chrono::steady_clock::now();
+        for (size_t c = 0; c < clients.size(); c++) {
+            if (!check_q2proto_result(encode_client(clients[c], frame_index, result),
+                                      "client {}, frame {}: encoding failed", c, frame_index))
+                return false;
+        }
+        auto end_time = std::chrono::steady_clock::now();
+        result.pack_ns = uint64_t(std::chrono::nanoseconds(pack_time - start_time).count());
+        result.encode_ns = uint64_t(std::chrono::nanoseconds(end_time - pack_time).count());
+    }
+    return true;
+}
+
+static void print_summary(int netver, size_t num_clients, const std::vector<frame_result>& results)
+{
+    uint64_t pack_ns = 0, encode_ns = 0, raw_bytes = 0, out_bytes = 0, full_updates = 0;
+    std::vector<uint64_t> frame_ns;
+    for (const auto& result : results) {
+        pack_ns += result.pack_ns;
+        encode_ns += result.encode_ns;
+        raw_bytes += result.raw_bytes;
+        out_bytes += result.out_bytes;
+        full_updates += result.full_updates;
+        frame_ns.push_back(result.encode_ns);
+    }
+    std::ranges::sort(frame_ns);
+    auto percentile = [&](size_t p) { return frame_ns.empty() ? 0 : frame_ns[(frame_ns.size() - 1) * p / 100]; };
+    double client_frames = double(std::max<size_t>(results.size() * num_clients, 1));
+
+    fmt::println("protocol {}: {} frames, {} clients", netver, results.size(), num_clients);
+    fmt::println("  pack:   {:.3f} ms, {:.0f} ns per frame", pack_ns / 1e6,
+                 double(pack_ns) / double(std::max<size_t>(results.size(), 1)));
+    fmt::println("  encode: {:.3f} ms, {:.0f} ns per client frame; per frame: p50 {} ns, p99 {} ns, max {} ns",
+                 encode_ns / 1e6, double(encode_ns) / client_frames, percentile(50), percentile(99), percentile(100));
+    fmt::println("  bytes:  {} encoded, {} out ({:.1f}%), {:.1f} bytes per client frame, {} full updates", raw_bytes,
+                 out_bytes, raw_bytes > 0 ? 100.0 * double(out_bytes) / double(raw_bytes) : 100.0,
+                 double(out_bytes) / client_frames, full_updates);
+}
+
+int main(int argc, const char* argv[])
+{
+    std::vector<q2proto_protocol_t> protocols;
+    size_t num_clients = 16;
+    uint32_t loss_percent = 0;
+    bool compress = false;
+    const char* csv_name = nullptr;
+    const char* demo_name = nullptr;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg(argv[i]);
+        if (arg == "-p" && i + 1 < argc) {
+            auto protocol = q2proto_protocol_from_netver(atoi(argv[++i]));
+            if (protocol == Q2P_PROTOCOL_INVALID) {
+                fmt::println(stderr, "unknown protocol {}", argv[i]);
+                return -1;
+            }
+            protocols.push_back(protocol);
+        } else if (arg == "-c" && i + 1 < argc)
+            num_clients = std::max(1, atoi(argv[++i]));
+        else if (arg == "-l" && i + 1 < argc)
+            loss_percent = uint32_t(std::clamp(atoi(argv[++i]), 0, 100));
+        else if (arg == "-z")
+            compress = true;
+        else if (arg == "-o" && i + 1 < argc)
+            csv_name = argv[++i];
+        else
+            demo_name = argv[i];
+    }
+    if (!demo_name) {
+        fmt::println(stderr, "Syntax: {} [-p protocol...] [-c clients] [-l loss] [-z] [-o output] demofile", argv[0]);
+        fmt::println(stderr, "  -p protocol  Protocol number to replay with. Can be given multiple times.");
+        fmt::println(stderr, "               Default: all protocols supporting the game API of the demo");
+        fmt::println(stderr, "  -c clients   Number of simulated clients. Default: 16");
+        fmt::println(stderr, "  -l loss      Percentage of frames lost by each client. Default: 0");
+        fmt::println(stderr, "  -z           Compress frames");
+        fmt::println(stderr, "  -o output    Write measurements of each frame to a CSV file");
+        return -1;
+    }
+
+    demo_recording rec;
+    auto result = rec.load(demo_name);
+    if (!result) {
+        fmt::println(stderr, "failed to read \"{}\"", demo_name);
+        return result.error();
+    }
+    fmt::println("\"{}\": {} bytes, {} frames, {} entity states", demo_name, rec.demo_bytes, rec.frames.size(),
+                 rec.entities.size());
+
+    if (protocols.empty()) {
+        protocols.resize(Q2P_NUM_PROTOCOLS);
+        protocols.resize(q2proto_get_protocols_for_gametypes(protocols.data(), protocols.size(), &rec.game_api, 1));
+        std::ranges::reverse(protocols);
+    }
+
+    FILE* csv_file = nullptr;
+    if (csv_name) {
+        csv_file = fopen(csv_name, "w");
+        if (!csv_file)
+            return print_io_error(errno, "failed to open \"{}\"", csv_name);
+        fmt::println(csv_file, "protocol,frame,serverframe,entities,pack_ns,encode_ns,encoded_bytes,out_bytes,ratio");
+    }
+    auto close_csv = nonstd::make_scope_exit([&] {
+        if (csv_file)
+            fclose(csv_file);
+    });
+
+    for (auto protocol : protocols) {
+        int netver = q2proto_get_protocol_netver(protocol);
+        auto encoder = std::make_unique<replay_encoder>(rec, protocol, compress, loss_percent);
+        auto err = encoder->init(num_clients);
+        if (err == Q2P_ERR_GAMETYPE_UNSUPPORTED) {
+            fmt::println(stderr, "protocol {} doesn't support the game API of the demo, skipped", netver);
+            continue;
+        } else if (!check_q2proto_result(err, "protocol {}: failed to set up server context", netver))
+            return -4;
+        if (!encoder->run())
+            return -6;
+
+        print_summary(netver, num_clients, encoder->results);
+        if (csv_file) {
+            for (size_t i = 0; i < encoder->results.size(); i++) {
+                const auto& r = encoder->results[i];
+                fmt::println(csv_file, "{},{},{},{},{},{},{},{},{:.4f}", netver, i, rec.frames[i].serverframe,
+                             r.num_entities, r.pack_ns, r.encode_ns, r.raw_bytes, r.out_bytes,
+                             r.raw_bytes > 0 ? double(r.out_bytes) / double(r.raw_bytes) : 1.0);
+            }
+        }
+    }
+    return 0;
+}
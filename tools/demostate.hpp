@@ -0,0 +1,442 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/* Reconstruction of game state from demo messages, in the "game" representation
+ * of democonvert.h, shared by the tools that need entity and player states of demo frames. */
+
+#ifndef DEMOSTATE_HPP_
+#define DEMOSTATE_HPP_
+
+#include "democonvert.h"
+
+#include "expected.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <fmt/format.h>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// Number of frames kept for delta decompression, like UPDATE_BACKUP of the original client
+static constexpr size_t demo_update_backup = 16;
+
+static inline void apply_entity_delta(democonvert_entity_state_t& state, const q2proto_entity_state_delta_t& delta)
+{
+    if (delta.delta_bits & Q2P_ESD_MODELINDEX)
+        state.modelindex = delta.modelindex;
+    if (delta.delta_bits & Q2P_ESD_MODELINDEX2)
+        state.modelindex2 = delta.modelindex2;
+    if (delta.delta_bits & Q2P_ESD_MODELINDEX3)
+        state.modelindex3 = delta.modelindex3;
+    if (delta.delta_bits & Q2P_ESD_MODELINDEX4)
+        state.modelindex4 = delta.modelindex4;
+    if (delta.delta_bits & Q2P_ESD_FRAME)
+        state.frame = delta.frame;
+    if (delta.delta_bits & Q2P_ESD_SKINNUM)
+        state.skinnum = delta.skinnum;
+    if (delta.delta_bits & Q2P_ESD_EFFECTS)
+        state.effects = (state.effects & ~0xffffffffull) | delta.effects;
+    if (delta.delta_bits & Q2P_ESD_EFFECTS_MORE)
+        state.effects = (state.effects & 0xffffffffull) | (uint64_t(delta.effects_more) << 32);
+    if (delta.delta_bits & Q2P_ESD_RENDERFX)
+        state.renderfx = delta.renderfx;
+    q2proto_maybe_read_diff_apply_float(&delta.origin, state.origin);
+    for (int c = 0; c < 3; c++) {
+        if (delta.angle.delta_bits & (1 << c))
+            state.angles[c] = q2proto_var_angles_get_float_comp(&delta.angle.values, c);
+    }
+    if (delta.delta_bits & Q2P_ESD_OLD_ORIGIN) {
+        for (int c = 0; c < 3; c++)
+            state.old_origin[c] = q2proto_var_coords_get_float_comp(&delta.old_origin, c);
+    }
+    if (delta.delta_bits & Q2P_ESD_SOUND)
+        state.sound = delta.sound;
+    if (delta.delta_bits & Q2P_ESD_LOOP_VOLUME)
+        state.loop_volume = delta.loop_volume / 255.f;
+    if (delta.delta_bits & Q2P_ESD_LOOP_ATTENUATION)
+        state.loop_attenuation = q2proto_sound_decode_loop_attenuation(delta.loop_attenuation);
+    // Events only last a single frame
+    state.event = (delta.delta_bits & Q2P_ESD_EVENT) ? delta.event : 0;
+    if (delta.delta_bits & Q2P_ESD_SOLID)
+        state.solid = delta.solid;
+    if (delta.delta_bits & Q2P_ESD_ALPHA)
+        state.alpha = delta.alpha / 255.f;
+    if (delta.delta_bits & Q2P_ESD_SCALE)
+        state.scale = delta.scale / 16.f;
+}
+
+static inline void apply_player_delta(democonvert_player_state_t& state, const q2proto_svc_playerstate_t& delta)
+{
+    if (delta.delta_bits & Q2P_PSD_PM_TYPE)
+        state.pmove.pm_type = delta.pm_type;
+    q2proto_maybe_read_diff_apply_float(&delta.pm_origin, state.pmove.origin);
+    q2proto_maybe_read_diff_apply_float(&delta.pm_velocity, state.pmove.velocity);
+    if (delta.delta_bits & Q2P_PSD_PM_TIME)
+        state.pmove.pm_time = delta.pm_time;
+    if (delta.delta_bits & Q2P_PSD_PM_FLAGS)
+        state.pmove.pm_flags = delta.pm_flags;
+    if (delta.delta_bits & Q2P_PSD_PM_GRAVITY)
+        state.pmove.gravity = delta.pm_gravity;
+    if (delta.delta_bits & Q2P_PSD_PM_DELTA_ANGLES)
+        q2proto_var_angles_get_float(&delta.pm_delta_angles, state.pmove.delta_angles);
+    if (delta.delta_bits & Q2P_PSD_PM_VIEWHEIGHT)
+        state.pmove.viewheight = delta.pm_viewheight;
+    if (delta.delta_bits & Q2P_PSD_VIEWOFFSET)
+        q2proto_var_small_offsets_get_float(&delta.viewoffset, state.viewoffset);
+    if (delta.delta_bits & Q2P_PSD_KICKANGLES)
+        q2proto_var_small_angles_get_float(&delta.kick_angles, state.kick_angles);
+    for (int c = 0; c < 3; c++) {
+        if (delta.viewangles.delta_bits & (1 << c))
+            state.viewangles[c] = q2proto_var_angles_get_float_comp(&delta.viewangles.values, c);
+        if (delta.gunoffset.delta_bits & (1 << c))
+            state.gunoffset[c] = q2proto_var_small_offsets_get_float_comp(&delta.gunoffset.values, c);
+        if (delta.gunangles.delta_bits & (1 << c))
+            state.gunangles[c] = q2proto_var_small_angles_get_float_comp(&delta.gunangles.values, c);
+    }
+    if (delta.delta_bits & Q2P_PSD_GUNINDEX)
+        state.gunindex = delta.gunindex;
+    if (delta.delta_bits & Q2P_PSD_GUNSKIN)
+        state.gunskin = delta.gunskin;
+    if (delta.delta_bits & Q2P_PSD_GUNFRAME)
+        state.gunframe = delta.gunframe;
+    for (int c = 0; c < 4; c++) {
+        if (delta.blend.delta_bits & (1 << c))
+            state.blend[c] = q2proto_var_color_get_float_comp(&delta.blend.values, c);
+        if (delta.damage_blend.delta_bits & (1 << c))
+            state.damage_blend[c] = q2proto_var_color_get_float_comp(&delta.damage_blend.values, c);
+    }
+    if (delta.delta_bits & Q2P_PSD_FOV)
+        state.fov = delta.fov;
+    if (delta.delta_bits & Q2P_PSD_RDFLAGS)
+        state.rdflags = delta.rdflags;
+    for (int i = 0; i < Q2PROTO_STATS; i++) {
+        if (delta.statbits & (1ull << i))
+            state.stats[i] = delta.stats[i];
+    }
+    if (delta.delta_bits & Q2P_PSD_GUNRATE)
+        state.gunrate = delta.gunrate;
+
+    const auto& fog = delta.fog;
+    if (fog.flags & Q2P_FOG_DENSITY_SKYFACTOR) {
+        state.fog.density = q2proto_var_fraction_get_float(&fog.global.density);
+        state.fog.sky_factor = q2proto_var_fraction_get_float(&fog.global.skyfactor);
+    }
+    if (fog.flags & Q2P_HEIGHTFOG_FALLOFF)
+        state.heightfog.falloff = q2proto_var_fraction_get_float(&fog.height.falloff);
+    if (fog.flags & Q2P_HEIGHTFOG_DENSITY)
+        state.heightfog.density = q2proto_var_fraction_get_float(&fog.height.density);
+    if (fog.flags & Q2P_HEIGHTFOG_START_DIST)
+        state.heightfog.start_dist = q2proto_var_coord_get_float(&fog.height.start_dist);
+    if (fog.flags & Q2P_HEIGHTFOG_END_DIST)
+        state.heightfog.end_dist = q2proto_var_coord_get_float(&fog.height.end_dist);
+    for (int c = 0; c < 3; c++) {
+        if (fog.global.color.delta_bits & (1 << c))
+            state.fog.color[c] = q2proto_var_color_get_float_comp(&fog.global.color.values, c);
+        if (fog.height.start_color.delta_bits & (1 << c))
+            state.heightfog.start_color[c] = q2proto_var_color_get_float_comp(&fog.height.start_color.values, c);
+        if (fog.height.end_color.delta_bits & (1 << c))
+            state.heightfog.end_color[c] = q2proto_var_color_get_float_comp(&fog.height.end_color.values, c);
+    }
+}
+
+/// Set of entity numbers
+class entity_set
+{
+    std::array<uint64_t, Q2PROTO_MAX_ENTITIES / 64> words = {};
+
+public:
+    void clear() { words = {}; }
+    bool test(uint16_t entnum) const { return (words[entnum / 64] & (1ull << (entnum % 64))) != 0; }
+    void set(uint16_t entnum, bool value)
+    {
+        if (value)
+            words[entnum / 64] |= 1ull << (entnum % 64);
+        else
+            words[entnum / 64] &= ~(1ull << (entnum % 64));
+    }
+
+    /// Call \a func for each contained entity number, in ascending order
+    template<typename Func>
+    void for_each(Func&& func) const
+    {
+        for_each_union(*this, *this, std::forward<Func>(func));
+    }
+
+    /// Call \a func for each entity number contained in either \a a or \a b, in ascending order
+    template<typename Func>
+    static void for_each_union(const entity_set& a, const entity_set& b, Func&& func)
+    {
+        for (size_t w = 0; w < a.words.size(); w++) {
+            uint64_t bits = a.words[w] | b.words[w];
+            while (bits != 0) {
+                int bit = std::countr_zero(bits);
+                bits &= bits - 1;
+                func(uint16_t(w * 64 + bit));
+            }
+        }
+    }
+};
+
+/// Visible entity of a frame
+struct demo_frame_entity
+{
+    uint16_t entnum;
+    democonvert_entity_state_t state;
+};
+
+/// Frame, as kept for delta decompression
+struct demo_frame
+{
+    /// Server frame number, -1 if unused
+    int32_t serverframe = -1;
+    democonvert_player_state_t player = {};
+    int16_t clientnum = 0;
+    std::vector<uint8_t> areabits;
+    /// Visible entities, in ascending order
+    std::vector<demo_frame_entity> entities;
+};
+
+/**
+ * Game state, as reconstructed from demo messages.
+ * Like a client, the last demo_update_backup frames are kept, and each frame is delta decompressed
+ * against the frame it names as delta frame. Solid values are kept in the encoding of the demo protocol.
+ */
+class demo_state
+{
+    /// Entities with an event in the current frame
+    std::vector<uint16_t> with_event;
+    /// Entities changed since the last clear_changed()
+    std::vector<uint16_t> changed_entities;
+    entity_set is_changed;
+
+    void mark_changed(uint16_t entnum)
+    {
+        if (is_changed.test(entnum))
+            return;
+        is_changed.set(entnum, true);
+        changed_entities.push_back(entnum);
+    }
+
+    void reset(const q2proto_clientcontext_t& context, const q2proto_svc_serverdata_t& serverdata)
+    {
+        configstrings.clear();
+        std::ranges::fill(baselines, democonvert_entity_state_t{});
+        has_baseline.clear();
+        for (auto& recent_frame : recent_frames)
+            recent_frame = {};
+        frame = {};
+        frame_complete = false;
+        areabits.clear();
+        visible.clear();
+        player = {};
+        player.num_stats = context.features.server_game_api >= Q2PROTO_GAME_Q2PRO_EXTENDED_V2 ? Q2PROTO_STATS : 32;
+        clientnum = serverdata.clientnum;
+        with_event.clear();
+        clear_changed();
+    }
+
+    /// Make \a from the current frame, with events cleared, as a frame delta compressed against it starts
+    void restore_frame(const demo_frame& from)
+    {
+        visible.for_each([&](uint16_t entnum) { mark_changed(entnum); });
+        visible.clear();
+        for (const auto& [entnum, state] : from.entities) {
+            entities[entnum] = state;
+            entities[entnum].event = 0;
+            visible.set(entnum, true);
+            mark_changed(entnum);
+        }
+        with_event.clear();
+        player = from.player;
+        clientnum = from.clientnum;
+    }
+
+    nonstd::expected<void, int> begin_frame(const q2proto_svc_frame_t& new_frame)
+    {
+        num_frames++;
+        if (new_frame.deltaframe < 0) {
+            visible.for_each([&](uint16_t entnum) { mark_changed(entnum); });
+            visible.clear();
+            with_event.clear();
+            auto num_stats = player.num_stats;
+            player = {};
+            player.num_stats = num_stats;
+        } else if (frame_complete && new_frame.deltaframe == frame.serverframe) {
+            // Delta against the current frame: only events need to be cleared
+            for (auto entnum : with_event) {
+                if (entities[entnum].event != 0) {
+                    entities[entnum].event = 0;
+                    mark_changed(entnum);
+                }
+            }
+            with_event.clear();
+        } else {
+            const auto* from = find_frame(new_frame.deltaframe);
+            if (!from) {
+                fmt::println(stderr, "frame {}: delta frame {} is not available", new_frame.serverframe,
+                             new_frame.deltaframe);
+                return nonstd::make_unexpected(-10);
+            }
+            restore_frame(*from);
+        }
+
+        frame = new_frame;
+        frame.areabits = nullptr;
+        frame.areabits_len = 0;
+        frame.playerstate = {};
+        frame_complete = false;
+        areabits.assign(static_cast<const uint8_t*>(new_frame.areabits),
+                        static_cast<const uint8_t*>(new_frame.areabits) + new_frame.areabits_len);
+        apply_player_delta(player, new_frame.playerstate);
+        if (new_frame.playerstate.delta_bits & Q2P_PSD_CLIENTNUM)
+            clientnum = new_frame.playerstate.clientnum;
+        return {};
+    }
+
+    void handle_entity_delta(const q2proto_svc_frame_entity_delta_t& delta)
+    {
+        auto entnum = delta.newnum;
+        mark_changed(entnum);
+        if (delta.remove) {
+            visible.set(entnum, false);
+            return;
+        }
+        auto& state = entities[entnum];
+        // Entity entering the frame: delta is against baseline
+        if (!visible.test(entnum)) {
+            state = baselines[entnum];
+            visible.set(entnum, true);
+        }
+        apply_entity_delta(state, delta.entity_delta);
+        if (state.event != 0)
+            with_event.push_back(entnum);
+    }
+
+    /// Keep the completed frame for delta decompression of later frames
+    void end_frame()
+    {
+        frame_complete = true;
+        auto& recent_frame = recent_frames[size_t(frame.serverframe) % demo_update_backup];
+        recent_frame.serverframe = frame.serverframe;
+        recent_frame.player = player;
+        recent_frame.clientnum = clientnum;
+        recent_frame.areabits = areabits;
+        recent_frame.entities.clear();
+        visible.for_each([&](uint16_t entnum) { recent_frame.entities.push_back({entnum, entities[entnum]}); });
+    }
+
+public:
+    std::map<uint16_t, std::string> configstrings;
+    std::vector<democonvert_entity_state_t> baselines = std::vector<democonvert_entity_state_t>(Q2PROTO_MAX_ENTITIES);
+    entity_set has_baseline;
+
+    /// Last demo_update_backup frames, indexed by server frame number modulo demo_update_backup
+    std::array<demo_frame, demo_update_backup> recent_frames;
+
+    /**\name Current frame
+     * @{ */
+    /// Number of frames decoded so far
+    uint32_t num_frames = 0;
+    /// Last frame message. Player state delta and area bits are not valid.
+    q2proto_svc_frame_t frame = {};
+    /// Whether all entity deltas of the current frame were read
+    bool frame_complete = false;
+    std::vector<uint8_t> areabits;
+    std::vector<democonvert_entity_state_t> entities = std::vector<democonvert_entity_state_t>(Q2PROTO_MAX_ENTITIES);
+    entity_set visible;
+    democonvert_player_state_t player = {};
+    int16_t clientnum = 0;
+    /** @} */
+
+    /**
+     * Update state from a message read with \a context.
+     * Fails if a frame is delta compressed against a frame that is not available.
+     */
+    nonstd::expected<void, int> handle_message(const q2proto_clientcontext_t& context, const q2proto_svc_message_t& msg)
+    {
+        switch (msg.type) {
+        case Q2P_SVC_SERVERDATA:
+            reset(context, msg.serverdata);
+            break;
+        case Q2P_SVC_CONFIGSTRING:
+            configstrings[msg.configstring.index] = std::string(msg.configstring.value.str, msg.configstring.value.len);
+            break;
+        case Q2P_SVC_SPAWNBASELINE:
+            {
+                auto& baseline = baselines[msg.spawnbaseline.entnum];
+                baseline = {};
+                apply_entity_delta(baseline, msg.spawnbaseline.delta_state);
+                baseline.event = 0;
+                has_baseline.set(msg.spawnbaseline.entnum, true);
+            }
+            break;
+        case Q2P_SVC_FRAME:
+            return begin_frame(msg.frame);
+        case Q2P_SVC_FRAME_ENTITY_DELTA:
+            if (msg.frame_entity_delta.newnum == 0)
+                end_frame();
+            else
+                handle_entity_delta(msg.frame_entity_delta);
+            break;
+        default:
+            break;
+        }
+        return {};
+    }
+
+    /// Kept frame \a serverframe, or \c nullptr if it is not available
+    const demo_frame* find_frame(int32_t serverframe) const
+    {
+        if (serverframe < 0)
+            return nullptr;
+        const auto& recent_frame = recent_frames[size_t(serverframe) % demo_update_backup];
+        return recent_frame.serverframe == serverframe ? &recent_frame : nullptr;
+    }
+
+    /// Make the kept frame \a serverframe the current frame. Returns \c false if it is not available.
+    bool select_frame(int32_t serverframe)
+    {
+        const auto* recent_frame = find_frame(serverframe);
+        if (!recent_frame)
+            return false;
+        restore_frame(*recent_frame);
+        // Restore events, too
+        for (const auto& [entnum, state] : recent_frame->entities) {
+            entities[entnum].event = state.event;
+            if (state.event != 0)
+                with_event.push_back(entnum);
+        }
+        frame.serverframe = serverframe;
+        frame_complete = true;
+        areabits = recent_frame->areabits;
+        return true;
+    }
+
+    /// Entities whose state or visibility changed since the last call to clear_changed()
+    const std::vector<uint16_t>& changed() const { return changed_entities; }
+    void clear_changed()
+    {
+        for (auto entnum : changed_entities)
+            is_changed.set(entnum, false);
+        changed_entities.clear();
+    }
+};
+
+#endif // DEMOSTATE_HPP_
@@ -0,0 +1,443 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/* Parallel frame encoder:
+ * Reference for encoding the frames of all clients concurrently. Each worker thread owns a work queue of
+ * clients, plus its own scratch buffer and deflate arguments; idle workers steal clients from other queues.
+ * Frames of a synthetic world are encoded with increasing thread counts to show how throughput scales. */
+
+#include "q2protoio_write.hpp"
+#include "toolutil.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <fmt/format.h>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Size of encoding buffers
+static constexpr uint32_t max_msg_len = 0x10000;
+
+// Synthetic world: entity and player states for all frames
+struct world
+{
+    size_t num_frames;
+    size_t num_entities;
+    size_t num_clients;
+    std::vector<q2proto_packed_entity_state_t> entities;
+    std::vector<q2proto_packed_player_state_t> players;
+
+    world(size_t num_frames, size_t num_entities, size_t num_clients);
+
+    const q2proto_packed_entity_state_t& entity(size_t frame, size_t entnum) const
+    {
+        return entities[frame * num_entities + entnum];
+    }
+    const q2proto_packed_player_state_t& player(size_t frame, size_t client) const
+    {
+        return players[frame * num_clients + client];
+    }
+    // Which entities a client sees. Changes over time, so entities enter and leave frames
+    bool visible(size_t frame, size_t client, size_t entnum) const { return (entnum + client + frame / 10) % 3 != 0; }
+};
+
+world::world(size_t num_frames, size_t num_entities, size_t num_clients)
+    : num_frames(num_frames), num_entities(num_entities), num_clients(num_clients), entities(num_frames * num_entities),
+      players(num_frames * num_clients)
+{
+    std::mt19937 rng(42);
+    auto random = [&](int32_t min, int32_t max) { return std::uniform_int_distribution<int32_t>(min, max)(rng); };
+    auto chance = [&](int one_in) { return random(0, one_in - 1) == 0; };
+
+    for (size_t frame = 0; frame < num_frames; frame++) {
+        for (size_t e = 0; e < num_entities; e++) {
+            auto& ent = entities[frame * num_entities + e];
+            if (frame == 0 || chance(32)) {
+                ent = {};
+                ent.modelindex = random(1, 255);
+                ent.skinnum = random(0, 15);
+                ent.effects = random(0, 0xffff);
+                ent.renderfx = random(0, 0xffff);
+                ent.sound = chance(4) ? random(1, 255) : 0;
+                ent.solid = random(0, 0xffff);
+            } else
+                ent = entities[(frame - 1) * num_entities + e];
+            std::ranges::copy(ent.origin, ent.old_origin);
+            for (int c = 0; c < 3; c++) {
+                // Most entities move a bit, some turn
+                if (chance(2))
+                    ent.origin[c] += random(-64, 64);
+                if (chance(8))
+                    ent.angles[c] = random(0, 65535);
+            }
+            ent.frame = (ent.frame + 1) % 200;
+            ent.event = chance(16) ? random(1, 8) : 0;
+        }
+
+        for (size_t c = 0; c < num_clients; c++) {
+            auto& ps = players[frame * num_clients + c];
+            if (frame == 0) {
+                ps = {};
+                ps.pm_gravity = 800;
+                ps.gunindex = random(1, 255);
+                ps.fov = 90;
+            } else
+                ps = players[(frame - 1) * num_clients + c];
+            for (int i = 0; i < 3; i++) {
+                ps.pm_velocity[i] = random(-2048, 2047);
+                ps.pm_origin[i] += ps.pm_velocity[i] / 8;
+                if (chance(2))
+                    ps.viewangles[i] = random(-32768, 32767);
+            }
+            ps.gunframe = (ps.gunframe + 1) % 100;
+            if (chance(8))
+                ps.stats[random(0, 31)] = random(-32768, 32767);
+        }
+    }
+}
+
+// Per-client state
+struct client
+{
+    q2proto_servercontext_t context;
+    // Output of last encoded frame
+    write_io_context io{max_msg_len};
+    // Totals over all frames
+    uint64_t total_bytes = 0;
+    uint32_t hash = 2166136261u;
+};
+
+// Work queue of a worker. Lock-based; contention is low as stealing only happens once a worker runs dry.
+class work_queue
+{
+    std::mutex mutex;
+    std::deque<size_t> items;
+
+public:
+    void push(size_t item)
+    {
+        std::lock_guard lock(mutex);
+        items.push_back(item);
+    }
+    // Take work from own queue
+    std::optional<size_t> pop()
+    {
+        std::lock_guard lock(mutex);
+        if (items.empty())
+            return std::nullopt;
+        auto item = items.back();
+        items.pop_back();
+        return item;
+    }
+    // Take work from another worker's queue
+    std::optional<size_t> steal()
+    {
+        std::lock_guard lock(mutex);
+        if (items.empty())
+            return std::nullopt;
+        auto item = items.front();
+        items.pop_front();
+        return item;
+    }
+};
+
+// Per-thread state. Nothing in here is shared with other threads, except the work queue
+struct worker
+{
+    work_queue queue;
+    // Uncompressed frame
+    write_io_context scratch{max_msg_len};
+    // Deflate state of this thread
+    q2protoio_deflate_args_t deflate_args{max_msg_len};
+    uint64_t num_stolen = 0;
+};
+
+class parallel_encoder
+{
+    const world& w;
+    q2proto_server_info_t server_info = {};
+    q2proto_protocol_t protocol;
+    bool compress;
+    std::vector<client> clients;
+    std::vector<std::unique_ptr<worker>> workers;
+    std::atomic<bool> failed = false;
+
+    std::optional<size_t> next_work(size_t worker_index);
+    q2proto_error_t write_frame(client& cl, write_io_context& io, size_t client_index, size_t frame);
+    void encode_client(worker& wk, size_t client_index, size_t frame);
+
+public:
+    parallel_encoder(const world& w, q2proto_game_api_t game_api, q2proto_protocol_t protocol, bool compress)
+        : w(w), protocol(protocol), compress(compress), clients(w.num_clients)
+    {
+        server_info.game_api = game_api;
+        server_info.default_packet_length = max_msg_len;
+    }
+
+    bool run(size_t num_threads);
+    uint64_t total_bytes() const;
+    uint32_t hash() const;
+    uint64_t num_stolen() const;
+};
+
+std::optional<size_t> parallel_encoder::next_work(size_t worker_index)
+{
+    if (auto item = workers[worker_index]->queue.pop())
+        return item;
+    for (size_t i = 1; i < workers.size(); i++) {
+        if (auto item = workers[(worker_index + i) % workers.size()]->queue.steal()) {
+            workers[worker_index]->num_stolen++;
+            return item;
+        }
+    }
+    return std::nullopt;
+}
+
+q2proto_error_t parallel_encoder::write_frame(client& cl, write_io_context& io, size_t client_index, size_t frame)
+{
+    auto io_arg = reinterpret_cast<uintptr_t>(&io);
+
+    q2proto_svc_message_t message = {.type = Q2P_SVC_FRAME, .frame = {}};
+    message.frame.serverframe = int32_t(frame);
+    message.frame.deltaframe = int32_t(frame) - 1;
+    q2proto_server_make_player_state_delta(&cl.context, frame > 0 ? &w.player(frame - 1, client_index) : nullptr,
+                                           &w.player(frame, client_index), &message.frame.playerstate);
+    q2proto_error_t err = q2proto_server_write(&cl.context, io_arg, &message);
+    if (err != Q2P_ERR_SUCCESS)
+        return err;
+
+    // Entity 0 is never sent
+    for (size_t entnum = 1; entnum < w.num_entities; entnum++) {
+        bool old_visible = frame > 0 && w.visible(frame - 1, client_index, entnum);
+        bool new_visible = w.visible(frame, client_index, entnum);
+        if (!old_visible && !new_visible)
+            continue;
+        q2proto_svc_message_t entity_message = {.type = Q2P_SVC_FRAME_ENTITY_DELTA, .frame_entity_delta = {}};
+        entity_message.frame_entity_delta.newnum = uint16_t(entnum);
+        if (new_visible)
+            q2proto_server_make_entity_state_delta(&cl.context, old_visible ? &w.entity(frame - 1, entnum) : nullptr,
+                                                   &w.entity(frame, entnum), !old_visible,
+                                                   &entity_message.frame_entity_delta.entity_delta);
+        else
+            entity_message.frame_entity_delta.remove = true;
+        err = q2proto_server_write(&cl.context, io_arg, &entity_message);
+        if (err != Q2P_ERR_SUCCESS)
+            return err;
+    }
+
+    q2proto_svc_message_t terminator = {.type = Q2P_SVC_FRAME_ENTITY_DELTA, .frame_entity_delta = {}};
+    return q2proto_server_write(&cl.context, io_arg, &terminator);
+}
+
+void parallel_encoder::encode_client(worker& wk, size_t client_index, size_t frame)
+{
+    auto& cl = clients[client_index];
+    cl.io.clear();
+    q2proto_error_t err;
+    if (compress) {
+        wk.scratch.clear();
+        err = write_frame(cl, wk.scratch, client_index, frame);
+        if (err == Q2P_ERR_SUCCESS) {
+            auto data = wk.scratch.written();
+            err = q2proto_server_write_zpacket(&cl.context, &wk.deflate_args, reinterpret_cast<uintptr_t>(&cl.io),
+                                               data.data(), data.size());
+            if (err == Q2P_ERR_ALREADY_COMPRESSED || err == Q2P_ERR_DEFLATE_NOT_SUPPORTED) {
+                // Didn't compress well, or compression not supported by protocol: send uncompressed
+                q2protoio_write_raw(reinterpret_cast<uintptr_t>(&cl.io), data.data(), data.size(), nullptr);
+                err = cl.io.err;
+            }
+        }
+    } else
+        err = write_frame(cl, cl.io, client_index, frame);
+    if (err != Q2P_ERR_SUCCESS) {
+        // Only report the first failure
+        if (!failed.exchange(true))
+            check_q2proto_result(err, "client {}, frame {}: encoding failed", client_index, frame);
+        return;
+    }
+
+    auto output = cl.io.written();
+    cl.total_bytes += output.size();
+    // FNV-1a
+    for (auto b : output) {
+        cl.hash ^= uint8_t(b);
+        cl.hash *= 16777619u;
+    }
+}
+
+bool parallel_encoder::run(size_t num_threads)
+{
+    failed = false;
+    for (size_t c = 0; c < clients.size(); c++) {
+        auto& cl = clients[c];
+        size_t max_len;
+        if (!check_q2proto_result(q2proto_init_servercontext_demo(&cl.context, protocol, &server_info, &max_len),
+                                  "failed to set up server context"))
+            return false;
+        cl.total_bytes = 0;
+        cl.hash = 2166136261u;
+    }
+
+    workers.clear();
+    for (size_t t = 0; t < num_threads; t++)
+        workers.push_back(std::make_unique<worker>());
+
+    /* Frame loop: all workers encode their share of clients for a frame.
+     * The barrier completion function distributes the clients of the next frame. */
+    size_t frame = 0;
+    auto distribute = [&]() noexcept {
+        for (size_t c = 0; c < clients.size(); c++)
+            workers[c % workers.size()]->queue.push(c);
+    };
+    auto next_frame = [&]() noexcept {
+        if (++frame < w.num_frames && !failed)
+            distribute();
+    };
+    std::barrier frame_barrier(ptrdiff_t(num_threads), next_frame);
+
+    auto work = [&](size_t worker_index) {
+        while (frame < w.num_frames && !failed) {
+            while (auto client_index = next_work(worker_index))
+                encode_client(*workers[worker_index], *client_index, frame);
+            frame_barrier.arrive_and_wait();
+        }
+    };
+
+    distribute();
+    std::vector<std::jthread> threads;
+    for (size_t t = 1; t < num_threads; t++)
+        threads.emplace_back(work, t);
+    work(0);
+    threads.clear();
+
+    return !failed;
+}
+
+uint64_t parallel_encoder::total_bytes() const
+{
+    uint64_t total = 0;
+    for (const auto& cl : clients)
+        total += cl.total_bytes;
+    return total;
+}
+
+uint32_t parallel_encoder::hash() const
+{
+    uint32_t hash = 0;
+    for (const auto& cl : clients)
+        hash = hash * 31 + cl.hash;
+    return hash;
+}
+
+uint64_t parallel_encoder::num_stolen() const
+{
+    uint64_t total = 0;
+    for (const auto& wk : workers)
+        total += wk->num_stolen;
+    return total;
+}
+
+int main(int argc, const char* argv[])
+{
+    q2proto_protocol_t protocol = Q2P_PROTOCOL_Q2PRO;
+    size_t num_clients = 64, num_entities = 256, num_frames = 200;
+    size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    bool compress = false;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg(argv[i]);
+        if (arg == "-p" && i + 1 < argc) {
+            protocol = q2proto_protocol_from_netver(atoi(argv[++i]));
+            if (protocol == Q2P_PROTOCOL_INVALID) {
+                fmt::println(stderr, "unknown protocol {}", argv[i]);
+                return -1;
+            }
+        } else if (arg == "-c" && i + 1 < argc)
+            num_clients = std::max(1, atoi(argv[++i]));
+        else if (arg == "-e" && i + 1 < argc)
+            num_entities = std::clamp(atoi(argv[++i]), 1, Q2PROTO_MAX_ENTITIES);
+        else if (arg == "-f" && i + 1 < argc)
+            num_frames = std::max(1, atoi(argv[++i]));
+        else if (arg == "-t" && i + 1 < argc)
+            max_threads = std::max(1, atoi(argv[++i]));
+        else if (arg == "-z")
+            compress = true;
+        else {
+            fmt::println(stderr, "Syntax: {} [-p protocol] [-c clients] [-e entities] [-f frames] [-t threads] [-z]",
+                         argv[0]);
+            fmt::println(stderr, "  -p protocol  Protocol number to encode for. Default: Q2PRO");
+            fmt::println(stderr, "  -c clients   Number of clients. Default: 64");
+            fmt::println(stderr, "  -e entities  Number of entities. Default: 256");
+            fmt::println(stderr, "  -f frames    Number of frames. Default: 200");
+            fmt::println(stderr, "  -t threads   Maximum number of threads. Default: number of cores");
+            fmt::println(stderr, "  -z           Compress frames (requires protocol with zpacket support)");
+            return -1;
+        }
+    }
+
+    auto game_api = most_capable_game_api(protocol);
+    if (!game_api) {
+        fmt::println(stderr, "protocol not supported");
+        return -1;
+    }
+
+    world w(num_frames, num_entities, num_clients);
+    parallel_encoder encoder(w, *game_api, protocol, compress);
+
+    fmt::println("{} clients, {} entities, {} frames{}", num_clients, num_entities, num_frames,
+                 compress ? ", compressed" : "");
+    fmt::println("{:>8} {:>16} {:>10} {:>8} {:>8}", "threads", "client frames/s", "MB/s", "speedup", "stolen");
+
+    double base_rate = 0;
+    std::optional<uint32_t> reference_hash;
+    std::vector<size_t> thread_counts;
+    for (size_t t = 1; t < max_threads; t *= 2)
+        thread_counts.push_back(t);
+    thread_counts.push_back(max_threads);
+    for (auto num_threads : thread_counts) {
+        auto start = std::chrono::steady_clock::now();
+        if (!encoder.run(num_threads))
+            return -2;
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        // Output must not depend on the number of threads
+        if (!reference_hash)
+            reference_hash = encoder.hash();
+        else if (*reference_hash != encoder.hash()) {
+            fmt::println(stderr, "output with {} threads differs from single-threaded output", num_threads);
+            return -3;
+        }
+
+        double rate = double(num_clients * num_frames) / elapsed.count();
+        if (base_rate == 0)
+            base_rate = rate;
+        fmt::println("{:>8} {:>16.0f} {:>10.2f} {:>7.2f}x {:>8}", num_threads, rate,
+                     double(encoder.total_bytes()) / elapsed.count() / (1024 * 1024), rate / base_rate,
+                     encoder.num_stolen());
+    }
+
+    return 0;
+}
@@ -16,6 +16,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 
+#include "q2protodbg.hpp"
 #include "q2protoio.hpp"
 
 #include "q2proto/q2proto.h"
@@ -24,10 +25,15 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <cstdio>
 #include <fmt/format.h>
 
-extern "C" bool q2protodbg_shownet_check(uintptr_t io_arg, int level) { return true; }
+bool q2protodbg_shownet_enabled = true;
+
+extern "C" bool q2protodbg_shownet_check(uintptr_t io_arg, int level) { return q2protodbg_shownet_enabled; }
 
 extern "C" void q2protodbg_shownet(uintptr_t io_arg, int level, int offset, const char *msg, ...)
 {
+    if (!q2protodbg_shownet_enabled)
+        return;
+
     auto *io_ctx = reinterpret_cast<const io_context *>(io_arg);
 
     char buf[256];
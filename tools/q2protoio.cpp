@@ -130,18 +130,19 @@ static inline void q2p_inflate_deflate_error(const char* message, int z_error)
 
 struct inflate_io_context : public io_context
 {
+    /// Context the compressed data is read from
+    io_context *parent;
     z_stream z = {};
     std::byte buffer[0x10000];
     bool stream_end = false;
 
-    inflate_io_context() : io_context(buffer, 0) {}
+    explicit inflate_io_context(io_context *parent) : io_context(buffer, 0), parent(parent) {}
     bool is_inflate() const override { return true; }
 };
 
 extern "C" {
 #define Q2PROTO_INFLATE_IMPL_HELPER_API static inline
 
-// #include "q2proto/q2proto_deflate_impl_helper.inc"
 #include "q2proto/q2proto_inflate_impl_helper.inc"
 } // extern "C"
 
@@ -151,8 +152,10 @@ extern "C" q2proto_error_t q2protoio_inflate_begin(uintptr_t io_arg, q2proto_inf
     if (io_ctx->is_inflate())
         return Q2P_ERR_INVALID_ARGUMENT;
 
-    auto *new_ctx = new inflate_io_context;
+    auto *new_ctx = new inflate_io_context(io_ctx);
     q2proto_error_t err = q2proto_inflate_impl_helper_begin(header_mode, &new_ctx->z);
+    io_ctx->num_inflates++;
+    io_ctx->active_inflate = new_ctx;
 
     *inflate_io_arg = reinterpret_cast<uintptr_t>(new_ctx);
     return err;
@@ -182,6 +185,7 @@ extern "C" q2proto_error_t q2protoio_inflate_data(uintptr_t io_arg, uintptr_t in
                                                            &inflate_io_ctx->buffer, sizeof(inflate_io_ctx->buffer),
                                                            &uncompressed_size, &inflate_io_ctx->stream_end);
 
+    inflate_io_ctx->parent->inflated_bytes_done += inflate_io_ctx->pos;
     inflate_io_ctx->size = uncompressed_size;
     inflate_io_ctx->pos = 0;
 
@@ -205,58 +209,9 @@ extern "C" q2proto_error_t q2protoio_inflate_end(uintptr_t inflate_io_arg)
     q2proto_error_t err = q2proto_inflate_impl_helper_end(&inflate_io_ctx->z);
     if (err == Q2P_ERR_SUCCESS)
         err = inflate_io_ctx->pos < inflate_io_ctx->size ? Q2P_ERR_MORE_DATA_DEFLATED : Q2P_ERR_SUCCESS;
+    inflate_io_ctx->parent->inflated_bytes_done += inflate_io_ctx->pos;
+    if (inflate_io_ctx->parent->active_inflate == inflate_io_ctx)
+        inflate_io_ctx->parent->active_inflate = nullptr;
     delete inflate_io_ctx;
     return err;
 }
-
-#if 0
-void Q2PROTO_deflate_args_init(q2protoio_deflate_args_t *deflate_args, byte *buffer, unsigned buffer_size, memtag_t z_stream_tag)
-{
-    q2proto_deflate_impl_helper_init(&deflate_args->defl, NULL, buffer, buffer_size);
-}
-
-void Q2PROTO_deflate_args_destroy(q2protoio_deflate_args_t *deflate_args)
-{
-    q2proto_deflate_impl_helper_destroy(&deflate_args->defl);
-}
-
-q2proto_error_t q2protoio_deflate_begin(q2protoio_deflate_args_t* deflate_args, size_t max_deflated, q2proto_inflate_deflate_header_mode_t header_mode, uintptr_t *deflate_io_arg)
-{
-    Q_assert(!deflate_q2protoio_ioarg.deflate);
-
-    q2proto_error_t err = q2proto_deflate_impl_helper_begin(&deflate_args->defl, header_mode, deflate_buf);
-    if (err != Q2P_ERR_SUCCESS)
-        return err;
-
-    SZ_InitWrite(&msg_deflate, deflate_buf, MAX_MSGLEN);
-
-    deflate_q2protoio_ioarg.max_msg_len = max_deflated;
-    deflate_q2protoio_ioarg.deflate = deflate_args;
-    *deflate_io_arg = IOARG_DEFLATE;
-
-    return Q2P_ERR_SUCCESS;
-}
-
-q2proto_error_t q2protoio_deflate_get_data(uintptr_t deflate_io_arg, q2proto_deflate_stream_mode_t stream_mode, size_t *in_size, const void **out, size_t *out_size)
-{
-    q2protoio_ioarg_t *io_data = (q2protoio_ioarg_t *)deflate_io_arg;
-    q2protoio_deflate_args_t *deflate_args = io_data->deflate;
-
-    q2proto_error_t err = q2proto_deflate_impl_helper_get_data(&deflate_args->defl, msg_deflate.cursize, stream_mode, in_size, out, out_size, deflate_buf);
-    if (err != Q2P_ERR_SUCCESS)
-        return err;
-
-    SZ_Clear(&msg_deflate);
-
-    return Q2P_ERR_SUCCESS;
-}
-
-q2proto_error_t q2protoio_deflate_end(uintptr_t deflate_io_arg)
-{
-    q2protoio_ioarg_t *io_data = (q2protoio_ioarg_t *)deflate_io_arg;
-
-    io_data->deflate = NULL;
-
-    return Q2P_ERR_SUCCESS;
-}
-#endif
@@ -31,12 +31,25 @@ struct io_context
     uint32_t pos = 0;
     q2proto_error_t err = Q2P_ERR_SUCCESS;
 
+    /**\name Data decompressed from this context
+     * @{ */
+    /// Number of inflate contexts started
+    uint32_t num_inflates = 0;
+    /// Bytes read from finished inflate contexts
+    uint64_t inflated_bytes_done = 0;
+    /// Currently active inflate context, if any
+    io_context *active_inflate = nullptr;
+    /** @} */
+
     io_context(const std::byte *data, uint32_t size) : data(data), size(size) {}
     io_context(io_context &&) = delete;
     io_context(const io_context &) = delete;
     virtual ~io_context() {}
     virtual bool is_inflate() const { return false; }
 
+    /// Total number of bytes read from data decompressed from this context
+    uint64_t inflated_bytes() const { return inflated_bytes_done + (active_inflate ? active_inflate->pos : 0); }
+
     io_context& operator=(io_context &&) = delete;
     io_context& operator=(const io_context &) = delete;
 };
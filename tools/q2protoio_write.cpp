@@ -0,0 +1,138 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "q2protoio_write.hpp"
+
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include <fmt/format.h>
+
+static inline void q2p_inflate_deflate_error(const char* message, int z_error)
+{
+    fmt::println(stderr, "{}: {}", message, zError(z_error));
+}
+
+extern "C" {
+#include "q2proto/q2proto_deflate_impl_helper.inc"
+} // extern "C"
+
+static std::byte *context_reserve(write_io_context *io_ctx, size_t size)
+{
+    if (io_ctx->buffer.size() - io_ctx->size < size) {
+        io_ctx->err = Q2P_ERR_NOT_ENOUGH_PACKET_SPACE;
+        return nullptr;
+    }
+    auto *p = io_ctx->buffer.data() + io_ctx->size;
+    io_ctx->size += size;
+    return p;
+}
+
+template<typename T>
+static void context_write(uintptr_t io_arg, T x)
+{
+    auto *io_ctx = reinterpret_cast<write_io_context *>(io_arg);
+    if constexpr (std::endian::native != std::endian::little)
+        x = std::byteswap(x);
+    if (auto *p = context_reserve(io_ctx, sizeof(x)))
+        memcpy(p, &x, sizeof(x));
+}
+
+extern "C" void q2protoio_write_u8(uintptr_t io_arg, uint8_t x) { context_write(io_arg, x); }
+extern "C" void q2protoio_write_u16(uintptr_t io_arg, uint16_t x) { context_write(io_arg, x); }
+extern "C" void q2protoio_write_u32(uintptr_t io_arg, uint32_t x) { context_write(io_arg, x); }
+extern "C" void q2protoio_write_u64(uintptr_t io_arg, uint64_t x) { context_write(io_arg, x); }
+
+extern "C" void *q2protoio_write_reserve_raw(uintptr_t io_arg, size_t size)
+{
+    auto *io_ctx = reinterpret_cast<write_io_context *>(io_arg);
+    return context_reserve(io_ctx, size);
+}
+
+extern "C" void q2protoio_write_raw(uintptr_t io_arg, const void *data, size_t size, size_t *written)
+{
+    auto *io_ctx = reinterpret_cast<write_io_context *>(io_arg);
+    if (written)
+        size = std::min(size, io_ctx->buffer.size() - io_ctx->size);
+    auto *p = context_reserve(io_ctx, size);
+    if (p)
+        memcpy(p, data, size);
+    if (written)
+        *written = p ? size : 0;
+}
+
+extern "C" size_t q2protoio_write_available(uintptr_t io_arg)
+{
+    auto *io_ctx = reinterpret_cast<write_io_context *>(io_arg);
+    if (io_ctx->deflate)
+        return q2proto_deflate_impl_helper_remaining(&io_ctx->deflate->defl, io_ctx->size, io_ctx->max_deflated);
+    return io_ctx->buffer.size() - io_ctx->size;
+}
+
+q2protoio_deflate_args_s::q2protoio_deflate_args_s(uint32_t max_size)
+    : z_buffer(compressBound(max_size)), io(max_size)
+{
+    q2proto_deflate_impl_helper_init(&defl, nullptr, z_buffer.data(), z_buffer.size());
+}
+
+q2protoio_deflate_args_s::~q2protoio_deflate_args_s() { q2proto_deflate_impl_helper_destroy(&defl); }
+
+extern "C" q2proto_error_t q2protoio_deflate_begin(q2protoio_deflate_args_t *deflate_args, size_t max_deflated,
+                                                   q2proto_inflate_deflate_header_mode_t header_mode,
+                                                   uintptr_t *deflate_io_arg)
+{
+    // One stream per deflate_args: using it for multiple streams at the same time is an error
+    if (deflate_args->io.deflate)
+        return Q2P_ERR_INVALID_ARGUMENT;
+
+    q2proto_error_t err = q2proto_deflate_impl_helper_begin(&deflate_args->defl, header_mode, deflate_args->io.data);
+    if (err != Q2P_ERR_SUCCESS)
+        return err;
+
+    deflate_args->io.clear();
+    deflate_args->io.deflate = deflate_args;
+    deflate_args->io.max_deflated = max_deflated;
+    *deflate_io_arg = reinterpret_cast<uintptr_t>(&deflate_args->io);
+    return Q2P_ERR_SUCCESS;
+}
+
+extern "C" q2proto_error_t q2protoio_deflate_get_data(uintptr_t deflate_io_arg,
+                                                      q2proto_deflate_stream_mode_t stream_mode, size_t *in_size,
+                                                      const void **out, size_t *out_size)
+{
+    auto *io_ctx = reinterpret_cast<write_io_context *>(deflate_io_arg);
+    if (!io_ctx->deflate)
+        return Q2P_ERR_INVALID_ARGUMENT;
+
+    q2proto_error_t err = q2proto_deflate_impl_helper_get_data(&io_ctx->deflate->defl, io_ctx->size, stream_mode,
+                                                               in_size, out, out_size, io_ctx->data);
+    if (err != Q2P_ERR_SUCCESS)
+        return err;
+
+    io_ctx->clear();
+    return Q2P_ERR_SUCCESS;
+}
+
+extern "C" q2proto_error_t q2protoio_deflate_end(uintptr_t deflate_io_arg)
+{
+    auto *io_ctx = reinterpret_cast<write_io_context *>(deflate_io_arg);
+    if (!io_ctx->deflate)
+        return Q2P_ERR_INVALID_ARGUMENT;
+    io_ctx->deflate = nullptr;
+    return Q2P_ERR_SUCCESS;
+}
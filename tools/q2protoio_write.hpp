@@ -0,0 +1,71 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef Q2PROTOIO_WRITE_HPP_
+#define Q2PROTOIO_WRITE_HPP_
+
+#include "q2protoio.hpp"
+
+#include <span>
+#include <vector>
+
+#include <zlib.h>
+
+#include "q2proto/q2proto.h"
+extern "C" {
+#include "q2proto/q2proto_deflate_impl_helper.h"
+}
+
+/* Output I/O context.
+ * Can be used from multiple threads, as long as each thread uses its own context.
+ * Note: derived from io_context so q2protoio_get_error() works uniformly. */
+struct write_io_context : public io_context
+{
+    std::vector<std::byte> buffer;
+    // Set if this context receives data to be deflated
+    q2protoio_deflate_args_t *deflate = nullptr;
+    // Maximum size of deflated data
+    size_t max_deflated = 0;
+
+    explicit write_io_context(uint32_t max_size) : io_context(nullptr, 0), buffer(max_size) { data = buffer.data(); }
+
+    void clear()
+    {
+        size = 0;
+        err = Q2P_ERR_SUCCESS;
+    }
+    std::span<const std::byte> written() const { return {buffer.data(), size}; }
+};
+
+/* Deflate arguments.
+ * Each instance holds the state of one deflate stream, so concurrent encoding needs one instance per thread. */
+struct q2protoio_deflate_args_s
+{
+    q2proto_deflate_impl_helper_args_t defl;
+    std::vector<std::byte> z_buffer;
+    // Receives uncompressed data
+    write_io_context io;
+
+    explicit q2protoio_deflate_args_s(uint32_t max_size);
+    ~q2protoio_deflate_args_s();
+
+    q2protoio_deflate_args_s(const q2protoio_deflate_args_s &) = delete;
+    q2protoio_deflate_args_s &operator=(const q2protoio_deflate_args_s &) = delete;
+};
+
+#endif // Q2PROTOIO_WRITE_HPP_
@@ -0,0 +1,110 @@
+/*
+Copyright (C) 2026 Frank Richter
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/* Helpers shared by the tools: error reporting, file I/O, game API selection */
+
+#ifndef TOOLUTIL_HPP_
+#define TOOLUTIL_HPP_
+
+#include "q2proto/q2proto.h"
+
+#include "expected.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <fmt/format.h>
+#include <optional>
+#include <string_view>
+#include <system_error>
+
+// Print stdio error
+template<typename... T>
+static inline int print_io_error(int code, fmt::format_string<T...> fmt, T&&... args)
+{
+    auto ec = std::make_error_code(static_cast<std::errc>(code));
+    fmt::print(stderr, fmt, std::forward<T>(args)...);
+    fmt::println(stderr, ": {:s}", ec);
+    return ec.value();
+}
+
+// Print q2proto error
+template<typename... T>
+static inline void print_q2proto_error(q2proto_error_t err, fmt::format_string<T...> fmt, T&&... args)
+{
+    fmt::print(stderr, fmt, std::forward<T>(args)...);
+    fmt::println(stderr, ": {}", q2proto_error_string(err));
+}
+
+// Check result of a q2proto call
+template<typename... T>
+static inline bool check_q2proto_result(q2proto_error_t result, fmt::format_string<T...> fmt, T&&... args)
+{
+    if (result != Q2P_ERR_SUCCESS) {
+        print_q2proto_error(result, std::move(fmt), std::forward<T>(args)...);
+        return false;
+    }
+    return true;
+}
+
+// Read exactly 'size' bytes from a file
+static inline nonstd::expected<void, int> read_file(FILE* f, void* buf, size_t size)
+{
+    if (size == 0)
+        return {};
+    size_t num_read = fread(buf, size, 1, f);
+    if (num_read != 1) {
+        if (feof(f)) {
+            fmt::println(stderr, "unexpected end of file");
+            return nonstd::make_unexpected(-2);
+        } else
+            return nonstd::make_unexpected(print_io_error(errno, "read error"));
+    }
+    return {};
+}
+
+// Write exactly 'size' bytes to a file
+static inline nonstd::expected<void, int> write_file(FILE* f, const void* buf, size_t size)
+{
+    if (size > 0 && fwrite(buf, size, 1, f) != 1)
+        return nonstd::make_unexpected(print_io_error(errno, "write error"));
+    return {};
+}
+
+// Parse a decimal number, failing unless all of 'str' is consumed and the value fits into 'value'
+template<typename T>
+static inline bool parse_number(std::string_view str, T& value)
+{
+    auto [end, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+    return ec == std::errc() && end == str.data() + str.size();
+}
+
+// Pick the most capable game API supported by a protocol
+static inline std::optional<q2proto_game_api_t> most_capable_game_api(q2proto_protocol_t protocol)
+{
+    for (int api = Q2PROTO_GAME_RERELEASE; api >= Q2PROTO_GAME_VANILLA; api--) {
+        auto candidate = q2proto_game_api_t(api);
+        q2proto_protocol_t protocols[Q2P_NUM_PROTOCOLS];
+        size_t num_protocols = q2proto_get_protocols_for_gametypes(protocols, Q2P_NUM_PROTOCOLS, &candidate, 1);
+        if (std::ranges::find(protocols, protocols + num_protocols, protocol) != protocols + num_protocols)
+            return candidate;
+    }
+    return std::nullopt;
+}
+
+#endif // TOOLUTIL_HPP_